@@ -16,6 +16,7 @@
  *
  ******************************************************************************/
 
+#include <string.h>
 #include "bt_trace.h"
 #include "allocator.h"
 #include "gki_int.h"
@@ -27,10 +28,16 @@
 ** Description      Internal function called at startup to initialize a free
 **                  queue. It is called once for each free queue.
 **
+** Parameters       id       - pool ID
+**                  size     - size of the buffers in the pool
+**                  total    - number of buffers the pool may have in use
+**                  prealloc - number of buffers in p_mem
+**                  p_mem    - memory of the preallocated buffers, or NULL
+**
 ** Returns          void
 **
 *******************************************************************************/
-static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_mem)
+static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, UINT16 prealloc, void *p_mem)
 {
     UINT16           i;
     UINT16           act_size;
@@ -47,7 +54,7 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
     /* Remember pool start and end addresses */
     if (p_mem) {
         p_cb->pool_start[id] = (UINT8 *)p_mem;
-        p_cb->pool_end[id]   = (UINT8 *)p_mem + (act_size * total);
+        p_cb->pool_end[id]   = (UINT8 *)p_mem + (act_size * prealloc);
     }
 
     p_cb->pool_size[id]  = act_size;
@@ -56,12 +63,14 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
     p_cb->freeq[id].total     = total;
     p_cb->freeq[id].cur_cnt   = 0;
     p_cb->freeq[id].max_cnt   = 0;
+    p_cb->freeq[id].prealloc  = p_mem ? prealloc : 0;
+    p_cb->freeq[id].heap_cnt  = 0;
 
     /* Initialize  index table */
     if (p_mem) {
         hdr = (BUFFER_HDR_T *)p_mem;
         p_cb->freeq[id]._p_first = hdr;
-        for (i = 0; i < total; i++) {
+        for (i = 0; i < prealloc; i++) {
             hdr->q_id    = id;
             hdr->status  = BUF_STATUS_FREE;
             magic        = (UINT32 *)((UINT8 *)hdr + BUFFER_HDR_SIZE + tempsize);
@@ -81,19 +90,21 @@ void gki_buffer_cleanup(void)
     tGKI_COM_CB *p_cb = &gki_cb.com;
 
     for (i = 0; i < GKI_NUM_FIXED_BUF_POOLS; i++) {
-        if ( 0 < p_cb->freeq[i].max_cnt ) {
+        if (p_cb->pool_start[i]) {
             osi_free(p_cb->pool_start[i]);
+        }
 
-            p_cb->freeq[i].cur_cnt   = 0;
-            p_cb->freeq[i].max_cnt   = 0;
-            p_cb->freeq[i]._p_first   = NULL;
-            p_cb->freeq[i]._p_last    = NULL;
+        p_cb->freeq[i].cur_cnt   = 0;
+        p_cb->freeq[i].max_cnt   = 0;
+        p_cb->freeq[i].prealloc  = 0;
+        p_cb->freeq[i]._p_first   = NULL;
+        p_cb->freeq[i]._p_last    = NULL;
 
-            p_cb->pool_start[i] = NULL;
-            p_cb->pool_end[i]   = NULL;
-            p_cb->pool_size[i]  = 0;
-        }
+        p_cb->pool_start[i] = NULL;
+        p_cb->pool_end[i]   = NULL;
+        p_cb->pool_size[i]  = 0;
     }
+    p_cb->num_public_pools = 0;
 }
 
 /*******************************************************************************
@@ -111,17 +122,18 @@ void gki_buffer_init(void)
     static const struct {
         uint16_t size;
         uint16_t count;
+        uint16_t prealloc;
     } buffer_info[GKI_NUM_FIXED_BUF_POOLS] = {
-        { GKI_BUF0_SIZE, GKI_BUF0_MAX },
-        { GKI_BUF1_SIZE, GKI_BUF1_MAX },
-        { GKI_BUF2_SIZE, GKI_BUF2_MAX },
-        { GKI_BUF3_SIZE, GKI_BUF3_MAX },
-        { GKI_BUF4_SIZE, GKI_BUF4_MAX },
-        { GKI_BUF5_SIZE, GKI_BUF5_MAX },
-        { GKI_BUF6_SIZE, GKI_BUF6_MAX },
-        { GKI_BUF7_SIZE, GKI_BUF7_MAX },
-        { GKI_BUF8_SIZE, GKI_BUF8_MAX },
-        { GKI_BUF9_SIZE, GKI_BUF9_MAX },
+        { GKI_BUF0_SIZE, GKI_BUF0_MAX, GKI_BUF0_PREALLOC },
+        { GKI_BUF1_SIZE, GKI_BUF1_MAX, GKI_BUF1_PREALLOC },
+        { GKI_BUF2_SIZE, GKI_BUF2_MAX, GKI_BUF2_PREALLOC },
+        { GKI_BUF3_SIZE, GKI_BUF3_MAX, GKI_BUF3_PREALLOC },
+        { GKI_BUF4_SIZE, GKI_BUF4_MAX, GKI_BUF4_PREALLOC },
+        { GKI_BUF5_SIZE, GKI_BUF5_MAX, GKI_BUF5_PREALLOC },
+        { GKI_BUF6_SIZE, GKI_BUF6_MAX, GKI_BUF6_PREALLOC },
+        { GKI_BUF7_SIZE, GKI_BUF7_MAX, GKI_BUF7_PREALLOC },
+        { GKI_BUF8_SIZE, GKI_BUF8_MAX, GKI_BUF8_PREALLOC },
+        { GKI_BUF9_SIZE, GKI_BUF9_MAX, GKI_BUF9_PREALLOC },
     };
 
     tGKI_COM_CB *p_cb = &gki_cb.com;
@@ -137,13 +149,33 @@ void gki_buffer_init(void)
         p_cb->freeq[i].total   = 0;
         p_cb->freeq[i].cur_cnt = 0;
         p_cb->freeq[i].max_cnt = 0;
+        p_cb->freeq[i].prealloc = 0;
+        p_cb->freeq[i].heap_cnt = 0;
     }
 
     /* Use default from target.h */
     p_cb->pool_access_mask = GKI_DEF_BUFPOOL_PERM_MASK;
 
     for (int i = 0; i < GKI_NUM_FIXED_BUF_POOLS; ++i) {
-        gki_init_free_queue(i, buffer_info[i].size, buffer_info[i].count, NULL);
+        void *p_mem = NULL;
+        if (buffer_info[i].prealloc) {
+            /* Without the memory the pool works from the heap only */
+            p_mem = osi_malloc((ALIGN_POOL(buffer_info[i].size) + BUFFER_PADDING_SIZE) * buffer_info[i].prealloc);
+        }
+        gki_init_free_queue(i, buffer_info[i].size, buffer_info[i].count, buffer_info[i].prealloc, p_mem);
+    }
+
+    /* Sort the public pools by size, so that GKI_getbuf takes the first one which fits */
+    p_cb->num_public_pools = 0;
+    for (int i = 0; i < GKI_NUM_FIXED_BUF_POOLS; ++i) {
+        if (p_cb->pool_access_mask & (1 << i)) {
+            continue;
+        }
+        int j = p_cb->num_public_pools++;
+        for (; j > 0 && p_cb->freeq[p_cb->public_pools[j - 1]].size > p_cb->freeq[i].size; --j) {
+            p_cb->public_pools[j] = p_cb->public_pools[j - 1];
+        }
+        p_cb->public_pools[j] = i;
     }
 }
 
@@ -162,6 +194,71 @@ void GKI_init_q (BUFFER_Q *p_q)
     p_q->_count = 0;
 }
 
+/*******************************************************************************
+**
+** Function         gki_alloc_buffer
+**
+** Description      Internal function to get a buffer of the given size
+**                  from a pool. The buffer is taken from the free queue of
+**                  the pool, or from the heap if the free queue is empty.
+**
+** Parameters       pool_id - pool ID, or GKI_INVALID_POOL for a buffer
+**                            which is too large for the public pools
+**                  size    - number of bytes needed
+**
+** Returns          A pointer to the buffer, or NULL if none available
+**
+*******************************************************************************/
+static void *gki_alloc_buffer(UINT8 pool_id, UINT16 size)
+{
+    BUFFER_HDR_T *header = NULL;
+    FREE_QUEUE_T *Q;
+
+    if (pool_id != GKI_INVALID_POOL) {
+        Q = &gki_cb.com.freeq[pool_id];
+
+        GKI_disable();
+        header = Q->_p_first;
+        if (header) {
+            Q->_p_first = header->p_next;
+            if (!Q->_p_first) {
+                Q->_p_last = NULL;
+            }
+        } else {
+            Q->heap_cnt++;
+        }
+        if (++Q->cur_cnt > Q->max_cnt) {
+            Q->max_cnt = Q->cur_cnt;
+        }
+        GKI_enable();
+
+        if (header) {
+            /* Buffers from the heap are zeroed, keep pool buffers the same */
+            memset(header + 1, 0, size);
+        }
+    }
+
+    if (!header) {
+        header = osi_malloc(size + BUFFER_HDR_SIZE);
+        if (!header) {
+            if (pool_id != GKI_INVALID_POOL) {
+                GKI_disable();
+                gki_cb.com.freeq[pool_id].cur_cnt--;
+                GKI_enable();
+            }
+            return NULL;
+        }
+        header->q_id = pool_id;
+    }
+
+    header->status  = BUF_STATUS_UNLINKED;
+    header->p_next  = NULL;
+    header->Type    = 0;
+    header->size = size;
+
+    return header + 1;
+}
+
 /*******************************************************************************
 **
 ** Function         GKI_getbuf_func
@@ -171,7 +268,8 @@ void GKI_init_q (BUFFER_Q *p_q)
 **
 **                  Note: This routine only takes buffers from public pools.
 **                        It will not use any buffers from pools
-**                        marked GKI_RESTRICTED_POOL.
+**                        marked GKI_RESTRICTED_POOL. Buffers larger than
+**                        the largest public pool are taken from the heap.
 **
 ** Parameters       size - (input) number of bytes needed.
 **
@@ -180,13 +278,17 @@ void GKI_init_q (BUFFER_Q *p_q)
 *******************************************************************************/
 void *GKI_getbuf_func(UINT16 size)
 {
-    BUFFER_HDR_T *header = osi_malloc(size + BUFFER_HDR_SIZE);
-    header->status  = BUF_STATUS_UNLINKED;
-    header->p_next  = NULL;
-    header->Type    = 0;
-    header->size = size;
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+    UINT8 pool_id = GKI_INVALID_POOL;
 
-    return header + 1;
+    for (int i = 0; i < p_cb->num_public_pools; i++) {
+        if (size <= p_cb->freeq[p_cb->public_pools[i]].size) {
+            pool_id = p_cb->public_pools[i];
+            break;
+        }
+    }
+
+    return gki_alloc_buffer(pool_id, size);
 }
 
 /*******************************************************************************
@@ -197,7 +299,7 @@ void *GKI_getbuf_func(UINT16 size)
 **                  a specific buffer pool.
 **
 **                  Note: If there are no more buffers available from the pool,
-**                        the public buffers are searched for an available buffer.
+**                        the buffer is taken from the heap.
 **
 ** Parameters       pool_id - (input) pool ID to get a buffer out of.
 **
@@ -206,7 +308,11 @@ void *GKI_getbuf_func(UINT16 size)
 *******************************************************************************/
 void *GKI_getpoolbuf_func(UINT8 pool_id)
 {
-    return GKI_getbuf_func(gki_cb.com.pool_size[pool_id]);
+    if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS) {
+        return (NULL);
+    }
+
+    return gki_alloc_buffer(pool_id, gki_cb.com.freeq[pool_id].size);
 }
 
 /*******************************************************************************
@@ -222,7 +328,36 @@ void *GKI_getpoolbuf_func(UINT8 pool_id)
 *******************************************************************************/
 void GKI_freebuf (void *p_buf)
 {
-    osi_free((BUFFER_HDR_T *)p_buf - 1);
+    BUFFER_HDR_T *p_hdr = (BUFFER_HDR_T *)p_buf - 1;
+    UINT8 pool_id = p_hdr->q_id;
+    FREE_QUEUE_T *Q;
+
+    if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS) {
+        osi_free(p_hdr);
+        return;
+    }
+
+    Q = &gki_cb.com.freeq[pool_id];
+
+    if ((UINT8 *)p_hdr >= gki_cb.com.pool_start[pool_id] && (UINT8 *)p_hdr < gki_cb.com.pool_end[pool_id]) {
+        assert(p_hdr->status != BUF_STATUS_FREE);
+        p_hdr->status = BUF_STATUS_FREE;
+
+        GKI_disable();
+        p_hdr->p_next = Q->_p_first;
+        if (!Q->_p_first) {
+            Q->_p_last = p_hdr;
+        }
+        Q->_p_first = p_hdr;
+        Q->cur_cnt--;
+        GKI_enable();
+    } else {
+        GKI_disable();
+        Q->cur_cnt--;
+        GKI_enable();
+
+        osi_free(p_hdr);
+    }
 }
 
 /*******************************************************************************
@@ -494,6 +629,10 @@ UINT16 GKI_poolfreecount (UINT8 pool_id)
 
     Q  = &gki_cb.com.freeq[pool_id];
 
+    if (Q->cur_cnt >= Q->total) {
+        return (0);
+    }
+
     return ((UINT16)(Q->total - Q->cur_cnt));
 }
 
@@ -539,9 +678,31 @@ UINT16 GKI_poolutilization (UINT8 pool_id)
 
     Q  = &gki_cb.com.freeq[pool_id];
 
-    if (Q->total == 0) {
+    if (Q->total == 0 || Q->cur_cnt >= Q->total) {
         return (100);
     }
 
     return ((Q->cur_cnt * 100) / Q->total);
 }
+
+/*******************************************************************************
+**
+** Function         GKI_poolheapcount
+**
+** Description      Called by an application to get the number of buffers of
+**                  the specified pool which were taken from the heap because
+**                  all preallocated buffers were in use.
+**
+** Parameters       pool_id - (input) pool ID to get the count of.
+**
+** Returns          the number of buffers taken from the heap since startup
+**
+*******************************************************************************/
+UINT32 GKI_poolheapcount (UINT8 pool_id)
+{
+    if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS) {
+        return (0);
+    }
+
+    return (gki_cb.com.freeq[pool_id].heap_cnt);
+}
@@ -66,6 +66,8 @@ typedef struct {
 #define GKI_PUBLIC_POOL         0       /* General pool accessible to GKI_getbuf() */
 #define GKI_RESTRICTED_POOL     1       /* Inaccessible pool to GKI_getbuf() */
 
+#define GKI_INVALID_POOL        0xFF    /* q_id of buffers which don't belong to a pool */
+
 /***********************************************************************
 ** Function prototypes
 */
@@ -80,6 +82,7 @@ void   *GKI_getpoolbuf (UINT8);
 UINT16  GKI_poolcount (UINT8);
 UINT16  GKI_poolfreecount (UINT8);
 UINT16  GKI_poolutilization (UINT8);
+UINT32  GKI_poolheapcount (UINT8);
 
 #ifdef CONFIG_BLUEDROID_MEM_DEBUG
 
@@ -88,6 +91,7 @@ UINT16  GKI_poolutilization (UINT8);
     BUFFER_HDR_T *header = osi_malloc((_size) + BUFFER_HDR_SIZE);      \
     header->status  = BUF_STATUS_UNLINKED;                          \
     header->p_next  = NULL;                                         \
+    header->q_id    = GKI_INVALID_POOL;                             \
     header->Type    = 0;                                            \
     header->size = (_size);                                          \
     (void *)(header + 1);                                                   \
@@ -95,7 +99,7 @@ UINT16  GKI_poolutilization (UINT8);
 
 #define GKI_getpoolbuf(_pool_id)                                     \
 ({                                                                  \
-    (void *)GKI_getbuf(gki_cb.com.pool_size[(_pool_id)]);                    \
+    (void *)GKI_getbuf(gki_cb.com.freeq[(_pool_id)].size);                   \
 })
            
 #else
@@ -36,6 +36,8 @@ typedef struct _free_queue {
     UINT16       total;            /* toatal number of buffers */
     UINT16       cur_cnt;          /* number of  buffers currently allocated */
     UINT16       max_cnt;          /* maximum number of buffers allocated at any time */
+    UINT16       prealloc;         /* number of buffers preallocated in the pool memory */
+    UINT32       heap_cnt;         /* number of buffers taken from the heap because the pool was empty */
 } FREE_QUEUE_T;
 
 /* Put all GKI variables into one control block
@@ -55,6 +57,10 @@ typedef struct {
 
     /* Define the buffer pool access control variables */
     UINT16      pool_access_mask;                   /* Bits are set if the corresponding buffer pool is a restricted pool */
+
+    /* Public pools sorted by buffer size, searched by GKI_getbuf */
+    UINT8       public_pools[GKI_NUM_TOTAL_BUF_POOLS];
+    UINT8       num_public_pools;
 } tGKI_COM_CB;
 
 /* Internal GKI function prototypes
@@ -231,6 +231,52 @@ over HCI data and intentionally kept out of order */
 #define GKI_BUF9_MAX           5
 #endif
 
+/* The number of buffers preallocated in each pool when GKI starts.
+** GKI_BUFx_MAX is the number of buffers a pool may have in use, which is
+** what GKI_poolutilization reports against. Only the buffers preallocated
+** here take RAM up front; when they are all in use, further buffers of the
+** pool come from the heap. Pools used for every HCI command and event are
+** preallocated, the large and rarely used pools are not. */
+#ifndef GKI_BUF0_PREALLOC
+#define GKI_BUF0_PREALLOC           16
+#endif
+
+#ifndef GKI_BUF1_PREALLOC
+#define GKI_BUF1_PREALLOC           8
+#endif
+
+#ifndef GKI_BUF2_PREALLOC
+#define GKI_BUF2_PREALLOC           4
+#endif
+
+#ifndef GKI_BUF3_PREALLOC
+#define GKI_BUF3_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF4_PREALLOC
+#define GKI_BUF4_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF5_PREALLOC
+#define GKI_BUF5_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF6_PREALLOC
+#define GKI_BUF6_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF7_PREALLOC
+#define GKI_BUF7_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF8_PREALLOC
+#define GKI_BUF8_PREALLOC           0
+#endif
+
+#ifndef GKI_BUF9_PREALLOC
+#define GKI_BUF9_PREALLOC           0
+#endif
+
 /* The number of fixed and dynamic buffer pools */
 #ifndef GKI_NUM_TOTAL_BUF_POOLS
 #define GKI_NUM_TOTAL_BUF_POOLS     10
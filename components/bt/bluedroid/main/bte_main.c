@@ -144,7 +144,10 @@ int bte_main_boot_entry(bluedroid_init_done_cb_t cb)
     //data_dispatcher_register_default(hci->event_dispatcher, btu_hci_msg_queue);
     hci->set_data_queue(btu_hci_msg_queue);
 
-    osi_alarm_init();
+    if (osi_alarm_init()) {
+        LOG_ERROR("%s unable to start the alarm service.\n", __func__);
+        return -4;
+    }
 
 #if (defined(BLE_INCLUDED) && (BLE_INCLUDED == TRUE))
     //bte_load_ble_conf(BTE_BLE_STACK_CONF_FILE);
@@ -185,6 +188,7 @@ void bte_main_shutdown(void)
     BTA_VendorCleanup();
 #endif
     bte_main_disable();
+    osi_alarm_deinit();
     gki_clean_up();
 }
 
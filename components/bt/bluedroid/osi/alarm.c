@@ -21,8 +21,9 @@
 #include "bt_defs.h"
 #include "bt_trace.h"
 #include "alarm.h"
+#include "alarm_wheel.h"
 #include "allocator.h"
-#include "list.h"
+#include "osi_arch.h"
 #include "thread.h"
 #include "freertos/FreeRTOSConfig.h"
 #include "freertos/xtensa_api.h"
@@ -30,77 +31,212 @@
 
 #define RTC_TIMER_TICKS_TO_MS(ticks)            (((ticks/625)<<1) + (ticks-(ticks/625)*625)/312)
 
+// Resolution of the timer wheel
+#define ALARM_WHEEL_TICK_MS         10
+
+enum {
+    ALARM_STATE_IDLE,       // not set
+    ALARM_STATE_SET,        // in the timer wheel
+    ALARM_STATE_EXPIRED,    // in the expired list, waiting for the BTU task
+};
+
+struct alarm_t {
+    alarm_wheel_entry_t entry;  // must be first, entries are cast to alarms
+    osi_alarm_callback_t cb;
+    void *cb_data;
+    uint8_t state;
+};
+
+// Everything below is protected by alarm_lock
+static osi_mutex_t alarm_lock;
+static alarm_wheel_t *alarm_wheel;
+static alarm_wheel_list_t alarm_expired;
+static TimerHandle_t alarm_timer;
+static bool alarm_timer_running;
+static uint32_t alarm_timer_tick;           // wheel tick the timer is set for
+static bool alarm_dispatch_posted;          // SIG_BTU_ALARM is in the BTU queue
+static osi_alarm_t *alarm_dispatching;      // alarm whose callback is running
+static TaskHandle_t alarm_dispatch_task;    // task which runs the callbacks
+static uint64_t alarm_time_ms;              // time since start of the service
+static TickType_t alarm_last_os_tick;
+
+static void alarm_timer_cb(TimerHandle_t xTimer);
+
+// Updates alarm_time_ms and returns the current wheel tick
+static uint32_t alarm_update_time(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    alarm_time_ms += (uint64_t)(TickType_t)(now - alarm_last_os_tick) * portTICK_PERIOD_MS;
+    alarm_last_os_tick = now;
+    return (uint32_t)(alarm_time_ms / ALARM_WHEEL_TICK_MS);
+}
 
-#define BT_ALARM_START_WAIT_TICKS   100
-#define BT_ALARM_STOP_WAIT_TICKS    100
-#define BT_ALARM_FREE_WAIT_TICKS    100
-#define BT_ALARM_CHG_PERIOD_WAIT_TICKS  100
+// Sets the timer to fire when the wheel has to process its next tick, or on
+// the next tick if |force| is set and the wheel is empty. Unless |force| is
+// set, a running timer is only changed to make it fire earlier.
+// Timer commands are sent without waiting while alarm_lock is held, so the
+// timer daemon executes them in the order they were decided in.
+static void alarm_schedule(bool force)
+{
+    uint32_t now = (uint32_t)(alarm_time_ms / ALARM_WHEEL_TICK_MS);
+    uint32_t tick;
+    uint32_t delay_ms;
+    TickType_t period;
+
+    if (alarm_wheel_is_empty(alarm_wheel)) {
+        if (!force) {
+            return;
+        }
+        tick = now + 1;
+    } else {
+        tick = alarm_wheel->now + alarm_wheel_ticks_to_next(alarm_wheel);
+    }
 
-static struct alarm_t alarm_cbs[ALARM_CBS_NUM];
+    if (alarm_timer_running && !force && (int32_t)(tick - alarm_timer_tick) >= 0) {
+        return;
+    }
+
+    delay_ms = 0;
+    if ((int32_t)(tick - now) > 0) {
+        delay_ms = (tick - now) * ALARM_WHEEL_TICK_MS - (uint32_t)(alarm_time_ms % ALARM_WHEEL_TICK_MS);
+    }
+    period = (delay_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    if (period == 0) {
+        period = 1;
+    }
+
+    if (xTimerChangePeriod(alarm_timer, period, 0) != pdPASS) {
+        LOG_ERROR("%s unable to set timer\n", __func__);
+        alarm_timer_running = false;
+        return;
+    }
+    alarm_timer_running = true;
+    alarm_timer_tick = tick;
+}
 
-void osi_alarm_init(void)
+// Removes |alarm| from the wheel or the expired list
+static void alarm_unlink(osi_alarm_t *alarm)
 {
-    memset(&alarm_cbs[0], 0x00, sizeof(alarm_cbs));
+    if (alarm->state == ALARM_STATE_SET) {
+        alarm_wheel_remove(alarm_wheel, &alarm->entry);
+    } else if (alarm->state == ALARM_STATE_EXPIRED) {
+        alarm_wheel_list_remove(&alarm->entry);
+    }
+    alarm->state = ALARM_STATE_IDLE;
 }
 
-static struct alarm_t *alarm_cbs_lookfor_available(void)
+static void alarm_timer_cb(TimerHandle_t xTimer)
 {
-    int i;
+    alarm_wheel_entry_t *entry;
+    bool post = false;
+
+    osi_mutex_lock(&alarm_lock);
+    alarm_timer_running = false;
+    if (!alarm_wheel) {
+        osi_mutex_unlock(&alarm_lock);
+        return;
+    }
 
-    for (i = 0; i < ALARM_CBS_NUM; i++) {
-        if (alarm_cbs[i].alarm_hdl == NULL) { //available
-            LOG_DEBUG("%s %d %p\n", __func__, i, &alarm_cbs[i]);
-            return &alarm_cbs[i];
+    alarm_wheel_advance(alarm_wheel, alarm_update_time(), &alarm_expired);
+    for (entry = alarm_expired.head.next; entry != &alarm_expired.head; entry = entry->next) {
+        ((osi_alarm_t *)entry)->state = ALARM_STATE_EXPIRED;
+    }
+    if (!alarm_dispatch_posted && !alarm_wheel_list_is_empty(&alarm_expired)) {
+        alarm_dispatch_posted = post = true;
+    }
+    alarm_schedule(false);
+    osi_mutex_unlock(&alarm_lock);
+
+    // One signal for all alarms which expired; if the BTU queue is full or
+    // the BTU task doesn't exist yet, the timer fires again to retry.
+    if (post && !btu_task_post(SIG_BTU_ALARM)) {
+        osi_mutex_lock(&alarm_lock);
+        alarm_dispatch_posted = false;
+        if (alarm_wheel) {
+            alarm_schedule(true);
         }
+        osi_mutex_unlock(&alarm_lock);
+    }
+}
+
+int osi_alarm_init(void)
+{
+    alarm_wheel = osi_malloc(sizeof(alarm_wheel_t));
+    if (!alarm_wheel) {
+        LOG_ERROR("%s unable to allocate timer wheel\n", __func__);
+        return -1;
+    }
+    if (osi_mutex_new(&alarm_lock) != 0) {
+        LOG_ERROR("%s unable to create mutex\n", __func__);
+        goto error;
+    }
+    alarm_timer = xTimerCreate("btAlarm", 1, pdFALSE, NULL, alarm_timer_cb);
+    if (!alarm_timer) {
+        LOG_ERROR("%s unable to create timer\n", __func__);
+        osi_mutex_free(&alarm_lock);
+        goto error;
     }
 
-    return NULL;
+    alarm_time_ms = 0;
+    alarm_last_os_tick = xTaskGetTickCount();
+    alarm_wheel_init(alarm_wheel, 0);
+    alarm_wheel_list_init(&alarm_expired);
+    alarm_timer_running = false;
+    alarm_dispatch_posted = false;
+    alarm_dispatching = NULL;
+    return 0;
+
+error:
+    osi_free(alarm_wheel);
+    alarm_wheel = NULL;
+    return -1;
 }
 
-static void alarm_cb_handler(TimerHandle_t xTimer)
+void osi_alarm_deinit(void)
 {
-    struct alarm_t *alarm;
+    alarm_wheel_entry_t *entry;
 
-    if (!xTimer) {
-        LOG_ERROR("TimerName: NULL\n");
+    if (!alarm_wheel) {
         return;
     }
 
-    alarm = pvTimerGetTimerID(xTimer);
-    LOG_DEBUG("TimerID %p, Name %s\n", alarm, pcTimerGetTimerName(xTimer));
-    if (alarm->cb) {
-        alarm->cb(alarm->cb_data);
+    xTimerDelete(alarm_timer, portMAX_DELAY);
+
+    osi_mutex_lock(&alarm_lock);
+    for (int level = 0; level < ALARM_WHEEL_LEVELS; level++) {
+        for (int i = 0; i < ALARM_WHEEL_SLOTS; i++) {
+            while ((entry = alarm_wheel_list_front(&alarm_wheel->slots[level][i])) != NULL) {
+                alarm_unlink((osi_alarm_t *)entry);
+            }
+        }
+    }
+    while ((entry = alarm_wheel_list_front(&alarm_expired)) != NULL) {
+        alarm_unlink((osi_alarm_t *)entry);
     }
+    osi_free(alarm_wheel);
+    alarm_wheel = NULL;
+    osi_mutex_unlock(&alarm_lock);
+
+    osi_mutex_free(&alarm_lock);
 }
 
 osi_alarm_t *osi_alarm_new(char *alarm_name, osi_alarm_callback_t callback, void *data, period_ms_t timer_expire)
 {
-    struct alarm_t *timer_id;
-    TimerHandle_t t;
-
-    if (timer_expire == 0) {
-        timer_expire = 1000;
-    }
+    osi_alarm_t *alarm;
 
-    /* TODO mutex lock */
-    timer_id = alarm_cbs_lookfor_available();
-    if (!timer_id) {
-        LOG_ERROR("%s full\n", __func__);
-        return NULL;
-    }
+    assert(alarm_wheel != NULL);
 
-    t = xTimerCreate(alarm_name, timer_expire / portTICK_PERIOD_MS, pdFALSE, timer_id, alarm_cb_handler);
-    if (!t) {
-        LOG_ERROR("%s error\n", __func__);
+    alarm = osi_calloc(sizeof(osi_alarm_t));
+    if (!alarm) {
+        LOG_ERROR("%s unable to allocate alarm\n", __func__);
         return NULL;
     }
 
-    timer_id->alarm_hdl = t;
-    timer_id->cb = callback;
-    timer_id->cb_data = data;
-    /* TODO mutex unlock */
-
-    return timer_id;
+    alarm->cb = callback;
+    alarm->cb_data = data;
+    alarm->state = ALARM_STATE_IDLE;
+    return alarm;
 }
 
 int osi_alarm_free(osi_alarm_t *alarm)
@@ -110,40 +246,39 @@ int osi_alarm_free(osi_alarm_t *alarm)
         return -1;
     }
 
-    if (xTimerDelete(alarm->alarm_hdl, BT_ALARM_FREE_WAIT_TICKS) != pdPASS) {
-        LOG_ERROR("%s error\n", __func__);
-        return -2;
-    }
-
-    /* TODO mutex lock */
-    memset(alarm, 0x00, sizeof(osi_alarm_t));
-    /* TODO mutex unlock */
-
+    osi_alarm_cancel(alarm);
+    osi_free(alarm);
     return 0;
 }
 
-
 int osi_alarm_set(osi_alarm_t *alarm, period_ms_t timeout)
 {
+    uint32_t now;
+
     if (!alarm) {
         LOG_ERROR("%s null\n", __func__);
         return -1;
     }
 
-    if (xTimerChangePeriod(alarm->alarm_hdl, timeout / portTICK_PERIOD_MS, BT_ALARM_CHG_PERIOD_WAIT_TICKS) != pdPASS) {
-        LOG_ERROR("%s chg period error\n", __func__);
-        return -2;
-    }
+    osi_mutex_lock(&alarm_lock);
+    alarm_unlink(alarm);
 
-    if (xTimerStart(alarm->alarm_hdl, BT_ALARM_START_WAIT_TICKS) != pdPASS) {
-        LOG_ERROR("%s start error\n", __func__);
-        return -3;
+    now = alarm_update_time();
+    if (alarm_wheel_is_empty(alarm_wheel)) {
+        // nothing to expire, only moves the wheel to the current tick
+        alarm_wheel_advance(alarm_wheel, now, &alarm_expired);
     }
 
+    // first tick which starts at or after the deadline
+    alarm_wheel_add(alarm_wheel, &alarm->entry,
+                    now + (timeout + (uint32_t)(alarm_time_ms % ALARM_WHEEL_TICK_MS) + ALARM_WHEEL_TICK_MS - 1) / ALARM_WHEEL_TICK_MS);
+    alarm->state = ALARM_STATE_SET;
+    alarm_schedule(false);
+    osi_mutex_unlock(&alarm_lock);
+
     return 0;
 }
 
-
 int osi_alarm_cancel(osi_alarm_t *alarm)
 {
     if (!alarm) {
@@ -151,14 +286,47 @@ int osi_alarm_cancel(osi_alarm_t *alarm)
         return -1;
     }
 
-    if (xTimerStop(alarm->alarm_hdl, BT_ALARM_STOP_WAIT_TICKS) != pdPASS) {
-        LOG_ERROR("%s error\n", __func__);
-        return -2;
+    osi_mutex_lock(&alarm_lock);
+    alarm_unlink(alarm);
+    // wait for the callback unless it is the callback which cancels
+    while (alarm_dispatching == alarm && xTaskGetCurrentTaskHandle() != alarm_dispatch_task) {
+        osi_mutex_unlock(&alarm_lock);
+        vTaskDelay(1);
+        osi_mutex_lock(&alarm_lock);
     }
+    osi_mutex_unlock(&alarm_lock);
 
     return 0;
 }
 
+void osi_alarm_process_expired(void)
+{
+    alarm_wheel_entry_t *entry;
+    osi_alarm_t *alarm;
+    osi_alarm_callback_t cb;
+    void *cb_data;
+
+    osi_mutex_lock(&alarm_lock);
+    alarm_dispatch_posted = false;
+    alarm_dispatch_task = xTaskGetCurrentTaskHandle();
+    while ((entry = alarm_wheel_list_front(&alarm_expired)) != NULL) {
+        alarm = (osi_alarm_t *)entry;
+        alarm_unlink(alarm);
+        cb = alarm->cb;
+        cb_data = alarm->cb_data;
+        alarm_dispatching = alarm;
+        osi_mutex_unlock(&alarm_lock);
+
+        if (cb) {
+            cb(cb_data);
+        }
+
+        osi_mutex_lock(&alarm_lock);
+        alarm_dispatching = NULL;
+    }
+    osi_mutex_unlock(&alarm_lock);
+}
+
 static uint32_t alarm_current_tick(void)
 {
     return xTaskGetTickCount();
@@ -173,8 +341,19 @@ period_ms_t osi_alarm_now(void)
 
 period_ms_t osi_alarm_get_remaining_ms(const osi_alarm_t *alarm)
 {
-    /* TODO: use FreeRTOS timer.c implement ??? */
-    return 0xffffffff;
+    period_ms_t remaining = 0;
+    uint32_t now;
+
+    osi_mutex_lock(&alarm_lock);
+    if (alarm->state == ALARM_STATE_SET) {
+        now = alarm_update_time();
+        if ((int32_t)(alarm->entry.expire - now) > 0) {
+            remaining = (alarm->entry.expire - now) * ALARM_WHEEL_TICK_MS - (uint32_t)(alarm_time_ms % ALARM_WHEEL_TICK_MS);
+        }
+    }
+    osi_mutex_unlock(&alarm_lock);
+
+    return remaining;
 }
 
 // pre-condition: 0 <= t1, t2 <= 0xD20D20
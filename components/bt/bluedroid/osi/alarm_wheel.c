@@ -0,0 +1,147 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include "alarm_wheel.h"
+
+#define SLOT_MASK   (ALARM_WHEEL_SLOTS - 1)
+
+// Slot of level |level| which covers tick |tick|
+#define SLOT_INDEX(tick, level)   (((tick) >> ((level) * ALARM_WHEEL_SLOT_BITS)) & SLOT_MASK)
+
+static void list_append(alarm_wheel_list_t *list, alarm_wheel_entry_t *entry)
+{
+    entry->next = &list->head;
+    entry->prev = list->head.prev;
+    list->head.prev->next = entry;
+    list->head.prev = entry;
+}
+
+// Moves all entries of |from| to the end of |to|
+static void list_splice(alarm_wheel_list_t *from, alarm_wheel_list_t *to)
+{
+    if (alarm_wheel_list_is_empty(from)) {
+        return;
+    }
+    from->head.next->prev = to->head.prev;
+    to->head.prev->next = from->head.next;
+    from->head.prev->next = &to->head;
+    to->head.prev = from->head.prev;
+    alarm_wheel_list_init(from);
+}
+
+static void wheel_insert(alarm_wheel_t *wheel, alarm_wheel_entry_t *entry)
+{
+    uint32_t when = entry->expire;
+    uint32_t delta = when - wheel->now;
+    int level;
+
+    if ((int32_t)delta < 0) {
+        // already due, expires on the next tick processed
+        when = wheel->now;
+        delta = 0;
+    } else if (delta > ALARM_WHEEL_MAX_TICKS) {
+        // moved down again when the last level reaches this slot
+        when = wheel->now + ALARM_WHEEL_MAX_TICKS;
+        delta = ALARM_WHEEL_MAX_TICKS;
+    }
+
+    for (level = 0; level < ALARM_WHEEL_LEVELS - 1; level++) {
+        if (delta < (1UL << ((level + 1) * ALARM_WHEEL_SLOT_BITS))) {
+            break;
+        }
+    }
+    list_append(&wheel->slots[level][SLOT_INDEX(when, level)], entry);
+}
+
+// Puts the entries of a slot of |level| back into the wheel, which moves
+// them to lower levels. Returns the index of the slot.
+static uint32_t wheel_cascade(alarm_wheel_t *wheel, int level)
+{
+    uint32_t index = SLOT_INDEX(wheel->now, level);
+    alarm_wheel_list_t list;
+    alarm_wheel_entry_t *entry;
+
+    alarm_wheel_list_init(&list);
+    list_splice(&wheel->slots[level][index], &list);
+    while ((entry = alarm_wheel_list_front(&list)) != NULL) {
+        alarm_wheel_list_remove(entry);
+        wheel_insert(wheel, entry);
+    }
+    return index;
+}
+
+void alarm_wheel_init(alarm_wheel_t *wheel, uint32_t now)
+{
+    wheel->now = now;
+    wheel->count = 0;
+    for (int level = 0; level < ALARM_WHEEL_LEVELS; level++) {
+        for (int i = 0; i < ALARM_WHEEL_SLOTS; i++) {
+            alarm_wheel_list_init(&wheel->slots[level][i]);
+        }
+    }
+}
+
+void alarm_wheel_add(alarm_wheel_t *wheel, alarm_wheel_entry_t *entry, uint32_t expire)
+{
+    entry->expire = expire;
+    wheel_insert(wheel, entry);
+    wheel->count++;
+}
+
+void alarm_wheel_remove(alarm_wheel_t *wheel, alarm_wheel_entry_t *entry)
+{
+    alarm_wheel_list_remove(entry);
+    wheel->count--;
+}
+
+void alarm_wheel_advance(alarm_wheel_t *wheel, uint32_t now, alarm_wheel_list_t *expired)
+{
+    while ((int32_t)(now - wheel->now) >= 0) {
+        if (wheel->count == 0) {
+            wheel->now = now + 1;
+            break;
+        }
+
+        uint32_t index = wheel->now & SLOT_MASK;
+        // at the start of each round of a level, bring the next slot of the
+        // level above down; stop at the first level which is not at a round
+        for (int level = 1; index == 0 && level < ALARM_WHEEL_LEVELS; level++) {
+            index = wheel_cascade(wheel, level);
+        }
+
+        alarm_wheel_list_t *slot = &wheel->slots[0][wheel->now & SLOT_MASK];
+        for (alarm_wheel_entry_t *entry = slot->head.next; entry != &slot->head; entry = entry->next) {
+            wheel->count--;
+        }
+        list_splice(slot, expired);
+        wheel->now++;
+    }
+}
+
+uint32_t alarm_wheel_ticks_to_next(const alarm_wheel_t *wheel)
+{
+    uint32_t n;
+
+    for (n = 0; n < ALARM_WHEEL_SLOTS; n++) {
+        uint32_t tick = wheel->now + n;
+        if ((tick & SLOT_MASK) == 0) {
+            break;
+        }
+        if (!alarm_wheel_list_is_empty(&wheel->slots[0][tick & SLOT_MASK])) {
+            break;
+        }
+    }
+    return n;
+}
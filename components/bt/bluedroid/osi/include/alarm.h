@@ -26,19 +26,18 @@
 typedef uint32_t period_ms_t;
 typedef void (*osi_alarm_callback_t)(void *data);
 
-#define ALARM_CBS_NUM   20
-#define ALARM_ID_BASE   1000
-typedef struct alarm_t {
-    /* timer id point to here */
-    TimerHandle_t alarm_hdl;
-    osi_alarm_callback_t cb;
-    void *cb_data;
-} osi_alarm_t;
+typedef struct alarm_t osi_alarm_t;
 
-void osi_alarm_init(void);
+// Starts the alarm service. All alarms are kept in one timer wheel which is
+// driven by a single FreeRTOS timer. Returns 0 on success.
+int osi_alarm_init(void);
+
+// Stops the alarm service. Alarms which are still set don't fire.
+void osi_alarm_deinit(void);
 
 // Creates a new alarm object. The returned object must be freed by calling
-// |alarm_free|. Returns NULL on failure.
+// |alarm_free|. Returns NULL on failure. |alarm_name| and |timer_expire| are
+// not used.
 osi_alarm_t *osi_alarm_new(char *alarm_name, osi_alarm_callback_t callback, void *data, period_ms_t timer_expire);
 
 // Frees an alarm object created by |alarm_new|. |alarm| may be NULL. If the
@@ -48,8 +47,9 @@ int osi_alarm_free(osi_alarm_t *alarm);
 
 // Sets an alarm to fire |cb| after the given |deadline|. Note that |deadline| is the
 // number of milliseconds relative to the current time. |data| is a context variable
-// for the callback and may be NULL. |cb| will be called back in the context of an
-// unspecified thread (i.e. it will not be called back in the same thread as the caller).
+// for the callback and may be NULL. |cb| is called in the BTU task, together with
+// the callbacks of other alarms which expired at the same time. Setting an alarm
+// which is already set moves it to the new deadline.
 // |alarm| and |cb| may not be NULL.
 int osi_alarm_set(osi_alarm_t *alarm, period_ms_t timeout);
 
@@ -59,6 +59,10 @@ int osi_alarm_set(osi_alarm_t *alarm, period_ms_t timeout);
 // |alarm| may not be NULL.
 int osi_alarm_cancel(osi_alarm_t *alarm);
 
+// Calls the callbacks of the alarms which have expired. Called by the BTU task
+// when the alarm service posts SIG_BTU_ALARM.
+void osi_alarm_process_expired(void);
+
 period_ms_t osi_alarm_now(void);
 
 // Figure out how much time until next expiration.
@@ -0,0 +1,110 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ALARM_WHEEL_H__
+#define __ALARM_WHEEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hierarchical timer wheel used by the alarm service. Time is counted in
+// wheel ticks which may wrap around. Adding and removing an entry takes
+// constant time; advancing the wheel takes constant time per tick plus the
+// time to move each entry at most once per level.
+//
+// The wheel does no locking and no memory allocation: entries are embedded
+// in the objects which use them and the caller serializes all calls.
+
+#define ALARM_WHEEL_LEVELS      4
+#define ALARM_WHEEL_SLOT_BITS   6
+#define ALARM_WHEEL_SLOTS       (1 << ALARM_WHEEL_SLOT_BITS)
+
+// Entries further away than this are kept in the last level and moved
+// down when their time comes closer.
+#define ALARM_WHEEL_MAX_TICKS   ((1UL << (ALARM_WHEEL_LEVELS * ALARM_WHEEL_SLOT_BITS)) - 1)
+
+typedef struct alarm_wheel_entry {
+    struct alarm_wheel_entry *next;
+    struct alarm_wheel_entry *prev;
+    uint32_t expire;                // tick at which the entry expires
+} alarm_wheel_entry_t;
+
+// Circular list of entries; |head| is a sentinel which is not an entry.
+typedef struct {
+    alarm_wheel_entry_t head;
+} alarm_wheel_list_t;
+
+typedef struct {
+    uint32_t now;                   // next tick to be processed
+    uint32_t count;                 // number of entries in the wheel
+    alarm_wheel_list_t slots[ALARM_WHEEL_LEVELS][ALARM_WHEEL_SLOTS];
+} alarm_wheel_t;
+
+// Initializes an empty |wheel| whose next tick to be processed is |now|.
+void alarm_wheel_init(alarm_wheel_t *wheel, uint32_t now);
+
+// Adds |entry| to |wheel| to expire at tick |expire|. Entries which expire
+// before the next tick to be processed expire on that tick.
+// |entry| may not be linked in any list.
+void alarm_wheel_add(alarm_wheel_t *wheel, alarm_wheel_entry_t *entry, uint32_t expire);
+
+// Removes |entry| from |wheel|. |entry| must have been added to |wheel|
+// and not expired yet.
+void alarm_wheel_remove(alarm_wheel_t *wheel, alarm_wheel_entry_t *entry);
+
+// Processes all ticks up to and including |now|, appending the entries which
+// expire to |expired| in the order of their expiry.
+void alarm_wheel_advance(alarm_wheel_t *wheel, uint32_t now, alarm_wheel_list_t *expired);
+
+// Returns the number of ticks from the next tick to be processed to the
+// first one which expires entries or moves entries down a level. Processing
+// the ticks before it only moves the wheel forward, so the wheel doesn't
+// need to be advanced until that tick. Returns at most ALARM_WHEEL_SLOTS - 1.
+uint32_t alarm_wheel_ticks_to_next(const alarm_wheel_t *wheel);
+
+static inline bool alarm_wheel_is_empty(const alarm_wheel_t *wheel)
+{
+    return wheel->count == 0;
+}
+
+static inline void alarm_wheel_list_init(alarm_wheel_list_t *list)
+{
+    list->head.next = list->head.prev = &list->head;
+}
+
+static inline bool alarm_wheel_list_is_empty(const alarm_wheel_list_t *list)
+{
+    return list->head.next == &list->head;
+}
+
+// Returns the first entry of |list| or NULL if it is empty.
+static inline alarm_wheel_entry_t *alarm_wheel_list_front(alarm_wheel_list_t *list)
+{
+    return alarm_wheel_list_is_empty(list) ? NULL : list->head.next;
+}
+
+// Unlinks |entry| from the list it is in. Unlinked entries have NULL links.
+static inline void alarm_wheel_list_remove(alarm_wheel_entry_t *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+}
+
+static inline bool alarm_wheel_entry_is_linked(const alarm_wheel_entry_t *entry)
+{
+    return entry->next != NULL;
+}
+
+#endif /* __ALARM_WHEEL_H__ */
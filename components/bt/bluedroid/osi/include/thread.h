@@ -15,6 +15,7 @@
 #ifndef __THREAD_H__
 #define __THREAD_H__
 
+#include <stdbool.h>
 #include "freertos/xtensa_api.h"
 #include "freertos/FreeRTOSConfig.h"
 #include "freertos/FreeRTOS.h"
@@ -36,6 +37,7 @@ typedef struct bt_task_evt BtTaskEvt_t;
 typedef bt_status_t (* BtTaskCb_t)(void *arg);
 
 enum {
+    SIG_BTU_ALARM = 0xfb,
     SIG_PRF_START_UP = 0xfc,
     SIG_PRF_WORK = 0xfd,
     SIG_BTU_START_UP = 0xfe,
@@ -63,7 +65,7 @@ enum {
 #define BTC_TASK_PRIO       		(configMAX_PRIORITIES - 5)
 #define BTC_TASK_QUEUE_NUM  		20
 
-void btu_task_post(uint32_t sig);
+bool btu_task_post(uint32_t sig);
 void hci_host_task_post(void);
 void hci_hal_h4_task_post(void);
 void hci_drv_task_post(void);
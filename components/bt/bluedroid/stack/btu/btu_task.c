@@ -319,6 +319,15 @@ void btu_task_thread_handler(void *arg)
 #if (defined(BTA_INCLUDED) && BTA_INCLUDED == TRUE)
                 fixed_queue_process(btu_bta_msg_queue);
                 fixed_queue_process(btu_bta_alarm_queue);
+#endif
+                fixed_queue_process(btu_general_alarm_queue);
+                fixed_queue_process(btu_oneshot_alarm_queue);
+                fixed_queue_process(btu_l2cap_alarm_queue);
+            } else if (e.sig == SIG_BTU_ALARM) {
+                /* The alarm callbacks queue their timer entries, handle them all at once */
+                osi_alarm_process_expired();
+#if (defined(BTA_INCLUDED) && BTA_INCLUDED == TRUE)
+                fixed_queue_process(btu_bta_alarm_queue);
 #endif
                 fixed_queue_process(btu_general_alarm_queue);
                 fixed_queue_process(btu_oneshot_alarm_queue);
@@ -331,16 +340,22 @@ void btu_task_thread_handler(void *arg)
 }
 
 
-void btu_task_post(uint32_t sig)
+bool btu_task_post(uint32_t sig)
 {
     BtTaskEvt_t evt;
 
+    if (!xBtuQueue) {
+        return false;
+    }
+
     evt.sig = sig;
     evt.par = 0;
 
     if (xQueueSend(xBtuQueue, &evt, 10 / portTICK_RATE_MS) != pdTRUE) {
         LOG_ERROR("xBtuQueue failed\n");
+        return false;
     }
+    return true;
 }
 
 void btu_task_start_up(void)
@@ -511,8 +526,6 @@ void btu_general_alarm_cb(void *data)
     TIMER_LIST_ENT *p_tle = (TIMER_LIST_ENT *)data;
 
     fixed_queue_enqueue(btu_general_alarm_queue, p_tle);
-    //ke_event_set(KE_EVENT_BTU_TASK_THREAD);
-    btu_task_post(SIG_BTU_WORK);
 }
 
 void btu_start_timer(TIMER_LIST_ENT *p_tle, UINT16 type, UINT32 timeout_sec)
@@ -601,8 +614,6 @@ static void btu_l2cap_alarm_cb(void *data)
     TIMER_LIST_ENT *p_tle = (TIMER_LIST_ENT *)data;
 
     fixed_queue_enqueue(btu_l2cap_alarm_queue, p_tle);
-    //ke_event_set(KE_EVENT_BTU_TASK_THREAD);
-    btu_task_post(SIG_BTU_WORK);
 }
 
 void btu_start_quick_timer(TIMER_LIST_ENT *p_tle, UINT16 type, UINT32 timeout_ticks)
@@ -669,8 +680,6 @@ void btu_oneshot_alarm_cb(void *data)
     btu_stop_timer_oneshot(p_tle);
 
     fixed_queue_enqueue(btu_oneshot_alarm_queue, p_tle);
-    //ke_event_set(KE_EVENT_BTU_TASK_THREAD);
-    btu_task_post(SIG_BTU_WORK);
 }
 
 /*
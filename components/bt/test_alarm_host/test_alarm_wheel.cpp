@@ -0,0 +1,247 @@
+#include "catch.hpp"
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+extern "C" {
+#include "alarm_wheel.h"
+}
+
+/* Alarm with the tick it fired on */
+struct TestAlarm {
+    alarm_wheel_entry_t entry;  // first, so that entries can be cast to alarms
+    uint32_t expire;
+    bool armed;
+    bool fired;
+    uint32_t fired_at;
+};
+
+class WheelTest {
+public:
+    WheelTest(uint32_t start, size_t count) : alarms(count)
+    {
+        alarm_wheel_init(&wheel, start);
+        now = start;
+    }
+
+    void arm(TestAlarm& alarm, uint32_t ticks)
+    {
+        if (alarm.armed) {
+            alarm_wheel_remove(&wheel, &alarm.entry);
+        }
+        alarm.expire = now + ticks;
+        alarm.armed = true;
+        alarm.fired = false;
+        alarm_wheel_add(&wheel, &alarm.entry, alarm.expire);
+    }
+
+    void cancel(TestAlarm& alarm)
+    {
+        if (alarm.armed) {
+            alarm_wheel_remove(&wheel, &alarm.entry);
+            alarm.armed = false;
+        }
+    }
+
+    /* Moves time to |to| and records the alarms which fire; returns their number */
+    size_t advance(uint32_t to)
+    {
+        alarm_wheel_list_t expired;
+        alarm_wheel_entry_t* entry;
+        size_t count = 0;
+
+        now = to;
+        alarm_wheel_list_init(&expired);
+        alarm_wheel_advance(&wheel, now, &expired);
+        uint32_t last = 0;
+        while ((entry = alarm_wheel_list_front(&expired)) != nullptr) {
+            alarm_wheel_list_remove(entry);
+            TestAlarm* alarm = reinterpret_cast<TestAlarm*>(entry);
+            /* expired in order */
+            if (count > 0) {
+                CHECK((int32_t)(alarm->expire - last) >= 0);
+            }
+            last = alarm->expire;
+            alarm->armed = false;
+            alarm->fired = true;
+            alarm->fired_at = now;
+            ++count;
+        }
+        return count;
+    }
+
+    alarm_wheel_t wheel;
+    uint32_t now;
+    std::vector<TestAlarm> alarms;
+};
+
+static uint32_t s_seed;
+
+static uint32_t rnd()
+{
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 8;
+}
+
+/* Spread of timeouts covering all levels of the wheel */
+static uint32_t randomTimeout()
+{
+    switch (rnd() % 4) {
+    case 0:
+        return rnd() % 64;
+    case 1:
+        return rnd() % 4096;
+    case 2:
+        return rnd() % 100000;
+    default:
+        return rnd() % 1000000;
+    }
+}
+
+static void checkOnTime(WheelTest& test)
+{
+    for (auto& alarm : test.alarms) {
+        if (alarm.fired) {
+            CHECK(alarm.fired_at == alarm.expire);
+        }
+    }
+}
+
+TEST_CASE("10000 alarms fire on the tick they expire", "[alarm]")
+{
+    s_seed = 1;
+    WheelTest test(0, 10000);
+    uint32_t last_expire = 0;
+    for (auto& alarm : test.alarms) {
+        test.arm(alarm, randomTimeout());
+        last_expire = std::max(last_expire, alarm.expire);
+    }
+    REQUIRE(test.wheel.count == 10000);
+
+    size_t fired = 0;
+    for (uint32_t tick = 0; tick <= last_expire; ++tick) {
+        fired += test.advance(tick);
+    }
+    CHECK(fired == 10000);
+    CHECK(alarm_wheel_is_empty(&test.wheel));
+    checkOnTime(test);
+}
+
+TEST_CASE("cancelled and re-armed alarms", "[alarm]")
+{
+    s_seed = 2;
+    WheelTest test(0, 10000);
+    for (auto& alarm : test.alarms) {
+        test.arm(alarm, randomTimeout());
+    }
+
+    for (uint32_t tick = 0; !alarm_wheel_is_empty(&test.wheel); ++tick) {
+        test.advance(tick);
+        /* while time passes, alarms are cancelled and set again; tick has
+           been processed, so the earliest an alarm can expire is the next one */
+        if (tick % 16 == 0 && tick < 1000000) {
+            TestAlarm& alarm = test.alarms[rnd() % test.alarms.size()];
+            if (rnd() % 2) {
+                test.cancel(alarm);
+            } else {
+                test.arm(alarm, 1 + randomTimeout());
+            }
+        }
+    }
+    checkOnTime(test);
+    size_t cancelled = 0;
+    for (auto& alarm : test.alarms) {
+        CHECK_FALSE(alarm.armed);
+        if (!alarm.fired) {
+            ++cancelled;
+        }
+    }
+    CHECK(cancelled > 0);
+    CHECK(alarm_wheel_is_empty(&test.wheel));
+}
+
+TEST_CASE("alarms fire on time when the tick counter wraps", "[alarm]")
+{
+    s_seed = 3;
+    WheelTest test(UINT32_MAX - 50000, 10000);
+    for (auto& alarm : test.alarms) {
+        test.arm(alarm, rnd() % 100000);
+    }
+    size_t fired = 0;
+    for (uint32_t i = 0; i <= 100000; ++i) {
+        fired += test.advance(UINT32_MAX - 50000 + i);
+    }
+    CHECK(fired == 10000);
+    checkOnTime(test);
+}
+
+TEST_CASE("alarms beyond the range of the wheel", "[alarm]")
+{
+    WheelTest test(0, 3);
+    const uint32_t far = ALARM_WHEEL_MAX_TICKS * 3 + 12345;
+    test.arm(test.alarms[0], far);
+    test.arm(test.alarms[1], ALARM_WHEEL_MAX_TICKS + 1);
+    test.arm(test.alarms[2], 0);
+
+    CHECK(test.advance(0) == 1);
+    CHECK(test.alarms[2].fired);
+    /* skip ahead in large steps, the wheel processes every tick */
+    for (uint32_t tick = 1; tick < far; tick += 1000) {
+        test.advance(tick);
+        CHECK_FALSE(test.alarms[0].fired);
+    }
+    test.advance(far);
+    CHECK(test.alarms[0].fired);
+    /* fired on the first advance which reached its tick */
+    CHECK(test.alarms[1].fired_at >= test.alarms[1].expire);
+    CHECK(test.alarms[1].fired_at - test.alarms[1].expire < 1000);
+    CHECK(alarm_wheel_is_empty(&test.wheel));
+}
+
+TEST_CASE("advancing only on the ticks reported by ticks_to_next", "[alarm]")
+{
+    s_seed = 4;
+    WheelTest test(1000, 10000);
+    uint32_t last_expire = 0;
+    for (auto& alarm : test.alarms) {
+        test.arm(alarm, randomTimeout());
+        last_expire = std::max(last_expire, alarm.expire);
+    }
+
+    /* what the alarm service does: the timer fires when the wheel has work */
+    size_t fired = 0;
+    size_t wakeups = 0;
+    uint32_t tick = test.now;
+    while (!alarm_wheel_is_empty(&test.wheel)) {
+        tick = test.wheel.now + alarm_wheel_ticks_to_next(&test.wheel);
+        fired += test.advance(tick);
+        ++wakeups;
+    }
+    CHECK(fired == 10000);
+    checkOnTime(test);
+    CHECK(wakeups < last_expire - 1000);
+    printf("%u ticks, %u wakeups\n", (unsigned) (last_expire - 1000), (unsigned) wakeups);
+}
+
+TEST_CASE("benchmark setting and cancelling alarms", "[alarm][bench]")
+{
+    s_seed = 5;
+    const int OPS = 1000000;
+    for (size_t count : { 100, 10000 }) {
+        WheelTest test(0, count);
+        for (auto& alarm : test.alarms) {
+            test.arm(alarm, randomTimeout());
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < OPS; ++i) {
+            TestAlarm& alarm = test.alarms[i % count];
+            test.arm(alarm, 1 + (i & 0xffff));
+            if (i % 64 == 0) {
+                test.advance(test.now + 1);
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%u alarms: %.0f ns per set\n", (unsigned) count, elapsed * 1e9 / OPS);
+    }
+}
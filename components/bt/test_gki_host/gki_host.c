@@ -0,0 +1,30 @@
+/* Host implementation of the parts of gki_ulinux.c used by gki_buffer.c */
+
+#include <string.h>
+#include "gki.h"
+
+tGKI_CB gki_cb;
+
+int gki_init(void)
+{
+    memset(&gki_cb, 0, sizeof(gki_cb));
+    pthread_mutex_init(&gki_cb.lock, NULL);
+    gki_buffer_init();
+    return 0;
+}
+
+void gki_clean_up(void)
+{
+    gki_buffer_cleanup();
+    pthread_mutex_destroy(&gki_cb.lock);
+}
+
+void GKI_enable(void)
+{
+    pthread_mutex_unlock(&gki_cb.lock);
+}
+
+void GKI_disable(void)
+{
+    pthread_mutex_lock(&gki_cb.lock);
+}
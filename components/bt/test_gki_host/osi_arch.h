@@ -0,0 +1,17 @@
+/* Host replacement of osi_arch.h: mutexes are POSIX mutexes */
+#ifndef __OSI_ARCH_H__
+#define __OSI_ARCH_H__
+
+#include <pthread.h>
+
+typedef pthread_mutex_t osi_mutex_t;
+
+int osi_mutex_new(osi_mutex_t *pxMutex);
+
+void osi_mutex_lock(osi_mutex_t *pxMutex);
+
+void osi_mutex_unlock(osi_mutex_t *pxMutex);
+
+void osi_mutex_free(osi_mutex_t *pxMutex);
+
+#endif /* __OSI_ARCH_H__ */
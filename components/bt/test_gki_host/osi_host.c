@@ -0,0 +1,40 @@
+/* Host implementation of the osi mutexes and log output, kept apart from
+   bt_defs.h which maps the pthread mutex functions to the osi ones */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "osi_arch.h"
+#include "esp_log.h"
+
+int osi_mutex_new(osi_mutex_t *pxMutex)
+{
+    return pthread_mutex_init(pxMutex, NULL);
+}
+
+void osi_mutex_lock(osi_mutex_t *pxMutex)
+{
+    pthread_mutex_lock(pxMutex);
+}
+
+void osi_mutex_unlock(osi_mutex_t *pxMutex)
+{
+    pthread_mutex_unlock(pxMutex);
+}
+
+void osi_mutex_free(osi_mutex_t *pxMutex)
+{
+    pthread_mutex_destroy(pxMutex);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return 0;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
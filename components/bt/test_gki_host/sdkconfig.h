@@ -0,0 +1,2 @@
+/* Configuration used for host build of the GKI buffer pools */
+#define CONFIG_LOG_DEFAULT_LEVEL 1
@@ -0,0 +1,258 @@
+#include "catch.hpp"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+extern "C" {
+#include "gki.h"
+}
+
+/* Initializes GKI for one test case and cleans it up afterwards */
+struct GkiFixture {
+    GkiFixture()
+    {
+        gki_init();
+    }
+    ~GkiFixture()
+    {
+        gki_clean_up();
+    }
+};
+
+static bool inPool(void* buf, UINT8 pool_id)
+{
+    UINT8* p = (UINT8*) buf;
+    return p >= gki_cb.com.pool_start[pool_id] && p < gki_cb.com.pool_end[pool_id];
+}
+
+TEST_CASE("buffers come from the smallest public pool which fits", "[gki]")
+{
+    GkiFixture gki;
+    struct {
+        UINT16 size;
+        UINT8 pool_id;
+    } cases[] = {
+        { 1, GKI_POOL_ID_0 },
+        { GKI_BUF0_SIZE, GKI_POOL_ID_0 },
+        { GKI_BUF0_SIZE + 1, GKI_POOL_ID_1 },
+        { GKI_BUF1_SIZE, GKI_POOL_ID_1 },
+        { GKI_BUF2_SIZE, GKI_POOL_ID_2 },
+        { GKI_BUF3_SIZE, GKI_POOL_ID_3 },
+        { GKI_BUF3_SIZE + 1, GKI_POOL_ID_9 },
+    };
+    for (auto& c : cases) {
+        void* buf = GKI_getbuf(c.size);
+        REQUIRE(buf != nullptr);
+        CHECK(GKI_get_buf_size(buf) == c.size);
+        CHECK(GKI_poolfreecount(c.pool_id) == GKI_poolcount(c.pool_id) - 1);
+        if (gki_cb.com.freeq[c.pool_id].prealloc) {
+            CHECK(inPool(buf, c.pool_id));
+        }
+        GKI_freebuf(buf);
+        CHECK(GKI_poolfreecount(c.pool_id) == GKI_poolcount(c.pool_id));
+    }
+}
+
+TEST_CASE("buffers larger than the public pools come from the heap", "[gki]")
+{
+    GkiFixture gki;
+    void* buf = GKI_getbuf(GKI_BUF9_SIZE + 1);
+    REQUIRE(buf != nullptr);
+    memset(buf, 0xab, GKI_BUF9_SIZE + 1);
+    for (int i = 0; i < GKI_NUM_TOTAL_BUF_POOLS; ++i) {
+        CHECK(gki_cb.com.freeq[i].cur_cnt == 0);
+    }
+    GKI_freebuf(buf);
+}
+
+TEST_CASE("restricted pools are only used by GKI_getpoolbuf", "[gki]")
+{
+    GkiFixture gki;
+    /* pool 5 is restricted and its buffers are larger than the ones of pool 2 */
+    REQUIRE((GKI_DEF_BUFPOOL_PERM_MASK & (1 << GKI_POOL_ID_5)) != 0);
+    void* buf = GKI_getbuf(GKI_BUF2_SIZE + 1);
+    CHECK(GKI_poolutilization(GKI_POOL_ID_5) == 0);
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_3].cur_cnt == 1);
+    GKI_freebuf(buf);
+
+    buf = GKI_getpoolbuf(GKI_POOL_ID_5);
+    REQUIRE(buf != nullptr);
+    CHECK(GKI_get_buf_size(buf) == GKI_get_pool_bufsize(GKI_POOL_ID_5));
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_5].cur_cnt == 1);
+    GKI_freebuf(buf);
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_5].cur_cnt == 0);
+}
+
+TEST_CASE("exhausted pools fall back to the heap", "[gki]")
+{
+    GkiFixture gki;
+    const int prealloc = GKI_BUF1_PREALLOC;
+    REQUIRE(prealloc > 0);
+
+    std::vector<void*> bufs;
+    for (int i = 0; i < prealloc; ++i) {
+        void* buf = GKI_getpoolbuf(GKI_POOL_ID_1);
+        REQUIRE(buf != nullptr);
+        CHECK(inPool(buf, GKI_POOL_ID_1));
+        CHECK(std::find(bufs.begin(), bufs.end(), buf) == bufs.end());
+        bufs.push_back(buf);
+    }
+    CHECK(GKI_poolheapcount(GKI_POOL_ID_1) == 0);
+
+    void* extra = GKI_getpoolbuf(GKI_POOL_ID_1);
+    REQUIRE(extra != nullptr);
+    CHECK_FALSE(inPool(extra, GKI_POOL_ID_1));
+    CHECK(GKI_poolheapcount(GKI_POOL_ID_1) == 1);
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_1].cur_cnt == prealloc + 1);
+    GKI_freebuf(extra);
+
+    for (void* buf : bufs) {
+        GKI_freebuf(buf);
+    }
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_1].cur_cnt == 0);
+    CHECK(gki_cb.com.freeq[GKI_POOL_ID_1].max_cnt == prealloc + 1);
+
+    /* freed buffers are used again */
+    void* buf = GKI_getpoolbuf(GKI_POOL_ID_1);
+    CHECK(inPool(buf, GKI_POOL_ID_1));
+    GKI_freebuf(buf);
+    CHECK(GKI_poolheapcount(GKI_POOL_ID_1) == 1);
+}
+
+TEST_CASE("pool buffers are zeroed", "[gki]")
+{
+    GkiFixture gki;
+    UINT8* buf = (UINT8*) GKI_getbuf(GKI_BUF0_SIZE);
+    memset(buf, 0xab, GKI_BUF0_SIZE);
+    GKI_freebuf(buf);
+    UINT8* buf2 = (UINT8*) GKI_getbuf(GKI_BUF0_SIZE);
+    REQUIRE(buf2 == buf);
+    for (int i = 0; i < GKI_BUF0_SIZE; ++i) {
+        CHECK(buf2[i] == 0);
+    }
+    GKI_freebuf(buf2);
+}
+
+TEST_CASE("utilization counts the buffers in use", "[gki]")
+{
+    GkiFixture gki;
+    const UINT8 pool_id = GKI_POOL_ID_2;
+    const int total = GKI_poolcount(pool_id);
+    REQUIRE(total == GKI_BUF2_MAX);
+    REQUIRE(total > GKI_BUF2_PREALLOC);
+
+    std::vector<void*> bufs;
+    for (int i = 0; i < total / 2; ++i) {
+        bufs.push_back(GKI_getpoolbuf(pool_id));
+    }
+    CHECK(GKI_poolutilization(pool_id) == 50);
+    CHECK(GKI_poolfreecount(pool_id) == total - total / 2);
+    while ((int) bufs.size() < total + 1) {
+        bufs.push_back(GKI_getpoolbuf(pool_id));
+    }
+    CHECK(GKI_poolutilization(pool_id) == 100);
+    CHECK(GKI_poolfreecount(pool_id) == 0);
+    for (void* buf : bufs) {
+        GKI_freebuf(buf);
+    }
+    CHECK(GKI_poolutilization(pool_id) == 0);
+    CHECK(GKI_poolfreecount(pool_id) == total);
+}
+
+TEST_CASE("buffers allocated by several threads are not shared", "[gki]")
+{
+    GkiFixture gki;
+    const int THREADS = 4;
+    const int ITERATIONS = 100000;
+    const UINT16 sizes[] = { 20, GKI_BUF0_SIZE + 1, GKI_BUF1_SIZE + 1 };
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<uint32_t*> held;
+            uint32_t seed = t + 1;
+            for (int i = 0; i < ITERATIONS; ++i) {
+                seed = seed * 1103515245 + 12345;
+                if (held.size() < 8 && (seed >> 16) % 3 != 0) {
+                    uint32_t* buf = (uint32_t*) GKI_getbuf(sizes[(seed >> 8) % 3]);
+                    buf[0] = t;
+                    held.push_back(buf);
+                } else if (!held.empty()) {
+                    uint32_t* buf = held.back();
+                    held.pop_back();
+                    if (buf[0] != (uint32_t) t) {
+                        ++errors;
+                    }
+                    GKI_freebuf(buf);
+                }
+            }
+            for (uint32_t* buf : held) {
+                GKI_freebuf(buf);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK(errors == 0);
+    for (int i = 0; i < GKI_NUM_TOTAL_BUF_POOLS; ++i) {
+        CHECK(gki_cb.com.freeq[i].cur_cnt == 0);
+    }
+}
+
+template<typename Alloc, typename Free>
+static double runBenchmark(Alloc alloc, Free free)
+{
+    /* HCI events and ACL packets of typical sizes, a few of them queued at a time */
+    const UINT16 sizes[] = { 40, 60, 270, 40, 600 };
+    const int SIZES = sizeof(sizes) / sizeof(sizes[0]);
+    const int IN_FLIGHT = 4;
+    const int PACKETS = 2000000;
+    void* bufs[IN_FLIGHT] = {};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < PACKETS; ++i) {
+        void** slot = &bufs[i % IN_FLIGHT];
+        if (*slot) {
+            free(*slot);
+        }
+        *slot = alloc(sizes[i % SIZES]);
+    }
+    for (void* buf : bufs) {
+        free(buf);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return PACKETS / elapsed;
+}
+
+TEST_CASE("benchmark buffer allocation", "[gki][bench]")
+{
+    GkiFixture gki;
+    /* what GKI_getbuf and GKI_freebuf did before: calloc for every buffer */
+    auto heapAlloc = [](UINT16 size) { return calloc(1, size + BUFFER_HDR_SIZE); };
+    auto heapFree = [](void* buf) { ::free(buf); };
+    /* the host heap has per-thread caches; the ESP32 heap has one lock */
+    static std::mutex heapLock;
+    auto lockedHeapAlloc = [](UINT16 size) {
+        std::lock_guard<std::mutex> lock(heapLock);
+        return calloc(1, size + BUFFER_HDR_SIZE);
+    };
+    auto lockedHeapFree = [](void* buf) {
+        std::lock_guard<std::mutex> lock(heapLock);
+        ::free(buf);
+    };
+    auto poolAlloc = [](UINT16 size) { return GKI_getbuf(size); };
+    auto poolFree = [](void* buf) { GKI_freebuf(buf); };
+
+    printf("heap: %.0f buffers/s\n", runBenchmark(heapAlloc, heapFree));
+    printf("heap with one lock: %.0f buffers/s\n", runBenchmark(lockedHeapAlloc, lockedHeapFree));
+    printf("pools: %.0f buffers/s\n", runBenchmark(poolAlloc, poolFree));
+    for (int i = 0; i < GKI_NUM_TOTAL_BUF_POOLS; ++i) {
+        CHECK(GKI_poolheapcount(i) == 0);
+    }
+}
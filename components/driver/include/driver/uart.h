@@ -143,6 +143,23 @@ typedef struct {
 
 typedef intr_handle_t uart_isr_handle_t;
 
+/**
+ * @brief Conditions reported to the select notification callback
+ */
+typedef enum {
+    UART_SELECT_READ_NOTIF,     /*!< Data was received into the RX ring buffer */
+    UART_SELECT_WRITE_NOTIF,    /*!< Space was freed in the TX FIFO or TX ring buffer */
+    UART_SELECT_ERROR_NOTIF,    /*!< RX overflow, frame, parity error or break */
+} uart_select_notif_t;
+
+/**
+ * @brief Select notification callback, called from the UART interrupt handler
+ *
+ * Must be placed in IRAM. task_woken should be set to pdTRUE if the callback
+ * wakes a task of higher priority than the interrupted one.
+ */
+typedef void (*uart_select_notif_callback_t)(uart_port_t uart_num, uart_select_notif_t notif, BaseType_t* task_woken);
+
 /**
  * @brief Set UART data bits.
  *
@@ -606,6 +623,20 @@ esp_err_t uart_flush(uart_port_t uart_num);
  */
 esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size);
 
+/**
+ * @brief   Set the callback which the UART interrupt handler calls when data is
+ *          received, space is freed for sending, or an RX error occurs.
+ *          Used by the VFS to wake up tasks blocked in select.
+ *
+ * @param   uart_num UART port number.
+ * @param   callback Callback, or NULL to remove it.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_FAIL Parameter error, or the driver is not installed
+ */
+esp_err_t uart_set_select_notif_callback(uart_port_t uart_num, uart_select_notif_callback_t callback);
+
 /**
  * @brief   UART disable pattern detect function.
  *          Designed for applications like 'AT commands'.
@@ -84,6 +84,7 @@ typedef struct {
     uint8_t tx_brk_flg;                 /*!< Flag to indicate to send a break signal in the end of the item sending procedure */
     uint8_t tx_brk_len;                 /*!< TX break signal cycle length/number */
     uint8_t tx_waiting_brk;             /*!< Flag to indicate that TX FIFO is ready to send break signal after FIFO is empty, do not push data into TX FIFO right now.*/
+    uart_select_notif_callback_t uart_select_notif_callback; /*!< Notification about select() events */
 } uart_obj_t;
 
 
@@ -494,6 +495,9 @@ static void IRAM_ATTR uart_rx_intr_handler_default(void *param)
             if(p_uart->tx_waiting_fifo == true && p_uart->tx_buf_size == 0) {
                 p_uart->tx_waiting_fifo = false;
                 xSemaphoreGiveFromISR(p_uart->tx_fifo_sem, &HPTaskAwoken);
+                if(p_uart->uart_select_notif_callback) {
+                    p_uart->uart_select_notif_callback(uart_num, UART_SELECT_WRITE_NOTIF, &HPTaskAwoken);
+                }
                 if(HPTaskAwoken == pdTRUE) {
                     portYIELD_FROM_ISR() ;
                 }
@@ -552,6 +556,9 @@ static void IRAM_ATTR uart_rx_intr_handler_default(void *param)
                         if(p_uart->tx_len_cur == 0) {
                             //Return item to ring buffer.
                             vRingbufferReturnItemFromISR(p_uart->tx_ring_buf, p_uart->tx_head, &HPTaskAwoken);
+                            if(p_uart->uart_select_notif_callback) {
+                                p_uart->uart_select_notif_callback(uart_num, UART_SELECT_WRITE_NOTIF, &HPTaskAwoken);
+                            }
                             if(HPTaskAwoken == pdTRUE) {
                                 portYIELD_FROM_ISR() ;
                             }
@@ -684,6 +691,19 @@ static void IRAM_ATTR uart_rx_intr_handler_default(void *param)
             uart_event.type = UART_EVENT_MAX;
         }
 
+        if(p_uart->uart_select_notif_callback) {
+            //Data pushed to the RX buffer, or an RX error, wakes up the task in select.
+            if(uart_event.type == UART_DATA || uart_event.type == UART_BUFFER_FULL) {
+                p_uart->uart_select_notif_callback(uart_num, UART_SELECT_READ_NOTIF, &HPTaskAwoken);
+            } else if(uart_event.type == UART_FIFO_OVF || uart_event.type == UART_BREAK
+                      || uart_event.type == UART_FRAME_ERR || uart_event.type == UART_PARITY_ERR) {
+                p_uart->uart_select_notif_callback(uart_num, UART_SELECT_ERROR_NOTIF, &HPTaskAwoken);
+            }
+            if(HPTaskAwoken == pdTRUE) {
+                portYIELD_FROM_ISR() ;
+            }
+        }
+
         if(uart_event.type != UART_EVENT_MAX && p_uart->xQueueUart) {
             xQueueSendFromISR(p_uart->xQueueUart, (void * )&uart_event, &HPTaskAwoken);
             if(HPTaskAwoken == pdTRUE) {
@@ -902,6 +922,16 @@ esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size)
     return ESP_OK;
 }
 
+esp_err_t uart_set_select_notif_callback(uart_port_t uart_num, uart_select_notif_callback_t callback)
+{
+    UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", ESP_FAIL);
+    UART_CHECK((p_uart_obj[uart_num]), "uart driver error", ESP_FAIL);
+    UART_ENTER_CRITICAL(&uart_spinlock[uart_num]);
+    p_uart_obj[uart_num]->uart_select_notif_callback = callback;
+    UART_EXIT_CRITICAL(&uart_spinlock[uart_num]);
+    return ESP_OK;
+}
+
 esp_err_t uart_flush(uart_port_t uart_num)
 {
     UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", ESP_FAIL);
@@ -974,6 +1004,7 @@ esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_b
         p_uart_obj[uart_num]->tx_brk_flg = 0;
         p_uart_obj[uart_num]->tx_brk_len = 0;
         p_uart_obj[uart_num]->tx_waiting_brk = 0;
+        p_uart_obj[uart_num]->uart_select_notif_callback = NULL;
         p_uart_obj[uart_num]->rx_buffered_len = 0;
 
         if(uart_queue) {
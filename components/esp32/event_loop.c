@@ -20,6 +20,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_event_loop.h"
+#include "esp_event_lib.h"
 #include "esp_task.h"
 
 #include "freertos/FreeRTOS.h"
@@ -37,6 +38,8 @@ static QueueHandle_t s_event_queue = NULL;
 static system_event_cb_t s_event_handler_cb = NULL;
 static void *s_event_ctx = NULL;
 
+ESP_EVENT_DEFINE_BASE(SYSTEM_EVENT);
+
 static esp_err_t esp_event_post_to_user(system_event_t *event)
 {
     if (s_event_handler_cb) {
@@ -58,6 +61,11 @@ static void esp_event_loop_task(void *pvParameters)
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "post event to user fail!");
             }
+            // forward to handlers of the default event loop, if the application created it
+            ret = esp_event_post(SYSTEM_EVENT, evt.event_id, &evt.event_info, sizeof(evt.event_info), 0);
+            if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "post event to default loop fail!");
+            }
         }
     }
 }
@@ -19,6 +19,9 @@
 #include "spiram.h"
 #include "esp_log.h"
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char* TAG = "heap_alloc_caps";
 
@@ -268,7 +271,7 @@ Standard malloc() implementation. Will return standard no-frills byte-accessible
 */
 void *pvPortMalloc( size_t xWantedSize )
 {
-    return pvPortMallocCaps( xWantedSize, MALLOC_CAP_8BIT );
+    return pvPortMallocCapsFrom( xWantedSize, MALLOC_CAP_8BIT, __builtin_return_address(0) );
 }
 
 /*
@@ -292,6 +295,14 @@ void vPortFree( void *pv )
 Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
 */
 void *pvPortMallocCaps( size_t xWantedSize, uint32_t caps )
+{
+    return pvPortMallocCapsFrom( xWantedSize, caps, __builtin_return_address(0) );
+}
+
+/*
+Same as pvPortMallocCaps, attributing the allocation to the given caller if heap tracing is enabled.
+*/
+void *pvPortMallocCapsFrom( size_t xWantedSize, uint32_t caps, void *caller )
 {
     int prio;
     int tag, j;
@@ -326,11 +337,11 @@ void *pvPortMallocCaps( size_t xWantedSize, uint32_t caps )
                         //This is special, insofar that what we're going to get back is probably a DRAM address. If so,
                         //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
                         //add a pointer to the DRAM equivalent before the address we're going to return.
-                        ret=pvPortMallocTagged(xWantedSize+4, tag);
+                        ret=pvPortMallocTaggedFrom(xWantedSize+4, tag, caller);
                         if (ret!=NULL) return dram_alloc_to_iram_addr(ret, xWantedSize+4);
                     } else {
                         //Just try to alloc, nothing special.
-                        ret=pvPortMallocTagged(xWantedSize, tag);
+                        ret=pvPortMallocTaggedFrom(xWantedSize, tag, caller);
                         if (ret!=NULL) return ret;
                     }
                 }
@@ -385,3 +396,206 @@ size_t xPortGetMinimumEverFreeHeapSize( void )
 }
 
 
+
+//Bitmask of the tags which can give out memory with at least one of the given capabilities
+static uint32_t tags_with_caps( uint32_t caps )
+{
+    int prio;
+    int tag;
+    uint32_t ret=0;
+    for (prio=0; prio<NO_PRIOS; prio++) {
+        for (tag=0; tag_desc[tag].prio[prio]!=MALLOC_CAP_INVALID; tag++) {
+            if ((tag_desc[tag].prio[prio]&caps)!=0) {
+                ret|=(1<<tag);
+            }
+        }
+    }
+    return ret;
+}
+
+//Free blocks are counted in buckets of power of two sizes, from 16 bytes to 256KiB and more
+#define DUMP_HISTOGRAM_BUCKETS 15
+#define DUMP_HISTOGRAM_MIN_SHIFT 4
+
+typedef struct {
+    size_t free_bytes;
+    size_t free_blocks;
+    size_t largest_free;
+    size_t used_bytes;
+    size_t used_blocks;
+    uint32_t histogram[DUMP_HISTOGRAM_BUCKETS];
+} tag_summary_t;
+
+#if CONFIG_HEAP_TRACING
+//Number of tasks and call sites reported by esp_heap_dump_summary. Memory held by others is
+//reported on one line.
+#define DUMP_MAX_TASKS 24
+#define DUMP_MAX_CALLERS 48
+
+typedef struct {
+    union {
+        char task[4];
+        void *caller;
+    };
+    size_t bytes;
+    size_t blocks;
+} owner_total_t;
+
+static owner_total_t s_task_totals[DUMP_MAX_TASKS + 1];
+static owner_total_t s_caller_totals[DUMP_MAX_CALLERS + 1];
+static int s_task_count, s_caller_count;
+
+static void add_to_owner(owner_total_t *totals, int *count, int max, const owner_total_t *key, bool by_task, size_t size)
+{
+    int i;
+    for (i=0; i<*count; i++) {
+        if (by_task ? memcmp(totals[i].task, key->task, 4)==0 : totals[i].caller==key->caller) {
+            break;
+        }
+    }
+    if (i==*count) {
+        if (*count<max) {
+            totals[i]=*key;
+            totals[i].bytes=0;
+            totals[i].blocks=0;
+            (*count)++;
+        } else {
+            //Table is full, count this under "others", kept after the last entry
+            i=max;
+        }
+    }
+    totals[i].bytes+=size;
+    totals[i].blocks++;
+}
+
+static int compare_owner_bytes(const void *a, const void *b)
+{
+    size_t ba=((const owner_total_t*)a)->bytes;
+    size_t bb=((const owner_total_t*)b)->bytes;
+    return (ba<bb) ? 1 : (ba>bb) ? -1 : 0;
+}
+
+//Task names are not null terminated, and are empty for allocations done before the scheduler started
+static void task_name(const char *task, char *name)
+{
+    memcpy(name, task, 4);
+    name[4]=0;
+    if (name[0]==0) {
+        strcpy(name, "-");
+    }
+}
+#endif
+
+static void summarize_block(const HeapBlockInfo_t *info, void *arg)
+{
+    tag_summary_t *summary=(tag_summary_t*)arg;
+    if (!info->xAllocated) {
+        int bucket=0;
+        size_t size=info->xSize >> DUMP_HISTOGRAM_MIN_SHIFT;
+        while (size>1 && bucket<DUMP_HISTOGRAM_BUCKETS-1) {
+            size>>=1;
+            bucket++;
+        }
+        summary->histogram[bucket]++;
+        summary->free_bytes+=info->xSize;
+        summary->free_blocks++;
+        if (info->xSize>summary->largest_free) {
+            summary->largest_free=info->xSize;
+        }
+        return;
+    }
+    summary->used_bytes+=info->xSize;
+    summary->used_blocks++;
+#if CONFIG_HEAP_TRACING
+    owner_total_t key;
+    memcpy(key.task, info->acTask, 4);
+    add_to_owner(s_task_totals, &s_task_count, DUMP_MAX_TASKS, &key, true, info->xSize);
+    key.caller=info->pvCaller;
+    add_to_owner(s_caller_totals, &s_caller_count, DUMP_MAX_CALLERS, &key, false, info->xSize);
+#endif
+}
+
+void esp_heap_dump_summary( uint32_t caps )
+{
+    int tag, i;
+    uint32_t tags=tags_with_caps(caps);
+    tag_summary_t summary;
+
+#if CONFIG_HEAP_TRACING
+    memset(s_task_totals, 0, sizeof(s_task_totals));
+    memset(s_caller_totals, 0, sizeof(s_caller_totals));
+    s_task_count=0;
+    s_caller_count=0;
+#endif
+    printf("Heap summary, caps 0x%x:\n", caps);
+    for (tag=0; tag_desc[tag].prio[0]!=MALLOC_CAP_INVALID; tag++) {
+        if ((tags & (1<<tag))==0) {
+            continue;
+        }
+        memset(&summary, 0, sizeof(summary));
+        vPortWalkHeapTagged(tag, summarize_block, &summary);
+        if (summary.free_blocks==0 && summary.used_blocks==0) {
+            continue;
+        }
+        printf("%s: %d bytes free in %d blocks, largest %d, lowest free %d; %d bytes used in %d blocks\n",
+                tag_desc[tag].name, summary.free_bytes, summary.free_blocks, summary.largest_free,
+                xPortGetMinimumEverFreeHeapSizeTagged(tag), summary.used_bytes, summary.used_blocks);
+        printf("  free blocks by size:");
+        for (i=0; i<DUMP_HISTOGRAM_BUCKETS; i++) {
+            if (summary.histogram[i]!=0) {
+                printf(" %d%s:%d", (1<<(i+DUMP_HISTOGRAM_MIN_SHIFT)), (i==DUMP_HISTOGRAM_BUCKETS-1)?"+":"", summary.histogram[i]);
+            }
+        }
+        printf("\n");
+    }
+#if CONFIG_HEAP_TRACING
+    char name[5];
+    qsort(s_task_totals, s_task_count, sizeof(owner_total_t), compare_owner_bytes);
+    qsort(s_caller_totals, s_caller_count, sizeof(owner_total_t), compare_owner_bytes);
+    printf("Used by task:\n");
+    for (i=0; i<s_task_count; i++) {
+        task_name(s_task_totals[i].task, name);
+        printf("  %-4s %8d bytes in %d blocks\n", name, s_task_totals[i].bytes, s_task_totals[i].blocks);
+    }
+    if (s_task_totals[DUMP_MAX_TASKS].blocks!=0) {
+        printf("  others %6d bytes in %d blocks\n", s_task_totals[DUMP_MAX_TASKS].bytes, s_task_totals[DUMP_MAX_TASKS].blocks);
+    }
+    printf("Used by call site:\n");
+    for (i=0; i<s_caller_count; i++) {
+        printf("  %p %8d bytes in %d blocks\n", s_caller_totals[i].caller, s_caller_totals[i].bytes, s_caller_totals[i].blocks);
+    }
+    if (s_caller_totals[DUMP_MAX_CALLERS].blocks!=0) {
+        printf("  others     %8d bytes in %d blocks\n", s_caller_totals[DUMP_MAX_CALLERS].bytes, s_caller_totals[DUMP_MAX_CALLERS].blocks);
+    }
+#endif
+}
+
+void esp_heap_dump_trace()
+{
+#if CONFIG_HEAP_TRACING
+    HeapTraceEvent_t events[16];
+    uint32_t next=0, first;
+    size_t count, i;
+    char name[5];
+
+    printf("Heap trace:\n");
+    while ((count=xPortGetHeapTrace(events, next, sizeof(events)/sizeof(events[0]), &first))!=0) {
+        if (first!=next) {
+            printf("# %d events dropped\n", first-next);
+        }
+        for (i=0; i<count; i++) {
+            task_name(events[i].acTask, name);
+            if (events[i].ucType==HEAP_TRACE_MALLOC) {
+                printf("m %d %d %d %p %p %s\n", first+i, events[i].ucTag, events[i].xSize,
+                        events[i].pvAddress, events[i].pvCaller, name);
+            } else {
+                printf("f %d %d %d %p - %s\n", first+i, events[i].ucTag, events[i].xSize,
+                        events[i].pvAddress, name);
+            }
+        }
+        next=first+count;
+    }
+#else
+    ESP_LOGW(TAG, "heap tracing is disabled, enable CONFIG_HEAP_TRACING");
+#endif
+}
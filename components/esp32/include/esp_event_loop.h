@@ -20,6 +20,7 @@
 
 #include "esp_err.h"
 #include "esp_event.h"
+#include "esp_event_lib.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
@@ -38,6 +39,14 @@ extern "C" {
   */
 typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
 
+/**
+  * @brief  Event base of system events posted to the default event loop of esp_event_lib
+  *
+  * Event id is system_event_id_t, event data is system_event_info_t.
+  * Events are only posted if the application has called esp_event_loop_create_default.
+  */
+ESP_EVENT_DECLARE_BASE(SYSTEM_EVENT);
+
 /**
   * @brief  Initialize event loop
   *         Create the event handler and task
@@ -49,6 +49,22 @@ void heap_alloc_caps_init();
  */
 void *pvPortMallocCaps(size_t xWantedSize, uint32_t caps);
 
+/**
+ * @brief Allocate a chunk of memory which has the given capabilities, on behalf of a caller
+ *
+ * Same as pvPortMallocCaps. If heap tracing is enabled (CONFIG_HEAP_TRACING), the
+ * allocation is attributed to the code at the caller address. Used by allocation
+ * functions such as malloc, to report the code which called them.
+ *
+ * @param xWantedSize Size, in bytes, of the amount of memory to allocate
+ * @param caps        Bitwise OR of MALLOC_CAP_* flags indicating the type
+ *                    of memory to be returned
+ * @param caller      Address of the code which requested the memory
+ *
+ * @return A pointer to the memory allocated on success, NULL on failure
+ */
+void *pvPortMallocCapsFrom(size_t xWantedSize, uint32_t caps, void *caller);
+
 /**
  * @brief Get the total free size of all the regions that have the given capabilities
  *
@@ -75,4 +91,36 @@ size_t xPortGetFreeHeapSizeCaps( uint32_t caps );
  */
 size_t xPortGetMinimumEverFreeHeapSizeCaps( uint32_t caps );
 
+/**
+ * @brief Print a summary of the regions with the given capabilities
+ *
+ * For each kind of memory, prints the number of free and used bytes and blocks,
+ * the largest free block and a histogram of free block sizes.
+ *
+ * If heap tracing is enabled (CONFIG_HEAP_TRACING), also prints the number of bytes
+ * held by each task and by each call site, largest first. Tasks are identified
+ * by the first 4 characters of their names.
+ *
+ * Heap is locked while each kind of memory is examined. This function must not
+ * be called from two tasks at the same time.
+ *
+ * @param caps        Bitwise OR of MALLOC_CAP_* flags indicating the type
+ *                    of memory
+ */
+void esp_heap_dump_summary(uint32_t caps);
+
+/**
+ * @brief Print the trace of the last allocations and frees
+ *
+ * Available if heap tracing is enabled (CONFIG_HEAP_TRACING). Prints one line per event,
+ * oldest first:
+ *
+ *     m <number> <tag> <requested size> <address> <caller> <task>
+ *     f <number> <tag> <block size> <address> - <task>
+ *
+ * The output can be replayed on a host with heap_trace_replay, found in
+ * components/freertos/test_heap_host, to find blocks which were not freed.
+ */
+void esp_heap_dump_trace();
+
 #endif
\ No newline at end of file
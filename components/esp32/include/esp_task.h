@@ -51,6 +51,8 @@
 /* idf task */
 #define ESP_TASKD_EVENT_PRIO          (ESP_TASK_PRIO_MAX - 5)
 #define ESP_TASKD_EVENT_STACK         CONFIG_SYSTEM_EVENT_TASK_STACK_SIZE
+#define ESP_TASKD_EVENT_LIB_PRIO      (ESP_TASK_PRIO_MAX - 6)
+#define ESP_TASKD_EVENT_LIB_STACK     CONFIG_EVENT_LIB_DEFAULT_TASK_STACK_SIZE
 #define ESP_TASK_TCPIP_PRIO           (ESP_TASK_PRIO_MAX - 7)
 #define ESP_TASK_TCPIP_STACK          2048
 #define ESP_TASK_MAIN_PRIO            (ESP_TASK_PRIO_MIN + 1)
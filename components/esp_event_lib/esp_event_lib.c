@@ -0,0 +1,459 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Event loop library — implementation notes.
+ *
+ * Each loop has a queue of posted events and a registry of handlers. The
+ * registry is a hash table keyed by (event base, event id); each key has a
+ * list of handlers in registration order. Handlers for "any id" of a base are
+ * stored under (base, ESP_EVENT_ANY_ID), handlers for any base under
+ * (ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID). Dispatching an event therefore takes
+ * three hash lookups, no matter how many other events have handlers. The
+ * number of buckets is doubled whenever there are more keys than buckets.
+ *
+ * The registry is protected by a recursive mutex, which the dispatching task
+ * holds while calling handlers. This lets handlers register and unregister
+ * handlers of their own loop. A handler unregistered while the loop is
+ * dispatching is only marked as removed, so that the list being walked stays
+ * valid; removed handlers are freed once the event has been dispatched.
+ *
+ * Event data of up to EVENT_INLINE_DATA_SIZE bytes is copied into the queue
+ * item, so small events don't need any heap allocation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_event_lib.h"
+#include "esp_task.h"
+#include "sdkconfig.h"
+
+#define EVENT_HASH_MIN_BUCKETS  16      // must be a power of two
+#define EVENT_INLINE_DATA_SIZE  16
+
+#define EVENT_DATA_INLINE       0x01    // data is copied into the queue item
+#define EVENT_DATA_HEAP         0x02    // data is a heap copy, freed after dispatch
+
+typedef struct esp_event_handler_node {
+    esp_event_handler_t handler;        // NULL if unregistered during dispatch
+    void* arg;
+    struct esp_event_handler_node* next;
+} esp_event_handler_node_t;
+
+typedef struct esp_event_key_node {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_node_t* handlers;
+    struct esp_event_key_node* next;    // next key in the same hash bucket
+} esp_event_key_node_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t flags;
+    union {
+        void* ptr;
+        uint8_t bytes[EVENT_INLINE_DATA_SIZE];
+        uint64_t align;
+    } data;
+} esp_event_post_t;
+
+struct esp_event_loop_instance {
+    QueueHandle_t queue;
+    SemaphoreHandle_t mutex;            // recursive, protects the registry
+    TaskHandle_t task;                  // dispatch task, NULL if run by the application
+    SemaphoreHandle_t task_exited;      // given by the dispatch task when it stops
+    bool exit;                          // set by the dispatch task when it gets the exit event
+    bool dispatching;
+    bool cleanup_pending;               // some handlers were unregistered during dispatch
+    size_t bucket_count;                // power of two, doubled when there are more keys than buckets
+    size_t key_count;
+    esp_event_key_node_t** buckets;
+};
+
+// Posted by esp_event_loop_delete to stop the dispatch task
+static const char s_exit_event_base[] = "exit";
+
+static esp_event_loop_handle_t s_default_loop;
+
+static inline size_t event_hash(esp_event_base_t base, int32_t id, size_t bucket_count)
+{
+    uint32_t h = (uint32_t) (uintptr_t) base;
+    h ^= h >> 7;
+    h += (uint32_t) id * 2654435761u;
+    return (h ^ (h >> 16)) & (bucket_count - 1);
+}
+
+static esp_event_key_node_t* event_find_key(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id)
+{
+    esp_event_key_node_t* key = loop->buckets[event_hash(base, id, loop->bucket_count)];
+    while (key && (key->base != base || key->id != id)) {
+        key = key->next;
+    }
+    return key;
+}
+
+static void event_call_handlers(esp_event_key_node_t* key, const esp_event_post_t* post, void* data)
+{
+    if (key == NULL) {
+        return;
+    }
+    for (esp_event_handler_node_t* node = key->handlers; node; node = node->next) {
+        if (node->handler) {
+            (*node->handler)(node->arg, post->base, post->id, data);
+        }
+    }
+}
+
+// Double the number of buckets. Failing to do so is not an error, lookups just get slower.
+static void event_grow_buckets(esp_event_loop_handle_t loop)
+{
+    size_t new_count = loop->bucket_count * 2;
+    esp_event_key_node_t** new_buckets = calloc(new_count, sizeof(esp_event_key_node_t*));
+    if (new_buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < loop->bucket_count; ++i) {
+        esp_event_key_node_t* key = loop->buckets[i];
+        while (key) {
+            esp_event_key_node_t* next = key->next;
+            size_t bucket = event_hash(key->base, key->id, new_count);
+            key->next = new_buckets[bucket];
+            new_buckets[bucket] = key;
+            key = next;
+        }
+    }
+    free(loop->buckets);
+    loop->buckets = new_buckets;
+    loop->bucket_count = new_count;
+}
+
+// Free handlers which were unregistered during dispatch, and keys without handlers
+static void event_cleanup(esp_event_loop_handle_t loop)
+{
+    for (size_t i = 0; i < loop->bucket_count; ++i) {
+        esp_event_key_node_t** pkey = &loop->buckets[i];
+        while (*pkey) {
+            esp_event_key_node_t* key = *pkey;
+            esp_event_handler_node_t** pnode = &key->handlers;
+            while (*pnode) {
+                esp_event_handler_node_t* node = *pnode;
+                if (node->handler == NULL) {
+                    *pnode = node->next;
+                    free(node);
+                } else {
+                    pnode = &node->next;
+                }
+            }
+            if (key->handlers == NULL) {
+                *pkey = key->next;
+                free(key);
+                --loop->key_count;
+            } else {
+                pkey = &key->next;
+            }
+        }
+    }
+    loop->cleanup_pending = false;
+}
+
+static void event_free_data(esp_event_post_t* post)
+{
+    if (post->flags & EVENT_DATA_HEAP) {
+        free(post->data.ptr);
+    }
+}
+
+static void event_dispatch(esp_event_loop_handle_t loop, esp_event_post_t* post)
+{
+    void* data = (post->flags & EVENT_DATA_INLINE) ? post->data.bytes : post->data.ptr;
+    xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+    loop->dispatching = true;
+    event_call_handlers(event_find_key(loop, post->base, post->id), post, data);
+    event_call_handlers(event_find_key(loop, post->base, ESP_EVENT_ANY_ID), post, data);
+    event_call_handlers(event_find_key(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID), post, data);
+    loop->dispatching = false;
+    if (loop->cleanup_pending) {
+        event_cleanup(loop);
+    }
+    xSemaphoreGiveRecursive(loop->mutex);
+    event_free_data(post);
+}
+
+static void event_loop_task(void* arg)
+{
+    esp_event_loop_handle_t loop = (esp_event_loop_handle_t) arg;
+    while (!loop->exit) {
+        esp_event_loop_run(loop, portMAX_DELAY);
+    }
+    xSemaphoreGive(loop->task_exited);
+    vTaskDelete(NULL);
+}
+
+static void event_loop_free(esp_event_loop_handle_t loop)
+{
+    if (loop->queue) {
+        esp_event_post_t post;
+        while (xQueueReceive(loop->queue, &post, 0) == pdTRUE) {
+            event_free_data(&post);
+        }
+        vQueueDelete(loop->queue);
+    }
+    if (loop->mutex) {
+        vSemaphoreDelete(loop->mutex);
+    }
+    if (loop->task_exited) {
+        vSemaphoreDelete(loop->task_exited);
+    }
+    for (size_t i = 0; loop->buckets && i < loop->bucket_count; ++i) {
+        esp_event_key_node_t* key = loop->buckets[i];
+        while (key) {
+            esp_event_handler_node_t* node = key->handlers;
+            while (node) {
+                esp_event_handler_node_t* next = node->next;
+                free(node);
+                node = next;
+            }
+            esp_event_key_node_t* next = key->next;
+            free(key);
+            key = next;
+        }
+    }
+    free(loop->buckets);
+    free(loop);
+}
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t* event_loop_args, esp_event_loop_handle_t* event_loop)
+{
+    if (event_loop_args == NULL || event_loop == NULL || event_loop_args->queue_size <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_event_loop_handle_t loop = calloc(1, sizeof(struct esp_event_loop_instance));
+    if (loop == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    loop->queue = xQueueCreate(event_loop_args->queue_size, sizeof(esp_event_post_t));
+    loop->mutex = xSemaphoreCreateRecursiveMutex();
+    loop->bucket_count = EVENT_HASH_MIN_BUCKETS;
+    loop->buckets = calloc(loop->bucket_count, sizeof(esp_event_key_node_t*));
+    if (loop->queue == NULL || loop->mutex == NULL || loop->buckets == NULL) {
+        event_loop_free(loop);
+        return ESP_ERR_NO_MEM;
+    }
+    if (event_loop_args->task_name) {
+        loop->task_exited = xSemaphoreCreateBinary();
+        if (loop->task_exited == NULL ||
+                xTaskCreatePinnedToCore(&event_loop_task, event_loop_args->task_name,
+                        event_loop_args->task_stack_size, loop, event_loop_args->task_priority,
+                        &loop->task, event_loop_args->task_core_id) != pdPASS) {
+            event_loop_free(loop);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    *event_loop = loop;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop)
+{
+    if (event_loop->task) {
+        if (event_loop->task == xTaskGetCurrentTaskHandle()) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        esp_event_post_t post = { .base = s_exit_event_base };
+        xQueueSendToBack(event_loop->queue, &post, portMAX_DELAY);
+        xSemaphoreTake(event_loop->task_exited, portMAX_DELAY);
+    }
+    event_loop_free(event_loop);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks_to_wait = ticks_to_run;
+    esp_event_post_t post;
+    while (xQueueReceive(event_loop->queue, &post, ticks_to_wait) == pdTRUE) {
+        if (post.base == s_exit_event_base) {
+            event_loop->exit = true;
+            break;
+        }
+        event_dispatch(event_loop, &post);
+        if (ticks_to_run != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            ticks_to_wait = (elapsed < ticks_to_run) ? ticks_to_run - elapsed : 0;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base,
+                                          int32_t event_id, esp_event_handler_t handler, void* handler_arg)
+{
+    if (handler == NULL || (event_base == ESP_EVENT_ANY_BASE && event_id != ESP_EVENT_ANY_ID)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    xSemaphoreTakeRecursive(event_loop->mutex, portMAX_DELAY);
+    esp_event_key_node_t* key = event_find_key(event_loop, event_base, event_id);
+    if (key == NULL) {
+        key = calloc(1, sizeof(esp_event_key_node_t));
+        if (key == NULL) {
+            err = ESP_ERR_NO_MEM;
+            goto out;
+        }
+        key->base = event_base;
+        key->id = event_id;
+        size_t bucket = event_hash(event_base, event_id, event_loop->bucket_count);
+        key->next = event_loop->buckets[bucket];
+        event_loop->buckets[bucket] = key;
+        if (++event_loop->key_count > event_loop->bucket_count) {
+            event_grow_buckets(event_loop);
+        }
+    }
+    esp_event_handler_node_t** pnode = &key->handlers;
+    for (; *pnode; pnode = &(*pnode)->next) {
+        if ((*pnode)->handler == handler) {
+            (*pnode)->arg = handler_arg;
+            goto out;
+        }
+    }
+    esp_event_handler_node_t* node = calloc(1, sizeof(esp_event_handler_node_t));
+    if (node == NULL) {
+        // an empty key is removed by the next cleanup
+        event_loop->cleanup_pending = true;
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    node->handler = handler;
+    node->arg = handler_arg;
+    *pnode = node;
+out:
+    xSemaphoreGiveRecursive(event_loop->mutex);
+    return err;
+}
+
+esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base,
+                                            int32_t event_id, esp_event_handler_t handler)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTakeRecursive(event_loop->mutex, portMAX_DELAY);
+    esp_event_key_node_t* key = event_find_key(event_loop, event_base, event_id);
+    if (key) {
+        for (esp_event_handler_node_t* node = key->handlers; node; node = node->next) {
+            if (node->handler == handler) {
+                node->handler = NULL;
+                event_loop->cleanup_pending = true;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    if (event_loop->cleanup_pending && !event_loop->dispatching) {
+        event_cleanup(event_loop);
+    }
+    xSemaphoreGiveRecursive(event_loop->mutex);
+    return err;
+}
+
+esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                            void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (event_base == ESP_EVENT_ANY_BASE || event_id == ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_event_post_t post = {
+        .base = event_base,
+        .id = event_id,
+    };
+    if (event_data_size == 0) {
+        post.data.ptr = event_data;
+    } else if (event_data_size <= EVENT_INLINE_DATA_SIZE) {
+        memcpy(post.data.bytes, event_data, event_data_size);
+        post.flags = EVENT_DATA_INLINE;
+    } else {
+        post.data.ptr = malloc(event_data_size);
+        if (post.data.ptr == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(post.data.ptr, event_data, event_data_size);
+        post.flags = EVENT_DATA_HEAP;
+    }
+    if (xQueueSendToBack(event_loop->queue, &post, ticks_to_wait) != pdTRUE) {
+        event_free_data(&post);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_default_loop) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_event_loop_args_t args = {
+        .queue_size = CONFIG_EVENT_LIB_DEFAULT_QUEUE_SIZE,
+        .task_name = "eventLibTask",
+        .task_priority = ESP_TASKD_EVENT_LIB_PRIO,
+        .task_stack_size = ESP_TASKD_EVENT_LIB_STACK,
+        .task_core_id = 0,
+    };
+    return esp_event_loop_create(&args, &s_default_loop);
+}
+
+esp_err_t esp_event_loop_delete_default(void)
+{
+    if (s_default_loop == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_event_loop_delete(s_default_loop);
+    if (err == ESP_OK) {
+        s_default_loop = NULL;
+    }
+    return err;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t handler, void* handler_arg)
+{
+    if (s_default_loop == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_event_handler_register_with(s_default_loop, event_base, event_id, handler, handler_arg);
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t handler)
+{
+    if (s_default_loop == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_event_handler_unregister_with(s_default_loop, event_base, event_id, handler);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (s_default_loop == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_event_post_to(s_default_loop, event_base, event_id, event_data, event_data_size, ticks_to_wait);
+}
@@ -0,0 +1,253 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_EVENT_LIB_H__
+#define __ESP_EVENT_LIB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Event base, identifies the module which posts the event
+ *
+ * Bases are compared by address, so each base has to be defined exactly once
+ * using ESP_EVENT_DEFINE_BASE.
+ */
+typedef const char* esp_event_base_t;
+
+/** Declare an event base in a header file */
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t id
+
+/** Define an event base in a source file */
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t id = #id
+
+/** Register a handler for events of all bases (id must be ESP_EVENT_ANY_ID) */
+#define ESP_EVENT_ANY_BASE      NULL
+
+/** Register a handler for all events of a base */
+#define ESP_EVENT_ANY_ID        -1
+
+/**
+ * @brief Event handler
+ *
+ * @param handler_arg  argument given when the handler was registered
+ * @param event_base   base of the event
+ * @param event_id     id of the event
+ * @param event_data   event data, see esp_event_post_to
+ */
+typedef void (*esp_event_handler_t)(void* handler_arg, esp_event_base_t event_base,
+                                    int32_t event_id, void* event_data);
+
+/** Handle of an event loop */
+typedef struct esp_event_loop_instance* esp_event_loop_handle_t;
+
+/**
+ * @brief Configuration of an event loop
+ */
+typedef struct {
+    int32_t queue_size;         /*!< Number of events which can be waiting for dispatch */
+    const char* task_name;      /*!< Name of the dispatch task. If NULL, no task is created and
+                                     the application calls esp_event_loop_run instead. */
+    UBaseType_t task_priority;  /*!< Priority of the dispatch task */
+    uint32_t task_stack_size;   /*!< Stack size of the dispatch task, in bytes */
+    BaseType_t task_core_id;    /*!< Core the dispatch task is pinned to, or tskNO_AFFINITY */
+} esp_event_loop_args_t;
+
+/**
+ * @brief Create an event loop
+ *
+ * @param event_loop_args  loop configuration
+ * @param[out] event_loop  handle of the new loop
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if queue size is not positive
+ *      - ESP_ERR_NO_MEM if memory or the task could not be allocated
+ */
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t* event_loop_args, esp_event_loop_handle_t* event_loop);
+
+/**
+ * @brief Delete an event loop
+ *
+ * Events which have not been dispatched yet are dropped. If the loop has a
+ * dispatch task, this function waits until the task has finished the event it
+ * is dispatching. Must not be called from a handler of the same loop.
+ * For loops without a task, no other task may be in esp_event_loop_run.
+ *
+ * @param event_loop  loop to delete
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if called from the dispatch task of the loop
+ */
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop);
+
+/**
+ * @brief Dispatch events of a loop which was created without a task
+ *
+ * @param event_loop    loop to run
+ * @param ticks_to_run  how long to wait for and dispatch events;
+ *                      0 dispatches the events which are already queued
+ *
+ * @return
+ *      - ESP_OK when the time has elapsed
+ */
+esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run);
+
+/**
+ * @brief Register a handler for an event
+ *
+ * For each event, the loop calls handlers registered for its base and id,
+ * then handlers registered for its base with ESP_EVENT_ANY_ID, then handlers
+ * registered with ESP_EVENT_ANY_BASE. Handlers for the same key are called in
+ * the order they were registered. Finding the handlers takes constant time,
+ * independent of the number of handlers registered for other events.
+ *
+ * Registering the same handler for the same event again replaces its argument.
+ * Handlers may register and unregister handlers of the loop they run in.
+ * While a handler runs, other tasks calling the register functions of
+ * that loop are blocked.
+ *
+ * @param event_loop   loop to register with
+ * @param event_base   event base, or ESP_EVENT_ANY_BASE
+ * @param event_id     event id, or ESP_EVENT_ANY_ID
+ * @param handler      function to call
+ * @param handler_arg  first argument passed to the handler
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if handler is NULL, or event_base is ESP_EVENT_ANY_BASE
+ *        but event_id is not ESP_EVENT_ANY_ID
+ *      - ESP_ERR_NO_MEM if memory could not be allocated
+ */
+esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base,
+                                          int32_t event_id, esp_event_handler_t handler, void* handler_arg);
+
+/**
+ * @brief Unregister a handler
+ *
+ * event_base and event_id must be the same as when the handler was registered.
+ * When this function returns, the handler will not be called again, unless
+ * it is called from another handler which is being run for the current event.
+ *
+ * @param event_loop  loop the handler was registered with
+ * @param event_base  event base the handler was registered for
+ * @param event_id    event id the handler was registered for
+ * @param handler     handler to remove
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_FOUND if the handler was not registered for this event
+ */
+esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base,
+                                            int32_t event_id, esp_event_handler_t handler);
+
+/**
+ * @brief Post an event to a loop
+ *
+ * If event_data_size is not zero, event_data is copied and handlers get a
+ * pointer to the copy. Up to 16 bytes are stored in the queue itself, larger
+ * data is copied to the heap. If event_data_size is zero, event_data is
+ * passed to handlers as is; in this case the caller has to keep the data valid
+ * until the handlers have run.
+ *
+ * @param event_loop       loop to post to
+ * @param event_base       event base, not ESP_EVENT_ANY_BASE
+ * @param event_id         event id, not ESP_EVENT_ANY_ID
+ * @param event_data       event data, may be NULL
+ * @param event_data_size  size of data to copy, or 0 to pass the pointer
+ * @param ticks_to_wait    how long to wait if the queue is full
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if event_base or event_id is invalid
+ *      - ESP_ERR_NO_MEM if data could not be copied
+ *      - ESP_ERR_TIMEOUT if the queue was still full after ticks_to_wait
+ */
+esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                            void* event_data, size_t event_data_size, TickType_t ticks_to_wait);
+
+/**
+ * @brief Create the default event loop
+ *
+ * The default loop has its own task. Its queue size and task stack size are
+ * set in menuconfig. System events of the esp32 event loop are posted to it
+ * with event base SYSTEM_EVENT.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the default loop already exists
+ *      - ESP_ERR_NO_MEM if memory or the task could not be allocated
+ */
+esp_err_t esp_event_loop_create_default(void);
+
+/**
+ * @brief Delete the default event loop
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the default loop doesn't exist or this is called from its task
+ */
+esp_err_t esp_event_loop_delete_default(void);
+
+/**
+ * @brief Register a handler with the default loop, see esp_event_handler_register_with
+ *
+ * @param event_base   event base, or ESP_EVENT_ANY_BASE
+ * @param event_id     event id, or ESP_EVENT_ANY_ID
+ * @param handler      function to call
+ * @param handler_arg  first argument passed to the handler
+ *
+ * @return ESP_ERR_INVALID_STATE if the default loop doesn't exist, otherwise see esp_event_handler_register_with
+ */
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t handler, void* handler_arg);
+
+/**
+ * @brief Unregister a handler from the default loop, see esp_event_handler_unregister_with
+ *
+ * @param event_base  event base the handler was registered for
+ * @param event_id    event id the handler was registered for
+ * @param handler     handler to remove
+ *
+ * @return ESP_ERR_INVALID_STATE if the default loop doesn't exist, otherwise see esp_event_handler_unregister_with
+ */
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t handler);
+
+/**
+ * @brief Post an event to the default loop, see esp_event_post_to
+ *
+ * @param event_base       event base, not ESP_EVENT_ANY_BASE
+ * @param event_id         event id, not ESP_EVENT_ANY_ID
+ * @param event_data       event data, may be NULL
+ * @param event_data_size  size of data to copy, or 0 to pass the pointer
+ * @param ticks_to_wait    how long to wait if the queue is full
+ *
+ * @return ESP_ERR_INVALID_STATE if the default loop doesn't exist, otherwise see esp_event_post_to
+ */
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         void* event_data, size_t event_data_size, TickType_t ticks_to_wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_EVENT_LIB_H__ */
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_event_lib.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+ESP_EVENT_DEFINE_BASE(TEST_EVENT_BASE);
+
+typedef struct {
+    SemaphoreHandle_t done;
+    int sum;
+    TaskHandle_t task;
+} test_event_ctx_t;
+
+static void test_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    test_event_ctx_t* ctx = (test_event_ctx_t*) arg;
+    ctx->sum += *(int*) data;
+    ctx->task = xTaskGetCurrentTaskHandle();
+    if (id == 2) {
+        xSemaphoreGive(ctx->done);
+    }
+}
+
+TEST_CASE("event loop task calls handlers with copied data", "[event]")
+{
+    esp_event_loop_args_t args = {
+        .queue_size = 8,
+        .task_name = "test_evt",
+        .task_priority = 5,
+        .task_stack_size = 2048,
+        .task_core_id = tskNO_AFFINITY,
+    };
+    esp_event_loop_handle_t loop;
+    TEST_ESP_OK(esp_event_loop_create(&args, &loop));
+    test_event_ctx_t ctx = { .done = xSemaphoreCreateBinary() };
+    TEST_ESP_OK(esp_event_handler_register_with(loop, TEST_EVENT_BASE, ESP_EVENT_ANY_ID, test_handler, &ctx));
+    for (int i = 1; i <= 4; ++i) {
+        TEST_ESP_OK(esp_event_post_to(loop, TEST_EVENT_BASE, 1, &i, sizeof(i), portMAX_DELAY));
+    }
+    int last = 10;
+    TEST_ESP_OK(esp_event_post_to(loop, TEST_EVENT_BASE, 2, &last, sizeof(last), portMAX_DELAY));
+    last = 0;
+    TEST_ASSERT_TRUE(xSemaphoreTake(ctx.done, 100 / portTICK_PERIOD_MS));
+    TEST_ASSERT_EQUAL(20, ctx.sum);
+    TEST_ASSERT_NOT_EQUAL(xTaskGetCurrentTaskHandle(), ctx.task);
+    TEST_ESP_OK(esp_event_loop_delete(loop));
+    vSemaphoreDelete(ctx.done);
+}
+
+TEST_CASE("event loop without task is run by the caller", "[event]")
+{
+    esp_event_loop_args_t args = {
+        .queue_size = 8,
+    };
+    esp_event_loop_handle_t loop;
+    TEST_ESP_OK(esp_event_loop_create(&args, &loop));
+    test_event_ctx_t ctx = { .done = xSemaphoreCreateBinary() };
+    TEST_ESP_OK(esp_event_handler_register_with(loop, TEST_EVENT_BASE, 2, test_handler, &ctx));
+    int value = 7;
+    TEST_ESP_OK(esp_event_post_to(loop, TEST_EVENT_BASE, 1, &value, sizeof(value), 0));
+    TEST_ESP_OK(esp_event_post_to(loop, TEST_EVENT_BASE, 2, &value, sizeof(value), 0));
+    TEST_ESP_OK(esp_event_loop_run(loop, 0));
+    TEST_ASSERT_EQUAL(7, ctx.sum);
+    TEST_ASSERT_EQUAL(xTaskGetCurrentTaskHandle(), ctx.task);
+    TEST_ESP_OK(esp_event_handler_unregister_with(loop, TEST_EVENT_BASE, 2, test_handler));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_event_handler_unregister_with(loop, TEST_EVENT_BASE, 2, test_handler));
+    TEST_ESP_OK(esp_event_loop_delete(loop));
+    vSemaphoreDelete(ctx.done);
+}
@@ -0,0 +1,23 @@
+/* Host replacement for FreeRTOS.h and portmacro.h, with just enough of them
+   to build the event loop library. Tasks are backed by POSIX threads. */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                     ( ( BaseType_t ) 0 )
+#define pdTRUE                      ( ( BaseType_t ) 1 )
+#define pdPASS                      ( pdTRUE )
+#define pdFAIL                      ( pdFALSE )
+
+#define configTICK_RATE_HZ          1000
+#define configMAX_PRIORITIES        25
+#define portTICK_PERIOD_MS          ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portMAX_DELAY               ( TickType_t ) 0xffffffffUL
+
+#endif //INC_FREERTOS_H
@@ -0,0 +1,25 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Mutexes are recursive, binary semaphores are counting semaphores with a maximum of one */
+typedef struct host_semaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void );
+SemaphoreHandle_t xSemaphoreCreateBinary( void );
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore );
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t xMutex, TickType_t xBlockTime );
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t xMutex );
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore, TickType_t xBlockTime );
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SEMAPHORE_H
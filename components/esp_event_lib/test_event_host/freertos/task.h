@@ -0,0 +1,28 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include <limits.h>
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*TaskFunction_t)( void * );
+typedef struct host_task* TaskHandle_t;
+
+#define tskNO_AFFINITY INT_MAX
+
+BaseType_t xTaskCreatePinnedToCore( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                    void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask,
+                                    const BaseType_t xCoreID );
+void vTaskDelete( TaskHandle_t xTaskToDelete );
+void vTaskDelay( const TickType_t xTicksToDelay );
+TickType_t xTaskGetTickCount( void );
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INC_TASK_H
@@ -0,0 +1,243 @@
+/* Minimal POSIX thread based implementation of FreeRTOS APIs used by the event loop library */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t func;
+    void* arg;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+    uint8_t* items;
+};
+
+struct host_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+static __thread TaskHandle_t s_current_task;
+
+static void get_deadline(TickType_t ticks, struct timespec* deadline)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ticks / 1000;
+    deadline->tv_nsec += (ticks % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/* Wait on cond until woken up; returns false if the ticks have passed */
+static int wait_cond(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline)
+{
+    if (ticks == 0) {
+        return 0;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return 1;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static void* task_start(void* arg)
+{
+    s_current_task = (TaskHandle_t) arg;
+    s_current_task->func(s_current_task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                    void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask,
+                                    const BaseType_t xCoreID )
+{
+    TaskHandle_t task = (TaskHandle_t) calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->func = pvTaskCode;
+    task->arg = pvParameters;
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    if (pthread_create(&task->thread, NULL, &task_start, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete( TaskHandle_t xTaskToDelete )
+{
+    /* only deleting the calling task is supported */
+    free(s_current_task);
+    s_current_task = NULL;
+    pthread_exit(NULL);
+}
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    struct timespec ts = { .tv_sec = xTicksToDelay / 1000, .tv_nsec = (xTicksToDelay % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return s_current_task;
+}
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength, UBaseType_t uxItemSize )
+{
+    QueueHandle_t queue = (QueueHandle_t) calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = (uint8_t*) malloc(uxQueueLength * uxItemSize);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->item_size = uxItemSize;
+    queue->length = uxQueueLength;
+    return queue;
+}
+
+void vQueueDelete( QueueHandle_t xQueue )
+{
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->not_empty);
+    pthread_cond_destroy(&xQueue->not_full);
+    free(xQueue->items);
+    free(xQueue);
+}
+
+BaseType_t xQueueSendToBack( QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait )
+{
+    struct timespec deadline;
+    get_deadline(xTicksToWait, &deadline);
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length) {
+        if (!wait_cond(&xQueue->not_full, &xQueue->lock, xTicksToWait, &deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    size_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+    memcpy(xQueue->items + tail * xQueue->item_size, pvItemToQueue, xQueue->item_size);
+    xQueue->count++;
+    pthread_cond_signal(&xQueue->not_empty);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue, void * pvBuffer, TickType_t xTicksToWait )
+{
+    struct timespec deadline;
+    get_deadline(xTicksToWait, &deadline);
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0) {
+        if (!wait_cond(&xQueue->not_empty, &xQueue->lock, xTicksToWait, &deadline)) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    memcpy(pvBuffer, xQueue->items + xQueue->head * xQueue->item_size, xQueue->item_size);
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    pthread_cond_signal(&xQueue->not_full);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void )
+{
+    SemaphoreHandle_t mutex = (SemaphoreHandle_t) calloc(1, sizeof(*mutex));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+    SemaphoreHandle_t sem = (SemaphoreHandle_t) calloc(1, sizeof(*sem));
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    return sem;
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+    pthread_mutex_destroy(&xSemaphore->lock);
+    pthread_cond_destroy(&xSemaphore->cond);
+    free(xSemaphore);
+}
+
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t xMutex, TickType_t xBlockTime )
+{
+    pthread_mutex_lock(&xMutex->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t xMutex )
+{
+    pthread_mutex_unlock(&xMutex->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore, TickType_t xBlockTime )
+{
+    struct timespec deadline;
+    get_deadline(xBlockTime, &deadline);
+    pthread_mutex_lock(&xSemaphore->lock);
+    while (xSemaphore->count == 0) {
+        if (!wait_cond(&xSemaphore->cond, &xSemaphore->lock, xBlockTime, &deadline)) {
+            pthread_mutex_unlock(&xSemaphore->lock);
+            return pdFALSE;
+        }
+    }
+    xSemaphore->count = 0;
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    xSemaphore->count = 1;
+    pthread_cond_signal(&xSemaphore->cond);
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return pdTRUE;
+}
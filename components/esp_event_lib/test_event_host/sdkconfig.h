@@ -0,0 +1,3 @@
+/* Configuration used for host build of the event loop library */
+#define CONFIG_EVENT_LIB_DEFAULT_QUEUE_SIZE 32
+#define CONFIG_EVENT_LIB_DEFAULT_TASK_STACK_SIZE 2304
@@ -0,0 +1,285 @@
+#include "catch.hpp"
+#include "esp_event_lib.h"
+#include "freertos/task.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+
+ESP_EVENT_DEFINE_BASE(TEST_BASE);
+ESP_EVENT_DEFINE_BASE(OTHER_BASE);
+
+/* Loop without a task, dispatched by the test with esp_event_loop_run */
+class TestLoop
+{
+public:
+    TestLoop(const char* taskName = nullptr, int32_t queueSize = 16)
+    {
+        esp_event_loop_args_t args = {};
+        args.queue_size = queueSize;
+        args.task_name = taskName;
+        args.task_stack_size = 4096;
+        args.task_core_id = tskNO_AFFINITY;
+        REQUIRE(esp_event_loop_create(&args, &mHandle) == ESP_OK);
+    }
+
+    ~TestLoop()
+    {
+        CHECK(esp_event_loop_delete(mHandle) == ESP_OK);
+    }
+
+    operator esp_event_loop_handle_t()
+    {
+        return mHandle;
+    }
+
+protected:
+    esp_event_loop_handle_t mHandle;
+};
+
+/* Records the handler calls it receives */
+struct Recorder
+{
+    std::vector<std::string> calls;
+    std::vector<std::string> data;
+};
+
+static void record(Recorder* r, const char* name, esp_event_base_t base, int32_t id, void* data)
+{
+    r->calls.push_back(std::string(name) + ":" + base + ":" + std::to_string(id));
+    r->data.push_back(data ? std::string(static_cast<char*>(data)) : std::string("<null>"));
+}
+
+static void handlerA(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    record(static_cast<Recorder*>(arg), "A", base, id, data);
+}
+
+static void handlerB(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    record(static_cast<Recorder*>(arg), "B", base, id, data);
+}
+
+static void handlerC(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    record(static_cast<Recorder*>(arg), "C", base, id, data);
+}
+
+TEST_CASE("handlers are called for their event only", "[event]")
+{
+    TestLoop loop;
+    Recorder r;
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, handlerA, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 2, handlerB, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, OTHER_BASE, 1, handlerC, &r) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, OTHER_BASE, 1, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 3, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 2, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_loop_run(loop, 0) == ESP_OK);
+    CHECK(r.calls == std::vector<std::string>({ "A:TEST_BASE:1", "C:OTHER_BASE:1", "B:TEST_BASE:2" }));
+}
+
+TEST_CASE("specific handlers run before any id and any base handlers", "[event]")
+{
+    TestLoop loop;
+    Recorder r;
+    CHECK(esp_event_handler_register_with(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, handlerC, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, ESP_EVENT_ANY_ID, handlerB, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 5, handlerA, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 5, handlerC, &r) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 5, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, OTHER_BASE, 7, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_loop_run(loop, 0) == ESP_OK);
+    CHECK(r.calls == std::vector<std::string>({
+        "A:TEST_BASE:5", "C:TEST_BASE:5", "B:TEST_BASE:5", "C:TEST_BASE:5", "C:OTHER_BASE:7" }));
+}
+
+TEST_CASE("invalid registrations and posts are rejected", "[event]")
+{
+    TestLoop loop;
+    Recorder r;
+    CHECK(esp_event_handler_register_with(loop, ESP_EVENT_ANY_BASE, 1, handlerA, &r) == ESP_ERR_INVALID_ARG);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, nullptr, &r) == ESP_ERR_INVALID_ARG);
+    CHECK(esp_event_post_to(loop, ESP_EVENT_ANY_BASE, 1, nullptr, 0, 0) == ESP_ERR_INVALID_ARG);
+    CHECK(esp_event_post_to(loop, TEST_BASE, ESP_EVENT_ANY_ID, nullptr, 0, 0) == ESP_ERR_INVALID_ARG);
+    CHECK(esp_event_handler_unregister_with(loop, TEST_BASE, 1, handlerA) == ESP_ERR_NOT_FOUND);
+}
+
+TEST_CASE("registering a handler again replaces its argument", "[event]")
+{
+    TestLoop loop;
+    Recorder r1, r2;
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, handlerA, &r1) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, handlerA, &r2) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_loop_run(loop, 0) == ESP_OK);
+    CHECK(r1.calls.empty());
+    CHECK(r2.calls.size() == 1);
+}
+
+TEST_CASE("event data is copied or passed by pointer", "[event]")
+{
+    TestLoop loop;
+    Recorder r;
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, ESP_EVENT_ANY_ID, handlerA, &r) == ESP_OK);
+    char shortData[] = "short";
+    std::string longData(100, 'x');
+    std::vector<char> longCopy(longData.c_str(), longData.c_str() + longData.size() + 1);
+    char pointerData[] = "by pointer";
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, shortData, sizeof(shortData), 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 2, longCopy.data(), longCopy.size(), 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 3, pointerData, 0, 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 4, nullptr, 0, 0) == ESP_OK);
+    // copies are made when posting, the pointer is passed as is
+    strcpy(shortData, "SHORT");
+    longCopy.assign(longCopy.size(), '\0');
+    strcpy(pointerData, "changed");
+    CHECK(esp_event_loop_run(loop, 0) == ESP_OK);
+    CHECK(r.data == std::vector<std::string>({ "short", longData, "changed", "<null>" }));
+}
+
+struct Unregisterer
+{
+    esp_event_loop_handle_t loop;
+    Recorder* recorder;
+    int calls;
+};
+
+static void unregisterSelfAndNext(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    Unregisterer* u = static_cast<Unregisterer*>(arg);
+    ++u->calls;
+    CHECK(esp_event_handler_unregister_with(u->loop, base, id, unregisterSelfAndNext) == ESP_OK);
+    CHECK(esp_event_handler_unregister_with(u->loop, base, id, handlerB) == ESP_OK);
+    CHECK(esp_event_handler_register_with(u->loop, base, id + 1, handlerC, u->recorder) == ESP_OK);
+}
+
+TEST_CASE("handlers can register and unregister handlers of their loop", "[event]")
+{
+    TestLoop loop;
+    Recorder r;
+    Unregisterer u = { loop, &r, 0 };
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, unregisterSelfAndNext, &u) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, handlerB, &r) == ESP_OK);
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, handlerA, &r) == ESP_OK);
+    for (int i = 0; i < 2; ++i) {
+        CHECK(esp_event_post_to(loop, TEST_BASE, 1, nullptr, 0, 0) == ESP_OK);
+    }
+    CHECK(esp_event_post_to(loop, TEST_BASE, 2, nullptr, 0, 0) == ESP_OK);
+    CHECK(esp_event_loop_run(loop, 0) == ESP_OK);
+    CHECK(u.calls == 1);
+    CHECK(r.calls == std::vector<std::string>({ "A:TEST_BASE:1", "A:TEST_BASE:1", "C:TEST_BASE:2" }));
+}
+
+TEST_CASE("post times out when the queue is full", "[event]")
+{
+    TestLoop loop(nullptr, 2);
+    std::string data(64, 'd');
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, &data[0], data.size(), 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, &data[0], data.size(), 0) == ESP_OK);
+    CHECK(esp_event_post_to(loop, TEST_BASE, 1, &data[0], data.size(), 10) == ESP_ERR_TIMEOUT);
+    // the loop is deleted with heap copies still queued
+}
+
+TEST_CASE("run waits for events for the given time", "[event]")
+{
+    TestLoop loop;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(esp_event_loop_run(loop, 50) == ESP_OK);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(elapsed >= std::chrono::milliseconds(45));
+}
+
+TEST_CASE("default loop dispatches from its own task", "[event]")
+{
+    std::atomic<int> count(0);
+    auto handler = [](void* arg, esp_event_base_t base, int32_t id, void* data) {
+        *static_cast<std::atomic<int>*>(arg) += *static_cast<int*>(data);
+    };
+    CHECK(esp_event_post(TEST_BASE, 1, nullptr, 0, 0) == ESP_ERR_INVALID_STATE);
+    CHECK(esp_event_loop_create_default() == ESP_OK);
+    CHECK(esp_event_loop_create_default() == ESP_ERR_INVALID_STATE);
+    CHECK(esp_event_handler_register(TEST_BASE, 1, handler, &count) == ESP_OK);
+    for (int i = 1; i <= 10; ++i) {
+        CHECK(esp_event_post(TEST_BASE, 1, &i, sizeof(i), portMAX_DELAY) == ESP_OK);
+    }
+    for (int i = 0; i < 100 && count != 55; ++i) {
+        vTaskDelay(1);
+    }
+    CHECK(count == 55);
+    CHECK(esp_event_handler_unregister(TEST_BASE, 1, handler) == ESP_OK);
+    CHECK(esp_event_loop_delete_default() == ESP_OK);
+    CHECK(esp_event_loop_delete_default() == ESP_ERR_INVALID_STATE);
+}
+
+/* Benchmark: producers post events carrying the time they were posted, the
+ * dispatch task of the loop measures the latency until the handler runs. */
+struct LatencyStats
+{
+    std::atomic<int> count;
+    std::atomic<uint64_t> totalNs;
+};
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void latencyHandler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    LatencyStats* stats = static_cast<LatencyStats*>(arg);
+    uint64_t posted;
+    memcpy(&posted, data, sizeof(posted));
+    stats->totalNs += nowNs() - posted;
+    ++stats->count;
+}
+
+static void otherHandler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+}
+
+static void runLatencyBenchmark(int otherHandlers)
+{
+    const int producers = 2;
+    const int eventsPerProducer = 50000;
+    TestLoop loop("bench", 64);
+    LatencyStats stats;
+    stats.count = 0;
+    stats.totalNs = 0;
+    for (int i = 0; i < otherHandlers; ++i) {
+        CHECK(esp_event_handler_register_with(loop, (i % 2) ? TEST_BASE : OTHER_BASE, i + 100, otherHandler, nullptr) == ESP_OK);
+    }
+    CHECK(esp_event_handler_register_with(loop, TEST_BASE, 1, latencyHandler, &stats) == ESP_OK);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&loop]() {
+            for (int i = 0; i < eventsPerProducer; ++i) {
+                uint64_t t = nowNs();
+                esp_event_post_to(loop, TEST_BASE, 1, &t, sizeof(t), portMAX_DELAY);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    while (stats.count < producers * eventsPerProducer) {
+        std::this_thread::yield();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%5d other handlers: %.0f events/s, mean post-to-handler latency %.1f us\n",
+           otherHandlers, stats.count / elapsed, stats.totalNs / 1000.0 / stats.count);
+}
+
+TEST_CASE("benchmark post-to-handler throughput and latency", "[event][bench]")
+{
+    runLatencyBenchmark(0);
+    runLatencyBenchmark(100);
+    runLatencyBenchmark(10000);
+}
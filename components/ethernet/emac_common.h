@@ -16,14 +16,28 @@
 #define _EMAC_COMMON_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
+#include "esp_eth.h"
 #include "emac_dev.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if CONFIG_ETHERNET
+#define DMA_RX_BUF_NUM CONFIG_DMA_RX_BUF_NUM
+#define DMA_RX_LEND_BUF_NUM CONFIG_DMA_RX_LEND_BUF_NUM
+#define DMA_TX_BUF_NUM CONFIG_DMA_TX_BUF_NUM
+#else
+#define DMA_RX_BUF_NUM 1
+#define DMA_RX_LEND_BUF_NUM 0
+#define DMA_TX_BUF_NUM 1
+#endif
+#define DMA_RX_BUF_SIZE 1600
+#define DMA_TX_BUF_SIZE 1600
+
 typedef uint32_t emac_sig_t;
 typedef uint32_t emac_par_t;
 
@@ -64,10 +78,15 @@ struct emac_config_data {
     unsigned int cur_tx;
     unsigned int dirty_tx;
     signed int cnt_tx;
+    uint8_t *dma_tx_buf;                        /* copy buffer of each tx desc */
+    eth_tx_free_fun tx_free[DMA_TX_BUF_NUM];    /* set on the last desc of a frame */
+    void *tx_free_arg[DMA_TX_BUF_NUM];
     struct dma_extended_desc *dma_erx;
     unsigned int cur_rx;
     unsigned int dirty_rx;
-    signed int cnt_rx;
+    signed int cnt_rx;                          /* rx bufs lent to tcpip */
+    void *rx_spare_buf[DMA_RX_LEND_BUF_NUM + 1];
+    signed int cnt_rx_spare;
     unsigned int rx_need_poll;
     bool phy_link_up;
     enum emac_runtime_status emac_status;
@@ -88,8 +107,10 @@ struct emac_post_cmd {
 };
 
 struct emac_tx_cmd {
-    uint8_t *buf;
-    uint16_t size;
+    const eth_tx_seg_t *segs;
+    int count;
+    eth_tx_free_fun free_fun;
+    void *arg;
     int8_t err;
 };
 
@@ -100,15 +121,6 @@ struct emac_open_cmd {
 struct emac_close_cmd {
     int8_t err;
 };
-#if CONFIG_ETHERNET
-#define DMA_RX_BUF_NUM CONFIG_DMA_RX_BUF_NUM
-#define DMA_TX_BUF_NUM CONFIG_DMA_TX_BUF_NUM
-#else
-#define DMA_RX_BUF_NUM 1
-#define DMA_TX_BUF_NUM 1
-#endif
-#define DMA_RX_BUF_SIZE 1600
-#define DMA_TX_BUF_SIZE 1600
 
 //lwip err
 #define ERR_OK   0
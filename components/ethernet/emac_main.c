@@ -39,6 +39,7 @@
 
 #include "emac_common.h"
 #include "emac_desc.h"
+#include "emac_ring.h"
 
 #include "freertos/xtensa_api.h"
 #include "freertos/FreeRTOS.h"
@@ -54,7 +55,7 @@ static struct emac_config_data emac_config;
 
 static uint8_t emac_dma_rx_chain_buf[32 * DMA_RX_BUF_NUM];
 static uint8_t emac_dma_tx_chain_buf[32 * DMA_TX_BUF_NUM];
-static uint8_t emac_dma_rx_buf[DMA_RX_BUF_SIZE * DMA_RX_BUF_NUM];
+static uint8_t emac_dma_rx_buf[DMA_RX_BUF_SIZE * (DMA_RX_BUF_NUM + DMA_RX_LEND_BUF_NUM)];
 static uint8_t emac_dma_tx_buf[DMA_TX_BUF_SIZE * DMA_TX_BUF_NUM];
 
 static SemaphoreHandle_t emac_g_sem;
@@ -80,24 +81,6 @@ void esp_eth_get_mac(uint8_t mac[6])
     memcpy(mac, &(emac_config.macaddr[0]), 6);
 }
 
-static void emac_setup_tx_desc(struct dma_extended_desc *tx_desc , uint32_t size)
-{
-    tx_desc->basic.desc0 = EMAC_DESC_TX_OWN | EMAC_DESC_INT_COMPL | EMAC_DESC_LAST_SEGMENT | EMAC_DESC_FIRST_SEGMENT | EMAC_DESC_SECOND_ADDR_CHAIN;
-    tx_desc->basic.desc1 = size & 0xfff;
-}
-
-static void emac_clean_tx_desc(struct dma_extended_desc *tx_desc)
-{
-    tx_desc->basic.desc0 = 0;
-    tx_desc->basic.desc1 = 0;
-}
-
-static void emac_clean_rx_desc(struct dma_extended_desc *rx_desc)
-{
-    rx_desc->basic.desc0 = EMAC_DESC_RX_OWN;
-    rx_desc->basic.desc1 = EMAC_DESC_RX_SECOND_ADDR_CHAIN | DMA_RX_BUF_SIZE;
-}
-
 static void emac_set_tx_base_reg(void)
 {
     REG_WRITE(EMAC_DMATXBASEADDR_REG, (uint32_t)(emac_config.dma_etx));
@@ -108,66 +91,10 @@ static void emac_set_rx_base_reg(void)
     REG_WRITE(EMAC_DMARXBASEADDR_REG, (uint32_t)(emac_config.dma_erx));
 }
 
-static void emac_reset_dma_chain(void)
-{
-    emac_config.cnt_tx = 0;
-    emac_config.cur_tx = 0;
-    emac_config.dirty_tx = 0;
-
-    emac_config.cnt_rx = 0;
-    emac_config.cur_rx = 0;
-    emac_config.dirty_rx = 0;
-}
-
 static void emac_init_dma_chain(void)
 {
-    int i;
-    uint32_t dma_phy;
-    struct dma_extended_desc *p = NULL;
-
-    //init tx chain
-    emac_config.dma_etx = (struct dma_extended_desc *)(&emac_dma_tx_chain_buf[0]);
-    emac_config.cnt_tx = 0;
-    emac_config.cur_tx = 0;
-    emac_config.dirty_tx = 0;
-
-    dma_phy = (uint32_t)(emac_config.dma_etx);
-    p = emac_config.dma_etx;
-
-    for (i = 0; i < (DMA_TX_BUF_NUM - 1); i++ ) {
-        dma_phy += sizeof(struct dma_extended_desc);
-        emac_clean_tx_desc(p);
-        p->basic.desc3 = dma_phy;
-        p->basic.desc2 = (uint32_t)(&emac_dma_tx_buf[0]) + (i * DMA_TX_BUF_SIZE);
-        p++;
-    }
-    p->basic.desc3 = (uint32_t)(emac_config.dma_etx);
-    p->basic.desc2 = (uint32_t)(&emac_dma_tx_buf[0]) + (i * DMA_TX_BUF_SIZE);
-
-    //init desc0 desc1
-    emac_clean_tx_desc(p);
-
-    //init rx chain
-    emac_config.dma_erx = (struct dma_extended_desc *)(&emac_dma_rx_chain_buf[0]);
-    emac_config.cnt_rx = 0;
-    emac_config.cur_rx = 0;
-    emac_config.dirty_rx = 0;
-
-    dma_phy = (uint32_t)(emac_config.dma_erx);
-    p = emac_config.dma_erx;
-
-    for (i = 0; i < (DMA_TX_BUF_NUM - 1); i++ ) {
-        dma_phy += sizeof(struct dma_extended_desc);
-        emac_clean_rx_desc(p);
-        p->basic.desc3 = dma_phy;
-        p->basic.desc2 = (uint32_t)(&emac_dma_rx_buf[0]) + (i * DMA_RX_BUF_SIZE);
-        p++;
-    }
-    p->basic.desc3 = (uint32_t)(emac_config.dma_erx);
-    p->basic.desc2 = (uint32_t)(&emac_dma_rx_buf[0]) + (i * DMA_RX_BUF_SIZE);
-
-    //init desc0 desc1
-    emac_clean_rx_desc(p);
+    emac_ring_init(&emac_config, (struct dma_extended_desc *)(&emac_dma_tx_chain_buf[0]), &emac_dma_tx_buf[0],
+                   (struct dma_extended_desc *)(&emac_dma_rx_chain_buf[0]), &emac_dma_rx_buf[0]);
 }
 
 void esp_eth_smi_write(uint32_t reg_num, uint16_t value)
@@ -253,39 +180,44 @@ void emac_check_mac_addr(void)
 
 static void emac_process_tx(void)
 {
-    uint32_t cur_tx_desc = emac_read_tx_cur_reg();
-
-    while (((uint32_t) & (emac_config.dma_etx[emac_config.dirty_tx].basic.desc0) != cur_tx_desc)) {
-        emac_clean_tx_desc(&(emac_config.dma_etx[emac_config.dirty_tx]));
-        emac_config.dirty_tx = (emac_config.dirty_tx + 1) % DMA_TX_BUF_NUM;
-        emac_config.cnt_tx --;
-
-        if (emac_config.cnt_tx < 0) {
-            ESP_LOGE(TAG, "emac tx chain err");
-        }
-    }
+    emac_ring_tx_reclaim(&emac_config);
 }
 
 static void emac_process_rx(void)
 {
-    uint32_t cur_rx_desc = emac_read_rx_cur_reg();
+    struct dma_extended_desc *rx_desc;
+    uint16_t len;
+    void *buf;
 
-    while (((uint32_t) & (emac_config.dma_erx[emac_config.dirty_rx].basic.desc0) != cur_rx_desc)) {
-        //copy data to lwip
-        emac_config.emac_tcpip_input((void *)(emac_config.dma_erx[emac_config.dirty_rx].basic.desc2),
-                                     (((emac_config.dma_erx[emac_config.dirty_rx].basic.desc0) >> EMAC_DESC_FRAME_LENGTH_S) & EMAC_DESC_FRAME_LENGTH) , NULL);
+    while ((rx_desc = emac_ring_rx_take(&emac_config, &len)) != NULL) {
+        portENTER_CRITICAL(&g_emac_mux);
+        buf = emac_ring_rx_lend(&emac_config, rx_desc);
+        portEXIT_CRITICAL(&g_emac_mux);
+
+        if (buf != NULL) {
+            //the desc has a spare buf now, lend the frame to lwip
+            emac_ring_rx_return(&emac_config, rx_desc);
+            emac_config.emac_tcpip_input(buf, len, buf);
+        } else {
+            //no spare buf, lwip copies the frame
+            emac_config.emac_tcpip_input(EMAC_DMA_PTR(rx_desc->basic.desc2), len, NULL);
+            emac_ring_rx_return(&emac_config, rx_desc);
+        }
 
-        emac_clean_rx_desc(&(emac_config.dma_erx[emac_config.dirty_rx]));
-        emac_config.dirty_rx = (emac_config.dirty_rx + 1) % DMA_RX_BUF_NUM;
         if (emac_config.rx_need_poll != 0) {
             emac_poll_rx_cmd();
             emac_config.rx_need_poll = 0;
         }
-        //if open this ,one intr can do many intrs ?
-        //cur_rx_desc = emac_read_rx_cur_reg();
     }
 }
 
+void esp_eth_free_rx_buf(void *eb)
+{
+    portENTER_CRITICAL(&g_emac_mux);
+    emac_ring_rx_free(&emac_config, eb);
+    portEXIT_CRITICAL(&g_emac_mux);
+}
+
 //TODO other events need to do something
 static void IRAM_ATTR emac_process_intr(void *arg)
 {
@@ -295,14 +227,15 @@ static void IRAM_ATTR emac_process_intr(void *arg)
     //clr intrs
     REG_WRITE(EMAC_DMASTATUS_REG, event);
 
+    //tx bufs are only freed on tx done, none of the events may be lost
     if (event & EMAC_RECV_BUF_UNAVAIL) {
         emac_config.rx_need_poll = 1;
-    } else if (event & EMAC_TRANS_INT) {
+    }
+    if (event & EMAC_TRANS_INT) {
         emac_post(SIG_EMAC_TX_DONE, 0);
-    } else if (event & EMAC_RECV_INT) {
+    }
+    if (event & EMAC_RECV_INT) {
         emac_post(SIG_EMAC_RX_DONE, 0);
-    } else {
-        //other events
     }
 }
 
@@ -362,9 +295,6 @@ static esp_err_t emac_xmit(void *param)
     struct emac_tx_cmd *cmd = (struct emac_tx_cmd *)(post_cmd->cmd);
     esp_err_t ret = ESP_OK;
 
-    void *buf = cmd->buf;
-    uint16_t size = cmd->size;
-
     if (emac_config.emac_status != EMAC_RUNTIME_START || emac_config.emac_status == EMAC_RUNTIME_NOT_INIT) {
         ESP_LOGI(TAG, "tx netif close");
         cmd->err = ERR_IF;
@@ -372,20 +302,16 @@ static esp_err_t emac_xmit(void *param)
         goto _exit;
     }
 
-    if (emac_config.cnt_tx == DMA_TX_BUF_NUM) {
+    //the tx done event may not have been handled yet
+    emac_ring_tx_reclaim(&emac_config);
+
+    if (emac_ring_tx(&emac_config, cmd->segs, cmd->count, cmd->free_fun, cmd->arg) != ESP_OK) {
         ESP_LOGI(TAG, "tx buf full");
         cmd->err = ERR_MEM;
         ret = ESP_FAIL;
         goto _exit;
     }
 
-    memcpy((uint8_t *)(emac_config.dma_etx[emac_config.cur_tx].basic.desc2), (uint8_t *)buf, size);
-
-    emac_setup_tx_desc(&(emac_config.dma_etx[emac_config.cur_tx]), size);
-
-    emac_config.cnt_tx ++;
-    emac_config.cur_tx = (emac_config.cur_tx + 1) % DMA_TX_BUF_NUM ;
-
     emac_poll_tx_cmd();
 
 _exit:
@@ -544,7 +470,7 @@ static void emac_stop(void *param)
     emac_process_link_updown(false);
 
     emac_disable_intr();
-    emac_reset_dma_chain();
+    emac_ring_reset(&emac_config);
     emac_reset();
     emac_enable_clk(false);
 
@@ -627,6 +553,15 @@ static esp_err_t emac_ioctl(emac_sig_t sig, emac_par_t par)
 }
 
 esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size)
+{
+    eth_tx_seg_t seg;
+
+    seg.buf = buf;
+    seg.len = size;
+    return esp_eth_tx_sg(&seg, 1, NULL, NULL);
+}
+
+esp_err_t esp_eth_tx_sg(const eth_tx_seg_t *segs, int count, eth_tx_free_fun free_fun, void *arg)
 {
     struct emac_post_cmd post_cmd;
     struct emac_tx_cmd tx_cmd;
@@ -637,8 +572,10 @@ esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size)
         emac_process_link_updown(false);
         tx_cmd.err = ERR_IF;
     } else {
-        tx_cmd.buf = buf;
-        tx_cmd.size = size;
+        tx_cmd.segs = segs;
+        tx_cmd.count = count;
+        tx_cmd.free_fun = free_fun;
+        tx_cmd.arg = arg;
         tx_cmd.err = ERR_OK;
 
         if (emac_ioctl(SIG_EMAC_TX, (emac_par_t)(&post_cmd)) != 0) {
@@ -0,0 +1,272 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "emac_common.h"
+#include "emac_desc.h"
+#include "emac_ring.h"
+
+static uint8_t *emac_tx_copy_buf(struct emac_config_data *config, int i)
+{
+    return config->dma_tx_buf + i * DMA_TX_BUF_SIZE;
+}
+
+static void emac_setup_tx_desc(struct dma_extended_desc *tx_desc, void *buf, uint32_t size, uint32_t flags)
+{
+    tx_desc->basic.desc2 = EMAC_DMA_ADDR(buf);
+    tx_desc->basic.desc1 = size & EMAC_DESC_TX_BUFFER1_SIZE;
+    tx_desc->basic.desc0 = flags | EMAC_DESC_SECOND_ADDR_CHAIN;
+}
+
+static void emac_clean_tx_desc(struct dma_extended_desc *tx_desc)
+{
+    tx_desc->basic.desc0 = 0;
+    tx_desc->basic.desc1 = 0;
+}
+
+static void emac_clean_rx_desc(struct dma_extended_desc *rx_desc)
+{
+    rx_desc->basic.desc1 = EMAC_DESC_RX_SECOND_ADDR_CHAIN | DMA_RX_BUF_SIZE;
+    EMAC_DMA_BARRIER();
+    rx_desc->basic.desc0 = EMAC_DESC_RX_OWN;
+}
+
+/* tx_buf holds DMA_TX_BUF_NUM bufs, rx_buf DMA_RX_BUF_NUM + DMA_RX_LEND_BUF_NUM */
+void emac_ring_init(struct emac_config_data *config, struct dma_extended_desc *tx_desc, uint8_t *tx_buf,
+                    struct dma_extended_desc *rx_desc, uint8_t *rx_buf)
+{
+    int i;
+
+    //init tx chain
+    config->dma_etx = tx_desc;
+    config->dma_tx_buf = tx_buf;
+    config->cnt_tx = 0;
+    config->cur_tx = 0;
+    config->dirty_tx = 0;
+
+    for (i = 0; i < DMA_TX_BUF_NUM; i++) {
+        emac_clean_tx_desc(&tx_desc[i]);
+        tx_desc[i].basic.desc2 = EMAC_DMA_ADDR(emac_tx_copy_buf(config, i));
+        tx_desc[i].basic.desc3 = EMAC_DMA_ADDR(&tx_desc[(i + 1) % DMA_TX_BUF_NUM]);
+        config->tx_free[i] = NULL;
+        config->tx_free_arg[i] = NULL;
+    }
+
+    //init rx chain
+    config->dma_erx = rx_desc;
+    config->cnt_rx = 0;
+    config->cur_rx = 0;
+    config->dirty_rx = 0;
+
+    for (i = 0; i < DMA_RX_BUF_NUM; i++) {
+        rx_desc[i].basic.desc2 = EMAC_DMA_ADDR(rx_buf + i * DMA_RX_BUF_SIZE);
+        rx_desc[i].basic.desc3 = EMAC_DMA_ADDR(&rx_desc[(i + 1) % DMA_RX_BUF_NUM]);
+        emac_clean_rx_desc(&rx_desc[i]);
+    }
+
+    //bufs swapped into rx descs for frames lent to tcpip
+    config->cnt_rx_spare = 0;
+    for (i = 0; i < DMA_RX_LEND_BUF_NUM; i++) {
+        config->rx_spare_buf[config->cnt_rx_spare++] = rx_buf + (DMA_RX_BUF_NUM + i) * DMA_RX_BUF_SIZE;
+    }
+}
+
+/* Called with the dma stopped: frames waiting to be sent are dropped and the
+   dma starts again at the first desc of both rings. Frames lent to tcpip
+   stay lent. */
+void emac_ring_reset(struct emac_config_data *config)
+{
+    int i;
+
+    for (i = 0; i < DMA_TX_BUF_NUM; i++) {
+        if (config->tx_free[i] != NULL) {
+            config->tx_free[i](config->tx_free_arg[i]);
+            config->tx_free[i] = NULL;
+        }
+        emac_clean_tx_desc(&config->dma_etx[i]);
+    }
+    config->cnt_tx = 0;
+    config->cur_tx = 0;
+    config->dirty_tx = 0;
+
+    for (i = 0; i < DMA_RX_BUF_NUM; i++) {
+        emac_clean_rx_desc(&config->dma_erx[i]);
+    }
+    config->cur_rx = 0;
+    config->dirty_rx = 0;
+}
+
+/* Queues a frame for the dma, see esp_eth_tx_sg. Returns ESP_ERR_NO_MEM if
+   all tx descs are in use. */
+esp_err_t emac_ring_tx(struct emac_config_data *config, const eth_tx_seg_t *segs, int count,
+                       eth_tx_free_fun free_fun, void *arg)
+{
+    struct dma_extended_desc *tx_desc;
+    uint32_t flags;
+    uint8_t *buf;
+    int total = 0;
+    int num = 0;
+    int first = config->cur_tx;
+    int cur = first;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (segs[i].len != 0) {
+            total += segs[i].len;
+            num++;
+        }
+    }
+
+    if (num == 0 || total > DMA_TX_BUF_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (config->cnt_tx == DMA_TX_BUF_NUM) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (free_fun == NULL || num > DMA_TX_BUF_NUM - config->cnt_tx) {
+        //the pieces may go away on return or do not get a desc each, copy the frame
+        buf = emac_tx_copy_buf(config, cur);
+        total = 0;
+        for (i = 0; i < count; i++) {
+            memcpy(buf + total, segs[i].buf, segs[i].len);
+            total += segs[i].len;
+        }
+        emac_setup_tx_desc(&config->dma_etx[cur], buf, total,
+                           EMAC_DESC_FIRST_SEGMENT | EMAC_DESC_LAST_SEGMENT | EMAC_DESC_INT_COMPL);
+        num = 1;
+    } else {
+        for (i = 0; i < count; i++) {
+            if (segs[i].len == 0) {
+                continue;
+            }
+
+            buf = segs[i].buf;
+            if (!EMAC_DMA_CAPABLE(buf)) {
+                memcpy(emac_tx_copy_buf(config, cur), buf, segs[i].len);
+                buf = emac_tx_copy_buf(config, cur);
+            }
+
+            //OWN of the first desc is set when the whole frame is set up
+            flags = (cur == first) ? EMAC_DESC_FIRST_SEGMENT : EMAC_DESC_TX_OWN;
+            total -= segs[i].len;
+            if (total == 0) {
+                flags |= EMAC_DESC_LAST_SEGMENT | EMAC_DESC_INT_COMPL;
+            }
+            emac_setup_tx_desc(&config->dma_etx[cur], buf, segs[i].len, flags);
+
+            if (total != 0) {
+                cur = (cur + 1) % DMA_TX_BUF_NUM;
+            }
+        }
+    }
+
+    config->tx_free[cur] = free_fun;
+    config->tx_free_arg[cur] = arg;
+    config->cnt_tx += num;
+    config->cur_tx = (cur + 1) % DMA_TX_BUF_NUM;
+
+    tx_desc = &config->dma_etx[first];
+    EMAC_DMA_BARRIER();
+    tx_desc->basic.desc0 |= EMAC_DESC_TX_OWN;
+
+    return ESP_OK;
+}
+
+/* Frees the frames the dma has sent, returns the number of descs freed */
+int emac_ring_tx_reclaim(struct emac_config_data *config)
+{
+    struct dma_extended_desc *tx_desc;
+    int num = 0;
+
+    while (config->cnt_tx > 0) {
+        tx_desc = &config->dma_etx[config->dirty_tx];
+        if (tx_desc->basic.desc0 & EMAC_DESC_TX_OWN) {
+            break;
+        }
+
+        if (config->tx_free[config->dirty_tx] != NULL) {
+            config->tx_free[config->dirty_tx](config->tx_free_arg[config->dirty_tx]);
+            config->tx_free[config->dirty_tx] = NULL;
+        }
+        emac_clean_tx_desc(tx_desc);
+        config->dirty_tx = (config->dirty_tx + 1) % DMA_TX_BUF_NUM;
+        config->cnt_tx--;
+        num++;
+    }
+
+    return num;
+}
+
+/* Returns the desc of the next frame the dma has received and its length,
+   or NULL. Bad frames are given back to the dma on the way. The desc must be
+   given back with emac_ring_rx_return. */
+struct dma_extended_desc *emac_ring_rx_take(struct emac_config_data *config, uint16_t *len)
+{
+    struct dma_extended_desc *rx_desc;
+    uint32_t desc0;
+
+    for (;;) {
+        rx_desc = &config->dma_erx[config->dirty_rx];
+        desc0 = rx_desc->basic.desc0;
+        if (desc0 & EMAC_DESC_RX_OWN) {
+            return NULL;
+        }
+
+        config->dirty_rx = (config->dirty_rx + 1) % DMA_RX_BUF_NUM;
+
+        //a frame fits in one buf, anything else is an error
+        if ((desc0 & EMAC_DESC_ERROR_SUMMARY) ||
+                (desc0 & (EMAC_DESC_FRIST_DESC | EMAC_DESC_LAST_DESC)) != (EMAC_DESC_FRIST_DESC | EMAC_DESC_LAST_DESC)) {
+            emac_clean_rx_desc(rx_desc);
+            continue;
+        }
+
+        *len = (desc0 >> EMAC_DESC_FRAME_LENGTH_S) & EMAC_DESC_FRAME_LENGTH;
+        return rx_desc;
+    }
+}
+
+/* Swaps a spare buf into the desc of a received frame and returns the buf of
+   the frame, which now belongs to the caller until emac_ring_rx_free. Returns
+   NULL if there is no spare buf. */
+void *emac_ring_rx_lend(struct emac_config_data *config, struct dma_extended_desc *rx_desc)
+{
+    void *buf;
+
+    if (config->cnt_rx_spare == 0) {
+        return NULL;
+    }
+
+    buf = EMAC_DMA_PTR(rx_desc->basic.desc2);
+    rx_desc->basic.desc2 = EMAC_DMA_ADDR(config->rx_spare_buf[--config->cnt_rx_spare]);
+    config->cnt_rx++;
+    return buf;
+}
+
+void emac_ring_rx_return(struct emac_config_data *config, struct dma_extended_desc *rx_desc)
+{
+    emac_clean_rx_desc(rx_desc);
+}
+
+void emac_ring_rx_free(struct emac_config_data *config, void *buf)
+{
+    config->rx_spare_buf[config->cnt_rx_spare++] = buf;
+    config->cnt_rx--;
+}
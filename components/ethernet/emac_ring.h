@@ -0,0 +1,68 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _EMAC_RING_H_
+#define _EMAC_RING_H_
+
+#include "emac_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Descriptor rings of the emac dma, without register access.
+ *
+ * A desc belongs to the dma while its OWN bit is set. The driver sets OWN
+ * to hand a desc over, the dma clears it when the desc is done, and neither
+ * touches a desc the other one owns. The dma goes through the ring in order
+ * and stops at the first desc it does not own.
+ *
+ * TX: each piece of a frame gets its own desc, pointing straight at the
+ * piece when the dma can read it and at the copy buffer of the desc
+ * otherwise. OWN of the first desc is set last, so the dma never starts a
+ * frame which is not complete.
+ *
+ * RX: a received frame is lent to tcpip by swapping a spare buffer into its
+ * desc, so the desc goes back to the dma at once. Without a spare buffer,
+ * the frame has to be copied before the desc goes back.
+ */
+
+/* Address of memory as seen by the dma, memory the dma can read, and
+   ordering of desc writes before OWN is handed over */
+#ifndef EMAC_DMA_ADDR
+#define EMAC_DMA_ADDR(ptr) ((uint32_t)(ptr))
+#define EMAC_DMA_PTR(addr) ((void *)(addr))
+#define EMAC_DMA_CAPABLE(ptr) ((uint32_t)(ptr) >= 0x3FFAE000 && (uint32_t)(ptr) < 0x40000000)
+#define EMAC_DMA_BARRIER() asm volatile ("memw" ::: "memory")
+#endif
+
+void emac_ring_init(struct emac_config_data *config, struct dma_extended_desc *tx_desc, uint8_t *tx_buf,
+                    struct dma_extended_desc *rx_desc, uint8_t *rx_buf);
+void emac_ring_reset(struct emac_config_data *config);
+
+esp_err_t emac_ring_tx(struct emac_config_data *config, const eth_tx_seg_t *segs, int count,
+                       eth_tx_free_fun free_fun, void *arg);
+int emac_ring_tx_reclaim(struct emac_config_data *config);
+
+struct dma_extended_desc *emac_ring_rx_take(struct emac_config_data *config, uint16_t *len);
+void *emac_ring_rx_lend(struct emac_config_data *config, struct dma_extended_desc *rx_desc);
+void emac_ring_rx_return(struct emac_config_data *config, struct dma_extended_desc *rx_desc);
+void emac_ring_rx_free(struct emac_config_data *config, void *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
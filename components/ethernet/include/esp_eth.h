@@ -25,6 +25,16 @@ extern "C" {
 typedef void (*eth_phy_fun)(void);
 typedef esp_err_t (*eth_tcpip_input_fun)(void *buffer, uint16_t len, void *eb);
 typedef void (*eth_gpio_config_func)(void);
+typedef void (*eth_tx_free_fun)(void *arg);
+
+/**
+ * @brief one piece of a frame sent with esp_eth_tx_sg
+ *
+ */
+typedef struct {
+    void *buf;                                  /*!< start address of the data */
+    uint16_t len;                               /*!< size (byte) of the data */
+} eth_tx_seg_t;
 
 typedef enum {
     ETH_MODE_RMII = 0,
@@ -83,6 +93,10 @@ typedef struct {
  *
  * @note   config can not be NULL,and phy chip must be suitable to phy init func.
  *
+ * @note   tcpip_input gets the eb of a frame which is lent to it, or NULL if
+ *         the frame is only valid until tcpip_input returns. A lent frame must
+ *         be given back with esp_eth_free_rx_buf(eb).
+ *
  * @param[in] config  mac init data.
  *
  * @return
@@ -106,6 +120,35 @@ esp_err_t esp_eth_init(eth_config_t *config);
  */
 esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size);
 
+/**
+ * @brief  Send a frame made of several pieces from tcp/ip to mac
+ *
+ * @note   The pieces are sent without copying when there are enough tx bufs.
+ *         They must stay valid until free_fun(arg) is called, which happens
+ *         once the mac has sent the frame. If free_fun is NULL, the pieces are
+ *         copied and only need to be valid until esp_eth_tx_sg returns.
+ *
+ * @param[in] segs:  pieces of the frame, the total size must be less than 1580
+ *
+ * @param[in] count:  number of pieces
+ *
+ * @param[in] free_fun:  called when the pieces are not used any more
+ *
+ * @param[in] arg:  argument of free_fun
+ *
+ * @return
+ *      - ESP_OK: the frame is sent, free_fun will be called
+ *      - ESP_FAIL: the frame is dropped, free_fun will not be called
+ */
+esp_err_t esp_eth_tx_sg(const eth_tx_seg_t *segs, int count, eth_tx_free_fun free_fun, void *arg);
+
+/**
+ * @brief  Give back a frame which was lent to tcpip_input
+ *
+ * @param[in] eb:  the eb tcpip_input got with the frame
+ */
+void esp_eth_free_rx_buf(void *eb);
+
 /**
  * @brief  Enable ethernet interface
  *
@@ -0,0 +1,42 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _EMAC_SIM_H_
+#define _EMAC_SIM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Memory the simulated dma can reach. Descs hold 32 bit addresses, which
+   are offsets into this array on the host. */
+#define EMAC_SIM_DRAM_SIZE (64 * 1024)
+extern uint8_t emac_sim_dram[EMAC_SIM_DRAM_SIZE];
+
+/* Called where the driver orders its desc writes before handing OWN over,
+   lets a test run the dma at that point */
+extern void (*emac_sim_barrier_hook)(void);
+
+#define EMAC_DMA_ADDR(ptr) ((uint32_t)((uint8_t *)(ptr) - emac_sim_dram))
+#define EMAC_DMA_PTR(addr) ((void *)(emac_sim_dram + (addr)))
+#define EMAC_DMA_CAPABLE(ptr) ((uint8_t *)(ptr) >= emac_sim_dram && (uint8_t *)(ptr) < emac_sim_dram + EMAC_SIM_DRAM_SIZE)
+#define EMAC_DMA_BARRIER() do { if (emac_sim_barrier_hook) emac_sim_barrier_hook(); } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
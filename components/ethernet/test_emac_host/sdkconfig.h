@@ -0,0 +1,5 @@
+/* Small rings, so tests run into full rings and wrap around quickly */
+#define CONFIG_ETHERNET 1
+#define CONFIG_DMA_RX_BUF_NUM 4
+#define CONFIG_DMA_TX_BUF_NUM 4
+#define CONFIG_DMA_RX_LEND_BUF_NUM 2
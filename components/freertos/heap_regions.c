@@ -115,15 +115,34 @@
  */
 
 /*
-
-ToDo:
-- This malloc implementation can be somewhat slow, especially when it is called multiple times with multiple tags
-when having low memory issues. ToDo: Make it quicker.
- -JD
+ * Free blocks are kept in segregated lists (two-level segregated fit, as in TLSF).
+ * Each tag has its own set of lists. The first level divides block sizes into
+ * powers of two, the second level divides each power of two range into
+ * heapSL_INDEX_COUNT equal parts. Two levels of bitmaps record which lists are
+ * not empty, so that a list holding blocks big enough for a request is found
+ * with a couple of bit scans, no matter how many free blocks there are.
+ *
+ * The lists of a tag, together with the bitmaps, take 732 bytes. They are
+ * static, so regions keep all their memory for the heap, however small.
+ * End marker of each region points to the first block of the next region of
+ * the same tag, so that all blocks of a tag can be walked.
+ *
+ * Each block knows whether the block just before it in memory is free. A free
+ * block stores a pointer to its own BlockLink_t in its last word, so that a
+ * block being freed can find the free block before it and merge with it. A free
+ * block also stores a pointer to the previous block in its free list, right
+ * after its BlockLink_t. These fields live in memory which is returned to the
+ * application when the block is allocated, so allocated blocks carry the same
+ * header as before.
+ *
+ * With heap tracing enabled, header of each block also holds the address of the
+ * code which allocated it and the start of the name of the task, and the last
+ * allocations and frees are kept in a ring buffer.
  */
 
 
 #include <stdlib.h>
+#include <string.h>
 
 /* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
 all the API functions to use the MPU wrappers.  That should only be done when
@@ -146,28 +165,56 @@ task.h is included from an application file. */
 /* Assumes 8bit bytes! */
 #define heapBITS_PER_BYTE       ( ( size_t ) 8 )
 
-/* Define the linked list structure.  This is used to link free blocks in order
-   of their memory address. This is optimized for size of the linked list struct
+/* Define the linked list structure.  This is used to link free blocks of the
+   same size class. This is optimized for size of the linked list struct
    and assumes a region is never larger than 16MiB. */
 #define HEAPREGIONS_MAX_REGIONSIZE (16*1024*1024)
 typedef struct A_BLOCK_LINK
 {
     struct A_BLOCK_LINK *pxNextFreeBlock;   /*<< The next free block in the list. */
-    int xBlockSize: 24;                     /*<< The size of the free block. */
-    int xTag: 7;                            /*<< Tag of this region */
+    int xBlockSize: 24;                     /*<< The size of the block. */
+    int xTag: 6;                            /*<< Tag of this region */
+    unsigned xPrevFree: 1;                  /*<< 1 if the block just before this one is free */
     int xAllocated: 1;                      /*<< 1 if allocated */
+#if ( configENABLE_HEAP_TRACING == 1 )
+    void *pvCaller;                         /*<< Code which allocated the block */
+    uint32_t ulTask;                        /*<< First 4 chars of the name of the task which allocated the block, in one word for IRAM */
+#endif
 } BlockLink_t;
 
+/* Number of second level lists per first level, log2. */
+#define heapSL_INDEX_COUNT_LOG2     3
+#define heapSL_INDEX_COUNT          ( 1 << heapSL_INDEX_COUNT_LOG2 )
+
+/* Blocks are never smaller than 16 bytes, and block size field is 24 bits wide,
+   so first level index n holds blocks of 2^(n + heapFL_INDEX_SHIFT) bytes and more. */
+#define heapFL_INDEX_SHIFT          4
+#define heapFL_INDEX_COUNT          ( 24 - heapFL_INDEX_SHIFT )
+
+/* Free lists of one tag. */
+typedef struct
+{
+    uint32_t ulFLBitmap;                                                /*<< Bit n is set if any list of first level n is not empty */
+    uint32_t ulSLBitmap[ heapFL_INDEX_COUNT ];                          /*<< Bit m is set if list m of first level n is not empty */
+    BlockLink_t *pxFreeLists[ heapFL_INDEX_COUNT ][ heapSL_INDEX_COUNT ];
+    BlockLink_t *pxFirstBlock;                                          /*<< First block of the first region of the tag */
+    BlockLink_t *pxLastEnd;                                             /*<< End marker of the last region of the tag */
+} TagHeap_t;
+
+/* Fields of a free block which follow BlockLink_t and which end the block. */
+#define heapPREV_FREE_BLOCK( pxBlock )  ( *( BlockLink_t ** ) ( ( ( uint8_t * ) ( pxBlock ) ) + sizeof( BlockLink_t ) ) )
+#define heapNEXT_PHYS_BLOCK( pxBlock )  ( ( BlockLink_t * ) ( ( ( uint8_t * ) ( pxBlock ) ) + ( pxBlock )->xBlockSize ) )
+#define heapPREV_PHYS_BLOCK( pxBlock )  ( *( BlockLink_t ** ) ( ( ( uint8_t * ) ( pxBlock ) ) - BLOCK_HEAD_LEN - BLOCK_TAIL_LEN - sizeof( BlockLink_t * ) ) )
+
 //Mux to protect the memory status data
 static portMUX_TYPE xMallocMutex = portMUX_INITIALIZER_UNLOCKED;
 
 /*-----------------------------------------------------------*/
 
 /*
- * Inserts a block of memory that is being freed into the correct position in
- * the list of free memory blocks.  The block being freed will be merged with
- * the block in front it and/or the block behind it if the memory blocks are
- * adjacent to each other.
+ * Frees a block of memory, merging it with the block in front it and/or the
+ * block behind it if these are free, and inserts the result into the free list
+ * of its size.
  */
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert );
 
@@ -177,21 +224,192 @@ static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert );
 block must be correctly byte aligned. */
 static const uint32_t uxHeapStructSize  = ( ( sizeof ( BlockLink_t ) + BLOCK_HEAD_LEN + BLOCK_TAIL_LEN + ( portBYTE_ALIGNMENT - 1 ) ) & ~portBYTE_ALIGNMENT_MASK );
 
-/* Create a couple of list links to mark the start and end of the list. */
-static BlockLink_t xStart, *pxEnd = NULL;
+/* Free lists of each tag. */
+static TagHeap_t xTagHeaps[HEAPREGIONS_MAX_TAGCOUNT];
+
+/* Points into xTagHeaps for tags which have regions, NULL for other tags. */
+static TagHeap_t *pxTagHeaps[HEAPREGIONS_MAX_TAGCOUNT] = {0};
+
+/* End marker of the last region defined. */
+static BlockLink_t *pxEnd = NULL;
 
 /* Keeps track of the number of free bytes remaining, but says nothing about
 fragmentation. */
 static size_t xFreeBytesRemaining[HEAPREGIONS_MAX_TAGCOUNT] = {0};
 static size_t xMinimumEverFreeBytesRemaining[HEAPREGIONS_MAX_TAGCOUNT] = {0};
 
+#if ( configENABLE_HEAP_TRACING == 1 )
+/* Last allocations and frees. Event number n is kept at n % configHEAP_TRACING_EVENTS. */
+static HeapTraceEvent_t xHeapTrace[ configHEAP_TRACING_EVENTS ];
+static uint32_t ulHeapTraceCount = 0;
+#endif
+
+
+/*-----------------------------------------------------------*/
+
+/* Index of the most significant bit set; xValue must not be 0. */
+static inline int prvFls( uint32_t xValue )
+{
+    return 31 - __builtin_clz( xValue );
+}
+
+/* Find the free list which holds blocks of xSize bytes. */
+static inline void prvMapping( size_t xSize, int *pxFL, int *pxSL )
+{
+int fl = prvFls( ( uint32_t ) xSize );
+
+    *pxSL = ( int ) ( xSize >> ( fl - heapSL_INDEX_COUNT_LOG2 ) ) - heapSL_INDEX_COUNT;
+    *pxFL = fl - heapFL_INDEX_SHIFT;
+}
+/*-----------------------------------------------------------*/
+
+#if ( configENABLE_HEAP_TRACING == 1 )
+
+/* Copy first 4 characters of the name of the current task, padded with zeros. */
+static void prvGetTaskName( char *pcName )
+{
+TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+const char *pcTaskName = ( xTask != NULL ) ? pcTaskGetTaskName( xTask ) : "";
+int i;
+
+    for( i = 0; i < 4; i++ )
+    {
+        pcName[ i ] = *pcTaskName;
+        if( *pcTaskName != 0 )
+        {
+            pcTaskName++;
+        }
+    }
+}
+
+/* Must be called with the heap locked. */
+static void prvTraceEvent( uint8_t ucType, BaseType_t tag, const char *pcTask, size_t xSize, void *pvAddress, void *pvCaller )
+{
+HeapTraceEvent_t *pxEvent = &xHeapTrace[ ulHeapTraceCount % configHEAP_TRACING_EVENTS ];
+
+    pxEvent->ucType = ucType;
+    pxEvent->ucTag = ( uint8_t ) tag;
+    memcpy( pxEvent->acTask, pcTask, sizeof( pxEvent->acTask ) );
+    pxEvent->xSize = xSize;
+    pxEvent->pvAddress = pvAddress;
+    pxEvent->pvCaller = pvCaller;
+    ulHeapTraceCount++;
+}
+
+#endif
+/*-----------------------------------------------------------*/
+
+static void prvInsertFreeBlock( TagHeap_t *pxHeap, BlockLink_t *pxBlock )
+{
+int fl, sl;
+BlockLink_t *pxHead;
+
+    prvMapping( pxBlock->xBlockSize, &fl, &sl );
+    pxHead = pxHeap->pxFreeLists[ fl ][ sl ];
+    pxBlock->pxNextFreeBlock = pxHead;
+    heapPREV_FREE_BLOCK( pxBlock ) = NULL;
+    if( pxHead != NULL )
+    {
+        heapPREV_FREE_BLOCK( pxHead ) = pxBlock;
+    }
+    pxHeap->pxFreeLists[ fl ][ sl ] = pxBlock;
+    pxHeap->ulFLBitmap |= 1U << fl;
+    pxHeap->ulSLBitmap[ fl ] |= 1U << sl;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRemoveFreeBlock( TagHeap_t *pxHeap, BlockLink_t *pxBlock )
+{
+int fl, sl;
+BlockLink_t *pxPrev = heapPREV_FREE_BLOCK( pxBlock );
+BlockLink_t *pxNext = pxBlock->pxNextFreeBlock;
+
+    if( pxNext != NULL )
+    {
+        heapPREV_FREE_BLOCK( pxNext ) = pxPrev;
+    }
+    if( pxPrev != NULL )
+    {
+        pxPrev->pxNextFreeBlock = pxNext;
+    }
+    else
+    {
+        prvMapping( pxBlock->xBlockSize, &fl, &sl );
+        pxHeap->pxFreeLists[ fl ][ sl ] = pxNext;
+        if( pxNext == NULL )
+        {
+            pxHeap->ulSLBitmap[ fl ] &= ~( 1U << sl );
+            if( pxHeap->ulSLBitmap[ fl ] == 0 )
+            {
+                pxHeap->ulFLBitmap &= ~( 1U << fl );
+            }
+        }
+    }
+    pxBlock->pxNextFreeBlock = NULL;
+}
+/*-----------------------------------------------------------*/
+
+/* Find a free block of at least xWantedSize bytes, or return NULL. */
+static BlockLink_t *prvFindFreeBlock( TagHeap_t *pxHeap, size_t xWantedSize )
+{
+int fl, sl;
+uint32_t ulMap;
+BlockLink_t *pxBlock;
+
+    /* Look in lists of the next size class and above first: any block there
+    is big enough, so this takes the same time whatever the heap looks like. */
+    prvMapping( xWantedSize + ( ( ( size_t ) 1 << ( prvFls( ( uint32_t ) xWantedSize ) - heapSL_INDEX_COUNT_LOG2 ) ) - 1 ), &fl, &sl );
+    if( fl < heapFL_INDEX_COUNT )
+    {
+        ulMap = pxHeap->ulSLBitmap[ fl ] & ( ~0U << sl );
+        if( ulMap == 0 )
+        {
+            ulMap = ( fl + 1 < heapFL_INDEX_COUNT ) ? pxHeap->ulFLBitmap & ( ~0U << ( fl + 1 ) ) : 0;
+            if( ulMap != 0 )
+            {
+                fl = __builtin_ctz( ulMap );
+                ulMap = pxHeap->ulSLBitmap[ fl ];
+            }
+        }
+        if( ulMap != 0 )
+        {
+            return pxHeap->pxFreeLists[ fl ][ __builtin_ctz( ulMap ) ];
+        }
+    }
 
+    /* Only blocks of the size class of the request itself are left. Some of
+    them may still be big enough. */
+    prvMapping( xWantedSize, &fl, &sl );
+    for( pxBlock = pxHeap->pxFreeLists[ fl ][ sl ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+    {
+        if( ( size_t ) pxBlock->xBlockSize >= xWantedSize )
+        {
+            return pxBlock;
+        }
+    }
+    return NULL;
+}
 /*-----------------------------------------------------------*/
 
 void *pvPortMallocTagged( size_t xWantedSize, BaseType_t tag )
 {
-BlockLink_t *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
+    return pvPortMallocTaggedFrom( xWantedSize, tag, __builtin_return_address( 0 ) );
+}
+/*-----------------------------------------------------------*/
+
+void *pvPortMallocTaggedFrom( size_t xWantedSize, BaseType_t tag, void *pvCaller )
+{
+BlockLink_t *pxBlock, *pxNewBlockLink;
+TagHeap_t *pxHeap;
 void *pvReturn = NULL;
+#if ( configENABLE_HEAP_TRACING == 1 )
+size_t xRequestedSize = xWantedSize;
+char acTask[ 4 ];
+
+    prvGetTaskName( acTask );
+#else
+    ( void ) pvCaller;
+#endif
 
     /* The heap must be initialised before the first call to
     prvPortMalloc(). */
@@ -216,43 +434,38 @@ void *pvReturn = NULL;
             {
                mtCOVERAGE_TEST_MARKER();
             }
+
+            /* Block must be able to hold the free list links once it is freed. */
+            if( xWantedSize < heapMINIMUM_BLOCK_SIZE )
+            {
+                xWantedSize = heapMINIMUM_BLOCK_SIZE;
+            }
         }
         else
         {
            mtCOVERAGE_TEST_MARKER();
         }
 
-        if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining[ tag ] ) )
+        pxHeap = pxTagHeaps[ tag ];
+        if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining[ tag ] ) && ( pxHeap != NULL ) )
         {
-            /* Traverse the list from the start (lowest address) block until
-            one of adequate size is found. */
-            pxPreviousBlock = &xStart;
-            pxBlock = xStart.pxNextFreeBlock;
-            while( ( ( pxBlock->xTag != tag ) ||  ( pxBlock->xBlockSize < xWantedSize ) ) && ( pxBlock->pxNextFreeBlock != NULL ) )
-            {
-//             ets_printf("Block %x -> %x\n", (uint32_t)pxBlock, (uint32_t)pxBlock->pxNextFreeBlock);
+            pxBlock = prvFindFreeBlock( pxHeap, xWantedSize );
 
+            if( pxBlock != NULL )
+            {
                                     #if (configENABLE_MEMORY_DEBUG == 1)
                                     {
                                         mem_check_block(pxBlock);
                                     }
                                     #endif
 
-               pxPreviousBlock = pxBlock;
-               pxBlock = pxBlock->pxNextFreeBlock;
-            }
-
-            /* If the end marker was not reached then a block of adequate size
-            was found. */
-            if( pxBlock != pxEnd )
-            {
                 /* Return the memory space pointed to - jumping over the
                 BlockLink_t structure at its start. */
-                pvReturn = ( void * ) ( ( ( uint8_t * ) pxPreviousBlock->pxNextFreeBlock ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN);
+                pvReturn = ( void * ) ( ( ( uint8_t * ) pxBlock ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN);
 
                 /* This block is being returned for use so must be taken out
                 of the list of free blocks. */
-                pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+                prvRemoveFreeBlock( pxHeap, pxBlock );
 
                 /* If the block is larger than required it can be split into
                 two. */
@@ -269,6 +482,8 @@ void *pvReturn = NULL;
                     single block. */
                     pxNewBlockLink->xBlockSize = pxBlock->xBlockSize - xWantedSize;
                     pxNewBlockLink->xTag = tag;
+                    pxNewBlockLink->xAllocated = 0;
+                    pxNewBlockLink->xPrevFree = 0;
                     pxBlock->xBlockSize = xWantedSize;
 
                                             #if (configENABLE_MEMORY_DEBUG == 1)
@@ -278,12 +493,15 @@ void *pvReturn = NULL;
                                             #endif
 
 
-                    /* Insert the new block into the list of free blocks. */
-                    prvInsertBlockIntoFreeList( ( pxNewBlockLink ) );
+                    /* Insert the new block into the list of free blocks. The
+                    block after it already knows that a free block is in front
+                    of it. */
+                    heapPREV_PHYS_BLOCK( heapNEXT_PHYS_BLOCK( pxNewBlockLink ) ) = pxNewBlockLink;
+                    prvInsertFreeBlock( pxHeap, pxNewBlockLink );
                 }
                 else
                 {
-                    mtCOVERAGE_TEST_MARKER();
+                    heapNEXT_PHYS_BLOCK( pxBlock )->xPrevFree = 0;
                 }
 
                 xFreeBytesRemaining[ tag ] -= pxBlock->xBlockSize;
@@ -302,6 +520,16 @@ void *pvReturn = NULL;
                 pxBlock->xAllocated = 1;
                 pxBlock->pxNextFreeBlock = NULL;
 
+                #if ( configENABLE_HEAP_TRACING == 1 )
+                {
+                    uint32_t ulTask;
+                    memcpy( &ulTask, acTask, sizeof( ulTask ) );
+                    pxBlock->pvCaller = pvCaller;
+                    pxBlock->ulTask = ulTask;
+                    prvTraceEvent( HEAP_TRACE_MALLOC, tag, acTask, xRequestedSize, pvReturn, pvCaller );
+                }
+                #endif
+
                                     #if (configENABLE_MEMORY_DEBUG == 1)
                                     {
                                         mem_init_dog(pxBlock);
@@ -345,9 +573,18 @@ void vPortFreeTagged( void *pv )
 {
 uint8_t *puc = ( uint8_t * ) pv;
 BlockLink_t *pxLink;
+#if ( configENABLE_HEAP_TRACING == 1 )
+char acTask[ 4 ];
+#endif
 
     if( pv != NULL )
     {
+        #if ( configENABLE_HEAP_TRACING == 1 )
+        {
+            prvGetTaskName( acTask );
+        }
+        #endif
+
         /* The memory being freed will have an BlockLink_t structure immediately
         before it. */
         puc -= (uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN) ;
@@ -372,15 +609,20 @@ BlockLink_t *pxLink;
         {
             if( pxLink->pxNextFreeBlock == NULL )
             {
-                /* The block is being returned to the heap - it is no longer
-                allocated. */
-                pxLink->xAllocated = 0;
-
                 taskENTER_CRITICAL(&xMallocMutex);
                 {
+                    /* The block is being returned to the heap - it is no longer
+                    allocated. */
+                    pxLink->xAllocated = 0;
+
                     /* Add this block to the list of free blocks. */
                     xFreeBytesRemaining[ pxLink->xTag ] += pxLink->xBlockSize;
                     traceFREE( pv, pxLink->xBlockSize );
+                    #if ( configENABLE_HEAP_TRACING == 1 )
+                    {
+                        prvTraceEvent( HEAP_TRACE_FREE, pxLink->xTag, acTask, pxLink->xBlockSize - uxHeapStructSize, pv, NULL );
+                    }
+                    #endif
                     prvInsertBlockIntoFreeList( ( ( BlockLink_t * ) pxLink ) );
                 }
                 taskEXIT_CRITICAL(&xMallocMutex);
@@ -412,73 +654,52 @@ size_t xPortGetMinimumEverFreeHeapSizeTagged( BaseType_t tag )
 
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
 {
-BlockLink_t *pxIterator;
-uint8_t *puc;
-
-    /* Iterate through the list until a block is found that has a higher address
-    than the block being inserted. */
-    for( pxIterator = &xStart; pxIterator->pxNextFreeBlock < pxBlockToInsert; pxIterator = pxIterator->pxNextFreeBlock )
-    {
-        /* Nothing to do here, just iterate to the right position. */
-    }
+TagHeap_t *pxHeap = pxTagHeaps[ pxBlockToInsert->xTag ];
+BlockLink_t *pxNextBlock = heapNEXT_PHYS_BLOCK( pxBlockToInsert );
+BlockLink_t *pxPrevBlock;
 
-    /* Do the block being inserted, and the block it is being inserted after
-    make a contiguous block of memory, and are the tags the same? */
-    puc = ( uint8_t * ) pxIterator;
-    if( ( puc + pxIterator->xBlockSize ) == ( uint8_t * ) pxBlockToInsert && pxBlockToInsert->xTag==pxIterator->xTag)
+    /* Is the block after the one being inserted free? End marker of the
+    region is never free, so blocks of different regions are not merged. */
+    if( pxNextBlock->xAllocated == 0 )
     {
-        pxIterator->xBlockSize += pxBlockToInsert->xBlockSize;
-        pxBlockToInsert = pxIterator;
+        prvRemoveFreeBlock( pxHeap, pxNextBlock );
+        pxBlockToInsert->xBlockSize += pxNextBlock->xBlockSize;
     }
     else
     {
         mtCOVERAGE_TEST_MARKER();
     }
 
-    /* Do the block being inserted, and the block it is being inserted before
-    make a contiguous block of memory, and are the tags the same */
-    puc = ( uint8_t * ) pxBlockToInsert;
-    if( ( puc + pxBlockToInsert->xBlockSize ) == ( uint8_t * ) pxIterator->pxNextFreeBlock && pxBlockToInsert->xTag==pxIterator->pxNextFreeBlock->xTag )
-    {
-        if( pxIterator->pxNextFreeBlock != pxEnd )
-        {
-            /* Form one big block from the two blocks. */
-            pxBlockToInsert->xBlockSize += pxIterator->pxNextFreeBlock->xBlockSize;
-            pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock->pxNextFreeBlock;
-        }
-        else
-        {
-            pxBlockToInsert->pxNextFreeBlock = pxEnd;
-        }
-    }
-    else
-    {
-        pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock;
-    }
-
-    /* If the block being inserted plugged a gap, so was merged with the block
-    before and the block after, then it's pxNextFreeBlock pointer will have
-    already been set, and should not be set here as that would make it point
-    to itself. */
-    if( pxIterator != pxBlockToInsert )
+    /* Is the block before the one being inserted free? */
+    if( pxBlockToInsert->xPrevFree != 0 )
     {
-        pxIterator->pxNextFreeBlock = pxBlockToInsert;
+        pxPrevBlock = heapPREV_PHYS_BLOCK( pxBlockToInsert );
+        prvRemoveFreeBlock( pxHeap, pxPrevBlock );
+        pxPrevBlock->xBlockSize += pxBlockToInsert->xBlockSize;
+        pxBlockToInsert = pxPrevBlock;
     }
     else
     {
         mtCOVERAGE_TEST_MARKER();
     }
+
+    prvInsertFreeBlock( pxHeap, pxBlockToInsert );
+
+    pxNextBlock = heapNEXT_PHYS_BLOCK( pxBlockToInsert );
+    heapPREV_PHYS_BLOCK( pxNextBlock ) = pxBlockToInsert;
+    pxNextBlock->xPrevFree = 1;
 }
 /*-----------------------------------------------------------*/
 
 void vPortDefineHeapRegionsTagged( const HeapRegionTagged_t * const pxHeapRegions )
 {
-BlockLink_t *pxFirstFreeBlockInRegion = NULL, *pxPreviousFreeBlock;
+BlockLink_t *pxFirstFreeBlockInRegion = NULL;
 uint8_t *pucAlignedHeap;
 size_t xTotalRegionSize, xTotalHeapSize = 0;
 BaseType_t xDefinedRegions = 0, xRegIdx = 0;
-uint32_t ulAddress;
+uintptr_t ulAddress;
 const HeapRegionTagged_t *pxHeapRegion;
+TagHeap_t *pxHeap;
 
     /* Can only call once! */
     configASSERT( pxEnd == NULL );
@@ -501,64 +722,65 @@ const HeapRegionTagged_t *pxHeapRegion;
         xTotalRegionSize = pxHeapRegion->xSizeInBytes;
 
         /* Ensure the heap region starts on a correctly aligned boundary. */
-        ulAddress = ( uint32_t ) pxHeapRegion->pucStartAddress;
+        ulAddress = ( uintptr_t ) pxHeapRegion->pucStartAddress;
         if( ( ulAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
         {
             ulAddress += ( portBYTE_ALIGNMENT - 1 );
-            ulAddress &= ~portBYTE_ALIGNMENT_MASK;
+            ulAddress &= ~( uintptr_t ) portBYTE_ALIGNMENT_MASK;
 
             /* Adjust the size for the bytes lost to alignment. */
-            xTotalRegionSize -= ulAddress - ( uint32_t ) pxHeapRegion->pucStartAddress;
+            xTotalRegionSize -= ulAddress - ( uintptr_t ) pxHeapRegion->pucStartAddress;
         }
 
         pucAlignedHeap = ( uint8_t * ) ulAddress;
 
-        /* Set xStart if it has not already been set. */
-        if( xDefinedRegions == 0 )
-        {
-            /* xStart is used to hold a pointer to the first item in the list of
-            free blocks.  The void cast is used to prevent compiler warnings. */
-            xStart.pxNextFreeBlock = ( BlockLink_t * ) (pucAlignedHeap + BLOCK_HEAD_LEN);
-            xStart.xBlockSize = ( size_t ) 0;
-        }
-        else
+        if( xDefinedRegions != 0 )
         {
-            /* Should only get here if one region has already been added to the
-            heap. */
-            configASSERT( pxEnd != NULL );
-
             /* Check blocks are passed in with increasing start addresses. */
-            configASSERT( ulAddress > ( uint32_t ) pxEnd );
+            configASSERT( ulAddress > ( uintptr_t ) pxEnd );
         }
 
-        /* Remember the location of the end marker in the previous region, if
-        any. */
-        pxPreviousFreeBlock = pxEnd;
+        pxHeap = pxTagHeaps[ pxHeapRegion->xTag ];
+        if( pxHeap == NULL )
+        {
+            pxHeap = &xTagHeaps[ pxHeapRegion->xTag ];
+            memset( pxHeap, 0, sizeof( TagHeap_t ) );
+            pxTagHeaps[ pxHeapRegion->xTag ] = pxHeap;
+        }
 
-        /* pxEnd is used to mark the end of the list of free blocks and is
-        inserted at the end of the region space. */
-        ulAddress = ( ( uint32_t ) pucAlignedHeap ) + xTotalRegionSize;
+        /* pxEnd is used to mark the end of the region. It looks like an
+        allocated block, so that free blocks are not merged with it. */
+        ulAddress = ( ( uintptr_t ) pucAlignedHeap ) + xTotalRegionSize;
         ulAddress -= uxHeapStructSize;
-        ulAddress &= ~portBYTE_ALIGNMENT_MASK;
+        ulAddress &= ~( uintptr_t ) portBYTE_ALIGNMENT_MASK;
         pxEnd = ( BlockLink_t * ) (ulAddress + BLOCK_HEAD_LEN);
         pxEnd->xBlockSize = 0;
         pxEnd->pxNextFreeBlock = NULL;
         pxEnd->xTag = -1;
+        pxEnd->xAllocated = 1;
 
         /* To start with there is a single free block in this region that is
         sized to take up the entire heap region minus the space taken by the
         free block structure. */
         pxFirstFreeBlockInRegion = ( BlockLink_t * ) (pucAlignedHeap + BLOCK_HEAD_LEN);
-        pxFirstFreeBlockInRegion->xBlockSize = ulAddress - ( uint32_t ) pxFirstFreeBlockInRegion + BLOCK_HEAD_LEN;
-        pxFirstFreeBlockInRegion->pxNextFreeBlock = pxEnd;
+        pxFirstFreeBlockInRegion->xBlockSize = ulAddress - ( uintptr_t ) pxFirstFreeBlockInRegion + BLOCK_HEAD_LEN;
         pxFirstFreeBlockInRegion->xTag=pxHeapRegion->xTag;
-
-        /* If this is not the first region that makes up the entire heap space
-        then link the previous region to this region. */
-        if( pxPreviousFreeBlock != NULL )
+        pxFirstFreeBlockInRegion->xAllocated = 0;
+        pxFirstFreeBlockInRegion->xPrevFree = 0;
+        prvInsertFreeBlock( pxHeap, pxFirstFreeBlockInRegion );
+        heapPREV_PHYS_BLOCK( pxEnd ) = pxFirstFreeBlockInRegion;
+        pxEnd->xPrevFree = 1;
+
+        /* Link the region to the previous region of this tag. */
+        if( pxHeap->pxLastEnd != NULL )
         {
-            pxPreviousFreeBlock->pxNextFreeBlock = pxFirstFreeBlockInRegion;
+            pxHeap->pxLastEnd->pxNextFreeBlock = pxFirstFreeBlockInRegion;
         }
+        else
+        {
+            pxHeap->pxFirstBlock = pxFirstFreeBlockInRegion;
+        }
+        pxHeap->pxLastEnd = pxEnd;
 
         xTotalHeapSize += pxFirstFreeBlockInRegion->xBlockSize;
         xMinimumEverFreeBytesRemaining[ pxHeapRegion->xTag ] += pxFirstFreeBlockInRegion->xBlockSize;
@@ -583,9 +805,137 @@ const HeapRegionTagged_t *pxHeapRegion;
 
         #if (configENABLE_MEMORY_DEBUG == 1)
         {
-            mem_debug_init(uxHeapStructSize, &xStart, pxEnd, &xMallocMutex);
+            mem_debug_init(uxHeapStructSize, &xMallocMutex);
             mem_check_all(0);
         }
         #endif
 }
+/*-----------------------------------------------------------*/
+
+size_t xPortGetLargestFreeBlockTagged( BaseType_t tag )
+{
+TagHeap_t *pxHeap = pxTagHeaps[ tag ];
+BlockLink_t *pxBlock;
+size_t xLargest = 0;
+int fl, sl;
+
+    taskENTER_CRITICAL(&xMallocMutex);
+    if( pxHeap != NULL && pxHeap->ulFLBitmap != 0 )
+    {
+        /* All blocks in the last non-empty list are bigger than the blocks in
+        other lists. */
+        fl = prvFls( pxHeap->ulFLBitmap );
+        sl = prvFls( pxHeap->ulSLBitmap[ fl ] );
+        for( pxBlock = pxHeap->pxFreeLists[ fl ][ sl ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+        {
+            if( ( size_t ) pxBlock->xBlockSize > xLargest )
+            {
+                xLargest = pxBlock->xBlockSize;
+            }
+        }
+        xLargest -= uxHeapStructSize;
+    }
+    taskEXIT_CRITICAL(&xMallocMutex);
+    return xLargest;
+}
+/*-----------------------------------------------------------*/
+
+void vPortWalkHeapTagged( BaseType_t tag, void ( *pxCallback )( const HeapBlockInfo_t *pxInfo, void *pvArg ), void *pvArg )
+{
+TagHeap_t *pxHeap = pxTagHeaps[ tag ];
+BlockLink_t *pxBlock;
+HeapBlockInfo_t xInfo;
+
+    if( pxHeap == NULL )
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&xMallocMutex);
+    pxBlock = pxHeap->pxFirstBlock;
+    while( pxBlock != NULL )
+    {
+        if( pxBlock->xBlockSize == 0 )
+        {
+            /* End marker of a region, continue with the next region */
+            pxBlock = pxBlock->pxNextFreeBlock;
+            continue;
+        }
+        xInfo.pvAddress = ( ( uint8_t * ) pxBlock ) + uxHeapStructSize - BLOCK_TAIL_LEN - BLOCK_HEAD_LEN;
+        xInfo.xSize = pxBlock->xBlockSize - uxHeapStructSize;
+        xInfo.xAllocated = ( pxBlock->xAllocated != 0 );
+        #if ( configENABLE_HEAP_TRACING == 1 )
+        if( xInfo.xAllocated )
+        {
+            uint32_t ulTask = pxBlock->ulTask;
+            xInfo.pvCaller = pxBlock->pvCaller;
+            memcpy( xInfo.acTask, &ulTask, sizeof( xInfo.acTask ) );
+        }
+        else
+        #endif
+        {
+            xInfo.pvCaller = NULL;
+            memset( xInfo.acTask, 0, sizeof( xInfo.acTask ) );
+        }
+        pxCallback( &xInfo, pvArg );
+        pxBlock = heapNEXT_PHYS_BLOCK( pxBlock );
+    }
+    taskEXIT_CRITICAL(&xMallocMutex);
+}
+/*-----------------------------------------------------------*/
+
+#if ( configENABLE_HEAP_TRACING == 1 )
+
+size_t xPortGetHeapTrace( HeapTraceEvent_t *pxEvents, uint32_t ulFirst, size_t xMaxEvents, uint32_t *pulCopiedFirst )
+{
+size_t xCount = 0;
+
+    taskENTER_CRITICAL(&xMallocMutex);
+    if( ulHeapTraceCount > configHEAP_TRACING_EVENTS && ulFirst < ulHeapTraceCount - configHEAP_TRACING_EVENTS )
+    {
+        ulFirst = ulHeapTraceCount - configHEAP_TRACING_EVENTS;
+    }
+    while( xCount < xMaxEvents && ulFirst + xCount < ulHeapTraceCount )
+    {
+        pxEvents[ xCount ] = xHeapTrace[ ( ulFirst + xCount ) % configHEAP_TRACING_EVENTS ];
+        xCount++;
+    }
+    taskEXIT_CRITICAL(&xMallocMutex);
+    if( pulCopiedFirst != NULL )
+    {
+        *pulCopiedFirst = ulFirst;
+    }
+    return xCount;
+}
+
+#endif
+/*-----------------------------------------------------------*/
+
+#if (configENABLE_MEMORY_DEBUG == 1)
+
+void mem_walk_free_blocks( void (*pxCallback)( void *pxBlock ) )
+{
+int fl, sl;
+BaseType_t tag;
+BlockLink_t *pxBlock;
+
+    for( tag = 0; tag < HEAPREGIONS_MAX_TAGCOUNT; tag++ )
+    {
+        if( pxTagHeaps[ tag ] == NULL )
+        {
+            continue;
+        }
+        for( fl = 0; fl < heapFL_INDEX_COUNT; fl++ )
+        {
+            for( sl = 0; sl < heapSL_INDEX_COUNT; sl++ )
+            {
+                for( pxBlock = pxTagHeaps[ tag ]->pxFreeLists[ fl ][ sl ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+                {
+                    pxCallback( pxBlock );
+                }
+            }
+        }
+    }
+}
 
+#endif
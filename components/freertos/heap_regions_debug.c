@@ -7,22 +7,20 @@
 
 #if (configENABLE_MEMORY_DEBUG == 1)
 
-static os_block_t g_malloc_list, *g_free_list=NULL, *g_end;
+static os_block_t g_malloc_list;
 static size_t g_heap_struct_size;
 static mem_dbg_ctl_t g_mem_dbg;
 char g_mem_print = 0;
 static portMUX_TYPE *g_malloc_mutex = NULL;
 #define MEM_DEBUG(...)
 
-void mem_debug_init(size_t size, void *start, void *end, portMUX_TYPE *mutex)
+void mem_debug_init(size_t size, portMUX_TYPE *mutex)
 {
-    MEM_DEBUG("size=%d start=%p end=%p mutex=%p%x\n", size, start, end, mutex);
+    MEM_DEBUG("size=%d mutex=%p\n", size, mutex);
     memset(&g_mem_dbg, 0, sizeof(g_mem_dbg));
     memset(&g_malloc_list, 0, sizeof(g_malloc_list));
     g_malloc_mutex = mutex;
     g_heap_struct_size = size;
-    g_free_list = start;
-    g_end = end;
 }
 
 void mem_debug_push(char type, void *addr)
@@ -109,10 +107,16 @@ void mem_init_dog(void *data)
     TAIL_DOG(b) = DEBUG_DOG_VALUE;
 }
 
-void mem_check_all(void* pv)
+static void mem_check_free_block(void *data)
 {
-    os_block_t *b;
+    os_block_t *b = (os_block_t*)data;
 
+    mem_check_block(b);
+    ets_printf("check b=%p size=%d ok\n", b, b->size);
+}
+
+void mem_check_all(void* pv)
+{
     if (pv){
         char *puc = (char*)(pv);
         os_block_t *b;
@@ -122,12 +126,7 @@ void mem_check_all(void* pv)
     }
 
     taskENTER_CRITICAL(g_malloc_mutex);
-    b = g_free_list->next;
-    while(b && b != g_end){
-        mem_check_block(b);
-        ets_printf("check b=%p size=%d ok\n", b, b->size);
-        b = b->next;
-    }
+    mem_walk_free_blocks(mem_check_free_block);
     taskEXIT_CRITICAL(g_malloc_mutex);
 }
 
@@ -188,8 +188,12 @@ extern "C" {
 	#define INCLUDE_xSemaphoreGetMutexHolder INCLUDE_xQueueGetMutexHolder
 #endif
 
+#ifndef configENABLE_HEAP_TRACING
+	#define configENABLE_HEAP_TRACING 0
+#endif
+
 #ifndef INCLUDE_pcTaskGetTaskName
-#if ( configENABLE_MEMORY_DEBUG == 1)
+#if ( configENABLE_MEMORY_DEBUG == 1 || configENABLE_HEAP_TRACING == 1 )
 	#define INCLUDE_pcTaskGetTaskName 1
 #else
 	#define INCLUDE_pcTaskGetTaskName 0
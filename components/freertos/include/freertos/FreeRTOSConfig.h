@@ -241,6 +241,13 @@
 #define configENABLE_MEMORY_DEBUG 0
 #endif
 
+#if CONFIG_HEAP_TRACING
+#define configENABLE_HEAP_TRACING 1
+#define configHEAP_TRACING_EVENTS CONFIG_HEAP_TRACING_EVENTS
+#else
+#define configENABLE_HEAP_TRACING 0
+#endif
+
 #define INCLUDE_xSemaphoreGetMutexHolder    1
 
 /* The priority at which the tick interrupt runs.  This should probably be
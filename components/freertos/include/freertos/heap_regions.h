@@ -58,6 +58,23 @@ void vPortDefineHeapRegionsTagged( const HeapRegionTagged_t * const pxHeapRegion
  */
 void *pvPortMallocTagged( size_t xWantedSize, BaseType_t tag );
 
+/**
+ * @brief Allocate memory from a region with a certain tag, on behalf of a caller
+ *
+ * Same as pvPortMallocTagged. If heap tracing is enabled, pvCaller is stored
+ * in the block header and reported as the call site of this allocation.
+ * Allocation functions layered on top of pvPortMallocTagged use this to report
+ * their own callers.
+ *
+ * @param  xWantedSize Size needed, in bytes
+ * @param  tag Tag of the memory region the allocation has to be from
+ * @param  pvCaller Address of the code which requested the memory
+ *
+ * @return Pointer to allocated memory if succesful.
+ *         NULL if unsuccesful.
+ */
+void *pvPortMallocTaggedFrom( size_t xWantedSize, BaseType_t tag, void *pvCaller );
+
 /**
  * @brief Free memory allocated with pvPortMallocTagged
  *
@@ -92,5 +109,74 @@ size_t xPortGetMinimumEverFreeHeapSizeTagged( BaseType_t tag );
  */
 size_t xPortGetFreeHeapSizeTagged( BaseType_t tag );
 
+/**
+ * @brief Get the size of the largest free block in a certain tagged region
+ *
+ * @param  tag Tag of the memory region
+ *
+ * @return Largest size which can be allocated from the tag at once
+ */
+size_t xPortGetLargestFreeBlockTagged( BaseType_t tag );
+
+/**
+ * @brief Description of a heap block, passed to the callback of vPortWalkHeapTagged
+ */
+typedef struct HeapBlockInfo
+{
+    void *pvAddress;                ///< Address of the block, as returned by pvPortMallocTagged
+    size_t xSize;                   ///< Size which can be used by the application
+    BaseType_t xAllocated;          ///< 1 if the block is allocated, 0 if it is free
+    void *pvCaller;                 ///< Code which allocated the block. NULL if block is free or heap tracing is disabled.
+    char acTask[ 4 ];               ///< Start of the name of the task which allocated the block, not null terminated
+} HeapBlockInfo_t;
+
+/**
+ * @brief Call a function for each block, allocated or free, in regions with a certain tag
+ *
+ * Blocks are reported in address order. The callback runs with the heap
+ * locked, so it must not allocate or free memory, and should return quickly.
+ *
+ * @param  tag Tag of the memory region
+ * @param  pxCallback Function to call for each block
+ * @param  pvArg Argument passed to the callback
+ */
+void vPortWalkHeapTagged( BaseType_t tag, void ( *pxCallback )( const HeapBlockInfo_t *pxInfo, void *pvArg ), void *pvArg );
+
+#if ( configENABLE_HEAP_TRACING == 1 )
+
+#define HEAP_TRACE_MALLOC   0   ///< Event type of an allocation
+#define HEAP_TRACE_FREE     1   ///< Event type of a free
+
+/**
+ * @brief Heap trace event
+ */
+typedef struct HeapTraceEvent
+{
+    uint8_t ucType;                 ///< HEAP_TRACE_MALLOC or HEAP_TRACE_FREE
+    uint8_t ucTag;                  ///< Tag of the block
+    char acTask[ 4 ];               ///< Start of the name of the task, not null terminated
+    size_t xSize;                   ///< Requested size for allocations, usable size of the block for frees
+    void *pvAddress;                ///< Address of the block
+    void *pvCaller;                 ///< Code which allocated the block; NULL for frees
+} HeapTraceEvent_t;
+
+/**
+ * @brief Copy events from the heap trace
+ *
+ * Trace holds the last configHEAP_TRACING_EVENTS allocations and frees. Events
+ * are numbered from 0 in the order they happened.
+ *
+ * @param  pxEvents Buffer for the events
+ * @param  ulFirst Number of the first event to copy. If that event was already
+ *                 dropped from the trace, copying starts with the oldest event kept.
+ * @param  xMaxEvents Size of the buffer
+ * @param  pulCopiedFirst Set to the number of the first event copied
+ *
+ * @return Number of events copied
+ */
+size_t xPortGetHeapTrace( HeapTraceEvent_t *pxEvents, uint32_t ulFirst, size_t xMaxEvents, uint32_t *pulCopiedFirst );
+
+#endif //configENABLE_HEAP_TRACING
+
 
 #endif
\ No newline at end of file
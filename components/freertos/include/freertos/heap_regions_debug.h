@@ -24,7 +24,8 @@ typedef struct {
 typedef struct _os_block_t {
     struct _os_block_t *next;               /*<< The next free block in the list. */
     int size: 24;                           /*<< The size of the free block. */
-    int xtag: 7;                            /*<< Tag of this region */
+    int xtag: 6;                            /*<< Tag of this region */
+    unsigned xPrevFree: 1;                  /*<< 1 if the block just before this one is free */
     int xAllocated: 1;                      /*<< 1 if allocated */
 }os_block_t;
 
@@ -61,10 +62,11 @@ typedef struct _mem_dbg_ctl{
 
 extern void mem_check_block(void * data);
 extern void mem_init_dog(void *data);
-extern void mem_debug_init(size_t size, void *start, void *end, portMUX_TYPE *mutex);
+extern void mem_debug_init(size_t size, portMUX_TYPE *mutex);
 extern void mem_malloc_block(void *data);
 extern void mem_free_block(void *data);
 extern void mem_check_all(void* pv);
+extern void mem_walk_free_blocks(void (*cb)(void *block));
 
 #else
 
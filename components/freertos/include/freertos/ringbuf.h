@@ -1,6 +1,10 @@
 #ifndef FREERTOS_RINGBUF_H
 #define FREERTOS_RINGBUF_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
 Header definitions for a FreeRTOS ringbuffer object
 
@@ -34,6 +38,15 @@ The maximum size of an item will be affected by this decision. When split items
 acceptable to push items of (buffer_size)-16 bytes into the buffer. When it's not allowed, the
 maximum size is (buffer_size/2)-8 bytes. The bytebuf can fill the entire buffer with data, it has
 no overhead.
+
+Items can also be built directly in ringbuffer memory, without a copy: xRingbufferSendAcquire reserves
+contiguous space for an item of the given size and xRingbufferSendComplete hands it over to the
+receivers. Items are still received in the order in which they were acquired, so an item which is
+acquired but not completed holds back the items after it. This works for RINGBUF_TYPE_NOSPLIT and
+RINGBUF_TYPE_ALLOWSPLIT buffers; acquired items are never split, so their size is limited by
+xRingbufferGetMaxAcquireSize.
+
+xRingbufferReceiveMultiple takes all available items, up to a given count, with one lock and wait.
 */
 
 //An opaque handle for a ringbuff object.
@@ -80,6 +93,16 @@ void vRingbufferDelete(RingbufHandle_t ringbuf);
 size_t xRingbufferGetMaxItemSize(RingbufHandle_t ringbuf);
 
 
+/**
+ * @brief  Get maximum size of an item that can be reserved with xRingbufferSendAcquire
+ *
+ * @param  ringbuf - Ring buffer to query
+ *
+ * @return Maximum size, in bytes, of an acquired item; 0 for RINGBUF_TYPE_BYTEBUF buffers.
+ */
+size_t xRingbufferGetMaxAcquireSize(RingbufHandle_t ringbuf);
+
+
 /**
  * @brief  Insert an item into the ring buffer
  *
@@ -107,6 +130,55 @@ BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, void *data, size_t data_size
  */
 BaseType_t xRingbufferSendFromISR(RingbufHandle_t ringbuf, void *data, size_t data_size, BaseType_t *higher_prio_task_awoken);
 
+/**
+ * @brief  Reserve space for an item in the ring buffer, to be written in place
+ *
+ * The item becomes visible to receivers when xRingbufferSendComplete is called for it.
+ *
+ * @param  ringbuf - Ring buffer to insert the item into
+ * @param  item - Pointer to a variable to which the address of the reserved space will be written.
+ *                The space is 32-bit aligned and contiguous.
+ * @param  item_size - Size of the item. A value of 0 is allowed.
+ * @param  ticks_to_wait - Ticks to wait for room in the ringbuffer.
+ *
+ * @return pdTRUE if succeeded, pdFALSE on time-out or when the item is larger
+ *         than indicated by xRingbufferGetMaxAcquireSize(ringbuf).
+ */
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t ringbuf, void **item, size_t item_size, TickType_t ticks_to_wait);
+
+/**
+ * @brief  Reserve space for an item in the ring buffer from an ISR
+ *
+ * @param  ringbuf - Ring buffer to insert the item into
+ * @param  item - Pointer to a variable to which the address of the reserved space will be written.
+ * @param  item_size - Size of the item. A value of 0 is allowed.
+ *
+ * @return pdTRUE if succeeded, pdFALSE when the ring buffer does not have space.
+ */
+BaseType_t xRingbufferSendAcquireFromISR(RingbufHandle_t ringbuf, void **item, size_t item_size);
+
+/**
+ * @brief  Pass an item reserved with xRingbufferSendAcquire on to the receivers
+ *
+ * @param  ringbuf - Ring buffer the item was acquired from
+ * @param  item - Address returned by xRingbufferSendAcquire
+ *
+ * @return pdTRUE
+ */
+BaseType_t xRingbufferSendComplete(RingbufHandle_t ringbuf, void *item);
+
+/**
+ * @brief  Pass an item reserved with xRingbufferSendAcquire on to the receivers, from an ISR
+ *
+ * @param  ringbuf - Ring buffer the item was acquired from
+ * @param  item - Address returned by xRingbufferSendAcquire or xRingbufferSendAcquireFromISR
+ * @param  higher_prio_task_awoken - Value pointed to will be set to pdTRUE if this woke up a higher
+ *                                     priority task.
+ *
+ * @return pdTRUE
+ */
+BaseType_t xRingbufferSendCompleteFromISR(RingbufHandle_t ringbuf, void *item, BaseType_t *higher_prio_task_awoken);
+
 /**
  * @brief  Retrieve an item from the ring buffer
  *
@@ -159,6 +231,37 @@ void *xRingbufferReceiveUpTo(RingbufHandle_t ringbuf, size_t *item_size, TickTyp
 void *xRingbufferReceiveUpToFromISR(RingbufHandle_t ringbuf, size_t *item_size, size_t wanted_size);
 
 
+/**
+ * @brief  Retrieve all available items, up to a maximum count, from the ring buffer
+ *
+ * Waits until at least one item is available. Each item has to be returned with
+ * vRingbufferReturnItem, or all of them at once with vRingbufferReturnItems.
+ * Not supported for RINGBUF_TYPE_BYTEBUF buffers.
+ *
+ * @param  ringbuf - Ring buffer to retrieve the items from
+ * @param  items - Array to which pointers to the retrieved items will be written
+ * @param  item_sizes - Array to which the sizes of the retrieved items will be written
+ * @param  max_items - Number of elements in items and item_sizes
+ * @param  ticks_to_wait - Ticks to wait for items in the ringbuffer.
+ *
+ * @return Number of items retrieved; 0 on timeout.
+ */
+UBaseType_t xRingbufferReceiveMultiple(RingbufHandle_t ringbuf, void **items, size_t *item_sizes, UBaseType_t max_items, TickType_t ticks_to_wait);
+
+
+/**
+ * @brief  Retrieve all available items, up to a maximum count, from the ring buffer. Call this from an ISR.
+ *
+ * @param  ringbuf - Ring buffer to retrieve the items from
+ * @param  items - Array to which pointers to the retrieved items will be written
+ * @param  item_sizes - Array to which the sizes of the retrieved items will be written
+ * @param  max_items - Number of elements in items and item_sizes
+ *
+ * @return Number of items retrieved; 0 when the ringbuffer is empty.
+ */
+UBaseType_t xRingbufferReceiveMultipleFromISR(RingbufHandle_t ringbuf, void **items, size_t *item_sizes, UBaseType_t max_items);
+
+
 
 /**
  * @brief  Return a previously-retrieved item to the ringbuffer
@@ -185,9 +288,21 @@ void vRingbufferReturnItem(RingbufHandle_t ringbuf, void *item);
 void vRingbufferReturnItemFromISR(RingbufHandle_t ringbuf, void *item, BaseType_t *higher_prio_task_awoken);
 
 
+/**
+ * @brief  Return several previously-retrieved items to the ringbuffer at once
+ *
+ * @param  ringbuf - Ring buffer the items were retrieved from
+ * @param  items - Items that were received earlier, e.g. by xRingbufferReceiveMultiple
+ * @param  count - Number of items
+ *
+ * @return void
+ */
+void vRingbufferReturnItems(RingbufHandle_t ringbuf, void **items, UBaseType_t count);
+
+
 /**
  * @brief  Add the ringbuffer to a queue set. This specifically adds the semaphore that indicates
- *         more space has become available in the ringbuffer.
+ *         something has been written into the ringbuffer, by a send or a completed acquire.
  *
  * @param  ringbuf - Ring buffer to add to the queue set
  * @param  xQueueSet - Queue set to add the ringbuffer to
@@ -199,7 +314,7 @@ BaseType_t xRingbufferAddToQueueSetRead(RingbufHandle_t ringbuf, QueueSetHandle_
 
 /**
  * @brief  Add the ringbuffer to a queue set. This specifically adds the semaphore that indicates
- *         something has been written into the ringbuffer.
+ *         more space has become available in the ringbuffer.
  *
  * @param  ringbuf - Ring buffer to add to the queue set
  * @param  xQueueSet - Queue set to add the ringbuffer to
@@ -211,7 +326,7 @@ BaseType_t xRingbufferAddToQueueSetWrite(RingbufHandle_t ringbuf, QueueSetHandle
 
 /**
  * @brief  Remove the ringbuffer from a queue set. This specifically removes the semaphore that indicates
- *         more space has become available in the ringbuffer.
+ *         something has been written into the ringbuffer.
  *
  * @param  ringbuf - Ring buffer to remove from the queue set
  * @param  xQueueSet - Queue set to remove the ringbuffer from
@@ -223,7 +338,7 @@ BaseType_t xRingbufferRemoveFromQueueSetRead(RingbufHandle_t ringbuf, QueueSetHa
 
 /**
  * @brief  Remove the ringbuffer from a queue set. This specifically removes the semaphore that indicates
- *         something has been written to the ringbuffer.
+ *         more space has become available in the ringbuffer.
  *
  * @param  ringbuf - Ring buffer to remove from the queue set
  * @param  xQueueSet - Queue set to remove the ringbuffer from
@@ -233,6 +348,30 @@ BaseType_t xRingbufferRemoveFromQueueSetRead(RingbufHandle_t ringbuf, QueueSetHa
 BaseType_t xRingbufferRemoveFromQueueSetWrite(RingbufHandle_t ringbuf, QueueSetHandle_t xQueueSet);
 
 
+/**
+ * @brief  Check if a member returned by xQueueSelectFromSet is the read semaphore of the ringbuffer,
+ *         i.e. if items can be received from it
+ *
+ * @param  ringbuf - Ring buffer added to the queue set with xRingbufferAddToQueueSetRead
+ * @param  member - Member returned by xQueueSelectFromSet
+ *
+ * @return pdTRUE if the member belongs to the ringbuffer, pdFALSE otherwise
+ */
+BaseType_t xRingbufferCanRead(RingbufHandle_t ringbuf, QueueSetMemberHandle_t member);
+
+
+/**
+ * @brief  Check if a member returned by xQueueSelectFromSet is the write semaphore of the ringbuffer,
+ *         i.e. if space has been freed for sending or acquiring an item
+ *
+ * @param  ringbuf - Ring buffer added to the queue set with xRingbufferAddToQueueSetWrite
+ * @param  member - Member returned by xQueueSelectFromSet
+ *
+ * @return pdTRUE if the member belongs to the ringbuffer, pdFALSE otherwise
+ */
+BaseType_t xRingbufferCanWrite(RingbufHandle_t ringbuf, QueueSetMemberHandle_t member);
+
+
 /**
  * @brief  Debugging function to print the internal pointers in the ring buffer
  *
@@ -242,5 +381,8 @@ BaseType_t xRingbufferRemoveFromQueueSetWrite(RingbufHandle_t ringbuf, QueueSetH
  */
 void xRingbufferPrintInfo(RingbufHandle_t ringbuf);
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,115 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef FREERTOS_RINGBUF_CORE_H
+#define FREERTOS_RINGBUF_CORE_H
+
+/*
+Internal header: storage management of the ringbuffer, used by ringbuf.c.
+
+The functions here only move the read, write and free pointers and copy data;
+they don't lock or block. ringbuf.c calls them from within a muxed section and
+adds the semaphores which let tasks wait for items or free space. Keeping this
+part free of RTOS calls allows it to be built and benchmarked on the host.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    flag_allowsplit = 1,
+    flag_bytebuf = 2,
+} rbflag_t;
+
+typedef struct ringbuf_core_t ringbuf_core_t;
+
+struct ringbuf_core_t {
+    size_t size;                                //Size of the data storage
+    uint8_t *write_ptr;                         //Pointer where the next item is written
+    uint8_t *read_ptr;                          //Pointer from where the next item is read
+    uint8_t *free_ptr;                          //Pointer to the last block that hasn't been given back to the ringbuffer yet
+    uint8_t *data;                              //Data storage
+    rbflag_t flags;
+    size_t maxItemSize;
+    size_t maxAcquireSize;                      //Largest item ringbufCoreAcquire can reserve, 0 if not supported
+   //The following keep function pointers to hold different implementations for ringbuffer management.
+    BaseType_t (*copyItemToRingbufImpl)(ringbuf_core_t *rb, const uint8_t *buffer, size_t buffer_size);
+    uint8_t *(*getItemFromRingbufImpl)(ringbuf_core_t *rb, size_t *length, int wanted_length);
+    void (*returnItemToRingbufImpl)(ringbuf_core_t *rb, void *item);
+};
+
+/**
+ * @brief  Set up a ringbuffer in the given storage
+ *
+ * @return pdTRUE on success, pdFALSE if the type is not valid
+ */
+BaseType_t ringbufCoreInit(ringbuf_core_t *rb, uint8_t *data, size_t size, ringbuf_type_t type);
+
+/**
+ * @brief  Bytes which can be written before the buffer is full, not counting item headers
+ */
+size_t ringbufCoreFreeMem(const ringbuf_core_t *rb);
+
+/**
+ * @brief  Copy an item into the buffer
+ *
+ * @return pdTRUE on success, pdFALSE if there is not enough space for it at the moment
+ */
+BaseType_t ringbufCoreSend(ringbuf_core_t *rb, const void *data, size_t data_size);
+
+/**
+ * @brief  Reserve contiguous space for an item, to be filled in by the caller
+ *
+ * The item is not visible to readers, and items sent after it are held back,
+ * until ringbufCoreComplete is called for it.
+ *
+ * @return pointer to the reserved space, or NULL if there is not enough space at the moment
+ */
+void *ringbufCoreAcquire(ringbuf_core_t *rb, size_t item_size);
+
+/**
+ * @brief  Make an item reserved with ringbufCoreAcquire visible to readers
+ */
+void ringbufCoreComplete(ringbuf_core_t *rb, void *item);
+
+/**
+ * @brief  Retrieve the next item, or NULL if there is none (see getItemFromRingbufImpl)
+ */
+void *ringbufCoreReceive(ringbuf_core_t *rb, size_t *item_size, size_t wanted_size);
+
+/**
+ * @brief  Retrieve up to max_items items at once
+ *
+ * wanted_size limits the size of each item, as for ringbufCoreReceive.
+ *
+ * @return number of items stored in items and item_sizes
+ */
+size_t ringbufCoreReceiveMultiple(ringbuf_core_t *rb, void **items, size_t *item_sizes, size_t max_items, size_t wanted_size);
+
+/**
+ * @brief  Give back the storage of an item which has been received
+ */
+void ringbufCoreReturn(ringbuf_core_t *rb, void *item);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,464 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FreeRTOS.h"
+#include "ringbuf_core.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    iflag_free = 1,             //Buffer is not read and given back by application, free to overwrite
+    iflag_dummydata = 2,        //Data from here to end of ringbuffer is dummy. Restart reading at start of ringbuffer.
+    iflag_acquired = 4,         //Space reserved by ringbufCoreAcquire, data is still being written. Reading stops here.
+} itemflag_t;
+
+
+//The header prepended to each ringbuffer entry. Size is assumed to be a multiple of 32bits.
+typedef struct {
+    size_t len;
+    itemflag_t flags;
+} buf_entry_hdr_t;
+
+
+//Calculate space free in the buffer
+static int ringbufferFreeMem(const ringbuf_core_t *rb)
+{
+    int free_size = rb->free_ptr-rb->write_ptr;
+    if (free_size <= 0) free_size += rb->size;
+    //Reserve one byte. If we do not do this and the entire buffer is filled, we get a situation 
+    //where read_ptr == free_ptr, messing up the next calculation.
+    return free_size-1;
+}
+
+
+//Reserves room for a single item in the ring buffer; refuses to split items. Writes the item header with the
+//given flags and increases write_ptr to the next item. Returns a pointer to where the item data goes, or NULL
+//if it can't make the item fit and the calling routine needs to retry later or fail.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static uint8_t *allocItemNoSplit(ringbuf_core_t *rb, size_t buffer_size, itemflag_t flags)
+{
+    size_t rbuffer_size;
+    rbuffer_size=(buffer_size+3)&~3; //Payload length, rounded to next 32-bit value
+    configASSERT(((uintptr_t)rb->write_ptr&3)==0); //write_ptr needs to be 32-bit aligned
+    configASSERT((rb->data+rb->size)-rb->write_ptr >= sizeof(buf_entry_hdr_t)); //need to have at least the size 
+                                            //of a header to the end of the ringbuff
+    size_t rem_len=(rb->data + rb->size) - rb->write_ptr; //length remaining until end of ringbuffer
+    
+    //See if we have enough contiguous space to write the buffer.
+    if (rem_len < rbuffer_size + sizeof(buf_entry_hdr_t)) {
+        //Buffer plus header is not going to fit in the room from wr_pos to the end of the 
+        //ringbuffer... but we're not allowed to split the buffer. We need to fill the 
+        //rest of the ringbuffer with a dummy item so we can place the data at the _start_ of
+        //the ringbuffer..
+        //First, find out if we actually have enough space at the start of the ringbuffer to
+        //make this work (Again, we need 4 bytes extra because otherwise read_ptr==free_ptr)
+        if (rb->free_ptr-rb->data < rbuffer_size+sizeof(buf_entry_hdr_t)+4) {
+            //Will not fit.
+            return NULL;
+        }
+        //If the read buffer hasn't wrapped around yet, there's no way this will work either.
+        if (rb->free_ptr > rb->write_ptr) {
+            //No luck.
+            return NULL;
+        }
+
+        //Okay, it will fit. Mark the rest of the ringbuffer space with a dummy packet.
+        buf_entry_hdr_t *hdr=(buf_entry_hdr_t *)rb->write_ptr;
+        hdr->flags=iflag_dummydata;
+        //Reset the write pointer to the start of the ringbuffer so the code later on can
+        //happily write the data.
+        rb->write_ptr=rb->data;
+    } else {
+        //No special handling needed. Checking if it's gonna fit probably still is a good idea.
+        //If less than a header remains after the item, the write pointer skips to the start of the
+        //ringbuffer, so that tail is used up as well; it must not end up on the free pointer.
+        size_t needed=sizeof(buf_entry_hdr_t)+rbuffer_size;
+        if (rem_len-needed < sizeof(buf_entry_hdr_t)) needed=rem_len;
+        if (ringbufferFreeMem(rb) < needed) {
+            //Buffer is not going to fit, period.
+            return NULL;
+        }
+    }
+
+    //If we are here, the buffer is guaranteed to fit in the space starting at the write pointer.
+    buf_entry_hdr_t *hdr=(buf_entry_hdr_t *)rb->write_ptr;
+    hdr->len=buffer_size;
+    hdr->flags=flags;
+    rb->write_ptr+=sizeof(buf_entry_hdr_t);
+    uint8_t *item=rb->write_ptr;
+    rb->write_ptr+=rbuffer_size;
+
+    //The buffer will wrap around if we don't have room for a header anymore.
+    if ((rb->data+rb->size)-rb->write_ptr < sizeof(buf_entry_hdr_t)) {
+        //'Forward' the write buffer until we are at the start of the ringbuffer.
+        //The read pointer will always be at the start of a full header, which cannot 
+        //exist at the point of the current write pointer, so there's no chance of overtaking
+        //that.
+        rb->write_ptr=rb->data;
+    }
+    return item;
+}
+
+//Copies a single item to the ring buffer; refuses to split items. Assumes the ringbuffer is locked.
+//Returns pdTRUE on success, pdFALSE if it can't make the item fit and the calling routine needs to
+//retry later or fail.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static BaseType_t copyItemToRingbufNoSplit(ringbuf_core_t *rb, const uint8_t *buffer, size_t buffer_size)
+{
+    uint8_t *item=allocItemNoSplit(rb, buffer_size, 0);
+    if (item == NULL) {
+        return pdFALSE;
+    }
+    memcpy(item, buffer, buffer_size);
+    return pdTRUE;
+}
+
+//Copies a single item to the ring buffer; allows split items. Assumes there is space in the ringbuffer and
+//the ringbuffer is locked. Increases write_ptr to the next item. Returns pdTRUE on
+//success, pdFALSE if it can't make the item fit and the calling routine needs to retry
+//later or fail.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static BaseType_t copyItemToRingbufAllowSplit(ringbuf_core_t *rb, const uint8_t *buffer, size_t buffer_size) 
+{
+    size_t rbuffer_size;
+    rbuffer_size=(buffer_size+3)&~3; //Payload length, rounded to next 32-bit value
+    configASSERT(((uintptr_t)rb->write_ptr&3)==0); //write_ptr needs to be 32-bit aligned
+    configASSERT((rb->data+rb->size)-rb->write_ptr >= sizeof(buf_entry_hdr_t)); //need to have at least the size 
+                                            //of a header to the end of the ringbuff
+    size_t rem_len=(rb->data + rb->size) - rb->write_ptr; //length remaining until end of ringbuffer
+    
+    //See if we have enough contiguous space to write the buffer.
+    if (rem_len < rbuffer_size + sizeof(buf_entry_hdr_t)) {
+        //The buffer can't be contiguously written to the ringbuffer, but needs special handling. Do
+        //that depending on how the ringbuffer is configured.
+        //The code here is also expected to check if the buffer, mangled in whatever way is implemented,
+        //will still fit, and return pdFALSE if that is not the case.
+        //Buffer plus header is not going to fit in the room from wr_pos to the end of the 
+        //ringbuffer... we need to split the write in two.
+        //First, see if this will fit at all.
+        if (ringbufferFreeMem(rb) < (sizeof(buf_entry_hdr_t)*2)+rbuffer_size) {
+            //Will not fit.
+            return pdFALSE;
+        }
+         //Because the code at the end of the function makes sure we always have 
+        //room for a header, this should never assert.
+        configASSERT(rem_len>=sizeof(buf_entry_hdr_t));
+         //Okay, it should fit. Write everything.
+        //First, place bit of buffer that does fit. Write header first...
+        buf_entry_hdr_t *hdr=(buf_entry_hdr_t *)rb->write_ptr;
+        hdr->flags=0;
+        hdr->len=rem_len-sizeof(buf_entry_hdr_t);
+        rb->write_ptr+=sizeof(buf_entry_hdr_t);
+        rem_len-=sizeof(buf_entry_hdr_t);
+        if (rem_len!=0) {
+            //..then write the data bit that fits.
+            memcpy(rb->write_ptr, buffer, rem_len);
+            //Update vars so the code later on will write the rest of the data.
+            buffer+=rem_len;
+            rbuffer_size-=rem_len;
+            buffer_size-=rem_len;
+        } else {
+            //Huh, only the header fit. Mark as dummy so the receive function doesn't receive
+            //an useless zero-byte packet.
+            hdr->flags|=iflag_dummydata;
+        }
+        rb->write_ptr=rb->data;
+    } else {
+        //No special handling needed. Checking if it's gonna fit probably still is a good idea.
+        //If less than a header remains after the item, the write pointer skips to the start of the
+        //ringbuffer, so that tail is used up as well; it must not end up on the free pointer.
+        size_t needed=sizeof(buf_entry_hdr_t)+rbuffer_size;
+        if (rem_len-needed < sizeof(buf_entry_hdr_t)) needed=rem_len;
+        if (ringbufferFreeMem(rb) < needed) {
+            //Buffer is not going to fit, period.
+            return pdFALSE;
+        }
+    }
+
+    //If we are here, the buffer is guaranteed to fit in the space starting at the write pointer.
+    buf_entry_hdr_t *hdr=(buf_entry_hdr_t *)rb->write_ptr;
+    hdr->len=buffer_size;
+    hdr->flags=0;
+    rb->write_ptr+=sizeof(buf_entry_hdr_t);
+    memcpy(rb->write_ptr, buffer, buffer_size);
+    rb->write_ptr+=rbuffer_size;
+
+    //The buffer will wrap around if we don't have room for a header anymore.
+    if ((rb->data+rb->size)-rb->write_ptr < sizeof(buf_entry_hdr_t)) {
+        //'Forward' the write buffer until we are at the start of the ringbuffer.
+        //The read pointer will always be at the start of a full header, which cannot 
+        //exist at the point of the current write pointer, so there's no chance of overtaking
+        //that.
+        rb->write_ptr=rb->data;
+    }
+    return pdTRUE;
+}
+
+
+//Copies a bunch of daya to the ring bytebuffer. Assumes there is space in the ringbuffer and
+//the ringbuffer is locked. Increases write_ptr to the next item. Returns pdTRUE on
+//success, pdFALSE if it can't make the item fit and the calling routine needs to retry
+//later or fail.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static BaseType_t copyItemToRingbufByteBuf(ringbuf_core_t *rb, const uint8_t *buffer, size_t buffer_size) 
+{
+    size_t rem_len=(rb->data + rb->size) - rb->write_ptr; //length remaining until end of ringbuffer
+    
+    //See if we have enough contiguous space to write the buffer.
+    if (rem_len < buffer_size) {
+        //...Nope. Write the data bit that fits.
+        memcpy(rb->write_ptr, buffer, rem_len);
+        //Update vars so the code later on will write the rest of the data.
+        buffer+=rem_len;
+        buffer_size-=rem_len;
+        rb->write_ptr=rb->data;
+    }
+
+    //If we are here, the buffer is guaranteed to fit in the space starting at the write pointer.
+    memcpy(rb->write_ptr, buffer, buffer_size);
+    rb->write_ptr+=buffer_size;
+    //The buffer will wrap around if we're at the end.
+    if ((rb->data+rb->size)==rb->write_ptr) {
+        rb->write_ptr=rb->data;
+    }
+    return pdTRUE;
+}
+
+//Retrieves a pointer to the data of the next item, or NULL if this is not possible.
+//This function by itself is not threadsafe, always call from within a muxed section.
+//Because we always return one item, this function ignores the wanted_length variable.
+static uint8_t *getItemFromRingbufDefault(ringbuf_core_t *rb, size_t *length, int wanted_length)
+{
+    uint8_t *ret;
+    configASSERT(((uintptr_t)rb->read_ptr&3)==0);
+    if (rb->read_ptr == rb->write_ptr) {
+        //No data available.
+        return NULL;
+    }
+    //The item written at the point of the read pointer may be a dummy item.
+    //We need to skip past it first, if that's the case.
+    buf_entry_hdr_t *hdr=(buf_entry_hdr_t *)rb->read_ptr;
+    configASSERT((hdr->len < rb->size) || (hdr->flags & iflag_dummydata));
+    if (hdr->flags & iflag_dummydata) {
+        //Hdr is dummy data. Reset to start of ringbuffer.
+        rb->read_ptr=rb->data;
+        //Get real header
+        hdr=(buf_entry_hdr_t *)rb->read_ptr;
+        configASSERT(hdr->len < rb->size);
+        //No need to re-check if the ringbuffer is empty: the write routine will
+        //always write a dummy item plus the real data item in one go, so now we must
+        //be at the real data item by definition.
+    }
+    if (hdr->flags & iflag_acquired) {
+        //The sender is still writing this item. Items after it have to wait as well.
+        return NULL;
+    }
+    //Okay, pass the data back.
+    ret=rb->read_ptr+sizeof(buf_entry_hdr_t);
+    *length=hdr->len;
+    //...and move the read pointer past the data.
+    rb->read_ptr+=sizeof(buf_entry_hdr_t)+((hdr->len+3)&~3);
+    //The buffer will wrap around if we don't have room for a header anymore.
+    if ((rb->data + rb->size) - rb->read_ptr < sizeof(buf_entry_hdr_t)) {
+        rb->read_ptr=rb->data;
+    }
+    return ret;
+}
+
+//Retrieves a pointer to the data in the buffer, or NULL if this is not possible.
+//This function by itself is not threadsafe, always call from within a muxed section.
+//This function honours the wanted_length and will never return more data than this.
+static uint8_t *getItemFromRingbufByteBuf(ringbuf_core_t *rb, size_t *length, int wanted_length)
+{
+    uint8_t *ret;
+    if (rb->read_ptr != rb->free_ptr) {
+        //This type of ringbuff does not support multiple outstanding buffers.
+        return NULL;
+    }
+    if (rb->read_ptr == rb->write_ptr) {
+        //No data available.
+        return NULL;
+    }
+    ret=rb->read_ptr;
+    if (rb->read_ptr > rb->write_ptr) {
+        //Available data wraps around. Give data until the end of the buffer.
+        *length=rb->size-(rb->read_ptr - rb->data);
+        if (wanted_length != 0 && *length > wanted_length) {
+            *length=wanted_length;
+            rb->read_ptr+=wanted_length;
+        } else {
+            rb->read_ptr=rb->data;
+        }
+    } else {
+        //Return data up to write pointer.
+        *length=rb->write_ptr -rb->read_ptr;
+        if (wanted_length != 0 && *length > wanted_length) {
+            *length=wanted_length;
+            rb->read_ptr+=wanted_length;
+        } else {
+            rb->read_ptr=rb->write_ptr;
+        }
+    }
+    return ret;
+}
+
+
+//Returns an item to the ringbuffer. Will mark the item as free, and will see if the free pointer
+//can be increase.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static void returnItemToRingbufDefault(ringbuf_core_t *rb, void *item) {
+    uint8_t *data=(uint8_t*)item;
+    configASSERT(((uintptr_t)rb->free_ptr&3)==0);
+    configASSERT(data >= rb->data);
+    configASSERT(data < rb->data+rb->size);
+    //Grab the buffer entry that preceeds the buffer
+    buf_entry_hdr_t *hdr=(buf_entry_hdr_t*)(data-sizeof(buf_entry_hdr_t));
+    configASSERT(hdr->len < rb->size);
+    configASSERT((hdr->flags & iflag_dummydata)==0);
+    configASSERT((hdr->flags & iflag_free)==0);
+    //Mark the buffer as free.
+    hdr->flags|=iflag_free;
+
+    //Do a cleanup pass.
+    hdr=(buf_entry_hdr_t *)rb->free_ptr;
+    //basically forward free_ptr until we run into either a block that is still in use or the write pointer.
+    while (((hdr->flags & iflag_free) || (hdr->flags & iflag_dummydata)) && rb->free_ptr != rb->write_ptr) {
+        if (hdr->flags & iflag_dummydata) {
+            //Rest is dummy data. Reset to start of ringbuffer.
+            rb->free_ptr=rb->data;
+        } else {
+            //Skip past item
+            size_t len=(hdr->len+3)&~3;
+            rb->free_ptr+=len+sizeof(buf_entry_hdr_t);
+            configASSERT(rb->free_ptr<=rb->data+rb->size);
+        }
+        //The buffer will wrap around if we don't have room for a header anymore.
+        if ((rb->data+rb->size)-rb->free_ptr < sizeof(buf_entry_hdr_t)) {
+            rb->free_ptr=rb->data;
+        }
+        //The free_ptr can not exceed read_ptr, otherwise write_ptr might overwrite read_ptr.
+        //Read_ptr can not set to rb->data with free_ptr, otherwise write_ptr might wrap around to rb->data.
+        if(rb->free_ptr == rb->read_ptr) break;
+        //Next header
+        hdr=(buf_entry_hdr_t *)rb->free_ptr;
+    }
+}
+
+
+//Returns an item to the ringbuffer. Will mark the item as free, and will see if the free pointer
+//can be increase.
+//This function by itself is not threadsafe, always call from within a muxed section.
+static void returnItemToRingbufBytebuf(ringbuf_core_t *rb, void *item) {
+    uint8_t *data=(uint8_t*)item;
+    configASSERT(data >= rb->data);
+    configASSERT(data < rb->data+rb->size);
+    //Free the read memory.
+    rb->free_ptr=rb->read_ptr;
+}
+
+
+BaseType_t ringbufCoreInit(ringbuf_core_t *rb, uint8_t *data, size_t size, ringbuf_type_t type)
+{
+    memset(rb, 0, sizeof(ringbuf_core_t));
+    rb->data = data;
+    rb->size = size;
+    rb->free_ptr = rb->data;
+    rb->read_ptr = rb->data;
+    rb->write_ptr = rb->data;
+    rb->flags=0;
+    //Acquired items are placed like items of a no-split buffer, so they are limited to the same size.
+    size_t maxNoSplitSize=(rb->size/2)-sizeof(buf_entry_hdr_t)-4;
+    if (type==RINGBUF_TYPE_ALLOWSPLIT) {
+        rb->flags|=flag_allowsplit;
+        rb->copyItemToRingbufImpl=copyItemToRingbufAllowSplit;
+        rb->getItemFromRingbufImpl=getItemFromRingbufDefault;
+        rb->returnItemToRingbufImpl=returnItemToRingbufDefault;
+        //Calculate max item size. Worst case, we need to split an item into two, which means two headers of overhead.
+        rb->maxItemSize=rb->size-(sizeof(buf_entry_hdr_t)*2)-4;
+        rb->maxAcquireSize=maxNoSplitSize;
+    } else if (type==RINGBUF_TYPE_BYTEBUF) {
+        rb->flags|=flag_bytebuf;
+        rb->copyItemToRingbufImpl=copyItemToRingbufByteBuf;
+        rb->getItemFromRingbufImpl=getItemFromRingbufByteBuf;
+        rb->returnItemToRingbufImpl=returnItemToRingbufBytebuf;
+        //Calculate max item size. We have no headers and can split anywhere -> size is total size minus one.
+        rb->maxItemSize=rb->size-1;
+        //There are no item boundaries to reserve space up to.
+        rb->maxAcquireSize=0;
+    } else if (type==RINGBUF_TYPE_NOSPLIT) {
+        rb->copyItemToRingbufImpl=copyItemToRingbufNoSplit;
+        rb->getItemFromRingbufImpl=getItemFromRingbufDefault;
+        rb->returnItemToRingbufImpl=returnItemToRingbufDefault;
+        //Calculate max item size. Worst case, we have the write ptr in such a position that we are lacking four bytes of free
+        //memory to put an item into the rest of the memory. If this happens, we have to dummy-fill
+        //(item_data-4) bytes of buffer, then we only have (size-(item_data-4) bytes left to fill
+        //with the real item. (item size being header+data)
+        rb->maxItemSize=maxNoSplitSize;
+        rb->maxAcquireSize=maxNoSplitSize;
+    } else {
+        return pdFALSE;
+    }
+    return pdTRUE;
+}
+
+size_t ringbufCoreFreeMem(const ringbuf_core_t *rb)
+{
+    return ringbufferFreeMem(rb);
+}
+
+BaseType_t ringbufCoreSend(ringbuf_core_t *rb, const void *data, size_t data_size)
+{
+    //The copy functions of the byte buffer rely on this check having been done.
+    if (ringbufferFreeMem(rb) < data_size+sizeof(buf_entry_hdr_t)) {
+        return pdFALSE;
+    }
+    return rb->copyItemToRingbufImpl(rb, data, data_size);
+}
+
+void *ringbufCoreAcquire(ringbuf_core_t *rb, size_t item_size)
+{
+    configASSERT(item_size <= rb->maxAcquireSize);
+    return allocItemNoSplit(rb, item_size, iflag_acquired);
+}
+
+void ringbufCoreComplete(ringbuf_core_t *rb, void *item)
+{
+    buf_entry_hdr_t *hdr=(buf_entry_hdr_t*)((uint8_t*)item-sizeof(buf_entry_hdr_t));
+    configASSERT((uint8_t*)hdr >= rb->data && (uint8_t*)item < rb->data+rb->size);
+    configASSERT(hdr->flags & iflag_acquired);
+    hdr->flags&=~iflag_acquired;
+}
+
+void *ringbufCoreReceive(ringbuf_core_t *rb, size_t *item_size, size_t wanted_size)
+{
+    return rb->getItemFromRingbufImpl(rb, item_size, wanted_size);
+}
+
+size_t ringbufCoreReceiveMultiple(ringbuf_core_t *rb, void **items, size_t *item_sizes, size_t max_items, size_t wanted_size)
+{
+    size_t count=0;
+    while (count < max_items) {
+        items[count]=rb->getItemFromRingbufImpl(rb, &item_sizes[count], wanted_size);
+        if (items[count] == NULL) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+void ringbufCoreReturn(ringbuf_core_t *rb, void *item)
+{
+    rb->returnItemToRingbufImpl(rb, item);
+}
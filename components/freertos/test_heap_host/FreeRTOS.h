@@ -0,0 +1,38 @@
+/* Host replacement for FreeRTOS.h and portmacro.h, with just enough of them
+   to build heap_regions.c. Include guard is the same as in FreeRTOS.h, so that
+   the real header is skipped when it is included from heap_regions_debug.h. */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef struct {
+    int dummy;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+#define portBYTE_ALIGNMENT          8
+#define portBYTE_ALIGNMENT_MASK     ( 0x0007U )
+
+#define configASSERT( x )           assert( x )
+#define configUSE_MALLOC_FAILED_HOOK 0
+#define configENABLE_MEMORY_DEBUG   0
+#define configENABLE_HEAP_TRACING   1
+#define configHEAP_TRACING_EVENTS   64
+
+#define mtCOVERAGE_TEST_MARKER()
+#define traceMALLOC( pvAddress, uiSize )
+#define traceFREE( pvAddress, uiSize )
+
+/* Host tests are single-threaded */
+#define taskENTER_CRITICAL( mux )   ( ( void ) ( mux ) )
+#define taskEXIT_CRITICAL( mux )    ( ( void ) ( mux ) )
+#define vPortCPUInitializeMutex( mux ) ( ( void ) ( mux ) )
+
+#endif //INC_FREERTOS_H
@@ -0,0 +1,93 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "heap_trace_replay.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+extern "C" {
+#include "heap_regions.h"
+}
+
+HeapTraceReplay::~HeapTraceReplay()
+{
+    for (auto& it : mBlocks) {
+        vPortFreeTagged(it.second.hostAddress);
+    }
+}
+
+bool HeapTraceReplay::replayLine(const char* line)
+{
+    char type;
+    unsigned number, tag;
+    size_t size;
+    uintptr_t address;
+    char caller[24];
+    char task[8];
+    if (sscanf(line, " %c %u %u %zu %" SCNxPTR " %23s %7s", &type, &number, &tag, &size, &address, caller, task) != 7) {
+        return false;
+    }
+    ++mEventCount;
+    if (type == 'm') {
+        void* hostAddress = pvPortMallocTagged(size, tag);
+        if (hostAddress == nullptr) {
+            ++mFailedAllocations;
+            return true;
+        }
+        auto it = mBlocks.find(address);
+        if (it != mBlocks.end()) {
+            /* free of this block was not traced; keep the newer one */
+            vPortFreeTagged(it->second.hostAddress);
+            mBlocks.erase(it);
+        }
+        Block block;
+        block.hostAddress = hostAddress;
+        block.size = size;
+        block.caller = strtoull(caller, nullptr, 16);
+        block.task = task;
+        mBlocks[address] = block;
+    } else if (type == 'f') {
+        auto it = mBlocks.find(address);
+        if (it == mBlocks.end()) {
+            ++mUnknownFrees;
+            return true;
+        }
+        vPortFreeTagged(it->second.hostAddress);
+        mBlocks.erase(it);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<HeapTraceReplay::Leak> HeapTraceReplay::leaks() const
+{
+    std::vector<Leak> result;
+    for (auto& it : mBlocks) {
+        const Block& block = it.second;
+        auto leak = std::find_if(result.begin(), result.end(), [&block](const Leak& l) {
+            return l.caller == block.caller && l.task == block.task;
+        });
+        if (leak == result.end()) {
+            result.push_back(Leak{block.caller, block.task, 0, 0});
+            leak = result.end() - 1;
+        }
+        leak->bytes += block.size;
+        leak->blocks++;
+    }
+    std::sort(result.begin(), result.end(), [](const Leak& a, const Leak& b) {
+        return a.bytes > b.bytes;
+    });
+    return result;
+}
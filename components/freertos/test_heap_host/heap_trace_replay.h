@@ -0,0 +1,80 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef heap_trace_replay_h
+#define heap_trace_replay_h
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Replays a heap trace printed by esp_heap_dump_trace against the heap of the
+ * host, which has to be initialized with regions of the same tags.
+ *
+ * Blocks allocated by the trace and not freed are reported as leaks. Because
+ * the same allocator is used, the state of the heap after the replay, e.g.
+ * the largest free block of each tag, is close to the one on the device.
+ */
+class HeapTraceReplay
+{
+public:
+    struct Leak {
+        uintptr_t caller;
+        std::string task;
+        size_t bytes;
+        size_t blocks;
+    };
+
+    ~HeapTraceReplay();
+
+    /* Replay one line of the trace. Returns false for lines which are not events. */
+    bool replayLine(const char* line);
+
+    /* Blocks which were not freed, grouped by call site and task, largest first. */
+    std::vector<Leak> leaks() const;
+
+    size_t eventCount() const
+    {
+        return mEventCount;
+    }
+
+    /* Allocations which failed on the host */
+    size_t failedAllocations() const
+    {
+        return mFailedAllocations;
+    }
+
+    /* Frees of blocks allocated before the trace started */
+    size_t unknownFrees() const
+    {
+        return mUnknownFrees;
+    }
+
+protected:
+    struct Block {
+        void* hostAddress;
+        size_t size;
+        uintptr_t caller;
+        std::string task;
+    };
+
+    std::map<uintptr_t, Block> mBlocks;
+    size_t mEventCount = 0;
+    size_t mFailedAllocations = 0;
+    size_t mUnknownFrees = 0;
+};
+
+#endif /* heap_trace_replay_h */
@@ -0,0 +1,78 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Replays a heap trace printed by esp_heap_dump_trace and reports leaks.
+ *
+ * Usage: heap_trace_replay [trace file]
+ * Trace is read from standard input if no file is given. Lines which are not
+ * trace events, e.g. other console output, are skipped.
+ */
+#include "heap_trace_replay.h"
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" {
+#include "heap_regions.h"
+}
+
+/* One region per tag, bigger than any memory of the ESP32 */
+static const size_t REGION_SIZE = 1024 * 1024;
+
+int main(int argc, char** argv)
+{
+    FILE* input = stdin;
+    if (argc > 1) {
+        input = fopen(argv[1], "r");
+        if (input == nullptr) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    uint8_t* memory = (uint8_t*) malloc(REGION_SIZE * HEAPREGIONS_MAX_TAGCOUNT);
+    HeapRegionTagged_t regions[HEAPREGIONS_MAX_TAGCOUNT + 1] = {};
+    for (int tag = 0; tag < HEAPREGIONS_MAX_TAGCOUNT; ++tag) {
+        regions[tag].pucStartAddress = memory + tag * REGION_SIZE;
+        regions[tag].xSizeInBytes = REGION_SIZE;
+        regions[tag].xTag = tag;
+    }
+    vPortDefineHeapRegionsTagged(regions);
+    size_t initialFree[HEAPREGIONS_MAX_TAGCOUNT];
+    for (int tag = 0; tag < HEAPREGIONS_MAX_TAGCOUNT; ++tag) {
+        initialFree[tag] = xPortGetFreeHeapSizeTagged(tag);
+    }
+
+    HeapTraceReplay replay;
+    char line[256];
+    while (fgets(line, sizeof(line), input) != nullptr) {
+        replay.replayLine(line);
+    }
+
+    printf("%zu events replayed, %zu frees of blocks allocated before the trace, %zu allocations failed\n",
+           replay.eventCount(), replay.unknownFrees(), replay.failedAllocations());
+    auto leaks = replay.leaks();
+    printf("%zu call sites hold blocks which were not freed:\n", leaks.size());
+    for (auto& leak : leaks) {
+        printf("  0x%08zx %-4s %8zu bytes in %zu blocks\n", (size_t) leak.caller, leak.task.c_str(), leak.bytes, leak.blocks);
+    }
+    for (int tag = 0; tag < HEAPREGIONS_MAX_TAGCOUNT; ++tag) {
+        if (xPortGetMinimumEverFreeHeapSizeTagged(tag) != initialFree[tag]) {
+            printf("tag %d: %zu bytes in use, peak %zu, largest free block %zu\n", tag,
+                   initialFree[tag] - xPortGetFreeHeapSizeTagged(tag),
+                   initialFree[tag] - xPortGetMinimumEverFreeHeapSizeTagged(tag),
+                   xPortGetLargestFreeBlockTagged(tag));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+#include "task.h"
+
+const char* g_host_task_name = NULL;
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return ( TaskHandle_t ) g_host_task_name;
+}
+
+char *pcTaskGetTaskName( TaskHandle_t xTaskToQuery )
+{
+    return ( char * ) xTaskToQuery;
+}
@@ -0,0 +1,22 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* TaskHandle_t;
+
+/* Name returned by pcTaskGetTaskName for the current task; no task if NULL */
+extern const char* g_host_task_name;
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+char *pcTaskGetTaskName( TaskHandle_t xTaskToQuery );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INC_TASK_H
@@ -0,0 +1,369 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "heap_trace_replay.h"
+
+extern "C" {
+#include "heap_regions.h"
+#include "task.h"
+}
+
+using namespace std;
+
+static const size_t HEAP_SIZE = 512 * 1024;
+static uint8_t s_heap[HEAP_SIZE] __attribute__((aligned(8)));
+
+/* Two regions of tag 0, one region of tag 1 and of tag 2, and a tiny region of
+   tag 3, in address order. Start of the second region of tag 0 is not aligned. */
+static HeapRegionTagged_t s_regions[] = {
+    { s_heap,                     0x20000, 0, 0 },
+    { s_heap + 0x21000,           0x10000, 1, 0 },
+    { s_heap + 0x32000,           0x08000, 2, 0 },
+    { s_heap + 0x3b001,           0x40000, 0, 0 },
+    { s_heap + 0x7c000,           0x00200, 3, 0 },
+    { NULL, 0, 0, 0 }
+};
+
+static size_t s_initialFree[4];
+
+static void init_heap()
+{
+    static bool s_initialized = false;
+    if (!s_initialized) {
+        vPortDefineHeapRegionsTagged(s_regions);
+        for (int tag = 0; tag < 4; ++tag) {
+            s_initialFree[tag] = xPortGetFreeHeapSizeTagged(tag);
+        }
+        s_initialized = true;
+    }
+}
+
+static bool in_region_of_tag(void* p, size_t size, int tag)
+{
+    for (const HeapRegionTagged_t* r = s_regions; r->xSizeInBytes != 0; ++r) {
+        if (r->xTag == tag && (uint8_t*) p >= r->pucStartAddress &&
+            (uint8_t*) p + size <= r->pucStartAddress + r->xSizeInBytes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("allocations come from regions of the requested tag", "[heap]")
+{
+    init_heap();
+    CHECK(s_initialFree[0] > 0x50000);
+    CHECK(s_initialFree[1] < 0x10000);
+    CHECK(s_initialFree[2] < 0x08000);
+    for (int tag = 0; tag < 3; ++tag) {
+        void* p = pvPortMallocTagged(100, tag);
+        REQUIRE(p != NULL);
+        CHECK(((uintptr_t) p & 7) == 0);
+        CHECK(in_region_of_tag(p, 100, tag));
+        CHECK(xPortGetFreeHeapSizeTagged(tag) < s_initialFree[tag]);
+        vPortFreeTagged(p);
+        CHECK(xPortGetFreeHeapSizeTagged(tag) == s_initialFree[tag]);
+    }
+    CHECK(pvPortMallocTagged(0, 0) == NULL);
+    CHECK(pvPortMallocTagged(100, 4) == NULL);
+    CHECK(pvPortMallocTagged(0x10000, 1) == NULL);
+}
+
+TEST_CASE("a tiny region keeps its memory for the heap", "[heap]")
+{
+    init_heap();
+    // only the header of the free block and the end marker are taken
+    CHECK(s_initialFree[3] >= 0x100);
+    void* p = pvPortMallocTagged(16, 3);
+    REQUIRE(p != NULL);
+    CHECK(in_region_of_tag(p, 16, 3));
+    vPortFreeTagged(p);
+    CHECK(xPortGetFreeHeapSizeTagged(3) == s_initialFree[3]);
+}
+
+TEST_CASE("freed blocks are merged with free neighbours", "[heap]")
+{
+    init_heap();
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> sizeDist(1, 300);
+    vector<void*> blocks;
+    void* p;
+    while ((p = pvPortMallocTagged(sizeDist(gen), 1)) != NULL) {
+        blocks.push_back(p);
+    }
+    CHECK(blocks.size() > 100);
+    CHECK(xPortGetFreeHeapSizeTagged(1) < 400);
+    CHECK(xPortGetMinimumEverFreeHeapSizeTagged(1) < 400);
+    shuffle(blocks.begin(), blocks.end(), gen);
+    for (auto b : blocks) {
+        vPortFreeTagged(b);
+    }
+    CHECK(xPortGetFreeHeapSizeTagged(1) == s_initialFree[1]);
+
+    /* whole region is one free block again */
+    p = pvPortMallocTagged(s_initialFree[1] - 64, 1);
+    CHECK(p != NULL);
+    vPortFreeTagged(p);
+    CHECK(xPortGetFreeHeapSizeTagged(1) == s_initialFree[1]);
+}
+
+TEST_CASE("block which fits the request is found in the list of its own size class", "[heap]")
+{
+    init_heap();
+    /* leave exactly one free block of 1000 bytes, then ask for a bit less */
+    vector<void*> blocks;
+    void* p;
+    while ((p = pvPortMallocTagged(1000 - 16, 2)) != NULL) {
+        blocks.push_back(p);
+    }
+    void* rest;
+    while ((rest = pvPortMallocTagged(8, 2)) != NULL) {
+        blocks.push_back(rest);
+    }
+    vPortFreeTagged(blocks[1]);
+    CHECK(xPortGetFreeHeapSizeTagged(2) < 1100);
+    p = pvPortMallocTagged(970, 2);
+    CHECK(p == blocks[1]);
+    vPortFreeTagged(p);
+    blocks[1] = NULL;
+    for (auto b : blocks) {
+        vPortFreeTagged(b);
+    }
+    CHECK(xPortGetFreeHeapSizeTagged(2) == s_initialFree[2]);
+}
+
+TEST_CASE("random allocations don't overlap", "[heap]")
+{
+    init_heap();
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<size_t> sizeDist(1, 2048);
+    std::uniform_int_distribution<int> tagDist(0, 1);
+    struct Block {
+        uint8_t* ptr;
+        size_t size;
+        int tag;
+        uint8_t fill;
+    };
+    vector<Block> live;
+    for (int i = 0; i < 20000; ++i) {
+        if (live.empty() || gen() % 2 == 0) {
+            Block b;
+            b.size = sizeDist(gen);
+            b.tag = tagDist(gen);
+            b.fill = (uint8_t) i;
+            b.ptr = (uint8_t*) pvPortMallocTagged(b.size, b.tag);
+            if (b.ptr == NULL) {
+                continue;
+            }
+            REQUIRE(in_region_of_tag(b.ptr, b.size, b.tag));
+            memset(b.ptr, b.fill, b.size);
+            live.push_back(b);
+        } else {
+            size_t index = gen() % live.size();
+            Block& b = live[index];
+            REQUIRE(count(b.ptr, b.ptr + b.size, b.fill) == (ptrdiff_t) b.size);
+            vPortFreeTagged(b.ptr);
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    for (auto& b : live) {
+        vPortFreeTagged(b.ptr);
+    }
+    CHECK(xPortGetFreeHeapSizeTagged(0) == s_initialFree[0]);
+    CHECK(xPortGetFreeHeapSizeTagged(1) == s_initialFree[1]);
+}
+
+TEST_CASE("latency of malloc and free with a mix of small and large blocks", "[heap][latency]")
+{
+    init_heap();
+    typedef chrono::high_resolution_clock clock;
+    std::mt19937 gen(7);
+    /* mostly small buffers, like lwIP pbufs, and some large ones, like TLS records */
+    std::uniform_int_distribution<size_t> smallDist(16, 256);
+    std::uniform_int_distribution<size_t> largeDist(1024, 8192);
+    vector<void*> live;
+    vector<uint32_t> mallocNs, freeNs;
+    const size_t maxLive = 1000;
+    for (int i = 0; i < 200000; ++i) {
+        bool allocate = live.size() < maxLive && (live.size() < maxLive / 2 || gen() % 2 == 0);
+        if (allocate) {
+            size_t size = (gen() % 32 == 0) ? largeDist(gen) : smallDist(gen);
+            auto start = clock::now();
+            void* p = pvPortMallocTagged(size, 0);
+            auto end = clock::now();
+            mallocNs.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+            if (p != NULL) {
+                live.push_back(p);
+            } else {
+                allocate = false;
+            }
+        }
+        if (!allocate) {
+            size_t index = gen() % live.size();
+            auto start = clock::now();
+            vPortFreeTagged(live[index]);
+            auto end = clock::now();
+            freeNs.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    for (auto p : live) {
+        vPortFreeTagged(p);
+    }
+    CHECK(xPortGetFreeHeapSizeTagged(0) == s_initialFree[0]);
+
+    auto report = [](const char* name, vector<uint32_t>& v) {
+        sort(v.begin(), v.end());
+        printf("%s latency, ns: 50%% %u, 99%% %u, 99.9%% %u, max %u (%u calls)\n", name,
+               v[v.size() / 2], v[v.size() * 99 / 100], v[v.size() * 999 / 1000], v.back(), (unsigned) v.size());
+    };
+    report("pvPortMallocTagged", mallocNs);
+    report("vPortFreeTagged", freeNs);
+}
+
+static void collect_block(const HeapBlockInfo_t* info, void* arg)
+{
+    static_cast<vector<HeapBlockInfo_t>*>(arg)->push_back(*info);
+}
+
+TEST_CASE("heap walk reports caller and task of allocated blocks", "[heap][trace]")
+{
+    init_heap();
+    g_host_task_name = "wifi_task";
+    void* p = pvPortMallocTaggedFrom(200, 2, (void*) 0x400d1234);
+    g_host_task_name = NULL;
+    void* q = pvPortMallocTagged(100, 2);
+    REQUIRE(p != NULL);
+    REQUIRE(q != NULL);
+
+    vector<HeapBlockInfo_t> blocks;
+    vPortWalkHeapTagged(2, collect_block, &blocks);
+    REQUIRE(blocks.size() == 3);
+    CHECK(blocks[0].pvAddress == p);
+    CHECK(blocks[0].xAllocated);
+    CHECK(blocks[0].xSize >= 200);
+    CHECK(blocks[0].pvCaller == (void*) 0x400d1234);
+    CHECK(memcmp(blocks[0].acTask, "wifi", 4) == 0);
+    CHECK(blocks[1].pvAddress == q);
+    CHECK(blocks[1].pvCaller != NULL);
+    CHECK(blocks[1].acTask[0] == 0);
+    CHECK_FALSE(blocks[2].xAllocated);
+    CHECK(blocks[2].xSize == xPortGetLargestFreeBlockTagged(2));
+
+    vPortFreeTagged(p);
+    vPortFreeTagged(q);
+    blocks.clear();
+    vPortWalkHeapTagged(2, collect_block, &blocks);
+    REQUIRE(blocks.size() == 1);
+    CHECK_FALSE(blocks[0].xAllocated);
+    CHECK(blocks[0].xSize == xPortGetLargestFreeBlockTagged(2));
+    CHECK(blocks[0].xSize < xPortGetFreeHeapSizeTagged(2));
+
+    /* both regions of tag 0 are walked */
+    blocks.clear();
+    vPortWalkHeapTagged(0, collect_block, &blocks);
+    REQUIRE(blocks.size() == 2);
+    CHECK(in_region_of_tag(blocks[0].pvAddress, blocks[0].xSize, 0));
+    CHECK(in_region_of_tag(blocks[1].pvAddress, blocks[1].xSize, 0));
+    CHECK(blocks[0].pvAddress < s_heap + 0x20000);
+    CHECK(blocks[1].pvAddress > s_heap + 0x3b000);
+}
+
+TEST_CASE("heap trace keeps the last allocations and frees", "[heap][trace]")
+{
+    init_heap();
+    HeapTraceEvent_t events[configHEAP_TRACING_EVENTS];
+    uint32_t next = 0, first;
+    size_t count;
+    while ((count = xPortGetHeapTrace(events, next, configHEAP_TRACING_EVENTS, &first)) != 0) {
+        next = first + count;
+    }
+
+    g_host_task_name = "test";
+    vector<void*> addresses;
+    for (size_t i = 0; i < configHEAP_TRACING_EVENTS; ++i) {
+        void* p = pvPortMallocTaggedFrom(16 + i, 1, (void*) (0x400d0000 + i));
+        addresses.push_back(p);
+        vPortFreeTagged(p);
+    }
+    g_host_task_name = NULL;
+
+    /* older half of these events was dropped */
+    count = xPortGetHeapTrace(events, next, configHEAP_TRACING_EVENTS, &first);
+    CHECK(count == configHEAP_TRACING_EVENTS);
+    CHECK(first == next + configHEAP_TRACING_EVENTS);
+    for (size_t i = 0; i < count; ++i) {
+        size_t n = configHEAP_TRACING_EVENTS / 2 + i / 2;
+        CHECK(events[i].ucTag == 1);
+        CHECK(events[i].pvAddress == addresses[n]);
+        CHECK(memcmp(events[i].acTask, "test", 4) == 0);
+        if (i % 2 == 0) {
+            CHECK(events[i].ucType == HEAP_TRACE_MALLOC);
+            CHECK(events[i].xSize == 16 + n);
+            CHECK(events[i].pvCaller == (void*) (0x400d0000 + n));
+        } else {
+            CHECK(events[i].ucType == HEAP_TRACE_FREE);
+            CHECK(events[i].xSize >= 16 + n);
+            CHECK(events[i].pvCaller == NULL);
+        }
+    }
+    CHECK(xPortGetHeapTrace(events, first + count, configHEAP_TRACING_EVENTS, &first) == 0);
+}
+
+TEST_CASE("heap trace replay reports blocks which were not freed", "[heap][trace]")
+{
+    init_heap();
+    const char* trace[] = {
+        "I (1234) example: starting",
+        "Heap trace:",
+        "# 12 events dropped",
+        "m 12 0 100 0x3ffb0000 0x400d1000 main",
+        "m 13 0 200 0x3ffb0100 0x400d2000 wifi",
+        "f 14 0 104 0x3ffb0000 - main",
+        "f 15 1 48 0x3ffc0000 - main",
+        "m 16 1 64 0x3ffc1000 0x400d2000 wifi",
+        "m 17 1 64 0x3ffc2000 0x400d3000 tiT",
+        "f 18 1 64 0x3ffc2000 - tiT",
+    };
+    {
+        HeapTraceReplay replay;
+        size_t events = 0;
+        for (auto line : trace) {
+            if (replay.replayLine(line)) {
+                ++events;
+            }
+        }
+        CHECK(events == 7);
+        CHECK(replay.eventCount() == 7);
+        CHECK(replay.unknownFrees() == 1);
+        CHECK(replay.failedAllocations() == 0);
+        auto leaks = replay.leaks();
+        REQUIRE(leaks.size() == 1);
+        CHECK(leaks[0].caller == 0x400d2000);
+        CHECK(leaks[0].task == "wifi");
+        CHECK(leaks[0].bytes == 264);
+        CHECK(leaks[0].blocks == 2);
+        CHECK(xPortGetFreeHeapSizeTagged(0) < s_initialFree[0]);
+    }
+    CHECK(xPortGetFreeHeapSizeTagged(0) == s_initialFree[0]);
+    CHECK(xPortGetFreeHeapSizeTagged(1) == s_initialFree[1]);
+}
@@ -0,0 +1,24 @@
+/* Host replacement for FreeRTOS.h and queue.h, with just enough of them to
+   build ringbuf_core.c. Include guards are the same as in the real headers,
+   so that those are skipped when ringbuf_core.h includes them. */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+typedef void * QueueSetHandle_t;
+typedef void * QueueSetMemberHandle_t;
+
+#define pdFALSE                     ( ( BaseType_t ) 0 )
+#define pdTRUE                      ( ( BaseType_t ) 1 )
+
+#define configASSERT( x )           assert( x )
+
+#endif //INC_FREERTOS_H
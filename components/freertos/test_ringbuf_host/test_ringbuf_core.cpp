@@ -0,0 +1,325 @@
+#include "catch.hpp"
+#include "FreeRTOS.h"
+#include "ringbuf_core.h"
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+/* Ring buffer with its own storage, locked like ringbuf.c locks it */
+class TestRingbuf
+{
+public:
+    TestRingbuf(size_t size, ringbuf_type_t type) : mStorage(size / 4 + 1)
+    {
+        REQUIRE(ringbufCoreInit(&mCore, reinterpret_cast<uint8_t*>(mStorage.data()), size, type) == pdTRUE);
+    }
+
+    ringbuf_core_t* operator->()
+    {
+        return &mCore;
+    }
+
+    ringbuf_core_t* core()
+    {
+        return &mCore;
+    }
+
+    std::mutex mutex;
+
+protected:
+    std::vector<uint32_t> mStorage;
+    ringbuf_core_t mCore;
+};
+
+static std::string receiveString(TestRingbuf& rb)
+{
+    size_t size;
+    void* item = ringbufCoreReceive(rb.core(), &size, 0);
+    if (item == nullptr) {
+        return "<none>";
+    }
+    std::string result(static_cast<const char*>(item), size);
+    ringbufCoreReturn(rb.core(), item);
+    return result;
+}
+
+TEST_CASE("items are received in the order they were sent", "[ringbuf]")
+{
+    for (auto type : { RINGBUF_TYPE_NOSPLIT, RINGBUF_TYPE_ALLOWSPLIT }) {
+        TestRingbuf rb(128, type);
+        for (int round = 0; round < 50; ++round) {
+            std::string a = "item " + std::to_string(round);
+            std::string b(round % 13, 'x');
+            CHECK(ringbufCoreSend(rb.core(), a.data(), a.size()) == pdTRUE);
+            CHECK(ringbufCoreSend(rb.core(), b.data(), b.size()) == pdTRUE);
+            if (type == RINGBUF_TYPE_ALLOWSPLIT) {
+                // split items arrive in two parts
+                std::string got = receiveString(rb);
+                if (got != a) {
+                    got += receiveString(rb);
+                }
+                CHECK(got == a);
+                got = receiveString(rb);
+                if (got != b) {
+                    got += receiveString(rb);
+                }
+                CHECK(got == b);
+            } else {
+                CHECK(receiveString(rb) == a);
+                CHECK(receiveString(rb) == b);
+            }
+            CHECK(receiveString(rb) == "<none>");
+        }
+    }
+}
+
+TEST_CASE("acquired items are placed contiguously and hold back later items", "[ringbuf]")
+{
+    TestRingbuf rb(256, RINGBUF_TYPE_NOSPLIT);
+    CHECK(rb->maxAcquireSize == rb->maxItemSize);
+
+    char* first = static_cast<char*>(ringbufCoreAcquire(rb.core(), 5));
+    REQUIRE(first != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(first) % 4 == 0);
+    char* second = static_cast<char*>(ringbufCoreAcquire(rb.core(), 6));
+    REQUIRE(second != nullptr);
+    CHECK(ringbufCoreSend(rb.core(), "third", 5) == pdTRUE);
+
+    memcpy(second, "second", 6);
+    ringbufCoreComplete(rb.core(), second);
+    // nothing can be received while the first item is being written
+    CHECK(receiveString(rb) == "<none>");
+
+    memcpy(first, "first", 5);
+    ringbufCoreComplete(rb.core(), first);
+    CHECK(receiveString(rb) == "first");
+    CHECK(receiveString(rb) == "second");
+    CHECK(receiveString(rb) == "third");
+    CHECK(receiveString(rb) == "<none>");
+}
+
+TEST_CASE("acquire wraps around instead of splitting", "[ringbuf]")
+{
+    TestRingbuf rb(256, RINGBUF_TYPE_ALLOWSPLIT);
+    CHECK(rb->maxAcquireSize < rb->maxItemSize);
+    std::string filler(40, 'f');
+    for (int round = 0; round < 20; ++round) {
+        REQUIRE(ringbufCoreSend(rb.core(), filler.data(), filler.size()) == pdTRUE);
+        char* item = static_cast<char*>(ringbufCoreAcquire(rb.core(), 30));
+        REQUIRE(item != nullptr);
+        REQUIRE(item + 30 <= reinterpret_cast<char*>(rb->data) + rb->size);
+        memset(item, 'a' + round % 26, 30);
+        ringbufCoreComplete(rb.core(), item);
+
+        std::string got = receiveString(rb);
+        if (got.size() < filler.size()) {
+            got += receiveString(rb);
+        }
+        CHECK(got == filler);
+        CHECK(receiveString(rb) == std::string(30, 'a' + round % 26));
+    }
+}
+
+TEST_CASE("byte buffers don't support acquire", "[ringbuf]")
+{
+    TestRingbuf rb(128, RINGBUF_TYPE_BYTEBUF);
+    CHECK(rb->maxAcquireSize == 0);
+}
+
+TEST_CASE("multiple items are received at once", "[ringbuf]")
+{
+    TestRingbuf rb(512, RINGBUF_TYPE_NOSPLIT);
+    for (int i = 0; i < 10; ++i) {
+        std::string s = "item " + std::to_string(i);
+        REQUIRE(ringbufCoreSend(rb.core(), s.data(), s.size()) == pdTRUE);
+    }
+    void* items[4];
+    size_t sizes[4];
+    int received = 0;
+    size_t count;
+    while ((count = ringbufCoreReceiveMultiple(rb.core(), items, sizes, 4, 0)) > 0) {
+        CHECK(count == std::min(4, 10 - received));
+        for (size_t i = 0; i < count; ++i) {
+            CHECK(std::string(static_cast<char*>(items[i]), sizes[i]) == "item " + std::to_string(received++));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            ringbufCoreReturn(rb.core(), items[i]);
+        }
+    }
+    CHECK(received == 10);
+    CHECK(ringbufCoreFreeMem(rb.core()) == rb->size - 1);
+}
+
+TEST_CASE("random sends, acquires and receives match a model", "[ringbuf]")
+{
+    std::mt19937 gen(42);
+    for (auto type : { RINGBUF_TYPE_NOSPLIT, RINGBUF_TYPE_ALLOWSPLIT }) {
+        TestRingbuf rb(300, type);
+        std::deque<std::string> model;     // sent or completed, not received yet
+        std::deque<std::pair<char*, std::string>> pending;  // acquired, in acquire order
+        std::deque<void*> outstanding;     // received, not returned yet
+        std::string receivedPart;
+        int counter = 0;
+
+        for (int step = 0; step < 20000; ++step) {
+            std::string data = std::to_string(counter) + std::string(gen() % 40, 'a' + counter % 26);
+            switch (gen() % 5) {
+            case 0:
+                if (ringbufCoreSend(rb.core(), data.data(), data.size()) == pdTRUE) {
+                    // items sent after an acquired one are only visible after it
+                    pending.emplace_back(nullptr, data);
+                    ++counter;
+                }
+                break;
+            case 1: {
+                char* item = static_cast<char*>(ringbufCoreAcquire(rb.core(), data.size()));
+                if (item != nullptr) {
+                    pending.emplace_back(item, data);
+                    ++counter;
+                }
+                break;
+            }
+            case 2:
+                // complete a random acquired item
+                if (!pending.empty()) {
+                    auto& p = pending[gen() % pending.size()];
+                    if (p.first != nullptr) {
+                        memcpy(p.first, p.second.data(), p.second.size());
+                        ringbufCoreComplete(rb.core(), p.first);
+                        p.first = nullptr;
+                    }
+                }
+                break;
+            case 3: {
+                size_t size;
+                void* item = ringbufCoreReceive(rb.core(), &size, 0);
+                if (item == nullptr) {
+                    CHECK(model.empty());
+                    break;
+                }
+                INFO("type " << type << " step " << step);
+                REQUIRE(!model.empty());
+                receivedPart += std::string(static_cast<char*>(item), size);
+                if (receivedPart.size() == model.front().size()) {
+                    CHECK(receivedPart == model.front());
+                    model.pop_front();
+                    receivedPart.clear();
+                }
+                outstanding.push_back(item);
+                break;
+            }
+            case 4:
+                if (!outstanding.empty()) {
+                    size_t i = gen() % outstanding.size();
+                    ringbufCoreReturn(rb.core(), outstanding[i]);
+                    outstanding.erase(outstanding.begin() + i);
+                }
+                break;
+            }
+            while (!pending.empty() && pending.front().first == nullptr) {
+                model.push_back(pending.front().second);
+                pending.pop_front();
+            }
+        }
+    }
+}
+
+/* Each producer sends items of ITEM_SIZE bytes which it has to build first,
+ * e.g. by formatting a sensor reading. One consumer checks and returns them. */
+static const size_t ITEM_SIZE = 64;
+static const int PRODUCERS = 4;
+static const int ITEMS_PER_PRODUCER = 100000;
+
+static void buildItem(uint8_t* dst, int producer, int seq)
+{
+    for (size_t i = 0; i < ITEM_SIZE; i += sizeof(int)) {
+        int value = producer * ITEMS_PER_PRODUCER + seq + static_cast<int>(i);
+        memcpy(dst + i, &value, sizeof(value));
+    }
+}
+
+static double runBenchmark(bool zeroCopy, bool batch)
+{
+    TestRingbuf rb(4096, RINGBUF_TYPE_NOSPLIT);
+    std::atomic<int> done(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&rb, &done, p, zeroCopy]() {
+            uint8_t temp[ITEM_SIZE];
+            for (int seq = 0; seq < ITEMS_PER_PRODUCER; ++seq) {
+                while (true) {
+                    if (zeroCopy) {
+                        void* item;
+                        {
+                            std::lock_guard<std::mutex> lock(rb.mutex);
+                            item = ringbufCoreAcquire(rb.core(), ITEM_SIZE);
+                        }
+                        if (item != nullptr) {
+                            buildItem(static_cast<uint8_t*>(item), p, seq);
+                            std::lock_guard<std::mutex> lock(rb.mutex);
+                            ringbufCoreComplete(rb.core(), item);
+                            break;
+                        }
+                    } else {
+                        buildItem(temp, p, seq);
+                        std::lock_guard<std::mutex> lock(rb.mutex);
+                        if (ringbufCoreSend(rb.core(), temp, ITEM_SIZE) == pdTRUE) {
+                            break;
+                        }
+                    }
+                    std::this_thread::yield();
+                }
+            }
+            ++done;
+        });
+    }
+
+    int received = 0;
+    uint64_t checksum = 0;
+    void* items[32];
+    size_t sizes[32];
+    while (received < PRODUCERS * ITEMS_PER_PRODUCER) {
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(rb.mutex);
+            count = ringbufCoreReceiveMultiple(rb.core(), items, sizes, batch ? 32 : 1, 0);
+        }
+        if (count == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            REQUIRE(sizes[i] == ITEM_SIZE);
+            checksum += static_cast<uint8_t*>(items[i])[0];
+        }
+        std::lock_guard<std::mutex> lock(rb.mutex);
+        for (size_t i = 0; i < count; ++i) {
+            ringbufCoreReturn(rb.core(), items[i]);
+        }
+        received += count;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    CHECK(done == PRODUCERS);
+    CHECK(checksum > 0);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return received / elapsed;
+}
+
+TEST_CASE("benchmark multi-producer throughput", "[ringbuf][bench]")
+{
+    printf("%d producers, %zu byte items\n", PRODUCERS, ITEM_SIZE);
+    printf("Copy send, single receive: %.0f items/s\n", runBenchmark(false, false));
+    printf("Copy send, batch receive: %.0f items/s\n", runBenchmark(false, true));
+    printf("Acquire/complete, single receive: %.0f items/s\n", runBenchmark(true, false));
+    printf("Acquire/complete, batch receive: %.0f items/s\n", runBenchmark(true, true));
+}
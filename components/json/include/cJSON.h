@@ -52,6 +52,9 @@ typedef struct cJSON {
 	double valuedouble;			/* The item's number, if type==cJSON_Number */
 
 	char *string;				/* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
+
+	struct cJSON_Arena *arena;	/* The arena holding the item and its strings, 0 if they are on the heap. */
+	struct cJSON_Index *index;	/* Hash index of the members of a large object parsed into an arena, 0 if there is none. */
 } cJSON;
 
 typedef struct cJSON_Hooks {
@@ -62,6 +65,23 @@ typedef struct cJSON_Hooks {
 /* Supply malloc, realloc and free functions to cJSON */
 extern void cJSON_InitHooks(cJSON_Hooks* hooks);
 
+/* An arena holds the items and strings of parsed JSON in a few large blocks instead of one heap allocation each.
+   It allocates from the buffer supplied to cJSON_InitArena first; when that is full, it adds blocks of block_size
+   bytes from the heap, or fails the parse if block_size is 0. */
+typedef struct cJSON_Arena {
+	char *buffer;				/* The block being allocated from, its size and the number of bytes used. */
+	size_t size,used;
+	size_t block_size;			/* The size of the blocks added from the heap, 0 if the arena may not grow. */
+	void *blocks;				/* The chain of blocks added from the heap. */
+	char *first;				/* The caller's buffer and its size. */
+	size_t first_size;
+} cJSON_Arena;
+
+/* Set up an arena which allocates from buffer first (may be 0) and then from blocks of block_size bytes (may be 0). */
+extern void cJSON_InitArena(cJSON_Arena *arena,void *buffer,size_t size,size_t block_size);
+/* Release everything parsed into the arena at once and make it ready for reuse. The caller's buffer is kept. */
+extern void cJSON_FreeArena(cJSON_Arena *arena);
+
 
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse(const char *value);
@@ -127,6 +147,11 @@ The item->next and ->prev pointers are always zero on return from Duplicate. */
 
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 extern cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated);
+/* ParseWithArena places all items and strings in arena. Objects with CJSON_INDEX_THRESHOLD or more members get a hash
+   index, which makes cJSON_GetObjectItem on them take constant time. The items are released by cJSON_FreeArena; cJSON_Delete
+   on them only frees items added from the heap. Adding, detaching or replacing members drops the index of an object; if
+   you relink or rename the members of an indexed object by hand, set its index to 0. On failure nothing is left in arena. */
+extern cJSON *cJSON_ParseWithArena(const char *value,cJSON_Arena *arena);
 
 extern void cJSON_Minify(char *json);
 
@@ -30,8 +30,14 @@
 #include <float.h>
 #include <limits.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "cJSON.h"
 
+/* Objects parsed into an arena with at least this many members get a hash index, 0 disables the index. */
+#ifndef CJSON_INDEX_THRESHOLD
+#define CJSON_INDEX_THRESHOLD 16
+#endif
+
 static const char *ep;
 
 const char *cJSON_GetErrorPtr(void) {return ep;}
@@ -69,13 +75,98 @@ void cJSON_InitHooks(cJSON_Hooks* hooks)
 	cJSON_free	 = (hooks->free_fn)?hooks->free_fn:free;
 }
 
+/* Arenas: blocks added from the heap are chained through a header in front of their data. */
+typedef struct cJSON_ArenaBlock {struct cJSON_ArenaBlock *next;double align;} cJSON_ArenaBlock;
+#define ARENA_BLOCK_DATA(block)	((char*)(block)+sizeof(cJSON_ArenaBlock))
+
+void cJSON_InitArena(cJSON_Arena *arena,void *buffer,size_t size,size_t block_size)
+{
+	memset(arena,0,sizeof(cJSON_Arena));
+	arena->first=arena->buffer=(char*)buffer;
+	arena->first_size=arena->size=buffer?size:0;
+	arena->block_size=block_size;
+}
+
+/* Give back the blocks added after mark was taken and allocate from where the arena was then. */
+static void arena_rollback(cJSON_Arena *arena,const cJSON_Arena *mark)
+{
+	cJSON_ArenaBlock *block;
+	while (arena->blocks!=mark->blocks) {block=(cJSON_ArenaBlock*)arena->blocks;arena->blocks=block->next;cJSON_free(block);}
+	arena->buffer=mark->buffer;arena->size=mark->size;arena->used=mark->used;
+}
+
+void cJSON_FreeArena(cJSON_Arena *arena)
+{
+	cJSON_Arena empty;
+	cJSON_InitArena(&empty,arena->first,arena->first_size,arena->block_size);
+	arena_rollback(arena,&empty);
+}
+
+/* Allocate sz bytes aligned to align (a power of 2) from the arena, adding a block if the current one is full. */
+static void *arena_alloc(cJSON_Arena *arena,size_t sz,size_t align)
+{
+	cJSON_ArenaBlock *block;size_t block_size;
+	if (arena->buffer)
+	{
+		size_t offset=(((uintptr_t)arena->buffer+arena->used+align-1)&~(uintptr_t)(align-1))-(uintptr_t)arena->buffer;
+		if (offset+sz<=arena->size) {arena->used=offset+sz;return arena->buffer+offset;}
+	}
+	if (!arena->block_size) return 0;	/* the arena may not grow */
+
+	block_size=(sz>arena->block_size)?sz:arena->block_size;
+	block=(cJSON_ArenaBlock*)cJSON_malloc(sizeof(cJSON_ArenaBlock)+block_size);
+	if (!block) return 0;
+	block->next=(cJSON_ArenaBlock*)arena->blocks;arena->blocks=block;
+	arena->buffer=ARENA_BLOCK_DATA(block);arena->size=block_size;arena->used=sz;
+	return arena->buffer;
+}
+
+/* Allocate from the arena if there is one, from the heap otherwise. */
+static void *cJSON_alloc(cJSON_Arena *arena,size_t sz) {return arena?arena_alloc(arena,sz,1):cJSON_malloc(sz);}
+
+static char* arena_strdup(cJSON_Arena *arena,const char* str)
+{
+	size_t len=strlen(str)+1;char *copy;
+	if (!(copy=(char*)cJSON_alloc(arena,len))) return 0;
+	memcpy(copy,str,len);
+	return copy;
+}
+
 /* Internal constructor. */
-static cJSON *cJSON_New_Item(void)
+static cJSON *cJSON_New_ArenaItem(cJSON_Arena *arena)
 {
-	cJSON* node = (cJSON*)cJSON_malloc(sizeof(cJSON));
-	if (node) memset(node,0,sizeof(cJSON));
+	cJSON* node = (cJSON*)(arena?arena_alloc(arena,sizeof(cJSON),sizeof(double)):cJSON_malloc(sizeof(cJSON)));
+	if (node) {memset(node,0,sizeof(cJSON));node->arena=arena;}
 	return node;
 }
+static cJSON *cJSON_New_Item(void) {return cJSON_New_ArenaItem(0);}
+
+/* Hash index of the members of an object: open addressing on a case insensitive hash of the names. Members are
+   inserted in list order, so a lookup finds the first of several members with the same name, like a walk would. */
+typedef struct cJSON_Index {unsigned mask;cJSON *slots[];} cJSON_Index;
+
+static unsigned cJSON_hash(const char *str)
+{
+	unsigned h=2166136261u;
+	while (*str) h=(h^(unsigned)tolower(*(const unsigned char *)str++))*16777619u;
+	return h;
+}
+
+static void cJSON_IndexObject(cJSON *object,int numentries)
+{
+	unsigned size=4,i;cJSON *c;cJSON_Index *index;
+	while (size<(unsigned)numentries*2) size<<=1;	/* at most half full */
+	index=(cJSON_Index*)arena_alloc(object->arena,sizeof(cJSON_Index)+size*sizeof(cJSON*),sizeof(void*));
+	if (!index) return;	/* lookups walk the members instead */
+	index->mask=size-1;
+	memset(index->slots,0,size*sizeof(cJSON*));
+	for (c=object->child;c;c=c->next)
+	{
+		for (i=cJSON_hash(c->string)&index->mask;index->slots[i];i=(i+1)&index->mask);
+		index->slots[i]=c;
+	}
+	object->index=index;
+}
 
 /* Delete a cJSON structure. */
 void cJSON_Delete(cJSON *c)
@@ -85,9 +176,12 @@ void cJSON_Delete(cJSON *c)
 	{
 		next=c->next;
 		if (!(c->type&cJSON_IsReference) && c->child) cJSON_Delete(c->child);
-		if (!(c->type&cJSON_IsReference) && c->valuestring) cJSON_free(c->valuestring);
-		if (!(c->type&cJSON_StringIsConst) && c->string) cJSON_free(c->string);
-		cJSON_free(c);
+		if (!c->arena)	/* Items in an arena are released with it. */
+		{
+			if (!(c->type&cJSON_IsReference) && c->valuestring) cJSON_free(c->valuestring);
+			if (!(c->type&cJSON_StringIsConst) && c->string) cJSON_free(c->string);
+			cJSON_free(c);
+		}
 		c=next;
 	}
 }
@@ -196,7 +290,7 @@ static const char *parse_string(cJSON *item,const char *str)
 	
 	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
 	
-	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+	out=(char*)cJSON_alloc(item->arena,len+1);	/* This is how long we need for the string, roughly. */
 	if (!out) return 0;
 	
 	ptr=str+1;ptr2=out;
@@ -319,22 +413,31 @@ static char *print_object(cJSON *item,int depth,int fmt,printbuffer *p);
 /* Utility to jump whitespace and cr/lf */
 static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
 
-/* Parse an object - create a new root, and populate. */
-cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
+/* Parse an object - create a new root, and populate. Children are allocated where their parent is. */
+static cJSON *parse_root(const char *value,cJSON_Arena *arena,const char **return_parse_end,int require_null_terminated)
 {
 	const char *end=0;
-	cJSON *c=cJSON_New_Item();
+	cJSON_Arena mark={0};
+	cJSON *c;
+	if (arena) mark=*arena;
+	c=cJSON_New_ArenaItem(arena);
 	ep=0;
 	if (!c) return 0;       /* memory fail */
 
 	end=parse_value(c,skip(value));
-	if (!end)	{cJSON_Delete(c);return 0;}	/* parse failure. ep is set. */
-
 	/* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
-	if (require_null_terminated) {end=skip(end);if (*end) {cJSON_Delete(c);ep=end;return 0;}}
+	if (end && require_null_terminated) {end=skip(end);if (*end) {ep=end;end=0;}}
+	if (!end)	/* parse failure. ep is set. */
+	{
+		if (arena) arena_rollback(arena,&mark);
+		else cJSON_Delete(c);
+		return 0;
+	}
 	if (return_parse_end) *return_parse_end=end;
 	return c;
 }
+cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated) {return parse_root(value,0,return_parse_end,require_null_terminated);}
+cJSON *cJSON_ParseWithArena(const char *value,cJSON_Arena *arena) {return parse_root(value,arena,0,0);}
 /* Default options for cJSON_Parse */
 cJSON *cJSON_Parse(const char *value) {return cJSON_ParseWithOpts(value,0,0);}
 
@@ -412,7 +515,7 @@ static const char *parse_array(cJSON *item,const char *value)
 	value=skip(value+1);
 	if (*value==']') return value+1;	/* empty array. */
 
-	item->child=child=cJSON_New_Item();
+	item->child=child=cJSON_New_ArenaItem(item->arena);
 	if (!item->child) return 0;		 /* memory fail */
 	value=skip(parse_value(child,skip(value)));	/* skip any spacing, get the value. */
 	if (!value) return 0;
@@ -420,7 +523,7 @@ static const char *parse_array(cJSON *item,const char *value)
 	while (*value==',')
 	{
 		cJSON *new_item;
-		if (!(new_item=cJSON_New_Item())) return 0; 	/* memory fail */
+		if (!(new_item=cJSON_New_ArenaItem(item->arena))) return 0; 	/* memory fail */
 		child->next=new_item;new_item->prev=child;child=new_item;
 		value=skip(parse_value(child,skip(value+1)));
 		if (!value) return 0;	/* memory fail */
@@ -513,14 +616,14 @@ static char *print_array(cJSON *item,int depth,int fmt,printbuffer *p)
 /* Build an object from the text. */
 static const char *parse_object(cJSON *item,const char *value)
 {
-	cJSON *child;
+	cJSON *child;int numentries=1;
 	if (*value!='{')	{ep=value;return 0;}	/* not an object! */
 	
 	item->type=cJSON_Object;
 	value=skip(value+1);
 	if (*value=='}') return value+1;	/* empty array. */
 	
-	item->child=child=cJSON_New_Item();
+	item->child=child=cJSON_New_ArenaItem(item->arena);
 	if (!item->child) return 0;
 	value=skip(parse_string(child,skip(value)));
 	if (!value) return 0;
@@ -532,8 +635,8 @@ static const char *parse_object(cJSON *item,const char *value)
 	while (*value==',')
 	{
 		cJSON *new_item;
-		if (!(new_item=cJSON_New_Item()))	return 0; /* memory fail */
-		child->next=new_item;new_item->prev=child;child=new_item;
+		if (!(new_item=cJSON_New_ArenaItem(item->arena)))	return 0; /* memory fail */
+		child->next=new_item;new_item->prev=child;child=new_item;numentries++;
 		value=skip(parse_string(child,skip(value+1)));
 		if (!value) return 0;
 		child->string=child->valuestring;child->valuestring=0;
@@ -542,7 +645,11 @@ static const char *parse_object(cJSON *item,const char *value)
 		if (!value) return 0;
 	}
 	
-	if (*value=='}') return value+1;	/* end of array */
+	if (*value=='}')	/* end of array */
+	{
+		if (item->arena && CJSON_INDEX_THRESHOLD && numentries>=CJSON_INDEX_THRESHOLD) cJSON_IndexObject(item,numentries);
+		return value+1;
+	}
 	ep=value;return 0;	/* malformed. */
 }
 
@@ -660,33 +767,42 @@ static char *print_object(cJSON *item,int depth,int fmt,printbuffer *p)
 /* Get Array size/item / object item. */
 int    cJSON_GetArraySize(cJSON *array)							{cJSON *c=array->child;int i=0;while(c)i++,c=c->next;return i;}
 cJSON *cJSON_GetArrayItem(cJSON *array,int item)				{cJSON *c=array->child;  while (c && item>0) item--,c=c->next; return c;}
-cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)	{cJSON *c=object->child; while (c && cJSON_strcasecmp(c->string,string)) c=c->next; return c;}
+cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)
+{
+	cJSON *c;unsigned i;
+	if (object->index && string)
+	{
+		for (i=cJSON_hash(string)&object->index->mask;(c=object->index->slots[i]);i=(i+1)&object->index->mask) if (!cJSON_strcasecmp(c->string,string)) return c;
+		return 0;
+	}
+	c=object->child; while (c && cJSON_strcasecmp(c->string,string)) c=c->next; return c;
+}
 
 /* Utility for array list handling. */
 static void suffix_object(cJSON *prev,cJSON *item) {prev->next=item;item->prev=prev;}
 /* Utility for handling references. */
-static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type|=cJSON_IsReference;ref->next=ref->prev=0;return ref;}
+static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type|=cJSON_IsReference;ref->next=ref->prev=0;ref->arena=0;ref->index=0;return ref;}
 
 /* Add item to array/object. */
-void   cJSON_AddItemToArray(cJSON *array, cJSON *item)						{cJSON *c=array->child;if (!item) return; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
-void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string) cJSON_free(item->string);item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
-void   cJSON_AddItemToObjectCS(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&cJSON_StringIsConst) && item->string) cJSON_free(item->string);item->string=(char*)string;item->type|=cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToArray(cJSON *array, cJSON *item)						{cJSON *c=array->child;if (!item) return; array->index=0; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
+void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string && !item->arena) cJSON_free(item->string);item->string=arena_strdup(item->arena,string);cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToObjectCS(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&cJSON_StringIsConst) && item->string && !item->arena) cJSON_free(item->string);item->string=(char*)string;item->type|=cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
 void	cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item)						{cJSON_AddItemToArray(array,create_reference(item));}
 void	cJSON_AddItemReferenceToObject(cJSON *object,const char *string,cJSON *item)	{cJSON_AddItemToObject(object,string,create_reference(item));}
 
 cJSON *cJSON_DetachItemFromArray(cJSON *array,int which)			{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return 0;
-	if (c->prev) c->prev->next=c->next;if (c->next) c->next->prev=c->prev;if (c==array->child) array->child=c->next;c->prev=c->next=0;return c;}
+	array->index=0;if (c->prev) c->prev->next=c->next;if (c->next) c->next->prev=c->prev;if (c==array->child) array->child=c->next;c->prev=c->next=0;return c;}
 void   cJSON_DeleteItemFromArray(cJSON *array,int which)			{cJSON_Delete(cJSON_DetachItemFromArray(array,which));}
 cJSON *cJSON_DetachItemFromObject(cJSON *object,const char *string) {int i=0;cJSON *c=object->child;while (c && cJSON_strcasecmp(c->string,string)) i++,c=c->next;if (c) return cJSON_DetachItemFromArray(object,i);return 0;}
 void   cJSON_DeleteItemFromObject(cJSON *object,const char *string) {cJSON_Delete(cJSON_DetachItemFromObject(object,string));}
 
 /* Replace array/object items with new ones. */
 void   cJSON_InsertItemInArray(cJSON *array,int which,cJSON *newitem)		{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) {cJSON_AddItemToArray(array,newitem);return;}
-	newitem->next=c;newitem->prev=c->prev;c->prev=newitem;if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;}
+	array->index=0;newitem->next=c;newitem->prev=c->prev;c->prev=newitem;if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;}
 void   cJSON_ReplaceItemInArray(cJSON *array,int which,cJSON *newitem)		{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return;
-	newitem->next=c->next;newitem->prev=c->prev;if (newitem->next) newitem->next->prev=newitem;
+	array->index=0;newitem->next=c->next;newitem->prev=c->prev;if (newitem->next) newitem->next->prev=newitem;
 	if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;c->next=c->prev=0;cJSON_Delete(c);}
-void   cJSON_ReplaceItemInObject(cJSON *object,const char *string,cJSON *newitem){int i=0;cJSON *c=object->child;while(c && cJSON_strcasecmp(c->string,string))i++,c=c->next;if(c){newitem->string=cJSON_strdup(string);cJSON_ReplaceItemInArray(object,i,newitem);}}
+void   cJSON_ReplaceItemInObject(cJSON *object,const char *string,cJSON *newitem){int i=0;cJSON *c=object->child;while(c && cJSON_strcasecmp(c->string,string))i++,c=c->next;if(c){newitem->string=arena_strdup(newitem->arena,string);cJSON_ReplaceItemInArray(object,i,newitem);}}
 
 /* Create basic types: */
 cJSON *cJSON_CreateNull(void)					{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_NULL;return item;}
@@ -0,0 +1,311 @@
+#include "catch.hpp"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "cJSON.h"
+
+/* Counts the heap allocations cJSON makes */
+static size_t s_allocs;
+static size_t s_live;
+
+static void* countingMalloc(size_t size)
+{
+    ++s_allocs;
+    ++s_live;
+    return malloc(size);
+}
+
+static void countingFree(void* ptr)
+{
+    if (ptr) {
+        --s_live;
+    }
+    free(ptr);
+}
+
+struct HeapCounter {
+    HeapCounter()
+    {
+        cJSON_Hooks hooks = { countingMalloc, countingFree };
+        cJSON_InitHooks(&hooks);
+        s_allocs = 0;
+        s_live = 0;
+    }
+    ~HeapCounter()
+    {
+        cJSON_InitHooks(nullptr);
+    }
+};
+
+/* Configuration pushed by a cloud service: a few nested objects, arrays of
+   small objects, strings with escapes and numbers of every kind */
+static std::string cloudConfig()
+{
+    std::string json = "{\"version\": 12, \"device\": {\"name\": \"esp32-\\\"kitchen\\\"\", "
+                       "\"fw\": \"v2.1.0-rc1\", \"reboot_after\": 86400, \"tz\": \"CET-1CEST,M3.5.0,M10.5.0/3\"}, "
+                       "\"wifi\": {\"ssid\": \"home\", \"channels\": [1, 6, 11], \"power\": -2.5e1, \"ps\": true}, \"sensors\": [";
+    for (int i = 0; i < 36; ++i) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s{\"id\": \"sensor-%02d\", \"type\": \"%s\", \"interval_ms\": %d, "
+                 "\"threshold\": %d.%d, \"enabled\": %s, \"tags\": [\"room%d\", \"floor%d\"], \"calib\": null}",
+                 i ? ", " : "", i, (i % 3) ? "temperature" : "humidity", 1000 * (i + 1), i, i * 7 % 10,
+                 (i % 2) ? "true" : "false", i, i / 12);
+        json += buf;
+    }
+    json += "], \"limits\": {";
+    for (int i = 0; i < 40; ++i) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s\"limit_%d\": %d", i ? ", " : "", i, i * 100);
+        json += buf;
+    }
+    json += "}, \"note\": \"caf\\u00e9 \\ud83d\\ude00\\n\"}";
+    return json;
+}
+
+/* Flat object with many members, looked up by name */
+static std::string flatObject(int count)
+{
+    std::string json = "{";
+    for (int i = 0; i < count; ++i) {
+        json += (i ? ", \"Key" : "\"Key") + std::to_string(i) + "\": " + std::to_string(i);
+    }
+    return json + "}";
+}
+
+static std::string print(cJSON* item)
+{
+    char* out = cJSON_PrintUnformatted(item);
+    std::string result(out);
+    countingFree(out);
+    return result;
+}
+
+TEST_CASE("arena parse gives the same tree as the heap parse", "[cjson]")
+{
+    const std::string docs[] = {
+        cloudConfig(),
+        flatObject(100),
+        "[1, -2.5, \"a\", [], {}, [[[]]], {\"x\": {\"y\": {\"z\": null}}}, true, false]",
+        "\"just a string\"",
+        "42",
+    };
+    for (auto& doc : docs) {
+        cJSON* heap = cJSON_Parse(doc.c_str());
+        REQUIRE(heap != nullptr);
+        cJSON_Arena arena;
+        cJSON_InitArena(&arena, nullptr, 0, 1024);
+        cJSON* parsed = cJSON_ParseWithArena(doc.c_str(), &arena);
+        REQUIRE(parsed != nullptr);
+        CHECK(print(parsed) == print(heap));
+        cJSON_Delete(heap);
+        cJSON_FreeArena(&arena);
+    }
+}
+
+TEST_CASE("arena parse takes a few blocks from the heap", "[cjson]")
+{
+    HeapCounter counter;
+    const std::string doc = cloudConfig();
+    cJSON_Arena arena;
+    cJSON_InitArena(&arena, nullptr, 0, 4096);
+    cJSON* root = cJSON_ParseWithArena(doc.c_str(), &arena);
+    REQUIRE(root != nullptr);
+    CHECK(s_allocs > 0);
+    CHECK(s_allocs <= 16);
+    cJSON_FreeArena(&arena);
+    CHECK(s_live == 0);
+
+    /* and none at all with a buffer which is large enough */
+    static char buffer[64 * 1024];
+    cJSON_InitArena(&arena, buffer, sizeof(buffer), 0);
+    s_allocs = 0;
+    root = cJSON_ParseWithArena(doc.c_str(), &arena);
+    REQUIRE(root != nullptr);
+    CHECK(s_allocs == 0);
+    CHECK(cJSON_GetArraySize(cJSON_GetObjectItem(root, "sensors")) == 36);
+    cJSON_FreeArena(&arena);
+    CHECK(arena.used == 0);
+}
+
+TEST_CASE("failed parse leaves nothing in the arena", "[cjson]")
+{
+    HeapCounter counter;
+    cJSON_Arena arena;
+    cJSON_InitArena(&arena, nullptr, 0, 256);
+    cJSON* first = cJSON_ParseWithArena("{\"a\": [1, 2, 3]}", &arena);
+    REQUIRE(first != nullptr);
+    size_t live = s_live;
+    size_t used = arena.used;
+
+    /* malformed after many items were allocated */
+    std::string bad = flatObject(200);
+    bad.back() = ']';
+    CHECK(cJSON_ParseWithArena(bad.c_str(), &arena) == nullptr);
+    CHECK(cJSON_GetErrorPtr() != nullptr);
+    CHECK(s_live == live);
+    CHECK(arena.used == used);
+    CHECK(print(first) == "{\"a\":[1,2,3]}");
+
+    /* does not fit in a fixed buffer */
+    char buffer[512];
+    cJSON_Arena fixed;
+    cJSON_InitArena(&fixed, buffer, sizeof(buffer), 0);
+    CHECK(cJSON_ParseWithArena(flatObject(50).c_str(), &fixed) == nullptr);
+    CHECK(fixed.used == 0);
+    CHECK(cJSON_ParseWithArena("[1, 2]", &fixed) != nullptr);
+
+    cJSON_FreeArena(&arena);
+    CHECK(s_live == 0);
+}
+
+TEST_CASE("indexed objects find members like a walk does", "[cjson]")
+{
+    const std::string doc = flatObject(100);
+    cJSON_Arena arena;
+    cJSON_InitArena(&arena, nullptr, 0, 4096);
+    cJSON* root = cJSON_ParseWithArena(doc.c_str(), &arena);
+    REQUIRE(root != nullptr);
+    CHECK(root->index != nullptr);
+    for (int i = 0; i < 100; ++i) {
+        std::string key = "Key" + std::to_string(i);
+        cJSON* item = cJSON_GetObjectItem(root, key.c_str());
+        REQUIRE(item != nullptr);
+        CHECK(item->valueint == i);
+        /* case insensitive */
+        key[0] = 'k';
+        key[1] = 'E';
+        CHECK(cJSON_GetObjectItem(root, key.c_str()) == item);
+    }
+    CHECK(cJSON_GetObjectItem(root, "Key100") == nullptr);
+    CHECK(cJSON_GetObjectItem(root, "") == nullptr);
+
+    /* small objects are walked */
+    cJSON* small = cJSON_ParseWithArena("{\"a\": 1, \"b\": 2}", &arena);
+    CHECK(small->index == nullptr);
+    CHECK(cJSON_GetObjectItem(small, "B")->valueint == 2);
+
+    /* the first of several members with the same name */
+    std::string dup = flatObject(30);
+    dup.back() = ',';
+    dup += "\"key7\": 700}";
+    cJSON* dups = cJSON_ParseWithArena(dup.c_str(), &arena);
+    REQUIRE(dups->index != nullptr);
+    CHECK(cJSON_GetObjectItem(dups, "KEY7")->valueint == 7);
+    cJSON_FreeArena(&arena);
+}
+
+TEST_CASE("changing the members of an arena object", "[cjson]")
+{
+    HeapCounter counter;
+    cJSON_Arena arena;
+    cJSON_InitArena(&arena, nullptr, 0, 4096);
+    cJSON* root = cJSON_ParseWithArena(flatObject(40).c_str(), &arena);
+    REQUIRE(root != nullptr);
+    REQUIRE(root->index != nullptr);
+    size_t live = s_live;
+
+    /* items from the heap are added, arena items are moved around */
+    cJSON_AddNumberToObject(root, "added", 1000);
+    CHECK(root->index == nullptr);
+    CHECK(cJSON_GetObjectItem(root, "added")->valueint == 1000);
+    cJSON_ReplaceItemInObject(root, "Key3", cJSON_CreateString("three"));
+    CHECK(std::string(cJSON_GetObjectItem(root, "key3")->valuestring) == "three");
+    cJSON* moved = cJSON_DetachItemFromObject(root, "Key5");
+    REQUIRE(moved != nullptr);
+    cJSON_AddItemToObject(root, "renamed", moved);
+    CHECK(cJSON_GetObjectItem(root, "Key5") == nullptr);
+    CHECK(cJSON_GetObjectItem(root, "renamed")->valueint == 5);
+    cJSON_DeleteItemFromObject(root, "Key6");
+    CHECK(cJSON_GetObjectItem(root, "Key6") == nullptr);
+    CHECK(cJSON_GetArraySize(root) == 40);
+
+    /* deleting frees the heap items and leaves the rest to the arena */
+    cJSON_Delete(root);
+    CHECK(s_live == live);
+    cJSON_FreeArena(&arena);
+    CHECK(s_live == 0);
+}
+
+TEST_CASE("duplicated arena items live on the heap", "[cjson]")
+{
+    HeapCounter counter;
+    cJSON_Arena arena;
+    cJSON_InitArena(&arena, nullptr, 0, 4096);
+    const std::string doc = cloudConfig();
+    cJSON* root = cJSON_ParseWithArena(doc.c_str(), &arena);
+    REQUIRE(root != nullptr);
+    cJSON* copy = cJSON_Duplicate(root, 1);
+    cJSON_FreeArena(&arena);
+    CHECK(copy->arena == nullptr);
+    cJSON* heap = cJSON_Parse(doc.c_str());
+    CHECK(print(copy) == print(heap));
+    cJSON_Delete(copy);
+    cJSON_Delete(heap);
+    CHECK(s_live == 0);
+}
+
+/* Allocations and time per parse of |doc|, each parse followed by |lookups| lookups */
+struct BenchResult {
+    double allocs;
+    double us;
+};
+
+template<typename Parse, typename Release>
+static BenchResult bench(const std::string& doc, const std::vector<std::string>& keys, Parse parse, Release release)
+{
+    const int RUNS = 2000;
+    s_allocs = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < RUNS; ++i) {
+        cJSON* root = parse(doc.c_str());
+        for (auto& key : keys) {
+            if (!cJSON_GetObjectItem(root, key.c_str())) {
+                FAIL("missing " << key);
+            }
+        }
+        release(root);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return { (double) s_allocs / RUNS, elapsed * 1e6 / RUNS };
+}
+
+TEST_CASE("benchmark parsing with the heap and with an arena", "[cjson][bench]")
+{
+    HeapCounter counter;
+    struct {
+        const char* name;
+        std::string doc;
+        std::vector<std::string> keys;
+    } docs[] = {
+        { "cloud config", cloudConfig(), { "version", "device", "wifi", "sensors", "limits", "note" } },
+        { "flat object of 200", flatObject(200), {} },
+    };
+    for (int i = 0; i < 200; ++i) {
+        docs[1].keys.push_back("key" + std::to_string(i));
+    }
+
+    static char buffer[64 * 1024];
+    cJSON_Arena arena;
+    for (auto& d : docs) {
+        BenchResult heap = bench(d.doc, d.keys, cJSON_Parse, cJSON_Delete);
+        cJSON_InitArena(&arena, nullptr, 0, 2048);
+        BenchResult grown = bench(d.doc, d.keys,
+                                  [&](const char * value) { return cJSON_ParseWithArena(value, &arena); },
+                                  [&](cJSON*) { cJSON_FreeArena(&arena); });
+        cJSON_InitArena(&arena, buffer, sizeof(buffer), 0);
+        BenchResult fixed = bench(d.doc, d.keys,
+                                  [&](const char * value) { return cJSON_ParseWithArena(value, &arena); },
+                                  [&](cJSON*) { cJSON_FreeArena(&arena); });
+        printf("%s, %u bytes, %u lookups:\n", d.name, (unsigned) d.doc.size(), (unsigned) d.keys.size());
+        printf("  heap:            %6.1f allocations, %7.1f us\n", heap.allocs, heap.us);
+        printf("  growable arena:  %6.1f allocations, %7.1f us\n", grown.allocs, grown.us);
+        printf("  caller's buffer: %6.1f allocations, %7.1f us\n", fixed.allocs, fixed.us);
+        CHECK(grown.allocs < heap.allocs / 10);
+        CHECK(fixed.allocs == 0);
+    }
+    CHECK(s_live == 0);
+}
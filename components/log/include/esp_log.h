@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include "sdkconfig.h"
 #include <rom/ets_sys.h>
 
@@ -85,6 +86,48 @@ uint32_t esp_log_timestamp(void);
  */
 void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) __attribute__ ((format (printf, 3, 4)));
 
+#if CONFIG_LOG_ASYNC
+
+/**
+ * @brief Enable or disable asynchronous log output
+ *
+ * In asynchronous mode, esp_log_write only checks log level and copies format
+ * string pointer and arguments into a ring buffer. String arguments are copied
+ * by value, other arguments are stored in binary form. Formatting and output
+ * happen in a separate low priority task.
+ *
+ * When the ring buffer is full, messages are dropped and counted. Formatted
+ * messages longer than 255 characters are truncated. Format strings must stay
+ * valid until the message is output, which is the case for string literals
+ * used with ESP_LOGx macros.
+ *
+ * When asynchronous mode is disabled, this function waits until all buffered
+ * messages are output.
+ *
+ * This function must be called after the scheduler has been started.
+ *
+ * @param enable true to enable asynchronous mode, false to return to
+ *               synchronous output
+ */
+void esp_log_set_async(bool enable);
+
+/**
+ * @brief Wait until all messages in asynchronous log buffer are output
+ *
+ * Messages logged by other tasks while this function waits are not waited for.
+ * The calling task blocks until the output task has written the messages.
+ */
+void esp_log_async_flush(void);
+
+/**
+ * @brief Get the number of messages dropped because asynchronous log buffer was full
+ *
+ * @return number of dropped messages since startup
+ */
+uint32_t esp_log_async_get_dropped(void);
+
+#endif //CONFIG_LOG_ASYNC
+
 
 #if CONFIG_LOG_COLORS
 #define LOG_COLOR_BLACK   "30"
@@ -15,23 +15,39 @@
 /*
  * Log library — implementation notes.
  *
- * Log library stores all tags provided to esp_log_set_level as a linked
+ * Log library stores all tags provided to esp_log_level_set as a linked
  * list. See uncached_tag_entry_t structure.
  *
  * To avoid looking up log level for given tag each time message is
  * printed, this library caches pointers to tags. Because the suggested
  * way of creating tags uses one 'TAG' constant per file, this caching
- * should be effective. Cache is a binary min-heap of cached_tag_entry_t
- * items, ordering is done on 'generation' member. In this context,
- * generation is an integer which is incremented each time an operation
- * with cache is performed. When cache is full, new item is inserted in
- * place of an oldest item (that is, with smallest 'generation' value).
- * After that, bubble-down operation is performed to fix ordering in the
- * min-heap.
+ * should be effective. Cache is an open-addressed hash table of
+ * cached_tag_entry_t items, keyed by tag pointer, with linear probing.
+ *
+ * Lookups in the cache don't take any locks, so that logging statements
+ * (including the ones which are filtered out) don't contend for a mutex.
+ * Entries are only added and replaced under s_log_mutex. A slot never becomes
+ * empty once it has been used, so probe sequences stay intact. A new entry
+ * gets its level before its tag pointer becomes visible.
+ *
+ * Each entry stores the level together with the value of s_log_generation
+ * at the time the level was resolved. esp_log_level_set increments the
+ * generation once the list of tags has been updated, which invalidates all
+ * entries at once. An entry with an old generation is treated as a cache
+ * miss: the level is looked up in the linked list under the mutex, and the
+ * entry is updated with the current generation.
+ *
+ * Number of slots is set with CONFIG_LOG_TAG_CACHE_SIZE. Probe sequences are
+ * at most TAG_CACHE_MAX_PROBES slots long. If all of them are used by other
+ * tags, a new tag replaces one of those entries, picked round-robin, so the
+ * cost of both hits and misses stays bounded however many tags are used.
+ * Each slot has a sequence number which is odd while the slot is being
+ * replaced; a reader which finds the tag only uses the level if the sequence
+ * number was even and didn't change meanwhile.
  *
  * The potential problem with wrap-around of cache generation counter is
- * ignored for now. This will happen if someone happens to output more
- * than 4 billion log entries, at which point wrap-around will not be
+ * ignored for now. This will happen if someone calls esp_log_level_set
+ * more than 500 million times, at which point wrap-around will not be
  * the biggest problem.
  *
  */
@@ -53,12 +69,21 @@
 #include <stdio.h>
 #include <assert.h>
 #include "esp_log.h"
+#include "log_async.h"
 
 
 #ifndef BOOTLOADER_BUILD
 
-// Number of tags to be cached. Must be 2**n - 1, n >= 2.
-#define TAG_CACHE_SIZE 31
+// Number of slots in tag cache, a power of two
+#define TAG_CACHE_SIZE CONFIG_LOG_TAG_CACHE_SIZE
+#define TAG_CACHE_BITS __builtin_ctz(TAG_CACHE_SIZE)
+
+#if (TAG_CACHE_SIZE & (TAG_CACHE_SIZE - 1)) != 0
+#error "CONFIG_LOG_TAG_CACHE_SIZE must be a power of two"
+#endif
+
+// Maximum number of slots looked at for one tag
+#define TAG_CACHE_MAX_PROBES 8
 
 // Maximum time to wait for the mutex in a logging statement.
 #define MAX_MUTEX_WAIT_MS 10
@@ -68,11 +93,16 @@
 // #define LOG_BUILTIN_CHECKS
 
 typedef struct {
-    const char* tag;
-    uint32_t level : 3;
-    uint32_t generation : 29;
+    const char* volatile tag;
+    volatile uint32_t level_generation; // see LEVEL_GENERATION macro
+    volatile uint32_t seq;              // odd while the entry is being replaced
 } cached_tag_entry_t;
 
+#define LEVEL_GENERATION(level, generation) (((generation) << 3) | (level))
+#define LEVEL_OF(level_generation)          ((esp_log_level_t) ((level_generation) & 7))
+#define GENERATION_OF(level_generation)     ((level_generation) >> 3)
+#define GENERATION_MASK                     (UINT32_MAX >> 3)
+
 typedef struct uncached_tag_entry_{
     struct uncached_tag_entry_* next;
     uint8_t level;  // esp_log_level_t as uint8_t
@@ -83,8 +113,8 @@ static esp_log_level_t s_log_default_level = ESP_LOG_VERBOSE;
 static uncached_tag_entry_t* s_log_tags_head = NULL;
 static uncached_tag_entry_t* s_log_tags_tail = NULL;
 static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
-static uint32_t s_log_cache_max_generation = 0;
-static uint32_t s_log_cache_entry_count = 0;
+static volatile uint32_t s_log_generation = 0;
+static uint32_t s_log_cache_replace_count = 0;
 static vprintf_like_t s_log_print_func = &vprintf;
 static SemaphoreHandle_t s_log_mutex = NULL;
 
@@ -95,8 +125,9 @@ static uint32_t s_log_cache_misses = 0;
 static inline bool get_cached_log_level(const char* tag, esp_log_level_t* level);
 static inline bool get_uncached_log_level(const char* tag, esp_log_level_t* level);
 static inline void add_to_cache(const char* tag, esp_log_level_t level);
-static void heap_bubble_down(int index);
-static inline void heap_swap(int i, int j);
+static inline uint32_t tag_hash(const char* tag);
+static inline void replace_cache_entry(cached_tag_entry_t* entry, const char* tag, uint32_t level_generation);
+static inline void publish_log_levels();
 static inline bool should_output(esp_log_level_t level_for_message, esp_log_level_t level_for_tag);
 static inline void clear_log_level_list();
 
@@ -116,6 +147,7 @@ void esp_log_level_set(const char* tag, esp_log_level_t level)
     if (strcmp(tag, "*") == 0) {
         s_log_default_level = level;
         clear_log_level_list();
+        publish_log_levels();
         xSemaphoreGive(s_log_mutex);
         return;
     }
@@ -137,6 +169,7 @@ void esp_log_level_set(const char* tag, esp_log_level_t level)
     if (!s_log_tags_head) {
         s_log_tags_head = new_entry;
     }
+    publish_log_levels();
     xSemaphoreGive(s_log_mutex);
 }
 
@@ -149,8 +182,6 @@ void clear_log_level_list()
     }
     s_log_tags_tail = NULL;
     s_log_tags_head = NULL;
-    s_log_cache_entry_count = 0;
-    s_log_cache_max_generation = 0;
 #ifdef LOG_BUILTIN_CHECKS
     s_log_cache_misses = 0;
 #endif
@@ -161,15 +192,16 @@ void IRAM_ATTR esp_log_write(esp_log_level_t level,
         const char* tag,
         const char* format, ...)
 {
-    if (!s_log_mutex) {
-        s_log_mutex = xSemaphoreCreateMutex();
-    }
-    if (xSemaphoreTake(s_log_mutex, MAX_MUTEX_WAIT_TICKS) == pdFALSE) {
-        return;
-    }
     esp_log_level_t level_for_tag;
-    // Look for the tag in cache first, then in the linked list of all tags
+    // Look for the tag in cache first, this doesn't need the mutex.
+    // If not found, look in the linked list of all tags and update the cache.
     if (!get_cached_log_level(tag, &level_for_tag)) {
+        if (!s_log_mutex) {
+            s_log_mutex = xSemaphoreCreateMutex();
+        }
+        if (xSemaphoreTake(s_log_mutex, MAX_MUTEX_WAIT_TICKS) == pdFALSE) {
+            return;
+        }
         if (!get_uncached_log_level(tag, &level_for_tag)) {
             level_for_tag = s_log_default_level;
         }
@@ -177,74 +209,108 @@ void IRAM_ATTR esp_log_write(esp_log_level_t level,
 #ifdef LOG_BUILTIN_CHECKS
         ++s_log_cache_misses;
 #endif
+        xSemaphoreGive(s_log_mutex);
     }
-    xSemaphoreGive(s_log_mutex);
     if (!should_output(level, level_for_tag)) {
         return;
     }
 
     va_list list;
     va_start(list, format);
+#if CONFIG_LOG_ASYNC
+    if (esp_log_async_write(level, format, list)) {
+        va_end(list);
+        return;
+    }
+#endif
     (*s_log_print_func)(format, list);
     va_end(list);
 }
 
+int esp_log_output(const char* format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = (*s_log_print_func)(format, list);
+    va_end(list);
+    return ret;
+}
+
+static inline uint32_t tag_hash(const char* tag)
+{
+    // Fibonacci hashing of the pointer, top bits are used as slot index
+    return (((uint32_t) (uintptr_t) tag) * 2654435769U) >> (32 - TAG_CACHE_BITS);
+}
+
 static inline bool get_cached_log_level(const char* tag, esp_log_level_t* level)
 {
-    // Look for `tag` in cache
-    int i;
-    for (i = 0; i < s_log_cache_entry_count; ++i) {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
-#endif
-        if (s_log_cache[i].tag == tag) {
+    uint32_t generation = s_log_generation;
+    uint32_t index = tag_hash(tag);
+    for (int probe = 0; probe < TAG_CACHE_MAX_PROBES; ++probe, ++index) {
+        const cached_tag_entry_t* entry = &s_log_cache[index % TAG_CACHE_SIZE];
+        uint32_t seq = entry->seq;
+        const char* entry_tag = entry->tag;
+        if (entry_tag == tag) {
+            uint32_t level_generation = entry->level_generation;
+            if ((seq & 1) != 0 || entry->seq != seq) {
+                // Entry is being replaced by another tag
+                return false;
+            }
+            if (GENERATION_OF(level_generation) != (generation & GENERATION_MASK)) {
+                // Log levels have been changed since this entry was added
+                return false;
+            }
+            *level = LEVEL_OF(level_generation);
+            return true;
+        }
+        if (entry_tag == NULL) {
             break;
         }
     }
-    if (i == s_log_cache_entry_count) { // Not found in cache
-        return false;
-    }
-    // Return level from cache
-    *level = (esp_log_level_t) s_log_cache[i].level;
-    // If cache has been filled, start taking ordering into account
-    // (other options are: dynamically resize cache, add "dummy" entries
-    //  to the cache; this option was chosen because code is much simpler,
-    //  and the unfair behavior of cache will show it self at most once, when
-    //  it has just been filled)
-    if (s_log_cache_entry_count == TAG_CACHE_SIZE) {
-        // Update item generation
-        s_log_cache[i].generation = s_log_cache_max_generation++;
-        // Restore heap ordering
-        heap_bubble_down(i);
-    }
-    return true;
+    return false;
 }
 
+// Must be called with s_log_mutex taken
 static inline void add_to_cache(const char* tag, esp_log_level_t level)
 {
-    uint32_t generation = s_log_cache_max_generation++;
-    // First consider the case when cache is not filled yet.
-    // In this case, just add new entry at the end.
-    // This happens to satisfy binary min-heap ordering.
-    if (s_log_cache_entry_count < TAG_CACHE_SIZE) {
-        s_log_cache[s_log_cache_entry_count] = (cached_tag_entry_t) {
-            .generation = generation,
-            .level = level,
-            .tag = tag
-        };
-        ++s_log_cache_entry_count;
-        return;
+    uint32_t level_generation = LEVEL_GENERATION(level, s_log_generation);
+    uint32_t home = tag_hash(tag);
+    uint32_t index = home;
+    for (int probe = 0; probe < TAG_CACHE_MAX_PROBES; ++probe, ++index) {
+        cached_tag_entry_t* entry = &s_log_cache[index % TAG_CACHE_SIZE];
+        if (entry->tag == tag) {
+            entry->level_generation = level_generation;
+            return;
+        }
+        if (entry->tag == NULL) {
+            // Readers which find the tag must also find the level
+            entry->level_generation = level_generation;
+            __sync_synchronize();
+            entry->tag = tag;
+            return;
+        }
     }
+    // All slots of the probe sequence are taken by other tags
+    uint32_t victim = home + s_log_cache_replace_count++ % TAG_CACHE_MAX_PROBES;
+    replace_cache_entry(&s_log_cache[victim % TAG_CACHE_SIZE], tag, level_generation);
+}
+
+// Must be called with s_log_mutex taken
+static inline void replace_cache_entry(cached_tag_entry_t* entry, const char* tag, uint32_t level_generation)
+{
+    entry->seq = entry->seq + 1;
+    __sync_synchronize();
+    entry->tag = tag;
+    entry->level_generation = level_generation;
+    __sync_synchronize();
+    entry->seq = entry->seq + 1;
+}
 
-    // Cache is full, so we replace the oldest entry (which is at index 0
-    // because this is a min-heap) with the new one, and do bubble-down
-    // operation to restore min-heap ordering.
-    s_log_cache[0] = (cached_tag_entry_t) {
-        .tag = tag,
-        .level = level,
-        .generation = generation
-    };
-    heap_bubble_down(0);
+// Must be called with s_log_mutex taken, after the list of tags was changed
+static inline void publish_log_levels()
+{
+    __sync_synchronize();
+    s_log_generation = s_log_generation + 1;
 }
 
 static inline bool get_uncached_log_level(const char* tag, esp_log_level_t* level)
@@ -265,23 +331,6 @@ static inline bool should_output(esp_log_level_t level_for_message, esp_log_leve
     return level_for_message <= level_for_tag;
 }
 
-static void heap_bubble_down(int index)
-{
-    while (index < TAG_CACHE_SIZE / 2) {
-        int left_index = index * 2 + 1;
-        int right_index = left_index + 1;
-        int next = (s_log_cache[left_index].generation < s_log_cache[right_index].generation) ? left_index : right_index;
-        heap_swap(index, next);
-        index = next;
-    }
-}
-
-static inline void heap_swap(int i, int j)
-{
-    cached_tag_entry_t tmp = s_log_cache[i];
-    s_log_cache[i] = s_log_cache[j];
-    s_log_cache[j] = tmp;
-}
 #endif //BOOTLOADER_BUILD
 
 
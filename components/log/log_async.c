@@ -0,0 +1,631 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Asynchronous log output — implementation notes.
+ *
+ * Messages are passed from logging tasks to the output task through a ring
+ * of fixed size entries. Producers reserve entries by advancing s_head with
+ * compare-and-set, so several tasks (on both CPUs) can log at the same time
+ * without taking a lock. The only consumer is the output task, which advances
+ * s_tail. Head and tail are free running counters, entry index is the counter
+ * modulo number of entries. If head is a full ring ahead of tail, the message
+ * is dropped and s_dropped is incremented.
+ *
+ * Once an entry is filled, the producer sets its 'seq' member to reserved
+ * head value + 1. The consumer only reads an entry when its seq matches the
+ * expected value, so it never sees entries which are reserved but not yet
+ * filled.
+ *
+ * Arguments are not formatted by the producer. Instead, the producer walks the
+ * format string, fetches each argument from the va_list with the type given
+ * by the conversion specifier, and stores it in binary form. Strings are
+ * copied, because they often live on the caller's stack. The consumer walks
+ * the format string again and formats one conversion at a time using
+ * snprintf. Format strings which can not be handled this way (%n, wide
+ * strings, too many arguments) are formatted by the producer into the entry.
+ * If the text doesn't fit into one entry, it is spread over the data of
+ * several consecutive entries. Producer takes the entries following the one
+ * it has reserved if no other task has reserved them yet; otherwise it marks
+ * its entry as skipped and reserves a new run of entries. Entries of a run
+ * are published last to first, so the consumer finds all of them filled once
+ * the first one is.
+ */
+
+#ifndef BOOTLOADER_BUILD
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "esp_attr.h"
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "esp_log.h"
+#include "log_async.h"
+
+#if CONFIG_LOG_ASYNC
+
+#define LOG_ASYNC_ENTRIES       CONFIG_LOG_ASYNC_BUFFER_ENTRIES
+#define LOG_ASYNC_ENTRY_SIZE    128
+#define LOG_ASYNC_LINE_MAX      256
+#define LOG_ASYNC_TASK_STACK    3072
+
+// Longest conversion specifier which is handled asynchronously
+#define LOG_SPEC_MAX            16
+
+// Timeout after which output task looks at the ring even if it wasn't notified
+#define LOG_ASYNC_POLL_TICKS    (100 / portTICK_PERIOD_MS)
+
+#if (LOG_ASYNC_ENTRIES & (LOG_ASYNC_ENTRIES - 1)) != 0
+#error "CONFIG_LOG_ASYNC_BUFFER_ENTRIES must be a power of two"
+#endif
+
+// Entry data contains a formatted message rather than arguments
+#define LOG_ENTRY_FORMATTED     0x01
+// Entry data continues the formatted message of the previous entry
+#define LOG_ENTRY_CONTINUED     0x02
+// Entry doesn't contain a message and is skipped by the output task
+#define LOG_ENTRY_SKIPPED       0x04
+
+typedef struct {
+    volatile uint32_t seq;
+    const char* format;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t size;
+    uint8_t data[LOG_ASYNC_ENTRY_SIZE - sizeof(uint32_t) - sizeof(const char*) - 4];
+} log_entry_t;
+
+#define LOG_ENTRY_DATA_SIZE     sizeof(((log_entry_t*) 0)->data)
+
+// Number of entries needed for a formatted message of given length
+#define LOG_ENTRY_COUNT(len)    (((len) + LOG_ENTRY_DATA_SIZE) / LOG_ENTRY_DATA_SIZE)
+
+typedef enum {
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_PTR,
+    ARG_STR,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_UNSUPPORTED,
+} arg_type_t;
+
+typedef struct {
+    const char* start;      // points to '%'
+    const char* end;        // one past conversion character
+    bool star_width;
+    bool star_precision;
+    arg_type_t type;
+} conv_spec_t;
+
+static log_entry_t* s_ring = NULL;
+static volatile uint32_t s_head = 0;
+static volatile uint32_t s_tail = 0;
+static volatile uint32_t s_dropped = 0;
+static uint32_t s_dropped_reported = 0;
+static volatile bool s_async = false;
+static TaskHandle_t s_task = NULL;
+// Serializes callers of esp_log_async_flush
+static SemaphoreHandle_t s_flush_lock = NULL;
+// Given by the output task after draining the ring while a flush is waiting
+static SemaphoreHandle_t s_flushed = NULL;
+static volatile bool s_flush_waiting = false;
+
+static void log_async_task(void* arg);
+
+static inline bool IRAM_ATTR compare_set(volatile uint32_t* addr, uint32_t compare, uint32_t set)
+{
+    uxPortCompareSet(addr, compare, &set);
+    return set == compare;
+}
+
+static inline void IRAM_ATTR atomic_increment(volatile uint32_t* addr)
+{
+    uint32_t val;
+    do {
+        val = *addr;
+    } while (!compare_set(addr, val, val + 1));
+}
+
+static inline bool IRAM_ATTR is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Find next conversion specifier in format, skipping "%%". Used both by the
+ * producer and the consumer, so that both agree on types of arguments. */
+static bool IRAM_ATTR next_conversion(const char* f, conv_spec_t* spec)
+{
+    for (;;) {
+        while (*f != '%' && *f != 0) {
+            ++f;
+        }
+        if (*f == 0) {
+            return false;
+        }
+        if (f[1] != '%') {
+            break;
+        }
+        f += 2;
+    }
+    spec->start = f++;
+    while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0') {
+        ++f;
+    }
+    spec->star_width = (*f == '*');
+    if (spec->star_width) {
+        ++f;
+    }
+    while (is_digit(*f)) {
+        ++f;
+    }
+    spec->star_precision = false;
+    if (*f == '.') {
+        ++f;
+        spec->star_precision = (*f == '*');
+        if (spec->star_precision) {
+            ++f;
+        }
+        while (is_digit(*f)) {
+            ++f;
+        }
+    }
+    arg_type_t int_type = ARG_INT;
+    bool long_double = false;
+    switch (*f) {
+    case 'h':
+        f += (f[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        if (f[1] == 'l') {
+            int_type = ARG_LLONG;
+            f += 2;
+        } else {
+            int_type = ARG_LONG;
+            ++f;
+        }
+        break;
+    case 'j':
+        int_type = ARG_LLONG;
+        ++f;
+        break;
+    case 'z':
+        int_type = ARG_SIZE;
+        ++f;
+        break;
+    case 't':
+        int_type = ARG_PTRDIFF;
+        ++f;
+        break;
+    case 'L':
+        long_double = true;
+        ++f;
+        break;
+    }
+    switch (*f) {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        spec->type = int_type;
+        break;
+    case 'c':
+        spec->type = (int_type == ARG_INT) ? ARG_INT : ARG_UNSUPPORTED;
+        break;
+    case 's':
+        spec->type = (int_type == ARG_INT) ? ARG_STR : ARG_UNSUPPORTED;
+        break;
+    case 'p':
+        spec->type = ARG_PTR;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->type = long_double ? ARG_LDOUBLE : ARG_DOUBLE;
+        break;
+    default:
+        spec->type = ARG_UNSUPPORTED;
+        break;
+    }
+    if (*f != 0) {
+        ++f;
+    }
+    spec->end = f;
+    if (spec->end - spec->start > LOG_SPEC_MAX) {
+        spec->type = ARG_UNSUPPORTED;
+    }
+    return true;
+}
+
+#define PUT_ARG(type) \
+    do { \
+        type val_ = va_arg(list, type); \
+        if (p + sizeof(val_) > end) { \
+            return false; \
+        } \
+        memcpy(p, &val_, sizeof(val_)); \
+        p += sizeof(val_); \
+    } while (0)
+
+static bool IRAM_ATTR capture_args(log_entry_t* entry, const char* format, va_list list)
+{
+    uint8_t* p = entry->data;
+    uint8_t* end = entry->data + sizeof(entry->data);
+    conv_spec_t spec;
+    while (next_conversion(format, &spec)) {
+        format = spec.end;
+        if (spec.star_width) {
+            PUT_ARG(int);
+        }
+        if (spec.star_precision) {
+            PUT_ARG(int);
+        }
+        switch (spec.type) {
+        case ARG_INT:       PUT_ARG(int); break;
+        case ARG_LONG:      PUT_ARG(long); break;
+        case ARG_LLONG:     PUT_ARG(long long); break;
+        case ARG_SIZE:      PUT_ARG(size_t); break;
+        case ARG_PTRDIFF:   PUT_ARG(ptrdiff_t); break;
+        case ARG_PTR:       PUT_ARG(void*); break;
+        case ARG_DOUBLE:    PUT_ARG(double); break;
+        case ARG_LDOUBLE:   PUT_ARG(long double); break;
+        case ARG_STR: {
+            const char* str = va_arg(list, const char*);
+            if (str == NULL) {
+                str = "(null)";
+            }
+            size_t len = strlen(str) + 1;
+            if (p + len > end) {
+                return false;
+            }
+            memcpy(p, str, len);
+            p += len;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    entry->size = p - entry->data;
+    return true;
+}
+
+/* Reserve count consecutive entries, returns false if the ring is too full */
+static inline bool IRAM_ATTR reserve_entries(uint32_t count, uint32_t* head)
+{
+    uint32_t val;
+    do {
+        val = s_head;
+        if (val - s_tail + count > LOG_ASYNC_ENTRIES) {
+            return false;
+        }
+    } while (!compare_set(&s_head, val, val + count));
+    *head = val;
+    return true;
+}
+
+static inline void IRAM_ATTR publish_entry(log_entry_t* entry, uint32_t head)
+{
+    __sync_synchronize();
+    entry->seq = head + 1;
+    // Output task only needs a notification if it may have found the ring empty
+    if (head == s_tail) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+/* Format a message which is too long for the entry at 'head' into a run of
+ * entries. Called with the entry at 'head' reserved, publishes all entries
+ * it uses. */
+static void __attribute__((noinline)) write_long_message(uint32_t head, esp_log_level_t level,
+        const char* format, const char* text, size_t len)
+{
+    uint32_t count = LOG_ENTRY_COUNT(len);
+    uint32_t first = head;
+    log_entry_t* entry = &s_ring[head & (LOG_ASYNC_ENTRIES - 1)];
+    if (head - s_tail + count > LOG_ASYNC_ENTRIES ||
+            !compare_set(&s_head, head + 1, head + count)) {
+        entry->flags = LOG_ENTRY_SKIPPED;
+        publish_entry(entry, head);
+        if (!reserve_entries(count, &first)) {
+            atomic_increment(&s_dropped);
+            return;
+        }
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        entry = &s_ring[(first + i) & (LOG_ASYNC_ENTRIES - 1)];
+        size_t offset = i * LOG_ENTRY_DATA_SIZE;
+        size_t size = len + 1 - offset;
+        if (size > LOG_ENTRY_DATA_SIZE) {
+            size = LOG_ENTRY_DATA_SIZE;
+        }
+        memcpy(entry->data, text + offset, size);
+        entry->format = format;
+        entry->level = level;
+        entry->flags = (i == 0) ? LOG_ENTRY_FORMATTED : LOG_ENTRY_CONTINUED;
+        entry->size = (i == 0) ? len : size;
+        publish_entry(entry, first + i);
+    }
+}
+
+/* Format the message into the entry at 'head' and publish it. Kept out of
+ * esp_log_async_write so that the line buffer is only on the stack when
+ * a message has to be formatted by the caller. */
+static void __attribute__((noinline)) write_formatted(uint32_t head, esp_log_level_t level,
+        const char* format, va_list list)
+{
+    log_entry_t* entry = &s_ring[head & (LOG_ASYNC_ENTRIES - 1)];
+    char text[LOG_ASYNC_LINE_MAX];
+    int len = vsnprintf(text, sizeof(text), format, list);
+    if (len < 0) {
+        len = 0;
+        text[0] = 0;
+    } else if (len >= (int) sizeof(text)) {
+        len = sizeof(text) - 1;
+    }
+    if (len >= (int) LOG_ENTRY_DATA_SIZE) {
+        write_long_message(head, level, format, text, len);
+        return;
+    }
+    memcpy(entry->data, text, len + 1);
+    entry->flags = LOG_ENTRY_FORMATTED;
+    entry->size = len;
+    publish_entry(entry, head);
+}
+
+bool IRAM_ATTR esp_log_async_write(esp_log_level_t level, const char* format, va_list list)
+{
+    if (!s_async) {
+        return false;
+    }
+    uint32_t head;
+    if (!reserve_entries(1, &head)) {
+        atomic_increment(&s_dropped);
+        return true;
+    }
+
+    log_entry_t* entry = &s_ring[head & (LOG_ASYNC_ENTRIES - 1)];
+    entry->format = format;
+    entry->level = level;
+    entry->flags = 0;
+    va_list copy;
+    va_copy(copy, list);
+    bool captured = capture_args(entry, format, copy);
+    va_end(copy);
+    if (!captured) {
+        write_formatted(head, level, format, list);
+        return true;
+    }
+    publish_entry(entry, head);
+    return true;
+}
+
+#define GET_ARG(type, val) \
+    do { \
+        memcpy(&val, p, sizeof(val)); \
+        p += sizeof(val); \
+    } while (0)
+
+/* Append text in [begin, end) to the line, replacing "%%" with "%" */
+static size_t append_literal(char* line, size_t pos, const char* begin, const char* end)
+{
+    for (const char* c = begin; c < end && pos < LOG_ASYNC_LINE_MAX - 1; ++c) {
+        line[pos++] = *c;
+        if (*c == '%') {
+            ++c;
+        }
+    }
+    return pos;
+}
+
+/* Copy a formatted message from the run of entries starting at 'tail' */
+static size_t copy_formatted(uint32_t tail, char* line)
+{
+    size_t len = s_ring[tail & (LOG_ASYNC_ENTRIES - 1)].size;
+    uint32_t count = LOG_ENTRY_COUNT(len);
+    for (uint32_t i = 0; i < count; ++i) {
+        const log_entry_t* entry = &s_ring[(tail + i) & (LOG_ASYNC_ENTRIES - 1)];
+        size_t offset = i * LOG_ENTRY_DATA_SIZE;
+        size_t size = len + 1 - offset;
+        memcpy(line + offset, entry->data, size < LOG_ENTRY_DATA_SIZE ? size : LOG_ENTRY_DATA_SIZE);
+    }
+    return len;
+}
+
+static size_t format_entry(const log_entry_t* entry, char* line)
+{
+    const uint8_t* p = entry->data;
+    const char* format = entry->format;
+    size_t pos = 0;
+    conv_spec_t spec;
+    while (next_conversion(format, &spec)) {
+        pos = append_literal(line, pos, format, spec.start);
+        format = spec.end;
+
+        // Copy conversion specifier, replacing '*' with actual width or precision
+        char spec_buf[LOG_SPEC_MAX + 24];
+        size_t n = 0;
+        bool precision = false;
+        for (const char* c = spec.start; c != spec.end; ++c) {
+            if (*c == '.') {
+                precision = true;
+            }
+            if (*c != '*') {
+                spec_buf[n++] = *c;
+                continue;
+            }
+            int val;
+            GET_ARG(int, val);
+            if (precision && val < 0) {
+                --n;    // negative precision is taken as if it was omitted
+                continue;
+            }
+            if (val < 0) {
+                spec_buf[n++] = '-';
+                val = -val;
+            }
+            n += sprintf(spec_buf + n, "%d", val);
+        }
+        spec_buf[n] = 0;
+
+        char* out = line + pos;
+        size_t avail = LOG_ASYNC_LINE_MAX - pos;
+        int len = 0;
+        switch (spec.type) {
+        case ARG_INT:       { int v; GET_ARG(int, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_LONG:      { long v; GET_ARG(long, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_LLONG:     { long long v; GET_ARG(long long, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_SIZE:      { size_t v; GET_ARG(size_t, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_PTRDIFF:   { ptrdiff_t v; GET_ARG(ptrdiff_t, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_PTR:       { void* v; GET_ARG(void*, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_DOUBLE:    { double v; GET_ARG(double, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_LDOUBLE:   { long double v; GET_ARG(long double, v); len = snprintf(out, avail, spec_buf, v); break; }
+        case ARG_STR: {
+            const char* v = (const char*) p;
+            p += strlen(v) + 1;
+            len = snprintf(out, avail, spec_buf, v);
+            break;
+        }
+        default:
+            break;
+        }
+        if (len > 0) {
+            pos += ((size_t) len < avail) ? (size_t) len : avail - 1;
+        }
+    }
+    pos = append_literal(line, pos, format, format + strlen(format));
+    line[pos] = 0;
+    return pos;
+}
+
+static void output_line(const char* line, size_t len)
+{
+    // Keep line structure of the output if the message was truncated
+    if (len == LOG_ASYNC_LINE_MAX - 1 && line[len - 1] != '\n') {
+        esp_log_output("%s\n", line);
+    } else {
+        esp_log_output("%s", line);
+    }
+}
+
+static void report_dropped(void)
+{
+    uint32_t dropped = s_dropped;
+    if (dropped != s_dropped_reported) {
+        esp_log_output(LOG_FORMAT(W, "%u messages dropped"), esp_log_timestamp(),
+                "log", dropped - s_dropped_reported);
+        s_dropped_reported = dropped;
+    }
+}
+
+static void drain(void)
+{
+    char line[LOG_ASYNC_LINE_MAX];
+    for (;;) {
+        uint32_t tail = s_tail;
+        log_entry_t* entry = &s_ring[tail & (LOG_ASYNC_ENTRIES - 1)];
+        if (entry->seq != tail + 1) {
+            break;
+        }
+        __sync_synchronize();
+        if (entry->flags & LOG_ENTRY_SKIPPED) {
+            s_tail = tail + 1;
+            continue;
+        }
+        if (entry->flags & LOG_ENTRY_FORMATTED) {
+            size_t len = copy_formatted(tail, line);
+            s_tail = tail + LOG_ENTRY_COUNT(len);
+            output_line(line, len);
+            continue;
+        }
+        size_t len = format_entry(entry, line);
+        s_tail = tail + 1;
+        output_line(line, len);
+    }
+    report_dropped();
+    if (s_flush_waiting) {
+        xSemaphoreGive(s_flushed);
+    }
+}
+
+static void log_async_task(void* arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, LOG_ASYNC_POLL_TICKS);
+        drain();
+    }
+}
+
+void esp_log_set_async(bool enable)
+{
+    if (enable && s_task == NULL) {
+        s_ring = (log_entry_t*) calloc(LOG_ASYNC_ENTRIES, sizeof(log_entry_t));
+        s_flush_lock = xSemaphoreCreateMutex();
+        s_flushed = xSemaphoreCreateBinary();
+        if (s_ring == NULL || s_flush_lock == NULL || s_flushed == NULL ||
+                xTaskCreate(&log_async_task, "log", LOG_ASYNC_TASK_STACK, NULL,
+                    CONFIG_LOG_ASYNC_TASK_PRIORITY, &s_task) != pdPASS) {
+            if (s_flush_lock) {
+                vSemaphoreDelete(s_flush_lock);
+                s_flush_lock = NULL;
+            }
+            if (s_flushed) {
+                vSemaphoreDelete(s_flushed);
+                s_flushed = NULL;
+            }
+            free(s_ring);
+            s_ring = NULL;
+            return;
+        }
+    }
+    if (s_task == NULL) {
+        return;
+    }
+    s_async = enable;
+    if (!enable) {
+        esp_log_async_flush();
+    }
+}
+
+void esp_log_async_flush(void)
+{
+    if (s_task == NULL || xTaskGetCurrentTaskHandle() == s_task) {
+        return;
+    }
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    s_flush_waiting = true;
+    // Messages logged after this point are not waited for
+    uint32_t head = s_head;
+    while ((int32_t) (s_tail - head) < 0) {
+        xTaskNotifyGive(s_task);
+        // Timeout covers an entry which is reserved but not yet published
+        xSemaphoreTake(s_flushed, LOG_ASYNC_POLL_TICKS);
+    }
+    s_flush_waiting = false;
+    xSemaphoreGive(s_flush_lock);
+}
+
+uint32_t esp_log_async_get_dropped(void)
+{
+    return s_dropped;
+}
+
+#endif //CONFIG_LOG_ASYNC
+
+#endif //BOOTLOADER_BUILD
@@ -0,0 +1,36 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESP_LOG_ASYNC_H__
+#define __ESP_LOG_ASYNC_H__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include "esp_log.h"
+
+/**
+ * This header file contains declarations of functions shared between log.c
+ * and log_async.c.
+ *
+ * These functions are considered internal and are not designed to be called from applications.
+ */
+
+// Send formatted output to the function set with esp_log_set_vprintf
+int esp_log_output(const char* format, ...) __attribute__ ((format (printf, 1, 2)));
+
+// If asynchronous mode is enabled, queue the message and return true.
+// Otherwise return false, and the caller should output the message itself.
+bool esp_log_async_write(esp_log_level_t level, const char* format, va_list list);
+
+#endif //__ESP_LOG_ASYNC_H__
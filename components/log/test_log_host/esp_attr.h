@@ -0,0 +1,6 @@
+#ifndef __ESP_ATTR_H__
+#define __ESP_ATTR_H__
+
+#define IRAM_ATTR
+
+#endif /* __ESP_ATTR_H__ */
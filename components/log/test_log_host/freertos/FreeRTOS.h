@@ -0,0 +1,32 @@
+/* Host replacement for FreeRTOS.h and portmacro.h, with just enough of them
+   to build the log library. Tasks are backed by POSIX threads. */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                     ( ( BaseType_t ) 0 )
+#define pdTRUE                      ( ( BaseType_t ) 1 )
+#define pdPASS                      ( pdTRUE )
+#define pdFAIL                      ( pdFALSE )
+
+#define configTICK_RATE_HZ          1000
+#define portTICK_PERIOD_MS          ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portMAX_DELAY               ( TickType_t ) 0xffffffffUL
+
+static inline void uxPortCompareSet(volatile uint32_t *addr, uint32_t compare, uint32_t *set)
+{
+    uint32_t expected = compare;
+    if (__atomic_compare_exchange_n(addr, &expected, *set, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        *set = compare;
+    } else {
+        *set = expected;
+    }
+}
+
+#endif //INC_FREERTOS_H
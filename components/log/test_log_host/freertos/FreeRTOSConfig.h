@@ -0,0 +1 @@
+/* Host build: configuration is part of freertos/FreeRTOS.h */
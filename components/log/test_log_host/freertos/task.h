@@ -0,0 +1,29 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*TaskFunction_t)( void * );
+typedef struct host_task* TaskHandle_t;
+
+#define taskSCHEDULER_NOT_STARTED   ( ( BaseType_t ) 1 )
+#define taskSCHEDULER_RUNNING       ( ( BaseType_t ) 2 )
+
+BaseType_t xTaskCreate( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                        void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask );
+void vTaskDelay( const TickType_t xTicksToDelay );
+TickType_t xTaskGetTickCount( void );
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+BaseType_t xTaskGetSchedulerState( void );
+uint32_t ulTaskNotifyTake( BaseType_t xClearCountOnExit, TickType_t xTicksToWait );
+BaseType_t xTaskNotifyGive( TaskHandle_t xTaskToNotify );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INC_TASK_H
@@ -0,0 +1,176 @@
+/* Minimal POSIX thread based implementation of FreeRTOS APIs used by the log library */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_count;
+    TaskFunction_t func;
+    void* arg;
+};
+
+/* Mutexes and binary semaphores, without ownership or priority inheritance */
+struct host_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t count;
+};
+
+static __thread TaskHandle_t s_current_task;
+
+static void* task_start(void* arg)
+{
+    s_current_task = (TaskHandle_t) arg;
+    s_current_task->func(s_current_task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                        void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask )
+{
+    TaskHandle_t task = (TaskHandle_t) calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    task->func = pvTaskCode;
+    task->arg = pvParameters;
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    if (pthread_create(&task->thread, NULL, &task_start, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    struct timespec ts = { .tv_sec = xTicksToDelay / 1000, .tv_nsec = (xTicksToDelay % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return s_current_task;
+}
+
+BaseType_t xTaskGetSchedulerState( void )
+{
+    return taskSCHEDULER_RUNNING;
+}
+
+static void get_deadline(TickType_t ticks, struct timespec* deadline)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ticks / 1000;
+    deadline->tv_nsec += (ticks % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+uint32_t ulTaskNotifyTake( BaseType_t xClearCountOnExit, TickType_t xTicksToWait )
+{
+    TaskHandle_t task = s_current_task;
+    struct timespec deadline;
+    get_deadline(xTicksToWait, &deadline);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_count == 0) {
+        if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t count = task->notify_count;
+    if (count > 0) {
+        task->notify_count = xClearCountOnExit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+BaseType_t xTaskNotifyGive( TaskHandle_t xTaskToNotify )
+{
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    xTaskToNotify->notify_count++;
+    pthread_cond_signal(&xTaskToNotify->cond);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return pdPASS;
+}
+
+static SemaphoreHandle_t create_semaphore(uint32_t count)
+{
+    SemaphoreHandle_t sem = (SemaphoreHandle_t) malloc(sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+    return create_semaphore(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+    return create_semaphore(0);
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+    pthread_cond_destroy(&xSemaphore->cond);
+    pthread_mutex_destroy(&xSemaphore->lock);
+    free(xSemaphore);
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore, TickType_t xBlockTime )
+{
+    struct timespec deadline;
+    get_deadline(xBlockTime == portMAX_DELAY ? 3600 * 1000 : xBlockTime, &deadline);
+    pthread_mutex_lock(&xSemaphore->lock);
+    while (xSemaphore->count == 0) {
+        if (pthread_cond_timedwait(&xSemaphore->cond, &xSemaphore->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t taken = pdFALSE;
+    if (xSemaphore->count > 0) {
+        xSemaphore->count = 0;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    BaseType_t given = (xSemaphore->count == 0) ? pdTRUE : pdFALSE;
+    xSemaphore->count = 1;
+    pthread_cond_signal(&xSemaphore->cond);
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return given;
+}
@@ -0,0 +1,8 @@
+#ifndef _ROM_ETS_SYS_H_
+#define _ROM_ETS_SYS_H_
+
+#include <stdio.h>
+
+#define ets_printf printf
+
+#endif //_ROM_ETS_SYS_H_
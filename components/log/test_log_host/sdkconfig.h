@@ -0,0 +1,7 @@
+/* Configuration used for host build of the log library */
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LOG_BOOTLOADER_LEVEL 3
+#define CONFIG_LOG_TAG_CACHE_SIZE 64
+#define CONFIG_LOG_ASYNC 1
+#define CONFIG_LOG_ASYNC_BUFFER_ENTRIES 256
+#define CONFIG_LOG_ASYNC_TASK_PRIORITY 1
@@ -0,0 +1,6 @@
+#ifndef _ESP32_SOC_H_
+#define _ESP32_SOC_H_
+
+#define CPU_CLK_FREQ_ROM    1000000
+
+#endif //_ESP32_SOC_H_
@@ -0,0 +1,278 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "esp_log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* TAG = "test";
+
+static std::mutex s_output_lock;
+static std::string s_output;
+static std::atomic<bool> s_output_blocked(false);
+
+static int capture_vprintf(const char* format, va_list list)
+{
+    while (s_output_blocked) {
+        std::this_thread::yield();
+    }
+    char buf[512];
+    int len = vsnprintf(buf, sizeof(buf), format, list);
+    std::lock_guard<std::mutex> guard(s_output_lock);
+    s_output += buf;
+    return len;
+}
+
+static std::string take_output()
+{
+    std::lock_guard<std::mutex> guard(s_output_lock);
+    std::string result;
+    result.swap(s_output);
+    return result;
+}
+
+static void log_test_messages()
+{
+    char on_stack[16];
+    strcpy(on_stack, "stack");
+    esp_log_write(ESP_LOG_INFO, TAG, "plain text\n");
+    esp_log_write(ESP_LOG_INFO, TAG, "%d %i %u %x %X %o %c %%\n", -5, 42, 3000000000U, 0xbeef, 0xcafe, 8, 'z');
+    esp_log_write(ESP_LOG_INFO, TAG, "%hhd %hd %ld %lld %zu %td %jd\n", 1, 2, -3L, -4LL, (size_t) 5, (ptrdiff_t) -6, (intmax_t) 7);
+    esp_log_write(ESP_LOG_INFO, TAG, "[%5d] [%-5d] [%05d] [%+d] [% d] [%#x]\n", 1, 2, 3, 4, 5, 6);
+    esp_log_write(ESP_LOG_INFO, TAG, "[%*d] [%-*d] [%*d] [%.*f] [%.*f]\n", 6, 1, 6, 2, -6, 3, 2, 3.14159, -1, 2.5);
+    esp_log_write(ESP_LOG_INFO, TAG, "%f %.3e %g %Lf\n", 1.5, 12345.678, 0.0001, (long double) 2.25);
+    esp_log_write(ESP_LOG_INFO, TAG, "%s [%10s] [%-10s] [%.3s]\n", on_stack, "right", "left", "truncated");
+    esp_log_write(ESP_LOG_INFO, TAG, "%p\n", (void*) 0x1234);
+    // arguments do not fit into an entry, formatted by the caller
+    esp_log_write(ESP_LOG_INFO, TAG, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d "
+            "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    // formatted by the caller, longer than one entry
+    esp_log_write(ESP_LOG_INFO, TAG, "%s %s\n", std::string(120, 'a').c_str(), std::string(110, 'b').c_str());
+    // same as ESP_LOGI, with a fixed timestamp
+    esp_log_write(ESP_LOG_INFO, TAG, LOG_FORMAT(I, "macro %d %s"), 1234, TAG, 42, "text");
+    // changing the stack buffer must not change queued message
+    strcpy(on_stack, "changed");
+}
+
+TEST_CASE("asynchronous output matches synchronous output", "[log]")
+{
+    esp_log_set_vprintf(&capture_vprintf);
+    take_output();
+    log_test_messages();
+    std::string sync_output = take_output();
+
+    esp_log_set_async(true);
+    log_test_messages();
+    esp_log_async_flush();
+    std::string async_output = take_output();
+    esp_log_set_async(false);
+
+    CHECK(sync_output == async_output);
+    CHECK(async_output.find("stack") != std::string::npos);
+    CHECK(async_output.find("changed") == std::string::npos);
+}
+
+TEST_CASE("messages are dropped and counted when buffer is full", "[log]")
+{
+    const int count = CONFIG_LOG_ASYNC_BUFFER_ENTRIES * 2;
+    esp_log_set_vprintf(&capture_vprintf);
+    take_output();
+    uint32_t dropped_before = esp_log_async_get_dropped();
+    esp_log_set_async(true);
+    s_output_blocked = true;
+    for (int i = 0; i < count; ++i) {
+        esp_log_write(ESP_LOG_INFO, TAG, "message %d\n", i);
+    }
+    uint32_t dropped = esp_log_async_get_dropped() - dropped_before;
+    s_output_blocked = false;
+    esp_log_set_async(false);
+    std::string output = take_output();
+
+    CHECK(dropped >= count - CONFIG_LOG_ASYNC_BUFFER_ENTRIES - 1);
+    int received = 0;
+    for (size_t pos = output.find("message "); pos != std::string::npos; pos = output.find("message ", pos + 1)) {
+        ++received;
+    }
+    CHECK(received + dropped == count);
+    char report[32];
+    snprintf(report, sizeof(report), "%u messages dropped", dropped);
+    CHECK(output.find(report) != std::string::npos);
+}
+
+TEST_CASE("flush returns while other tasks keep logging", "[log]")
+{
+    esp_log_set_vprintf(&capture_vprintf);
+    esp_log_set_async(true);
+    std::atomic<bool> stop(false);
+    std::thread logger([&stop]() {
+        for (int i = 0; !stop; ++i) {
+            esp_log_write(ESP_LOG_INFO, TAG, "background %d\n", i);
+        }
+    });
+    esp_log_write(ESP_LOG_INFO, TAG, "before flush\n");
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        esp_log_async_flush();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(take_output().find("before flush") != std::string::npos);
+    stop = true;
+    logger.join();
+    esp_log_set_async(false);
+    take_output();
+    CHECK(elapsed < std::chrono::seconds(1));
+}
+
+static FILE* s_null_output;
+
+static int null_vprintf(const char* format, va_list list)
+{
+    char buf[256];
+    int len = vsnprintf(buf, sizeof(buf), format, list);
+    fwrite(buf, 1, len, s_null_output);
+    return len;
+}
+
+static double caller_ns_per_call(bool async)
+{
+    const int burst = CONFIG_LOG_ASYNC_BUFFER_ENTRIES / 2;
+    const int bursts = 400;
+    esp_log_set_async(async);
+    std::chrono::nanoseconds total(0);
+    char peer[16];
+    strcpy(peer, "192.168.4.2");
+    for (int b = 0; b < bursts; ++b) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < burst; ++i) {
+            ESP_LOGI(TAG, "conn %d: rx %u bytes, rtt %.2f ms, peer %s", i, 1460U * i, 12.5 + i, peer);
+        }
+        total += std::chrono::steady_clock::now() - start;
+        if (async) {
+            esp_log_async_flush();
+        }
+    }
+    esp_log_set_async(false);
+    return (double) total.count() / (burst * bursts);
+}
+
+TEST_CASE("benchmark caller cost of ESP_LOGI in synchronous and asynchronous modes", "[log][bench]")
+{
+    s_null_output = fopen("/dev/null", "w");
+    REQUIRE(s_null_output != NULL);
+    esp_log_set_vprintf(&null_vprintf);
+    uint32_t dropped_before = esp_log_async_get_dropped();
+    double sync_ns = caller_ns_per_call(false);
+    double async_ns = caller_ns_per_call(true);
+    printf("Caller cost per ESP_LOGI: synchronous %.0f ns, asynchronous %.0f ns\n", sync_ns, async_ns);
+    CHECK(esp_log_async_get_dropped() == dropped_before);
+    esp_log_set_vprintf(&vprintf);
+    fclose(s_null_output);
+}
+
+TEST_CASE("log levels can be changed for tags which are already cached", "[log]")
+{
+    esp_log_set_vprintf(&capture_vprintf);
+    take_output();
+    // same content, different pointer
+    static char tag_copy[8];
+    strcpy(tag_copy, "wifi");
+    const char* tag = "wifi";
+
+    esp_log_write(ESP_LOG_DEBUG, tag, "a");
+    esp_log_write(ESP_LOG_DEBUG, tag_copy, "b");
+    CHECK(take_output() == "ab");
+
+    esp_log_level_set("wifi", ESP_LOG_INFO);
+    esp_log_write(ESP_LOG_DEBUG, tag, "c");
+    esp_log_write(ESP_LOG_DEBUG, tag_copy, "d");
+    esp_log_write(ESP_LOG_INFO, tag, "e");
+    esp_log_write(ESP_LOG_DEBUG, TAG, "f");
+    CHECK(take_output() == "ef");
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    esp_log_write(ESP_LOG_WARN, tag, "g");
+    esp_log_write(ESP_LOG_WARN, TAG, "h");
+    esp_log_write(ESP_LOG_ERROR, TAG, "i");
+    CHECK(take_output() == "i");
+
+    // many distinct tags, more than fit into the cache
+    static char tags[300][8];
+    esp_log_level_set("t17", ESP_LOG_NONE);
+    for (int i = 0; i < 300; ++i) {
+        snprintf(tags[i], sizeof(tags[i]), "t%d", i);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < 300; ++i) {
+            esp_log_write(ESP_LOG_ERROR, tags[i], "x");
+        }
+        CHECK(take_output() == std::string(299, 'x'));
+    }
+    // levels of tags which have been replaced in the cache
+    esp_log_level_set("t3", ESP_LOG_NONE);
+    for (int i = 0; i < 300; ++i) {
+        esp_log_write(ESP_LOG_ERROR, tags[i], "x");
+    }
+    CHECK(take_output() == std::string(298, 'x'));
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+    esp_log_write(ESP_LOG_VERBOSE, tags[17], "y");
+    CHECK(take_output() == "y");
+}
+
+/* Wall clock time of all threads divided by total number of calls */
+static double lookup_ns_per_call(int thread_count)
+{
+    const int calls = 1000000;
+    static const char* tags[] = { "wifi", "tcpip", "nvs", "httpd", "mqtt", "spi_flash", "main", "sensor" };
+    std::vector<std::thread> threads;
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            ++ready;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < calls; ++i) {
+                // filtered out by tag level, so this only measures the lookup
+                esp_log_write(ESP_LOG_DEBUG, tags[(t + i) % 8], "value %d", i);
+            }
+        });
+    }
+    while (ready != thread_count) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ((double) calls * thread_count);
+}
+
+TEST_CASE("benchmark tag level lookup from multiple threads", "[log][bench]")
+{
+    esp_log_level_set("*", ESP_LOG_INFO);
+    printf("Tag level lookup per filtered out call: 1 thread %.1f ns, 8 threads %.1f ns\n",
+            lookup_ns_per_call(1), lookup_ns_per_call(8));
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
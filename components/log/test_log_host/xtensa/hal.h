@@ -0,0 +1,15 @@
+#ifndef XTENSA_HAL_H
+#define XTENSA_HAL_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* CPU cycle counter, emulated using a 1 MHz clock (see soc/soc.h) */
+static inline uint32_t xthal_get_ccount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+#endif //XTENSA_HAL_H
@@ -0,0 +1,130 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef esp_logfs_h
+#define esp_logfs_h
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of a log-structured file system
+ */
+typedef struct {
+    const char* base_path;          /*!< VFS path prefix the file system is registered at, e.g. "/logs" */
+    const char* partition_label;    /*!< label of the data partition which holds the file system */
+    size_t max_files;               /*!< maximum number of files open at the same time */
+    size_t write_buffer_size;       /*!< bytes buffered in RAM for each open file before they are
+                                         written to flash; 0 writes every write() call through */
+    size_t gc_free_sectors;         /*!< number of erased sectors the background task keeps available;
+                                         0 disables background garbage collection */
+} esp_logfs_config_t;
+
+/**
+ * @brief Space usage of a mounted file system
+ */
+typedef struct {
+    size_t total_bytes;             /*!< bytes available for file contents and names */
+    size_t used_bytes;              /*!< bytes taken by live file contents and names */
+    size_t free_sectors;            /*!< erased sectors, ready to be written without garbage collection */
+} esp_logfs_info_t;
+
+/**
+ * @brief Mount a log-structured file system and register it with VFS
+ *
+ * Sectors of the partition which don't hold file system data are erased,
+ * so mounting a blank partition formats it.
+ *
+ * Once mounted, files under config->base_path can be used with the standard
+ * open/read/write/lseek/close, stat, unlink and rename functions, and with
+ * the stdio functions built on top of them.
+ *
+ * @param config  file system configuration
+ *
+ * @return
+ *      - ESP_OK if the file system was mounted
+ *      - ESP_ERR_NOT_FOUND if there is no data partition with the given label
+ *      - ESP_ERR_INVALID_ARG if the partition is too small or config is invalid
+ *      - ESP_ERR_INVALID_STATE if a file system is already mounted at base_path
+ *      - ESP_ERR_NO_MEM if too many file systems are mounted or memory ran out
+ *      - error from the flash driver if the partition can not be read
+ */
+esp_err_t esp_logfs_mount(const esp_logfs_config_t* config);
+
+/**
+ * @brief Unmount a file system mounted with esp_logfs_mount
+ *
+ * Buffered data of files which are still open is written to flash, and the
+ * files are closed.
+ *
+ * @param base_path  base_path the file system was mounted with
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if no file system is mounted at base_path
+ *      - error from the flash driver if buffered data could not be written
+ */
+esp_err_t esp_logfs_unmount(const char* base_path);
+
+/**
+ * @brief Erase all files of a mounted file system
+ *
+ * @param base_path  base_path the file system was mounted with
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if no file system is mounted at base_path,
+ *        or if some of its files are open
+ *      - error from the flash driver if a sector could not be erased
+ */
+esp_err_t esp_logfs_format(const char* base_path);
+
+/**
+ * @brief Run garbage collection until the given number of sectors is erased
+ *
+ * Garbage collection runs on its own when a write finds no erased sector, and
+ * in the background if gc_free_sectors was set when mounting. This function
+ * can be used to prepare for a burst of writes at a convenient time.
+ *
+ * @param base_path     base_path the file system was mounted with
+ * @param free_sectors  number of erased sectors to reach
+ *
+ * @return
+ *      - ESP_OK if at least free_sectors sectors are erased
+ *      - ESP_ERR_INVALID_STATE if no file system is mounted at base_path
+ *      - ESP_ERR_NO_MEM if live data doesn't leave this many sectors free
+ *      - error from the flash driver if a sector could not be copied or erased
+ */
+esp_err_t esp_logfs_gc(const char* base_path, size_t free_sectors);
+
+/**
+ * @brief Get space usage of a mounted file system
+ *
+ * @param base_path  base_path the file system was mounted with
+ * @param[out] info  space usage
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if no file system is mounted at base_path
+ */
+esp_err_t esp_logfs_info(const char* base_path, esp_logfs_info_t* info);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* esp_logfs_h */
@@ -0,0 +1,37 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_logfs.h"
+
+/**
+ * @brief Mount a log-structured file system with custom flash sector layout
+ *
+ * @note  This API is intended to be used in unit tests.
+ *
+ * @param config       file system configuration; partition_label is not used
+ * @param baseSector   Flash sector (units of 4096 bytes) offset of the file system
+ * @param sectorCount  Length (in flash sectors) of the file system, at least 5
+ * @return ESP_OK if the file system was mounted
+ */
+esp_err_t esp_logfs_mount_custom(const esp_logfs_config_t* config, uint32_t baseSector, uint32_t sectorCount);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1128 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "logfs.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <errno.h>
+#include <fcntl.h>
+#if defined(ESP_PLATFORM)
+#include <rom/crc.h>
+#else
+#include "crc.h"
+#endif
+
+namespace logfs
+{
+
+static bool isErased(const void* data, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t sectorHeaderCrc(const SectorHeader& header)
+{
+    return crc32_le(0xffffffff, reinterpret_cast<const uint8_t*>(&header), offsetof(SectorHeader, crc32));
+}
+
+static uint32_t recordHeaderCrc(const RecordHeader& header)
+{
+    return crc32_le(0xffffffff, reinterpret_cast<const uint8_t*>(&header), offsetof(RecordHeader, crc32));
+}
+
+/* Running out of sectors is reported as ESP_ERR_NO_MEM internally */
+static int toErrno(esp_err_t err)
+{
+    return (err == ESP_ERR_NO_MEM) ? ENOSPC : EIO;
+}
+
+static size_t sectorOf(uint32_t address)
+{
+    return address / SECTOR_SIZE;
+}
+
+FileSystem::Inode::Inode(uint32_t id, const char* name, size_t nameLength) :
+    id(id),
+    size(0),
+    recordAddress(0),
+    nameLength(static_cast<uint16_t>(nameLength)),
+    recordLength(static_cast<uint16_t>(nameLength)),
+    name(new char[nameLength + 1])
+{
+    memcpy(this->name, name, nameLength);
+    this->name[nameLength] = 0;
+}
+
+FileSystem::Inode::~Inode()
+{
+    delete[] name;
+}
+
+FileSystem::FileSystem()
+{
+}
+
+FileSystem::~FileSystem()
+{
+    clear();
+}
+
+void FileSystem::clear()
+{
+    for (auto file : mFiles) {
+        delete file;
+    }
+    std::fill(mFiles.begin(), mFiles.end(), nullptr);
+    for (auto inode : mInodes) {
+        delete inode;
+    }
+    mInodes.clear();
+}
+
+esp_err_t FileSystem::init(uint32_t baseSector, uint32_t sectorCount, size_t maxFiles, size_t writeBufferSize)
+{
+    Lock lock(mMutex);
+    if (sectorCount < MIN_SECTORS || maxFiles == 0 || writeBufferSize > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    clear();
+    mBaseAddress = baseSector * SECTOR_SIZE;
+    mSeq.assign(sectorCount, SEQ_ERASED);
+    mLive.assign(sectorCount, 0);
+    mFiles.assign(maxFiles, nullptr);
+    mWriteBufferSize = writeBufferSize;
+    mLiveBytes = 0;
+    mHead = SIZE_MAX;
+    mWritePos = SECTOR_SIZE;
+    mNextSeq = 0;
+    mNextId = 1;
+    mInGc = false;
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < sectorCount; ++i) {
+        SectorHeader header;
+        esp_err_t err = readFlash(sectorAddress(i), &header, sizeof(header));
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (header.magic == SECTOR_MAGIC && header.version == FORMAT_VERSION &&
+                header.seq != SEQ_ERASED && header.crc32 == sectorHeaderCrc(header)) {
+            mSeq[i] = header.seq;
+            order.push_back(i);
+        } else if (!isErased(&header, sizeof(header))) {
+            err = spi_flash_erase_sector(baseSector + i);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return mSeq[a] < mSeq[b];
+    });
+
+    std::unique_ptr<uint8_t[]> image(new (std::nothrow) uint8_t[SECTOR_SIZE]);
+    if (!image) {
+        return ESP_ERR_NO_MEM;
+    }
+    bool sealed;
+
+    if (!order.empty()) {
+        // Garbage collection writes an ERASE record right before erasing
+        // a sector. If power was lost during the erase, the record is in
+        // the newest sector, and the half-erased sector must be dropped.
+        size_t newest = order.back();
+        esp_err_t err = readFlash(sectorAddress(newest), image.get(), SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        std::vector<size_t> erased;
+        forEachRecord(image.get(), sealed, [&](const RecordHeader& header, uint32_t, const uint8_t*) {
+            if (header.type == static_cast<uint8_t>(RecordType::ERASE) && header.offset < sectorCount &&
+                    header.offset != newest && mSeq[header.offset] == header.inode) {
+                erased.push_back(header.offset);
+            }
+        });
+        for (auto sector : erased) {
+            err = spi_flash_erase_sector(baseSector + sector);
+            if (err != ESP_OK) {
+                return err;
+            }
+            mSeq[sector] = SEQ_ERASED;
+            order.erase(std::find(order.begin(), order.end(), sector));
+        }
+    }
+
+    // First pass binds names to inode ids, in the order the log was written
+    uint32_t maxId = 0;
+    for (auto sector : order) {
+        esp_err_t err = readFlash(sectorAddress(sector), image.get(), SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        uint32_t end = forEachRecord(image.get(), sealed, [&](const RecordHeader& header, uint32_t pos, const uint8_t* data) {
+            if (header.type == static_cast<uint8_t>(RecordType::INODE)) {
+                applyInodeRecord(header, sectorAddress(sector) + pos, data);
+            }
+            if (header.type != static_cast<uint8_t>(RecordType::ERASE)) {
+                maxId = std::max(maxId, header.inode);
+            }
+        });
+        if (sector == order.back()) {
+            mNextSeq = mSeq[sector] + 1;
+            if (!sealed) {
+                mHead = sector;
+                mWritePos = end;
+            }
+        }
+    }
+    mNextId = maxId + 1;
+
+    // Second pass collects the contents of files which are still bound to
+    // a name; DATA records may precede the INODE record of their file if it
+    // was moved by garbage collection.
+    std::vector<std::pair<uint32_t, Inode*> > byId;
+    byId.reserve(mInodes.size());
+    for (auto inode : mInodes) {
+        byId.push_back(std::make_pair(inode->id, inode));
+    }
+    std::sort(byId.begin(), byId.end());
+    for (auto sector : order) {
+        esp_err_t err = readFlash(sectorAddress(sector), image.get(), SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        forEachRecord(image.get(), sealed, [&](const RecordHeader& header, uint32_t pos, const uint8_t*) {
+            if (header.type != static_cast<uint8_t>(RecordType::DATA) || header.length == 0) {
+                return;
+            }
+            auto it = std::lower_bound(byId.begin(), byId.end(), std::make_pair(header.inode, static_cast<Inode*>(nullptr)));
+            if (it == byId.end() || it->first != header.inode) {
+                return;
+            }
+            Inode* inode = it->second;
+            Extent extent = {header.offset, sectorAddress(sector) + pos + static_cast<uint32_t>(sizeof(RecordHeader)), header.length};
+            addExtent(inode, extent);
+            inode->size = std::max(inode->size, extent.end());
+        });
+    }
+
+    mFreeCount = std::count(mSeq.begin(), mSeq.end(), SEQ_ERASED);
+    return ESP_OK;
+}
+
+template<typename TFunc>
+uint32_t FileSystem::forEachRecord(const uint8_t* image, bool& sealed, TFunc func)
+{
+    uint32_t pos = sizeof(SectorHeader);
+    while (pos + sizeof(RecordHeader) <= SECTOR_SIZE) {
+        const uint8_t* p = image + pos;
+        if (isErased(p, sizeof(RecordHeader))) {
+            // data of a record is written before its header, so anything
+            // past an erased header means a write was interrupted
+            sealed = !isErased(p, SECTOR_SIZE - pos);
+            return pos;
+        }
+        RecordHeader header;
+        memcpy(&header, p, sizeof(header));
+        if (header.length > MAX_RECORD_DATA || pos + recordSize(header.length) > SECTOR_SIZE ||
+                header.crc32 != crc32_le(recordHeaderCrc(header), p + sizeof(header), header.length)) {
+            sealed = true;
+            return pos;
+        }
+        func(header, pos, p + sizeof(header));
+        pos += recordSize(header.length);
+    }
+    sealed = true;
+    return pos;
+}
+
+void FileSystem::applyInodeRecord(const RecordHeader& header, uint32_t address, const uint8_t* data)
+{
+    size_t nameLength = header.offset;
+    size_t oldNameLength = header.length - nameLength;
+    if (nameLength == 0 || nameLength > header.length ||
+            nameLength >= NAME_MAX_LENGTH || oldNameLength >= NAME_MAX_LENGTH) {
+        return;
+    }
+    const char* name = reinterpret_cast<const char*>(data);
+    Inode* inode = findInode(name, nameLength);
+    if (header.inode == 0) {
+        if (inode) {
+            removeInode(inode);
+        }
+        return;
+    }
+    if (inode == nullptr) {
+        inode = new Inode(header.inode, name, nameLength);
+        mInodes.push_back(inode);
+    } else {
+        account(inode->recordAddress, recordSize(inode->recordLength), false);
+    }
+    inode->id = header.inode;
+    inode->recordAddress = address;
+    inode->recordLength = header.length;
+    account(inode->recordAddress, recordSize(inode->recordLength), true);
+    if (oldNameLength > 0) {
+        Inode* previous = findInode(name + nameLength, oldNameLength);
+        if (previous && previous->id == header.inode) {
+            removeInode(previous);
+        }
+    }
+}
+
+esp_err_t FileSystem::flushAll()
+{
+    Lock lock(mMutex);
+    esp_err_t result = ESP_OK;
+    for (auto& file : mFiles) {
+        if (file == nullptr) {
+            continue;
+        }
+        esp_err_t err = flushFile(file);
+        if (result == ESP_OK) {
+            result = err;
+        }
+        --file->inode->openCount;
+        delete file;
+        file = nullptr;
+    }
+    return result;
+}
+
+bool FileSystem::hasOpenFiles()
+{
+    Lock lock(mMutex);
+    return std::any_of(mFiles.begin(), mFiles.end(), [](const OpenFile* file) {
+        return file != nullptr;
+    });
+}
+
+esp_err_t FileSystem::format()
+{
+    Lock lock(mMutex);
+    for (auto file : mFiles) {
+        if (file) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    for (size_t i = 0; i < mSeq.size(); ++i) {
+        if (mSeq[i] == SEQ_ERASED) {
+            continue;
+        }
+        esp_err_t err = spi_flash_erase_sector(mBaseAddress / SECTOR_SIZE + i);
+        if (err != ESP_OK) {
+            return err;
+        }
+        mSeq[i] = SEQ_ERASED;
+        mLive[i] = 0;
+    }
+    clear();
+    mFreeCount = mSeq.size();
+    mLiveBytes = 0;
+    mHead = SIZE_MAX;
+    mWritePos = SECTOR_SIZE;
+    mNextId = 1;
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::collect(size_t freeSectors, size_t maxSteps)
+{
+    Lock lock(mMutex);
+    if (freeSectors >= mSeq.size()) {
+        return ESP_ERR_NO_MEM;
+    }
+    // every live record has been moved once after two rounds
+    maxSteps = std::min(maxSteps, 2 * mSeq.size());
+    for (size_t step = 0; mFreeCount < freeSectors && step < maxSteps; ++step) {
+        esp_err_t err = collectOne();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return (mFreeCount >= freeSectors) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+size_t FileSystem::capacity() const
+{
+    // leave room for the space wasted at the end of sectors, and for ERASE records
+    const size_t usable = SECTOR_DATA_SIZE - 2 * recordSize(2 * NAME_MAX_LENGTH);
+    return (mSeq.size() - RESERVED_SECTORS - 1) * usable;
+}
+
+void FileSystem::getInfo(size_t& totalBytes, size_t& usedBytes, size_t& freeSectors)
+{
+    Lock lock(mMutex);
+    totalBytes = capacity();
+    usedBytes = std::min(mLiveBytes, totalBytes);
+    freeSectors = mFreeCount;
+}
+
+bool FileSystem::hasSpaceFor(size_t dataLength)
+{
+    size_t records = dataLength / MAX_RECORD_DATA + 2;
+    return mLiveBytes + dataLength + records * recordSize(3) <= capacity();
+}
+
+FileSystem::Inode* FileSystem::findInode(const char* name, size_t nameLength)
+{
+    for (auto inode : mInodes) {
+        if (inode->nameLength == nameLength && memcmp(inode->name, name, nameLength) == 0) {
+            return inode;
+        }
+    }
+    return nullptr;
+}
+
+void FileSystem::removeInode(Inode* inode)
+{
+    dropExtents(inode);
+    account(inode->recordAddress, recordSize(inode->recordLength), false);
+    mInodes.erase(std::find(mInodes.begin(), mInodes.end(), inode));
+    delete inode;
+}
+
+void FileSystem::dropExtents(Inode* inode)
+{
+    for (const auto& extent : inode->extents) {
+        account(extent.address, recordSize(extent.length), false);
+    }
+    std::vector<Extent>().swap(inode->extents);
+}
+
+void FileSystem::account(uint32_t address, uint32_t size, bool add)
+{
+    if (add) {
+        mLive[sectorOf(address)] += size;
+        mLiveBytes += size;
+    } else {
+        mLive[sectorOf(address)] -= size;
+        mLiveBytes -= size;
+    }
+}
+
+/* Each extent is charged the size of a record holding it. An extent split by
+ * an overwrite is charged twice for the header, which is what it will take
+ * once garbage collection copies the two halves. */
+void FileSystem::addExtent(Inode* inode, const Extent& extent)
+{
+    auto& extents = inode->extents;
+    account(extent.address, recordSize(extent.length), true);
+    if (extents.empty() || extents.back().end() <= extent.offset) {
+        extents.push_back(extent);
+        return;
+    }
+    auto first = std::upper_bound(extents.begin(), extents.end(), extent.offset,
+    [](uint32_t offset, const Extent& e) {
+        return offset < e.end();
+    });
+    auto last = first;
+    Extent replacement[3];
+    size_t count = 0;
+    Extent right = {0, 0, 0};
+    for (; last != extents.end() && last->offset < extent.end(); ++last) {
+        account(last->address, recordSize(last->length), false);
+        if (last->offset < extent.offset) {
+            Extent left = {last->offset, last->address, extent.offset - last->offset};
+            account(left.address, recordSize(left.length), true);
+            replacement[count++] = left;
+        }
+        if (last->end() > extent.end()) {
+            right = {extent.end(), last->address + (extent.end() - last->offset), last->end() - extent.end()};
+            account(right.address, recordSize(right.length), true);
+        }
+    }
+    replacement[count++] = extent;
+    if (right.length > 0) {
+        replacement[count++] = right;
+    }
+    size_t index = first - extents.begin();
+    extents.erase(first, last);
+    extents.insert(extents.begin() + index, replacement, replacement + count);
+}
+
+FileSystem::OpenFile* FileSystem::getFile(int fd)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= mFiles.size()) {
+        return nullptr;
+    }
+    return mFiles[fd];
+}
+
+esp_err_t FileSystem::flushFile(OpenFile* file)
+{
+    if (file->bufferLength == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = writeData(file->inode, file->bufferOffset, file->buffer.get(), file->bufferLength);
+    file->bufferLength = 0;
+    return err;
+}
+
+esp_err_t FileSystem::flushInode(Inode* inode, OpenFile* except)
+{
+    for (auto file : mFiles) {
+        if (file && file != except && file->inode == inode) {
+            esp_err_t err = flushFile(file);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::readFlash(uint32_t address, void* dst, size_t size)
+{
+    // the flash driver on the host only accepts 4-byte aligned reads
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    address += mBaseAddress;
+    // short unaligned reads take a single read of the enclosing words
+    uint32_t bounce[32];
+    uint32_t start = address & ~3U;
+    uint32_t span = align4(address + size) - start;
+    if ((start != address || span != size) && span <= sizeof(bounce)) {
+        esp_err_t err = spi_flash_read(start, bounce, span);
+        if (err == ESP_OK) {
+            memcpy(out, reinterpret_cast<uint8_t*>(bounce) + (address - start), size);
+        }
+        return err;
+    }
+    uint32_t word;
+    if (address % 4 != 0 && size > 0) {
+        uint32_t skip = address % 4;
+        esp_err_t err = spi_flash_read(address - skip, &word, sizeof(word));
+        if (err != ESP_OK) {
+            return err;
+        }
+        size_t count = std::min(size, static_cast<size_t>(4 - skip));
+        memcpy(out, reinterpret_cast<uint8_t*>(&word) + skip, count);
+        out += count;
+        address += count;
+        size -= count;
+    }
+    size_t body = size & ~3U;
+    if (body > 0) {
+        esp_err_t err = spi_flash_read(address, out, body);
+        if (err != ESP_OK) {
+            return err;
+        }
+        out += body;
+        address += body;
+        size -= body;
+    }
+    if (size > 0) {
+        esp_err_t err = spi_flash_read(address, &word, sizeof(word));
+        if (err != ESP_OK) {
+            return err;
+        }
+        memcpy(out, &word, size);
+    }
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::readExtents(const std::vector<Extent>& extents, uint32_t offset, uint8_t* dst, size_t size)
+{
+    auto it = std::upper_bound(extents.begin(), extents.end(), offset,
+    [](uint32_t offset, const Extent& e) {
+        return offset < e.end();
+    });
+    while (size > 0) {
+        if (it == extents.end() || it->offset >= offset + size) {
+            // holes left by seeking past the end read as zeros
+            memset(dst, 0, size);
+            break;
+        }
+        if (it->offset > offset) {
+            size_t gap = it->offset - offset;
+            memset(dst, 0, gap);
+            dst += gap;
+            offset += gap;
+            size -= gap;
+        }
+        uint32_t skip = offset - it->offset;
+        size_t count = std::min(size, static_cast<size_t>(it->length - skip));
+        esp_err_t err = readFlash(it->address + skip, dst, count);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dst += count;
+        offset += count;
+        size -= count;
+        ++it;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::openSector()
+{
+    if (!mInGc) {
+        for (size_t i = 0; mFreeCount <= RESERVED_SECTORS && i < 2 * mSeq.size(); ++i) {
+            esp_err_t err = collectOne();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        if (mFreeCount <= RESERVED_SECTORS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (mFreeCount == 0) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t start = (mHead == SIZE_MAX) ? 0 : mHead + 1;
+    size_t sector = start % mSeq.size();
+    for (size_t i = 0; i < mSeq.size(); ++i) {
+        sector = (start + i) % mSeq.size();
+        if (mSeq[sector] == SEQ_ERASED) {
+            break;
+        }
+    }
+
+    // Free sectors are erased when they are collected, but one which was
+    // being written or erased when power was lost may hold some data.
+    bool blank = true;
+    for (uint32_t pos = 0; pos < SECTOR_SIZE && blank; pos += sizeof(mScratch)) {
+        esp_err_t err = readFlash(sectorAddress(sector) + pos, mScratch, sizeof(mScratch));
+        if (err != ESP_OK) {
+            return err;
+        }
+        blank = isErased(mScratch, sizeof(mScratch));
+    }
+    if (!blank) {
+        esp_err_t err = spi_flash_erase_sector(mBaseAddress / SECTOR_SIZE + sector);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    SectorHeader header;
+    header.magic = SECTOR_MAGIC;
+    header.version = FORMAT_VERSION;
+    header.reserved = 0xffff;
+    header.seq = mNextSeq;
+    header.crc32 = sectorHeaderCrc(header);
+    esp_err_t err = spi_flash_write(mBaseAddress + sectorAddress(sector), &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    mSeq[sector] = mNextSeq++;
+    --mFreeCount;
+    mHead = sector;
+    mWritePos = sizeof(SectorHeader);
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::reserve(uint32_t length, uint32_t minimum, uint32_t& granted)
+{
+    bool hasHeaderRoom = mHead != SIZE_MAX && mWritePos + sizeof(RecordHeader) <= SECTOR_SIZE;
+    uint32_t room = hasHeaderRoom ? SECTOR_SIZE - mWritePos - sizeof(RecordHeader) : 0;
+    if (!hasHeaderRoom || room < std::min(length, minimum)) {
+        esp_err_t err = openSector();
+        if (err != ESP_OK) {
+            return err;
+        }
+        room = MAX_RECORD_DATA;
+    }
+    granted = std::min(length, room);
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::writeRecord(RecordType type, uint32_t inode, uint32_t offset, uint32_t length,
+                                  const uint8_t* src, const Inode* copyFrom, uint32_t& address)
+{
+    address = sectorAddress(mHead) + mWritePos;
+    RecordHeader header;
+    header.type = static_cast<uint8_t>(type);
+    header.reserved = 0xff;
+    header.length = static_cast<uint16_t>(length);
+    header.inode = inode;
+    header.offset = offset;
+    uint32_t crc = recordHeaderCrc(header);
+
+    // A failed write leaves the rest of the sector unusable
+    const uint32_t dataAddress = mBaseAddress + address + sizeof(RecordHeader);
+    for (uint32_t done = 0; done < length; ) {
+        uint32_t count;
+        const uint8_t* data;
+        if (src && length - done >= 4) {
+            count = (length - done) & ~3U;
+            data = src + done;
+        } else {
+            count = std::min(length - done, static_cast<uint32_t>(sizeof(mScratch)));
+            if (src) {
+                memcpy(mScratch, src + done, count);
+            } else {
+                esp_err_t err = readExtents(copyFrom->extents, offset + done, mScratch, count);
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            memset(mScratch + count, 0xff, align4(count) - count);
+            data = mScratch;
+        }
+        crc = crc32_le(crc, data, count);
+        esp_err_t err = spi_flash_write(dataAddress + done, data, align4(count));
+        if (err != ESP_OK) {
+            mWritePos = SECTOR_SIZE;
+            return err;
+        }
+        done += count;
+    }
+
+    header.crc32 = crc;
+    esp_err_t err = spi_flash_write(mBaseAddress + address, &header, sizeof(header));
+    if (err != ESP_OK) {
+        mWritePos = SECTOR_SIZE;
+        return err;
+    }
+    mWritePos += recordSize(length);
+    return ESP_OK;
+}
+
+esp_err_t FileSystem::writeInodeRecord(uint32_t id, const char* name, size_t nameLength,
+                                       const char* oldName, size_t oldNameLength, uint32_t& address)
+{
+    uint8_t data[2 * NAME_MAX_LENGTH];
+    memcpy(data, name, nameLength);
+    if (oldNameLength > 0) {
+        memcpy(data + nameLength, oldName, oldNameLength);
+    }
+    uint32_t length = static_cast<uint32_t>(nameLength + oldNameLength);
+    uint32_t granted;
+    esp_err_t err = reserve(length, length, granted);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return writeRecord(RecordType::INODE, id, static_cast<uint32_t>(nameLength), length, data, nullptr, address);
+}
+
+/* Writes file contents from src, or copies them from their current place in
+ * flash if src is null. */
+esp_err_t FileSystem::writeData(Inode* inode, uint32_t offset, const uint8_t* src, uint32_t length)
+{
+    while (length > 0) {
+        uint32_t granted;
+        esp_err_t err = reserve(length, MIN_RECORD_DATA, granted);
+        if (err != ESP_OK) {
+            return err;
+        }
+        uint32_t address;
+        err = writeRecord(RecordType::DATA, inode->id, offset, granted, src, src ? nullptr : inode, address);
+        if (err != ESP_OK) {
+            return err;
+        }
+        Extent extent = {offset, address + static_cast<uint32_t>(sizeof(RecordHeader)), granted};
+        addExtent(inode, extent);
+        if (src) {
+            src += granted;
+        }
+        offset += granted;
+        length -= granted;
+    }
+    return ESP_OK;
+}
+
+/* Moves whatever is still live in the oldest sector to the head of the log,
+ * then erases it. */
+esp_err_t FileSystem::collectOne()
+{
+    size_t victim = SIZE_MAX;
+    for (size_t i = 0; i < mSeq.size(); ++i) {
+        if (mSeq[i] != SEQ_ERASED && i != mHead && (victim == SIZE_MAX || mSeq[i] < mSeq[victim])) {
+            victim = i;
+        }
+    }
+    if (victim == SIZE_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mInGc = true;
+    esp_err_t err = ESP_OK;
+    for (size_t n = 0; n < mInodes.size() && err == ESP_OK; ++n) {
+        Inode* inode = mInodes[n];
+        if (mLive[victim] == 0) {
+            break;
+        }
+        if (sectorOf(inode->recordAddress) == victim) {
+            uint32_t address;
+            err = writeInodeRecord(inode->id, inode->name, inode->nameLength, nullptr, 0, address);
+            if (err != ESP_OK) {
+                break;
+            }
+            account(inode->recordAddress, recordSize(inode->recordLength), false);
+            inode->recordAddress = address;
+            inode->recordLength = inode->nameLength;
+            account(inode->recordAddress, recordSize(inode->recordLength), true);
+        }
+
+        // Copy runs of adjacent extents as single records, so that files
+        // written in small pieces end up with fewer, larger extents.
+        auto& extents = inode->extents;
+        uint32_t from = 0;
+        while (err == ESP_OK) {
+            auto it = std::upper_bound(extents.begin(), extents.end(), from,
+            [](uint32_t offset, const Extent& e) {
+                return offset < e.end();
+            });
+            while (it != extents.end() && sectorOf(it->address) != victim) {
+                ++it;
+            }
+            if (it == extents.end()) {
+                break;
+            }
+            uint32_t start = it->offset;
+            uint32_t end = it->end();
+            for (++it; it != extents.end() && it->offset == end && sectorOf(it->address) == victim; ++it) {
+                end = it->end();
+            }
+            err = writeData(inode, start, nullptr, end - start);
+            from = end;
+        }
+    }
+    if (err == ESP_OK) {
+        uint32_t granted;
+        uint32_t address;
+        err = reserve(0, 0, granted);
+        if (err == ESP_OK) {
+            err = writeRecord(RecordType::ERASE, mSeq[victim], static_cast<uint32_t>(victim), 0, nullptr, nullptr, address);
+        }
+    }
+    if (err == ESP_OK) {
+        err = spi_flash_erase_sector(mBaseAddress / SECTOR_SIZE + victim);
+    }
+    if (err == ESP_OK) {
+        mSeq[victim] = SEQ_ERASED;
+        mLive[victim] = 0;
+        ++mFreeCount;
+    }
+    mInGc = false;
+    return err;
+}
+
+int FileSystem::open(const char* path, int flags, int& fd)
+{
+    Lock lock(mMutex);
+    size_t nameLength = strlen(path);
+    if (nameLength == 0) {
+        return ENOENT;
+    }
+    if (nameLength >= NAME_MAX_LENGTH) {
+        return ENAMETOOLONG;
+    }
+    auto slot = std::find(mFiles.begin(), mFiles.end(), nullptr);
+    if (slot == mFiles.end()) {
+        return ENFILE;
+    }
+    bool writable = (flags & O_ACCMODE) != O_RDONLY;
+
+    std::unique_ptr<OpenFile> file(new (std::nothrow) OpenFile);
+    if (!file) {
+        return ENOMEM;
+    }
+    if (writable && mWriteBufferSize > 0) {
+        file->buffer.reset(new (std::nothrow) uint8_t[mWriteBufferSize]);
+        if (!file->buffer) {
+            return ENOMEM;
+        }
+    }
+
+    Inode* inode = findInode(path, nameLength);
+    if (inode == nullptr) {
+        if ((flags & O_CREAT) == 0) {
+            return ENOENT;
+        }
+        if (!hasSpaceFor(nameLength)) {
+            return ENOSPC;
+        }
+        uint32_t address;
+        esp_err_t err = writeInodeRecord(mNextId, path, nameLength, nullptr, 0, address);
+        if (err != ESP_OK) {
+            return toErrno(err);
+        }
+        inode = new (std::nothrow) Inode(mNextId++, path, nameLength);
+        if (inode == nullptr) {
+            return ENOMEM;
+        }
+        inode->recordAddress = address;
+        account(address, recordSize(inode->recordLength), true);
+        mInodes.push_back(inode);
+    } else if ((flags & O_CREAT) && (flags & O_EXCL)) {
+        return EEXIST;
+    } else if ((flags & O_TRUNC) && writable && inode->size > 0) {
+        // truncated contents become garbage as a whole: the name is bound to a new id
+        uint32_t address;
+        esp_err_t err = writeInodeRecord(mNextId, path, nameLength, nullptr, 0, address);
+        if (err != ESP_OK) {
+            return toErrno(err);
+        }
+        for (auto other : mFiles) {
+            if (other && other->inode == inode) {
+                other->bufferLength = 0;
+            }
+        }
+        dropExtents(inode);
+        account(inode->recordAddress, recordSize(inode->recordLength), false);
+        inode->id = mNextId++;
+        inode->size = 0;
+        inode->recordAddress = address;
+        inode->recordLength = inode->nameLength;
+        account(inode->recordAddress, recordSize(inode->recordLength), true);
+    }
+
+    file->inode = inode;
+    file->flags = flags;
+    ++inode->openCount;
+    *slot = file.release();
+    fd = static_cast<int>(slot - mFiles.begin());
+    return 0;
+}
+
+int FileSystem::close(int fd)
+{
+    Lock lock(mMutex);
+    OpenFile* file = getFile(fd);
+    if (file == nullptr) {
+        return EBADF;
+    }
+    esp_err_t err = flushFile(file);
+    --file->inode->openCount;
+    delete file;
+    mFiles[fd] = nullptr;
+    return (err == ESP_OK) ? 0 : toErrno(err);
+}
+
+int FileSystem::read(int fd, void* dst, size_t size, size_t& bytesRead)
+{
+    Lock lock(mMutex);
+    bytesRead = 0;
+    OpenFile* file = getFile(fd);
+    if (file == nullptr || (file->flags & O_ACCMODE) == O_WRONLY) {
+        return EBADF;
+    }
+    Inode* inode = file->inode;
+    esp_err_t err = flushInode(inode, nullptr);
+    if (err != ESP_OK) {
+        return toErrno(err);
+    }
+    if (file->position >= inode->size) {
+        return 0;
+    }
+    size_t count = std::min(size, static_cast<size_t>(inode->size - file->position));
+    err = readExtents(inode->extents, file->position, static_cast<uint8_t*>(dst), count);
+    if (err != ESP_OK) {
+        return EIO;
+    }
+    file->position += count;
+    bytesRead = count;
+    return 0;
+}
+
+int FileSystem::write(int fd, const void* src, size_t size)
+{
+    Lock lock(mMutex);
+    OpenFile* file = getFile(fd);
+    if (file == nullptr || (file->flags & O_ACCMODE) == O_RDONLY) {
+        return EBADF;
+    }
+    Inode* inode = file->inode;
+    if (file->flags & O_APPEND) {
+        file->position = inode->size;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    if (size > UINT32_MAX - file->position) {
+        return EFBIG;
+    }
+    // keep the order of writes made through other descriptors of this file
+    esp_err_t err = ESP_OK;
+    if (inode->openCount > 1) {
+        err = flushInode(inode, file);
+        if (err != ESP_OK) {
+            return toErrno(err);
+        }
+    }
+    if (!hasSpaceFor(file->bufferLength + size)) {
+        return ENOSPC;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(src);
+    if (!file->buffer) {
+        err = writeData(inode, file->position, data, size);
+    } else {
+        if (file->bufferLength > 0 && file->bufferOffset + file->bufferLength != file->position) {
+            err = flushFile(file);
+        }
+        size_t done = 0;
+        while (done < size && err == ESP_OK) {
+            if (file->bufferLength == 0) {
+                file->bufferOffset = file->position + done;
+                if (size - done >= mWriteBufferSize) {
+                    // large writes bypass the buffer
+                    err = writeData(inode, file->bufferOffset, data + done, size - done);
+                    break;
+                }
+            }
+            size_t count = std::min(size - done, mWriteBufferSize - file->bufferLength);
+            memcpy(file->buffer.get() + file->bufferLength, data + done, count);
+            file->bufferLength += count;
+            done += count;
+            if (file->bufferLength == mWriteBufferSize) {
+                err = flushFile(file);
+            }
+        }
+    }
+    if (err != ESP_OK) {
+        return toErrno(err);
+    }
+    file->position += size;
+    inode->size = std::max(inode->size, file->position);
+    return 0;
+}
+
+int FileSystem::lseek(int fd, off_t offset, int whence, off_t& position)
+{
+    Lock lock(mMutex);
+    OpenFile* file = getFile(fd);
+    if (file == nullptr) {
+        return EBADF;
+    }
+    off_t base;
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = file->position;
+        break;
+    case SEEK_END:
+        base = file->inode->size;
+        break;
+    default:
+        return EINVAL;
+    }
+    position = base + offset;
+    if (position < 0 || static_cast<uint64_t>(position) > UINT32_MAX) {
+        return EINVAL;
+    }
+    file->position = static_cast<uint32_t>(position);
+    return 0;
+}
+
+static void fillStat(uint32_t size, struct stat* st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_size = size;
+    st->st_mode = S_IFREG | S_IRWXU | S_IRWXG | S_IRWXO;
+    st->st_blksize = SECTOR_SIZE;
+}
+
+int FileSystem::fstat(int fd, struct stat* st)
+{
+    Lock lock(mMutex);
+    OpenFile* file = getFile(fd);
+    if (file == nullptr) {
+        return EBADF;
+    }
+    fillStat(file->inode->size, st);
+    return 0;
+}
+
+int FileSystem::stat(const char* path, struct stat* st)
+{
+    Lock lock(mMutex);
+    Inode* inode = findInode(path, strlen(path));
+    if (inode == nullptr) {
+        return ENOENT;
+    }
+    fillStat(inode->size, st);
+    return 0;
+}
+
+int FileSystem::unlink(const char* path)
+{
+    Lock lock(mMutex);
+    size_t nameLength = strlen(path);
+    Inode* inode = findInode(path, nameLength);
+    if (inode == nullptr) {
+        return ENOENT;
+    }
+    if (inode->openCount > 0) {
+        return EBUSY;
+    }
+    uint32_t address;
+    esp_err_t err = writeInodeRecord(0, path, nameLength, nullptr, 0, address);
+    if (err != ESP_OK) {
+        return toErrno(err);
+    }
+    removeInode(inode);
+    return 0;
+}
+
+int FileSystem::rename(const char* src, const char* dst)
+{
+    Lock lock(mMutex);
+    size_t srcLength = strlen(src);
+    size_t dstLength = strlen(dst);
+    if (dstLength == 0) {
+        return ENOENT;
+    }
+    if (dstLength >= NAME_MAX_LENGTH) {
+        return ENAMETOOLONG;
+    }
+    Inode* inode = findInode(src, srcLength);
+    if (inode == nullptr) {
+        return ENOENT;
+    }
+    Inode* target = findInode(dst, dstLength);
+    if (target == inode) {
+        return 0;
+    }
+    if (target && target->openCount > 0) {
+        return EBUSY;
+    }
+    char* name = new (std::nothrow) char[dstLength + 1];
+    if (name == nullptr) {
+        return ENOMEM;
+    }
+    // a single record binds the new name and drops the old one
+    uint32_t address;
+    esp_err_t err = writeInodeRecord(inode->id, dst, dstLength, src, srcLength, address);
+    if (err != ESP_OK) {
+        delete[] name;
+        return toErrno(err);
+    }
+    if (target) {
+        removeInode(target);
+    }
+    memcpy(name, dst, dstLength + 1);
+    delete[] inode->name;
+    inode->name = name;
+    inode->nameLength = static_cast<uint16_t>(dstLength);
+    account(inode->recordAddress, recordSize(inode->recordLength), false);
+    inode->recordAddress = address;
+    inode->recordLength = static_cast<uint16_t>(dstLength + srcLength);
+    account(inode->recordAddress, recordSize(inode->recordLength), true);
+    return 0;
+}
+
+} // namespace logfs
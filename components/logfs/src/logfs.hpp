@@ -0,0 +1,162 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef logfs_hpp
+#define logfs_hpp
+
+#include <vector>
+#include <memory>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "esp_err.h"
+#include "logfs_types.hpp"
+#include "logfs_platform.hpp"
+
+namespace logfs
+{
+
+/*
+ * Log-structured file system.
+ *
+ * Everything which changes is appended at the head of the log: file contents
+ * as DATA records, and creation, truncation, rename and removal of files as
+ * INODE records. RAM holds, for every file, its name and a sorted list of the
+ * extents which make up its current contents, so appending to a file costs
+ * one record write and reading any offset is a binary search followed by a
+ * flash read.
+ *
+ * Space is reclaimed by garbage collection, which takes the oldest sector,
+ * copies the records still referenced from RAM to the head of the log, and
+ * erases it. Because sectors are always reclaimed oldest first, a record
+ * which has been superseded can be dropped without ever exposing an older
+ * record in its place.
+ *
+ * Methods which implement file system calls return 0 or an errno value.
+ */
+class FileSystem
+{
+public:
+    /* Sectors set aside for garbage collection. Writes fail with ENOSPC
+     * rather than take them. */
+    static const size_t RESERVED_SECTORS = 2;
+    static const size_t MIN_SECTORS = RESERVED_SECTORS + 3;
+
+    FileSystem();
+    ~FileSystem();
+
+    /* Reads the log and builds the in-memory state. Sectors which don't
+     * belong to the file system are erased. */
+    esp_err_t init(uint32_t baseSector, uint32_t sectorCount, size_t maxFiles, size_t writeBufferSize);
+
+    /* Writes buffered data and closes all files. */
+    esp_err_t flushAll();
+
+    esp_err_t format();
+
+    /* Reclaims sectors until freeSectors are erased, giving up after
+     * maxSteps sectors have been collected. */
+    esp_err_t collect(size_t freeSectors, size_t maxSteps);
+
+    void getInfo(size_t& totalBytes, size_t& usedBytes, size_t& freeSectors);
+
+    bool hasOpenFiles();
+
+    int open(const char* path, int flags, int& fd);
+    int close(int fd);
+    int read(int fd, void* dst, size_t size, size_t& bytesRead);
+    int write(int fd, const void* src, size_t size);
+    int lseek(int fd, off_t offset, int whence, off_t& position);
+    int fstat(int fd, struct stat* st);
+    int stat(const char* path, struct stat* st);
+    int unlink(const char* path);
+    int rename(const char* src, const char* dst);
+
+protected:
+    struct Inode
+    {
+        uint32_t id;
+        uint32_t size;
+        uint32_t recordAddress;     // of the INODE record binding the name
+        uint16_t openCount = 0;
+        uint16_t nameLength;
+        uint16_t recordLength;      // name and, after a rename, the previous name
+        char* name;
+        std::vector<Extent> extents;
+
+        Inode(uint32_t id, const char* name, size_t nameLength);
+        ~Inode();
+    };
+
+    struct OpenFile
+    {
+        Inode* inode;
+        int flags;
+        uint32_t position = 0;
+        uint32_t bufferOffset = 0;  // file offset of buffer[0]
+        uint32_t bufferLength = 0;
+        std::unique_ptr<uint8_t[]> buffer;
+    };
+
+    void clear();
+    size_t capacity() const;
+    Inode* findInode(const char* name, size_t nameLength);
+    void removeInode(Inode* inode);
+    void dropExtents(Inode* inode);
+    void addExtent(Inode* inode, const Extent& extent);
+    void account(uint32_t address, uint32_t size, bool add);
+
+    OpenFile* getFile(int fd);
+    esp_err_t flushFile(OpenFile* file);
+    esp_err_t flushInode(Inode* inode, OpenFile* except);
+    bool hasSpaceFor(size_t dataLength);
+
+    esp_err_t readFlash(uint32_t address, void* dst, size_t size);
+    esp_err_t readExtents(const std::vector<Extent>& extents, uint32_t offset, uint8_t* dst, size_t size);
+    esp_err_t openSector();
+    esp_err_t reserve(uint32_t length, uint32_t minimum, uint32_t& granted);
+    esp_err_t writeRecord(RecordType type, uint32_t inode, uint32_t offset, uint32_t length,
+                          const uint8_t* src, const Inode* copyFrom, uint32_t& address);
+    esp_err_t writeInodeRecord(uint32_t id, const char* name, size_t nameLength,
+                               const char* oldName, size_t oldNameLength, uint32_t& address);
+    esp_err_t writeData(Inode* inode, uint32_t offset, const uint8_t* src, uint32_t length);
+    esp_err_t collectOne();
+
+    template<typename TFunc>
+    uint32_t forEachRecord(const uint8_t* image, bool& sealed, TFunc func);
+    void applyInodeRecord(const RecordHeader& header, uint32_t address, const uint8_t* data);
+
+    uint32_t sectorAddress(size_t sector) const
+    {
+        return static_cast<uint32_t>(sector) * SECTOR_SIZE;
+    }
+
+    Mutex mMutex;
+    uint32_t mBaseAddress = 0;
+    std::vector<uint32_t> mSeq;     // per sector; SEQ_ERASED for free sectors
+    std::vector<uint32_t> mLive;    // per sector, bytes of records still referenced
+    size_t mFreeCount = 0;
+    size_t mLiveBytes = 0;
+    size_t mHead = SIZE_MAX;
+    uint32_t mWritePos = SECTOR_SIZE;
+    uint32_t mNextSeq = 0;
+    uint32_t mNextId = 1;
+    bool mInGc = false;
+    std::vector<Inode*> mInodes;
+    std::vector<OpenFile*> mFiles;
+    size_t mWriteBufferSize = 0;
+    uint8_t mScratch[256];
+};
+
+} // namespace logfs
+
+#endif /* logfs_hpp */
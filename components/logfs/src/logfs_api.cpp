@@ -0,0 +1,307 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "esp_logfs.h"
+#include "logfs_test_api.h"
+#include "logfs.hpp"
+#include "logfs_platform.hpp"
+#include "esp_vfs.h"
+#include "esp_partition.h"
+#include <cstring>
+#include <new>
+#include <errno.h>
+
+#ifdef ESP_PLATFORM
+// Uncomment this line to force output from this module
+// #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
+#include "esp_log.h"
+#include "freertos/task.h"
+static const char* TAG = "logfs";
+#else
+#define ESP_LOGD(...)
+#endif
+
+using namespace logfs;
+
+/* One mounted file system */
+struct MountEntry
+{
+    char basePath[ESP_VFS_PATH_MAX + 1];
+    FileSystem* fs;
+    size_t gcFreeSectors;
+};
+
+static const size_t MAX_MOUNTS = 4;
+
+// guards the mount table; each file system has its own lock
+static Mutex s_mount_mutex;
+static MountEntry s_mounts[MAX_MOUNTS];
+
+static MountEntry* logfs_find_mount(const char* base_path)
+{
+    for (auto& entry : s_mounts) {
+        if (entry.fs && strcmp(entry.basePath, base_path) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+static int logfs_vfs_open(void* ctx, const char* path, int flags, int mode)
+{
+    int fd;
+    int err = static_cast<FileSystem*>(ctx)->open(path, flags, fd);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static int logfs_vfs_close(void* ctx, int fd)
+{
+    int err = static_cast<FileSystem*>(ctx)->close(fd);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static ssize_t logfs_vfs_read(void* ctx, int fd, void* dst, size_t size)
+{
+    size_t bytesRead;
+    int err = static_cast<FileSystem*>(ctx)->read(fd, dst, size, bytesRead);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return bytesRead;
+}
+
+static size_t logfs_vfs_write(void* ctx, int fd, const void* data, size_t size)
+{
+    int err = static_cast<FileSystem*>(ctx)->write(fd, data, size);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return size;
+}
+
+static off_t logfs_vfs_lseek(void* ctx, int fd, off_t offset, int mode)
+{
+    off_t position;
+    int err = static_cast<FileSystem*>(ctx)->lseek(fd, offset, mode, position);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return position;
+}
+
+static int logfs_vfs_fstat(void* ctx, int fd, struct stat* st)
+{
+    int err = static_cast<FileSystem*>(ctx)->fstat(fd, st);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int logfs_vfs_stat(void* ctx, const char* path, struct stat* st)
+{
+    int err = static_cast<FileSystem*>(ctx)->stat(path, st);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int logfs_vfs_unlink(void* ctx, const char* path)
+{
+    int err = static_cast<FileSystem*>(ctx)->unlink(path);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int logfs_vfs_rename(void* ctx, const char* src, const char* dst)
+{
+    int err = static_cast<FileSystem*>(ctx)->rename(src, dst);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static esp_vfs_t logfs_vfs()
+{
+    esp_vfs_t vfs;
+    memset(&vfs, 0, sizeof(vfs));
+    vfs.fd_offset = 0;
+    vfs.flags = ESP_VFS_FLAG_CONTEXT_PTR;
+    vfs.write_p = &logfs_vfs_write;
+    vfs.lseek_p = &logfs_vfs_lseek;
+    vfs.read_p = &logfs_vfs_read;
+    vfs.open_p = &logfs_vfs_open;
+    vfs.close_p = &logfs_vfs_close;
+    vfs.fstat_p = &logfs_vfs_fstat;
+    vfs.stat_p = &logfs_vfs_stat;
+    vfs.unlink_p = &logfs_vfs_unlink;
+    vfs.rename_p = &logfs_vfs_rename;
+    return vfs;
+}
+
+#ifdef ESP_PLATFORM
+#define LOGFS_GC_TASK_PERIOD_MS     100
+#define LOGFS_GC_TASK_STACK_SIZE    3072
+
+static TaskHandle_t s_gc_task;
+
+/* Keeps gc_free_sectors sectors erased on each file system, collecting one
+ * sector at a time so that writers are not held up for long. */
+static void logfs_gc_task(void* arg)
+{
+    while (true) {
+        bool more = false;
+        {
+            Lock lock(s_mount_mutex);
+            for (auto& entry : s_mounts) {
+                if (entry.fs && entry.gcFreeSectors > 0 &&
+                        entry.fs->collect(entry.gcFreeSectors, 1) == ESP_ERR_NO_MEM) {
+                    more = true;
+                }
+            }
+        }
+        vTaskDelay((more ? 1 : LOGFS_GC_TASK_PERIOD_MS) / portTICK_PERIOD_MS);
+    }
+}
+#endif // ESP_PLATFORM
+
+extern "C" esp_err_t esp_logfs_mount_custom(const esp_logfs_config_t* config, uint32_t baseSector, uint32_t sectorCount)
+{
+    ESP_LOGD(TAG, "mount %s start=%d count=%d", config->base_path, baseSector, sectorCount);
+    if (config->base_path == NULL || strlen(config->base_path) > ESP_VFS_PATH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Lock lock(s_mount_mutex);
+    if (logfs_find_mount(config->base_path)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    MountEntry* entry = nullptr;
+    for (auto& e : s_mounts) {
+        if (e.fs == nullptr) {
+            entry = &e;
+            break;
+        }
+    }
+    if (entry == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    FileSystem* fs = new (std::nothrow) FileSystem();
+    if (fs == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = fs->init(baseSector, sectorCount, config->max_files, config->write_buffer_size);
+    if (err == ESP_OK) {
+        const esp_vfs_t vfs = logfs_vfs();
+        err = esp_vfs_register(config->base_path, &vfs, fs);
+    }
+    if (err != ESP_OK) {
+        delete fs;
+        return err;
+    }
+
+#ifdef ESP_PLATFORM
+    if (config->gc_free_sectors > 0 && s_gc_task == NULL &&
+            xTaskCreate(&logfs_gc_task, "logfs_gc", LOGFS_GC_TASK_STACK_SIZE, NULL,
+                        tskIDLE_PRIORITY + 1, &s_gc_task) != pdPASS) {
+        esp_vfs_unregister(config->base_path);
+        delete fs;
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    strcpy(entry->basePath, config->base_path);
+    entry->fs = fs;
+    entry->gcFreeSectors = config->gc_free_sectors;
+    return ESP_OK;
+}
+
+#ifdef ESP_PLATFORM
+extern "C" esp_err_t esp_logfs_mount(const esp_logfs_config_t* config)
+{
+    if (config->partition_label == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const esp_partition_t* partition = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, config->partition_label);
+    if (partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return esp_logfs_mount_custom(config, partition->address / SPI_FLASH_SEC_SIZE,
+            partition->size / SPI_FLASH_SEC_SIZE);
+}
+#endif
+
+extern "C" esp_err_t esp_logfs_unmount(const char* base_path)
+{
+    Lock lock(s_mount_mutex);
+    MountEntry* entry = logfs_find_mount(base_path);
+    if (entry == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = entry->fs->flushAll();
+    esp_vfs_unregister(base_path);
+    delete entry->fs;
+    entry->fs = nullptr;
+    return err;
+}
+
+extern "C" esp_err_t esp_logfs_format(const char* base_path)
+{
+    Lock lock(s_mount_mutex);
+    MountEntry* entry = logfs_find_mount(base_path);
+    if (entry == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return entry->fs->format();
+}
+
+extern "C" esp_err_t esp_logfs_gc(const char* base_path, size_t free_sectors)
+{
+    Lock lock(s_mount_mutex);
+    MountEntry* entry = logfs_find_mount(base_path);
+    if (entry == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return entry->fs->collect(free_sectors, SIZE_MAX);
+}
+
+extern "C" esp_err_t esp_logfs_info(const char* base_path, esp_logfs_info_t* info)
+{
+    Lock lock(s_mount_mutex);
+    MountEntry* entry = logfs_find_mount(base_path);
+    if (entry == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    entry->fs->getInfo(info->total_bytes, info->used_bytes, info->free_sectors);
+    return ESP_OK;
+}
@@ -0,0 +1,92 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef logfs_platform_h
+#define logfs_platform_h
+
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace logfs
+{
+
+class Mutex
+{
+public:
+    Mutex() : mSemaphore(xSemaphoreCreateMutex())
+    {
+    }
+
+    ~Mutex()
+    {
+        vSemaphoreDelete(mSemaphore);
+    }
+
+    void lock()
+    {
+        xSemaphoreTake(mSemaphore, portMAX_DELAY);
+    }
+
+    void unlock()
+    {
+        xSemaphoreGive(mSemaphore);
+    }
+
+protected:
+    SemaphoreHandle_t mSemaphore;
+
+private:
+    Mutex(const Mutex& other);
+    const Mutex& operator= (const Mutex& rhs);
+};
+
+} // namespace logfs
+
+#else // ESP_PLATFORM
+#include <mutex>
+
+namespace logfs
+{
+typedef std::mutex Mutex;
+} // namespace logfs
+
+#endif // ESP_PLATFORM
+
+namespace logfs
+{
+
+class Lock
+{
+public:
+    Lock(Mutex& mutex) : mMutex(mutex)
+    {
+        mMutex.lock();
+    }
+
+    ~Lock()
+    {
+        mMutex.unlock();
+    }
+
+private:
+    Mutex& mMutex;
+
+    Lock(const Lock& other);
+    const Lock& operator= (const Lock& rhs);
+};
+
+} // namespace logfs
+
+#endif /* logfs_platform_h */
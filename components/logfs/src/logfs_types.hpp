@@ -0,0 +1,125 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef logfs_types_h
+#define logfs_types_h
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_spi_flash.h"
+
+namespace logfs
+{
+
+/*
+ * On-flash format
+ *
+ * The partition is a circular log of sectors. Every sector in use starts with
+ * a SectorHeader carrying a sequence number which is incremented each time a
+ * sector is opened, so sorting sectors by sequence number gives the order in
+ * which the log was written. The rest of the sector is a run of records:
+ *
+ *   +--------------+-------------------------------+
+ *   | RecordHeader | data, padded to 4 bytes       |
+ *   +--------------+-------------------------------+
+ *
+ * Data is programmed before the header, so a record whose header reads back
+ * with a valid CRC is complete. The first position holding an erased header
+ * is where writing continues; anything else which doesn't parse means that
+ * a write was interrupted, and the sector is not written to again.
+ */
+
+const uint32_t SECTOR_SIZE = SPI_FLASH_SEC_SIZE;
+const uint32_t SECTOR_MAGIC = 0x5346474c; // "LGFS"
+const uint16_t FORMAT_VERSION = 1;
+const uint32_t SEQ_ERASED = 0xffffffff;
+
+struct SectorHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t crc32;     // over the preceding fields
+};
+
+static_assert(sizeof(SectorHeader) == 16, "unexpected SectorHeader size");
+
+enum class RecordType : uint8_t
+{
+    /* Binds a file name to an inode id, or unbinds it if the id is 0.
+     * Data is the name, followed by the previous name for a rename;
+     * offset is the length of the first name. */
+    INODE = 0x01,
+    /* A piece of file contents, stored at the given file offset. */
+    DATA = 0x02,
+    /* Written by garbage collection right before a sector is erased, so
+     * that a sector whose erase was interrupted is not replayed.
+     * inode holds the sequence number of the sector, offset its index. */
+    ERASE = 0x03,
+    EMPTY = 0xff,
+};
+
+struct RecordHeader
+{
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t length;    // of data, not including padding
+    uint32_t inode;
+    uint32_t offset;
+    uint32_t crc32;     // over the preceding fields and data
+};
+
+static_assert(sizeof(RecordHeader) == 16, "unexpected RecordHeader size");
+
+const uint32_t SECTOR_DATA_SIZE = SECTOR_SIZE - sizeof(SectorHeader);
+const uint32_t MAX_RECORD_DATA = SECTOR_DATA_SIZE - sizeof(RecordHeader);
+
+/* Don't start a DATA record with less than this much room left in a sector;
+ * bounds the space wasted at the end of each sector. */
+const uint32_t MIN_RECORD_DATA = 64;
+
+const size_t NAME_MAX_LENGTH = 64;
+
+inline uint32_t align4(uint32_t value)
+{
+    return (value + 3) & ~3U;
+}
+
+inline uint32_t recordSize(uint32_t dataLength)
+{
+    return sizeof(RecordHeader) + align4(dataLength);
+}
+
+
+/*
+ * In-memory state
+ */
+
+/* A run of file contents stored contiguously in flash. Addresses are
+ * relative to the start of the partition. */
+struct Extent
+{
+    uint32_t offset;
+    uint32_t address;
+    uint32_t length;
+
+    uint32_t end() const
+    {
+        return offset + length;
+    }
+};
+
+} // namespace logfs
+
+#endif /* logfs_types_h */
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "unity.h"
+#include "esp_logfs.h"
+#include "logfs_test_api.h"
+#include "esp_spi_flash.h"
+
+/* Flash sectors used by these tests */
+#define TEST_BASE_SECTOR    0x130
+#define TEST_SECTOR_COUNT   16
+
+static void mount(size_t write_buffer_size)
+{
+    esp_logfs_config_t config = {
+        .base_path = "/logfs",
+        .max_files = 4,
+        .write_buffer_size = write_buffer_size,
+        .gc_free_sectors = 0,
+    };
+    TEST_ESP_OK(esp_logfs_mount_custom(&config, TEST_BASE_SECTOR, TEST_SECTOR_COUNT));
+}
+
+TEST_CASE("logfs files can be written and read with stdio", "[logfs]")
+{
+    mount(256);
+    TEST_ESP_OK(esp_logfs_format("/logfs"));
+
+    FILE* f = fopen("/logfs/test.txt", "w");
+    TEST_ASSERT_NOT_NULL(f);
+    for (int i = 0; i < 100; ++i) {
+        fprintf(f, "line %d\n", i);
+    }
+    fclose(f);
+
+    TEST_ESP_OK(esp_logfs_unmount("/logfs"));
+    mount(256);
+
+    f = fopen("/logfs/test.txt", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    char line[32];
+    for (int i = 0; i < 100; ++i) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "line %d\n", i);
+        TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+        TEST_ASSERT_EQUAL_STRING(expected, line);
+    }
+    TEST_ASSERT_NULL(fgets(line, sizeof(line), f));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL(0, rename("/logfs/test.txt", "/logfs/old.txt"));
+    struct stat st;
+    TEST_ASSERT_EQUAL(-1, stat("/logfs/test.txt", &st));
+    TEST_ASSERT_EQUAL(ENOENT, errno);
+    TEST_ASSERT_EQUAL(0, stat("/logfs/old.txt", &st));
+    TEST_ASSERT_EQUAL(0, unlink("/logfs/old.txt"));
+    TEST_ESP_OK(esp_logfs_unmount("/logfs"));
+}
+
+TEST_CASE("logfs reclaims space of removed files", "[logfs]")
+{
+    mount(0);
+    TEST_ESP_OK(esp_logfs_format("/logfs"));
+    esp_logfs_info_t info;
+    TEST_ESP_OK(esp_logfs_info("/logfs", &info));
+    static char chunk[1024];
+    memset(chunk, 0x5a, sizeof(chunk));
+    // write the partition over several times
+    for (int i = 0; i < 8; ++i) {
+        int fd = open("/logfs/data.bin", O_WRONLY | O_CREAT | O_TRUNC);
+        TEST_ASSERT_TRUE(fd >= 0);
+        for (size_t written = 0; written < info.total_bytes / 2; written += sizeof(chunk)) {
+            TEST_ASSERT_EQUAL(sizeof(chunk), write(fd, chunk, sizeof(chunk)));
+        }
+        TEST_ASSERT_EQUAL(0, close(fd));
+    }
+    TEST_ASSERT_EQUAL(0, unlink("/logfs/data.bin"));
+    TEST_ESP_OK(esp_logfs_gc("/logfs", TEST_SECTOR_COUNT - 2));
+    TEST_ESP_OK(esp_logfs_info("/logfs", &info));
+    TEST_ASSERT_EQUAL(0, info.used_bytes);
+    TEST_ASSERT_TRUE(info.free_sectors >= TEST_SECTOR_COUNT - 2);
+    TEST_ESP_OK(esp_logfs_unmount("/logfs"));
+}
@@ -0,0 +1,4 @@
+// Stand-in for the newlib header included by esp_vfs.h
+#pragma once
+
+struct _reent;
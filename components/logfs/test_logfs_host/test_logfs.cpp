@@ -0,0 +1,547 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "logfs.hpp"
+#include "logfs_test_api.h"
+#include "esp_vfs.h"
+#include "spi_flash_emulation.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+
+using namespace logfs;
+
+static esp_vfs_t s_vfs;
+static void* s_vfs_ctx;
+
+extern "C" esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx)
+{
+    s_vfs = *vfs;
+    s_vfs_ctx = ctx;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_vfs_unregister(const char* base_path)
+{
+    s_vfs_ctx = nullptr;
+    return ESP_OK;
+}
+
+static std::vector<uint8_t> pattern(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> data(size);
+    std::mt19937 gen(seed);
+    for (auto& b : data) {
+        b = static_cast<uint8_t>(gen());
+    }
+    return data;
+}
+
+static void writeFile(FileSystem& fs, const char* name, const std::vector<uint8_t>& data, int flags = O_WRONLY | O_CREAT | O_TRUNC)
+{
+    int fd;
+    REQUIRE(fs.open(name, flags, fd) == 0);
+    REQUIRE(fs.write(fd, data.data(), data.size()) == 0);
+    REQUIRE(fs.close(fd) == 0);
+}
+
+static std::vector<uint8_t> readFile(FileSystem& fs, const char* name)
+{
+    int fd;
+    REQUIRE(fs.open(name, O_RDONLY, fd) == 0);
+    struct stat st;
+    REQUIRE(fs.fstat(fd, &st) == 0);
+    std::vector<uint8_t> data(st.st_size);
+    size_t bytesRead;
+    REQUIRE(fs.read(fd, data.data(), data.size(), bytesRead) == 0);
+    CHECK(bytesRead == data.size());
+    REQUIRE(fs.close(fd) == 0);
+    return data;
+}
+
+TEST_CASE("files can be written, read back and survive remount", "[logfs]")
+{
+    SpiFlashEmulator emu(16);
+    auto first = pattern(10000, 1);
+    auto second = pattern(100, 2);
+    {
+        FileSystem fs;
+        REQUIRE(fs.init(0, 16, 4, 512) == ESP_OK);
+        writeFile(fs, "/first.bin", first);
+        writeFile(fs, "/second.bin", second);
+        CHECK(readFile(fs, "/first.bin") == first);
+        CHECK(readFile(fs, "/second.bin") == second);
+    }
+    FileSystem fs;
+    REQUIRE(fs.init(0, 16, 4, 512) == ESP_OK);
+    CHECK(readFile(fs, "/first.bin") == first);
+    CHECK(readFile(fs, "/second.bin") == second);
+    struct stat st;
+    CHECK(fs.stat("/missing", &st) == ENOENT);
+    int fd;
+    CHECK(fs.open("/missing", O_RDONLY, fd) == ENOENT);
+}
+
+TEST_CASE("appends, overwrites and holes", "[logfs]")
+{
+    SpiFlashEmulator emu(16);
+    FileSystem fs;
+    REQUIRE(fs.init(0, 16, 4, 64) == ESP_OK);
+    std::vector<uint8_t> expected;
+    for (int i = 0; i < 50; ++i) {
+        auto chunk = pattern(37 + i, i);
+        writeFile(fs, "/log", chunk, O_WRONLY | O_CREAT | O_APPEND);
+        expected.insert(expected.end(), chunk.begin(), chunk.end());
+    }
+    CHECK(readFile(fs, "/log") == expected);
+
+    int fd;
+    REQUIRE(fs.open("/log", O_RDWR, fd) == 0);
+    off_t pos;
+    REQUIRE(fs.lseek(fd, 100, SEEK_SET, pos) == 0);
+    auto patch = pattern(300, 99);
+    REQUIRE(fs.write(fd, patch.data(), patch.size()) == 0);
+    std::copy(patch.begin(), patch.end(), expected.begin() + 100);
+    // reading through the same descriptor sees the buffered write
+    REQUIRE(fs.lseek(fd, 90, SEEK_SET, pos) == 0);
+    uint8_t buf[320];
+    size_t bytesRead;
+    REQUIRE(fs.read(fd, buf, sizeof(buf), bytesRead) == 0);
+    REQUIRE(bytesRead == sizeof(buf));
+    CHECK(std::equal(buf, buf + sizeof(buf), expected.begin() + 90));
+
+    REQUIRE(fs.lseek(fd, 10, SEEK_END, pos) == 0);
+    CHECK(pos == static_cast<off_t>(expected.size() + 10));
+    const uint8_t tail[] = {1, 2, 3};
+    REQUIRE(fs.write(fd, tail, sizeof(tail)) == 0);
+    expected.resize(expected.size() + 10, 0);
+    expected.insert(expected.end(), tail, tail + sizeof(tail));
+    REQUIRE(fs.close(fd) == 0);
+    CHECK(readFile(fs, "/log") == expected);
+
+    FileSystem fs2;
+    REQUIRE(fs2.init(0, 16, 4, 64) == ESP_OK);
+    CHECK(readFile(fs2, "/log") == expected);
+}
+
+TEST_CASE("open flags, rename and unlink", "[logfs]")
+{
+    SpiFlashEmulator emu(16);
+    FileSystem fs;
+    REQUIRE(fs.init(0, 16, 2, 0) == ESP_OK);
+    auto a = pattern(500, 1);
+    auto b = pattern(700, 2);
+    writeFile(fs, "/a", a);
+    writeFile(fs, "/b", b);
+
+    int fd, fd2, fd3;
+    CHECK(fs.open("/a", O_WRONLY | O_CREAT | O_EXCL, fd) == EEXIST);
+    REQUIRE(fs.open("/a", O_RDONLY, fd) == 0);
+    CHECK(fs.write(fd, a.data(), 1) == EBADF);
+    CHECK(fs.unlink("/a") == EBUSY);
+    REQUIRE(fs.open("/b", O_WRONLY, fd2) == 0);
+    CHECK(fs.open("/c", O_WRONLY | O_CREAT, fd3) == ENFILE);
+    REQUIRE(fs.close(fd2) == 0);
+    REQUIRE(fs.close(fd) == 0);
+    CHECK(fs.close(fd) == EBADF);
+    CHECK(fs.open("/this-name-is-much-too-long-to-be-stored-in-a-single-inode-record", O_WRONLY | O_CREAT, fd) == ENAMETOOLONG);
+
+    REQUIRE(fs.rename("/a", "/c") == 0);
+    struct stat st;
+    CHECK(fs.stat("/a", &st) == ENOENT);
+    REQUIRE(fs.rename("/c", "/b") == 0);
+    CHECK(readFile(fs, "/b") == a);
+    writeFile(fs, "/b", b);
+    CHECK(readFile(fs, "/b") == b);
+    REQUIRE(fs.stat("/b", &st) == 0);
+    CHECK(st.st_size == 700);
+    REQUIRE(fs.unlink("/b") == 0);
+    CHECK(fs.unlink("/b") == ENOENT);
+
+    writeFile(fs, "/d", a);
+    writeFile(fs, "/e", b);
+    REQUIRE(fs.rename("/d", "/e") == 0);
+
+    FileSystem fs2;
+    REQUIRE(fs2.init(0, 16, 2, 0) == ESP_OK);
+    CHECK(fs2.stat("/a", &st) == ENOENT);
+    CHECK(fs2.stat("/b", &st) == ENOENT);
+    CHECK(fs2.stat("/c", &st) == ENOENT);
+    CHECK(fs2.stat("/d", &st) == ENOENT);
+    CHECK(readFile(fs2, "/e") == a);
+}
+
+/* Random operations checked against a model, on a partition small enough
+ * that garbage collection runs all the time. */
+TEST_CASE("garbage collection keeps contents under random operations", "[logfs]")
+{
+    const size_t sectors = 8;
+    SpiFlashEmulator emu(sectors);
+    std::unique_ptr<FileSystem> fs(new FileSystem);
+    REQUIRE(fs->init(0, sectors, 4, 128) == ESP_OK);
+    std::map<std::string, std::vector<uint8_t> > model;
+    std::mt19937 gen(42);
+    size_t written = 0;
+    size_t enospc = 0;
+    for (int i = 0; i < 4000; ++i) {
+        std::string name = "/f" + std::to_string(gen() % 6);
+        uint32_t op = gen() % 10;
+        if (op < 5) {
+            // write at a random position, sometimes past the end
+            auto& expected = model[name];
+            auto data = pattern(gen() % 1500 + 1, i);
+            size_t offset = expected.empty() ? 0 : gen() % (expected.size() + 100);
+            int fd;
+            REQUIRE(fs->open(name.c_str(), O_RDWR | O_CREAT, fd) == 0);
+            off_t pos;
+            REQUIRE(fs->lseek(fd, offset, SEEK_SET, pos) == 0);
+            int err = fs->write(fd, data.data(), data.size());
+            REQUIRE(fs->close(fd) == 0);
+            if (err == ENOSPC) {
+                ++enospc;
+                continue;
+            }
+            REQUIRE(err == 0);
+            written += data.size();
+            if (expected.size() < offset + data.size()) {
+                expected.resize(offset + data.size(), 0);
+            }
+            std::copy(data.begin(), data.end(), expected.begin() + offset);
+        } else if (op < 7) {
+            auto data = pattern(gen() % 2000, i);
+            int fd;
+            REQUIRE(fs->open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, fd) == 0);
+            model[name].clear();
+            int err = fs->write(fd, data.data(), data.size());
+            REQUIRE(fs->close(fd) == 0);
+            if (err == ENOSPC) {
+                ++enospc;
+                continue;
+            }
+            REQUIRE(err == 0);
+            model[name] = data;
+            written += data.size();
+        } else if (op < 8) {
+            int err = fs->unlink(name.c_str());
+            CHECK(err == (model.count(name) ? 0 : ENOENT));
+            model.erase(name);
+        } else if (op < 9) {
+            std::string to = "/f" + std::to_string(gen() % 6);
+            int err = fs->rename(name.c_str(), to.c_str());
+            if (!model.count(name)) {
+                CHECK(err == ENOENT);
+            } else {
+                REQUIRE(err == 0);
+                auto data = model[name];
+                model.erase(name);
+                model[to] = data;
+            }
+        } else {
+            fs.reset(new FileSystem);
+            REQUIRE(fs->init(0, sectors, 4, 128) == ESP_OK);
+        }
+        if (i % 100 == 0) {
+            for (const auto& entry : model) {
+                REQUIRE(readFile(*fs, entry.first.c_str()) == entry.second);
+            }
+        }
+    }
+    for (const auto& entry : model) {
+        REQUIRE(readFile(*fs, entry.first.c_str()) == entry.second);
+    }
+    // far more than fits the partition went through it
+    CHECK(written > 20 * sectors * SECTOR_SIZE);
+    CHECK(enospc < 400);
+
+    for (const auto& entry : model) {
+        REQUIRE(fs->unlink(entry.first.c_str()) == 0);
+    }
+    size_t total, used, freeSectors;
+    fs->getInfo(total, used, freeSectors);
+    CHECK(used == 0);
+    REQUIRE(fs->collect(sectors - 2, SIZE_MAX) == ESP_OK);
+    fs->getInfo(total, used, freeSectors);
+    CHECK(freeSectors >= sectors - 2);
+}
+
+TEST_CASE("writes fail with ENOSPC when the partition is full", "[logfs]")
+{
+    SpiFlashEmulator emu(8);
+    FileSystem fs;
+    REQUIRE(fs.init(0, 8, 2, 0) == ESP_OK);
+    size_t total, used, freeSectors;
+    fs.getInfo(total, used, freeSectors);
+    int fd;
+    REQUIRE(fs.open("/big", O_WRONLY | O_CREAT, fd) == 0);
+    auto chunk = pattern(1000, 0);
+    size_t written = 0;
+    int err;
+    while ((err = fs.write(fd, chunk.data(), chunk.size())) == 0) {
+        written += chunk.size();
+    }
+    CHECK(err == ENOSPC);
+    CHECK(written > total - 2 * chunk.size());
+    REQUIRE(fs.close(fd) == 0);
+    // space comes back once the file is gone
+    REQUIRE(fs.unlink("/big") == 0);
+    writeFile(fs, "/small", chunk);
+    FileSystem fs2;
+    REQUIRE(fs2.init(0, 8, 2, 0) == ESP_OK);
+    CHECK(readFile(fs2, "/small") == chunk);
+}
+
+/* Simulates power loss after every possible number of flash word writes,
+ * then checks what survives the next mount:
+ * - a file which was complete before is untouched,
+ * - an unbuffered log holds at least every acknowledged append, in order,
+ * - a file replaced through a temporary file and rename is either the last
+ *   version which was acknowledged, or the next one.
+ * Replacing the file creates enough garbage for collection to run. */
+TEST_CASE("file system recovers from power loss at any point", "[logfs][recovery]")
+{
+    const size_t sectors = 6;
+    const int rounds = 20;
+    auto stable = pattern(3000, 1);
+    auto record = pattern(40, 2);
+    auto config = [](int version) {
+        return pattern(600, 100 + version);
+    };
+
+    size_t scenarios = 0;
+    size_t erases = 0;
+    for (uint32_t failAfter = 0; ; failAfter += 5) {
+        SpiFlashEmulator emu(sectors);
+        std::unique_ptr<FileSystem> fs(new FileSystem);
+        REQUIRE(fs->init(0, sectors, 4, 0) == ESP_OK);
+        writeFile(*fs, "/stable", stable);
+        writeFile(*fs, "/config", config(0));
+
+        emu.failAfter(failAfter);
+        size_t acknowledged = 0;
+        int version = 0;
+        bool failed = false;
+        for (int round = 1; round <= rounds && !failed; ++round) {
+            int fd;
+            failed = fs->open("/log", O_WRONLY | O_CREAT | O_APPEND, fd) != 0;
+            for (int i = 0; i < 4 && !failed; ++i) {
+                failed = fs->write(fd, record.data(), record.size()) != 0;
+                acknowledged += failed ? 0 : 1;
+            }
+            if (failed) {
+                break;
+            }
+            auto next = config(round);
+            failed = fs->close(fd) != 0 ||
+                     fs->open("/config.tmp", O_WRONLY | O_CREAT | O_TRUNC, fd) != 0 ||
+                     fs->write(fd, next.data(), next.size()) != 0 ||
+                     fs->close(fd) != 0 ||
+                     fs->rename("/config.tmp", "/config") != 0;
+            version += failed ? 0 : 1;
+        }
+        if (!failed) {
+            erases = emu.getEraseOps();
+            break;
+        }
+        ++scenarios;
+
+        emu.failAfter(UINT32_MAX);
+        fs.reset(new FileSystem);
+        REQUIRE(fs->init(0, sectors, 4, 0) == ESP_OK);
+        CHECK(readFile(*fs, "/stable") == stable);
+        auto current = readFile(*fs, "/config");
+        CHECK((current == config(version) || current == config(version + 1)));
+        struct stat st;
+        if (fs->stat("/log", &st) == 0) {
+            auto log = readFile(*fs, "/log");
+            REQUIRE(log.size() >= acknowledged * record.size());
+            REQUIRE(log.size() % record.size() == 0);
+            for (size_t i = 0; i < log.size(); i += record.size()) {
+                REQUIRE(std::equal(record.begin(), record.end(), log.begin() + i));
+            }
+        } else {
+            CHECK(acknowledged == 0);
+        }
+        // and the file system keeps working
+        writeFile(*fs, "/after", record);
+        CHECK(readFile(*fs, "/after") == record);
+    }
+    CHECK(scenarios > 500);
+    CHECK(erases >= 3);
+}
+
+TEST_CASE("interrupted erase of a collected sector is completed on mount", "[logfs][recovery]")
+{
+    const size_t sectors = 6;
+    auto keep = pattern(2000, 1);
+    auto prepare = [&](FileSystem& fs) {
+        REQUIRE(fs.init(0, sectors, 2, 0) == ESP_OK);
+        writeFile(fs, "/keep", keep);
+        for (int i = 0; i < 4; ++i) {
+            writeFile(fs, "/churn", pattern(3000, i));
+        }
+    };
+
+    // count the words written by one collection step, up to the erase
+    size_t words;
+    {
+        SpiFlashEmulator emu(sectors);
+        FileSystem fs;
+        prepare(fs);
+        size_t before = emu.getWriteBytes();
+        REQUIRE(fs.collect(sectors - 1, 1) == ESP_ERR_NO_MEM);
+        REQUIRE(emu.getEraseOps() == 1);
+        words = (emu.getWriteBytes() - before) / 4;
+    }
+
+    SpiFlashEmulator emu(sectors);
+    std::unique_ptr<FileSystem> fs(new FileSystem);
+    prepare(*fs);
+    emu.failAfter(words);
+    CHECK(fs->collect(sectors - 1, 1) == ESP_ERR_FLASH_OP_FAIL);
+    CHECK(emu.getEraseOps() == 0);
+    emu.failAfter(UINT32_MAX);
+
+    // the sector still holds its records, but the ERASE record written
+    // before the erase keeps them from being replayed
+    fs.reset(new FileSystem);
+    REQUIRE(fs->init(0, sectors, 2, 0) == ESP_OK);
+    CHECK(emu.getEraseOps() == 1);
+    CHECK(readFile(*fs, "/keep") == keep);
+    CHECK(readFile(*fs, "/churn") == pattern(3000, 3));
+}
+
+TEST_CASE("file system is usable through VFS", "[logfs]")
+{
+    SpiFlashEmulator emu(16);
+    esp_logfs_config_t config = {};
+    config.base_path = "/logs";
+    config.max_files = 2;
+    config.write_buffer_size = 256;
+    REQUIRE(esp_logfs_mount_custom(&config, 0, 16) == ESP_OK);
+    CHECK(esp_logfs_mount_custom(&config, 0, 16) == ESP_ERR_INVALID_STATE);
+    REQUIRE(s_vfs_ctx != nullptr);
+
+    int fd = s_vfs.open_p(s_vfs_ctx, "/hello.txt", O_WRONLY | O_CREAT, 0);
+    REQUIRE(fd >= 0);
+    const char text[] = "hello, world";
+    CHECK(s_vfs.write_p(s_vfs_ctx, fd, text, sizeof(text)) == sizeof(text));
+    CHECK(s_vfs.close_p(s_vfs_ctx, fd) == 0);
+
+    errno = 0;
+    CHECK(s_vfs.open_p(s_vfs_ctx, "/nope", O_RDONLY, 0) == -1);
+    CHECK(errno == ENOENT);
+    CHECK(s_vfs.rename_p(s_vfs_ctx, "/hello.txt", "/hi.txt") == 0);
+
+    struct stat st;
+    REQUIRE(s_vfs.stat_p(s_vfs_ctx, "/hi.txt", &st) == 0);
+    CHECK(st.st_size == sizeof(text));
+    CHECK(S_ISREG(st.st_mode));
+
+    // unmount writes buffered data of files left open
+    fd = s_vfs.open_p(s_vfs_ctx, "/open.txt", O_WRONLY | O_CREAT, 0);
+    REQUIRE(fd >= 0);
+    CHECK(s_vfs.write_p(s_vfs_ctx, fd, text, 5) == 5);
+    esp_logfs_info_t info;
+    REQUIRE(esp_logfs_info("/logs", &info) == ESP_OK);
+    CHECK(info.used_bytes > 0);
+    CHECK(info.used_bytes < info.total_bytes);
+    CHECK(esp_logfs_format("/logs") == ESP_ERR_INVALID_STATE);
+    REQUIRE(esp_logfs_unmount("/logs") == ESP_OK);
+    CHECK(esp_logfs_info("/logs", &info) == ESP_ERR_INVALID_STATE);
+
+    REQUIRE(esp_logfs_mount_custom(&config, 0, 16) == ESP_OK);
+    fd = s_vfs.open_p(s_vfs_ctx, "/open.txt", O_RDONLY, 0);
+    REQUIRE(fd >= 0);
+    char buf[16];
+    CHECK(s_vfs.read_p(s_vfs_ctx, fd, buf, sizeof(buf)) == 5);
+    CHECK(memcmp(buf, text, 5) == 0);
+    CHECK(s_vfs.lseek_p(s_vfs_ctx, fd, 0, SEEK_END) == 5);
+    CHECK(s_vfs.close_p(s_vfs_ctx, fd) == 0);
+    REQUIRE(esp_logfs_format("/logs") == ESP_OK);
+    CHECK(s_vfs.stat_p(s_vfs_ctx, "/hi.txt", &st) == -1);
+    REQUIRE(esp_logfs_gc("/logs", 14) == ESP_OK);
+    REQUIRE(esp_logfs_unmount("/logs") == ESP_OK);
+}
+
+/* Flash time below comes from the emulator's timing model. */
+TEST_CASE("benchmark sequential write, append and random read", "[logfs][bench]")
+{
+    const size_t sectors = 64;
+    SpiFlashEmulator emu(sectors);
+    FileSystem fs;
+    REQUIRE(fs.init(0, sectors, 4, 1024) == ESP_OK);
+
+    const size_t fileSize = 128 * 1024;
+    auto data = pattern(fileSize, 7);
+    emu.clearStats();
+    int fd;
+    REQUIRE(fs.open("/seq", O_WRONLY | O_CREAT, fd) == 0);
+    for (size_t pos = 0; pos < fileSize; pos += 256) {
+        REQUIRE(fs.write(fd, data.data() + pos, 256) == 0);
+    }
+    REQUIRE(fs.close(fd) == 0);
+    double seqTime = emu.getTotalTime();
+    size_t seqWrites = emu.getWriteOps();
+    CHECK(emu.getWriteBytes() < fileSize * 105 / 100);
+
+    const int appends = 1000;
+    auto line = pattern(48, 8);
+    emu.clearStats();
+    for (int i = 0; i < appends; ++i) {
+        REQUIRE(fs.open("/append", O_WRONLY | O_CREAT | O_APPEND, fd) == 0);
+        REQUIRE(fs.write(fd, line.data(), line.size()) == 0);
+        REQUIRE(fs.close(fd) == 0);
+    }
+    double appendTime = emu.getTotalTime();
+    size_t appendWrites = emu.getWriteOps();
+    size_t appendReads = emu.getReadOps();
+
+    const int reads = 1000;
+    std::mt19937 gen(1);
+    REQUIRE(fs.open("/seq", O_RDONLY, fd) == 0);
+    emu.clearStats();
+    for (int i = 0; i < reads; ++i) {
+        uint8_t buf[64];
+        off_t pos;
+        size_t bytesRead;
+        size_t offset = gen() % (fileSize - sizeof(buf));
+        REQUIRE(fs.lseek(fd, offset, SEEK_SET, pos) == 0);
+        REQUIRE(fs.read(fd, buf, sizeof(buf), bytesRead) == 0);
+        REQUIRE(std::equal(buf, buf + sizeof(buf), data.begin() + offset));
+    }
+    REQUIRE(fs.close(fd) == 0);
+    double readTime = emu.getTotalTime();
+    size_t readOps = emu.getReadOps();
+
+    emu.clearStats();
+    FileSystem remounted;
+    REQUIRE(remounted.init(0, sectors, 4, 1024) == ESP_OK);
+    double mountTime = emu.getTotalTime();
+
+    printf("Sequential write: %.0f KB/s, %zu flash writes for %zu KB\n",
+           fileSize / 1024.0 / (seqTime / 1e6), seqWrites, fileSize / 1024);
+    printf("Append (open, 48 bytes, close): %.0f us, %.1f flash writes, %.1f flash reads each\n",
+           appendTime / appends, double(appendWrites) / appends, double(appendReads) / appends);
+    printf("Random 64 byte read: %.0f us, %.1f flash reads each\n",
+           readTime / reads, double(readOps) / reads);
+    printf("Mount: %.1f ms\n", mountTime / 1000);
+    // an append is one DATA record: data and header
+    CHECK(appendWrites <= 2 * appends + 2 * (appends * 64 / SECTOR_SIZE + 1));
+    CHECK(readOps <= 2 * reads);
+}
@@ -320,6 +320,15 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
     }
   }
 
+#if LWIP_TCP_TIMER_WHEEL
+  /* Nothing left to poll for: don't have the timer wheel wake up for this
+     pcb until writing or closing registers poll_tcp again */
+  if ((conn->pcb.tcp != NULL) && (conn->state != NETCONN_WRITE) &&
+      (conn->state != NETCONN_CLOSE) && !(conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    tcp_poll(conn->pcb.tcp, NULL, NETCONN_TCP_POLL_INTERVAL);
+  }
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
   return ERR_OK;
 }
 
@@ -447,7 +456,10 @@ setup_tcp(struct netconn *conn)
   tcp_arg(pcb, conn);
   tcp_recv(pcb, recv_tcp);
   tcp_sent(pcb, sent_tcp);
+#if !LWIP_TCP_TIMER_WHEEL
+  /* with the timer wheel, poll_tcp is only registered while writing or closing */
   tcp_poll(pcb, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+#endif /* !LWIP_TCP_TIMER_WHEEL */
   tcp_err(pcb, err_tcp);
 }
 
@@ -1637,6 +1649,9 @@ lwip_netconn_do_write(void *m)
         LWIP_ASSERT("msg->msg.w.len != 0", msg->msg.w.len != 0);
         msg->conn->current_msg = msg;
         msg->conn->write_offset = 0;
+#if LWIP_TCP_TIMER_WHEEL
+        tcp_poll(msg->conn->pcb.tcp, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+#endif /* LWIP_TCP_TIMER_WHEEL */
 #if LWIP_TCPIP_CORE_LOCKING
         if (lwip_netconn_do_writemore(msg->conn, 0) != ERR_OK) {
           LWIP_ASSERT("state!", msg->conn->state == NETCONN_WRITE);
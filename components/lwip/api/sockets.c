@@ -185,12 +185,7 @@ static void sockaddr_to_ipaddr_port(const struct sockaddr* sockaddr, ip_addr_t*
 
 #define NUM_SOCKETS MEMP_NUM_NETCONN
 
-/** This is overridable for the rare case where more than 255 threads
- * select on the same socket...
- */
-#ifndef SELWAIT_T
-#define SELWAIT_T u8_t
-#endif
+struct lwip_epoll_item;
 
 /** Contains all internal pointers and states used for a socket */
 struct lwip_sock {
@@ -230,8 +225,8 @@ struct lwip_sock {
   u8_t age;
 #endif
  
-  /** counter of how many threads are waiting for this socket using select */
-  SELWAIT_T select_waiting;
+  /** epoll instances and select calls watching this socket */
+  struct lwip_epoll_item *watchers;
 };
 
 #if ESP_THREAD_SAFE
@@ -319,30 +314,62 @@ do{\
 
 
 
-#if LWIP_NETCONN_SEM_PER_THREAD
-#define SELECT_SEM_T        sys_sem_t*
-#define SELECT_SEM_PTR(sem) (sem)
-#else /* LWIP_NETCONN_SEM_PER_THREAD */
-#define SELECT_SEM_T        sys_sem_t
-#define SELECT_SEM_PTR(sem) (&(sem))
-#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+/** Events a socket can be watched for, the same values as EPOLLIN, EPOLLOUT
+    and EPOLLERR */
+#define LWIP_EV_READ    0x001
+#define LWIP_EV_WRITE   0x004
+#define LWIP_EV_ERROR   0x008
+#define LWIP_EV_MASK    (LWIP_EV_READ | LWIP_EV_WRITE | LWIP_EV_ERROR)
+
+#if LWIP_SOCKET_EPOLL && ((EPOLLIN != LWIP_EV_READ) || (EPOLLOUT != LWIP_EV_WRITE) || (EPOLLERR != LWIP_EV_ERROR))
+#error "EPOLLIN, EPOLLOUT and EPOLLERR must match LWIP_EV_READ, LWIP_EV_WRITE and LWIP_EV_ERROR"
+#endif
+
+/** The item is on the watchers list of its socket */
+#define EPOLL_ITEM_REGISTERED 0x01
+/** The item is on the ready list of its epoll instance */
+#define EPOLL_ITEM_QUEUED     0x02
+
+/** A socket watched by an epoll instance or by a task in select */
+struct lwip_epoll_item {
+  /** next item watching the same socket */
+  struct lwip_epoll_item *sock_next;
+  /** next item on the ready list */
+  struct lwip_epoll_item *ready_next;
+  /** the epoll instance (or select call) this item belongs to */
+  struct lwip_epoll *ep;
+  /** LWIP_EV_* events watched for, with EPOLLET and EPOLLONESHOT for epoll */
+  u32_t events;
+  /** EPOLL_ITEM_* flags */
+  u8_t flags;
+};
 
-/** Description for a task waiting in select */
-struct lwip_select_cb {
-  /** Pointer to the next waiting task */
-  struct lwip_select_cb *next;
-  /** Pointer to the previous waiting task */
-  struct lwip_select_cb *prev;
-  /** readset passed to select */
-  fd_set *readset;
-  /** writeset passed to select */
-  fd_set *writeset;
-  /** unimplemented: exceptset passed to select */
-  fd_set *exceptset;
+/** The sockets watched by an epoll instance or by a task in select, and
+    those of them which had an event since they were last looked at */
+struct lwip_epoll {
+  /** one item per socket, indexed like sockets[] */
+  struct lwip_epoll_item *items;
+  /** number of items, the sockets after them are not watched */
+  int num_items;
+  /** items which had an event, oldest first */
+  struct lwip_epoll_item *ready_head;
+  struct lwip_epoll_item **ready_tail;
+  /** semaphore of the waiting task, valid while 'waiting' is set */
+  sys_sem_t *sem;
+  /** a task is waiting for an item to become ready */
+  u8_t waiting;
   /** don't signal the same semaphore twice: set to 1 when signalled */
-  int sem_signalled;
-  /** semaphore to wake up a task waiting for select */
-  SELECT_SEM_T sem;
+  u8_t sem_signalled;
+  /** a watched socket has been closed */
+  u8_t sock_closed;
+#if LWIP_SOCKET_EPOLL
+  /** the epoll instance is open */
+  u8_t used;
+#if !LWIP_NETCONN_SEM_PER_THREAD
+  /** semaphore to wake up a task in lwip_epoll_wait */
+  sys_sem_t own_sem;
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
+#endif /* LWIP_SOCKET_EPOLL */
 };
 
 /** A struct sockaddr replacement that has the same alignment as sockaddr_in/
@@ -387,11 +414,17 @@ static struct lwip_sock sockets[NUM_SOCKETS];
 #if ESP_THREAD_SAFE
 static bool sockets_init_flag = false;
 #endif
-/** The global list of tasks waiting for select */
-static struct lwip_select_cb *select_cb_list;
-/** This counter is increased from lwip_select when the list is changed
-    and checked in event_callback to see if it has changed. */
-static volatile int select_cb_ctr;
+#if LWIP_SOCKET_EPOLL
+/** The global array of epoll instances, numbered after the sockets */
+static struct lwip_epoll epolls[LWIP_SOCKET_EPOLL_MAX];
+/** The items of the epoll instances, indexed like epolls[] and sockets[] */
+static struct lwip_epoll_item epoll_items[LWIP_SOCKET_EPOLL_MAX][NUM_SOCKETS];
+/** Data returned by lwip_epoll_wait with the events, indexed like epoll_items.
+    Kept out of the items, which select has on the stack. */
+static epoll_data_t epoll_data[LWIP_SOCKET_EPOLL_MAX][NUM_SOCKETS];
+#define EPOLL_ITEM_DATA(ep, item) epoll_data[(ep) - epolls][(item) - (ep)->items]
+#define EPOLL_FD(i) (LWIP_SOCKET_OFFSET + NUM_SOCKETS + (i))
+#endif /* LWIP_SOCKET_EPOLL */
 
 /** Table to quickly map an lwIP error (err_t) to a socket error
   * by using -err as an index */
@@ -533,6 +566,231 @@ tryget_socket(int s)
   return &sockets[s];
 }
 
+/**
+ * Get the events a socket is ready for. Call with SYS_ARCH_PROTECT held.
+ *
+ * @param sock the socket to check
+ * @return LWIP_EV_* events
+ */
+static u32_t
+lwip_sock_events(struct lwip_sock *sock)
+{
+  u32_t events = 0;
+
+  if ((sock->lastdata != NULL) || (sock->rcvevent > 0)) {
+    events |= LWIP_EV_READ;
+  }
+  if (sock->sendevent != 0) {
+    events |= LWIP_EV_WRITE;
+  }
+  if (sock->errevent != 0) {
+    events |= LWIP_EV_ERROR;
+  }
+  return events;
+}
+
+/**
+ * Initialize an epoll instance (or the sockets watched by a select call)
+ *
+ * @param ep the epoll instance
+ * @param items one item for each of the first num_items sockets
+ * @param num_items number of items
+ */
+static void
+epoll_init(struct lwip_epoll *ep, struct lwip_epoll_item *items, int num_items)
+{
+  memset(ep, 0, sizeof(*ep));
+  memset(items, 0, num_items * sizeof(*items));
+  ep->items = items;
+  ep->num_items = num_items;
+  ep->ready_tail = &ep->ready_head;
+}
+
+/**
+ * Put an item on the ready list of its epoll instance and wake up the task
+ * waiting for it. Call with SYS_ARCH_PROTECT held.
+ */
+static void
+epoll_item_ready(struct lwip_epoll_item *item)
+{
+  struct lwip_epoll *ep = item->ep;
+
+  if (!(item->flags & EPOLL_ITEM_QUEUED)) {
+    item->flags |= EPOLL_ITEM_QUEUED;
+    item->ready_next = NULL;
+    *ep->ready_tail = item;
+    ep->ready_tail = &item->ready_next;
+  }
+  if (ep->waiting && !ep->sem_signalled) {
+    ep->sem_signalled = 1;
+    /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
+       lead to the waiting task leaving, invalidating the semaphore. */
+    sys_sem_signal(ep->sem);
+  }
+}
+
+/**
+ * Take the oldest item off the ready list of an epoll instance.
+ * Call with SYS_ARCH_PROTECT held.
+ *
+ * @return the item or NULL if the list is empty
+ */
+static struct lwip_epoll_item *
+epoll_next_ready(struct lwip_epoll *ep)
+{
+  struct lwip_epoll_item *item = ep->ready_head;
+
+  if (item != NULL) {
+    ep->ready_head = item->ready_next;
+    if (ep->ready_head == NULL) {
+      ep->ready_tail = &ep->ready_head;
+    }
+    item->flags &= ~EPOLL_ITEM_QUEUED;
+  }
+  return item;
+}
+
+/**
+ * Start watching a socket for item->events. The item is made ready at once
+ * if the socket already is. Call with SYS_ARCH_PROTECT held.
+ */
+static void
+epoll_item_attach(struct lwip_epoll *ep, struct lwip_epoll_item *item, struct lwip_sock *sock)
+{
+  item->ep = ep;
+  item->sock_next = sock->watchers;
+  sock->watchers = item;
+  item->flags |= EPOLL_ITEM_REGISTERED;
+  if (lwip_sock_events(sock) & item->events) {
+    epoll_item_ready(item);
+  }
+}
+
+/**
+ * Stop watching a socket. If the item is on the ready list, it is dropped
+ * from there when the list is next looked at. Call with SYS_ARCH_PROTECT held.
+ */
+static void
+epoll_item_detach(struct lwip_epoll_item *item, struct lwip_sock *sock)
+{
+  struct lwip_epoll_item **pitem;
+
+  for (pitem = &sock->watchers; *pitem != NULL; pitem = &(*pitem)->sock_next) {
+    if (*pitem == item) {
+      *pitem = item->sock_next;
+      break;
+    }
+  }
+  item->flags &= ~EPOLL_ITEM_REGISTERED;
+}
+
+/** Stop watching all sockets of an epoll instance (or select call) */
+static void
+epoll_detach_all(struct lwip_epoll *ep)
+{
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  for (i = 0; i < ep->num_items; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (ep->items[i].flags & EPOLL_ITEM_REGISTERED) {
+      epoll_item_detach(&ep->items[i], &sockets[i]);
+    }
+    SYS_ARCH_UNPROTECT(lev);
+  }
+}
+
+/**
+ * Wait until an item of an epoll instance is ready.
+ *
+ * @param ep the epoll instance (or select call)
+ * @param sem semaphore of the calling task
+ * @param msectimeout timeout in milliseconds, 0 to wait forever
+ * @return SYS_ARCH_TIMEOUT if no item became ready in time
+ */
+static u32_t
+epoll_block(struct lwip_epoll *ep, sys_sem_t *sem, u32_t msectimeout)
+{
+  u32_t waitres;
+  u8_t signalled;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  if (ep->ready_head != NULL) {
+    SYS_ARCH_UNPROTECT(lev);
+    return 0;
+  }
+  ep->sem = sem;
+  ep->sem_signalled = 0;
+  ep->waiting = 1;
+  SYS_ARCH_UNPROTECT(lev);
+
+  waitres = sys_arch_sem_wait(sem, msectimeout);
+
+  SYS_ARCH_PROTECT(lev);
+  ep->waiting = 0;
+  signalled = ep->sem_signalled;
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (signalled && (waitres == SYS_ARCH_TIMEOUT)) {
+    /* don't leave the (thread-local) semaphore signalled */
+    sys_arch_sem_wait(sem, 1);
+  }
+  return waitres;
+}
+
+#if LWIP_SOCKET_EPOLL
+/**
+ * Map an epoll file descriptor to the epoll instance.
+ *
+ * @param epfd file descriptor returned by lwip_epoll_create
+ * @return the epoll instance or NULL if not open
+ */
+static struct lwip_epoll *
+tryget_epoll(int epfd)
+{
+  epfd -= EPOLL_FD(0);
+  if ((epfd < 0) || (epfd >= LWIP_SOCKET_EPOLL_MAX) || !epolls[epfd].used) {
+    return NULL;
+  }
+  return &epolls[epfd];
+}
+
+/**
+ * Same as tryget_epoll but sets errno
+ */
+static struct lwip_epoll *
+get_epoll(int epfd)
+{
+  struct lwip_epoll *ep = tryget_epoll(epfd);
+
+  if (ep == NULL) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("get_epoll(%d): invalid\n", epfd));
+    set_errno(EBADF);
+  }
+  return ep;
+}
+
+/**
+ * Close an epoll instance, called from lwip_close. No task may be waiting
+ * in lwip_epoll_wait for it.
+ */
+static int
+lwip_epoll_close(struct lwip_epoll *ep)
+{
+  LWIP_ASSERT("lwip_epoll_close: a task is waiting", !ep->waiting);
+
+  epoll_detach_all(ep);
+#if !LWIP_NETCONN_SEM_PER_THREAD
+  sys_sem_free(&ep->own_sem);
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
+  SYS_ARCH_SET(ep->used, 0);
+
+  set_errno(0);
+  return 0;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 /**
  * Allocate a new socket for a given netconn.
  *
@@ -595,7 +853,6 @@ alloc_socket(struct netconn *newconn, int accepted)
     sockets[oldest].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
     sockets[oldest].errevent   = 0;
     sockets[oldest].err        = 0;
-    sockets[oldest].select_waiting = 0;
 
     sockets[oldest].state      = LWIP_SOCK_OPEN;
     sockets[oldest].age        = 0;
@@ -633,7 +890,6 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
       sockets[i].errevent   = 0;
       sockets[i].err        = 0;
-      sockets[i].select_waiting = 0;
 
       return i + LWIP_SOCKET_OFFSET;
     }
@@ -655,9 +911,20 @@ static void
 free_socket(struct lwip_sock *sock, int is_tcp)
 {
   void *lastdata;
+  struct lwip_epoll_item *item;
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_DEBUGF(ESP_THREAD_SAFE_DEBUG, ("free_sockset:free socket s=%p is_tcp=%d\n", sock, is_tcp));
+  /* Remove the socket from all epoll instances and wake up tasks in select */
+  SYS_ARCH_PROTECT(lev);
+  while ((item = sock->watchers) != NULL) {
+    sock->watchers = item->sock_next;
+    item->flags &= ~EPOLL_ITEM_REGISTERED;
+    item->ep->sock_closed = 1;
+    epoll_item_ready(item);
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
   lastdata         = sock->lastdata;
   sock->lastdata   = NULL;
   sock->lastoffset = 0;
@@ -835,9 +1102,19 @@ lwip_close(int s)
   struct lwip_sock *sock;
   int is_tcp = 0;
   err_t err;
+#if LWIP_SOCKET_EPOLL
+  struct lwip_epoll *ep;
+#endif /* LWIP_SOCKET_EPOLL */
 
   LWIP_DEBUGF(SOCKETS_DEBUG|ESP_THREAD_SAFE_DEBUG, ("lwip_close: (%d)\n", s));
 
+#if LWIP_SOCKET_EPOLL
+  ep = tryget_epoll(s);
+  if (ep != NULL) {
+    return lwip_epoll_close(ep);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   sock = get_socket(s);
   if (!sock) {
     LWIP_DEBUGF(SOCKETS_DEBUG|ESP_THREAD_SAFE_DEBUG, ("lwip_close: sock is null, return -1\n"));
@@ -1611,6 +1888,17 @@ lwip_selscan(int maxfdp1, fd_set *readset_in, fd_set *writeset_in, fd_set *excep
   return nready;
 }
 
+/** Number of items lwip_select needs to watch the sockets below maxfdp1 */
+#define SELECT_NUM_ITEMS(maxfdp1) LWIP_MAX(LWIP_MIN((maxfdp1) - LWIP_SOCKET_OFFSET, NUM_SOCKETS), 1)
+
+/**
+ * Wait until one of the sockets in the sets is ready, or the timeout expires.
+ *
+ * While waiting, the sockets are watched like by an epoll instance which is
+ * a local variable. It takes one item (five words) for each socket below
+ * maxfdp1 on the stack of the calling task, only if none of the sockets is
+ * ready at once.
+ */
 int
 lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
             struct timeval *timeout)
@@ -1618,13 +1906,13 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
   u32_t waitres = 0;
   int nready;
   fd_set lreadset, lwriteset, lexceptset;
-  u32_t msectimeout;
-  struct lwip_select_cb select_cb;
+  u32_t msectimeout = 0;
+  u32_t deadline = 0;
+  sys_sem_t *sem;
+#if !LWIP_NETCONN_SEM_PER_THREAD
+  sys_sem_t select_sem;
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
   int i;
-  int maxfdp2;
-#if LWIP_NETCONN_SEM_PER_THREAD
-  int waited = 0;
-#endif
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select(%d, %p, %p, %p, tvsec=%"S32_F" tvusec=%"S32_F")\n",
@@ -1638,6 +1926,9 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
 
   /* If we don't have any current events, then suspend if we are supposed to */
   if (!nready) {
+    struct lwip_epoll select_ep;
+    struct lwip_epoll_item select_items[SELECT_NUM_ITEMS(maxfdp1)];
+
     if (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0) {
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: no timeout, returning 0\n"));
       /* This is OK as the local fdsets are empty and nready is zero,
@@ -1645,58 +1936,43 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       goto return_copy_fdsets;
     }
 
-    /* None ready: add our semaphore to list:
-       We don't actually need any dynamic memory. Our entry on the
-       list is only valid while we are in this function, so it's ok
-       to use local variables. */
-
-    select_cb.next = NULL;
-    select_cb.prev = NULL;
-    select_cb.readset = readset;
-    select_cb.writeset = writeset;
-    select_cb.exceptset = exceptset;
-    select_cb.sem_signalled = 0;
+    /* None ready: watch the sockets in the sets like an epoll instance does.
+       We don't actually need any dynamic memory. The items are only valid
+       while we are in this function, so it's ok to use local variables. */
 #if LWIP_NETCONN_SEM_PER_THREAD
-    select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
+    sem = LWIP_NETCONN_THREAD_SEM_GET();
 #else /* LWIP_NETCONN_SEM_PER_THREAD */
-    if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
+    if (sys_sem_new(&select_sem, 0) != ERR_OK) {
       /* failed to create semaphore */
       set_errno(ENOMEM);
       return -1;
     }
+    sem = &select_sem;
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
+    epoll_init(&select_ep, select_items, (int)LWIP_ARRAYSIZE(select_items));
 
-    /* Protect the select_cb_list */
-    SYS_ARCH_PROTECT(lev);
-
-    /* Put this select_cb on top of list */
-    select_cb.next = select_cb_list;
-    if (select_cb_list != NULL) {
-      select_cb_list->prev = &select_cb;
-    }
-    select_cb_list = &select_cb;
-    /* Increasing this counter tells event_callback that the list has changed. */
-    select_cb_ctr++;
-
-    /* Now we can safely unprotect */
-    SYS_ARCH_UNPROTECT(lev);
-
-    /* Increase select_waiting for each socket we are interested in */
-    maxfdp2 = maxfdp1;
     for (i = LWIP_SOCKET_OFFSET; i < maxfdp1; i++) {
-      if ((readset && FD_ISSET(i, readset)) ||
-          (writeset && FD_ISSET(i, writeset)) ||
-          (exceptset && FD_ISSET(i, exceptset))) {
+      u32_t events = 0;
+      if (readset && FD_ISSET(i, readset)) {
+        events |= LWIP_EV_READ;
+      }
+      if (writeset && FD_ISSET(i, writeset)) {
+        events |= LWIP_EV_WRITE;
+      }
+      if (exceptset && FD_ISSET(i, exceptset)) {
+        events |= LWIP_EV_ERROR;
+      }
+      if (events != 0) {
         struct lwip_sock *sock;
         SYS_ARCH_PROTECT(lev);
         sock = tryget_socket(i);
         if (sock != NULL) {
-          sock->select_waiting++;
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+          struct lwip_epoll_item *item = &select_ep.items[i - LWIP_SOCKET_OFFSET];
+          item->events = events;
+          epoll_item_attach(&select_ep, item, sock);
         } else {
           /* Not a valid socket */
           nready = -1;
-          maxfdp2 = i;
           SYS_ARCH_UNPROTECT(lev);
           break;
         }
@@ -1704,80 +1980,50 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       }
     }
 
-    if (nready >= 0) {
-      /* Call lwip_selscan again: there could have been events between
-         the last scan (without us on the list) and putting us on the list! */
-      nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
-      if (!nready) {
-        /* Still none ready, just wait to be woken */
-        if (timeout == 0) {
-          /* Wait forever */
-          msectimeout = 0;
-        } else {
-          msectimeout =  ((timeout->tv_sec * 1000) + ((timeout->tv_usec + 500)/1000));
-          if (msectimeout == 0) {
-            /* Wait 1ms at least (0 means wait forever) */
-            msectimeout = 1;
-          }
-        }
-
-        waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), msectimeout);
-#if LWIP_NETCONN_SEM_PER_THREAD
-        waited = 1;
-#endif
+    if (timeout != NULL) {
+      msectimeout = ((timeout->tv_sec * 1000) + ((timeout->tv_usec + 500)/1000));
+      if (msectimeout == 0) {
+        /* Wait 1ms at least (0 means wait forever) */
+        msectimeout = 1;
       }
+      deadline = sys_now() + msectimeout;
     }
 
-    /* Decrease select_waiting for each socket we are interested in */
-    for (i = LWIP_SOCKET_OFFSET; i < maxfdp2; i++) {
-      if ((readset && FD_ISSET(i, readset)) ||
-          (writeset && FD_ISSET(i, writeset)) ||
-          (exceptset && FD_ISSET(i, exceptset))) {
-        struct lwip_sock *sock;
-        SYS_ARCH_PROTECT(lev);
-        sock = tryget_socket(i);
-        if (sock != NULL) {
-          /* @todo: what if this is a new socket (reallocated?) in this case,
-             select_waiting-- would be wrong (a global 'sockalloc' counter,
-             stored per socket could help) */
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
-          if (sock->select_waiting > 0) {
-            sock->select_waiting--;
-          }
-        } else {
-          /* Not a valid socket */
-          nready = -1;
+    while (nready == 0) {
+      /* Events from here on put the sockets on the ready list again */
+      SYS_ARCH_PROTECT(lev);
+      while (epoll_next_ready(&select_ep) != NULL) {
+      }
+      SYS_ARCH_UNPROTECT(lev);
+
+      nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+      if ((nready != 0) || (waitres == SYS_ARCH_TIMEOUT) || select_ep.sock_closed) {
+        break;
+      }
+      if (timeout != NULL) {
+        s32_t left = (s32_t)(deadline - sys_now());
+        if (left <= 0) {
+          waitres = SYS_ARCH_TIMEOUT;
+          break;
         }
-        SYS_ARCH_UNPROTECT(lev);
+        msectimeout = (u32_t)left;
       }
+      /* Still none ready, just wait to be woken */
+      waitres = epoll_block(&select_ep, sem, msectimeout);
     }
-    /* Take us off the list */
-    SYS_ARCH_PROTECT(lev);
-    if (select_cb.next != NULL) {
-      select_cb.next->prev = select_cb.prev;
-    }
-    if (select_cb_list == &select_cb) {
-      LWIP_ASSERT("select_cb.prev == NULL", select_cb.prev == NULL);
-      select_cb_list = select_cb.next;
-    } else {
-      LWIP_ASSERT("select_cb.prev != NULL", select_cb.prev != NULL);
-      select_cb.prev->next = select_cb.next;
-    }
-    /* Increasing this counter tells event_callback that the list has changed. */
-    select_cb_ctr++;
-    SYS_ARCH_UNPROTECT(lev);
 
-#if LWIP_NETCONN_SEM_PER_THREAD
-    if (select_cb.sem_signalled && (!waited || (waitres == SYS_ARCH_TIMEOUT))) {
-      /* don't leave the thread-local semaphore signalled */
-      sys_arch_sem_wait(select_cb.sem, 1);
+    /* Take us off the sockets */
+    epoll_detach_all(&select_ep);
+    if (select_ep.sock_closed) {
+      /* This happens when a socket got closed while waiting */
+      nready = -1;
     }
-#else /* LWIP_NETCONN_SEM_PER_THREAD */
-    sys_sem_free(&select_cb.sem);
-#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+#if !LWIP_NETCONN_SEM_PER_THREAD
+    sys_sem_free(&select_sem);
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
 
     if (nready < 0) {
-      /* This happens when a socket got closed while waiting */
       set_errno(EBADF);
       return -1;
     }
@@ -1785,13 +2031,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
     if (waitres == SYS_ARCH_TIMEOUT) {
       /* Timeout */
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: timeout expired\n"));
-      /* This is OK as the local fdsets are empty and nready is zero,
-         or we would have returned earlier. */
-      goto return_copy_fdsets;
     }
-
-    /* See what's set */
-    nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
   }
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: nready=%d\n", nready));
@@ -1809,17 +2049,209 @@ return_copy_fdsets:
   return nready;
 }
 
+#if LWIP_SOCKET_EPOLL
+int
+lwip_epoll_create(int size)
+{
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  for (i = 0; i < LWIP_SOCKET_EPOLL_MAX; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (!epolls[i].used) {
+      epoll_init(&epolls[i], epoll_items[i], NUM_SOCKETS);
+      epolls[i].used = 1;
+      SYS_ARCH_UNPROTECT(lev);
+#if !LWIP_NETCONN_SEM_PER_THREAD
+      if (sys_sem_new(&epolls[i].own_sem, 0) != ERR_OK) {
+        SYS_ARCH_SET(epolls[i].used, 0);
+        set_errno(ENOMEM);
+        return -1;
+      }
+#endif /* !LWIP_NETCONN_SEM_PER_THREAD */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create(%d) = %d\n", size, EPOLL_FD(i)));
+      set_errno(0);
+      return EPOLL_FD(i);
+    }
+    SYS_ARCH_UNPROTECT(lev);
+  }
+
+  set_errno(ENFILE);
+  return -1;
+}
+
+int
+lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  struct lwip_epoll *ep;
+  struct lwip_sock *sock;
+  struct lwip_epoll_item *item;
+  int err = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  ep = get_epoll(epfd);
+  if (!ep) {
+    return -1;
+  }
+  if ((op != EPOLL_CTL_DEL) && (event == NULL)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  sock = tryget_socket(fd);
+  if (sock == NULL) {
+    err = EBADF;
+  } else {
+    item = &ep->items[fd - LWIP_SOCKET_OFFSET];
+    switch (op) {
+      case EPOLL_CTL_ADD:
+        if (item->flags & EPOLL_ITEM_REGISTERED) {
+          err = EEXIST;
+          break;
+        }
+        /* errors are always reported, like in Linux */
+        item->events = (event->events & (LWIP_EV_MASK | EPOLLET | EPOLLONESHOT)) | EPOLLERR;
+        EPOLL_ITEM_DATA(ep, item) = event->data;
+        epoll_item_attach(ep, item, sock);
+        break;
+      case EPOLL_CTL_MOD:
+        if (!(item->flags & EPOLL_ITEM_REGISTERED)) {
+          err = ENOENT;
+          break;
+        }
+        item->events = (event->events & (LWIP_EV_MASK | EPOLLET | EPOLLONESHOT)) | EPOLLERR;
+        EPOLL_ITEM_DATA(ep, item) = event->data;
+        if (lwip_sock_events(sock) & item->events) {
+          epoll_item_ready(item);
+        }
+        break;
+      case EPOLL_CTL_DEL:
+        if (!(item->flags & EPOLL_ITEM_REGISTERED)) {
+          err = ENOENT;
+          break;
+        }
+        epoll_item_detach(item, sock);
+        break;
+      default:
+        err = EINVAL;
+        break;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d): err=%d\n", epfd, op, fd, err));
+  set_errno(err);
+  return (err != 0) ? -1 : 0;
+}
+
+/**
+ * Wait for events on the sockets of an epoll instance. Only the sockets
+ * which had an event since the last call are looked at. Only one task at a
+ * time may wait for an epoll instance.
+ *
+ * @param timeout in milliseconds, -1 to wait forever, 0 to return at once
+ * @return number of events stored in 'events', -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  struct lwip_epoll_item *item;
+  struct lwip_epoll_item *requeue;
+  struct lwip_epoll_item **requeue_tail;
+  sys_sem_t *sem;
+  u32_t waitres = 0;
+  u32_t msectimeout = 0;
+  u32_t deadline = 0;
+  int nready = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  ep = get_epoll(epfd);
+  if (!ep) {
+    return -1;
+  }
+  if ((events == NULL) || (maxevents <= 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+#if LWIP_NETCONN_SEM_PER_THREAD
+  sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+  sem = &ep->own_sem;
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+  if (timeout > 0) {
+    deadline = sys_now() + (u32_t)timeout;
+  }
+
+  for (;;) {
+    /* Report the items on the ready list which are still ready. Level-triggered
+       ones are put back on the list, to be checked again by the next call. */
+    requeue = NULL;
+    requeue_tail = &requeue;
+    SYS_ARCH_PROTECT(lev);
+    while ((nready < maxevents) && ((item = epoll_next_ready(ep)) != NULL)) {
+      u32_t ready;
+      if (!(item->flags & EPOLL_ITEM_REGISTERED)) {
+        continue;
+      }
+      ready = lwip_sock_events(&sockets[item - ep->items]) & item->events;
+      if (ready == 0) {
+        continue;
+      }
+      events[nready].events = ready;
+      events[nready].data = EPOLL_ITEM_DATA(ep, item);
+      nready++;
+      if (item->events & EPOLLONESHOT) {
+        /* disabled until EPOLL_CTL_MOD */
+        item->events &= ~LWIP_EV_MASK;
+      } else if (!(item->events & EPOLLET)) {
+        *requeue_tail = item;
+        requeue_tail = &item->ready_next;
+      }
+    }
+    *requeue_tail = NULL;
+    while ((item = requeue) != NULL) {
+      requeue = item->ready_next;
+      epoll_item_ready(item);
+    }
+    SYS_ARCH_UNPROTECT(lev);
+
+    if ((nready > 0) || (timeout == 0) || (waitres == SYS_ARCH_TIMEOUT)) {
+      break;
+    }
+    if (timeout > 0) {
+      s32_t left = (s32_t)(deadline - sys_now());
+      if (left <= 0) {
+        break;
+      }
+      msectimeout = (u32_t)left;
+    }
+    waitres = epoll_block(ep, sem, msectimeout);
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d): nready=%d\n", epfd, nready));
+  set_errno(0);
+  return nready;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 /**
  * Callback registered in the netconn layer for each socket-netconn.
- * Processes recvevent (data available) and wakes up tasks waiting for select.
+ * Processes recvevent (data available) and wakes up tasks waiting for select
+ * or epoll.
  */
 static void
 event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s;
   struct lwip_sock *sock;
-  struct lwip_select_cb *scb;
-  int last_select_cb_ctr;
+  struct lwip_epoll_item *item;
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -1876,55 +2308,15 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
-  if (sock->select_waiting == 0) {
-    /* noone is waiting for this socket, no need to check select_cb_list */
-    SYS_ARCH_UNPROTECT(lev);
-    return;
-  }
-
-  /* Now decide if anyone is waiting for this socket */
-  /* NOTE: This code goes through the select_cb_list list multiple times
-     ONLY IF a select was actually waiting. We go through the list the number
-     of waiting select calls + 1. This list is expected to be small. */
-
-  /* At this point, SYS_ARCH is still protected! */
-again:
-  for (scb = select_cb_list; scb != NULL; scb = scb->next) {
-    /* remember the state of select_cb_list to detect changes */
-    last_select_cb_ctr = select_cb_ctr;
-    if (scb->sem_signalled == 0) {
-      /* semaphore not signalled yet */
-      int do_signal = 0;
-      /* Test this select call for our socket */
-      if (sock->rcvevent > 0) {
-        if (scb->readset && FD_ISSET(s, scb->readset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->sendevent != 0) {
-        if (!do_signal && scb->writeset && FD_ISSET(s, scb->writeset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->errevent != 0) {
-        if (!do_signal && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
-          do_signal = 1;
-        }
+  if ((evt == NETCONN_EVT_RCVPLUS) || (evt == NETCONN_EVT_SENDPLUS) || (evt == NETCONN_EVT_ERROR)) {
+    /* Put the epoll instances and select calls watching this socket for
+       what it is ready for now on their ready lists. Only those watching
+       this socket are visited. */
+    u32_t events = lwip_sock_events(sock);
+    for (item = sock->watchers; item != NULL; item = item->sock_next) {
+      if (events & item->events) {
+        epoll_item_ready(item);
       }
-      if (do_signal) {
-        scb->sem_signalled = 1;
-        /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
-           lead to the select thread taking itself off the list, invalidating the semaphore. */
-        sys_sem_signal(SELECT_SEM_PTR(scb->sem));
-      }
-    }
-    /* unlock interrupts with each step */
-    SYS_ARCH_UNPROTECT(lev);
-    /* this makes sure interrupt protection time is short */
-    SYS_ARCH_PROTECT(lev);
-    if (last_select_cb_ctr != select_cb_ctr) {
-      /* someone has changed select_cb_list, restart at the beginning */
-      goto again;
     }
   }
   SYS_ARCH_UNPROTECT(lev);
@@ -2568,6 +2960,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       } else {
         ip_reset_option(sock->conn->pcb.ip, optname);
       }
+#if LWIP_TCP
+      if ((optname == SO_KEEPALIVE) &&
+          (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP)) {
+        tcp_keepalive_changed(sock->conn->pcb.tcp);
+      }
+#endif /* LWIP_TCP */
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                   s, optname, (*(const int*)optval?"on":"off")));
       break;
@@ -2732,6 +3130,7 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       sock->conn->pcb.tcp->keep_idle = (u32_t)(*(const int*)optval);
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPALIVE) -> %"U32_F"\n",
                   s, sock->conn->pcb.tcp->keep_idle));
+      tcp_keepalive_changed(sock->conn->pcb.tcp);
       break;
 
 #if LWIP_TCP_KEEPALIVE
@@ -2739,16 +3138,19 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       sock->conn->pcb.tcp->keep_idle = 1000*(u32_t)(*(const int*)optval);
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPIDLE) -> %"U32_F"\n",
                   s, sock->conn->pcb.tcp->keep_idle));
+      tcp_keepalive_changed(sock->conn->pcb.tcp);
       break;
     case TCP_KEEPINTVL:
       sock->conn->pcb.tcp->keep_intvl = 1000*(u32_t)(*(const int*)optval);
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPINTVL) -> %"U32_F"\n",
                   s, sock->conn->pcb.tcp->keep_intvl));
+      tcp_keepalive_changed(sock->conn->pcb.tcp);
       break;
     case TCP_KEEPCNT:
       sock->conn->pcb.tcp->keep_cnt = (u32_t)(*(const int*)optval);
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPCNT) -> %"U32_F"\n",
                   s, sock->conn->pcb.tcp->keep_cnt));
+      tcp_keepalive_changed(sock->conn->pcb.tcp);
       break;
 #endif /* LWIP_TCP_KEEPALIVE */
 
@@ -3235,6 +3637,11 @@ lwip_getsockname_r(int s, struct sockaddr *name, socklen_t *namelen)
 int
 lwip_close_r(int s)
 {
+#if LWIP_SOCKET_EPOLL
+  if (tryget_epoll(s) != NULL) {
+    return lwip_close(s);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
   LWIP_API_LOCK();
   LWIP_SET_CLOSE_FLAG();
   __ret = lwip_close(s);
@@ -74,6 +74,10 @@ sys_mutex_t lock_tcpip_core;
  * It also starts all the timers to make sure they are running in the right
  * thread context.
  *
+ * After waking up for a message, it also handles the messages queued behind
+ * it, up to TCPIP_MSG_BATCH_MAX, without going back to the timeouts and
+ * the core lock in between.
+ *
  * @param arg unused argument
  */
 static void
@@ -82,6 +86,7 @@ tcpip_thread(void *arg)
 
 
   struct tcpip_msg *msg;
+  int batch = 0;
   LWIP_UNUSED_ARG(arg);
 
   if (tcpip_init_done != NULL) {
@@ -95,11 +100,16 @@ tcpip_thread(void *arg)
 
 
     /* MAIN Loop */
-    UNLOCK_TCPIP_CORE();
-    LWIP_TCPIP_THREAD_ALIVE();
-    /* wait for a message, timeouts are processed while waiting */
-    sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
-    LOCK_TCPIP_CORE();
+    if ((batch == 0) || (batch >= TCPIP_MSG_BATCH_MAX) ||
+        (sys_arch_mbox_tryfetch(&mbox, (void **)&msg) == SYS_MBOX_EMPTY)) {
+      batch = 0;
+      UNLOCK_TCPIP_CORE();
+      LWIP_TCPIP_THREAD_ALIVE();
+      /* wait for a message, timeouts are processed while waiting */
+      sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
+      LOCK_TCPIP_CORE();
+    }
+    batch++;
     
 
     
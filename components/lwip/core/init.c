@@ -189,6 +189,9 @@
 #if (MEM_USE_POOLS && !MEMP_USE_CUSTOM_POOLS)
   #error "MEM_USE_POOLS requires custom pools (MEMP_USE_CUSTOM_POOLS) to be enabled in your lwipopts.h"
 #endif
+#if (MEMP_POOLED_MALLOC && (!MEMP_MEM_MALLOC || MEMP_OVERFLOW_CHECK))
+  #error "MEMP_POOLED_MALLOC requires MEMP_MEM_MALLOC and may not be used with MEMP_OVERFLOW_CHECK in your lwipopts.h"
+#endif
 #if (PBUF_POOL_BUFSIZE <= MEM_ALIGNMENT)
   #error "PBUF_POOL_BUFSIZE must be greater than MEM_ALIGNMENT or the offset may take the full first pbuf"
 #endif
@@ -78,6 +78,152 @@ const struct memp_desc* const memp_pools[MEMP_MAX] = {
 #include "lwip/priv/memp_std.h"
 };
 
+#if MEMP_POOLED_MALLOC
+/*
+ * Pooled backend for MEMP_MEM_MALLOC: each pool has a static array of elements
+ * and a free list which is used as a stack without locks. The list head holds
+ * the index of the first free element in its low half and a counter in its high
+ * half which is incremented on every change, so that a compare-and-set with a
+ * stale head fails even if the same element is at the head again. A free
+ * element keeps the index of the next free element in its first word.
+ * When a pool is empty, elements are allocated with mem_malloc; memp_free
+ * tells them apart from pool elements by their address.
+ *
+ * The free lists start in index order and elements which have never been used
+ * stay at their end, so an element is taken for the first time only when all
+ * elements with lower indexes are in use. The highest index taken so far is
+ * therefore the high-water mark of the pool, and counting the elements in use
+ * on every allocation is not needed.
+ */
+
+#define MEMP_POOL_INDEX(head)   ((head) & 0xffff)
+#define MEMP_POOL_COUNT(head)   (((head) & 0xffff0000) + 0x10000)
+
+static void
+memp_pool_inc(volatile u32_t *counter)
+{
+  u32_t old;
+
+  do {
+    old = *counter;
+  } while (!sys_arch_cas32(counter, old, old + 1));
+}
+
+void
+memp_init_pool(const struct memp_desc *desc)
+{
+  struct memp_pool *pool = desc->pool;
+  u32_t i;
+
+  LWIP_ASSERT("memp_init_pool: too many elements", desc->num < MEMP_POOL_END);
+
+  for (i = 0; i < desc->num; ++i) {
+    *(u32_t *)(void *)(desc->base + i * desc->size) = (i + 1 < desc->num) ? i + 1 : MEMP_POOL_END;
+  }
+  pool->max = 0;
+  pool->fallback = 0;
+  pool->err = 0;
+  pool->head = MEMP_POOL_COUNT(pool->head) + (desc->num ? 0 : MEMP_POOL_END);
+}
+
+/**
+ * Initialize this module.
+ *
+ * Builds the free lists of all pools.
+ */
+void
+memp_init(void)
+{
+  u16_t i;
+
+  for (i = 0; i < MEMP_MAX; ++i) {
+    memp_init_pool(memp_pools[i]);
+  }
+}
+
+void *
+memp_malloc_pool(const struct memp_desc *desc)
+{
+  struct memp_pool *pool = desc->pool;
+  u32_t head, index, next, max;
+  void *mem;
+
+  do {
+    head = pool->head;
+    index = MEMP_POOL_INDEX(head);
+    if (index == MEMP_POOL_END) {
+      mem = mem_malloc(desc->size);
+      memp_pool_inc(mem != NULL ? &pool->fallback : &pool->err);
+      return mem;
+    }
+    /* may read an element which another task has just taken; the
+       compare-and-set fails then because the head has changed */
+    next = MEMP_POOL_INDEX(*(volatile u32_t *)(void *)(desc->base + index * desc->size));
+  } while (!sys_arch_cas32(&pool->head, head, MEMP_POOL_COUNT(head) + next));
+
+  do {
+    max = pool->max;
+  } while (index >= max && !sys_arch_cas32(&pool->max, max, index + 1));
+
+  return desc->base + index * desc->size;
+}
+
+void
+memp_free_pool(const struct memp_desc *desc, void *mem)
+{
+  struct memp_pool *pool;
+  u32_t head, index;
+
+  if ((desc == NULL) || (mem == NULL)) {
+    return;
+  }
+  pool = desc->pool;
+
+  if (((u8_t *)mem < desc->base) || ((u8_t *)mem >= desc->base + desc->num * desc->size)) {
+    mem_free(mem);
+    return;
+  }
+
+  index = (u32_t)((u8_t *)mem - desc->base) / desc->size;
+  do {
+    head = pool->head;
+    *(volatile u32_t *)mem = MEMP_POOL_INDEX(head);
+  } while (!sys_arch_cas32(&pool->head, head, MEMP_POOL_COUNT(head) + index));
+}
+
+/**
+ * Get an element from a specific pool, or from the heap if the pool is empty.
+ *
+ * @param type the pool to get an element from
+ *
+ * @return a pointer to the allocated memory or a NULL pointer on error
+ */
+void *
+memp_malloc(memp_t type)
+{
+  LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
+
+  ESP_CNT_MEM_MALLOC_INC(type);
+  return memp_malloc_pool(memp_pools[type]);
+}
+
+/**
+ * Put an element back into its pool, or free it if it came from the heap.
+ *
+ * @param type the pool where to put mem
+ * @param mem the memp element to free
+ */
+void
+memp_free(memp_t type, void *mem)
+{
+  LWIP_ERROR("memp_free: type < MEMP_MAX", (type < MEMP_MAX), return;);
+
+  ESP_CNT_MEM_FREE_INC(type);
+  memp_free_pool(memp_pools[type], mem);
+}
+
+#endif /* MEMP_POOLED_MALLOC */
+
 #if !MEMP_MEM_MALLOC /* don't build if not configured for use in lwipopts.h */
 
 #if MEMP_SANITY_CHECK
@@ -200,3 +200,38 @@ void stats_display_esp(struct stats_esp *esp)
 
 #endif /* LWIP_STATS */
 
+#if MEMP_POOLED_MALLOC
+
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+
+void
+stats_memp_pool_get(memp_t type, struct stats_memp_pool *pool)
+{
+  const struct memp_desc *desc = memp_pools[type];
+
+  pool->name = desc->desc;
+  pool->num = desc->num;
+  pool->max = (u16_t)desc->pool->max;
+  pool->fallback = desc->pool->fallback;
+  pool->err = desc->pool->err;
+}
+
+void
+stats_display_memp_pools(void)
+{
+  struct stats_memp_pool pool;
+  int i;
+
+  for (i = 0; i < MEMP_MAX; i++) {
+    stats_memp_pool_get((memp_t)i, &pool);
+    LWIP_PLATFORM_DIAG(("\nMEMP POOL %s\n\t", pool.name));
+    LWIP_PLATFORM_DIAG(("num: %"U32_F"\n\t", (u32_t)pool.num));
+    LWIP_PLATFORM_DIAG(("max: %"U32_F"\n\t", (u32_t)pool.max));
+    LWIP_PLATFORM_DIAG(("fallback: %"U32_F"\n\t", pool.fallback));
+    LWIP_PLATFORM_DIAG(("err: %"U32_F"\n", pool.err));
+  }
+}
+
+#endif /* MEMP_POOLED_MALLOC */
+
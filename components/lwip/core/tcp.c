@@ -51,6 +51,7 @@
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/debug.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/nd6.h"
@@ -117,11 +118,147 @@ struct tcp_pcb ** const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcb
 
 u8_t tcp_active_pcbs_changed;
 
+#if LWIP_PCB_HASH
+/** Hash tables of tcp_active_pcbs and tcp_tw_pcbs, keyed by address and ports */
+static struct tcp_pcb *tcp_active_pcb_hash[TCP_PCB_HASH_SIZE];
+static struct tcp_pcb *tcp_tw_pcb_hash[TCP_PCB_HASH_SIZE];
+/** Hash table of tcp_listen_pcbs, keyed by local port */
+static union tcp_listen_pcbs_t tcp_listen_pcb_hash[TCP_LISTEN_PCB_HASH_SIZE];
+#endif /* LWIP_PCB_HASH */
+
+#if !LWIP_TCP_TIMER_WHEEL
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
+#endif /* !LWIP_TCP_TIMER_WHEEL */
 static u8_t tcp_timer_ctr;
 static u16_t tcp_new_port(void);
 
+#if LWIP_TCP_TIMER_WHEEL
+#define TCP_TIMER_WHEEL_MASK (TCP_TIMER_WHEEL_SIZE - 1)
+
+/* pcb->timer_flags */
+#define TCP_TIMER_F_REG   0x01U /* in tcp_active_pcbs or tcp_tw_pcbs */
+#define TCP_TIMER_F_NEAR  0x02U /* in a slot of tcp_timer_wheel */
+#define TCP_TIMER_F_FAR   0x04U /* in tcp_timer_far */
+
+/** Slots of the timer wheel: a PCB due at tick t is in slot t % size, for t
+    less than TCP_TIMER_WHEEL_SIZE ticks after tcp_timer_tick */
+static struct tcp_pcb *tcp_timer_wheel[TCP_TIMER_WHEEL_SIZE];
+static u16_t tcp_timer_near_num;
+/** PCBs due later than that, and a tick no later than the first of them is due */
+static struct tcp_pcb *tcp_timer_far;
+static u32_t tcp_timer_far_due;
+/** Last tick the timer wheel has been run for */
+static u32_t tcp_timer_tick;
+/** PCBs with a delayed ACK or refused data, for tcp_fasttmr() */
+static struct tcp_pcb *tcp_timer_fast;
+/** sys_now() at which the current tcp_ticks started */
+static u32_t tcp_ticks_start;
+/** Set while tcp_tmr() runs: it schedules its next call when done */
+static u8_t tcp_timer_running;
+u32_t tcp_timer_wake_at;
+u8_t tcp_timer_wake_pending;
+
+static void tcp_timer_schedule(void);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
+#if LWIP_PCB_HASH
+static u32_t
+tcp_pcb_hash_ip(const ip_addr_t *ipaddr)
+{
+  u32_t h = 0;
+#if LWIP_IPV6
+  if (IP_IS_V6(ipaddr)) {
+    const u32_t *addr = ip_2_ip6(ipaddr)->addr;
+    h = addr[0] ^ addr[1] ^ addr[2] ^ addr[3];
+  } else
+#endif /* LWIP_IPV6 */
+  {
+#if LWIP_IPV4
+    h = ip4_addr_get_u32(ip_2_ip4(ipaddr));
+#endif /* LWIP_IPV4 */
+  }
+  return h;
+}
+
+/**
+ * Returns the hash table bucket in which a PCB of a list is kept.
+ *
+ * @param pcbs the PCB list: &tcp_active_pcbs, &tcp_tw_pcbs or &tcp_listen_pcbs.pcbs
+ * @param local_port local port of the PCB
+ * @param remote_ip remote address of the PCB, not used for listening PCBs
+ * @param remote_port remote port of the PCB, not used for listening PCBs
+ * @return the bucket, or NULL for a list which is not hashed
+ */
+struct tcp_pcb **
+tcp_pcb_hash_bucket(struct tcp_pcb **pcbs, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h;
+
+  if (pcbs == &tcp_listen_pcbs.pcbs) {
+    return &tcp_listen_pcb_hash[local_port & (TCP_LISTEN_PCB_HASH_SIZE - 1)].pcbs;
+  }
+  if ((pcbs != &tcp_active_pcbs) && (pcbs != &tcp_tw_pcbs)) {
+    return NULL;
+  }
+  /* mix the bits so that neighbouring ports and addresses are spread */
+  h = tcp_pcb_hash_ip(remote_ip) ^ (((u32_t)local_port << 16) | remote_port);
+  h ^= h >> 16;
+  h *= 0x45d9f3bU;
+  h ^= h >> 16;
+  if (pcbs == &tcp_active_pcbs) {
+    return &tcp_active_pcb_hash[h & (TCP_PCB_HASH_SIZE - 1)];
+  }
+  return &tcp_tw_pcb_hash[h & (TCP_PCB_HASH_SIZE - 1)];
+}
+
+static struct tcp_pcb **
+tcp_pcb_hash_bucket_of(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  if (pcbs == &tcp_listen_pcbs.pcbs) {
+    /* listening PCBs have no remote address and port */
+    return tcp_pcb_hash_bucket(pcbs, pcb->local_port, NULL, 0);
+  }
+  return tcp_pcb_hash_bucket(pcbs, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+}
+
+/**
+ * Adds a PCB which has just been registered in a list to the hash table
+ * of the list. Called by TCP_REG.
+ */
+void
+tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket_of(pcbs, pcb);
+
+  if (bucket != NULL) {
+    pcb->hash_next = *bucket;
+    *bucket = pcb;
+  }
+}
+
+/**
+ * Removes a PCB which has just been removed from a list from the hash table
+ * of the list. Called by TCP_RMV.
+ */
+void
+tcp_pcb_hash_remove(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket_of(pcbs, pcb);
+
+  if (bucket != NULL) {
+    for (; *bucket != NULL; bucket = &(*bucket)->hash_next) {
+      if (*bucket == pcb) {
+        *bucket = pcb->hash_next;
+        break;
+      }
+    }
+  }
+  pcb->hash_next = NULL;
+}
+#endif /* LWIP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -131,8 +268,27 @@ tcp_init(void)
 #if LWIP_RANDOMIZE_INITIAL_LOCAL_PORTS && defined(LWIP_RAND)
   tcp_port = TCP_ENSURE_LOCAL_PORT_RANGE(LWIP_RAND());
 #endif /* LWIP_RANDOMIZE_INITIAL_LOCAL_PORTS && defined(LWIP_RAND) */
+#if LWIP_TCP_TIMER_WHEEL
+  tcp_ticks_start = sys_now();
+#endif /* LWIP_TCP_TIMER_WHEEL */
 }
 
+#if LWIP_TCP_TIMER_WHEEL
+/**
+ * Called when tcp_timer_wakeup() has asked for it, i.e. when a timer of
+ * some PCB is due, to dispatch TCP timers.
+ */
+void
+tcp_tmr(void)
+{
+  tcp_timer_wake_pending = 0;
+  tcp_timer_running = 1;
+  tcp_fasttmr();
+  tcp_slowtmr();
+  tcp_timer_running = 0;
+  tcp_timer_schedule();
+}
+#else /* LWIP_TCP_TIMER_WHEEL */
 /**
  * Called periodically to dispatch TCP timers.
  */
@@ -148,6 +304,7 @@ tcp_tmr(void)
     tcp_slowtmr();
   }
 }
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 /**
  * Closes the TX side of a connection held by the PCB.
@@ -253,6 +410,8 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   default:
     /* Has already been closed, do nothing. */
     err = ERR_OK;
+    /* except for the FIN-WAIT-2 timeout tcp_close may have started */
+    tcp_timer_arm(pcb);
     pcb = NULL;
     break;
   }
@@ -326,6 +485,8 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
       pbuf_free(pcb->refused_data);
       pcb->refused_data = NULL;
     }
+    /* the FIN-WAIT-2 timeout may have started */
+    tcp_timer_arm(pcb);
   }
   if (shut_tx) {
     /* This can't happen twice since if it succeeds, the pcb's state is changed.
@@ -826,6 +987,576 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+/**
+ * Counts ticks on the timers of an active PCB: the persist timer or the
+ * retransmission timer, whichever runs, and the poll timer.
+ *
+ * @param pcb the tcp_pcb
+ * @param ticks number of slow timer ticks passed
+ */
+static void
+tcp_timer_advance(struct tcp_pcb *pcb, u32_t ticks)
+{
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
+
+    if (pcb->persist_cnt < backoff_cnt) {
+      pcb->persist_cnt = (u8_t)LWIP_MIN(pcb->persist_cnt + ticks, backoff_cnt);
+    }
+  } else if (pcb->rtime >= 0) {
+    /* Increase the retransmission timer if it is running */
+    pcb->rtime = (s16_t)LWIP_MIN(pcb->rtime + ticks, 0x7fff);
+  }
+  pcb->polltmr = (u8_t)LWIP_MIN(pcb->polltmr + ticks, 0xff);
+}
+
+/**
+ * Runs the slow timers of an active PCB which are due, after the timers
+ * have been advanced to tcp_ticks: retransmission, zero window probe,
+ * keepalive and the timeouts of the states. Polling is left to the caller.
+ *
+ * @param pcb the tcp_pcb
+ * @param pcb_reset set if a RST should be sent when removing the PCB
+ * @return != 0 if the PCB should be removed
+ */
+static u8_t
+tcp_slowtmr_pcb(struct tcp_pcb *pcb, u8_t *pcb_reset)
+{
+  tcpwnd_size_t eff_wnd;
+  u8_t pcb_remove = 0;
+  err_t err;
+
+  if (pcb->state == SYN_SENT && pcb->nrtx == TCP_SYNMAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
+  }
+  else if (pcb->nrtx == TCP_MAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
+  } else {
+    if (pcb->persist_backoff > 0) {
+
+      /* If snd_wnd is zero, use persist timer to send 1 byte probes
+       * instead of using the standard retransmission mechanism. */
+      u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
+
+      if (pcb->persist_cnt >= backoff_cnt) {
+        if (tcp_zero_window_probe(pcb) == ERR_OK) {
+          pcb->persist_cnt = 0;
+          if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
+            pcb->persist_backoff++;
+          }
+        }
+      }
+    } else {
+      if (pcb->unacked != NULL && pcb->rtime >= pcb->rto) {
+        /* Time for a retransmission. */
+        LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
+                                    " pcb->rto %"S16_F"\n",
+                                    pcb->rtime, pcb->rto));
+
+        /* Double retransmission time-out unless we are trying to
+         * connect to somebody (i.e., we are in SYN_SENT). */
+        if (pcb->state != SYN_SENT) {
+            pcb->rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[pcb->nrtx];
+        }
+
+        /* Reset the retransmission timer. */
+        pcb->rtime = 0;
+
+        /* Reduce congestion window and ssthresh. */
+        eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+        pcb->ssthresh = eff_wnd >> 1;
+        if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+          pcb->ssthresh = (pcb->mss << 1);
+        }
+        pcb->cwnd = pcb->mss;
+        LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                     " ssthresh %"TCPWNDSIZE_F"\n",
+                                     pcb->cwnd, pcb->ssthresh));
+
+        /* The following needs to be called AFTER cwnd is set to one
+           mss - STJ */
+        tcp_rexmit_rto(pcb);
+      }
+    }
+  }
+  /* Check if this PCB has stayed too long in FIN-WAIT-2 */
+  if (pcb->state == FIN_WAIT_2) {
+    /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
+    if (pcb->flags & TF_RXCLOSED) {
+      /* PCB was fully closed (either through close() or SHUT_RDWR):
+         normal FIN-WAIT timeout handling. */
+      if ((u32_t)(tcp_ticks - pcb->tmr) >
+          TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
+        ++pcb_remove;
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
+      }
+    }
+  }
+
+  /* Check if KEEPALIVE should be sent */
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+     ((pcb->state == ESTABLISHED) ||
+      (pcb->state == CLOSE_WAIT))) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+       (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL)
+    {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
+      ip_addr_debug_print(TCP_DEBUG, &pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+
+      ++pcb_remove;
+      ++(*pcb_reset);
+    } else if ((u32_t)(tcp_ticks - pcb->tmr) >
+              (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+              / TCP_SLOW_INTERVAL)
+    {
+      err = tcp_keepalive(pcb);
+      if (err == ERR_OK) {
+        pcb->keep_cnt_sent++;
+      }
+    }
+  }
+
+  /* If this PCB has queued out of sequence data, but has been
+     inactive for too long, will drop the data (it will eventually
+     be retransmitted). */
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL &&
+      (u32_t)tcp_ticks - pcb->tmr >= pcb->rto * TCP_OOSEQ_TIMEOUT) {
+    tcp_segs_free(pcb->ooseq);
+    pcb->ooseq = NULL;
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  /* Check if this PCB has stayed too long in SYN-RCVD */
+  if (pcb->state == SYN_RCVD) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
+    }
+  }
+
+  /* Check if this PCB has stayed too long in LAST-ACK */
+  if (pcb->state == LAST_ACK) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
+    }
+  }
+
+  return pcb_remove;
+}
+
+#if LWIP_TCP_TIMER_WHEEL
+/* A PCB needs its poll timer if polling calls back the application or
+   retries tcp_output */
+#if LWIP_CALLBACK_API
+#define TCP_TIMER_POLL_NEEDED(pcb) (((pcb)->poll != NULL) || ((pcb)->unsent != NULL) || \
+                                    ((pcb)->flags & (TF_ACK_NOW | TF_NAGLEMEMERR)))
+#else /* LWIP_CALLBACK_API */
+#define TCP_TIMER_POLL_NEEDED(pcb) 1
+#endif /* LWIP_CALLBACK_API */
+
+#define TCP_TIMER_NONE 0xffffffffUL
+
+/**
+ * Brings tcp_ticks up to sys_now(), which it follows in the timer wheel
+ * instead of being counted by tcp_slowtmr().
+ */
+void
+tcp_timer_update_ticks(void)
+{
+  u32_t ticks = (u32_t)(sys_now() - tcp_ticks_start) / TCP_SLOW_INTERVAL;
+
+  tcp_ticks += ticks;
+  tcp_ticks_start += ticks * TCP_SLOW_INTERVAL;
+}
+
+/** sys_now() at which a tick after tcp_ticks starts */
+static u32_t
+tcp_timer_tick_time(u32_t tick)
+{
+  return tcp_ticks_start + (tick - tcp_ticks) * TCP_SLOW_INTERVAL;
+}
+
+/** Number of ticks from tcp_ticks until a tick, at least 1 */
+static u32_t
+tcp_timer_ticks_until(u32_t tick)
+{
+  s32_t d = (s32_t)(tick - tcp_ticks);
+  return (d > 0) ? (u32_t)d : 1;
+}
+
+/** Has tcp_tmr() called at sys_now() 'at', unless it is called earlier anyway */
+static void
+tcp_timer_wake(u32_t at)
+{
+  s32_t msecs;
+
+  if (tcp_timer_running ||
+      (tcp_timer_wake_pending && ((s32_t)(at - tcp_timer_wake_at) >= 0))) {
+    return;
+  }
+  tcp_timer_wake_at = at;
+  tcp_timer_wake_pending = 1;
+  msecs = (s32_t)(at - sys_now());
+  tcp_timer_wakeup((msecs > 0) ? (u32_t)msecs : 0);
+}
+
+static void
+tcp_timer_link(struct tcp_pcb **head, struct tcp_pcb *pcb)
+{
+  pcb->timer_next = *head;
+  if (*head != NULL) {
+    (*head)->timer_pprev = &pcb->timer_next;
+  }
+  *head = pcb;
+  pcb->timer_pprev = head;
+}
+
+static void
+tcp_timer_unlink(struct tcp_pcb *pcb)
+{
+  if (pcb->timer_pprev != NULL) {
+    *pcb->timer_pprev = pcb->timer_next;
+    if (pcb->timer_next != NULL) {
+      pcb->timer_next->timer_pprev = pcb->timer_pprev;
+    }
+    pcb->timer_next = NULL;
+    pcb->timer_pprev = NULL;
+    if (pcb->timer_flags & TCP_TIMER_F_NEAR) {
+      tcp_timer_near_num--;
+    }
+    pcb->timer_flags &= ~(TCP_TIMER_F_NEAR | TCP_TIMER_F_FAR);
+  }
+}
+
+static void
+tcp_timer_fast_link(struct tcp_pcb **head, struct tcp_pcb *pcb)
+{
+  pcb->fast_next = *head;
+  if (*head != NULL) {
+    (*head)->fast_pprev = &pcb->fast_next;
+  }
+  *head = pcb;
+  pcb->fast_pprev = head;
+}
+
+static void
+tcp_timer_fast_unlink(struct tcp_pcb *pcb)
+{
+  if (pcb->fast_pprev != NULL) {
+    *pcb->fast_pprev = pcb->fast_next;
+    if (pcb->fast_next != NULL) {
+      pcb->fast_next->fast_pprev = pcb->fast_pprev;
+    }
+    pcb->fast_next = NULL;
+    pcb->fast_pprev = NULL;
+  }
+}
+
+/** Puts a PCB into the wheel slot of pcb->timer_due, or the far list */
+static void
+tcp_timer_insert(struct tcp_pcb *pcb)
+{
+  if ((u32_t)(pcb->timer_due - tcp_timer_tick) < TCP_TIMER_WHEEL_SIZE) {
+    tcp_timer_link(&tcp_timer_wheel[pcb->timer_due & TCP_TIMER_WHEEL_MASK], pcb);
+    pcb->timer_flags |= TCP_TIMER_F_NEAR;
+    tcp_timer_near_num++;
+  } else {
+    if ((tcp_timer_far == NULL) || ((s32_t)(pcb->timer_due - tcp_timer_far_due) < 0)) {
+      tcp_timer_far_due = pcb->timer_due;
+    }
+    tcp_timer_link(&tcp_timer_far, pcb);
+    pcb->timer_flags |= TCP_TIMER_F_FAR;
+  }
+}
+
+/** Moves the PCBs of the far list which are now near into the wheel */
+static void
+tcp_timer_cascade(void)
+{
+  struct tcp_pcb *pcb = tcp_timer_far;
+  struct tcp_pcb *next;
+
+  tcp_timer_far = NULL;
+  for (; pcb != NULL; pcb = next) {
+    next = pcb->timer_next;
+    pcb->timer_pprev = NULL;
+    pcb->timer_flags &= ~TCP_TIMER_F_FAR;
+    if ((s32_t)(pcb->timer_due - tcp_timer_tick) < 0) {
+      pcb->timer_due = tcp_timer_tick;
+    }
+    tcp_timer_insert(pcb);
+  }
+}
+
+void
+tcp_timer_sync(struct tcp_pcb *pcb)
+{
+  tcp_timer_update_ticks();
+  if (pcb->timer_last != tcp_ticks) {
+    /* only the timers of active PCBs run */
+    if ((pcb->timer_flags & TCP_TIMER_F_REG) && (pcb->state != TIME_WAIT)) {
+      tcp_timer_advance(pcb, tcp_ticks - pcb->timer_last);
+    }
+    pcb->timer_last = tcp_ticks;
+  }
+}
+
+void
+tcp_timer_reg(struct tcp_pcb *pcb)
+{
+  tcp_timer_sync(pcb);
+  pcb->timer_flags |= TCP_TIMER_F_REG;
+  tcp_timer_arm(pcb);
+}
+
+void
+tcp_timer_rmv(struct tcp_pcb *pcb)
+{
+  tcp_timer_unlink(pcb);
+  tcp_timer_fast_unlink(pcb);
+  pcb->timer_flags = 0;
+}
+
+void
+tcp_timer_arm(struct tcp_pcb *pcb)
+{
+  u32_t d = TCP_TIMER_NONE;
+
+  if (!(pcb->timer_flags & TCP_TIMER_F_REG)) {
+    return;
+  }
+  tcp_timer_sync(pcb);
+  tcp_timer_unlink(pcb);
+
+  /* the first tick at which one of the checks of tcp_slowtmr_pcb succeeds */
+  if (pcb->state == TIME_WAIT) {
+    d = tcp_timer_ticks_until(pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+  } else {
+    if ((pcb->state == SYN_SENT && pcb->nrtx == TCP_SYNMAXRTX) || (pcb->nrtx == TCP_MAXRTX)) {
+      d = 1;
+    } else if (pcb->persist_backoff > 0) {
+      u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
+      d = (pcb->persist_cnt < backoff_cnt) ? (u32_t)(backoff_cnt - pcb->persist_cnt) : 1;
+    } else if ((pcb->unacked != NULL) && (pcb->rtime >= 0)) {
+      d = (pcb->rtime < pcb->rto) ? (u32_t)(pcb->rto - pcb->rtime) : 1;
+    }
+    if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr + TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL + 1));
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+       ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr +
+          (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL + 1));
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr +
+          (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb)) / TCP_SLOW_INTERVAL + 1));
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq != NULL) {
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr + pcb->rto * TCP_OOSEQ_TIMEOUT));
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+    if (pcb->state == SYN_RCVD) {
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr + TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL + 1));
+    }
+    if (pcb->state == LAST_ACK) {
+      d = LWIP_MIN(d, tcp_timer_ticks_until(pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1));
+    }
+    if (TCP_TIMER_POLL_NEEDED(pcb)) {
+      d = LWIP_MIN(d, (pcb->polltmr < pcb->pollinterval) ? (u32_t)(pcb->pollinterval - pcb->polltmr) : 1);
+    }
+
+    if ((pcb->fast_pprev == NULL) && ((pcb->flags & TF_ACK_DELAY) || (pcb->refused_data != NULL))) {
+      tcp_timer_fast_link(&tcp_timer_fast, pcb);
+      tcp_timer_wake(sys_now() + TCP_FAST_INTERVAL);
+    }
+  }
+
+  if (d != TCP_TIMER_NONE) {
+    if ((tcp_timer_near_num == 0) && (tcp_timer_far == NULL)) {
+      /* the wheel is empty, it can start again at tcp_ticks */
+      tcp_timer_tick = tcp_ticks;
+    }
+    pcb->timer_due = tcp_ticks + d;
+    tcp_timer_insert(pcb);
+    tcp_timer_wake(tcp_timer_tick_time(pcb->timer_due));
+  }
+}
+
+/**
+ * Called after SOF_KEEPALIVE or the keepalive times of a PCB have changed.
+ *
+ * @param pcb the tcp_pcb
+ */
+void
+tcp_keepalive_changed(struct tcp_pcb *pcb)
+{
+  if ((pcb->state != CLOSED) && (pcb->state != LISTEN)) {
+    tcp_timer_arm(pcb);
+  }
+}
+
+/** Runs the slow timers of a PCB taken from the wheel */
+static void
+tcp_timer_slow_pcb(struct tcp_pcb *pcb)
+{
+  u8_t pcb_reset = 0;
+  err_t err;
+
+  tcp_timer_sync(pcb);
+
+  if (pcb->state == TIME_WAIT) {
+    /* Check if this PCB has stayed long enough in TIME-WAIT */
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      tcp_pcb_purge(pcb);
+      TCP_RMV(&tcp_tw_pcbs, pcb);
+      memp_free(MEMP_TCP_PCB, pcb);
+    } else {
+      tcp_timer_arm(pcb);
+    }
+    return;
+  }
+
+  if (tcp_slowtmr_pcb(pcb, &pcb_reset)) {
+    tcp_err_fn err_fn;
+    void *err_arg;
+
+    tcp_pcb_purge(pcb);
+    TCP_RMV_ACTIVE(pcb);
+    if (pcb_reset) {
+      tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
+               pcb->local_port, pcb->remote_port);
+    }
+    err_fn = pcb->errf;
+    err_arg = pcb->callback_arg;
+    memp_free(MEMP_TCP_PCB, pcb);
+    TCP_EVENT_ERR(err_fn, err_arg, ERR_ABRT);
+    return;
+  }
+
+  /* We check if we should poll the connection. */
+  if (pcb->polltmr >= pcb->pollinterval) {
+    pcb->polltmr = 0;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
+    TCP_EVENT_POLL(pcb, err);
+    if (err == ERR_ABRT) {
+      /* 'pcb' is already deallocated */
+      return;
+    }
+    if (err == ERR_OK) {
+      tcp_output(pcb);
+    }
+  }
+  tcp_timer_arm(pcb);
+}
+
+/**
+ * Has tcp_tmr() called when the first timer in the wheel is due, or for the
+ * next fast timer tick if a PCB needs it. Not at all if nothing is due.
+ */
+static void
+tcp_timer_schedule(void)
+{
+  u32_t i;
+
+  if (tcp_timer_fast != NULL) {
+    tcp_timer_wake(sys_now() + TCP_FAST_INTERVAL);
+  }
+  if (tcp_timer_near_num > 0) {
+    for (i = 1; i < TCP_TIMER_WHEEL_SIZE; i++) {
+      if (tcp_timer_wheel[(tcp_timer_tick + i) & TCP_TIMER_WHEEL_MASK] != NULL) {
+        break;
+      }
+    }
+    tcp_timer_wake(tcp_timer_tick_time(tcp_timer_tick + i));
+  } else if (tcp_timer_far != NULL) {
+    tcp_timer_wake(tcp_timer_tick_time(tcp_timer_far_due));
+  }
+}
+
+/**
+ * Runs the slow timers of the PCBs in the timer wheel which are due, i.e.
+ * the slots of the ticks up to tcp_ticks. Active PCBs which have nothing
+ * due are not visited.
+ *
+ * Automatically called from tcp_tmr().
+ */
+void
+tcp_slowtmr(void)
+{
+  struct tcp_pcb *pcb;
+
+  tcp_timer_update_ticks();
+  while (tcp_timer_tick != tcp_ticks) {
+    if (tcp_timer_near_num == 0) {
+      /* skip empty slots up to where the far list has to be looked at */
+      u32_t skip = tcp_ticks;
+      if ((tcp_timer_far != NULL) &&
+          ((s32_t)(tcp_timer_far_due - TCP_TIMER_WHEEL_SIZE - skip) < 0)) {
+        skip = tcp_timer_far_due - TCP_TIMER_WHEEL_SIZE;
+      }
+      if ((s32_t)(skip - tcp_timer_tick) > 0) {
+        tcp_timer_tick = skip;
+        continue;
+      }
+    }
+    ++tcp_timer_tick;
+    if ((tcp_timer_far != NULL) &&
+        ((s32_t)(tcp_timer_far_due - tcp_timer_tick) < TCP_TIMER_WHEEL_SIZE)) {
+      tcp_timer_cascade();
+    }
+    while ((pcb = tcp_timer_wheel[tcp_timer_tick & TCP_TIMER_WHEEL_MASK]) != NULL) {
+      tcp_timer_unlink(pcb);
+      tcp_timer_slow_pcb(pcb);
+    }
+  }
+}
+
+/**
+ * Sends the delayed ACKs and passes refused data to the application for the
+ * PCBs which have put themselves into the fast list.
+ *
+ * Automatically called from tcp_tmr().
+ */
+void
+tcp_fasttmr(void)
+{
+  struct tcp_pcb *pending;
+  struct tcp_pcb *pcb;
+
+  /* take over the list: PCBs which need the next tick too put themselves
+     back into it */
+  pending = tcp_timer_fast;
+  tcp_timer_fast = NULL;
+  if (pending != NULL) {
+    pending->fast_pprev = &pending;
+  }
+
+  while ((pcb = pending) != NULL) {
+    tcp_timer_fast_unlink(pcb);
+    /* send delayed ACKs */
+    if (pcb->flags & TF_ACK_DELAY) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: delayed ACK\n"));
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+      pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
+    }
+
+    /* If there is data which was previously "refused" by upper layer */
+    if (pcb->refused_data != NULL) {
+      /* PCBs removed by the callback are also removed from 'pending' */
+      tcp_process_refused_data(pcb);
+    }
+  }
+}
+#else /* LWIP_TCP_TIMER_WHEEL */
+
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -837,7 +1568,6 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -866,138 +1596,9 @@ tcp_slowtmr_start:
     }
     pcb->last_timer = tcp_timer_ctr;
 
-    pcb_remove = 0;
     pcb_reset = 0;
-
-    if (pcb->state == SYN_SENT && pcb->nrtx == TCP_SYNMAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
-    }
-    else if (pcb->nrtx == TCP_MAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
-    } else {
-      if (pcb->persist_backoff > 0) {
-        
-        /* If snd_wnd is zero, use persist timer to send 1 byte probes
-         * instead of using the standard retransmission mechanism. */
-        u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
-
-        if (pcb->persist_cnt < backoff_cnt) {
-          pcb->persist_cnt++;
-        }
-        if (pcb->persist_cnt >= backoff_cnt) {
-          if (tcp_zero_window_probe(pcb) == ERR_OK) {
-            pcb->persist_cnt = 0;
-            if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
-              pcb->persist_backoff++;
-            }
-          }
-        }
-      } else {
-        /* Increase the retransmission timer if it is running */
-        if (pcb->rtime >= 0) {
-          ++pcb->rtime;
-        }
-
-        if (pcb->unacked != NULL && pcb->rtime >= pcb->rto) {
-          /* Time for a retransmission. */
-          LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
-                                      " pcb->rto %"S16_F"\n",
-                                      pcb->rtime, pcb->rto));
-
-          /* Double retransmission time-out unless we are trying to
-           * connect to somebody (i.e., we are in SYN_SENT). */
-          if (pcb->state != SYN_SENT) {
-              pcb->rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[pcb->nrtx];
-          }
-
-          /* Reset the retransmission timer. */
-          pcb->rtime = 0;
-
-          /* Reduce congestion window and ssthresh. */
-          eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-          pcb->ssthresh = eff_wnd >> 1;
-          if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-            pcb->ssthresh = (pcb->mss << 1);
-          }
-          pcb->cwnd = pcb->mss;
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                       " ssthresh %"TCPWNDSIZE_F"\n",
-                                       pcb->cwnd, pcb->ssthresh));
-
-          /* The following needs to be called AFTER cwnd is set to one
-             mss - STJ */
-          tcp_rexmit_rto(pcb);
-        }
-      }
-    }
-    /* Check if this PCB has stayed too long in FIN-WAIT-2 */
-    if (pcb->state == FIN_WAIT_2) {
-      /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
-      if (pcb->flags & TF_RXCLOSED) {
-        /* PCB was fully closed (either through close() or SHUT_RDWR):
-           normal FIN-WAIT timeout handling. */
-        if ((u32_t)(tcp_ticks - pcb->tmr) >
-            TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
-          ++pcb_remove;
-          LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
-        }
-      }
-    }
-
-    /* Check if KEEPALIVE should be sent */
-    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
-       ((pcb->state == ESTABLISHED) ||
-        (pcb->state == CLOSE_WAIT))) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-         (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL)
-      {
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
-        ip_addr_debug_print(TCP_DEBUG, &pcb->remote_ip);
-        LWIP_DEBUGF(TCP_DEBUG, ("\n"));
-
-        ++pcb_remove;
-        ++pcb_reset;
-      } else if ((u32_t)(tcp_ticks - pcb->tmr) >
-                (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
-                / TCP_SLOW_INTERVAL)
-      {
-        err = tcp_keepalive(pcb);
-        if (err == ERR_OK) {
-          pcb->keep_cnt_sent++;
-        }
-      }
-    }
-
-    /* If this PCB has queued out of sequence data, but has been
-       inactive for too long, will drop the data (it will eventually
-       be retransmitted). */
-#if TCP_QUEUE_OOSEQ
-    if (pcb->ooseq != NULL &&
-        (u32_t)tcp_ticks - pcb->tmr >= pcb->rto * TCP_OOSEQ_TIMEOUT) {
-      tcp_segs_free(pcb->ooseq);
-      pcb->ooseq = NULL;
-      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
-    }
-#endif /* TCP_QUEUE_OOSEQ */
-
-    /* Check if this PCB has stayed too long in SYN-RCVD */
-    if (pcb->state == SYN_RCVD) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
-      }
-    }
-
-    /* Check if this PCB has stayed too long in LAST-ACK */
-    if (pcb->state == LAST_ACK) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
-      }
-    }
+    tcp_timer_advance(pcb, 1);
+    pcb_remove = tcp_slowtmr_pcb(pcb, &pcb_reset);
 
     /* If the PCB should be removed, do it. */
     if (pcb_remove) {
@@ -1014,6 +1615,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_active_pcbs, pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1037,7 +1639,6 @@ tcp_slowtmr_start:
       pcb = pcb->next;
 
       /* We check if we should poll the connection. */
-      ++prev->polltmr;
       if (prev->polltmr >= prev->pollinterval) {
         prev->polltmr = 0;
         LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
@@ -1080,6 +1681,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_tw_pcbs, pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       memp_free(MEMP_TCP_PCB, pcb2);
@@ -1135,6 +1737,7 @@ tcp_fasttmr_start:
     }
   }
 }
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
 void
@@ -1203,6 +1806,8 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
       }
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
       pcb->refused_data = refused_data;
+      /* have tcp_fasttmr try again */
+      tcp_timer_arm(pcb);
       return ERR_INPROGRESS;
     }
   }
@@ -1563,9 +2168,13 @@ tcp_alloc(u8_t prio)
     pcb->snd_nxt = iss;
     pcb->lastack = iss;
     pcb->snd_lbb = iss;
+    tcp_timer_update_ticks();
     pcb->tmr = tcp_ticks;
     pcb->last_timer = tcp_timer_ctr;
     pcb->polltmr = 0;
+#if LWIP_TCP_TIMER_WHEEL
+    pcb->timer_last = tcp_ticks;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
@@ -1720,6 +2329,7 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+  tcp_timer_arm(pcb);
 }
 
 /**
@@ -65,6 +65,17 @@
 /** Initial slow start threshold value: we use the full window */
 #define LWIP_TCP_INITIAL_SSTHRESH(pcb)  ((pcb)->snd_wnd)
 
+/* The PCBs of a list which may match the incoming segment, linked through
+   TCP_INPUT_NEXT: the hash table bucket of the segment's addresses and ports
+   with LWIP_PCB_HASH, the whole list otherwise. */
+#if LWIP_PCB_HASH
+#define TCP_INPUT_PCBS(pcbs)  tcp_pcb_hash_bucket(pcbs, tcphdr->dest, ip_current_src_addr(), tcphdr->src)
+#define TCP_INPUT_NEXT(pcb)   ((pcb)->hash_next)
+#else /* LWIP_PCB_HASH */
+#define TCP_INPUT_PCBS(pcbs)  (pcbs)
+#define TCP_INPUT_NEXT(pcb)   ((pcb)->next)
+#endif /* LWIP_PCB_HASH */
+
 /* These variables are global to all functions involved in the input
    processing of TCP segments. They are set by the tcp_input()
    function. */
@@ -104,6 +115,7 @@ void
 tcp_input(struct pbuf *p, struct netif *inp)
 {
   struct tcp_pcb *pcb, *prev;
+  struct tcp_pcb **pcbs;
   struct tcp_pcb_listen *lpcb;
 #if SO_REUSE
   struct tcp_pcb *lpcb_prev = NULL;
@@ -119,6 +131,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
   TCP_STATS_INC(tcp.recv);
   MIB2_STATS_INC(mib2.tcpinsegs);
 
+  tcp_timer_update_ticks();
+
   tcphdr = (struct tcp_hdr *)p->payload;
 
 #if TCP_INPUT_DEBUG
@@ -213,7 +227,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
-  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+  pcbs = TCP_INPUT_PCBS(&tcp_active_pcbs);
+  for (pcb = *pcbs; pcb != NULL; pcb = TCP_INPUT_NEXT(pcb)) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
     LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
@@ -226,9 +241,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
          arrivals). */
       LWIP_ASSERT("tcp_input: pcb->next != pcb (before cache)", pcb->next != pcb);
       if (prev != NULL) {
-        prev->next = pcb->next;
-        pcb->next = tcp_active_pcbs;
-        tcp_active_pcbs = pcb;
+        TCP_INPUT_NEXT(prev) = TCP_INPUT_NEXT(pcb);
+        TCP_INPUT_NEXT(pcb) = *pcbs;
+        *pcbs = pcb;
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
@@ -241,7 +256,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
-    for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+    for (pcb = *TCP_INPUT_PCBS(&tcp_tw_pcbs); pcb != NULL; pcb = TCP_INPUT_NEXT(pcb)) {
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
       if (pcb->remote_port == tcphdr->src &&
           pcb->local_port == tcphdr->dest &&
@@ -260,7 +275,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
     prev = NULL;
-    for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+    pcbs = TCP_INPUT_PCBS(&tcp_listen_pcbs.pcbs);
+    for (lpcb = (struct tcp_pcb_listen *)*pcbs; lpcb != NULL; lpcb = TCP_INPUT_NEXT(lpcb)) {
       if (lpcb->local_port == tcphdr->dest) {
         if (IP_IS_ANY_TYPE_VAL(lpcb->local_ip)) {
           /* found an ANY TYPE (IPv4/IPv6) match */
@@ -300,11 +316,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
       if (prev != NULL) {
-        ((struct tcp_pcb_listen *)prev)->next = lpcb->next;
+        TCP_INPUT_NEXT((struct tcp_pcb_listen *)prev) = TCP_INPUT_NEXT(lpcb);
               /* our successor is the remainder of the listening list */
-        lpcb->next = tcp_listen_pcbs.listen_pcbs;
+        TCP_INPUT_NEXT(lpcb) = (struct tcp_pcb_listen *)*pcbs;
               /* put this listening pcb at the head of the listening list */
-        tcp_listen_pcbs.listen_pcbs = lpcb;
+        *pcbs = (struct tcp_pcb *)lpcb;
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
@@ -328,6 +344,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
 #if TCP_INPUT_DEBUG
     tcp_debug_print_state(pcb->state);
 #endif /* TCP_INPUT_DEBUG */
+    /* the segment restarts timers, count them up to now first */
+    tcp_timer_sync(pcb);
 
     /* Set up a tcp_seg structure. */
     inseg.next = NULL;
@@ -720,6 +720,8 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     TCPH_SET_FLAG(seg->tcphdr, TCP_PSH);
   }
 
+  /* poll retries sending the queued data */
+  tcp_timer_arm(pcb);
   return ERR_OK;
 memerr:
   pcb->flags |= TF_NAGLEMEMERR;
@@ -736,6 +738,7 @@ memerr:
       pcb->unsent != NULL);
   }
   LWIP_DEBUGF(TCP_QLEN_DEBUG | LWIP_DBG_STATE, ("tcp_write: %"S16_F" (with mem err)\n", pcb->snd_queuelen));
+  tcp_timer_arm(pcb);
   return ERR_MEM;
 }
 
@@ -856,6 +859,7 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       pcb->unacked != NULL || pcb->unsent != NULL);
   }
 
+  tcp_timer_arm(pcb);
   return ERR_OK;
 }
 
@@ -959,6 +963,30 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   return err;
 }
 
+#if LWIP_TCP_TIMER_WHEEL
+static err_t tcp_output_segments(struct tcp_pcb *pcb);
+
+/**
+ * Find out what we can send and send it, then arm the timers the pcb needs
+ * for what has been sent and what is left
+ *
+ * @param pcb Protocol control block for the TCP connection to send data
+ * @return ERR_OK if data has been sent or nothing to send
+ *         another err_t on error
+ */
+err_t
+tcp_output(struct tcp_pcb *pcb)
+{
+  err_t err;
+
+  /* the retransmission timer may be restarted, count it up to now first */
+  tcp_timer_sync(pcb);
+  err = tcp_output_segments(pcb);
+  tcp_timer_arm(pcb);
+  return err;
+}
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
 /**
  * Find out what we can send and send it
  *
@@ -966,8 +994,13 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
  * @return ERR_OK if data has been sent or nothing to send
  *         another err_t on error
  */
+#if LWIP_TCP_TIMER_WHEEL
+static err_t
+tcp_output_segments(struct tcp_pcb *pcb)
+#else /* LWIP_TCP_TIMER_WHEEL */
 err_t
 tcp_output(struct tcp_pcb *pcb)
+#endif /* LWIP_TCP_TIMER_WHEEL */
 {
   struct tcp_seg *seg, *useg;
   u32_t wnd, snd_nxt;
@@ -1137,6 +1170,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   u32_t *opts;
   struct netif *netif;
 
+  if (seg->p->ref != 1) {
+    /* The pbuf of this segment is still referenced by a netif driver which
+       sends without copying. The header must not be changed under it, the
+       segment is sent again when it is retransmitted. */
+    return ERR_OK;
+  }
+
   /** @bug Exclude retransmitted segments from this count. */
   MIB2_STATS_INC(mib2.tcpoutsegs);
 
@@ -84,6 +84,9 @@ tcpip_tcp_timer(void *arg)
 
   /* call TCP timer handler */
   tcp_tmr();
+#if LWIP_TCP_TIMER_WHEEL
+  /* tcp_tmr() has scheduled the next call through tcp_timer_wakeup() */
+#else /* LWIP_TCP_TIMER_WHEEL */
   /* timer still needed? */
   if (tcp_active_pcbs || tcp_tw_pcbs) {
     /* restart timer */
@@ -92,6 +95,7 @@ tcpip_tcp_timer(void *arg)
     /* disable timer */
     tcpip_tcp_timer_active = 0;
   }
+#endif /* LWIP_TCP_TIMER_WHEEL */
 }
 
 /**
@@ -109,6 +113,19 @@ tcp_timer_needed(void)
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   }
 }
+
+#if LWIP_TCP_TIMER_WHEEL
+/**
+ * Called by the TCP timer wheel: the next call to tcp_tmr() is due in msecs.
+ * Replaces the call scheduled before, if any.
+ */
+void
+tcp_timer_wakeup(u32_t msecs)
+{
+  sys_untimeout(tcpip_tcp_timer, NULL);
+  sys_timeout(msecs, tcpip_tcp_timer, NULL);
+}
+#endif /* LWIP_TCP_TIMER_WHEEL */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV4
@@ -600,4 +617,12 @@ void
 tcp_timer_needed(void)
 {
 }
+
+#if LWIP_TCP_TIMER_WHEEL
+void
+tcp_timer_wakeup(u32_t msecs)
+{
+  LWIP_UNUSED_ARG(msecs);
+}
+#endif /* LWIP_TCP_TIMER_WHEEL */
 #endif /* LWIP_TIMERS */
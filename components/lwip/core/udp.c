@@ -82,6 +82,45 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if LWIP_PCB_HASH
+/* Hash table of udp_pcbs keyed by local port, chained through hash_next */
+static struct udp_pcb *udp_pcb_hash[UDP_PCB_HASH_SIZE];
+
+/* The PCBs which may be bound to a local port, linked through UDP_PORT_NEXT */
+#define UDP_PORT_PCBS(port)   (&udp_pcb_hash[(port) & (UDP_PCB_HASH_SIZE - 1)])
+#define UDP_PORT_NEXT(pcb)    ((pcb)->hash_next)
+
+/* Adds a PCB which has just been put on udp_pcbs to the hash table */
+static void
+udp_pcb_hash_add(struct udp_pcb *pcb)
+{
+  struct udp_pcb **bucket = UDP_PORT_PCBS(pcb->local_port);
+
+  pcb->hash_next = *bucket;
+  *bucket = pcb;
+}
+
+/* Removes a PCB which is on udp_pcbs from the hash table */
+static void
+udp_pcb_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **bucket;
+
+  for (bucket = UDP_PORT_PCBS(pcb->local_port); *bucket != NULL; bucket = &(*bucket)->hash_next) {
+    if (*bucket == pcb) {
+      *bucket = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+#else /* LWIP_PCB_HASH */
+#define UDP_PORT_PCBS(port)   (&udp_pcbs)
+#define UDP_PORT_NEXT(pcb)    ((pcb)->next)
+#define udp_pcb_hash_add(pcb)
+#define udp_pcb_hash_remove(pcb)
+#endif /* LWIP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -109,7 +148,7 @@ again:
     udp_port = UDP_LOCAL_PORT_RANGE_START;
   }
   /* Check all PCBs. */
-  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  for (pcb = *UDP_PORT_PCBS(udp_port); pcb != NULL; pcb = UDP_PORT_NEXT(pcb)) {
     if (pcb->local_port == udp_port) {
       if (++n > (UDP_LOCAL_PORT_RANGE_END - UDP_LOCAL_PORT_RANGE_START)) {
         return 0;
@@ -215,6 +254,7 @@ udp_input(struct pbuf *p, struct netif *inp)
 {
   struct udp_hdr *udphdr;
   struct udp_pcb *pcb, *prev;
+  struct udp_pcb **pcbs;
   struct udp_pcb *uncon_pcb;
   u16_t src, dest;
   u8_t broadcast;
@@ -265,7 +305,8 @@ udp_input(struct pbuf *p, struct netif *inp)
    * 'Perfect match' pcbs (connected to the remote port & ip address) are
    * preferred. If no perfect match is found, the first unconnected pcb that
    * matches the local port and ip address gets the datagram. */
-  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  pcbs = UDP_PORT_PCBS(dest);
+  for (pcb = *pcbs; pcb != NULL; pcb = UDP_PORT_NEXT(pcb)) {
     /* print the PCB local and remote address */
     LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
     ip_addr_debug_print(UDP_DEBUG, &pcb->local_ip);
@@ -290,9 +331,9 @@ udp_input(struct pbuf *p, struct netif *inp)
         if (prev != NULL) {
           /* move the pcb to the front of udp_pcbs so that is
              found faster next time */
-          prev->next = pcb->next;
-          pcb->next = udp_pcbs;
-          udp_pcbs = pcb;
+          UDP_PORT_NEXT(prev) = UDP_PORT_NEXT(pcb);
+          UDP_PORT_NEXT(pcb) = *pcbs;
+          *pcbs = pcb;
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -379,7 +420,7 @@ udp_input(struct pbuf *p, struct netif *inp)
         struct udp_pcb *mpcb;
         u8_t p_header_changed = 0;
         s16_t hdrs_len = (s16_t)(ip_current_header_tot_len() + UDP_HLEN);
-        for (mpcb = udp_pcbs; mpcb != NULL; mpcb = mpcb->next) {
+        for (mpcb = *pcbs; mpcb != NULL; mpcb = UDP_PORT_NEXT(mpcb)) {
           if (mpcb != pcb) {
             /* compare PCB local addr+port to UDP destination addr+port */
             if ((mpcb->local_port == dest) &&
@@ -929,7 +970,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
       return ERR_USE;
     }
   } else {
-    for (ipcb = udp_pcbs; ipcb != NULL; ipcb = ipcb->next) {
+    for (ipcb = *UDP_PORT_PCBS(port); ipcb != NULL; ipcb = UDP_PORT_NEXT(ipcb)) {
       if (pcb != ipcb) {
       /* By default, we don't allow to bind to a port that any other udp
          PCB is already bound to, unless *all* PCBs with that port have tha
@@ -957,6 +998,10 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   ip_addr_set_ipaddr(&pcb->local_ip, ipaddr);
 
+  if (rebind) {
+    /* the port it is hashed by changes */
+    udp_pcb_hash_remove(pcb);
+  }
   pcb->local_port = port;
   mib2_udp_bind(pcb);
   /* pcb not active yet? */
@@ -965,6 +1010,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
   }
+  udp_pcb_hash_add(pcb);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("udp_bind: bound to "));
   ip_addr_debug_print(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, &pcb->local_ip);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, (", port %"U16_F")\n", pcb->local_port));
@@ -1023,6 +1069,7 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+  udp_pcb_hash_add(pcb);
   return ERR_OK;
 }
 
@@ -1076,6 +1123,7 @@ udp_remove(struct udp_pcb *pcb)
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
     udp_pcbs = udp_pcbs->next;
+    udp_pcb_hash_remove(pcb);
     /* pcb not 1st in list */
   } else {
     for (pcb2 = udp_pcbs; pcb2 != NULL; pcb2 = pcb2->next) {
@@ -1083,6 +1131,7 @@ udp_remove(struct udp_pcb *pcb)
       if (pcb2->next != NULL && pcb2->next == pcb) {
         /* remove pcb from list */
         pcb2->next = pcb->next;
+        udp_pcb_hash_remove(pcb);
         break;
       }
     }
@@ -70,6 +70,32 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
 
 #include "lwip/mem.h"
 
+#if MEMP_POOLED_MALLOC
+
+#define LWIP_MEMPOOL_DECLARE(name,num,size,desc) \
+  static u32_t memp_memory_ ## name ## _base \
+    [((num) * LWIP_MEM_ALIGN_SIZE(size) + sizeof(u32_t) - 1) / sizeof(u32_t)]; \
+    \
+  static struct memp_pool memp_pool_ ## name = { MEMP_POOL_END }; \
+    \
+  const struct memp_desc memp_ ## name = { \
+    LWIP_MEM_ALIGN_SIZE(size), \
+    (num), \
+    (desc), \
+    (u8_t *)memp_memory_ ## name ## _base, \
+    &memp_pool_ ## name \
+  };
+
+#define LWIP_MEMPOOL_INIT(name)    memp_init_pool(&memp_ ## name)
+#define LWIP_MEMPOOL_ALLOC(name)   memp_malloc_pool(&memp_ ## name)
+#define LWIP_MEMPOOL_FREE(name, x) memp_free_pool(&memp_ ## name, (x))
+
+void  memp_init(void);
+void *memp_malloc(memp_t type);
+void  memp_free(memp_t type, void *mem);
+
+#else /* MEMP_POOLED_MALLOC */
+
 #define memp_init()
 #if ESP_CNT_DEBUG
 static inline void* memp_malloc(int type)
@@ -100,6 +126,8 @@ static inline void memp_free(int type, void *mem)
 #define LWIP_MEMPOOL_ALLOC(name)   mem_malloc(memp_ ## name.size)
 #define LWIP_MEMPOOL_FREE(name, x) mem_free(x)
 
+#endif /* MEMP_POOLED_MALLOC */
+
 #else /* MEMP_MEM_MALLOC */
 
 #define LWIP_MEMPOOL_DECLARE(name,num,size,desc) u8_t memp_memory_ ## name ## _base \
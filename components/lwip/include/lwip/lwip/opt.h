@@ -125,6 +125,16 @@
 #define MEMP_MEM_MALLOC                 0
 #endif
 
+/**
+ * MEMP_POOLED_MALLOC==1: With MEMP_MEM_MALLOC, take elements from fixed-size
+ * pools with lock-free free lists first and use mem_malloc only when a pool is
+ * empty. The pools are sized by the MEMP_NUM_* options. Requires
+ * sys_arch_cas32() from the port.
+ */
+#ifndef MEMP_POOLED_MALLOC
+#define MEMP_POOLED_MALLOC              0
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> #define MEM_ALIGNMENT 4
@@ -962,6 +972,14 @@
 #define LWIP_NETBUF_RECVINFO            0
 #endif
 
+/**
+ * UDP_PCB_HASH_SIZE: With LWIP_PCB_HASH, the number of buckets (a power of 2)
+ * in the table of bound UDP PCBs, which is keyed by local port.
+ */
+#ifndef UDP_PCB_HASH_SIZE
+#define UDP_PCB_HASH_SIZE               16
+#endif
+
 /*
    ---------------------------------
    ---------- TCP options ----------
@@ -1101,6 +1119,51 @@
 #define TCP_DEFAULT_LISTEN_BACKLOG      0xff
 #endif
 
+/**
+ * LWIP_PCB_HASH==1: Find the PCB of each incoming TCP segment and UDP datagram
+ * in a hash table instead of walking the PCB lists. Connected and TIME-WAIT
+ * TCP PCBs are keyed by their address and ports, listening TCP PCBs and UDP
+ * PCBs by their local port. The PCB lists are kept for the timers.
+ */
+#ifndef LWIP_PCB_HASH
+#define LWIP_PCB_HASH                   0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: With LWIP_PCB_HASH, the number of buckets (a power of 2)
+ * in each of the tables of connected and TIME-WAIT TCP PCBs.
+ */
+#ifndef TCP_PCB_HASH_SIZE
+#define TCP_PCB_HASH_SIZE               64
+#endif
+
+/**
+ * TCP_LISTEN_PCB_HASH_SIZE: With LWIP_PCB_HASH, the number of buckets (a
+ * power of 2) in the table of listening TCP PCBs.
+ */
+#ifndef TCP_LISTEN_PCB_HASH_SIZE
+#define TCP_LISTEN_PCB_HASH_SIZE        16
+#endif
+
+/**
+ * LWIP_TCP_TIMER_WHEEL==1: Instead of visiting every active PCB each time
+ * tcp_slowtmr() and tcp_fasttmr() run, keep each PCB in a timer wheel slot
+ * for the next tick one of its timers is due, and have the TCP timer
+ * scheduled only when something is due. tcp_ticks then follows sys_now().
+ */
+#ifndef LWIP_TCP_TIMER_WHEEL
+#define LWIP_TCP_TIMER_WHEEL            0
+#endif
+
+/**
+ * TCP_TIMER_WHEEL_SIZE: With LWIP_TCP_TIMER_WHEEL, the number of slots (a
+ * power of 2) in the timer wheel, one per slow timer tick. PCBs due further
+ * ahead are kept in a list which is only looked at when its first PCB nears.
+ */
+#ifndef TCP_TIMER_WHEEL_SIZE
+#define TCP_TIMER_WHEEL_SIZE            64
+#endif
+
 /**
  * TCP_OVERSIZE: The maximum number of bytes that tcp_write may
  * allocate ahead of time in an attempt to create shorter pbuf chains
@@ -1371,6 +1434,16 @@
 #define TCPIP_MBOX_SIZE                 0
 #endif
 
+/**
+ * TCPIP_MSG_BATCH_MAX: The maximum number of messages tcpip_thread handles
+ * after it wakes up, before it checks the timeouts again. Messages after the
+ * first one are taken with sys_arch_mbox_tryfetch(), and with
+ * LWIP_TCPIP_CORE_LOCKING, the core stays locked for the whole batch.
+ */
+#ifndef TCPIP_MSG_BATCH_MAX
+#define TCPIP_MSG_BATCH_MAX             1
+#endif
+
 /**
  * SLIPIF_THREAD_NAME: The name assigned to the slipif_loop thread.
  */
@@ -1567,6 +1640,24 @@
 #define LWIP_SOCKET_OFFSET              0
 #endif
 
+/**
+ * LWIP_SOCKET_EPOLL==1: Enable lwip_epoll_create(), lwip_epoll_ctl() and
+ * lwip_epoll_wait(). Each socket keeps a list of the epoll instances (and
+ * select calls) watching it, so an event only visits those and only ready
+ * sockets are looked at when waiting.
+ */
+#ifndef LWIP_SOCKET_EPOLL
+#define LWIP_SOCKET_EPOLL               0
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL_MAX: With LWIP_SOCKET_EPOLL, the number of epoll instances
+ * which can be open at the same time.
+ */
+#ifndef LWIP_SOCKET_EPOLL_MAX
+#define LWIP_SOCKET_EPOLL_MAX           2
+#endif
+
 /**
  * LWIP_TCP_KEEPALIVE==1: Enable TCP_KEEPIDLE, TCP_KEEPINTVL and TCP_KEEPCNT
  * options processing. Note that TCP_KEEPIDLE and TCP_KEEPINTVL have to be set
@@ -119,10 +119,41 @@ typedef enum {
 #define MEMP_POOL_LAST   ((memp_t) MEMP_POOL_HELPER_LAST)
 #endif /* MEM_USE_POOLS */
 
+#if MEMP_POOLED_MALLOC
+/** Index of the list end in a pool free list */
+#define MEMP_POOL_END   0xffff
+
+/** State of a pool of the pooled backend (MEMP_POOLED_MALLOC) */
+struct memp_pool {
+  /** Index of the first free element in the low half, change counter in the high half */
+  volatile u32_t head;
+  /** Most elements ever allocated from the pool at once */
+  volatile u32_t max;
+  /** Allocations taken from the heap because the pool was empty */
+  volatile u32_t fallback;
+  /** Allocations which failed */
+  volatile u32_t err;
+};
+#endif /* MEMP_POOLED_MALLOC */
+
 struct memp_desc {
   /** Element size */
   u16_t size;
 
+#if MEMP_POOLED_MALLOC
+  /** Number of elements in the pool */
+  u16_t num;
+
+  /** Textual description */
+  const char *desc;
+
+  /** Base */
+  u8_t *base;
+
+  /** Free list and counters */
+  struct memp_pool *pool;
+#endif /* MEMP_POOLED_MALLOC */
+
 #if !MEMP_MEM_MALLOC
   /** Number of elements */
   u16_t num;
@@ -364,6 +364,53 @@ extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. *
 #define NUM_TCP_PCB_LISTS               4
 extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
+#if LWIP_PCB_HASH
+/* Hash tables of the PCBs in tcp_active_pcbs, tcp_tw_pcbs and tcp_listen_pcbs,
+   kept in sync with the lists by TCP_REG and TCP_RMV. The buckets are chained
+   through hash_next. */
+struct tcp_pcb **tcp_pcb_hash_bucket(struct tcp_pcb **pcbs, u16_t local_port,
+                                     const ip_addr_t *remote_ip, u16_t remote_port);
+void tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+#define TCP_HASH_REG(pcbs, npcb) tcp_pcb_hash_add(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb) tcp_pcb_hash_remove(pcbs, npcb)
+#else /* LWIP_PCB_HASH */
+#define TCP_HASH_REG(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb)
+#endif /* LWIP_PCB_HASH */
+
+#if LWIP_TCP_TIMER_WHEEL
+/* The PCBs in tcp_active_pcbs and tcp_tw_pcbs are kept in the timer wheel
+   from TCP_REG to TCP_RMV. tcp_timer_arm puts a PCB into the slot of the next
+   tick one of its timers is due, and is called whenever something has made
+   a timer of the PCB due earlier. tcp_timer_sync brings rtime, persist_cnt
+   and polltmr up to tcp_ticks before they are looked at or changed. */
+void tcp_timer_reg(struct tcp_pcb *pcb);
+void tcp_timer_rmv(struct tcp_pcb *pcb);
+void tcp_timer_arm(struct tcp_pcb *pcb);
+void tcp_timer_sync(struct tcp_pcb *pcb);
+void tcp_timer_update_ticks(void);
+/* When the next call to tcp_tmr() is due (sys_now() based), if one is */
+extern u32_t tcp_timer_wake_at;
+extern u8_t tcp_timer_wake_pending;
+#define TCP_TIMER_REG(pcbs, npcb) do { \
+    if (((pcbs) == &tcp_active_pcbs) || ((pcbs) == &tcp_tw_pcbs)) { \
+      tcp_timer_reg(npcb); \
+    } \
+  } while (0)
+#define TCP_TIMER_RMV(pcbs, npcb) do { \
+    if (((pcbs) == &tcp_active_pcbs) || ((pcbs) == &tcp_tw_pcbs)) { \
+      tcp_timer_rmv(npcb); \
+    } \
+  } while (0)
+#else /* LWIP_TCP_TIMER_WHEEL */
+#define TCP_TIMER_REG(pcbs, npcb) tcp_timer_needed()
+#define TCP_TIMER_RMV(pcbs, npcb)
+#define tcp_timer_arm(pcb)
+#define tcp_timer_sync(pcb)
+#define tcp_timer_update_ticks()
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
 /* Axioms about the above lists:
    1) Every TCP PCB that is not CLOSED is in one of the lists.
    2) A PCB is only in one of the lists.
@@ -388,8 +435,9 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_HASH_REG(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
-              tcp_timer_needed(); \
+                            TCP_TIMER_REG(pcbs, npcb); \
                             } while(0)
 #define TCP_RMV(pcbs, npcb) do { \
                             struct tcp_pcb *tcp_tmp_pcb; \
@@ -404,6 +452,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_HASH_RMV(pcbs, npcb); \
+                            TCP_TIMER_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (npcb), *(pcbs))); \
                             } while(0)
@@ -414,7 +464,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
-    tcp_timer_needed();                            \
+    TCP_HASH_REG(pcbs, npcb);                      \
+    TCP_TIMER_REG(pcbs, npcb);                     \
   } while (0)
 
 #define TCP_RMV(pcbs, npcb)                        \
@@ -434,6 +485,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_HASH_RMV(pcbs, npcb);                      \
+    TCP_TIMER_RMV(pcbs, npcb);                     \
   } while(0)
 
 #endif /* LWIP_DEBUG */
@@ -531,6 +584,11 @@ s16_t tcp_pcbs_sane(void);
 /** External function (implemented in timers.c), called when TCP detects
  * that a timer is needed (i.e. active- or time-wait-pcb found). */
 void tcp_timer_needed(void);
+#if LWIP_TCP_TIMER_WHEEL
+/** External function (implemented in timers.c), called by the timer wheel to
+ * have tcp_tmr() called in msecs instead of every TCP_TMR_INTERVAL. */
+void tcp_timer_wakeup(u32_t msecs);
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 #if LWIP_IPV4
 void tcp_netif_ipv4_addr_changed(const ip4_addr_t* old_addr, const ip4_addr_t* new_addr);
@@ -441,6 +441,32 @@ struct timeval {
 };
 #endif /* LWIP_TIMEVAL_PRIVATE */
 
+#if LWIP_SOCKET_EPOLL
+/* Events and operations for lwip_epoll_ctl/lwip_epoll_wait */
+#ifndef EPOLLIN
+#define EPOLLIN       0x001
+#define EPOLLOUT      0x004
+#define EPOLLERR      0x008
+#define EPOLLONESHOT  (1U << 30)
+#define EPOLLET       (1U << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data {
+  void  *ptr;
+  int    fd;
+  u32_t  u32;
+} epoll_data_t;
+
+struct epoll_event {
+  u32_t        events;
+  epoll_data_t data;
+};
+#endif /* EPOLLIN */
+#endif /* LWIP_SOCKET_EPOLL */
+
 #define lwip_socket_init() /* Compatibility define, no init needed. */
 void lwip_socket_thread_init(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: initialize thread-local semaphore */
 void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destroy thread-local semaphore */
@@ -467,6 +493,11 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #define lwip_socket       socket
 #define lwip_select       select
 #define lwip_ioctlsocket  ioctl
+#if LWIP_SOCKET_EPOLL
+#define lwip_epoll_create epoll_create
+#define lwip_epoll_ctl    epoll_ctl
+#define lwip_epoll_wait   epoll_wait
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define lwip_read         read
@@ -505,6 +536,11 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
                 struct timeval *timeout);
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
+#if LWIP_SOCKET_EPOLL
+int lwip_epoll_create(int size);
+int lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_COMPAT_SOCKETS
 #if LWIP_COMPAT_SOCKETS != 2
@@ -555,6 +591,11 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl_r(s,cmd,argp)
+#if LWIP_SOCKET_EPOLL
+#define epoll_create(size)                        lwip_epoll_create(size)
+#define epoll_ctl(epfd,op,fd,event)               lwip_epoll_ctl(epfd,op,fd,event)
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define read(s,mem,len)                           lwip_read_r(s,mem,len)
@@ -585,6 +626,11 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
+#if LWIP_SOCKET_EPOLL
+#define epoll_create(size)                        lwip_epoll_create(size)
+#define epoll_ctl(epfd,op,fd,event)               lwip_epoll_ctl(epfd,op,fd,event)
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define read(s,mem,len)                           lwip_read(s,mem,len)
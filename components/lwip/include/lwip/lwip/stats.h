@@ -306,6 +306,20 @@ void stats_init(void);
 #define STATS_INC_USED(x)
 #endif /* LWIP_STATS */
 
+#if MEMP_POOLED_MALLOC
+/* Usage of a pool of the pooled memp backend, kept independently of LWIP_STATS */
+struct stats_memp_pool {
+  const char *name;
+  u16_t num;        /* elements in the pool */
+  u16_t max;        /* most elements allocated from the pool at once */
+  u32_t fallback;   /* allocations taken from the heap because the pool was empty */
+  u32_t err;        /* allocations which failed */
+};
+
+void stats_memp_pool_get(memp_t type, struct stats_memp_pool *pool);
+void stats_display_memp_pools(void);
+#endif /* MEMP_POOLED_MALLOC */
+
 #if TCP_STATS
 #define TCP_STATS_INC(x) STATS_INC(x)
 #define TCP_STATS_DISPLAY() stats_display_proto(&lwip_stats.tcp, "TCP")
@@ -168,11 +168,18 @@ enum tcp_state {
 #define DEF_ACCEPT_CALLBACK
 #endif /* LWIP_CALLBACK_API */
 
+#if LWIP_PCB_HASH
+#define DEF_HASH_NEXT(type)  type *hash_next; /* for the hash table bucket */
+#else /* LWIP_PCB_HASH */
+#define DEF_HASH_NEXT(type)
+#endif /* LWIP_PCB_HASH */
+
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  DEF_HASH_NEXT(type) \
   void *callback_arg; \
   /* the accept callback for listen- and normal pcbs, if LWIP_CALLBACK_API */ \
   DEF_ACCEPT_CALLBACK \
@@ -212,6 +219,15 @@ struct tcp_pcb {
   u8_t polltmr, pollinterval;
   u8_t last_timer;
   u32_t tmr;
+#if LWIP_TCP_TIMER_WHEEL
+  /* timer wheel slot, or list of PCBs due later, the PCB is kept in */
+  struct tcp_pcb *timer_next, **timer_pprev;
+  /* list of PCBs with a delayed ACK or refused data */
+  struct tcp_pcb *fast_next, **fast_pprev;
+  u32_t timer_due;  /* tick at which the PCB is due in the wheel */
+  u32_t timer_last; /* tick up to which rtime, persist_cnt and polltmr count */
+  u8_t timer_flags;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
@@ -401,6 +417,13 @@ void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
 
 err_t            tcp_output  (struct tcp_pcb *pcb);
 
+#if LWIP_TCP_TIMER_WHEEL
+/* To be called after SOF_KEEPALIVE or the keepalive times of a pcb have changed */
+void             tcp_keepalive_changed(struct tcp_pcb *pcb);
+#else /* LWIP_TCP_TIMER_WHEEL */
+#define          tcp_keepalive_changed(pcb)
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
 
 const char* tcp_debug_state_str(enum tcp_state s);
 
@@ -67,6 +67,15 @@ typedef struct sys_mbox_s {
 #define sys_sem_valid( x ) ( ( ( *x ) == NULL) ? pdFALSE : pdTRUE )
 #define sys_sem_set_invalid( x ) ( ( *x ) = NULL )
 
+/* Set *addr to desired if it is equal to expected, atomically across both cores.
+   Returns nonzero if *addr was set. */
+static inline int sys_arch_cas32(volatile uint32_t *addr, uint32_t expected, uint32_t desired)
+{
+    uint32_t set = desired;
+    uxPortCompareSet(addr, expected, &set);
+    return set == expected;
+}
+
 void sys_arch_assert(const char *file, int line);
 uint32_t system_get_time(void);
 void sys_delay_ms(uint32_t ms);
@@ -86,6 +86,18 @@
 */
 #define MEMP_MEM_MALLOC                 1
 
+/**
+ * MEMP_POOLED_MALLOC==1: Take pbufs, TCP segments, PCBs and the other memp
+ * elements from fixed-size pools first and from the heap only when a pool
+ * is empty.
+ */
+#if CONFIG_LWIP_MEMP_POOLS
+#define MEMP_POOLED_MALLOC              1
+#define MEMP_NUM_PBUF                   CONFIG_LWIP_MEMP_NUM_PBUF
+#define MEMP_NUM_TCP_SEG                CONFIG_LWIP_MEMP_NUM_TCP_SEG
+#define PBUF_POOL_SIZE                  CONFIG_LWIP_PBUF_POOL_SIZE
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> #define MEM_ALIGNMENT 4
@@ -115,7 +127,7 @@
  * MEMP_NUM_TCP_PCB: the number of simulatenously active TCP connections.
  * (requires the LWIP_TCP option)
  */
-#define MEMP_NUM_TCP_PCB                16
+#define MEMP_NUM_TCP_PCB                CONFIG_LWIP_MAX_ACTIVE_TCP
 
 /**
  * MEMP_NUM_TCP_PCB_LISTEN: the number of listening TCP connections.
@@ -130,6 +142,18 @@
  */
 #define MEMP_NUM_UDP_PCB                16
 
+/**
+ * LWIP_PCB_HASH==1: Find the PCBs of incoming TCP segments and UDP datagrams
+ * in hash tables instead of walking the PCB lists.
+ */
+#define LWIP_PCB_HASH                   CONFIG_LWIP_PCB_HASH
+
+/**
+ * LWIP_TCP_TIMER_WHEEL==1: Run the TCP timers of a PCB only when one of them
+ * is due, and wake up the tcpip thread only then.
+ */
+#define LWIP_TCP_TIMER_WHEEL            CONFIG_LWIP_TCP_TIMER_WHEEL
+
 /*
    --------------------------------
    ---------- ARP options -------
@@ -325,6 +349,12 @@
  */
 #define LWIP_NETIF_TX_SINGLE_PBUF             1
 
+/**
+ * LWIP_SUPPORT_CUSTOM_PBUF==1: the ethernet netif wraps frames received by the
+ * emac dma in custom pbufs, which give the dma buffer back when freed.
+ */
+#define LWIP_SUPPORT_CUSTOM_PBUF              1
+
 /*
    ------------------------------------
    ---------- LOOPIF options ----------
@@ -379,7 +409,14 @@
  * The queue size value itself is platform-dependent, but is passed to
  * sys_mbox_new() when tcpip_init is called.
  */
-#define TCPIP_MBOX_SIZE                 32
+#define TCPIP_MBOX_SIZE                 CONFIG_TCPIP_RECVMBOX_SIZE
+
+/**
+ * TCPIP_MSG_BATCH_MAX: The maximum number of messages tcpip_thread handles
+ * each time it wakes up. Up to a full mailbox, so that a burst of received
+ * packets is handled in one go.
+ */
+#define TCPIP_MSG_BATCH_MAX             TCPIP_MBOX_SIZE
 
 /**
  * DEFAULT_UDP_RECVMBOX_SIZE: The mailbox size for the incoming packets on a
@@ -408,10 +445,11 @@
    ----------------------------------------------
 */
 /**
- * LWIP_TCPIP_CORE_LOCKING: (EXPERIMENTAL!)
- * Don't use it if you're not an active lwIP project member
+ * LWIP_TCPIP_CORE_LOCKING==1: Run API calls in the calling thread, under a
+ * mutex which protects the core, instead of sending them to tcpip_thread.
+ * This option is set via menuconfig.
  */
-#define LWIP_TCPIP_CORE_LOCKING         0
+#define LWIP_TCPIP_CORE_LOCKING         CONFIG_LWIP_TCPIP_CORE_LOCKING
 
 /*
    ------------------------------------
@@ -448,6 +486,12 @@
  */
 #define SO_REUSE                        CONFIG_LWIP_SO_REUSE
 
+/**
+ * LWIP_SOCKET_EPOLL==1: Enable lwip_epoll_create/ctl/wait.
+ * This option is set via menuconfig.
+ */
+#define LWIP_SOCKET_EPOLL               CONFIG_LWIP_EPOLL
+
 #if CONFIG_MDNS
 /**
  * SO_REUSE_RXTOALL==1: Pass a copy of incoming broadcast/multicast packets
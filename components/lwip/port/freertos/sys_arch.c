@@ -47,6 +47,14 @@ static BaseType_t g_lwip_critical_section_needs_taskswitch;
 
 #if !LWIP_COMPAT_MUTEX
 /** Create a new mutex
+ *
+ * This is also the core lock with LWIP_TCPIP_CORE_LOCKING. A FreeRTOS mutex
+ * has priority inheritance, so a low priority task which holds the core lock
+ * runs at the priority of the tcpip thread (or another task) waiting for it.
+ * It is not recursive: lwIP never takes the core lock while holding it, and
+ * api_msg.c releases it once to block, which would not free a lock taken
+ * twice.
+ *
  * @param mutex pointer to the mutex to create
  * @return a new mutex */
 err_t
@@ -45,6 +45,7 @@
 #include "lwip/snmp.h"
 #include "lwip/ethip6.h"
 #include "netif/etharp.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -55,6 +56,25 @@
 #define IFNAME0 'e'
 #define IFNAME1 'n'
 
+/* A pbuf chain with more pbufs is copied into one pbuf before it is sent */
+#define ETHERNETIF_TX_SEG_MAX 4
+
+#if (ESP_L2_TO_L3_COPY == 0)
+#if CONFIG_ETHERNET && CONFIG_DMA_RX_LEND_BUF_NUM
+#define ETHERNETIF_RX_PBUF_NUM CONFIG_DMA_RX_LEND_BUF_NUM
+#else
+#define ETHERNETIF_RX_PBUF_NUM 1
+#endif
+
+/* A received frame which stays in the emac rx buf it was received in */
+struct ethernetif_rx_pbuf {
+  struct pbuf_custom p;
+  void *eb;
+};
+
+LWIP_MEMPOOL_DECLARE(ETH_RX_PBUF, ETHERNETIF_RX_PBUF_NUM, sizeof(struct ethernetif_rx_pbuf), "ETH_RX_PBUF")
+#endif
+
 static char hostname[16];
 #if ESP_PERF
 uint32_t g_rx_alloc_pbuf_fail_cnt = 0;
@@ -106,6 +126,14 @@ ethernet_low_level_init(struct netif *netif)
  *       to become availale since the stack doesn't retry to send a packet
  *       dropped because of memory failure (except for the TCP timers).
  */
+#if ESP_LWIP
+static void
+ethernet_low_level_output_done(void *arg)
+{
+  pbuf_free((struct pbuf *)arg);
+}
+#endif
+
 static err_t
 ethernet_low_level_output(struct netif *netif, struct pbuf *p)
 {
@@ -118,24 +146,37 @@ ethernet_low_level_output(struct netif *netif, struct pbuf *p)
   } 
   
 #if ESP_LWIP
-    q = p;
-    u16_t pbuf_x_len = 0;
-    pbuf_x_len = q->len;
-    if(q->next !=NULL)
-    {
-        //char cnt = 0;
-        struct pbuf *tmp = q->next;
-        while(tmp != NULL)
-        {
-            memcpy( (u8_t *)( (u8_t *)(q->payload) + pbuf_x_len), (u8_t *)tmp->payload , tmp->len );
-            pbuf_x_len += tmp->len;
-            //cnt++;
-            tmp = tmp->next;
+    eth_tx_seg_t segs[ETHERNETIF_TX_SEG_MAX];
+    int count = 0;
+    err_t ret;
+
+    for (q = p; q != NULL && count < ETHERNETIF_TX_SEG_MAX; q = q->next) {
+        segs[count].buf = q->payload;
+        segs[count].len = q->len;
+        count++;
+    }
+
+    if (q != NULL) {
+        LWIP_DEBUGF(PBUF_DEBUG, ("ethernet_low_level_output: long pbuf chain, copy it\n"));
+        q = pbuf_alloc(PBUF_RAW_TX, p->tot_len, PBUF_RAM);
+        if (q == NULL) {
+            return ERR_MEM;
         }
+        pbuf_copy(q, p);
+        segs[0].buf = q->payload;
+        segs[0].len = q->len;
+        count = 1;
+    } else {
+        q = p;
+        pbuf_ref(q);
+    }
+
+    /* the emac sends the pbufs without copying, q is freed when it is done */
+    ret = esp_eth_tx_sg(segs, count, ethernet_low_level_output_done, q);
+    if (ret != ERR_OK) {
+        pbuf_free(q);
     }
-   
-    //printf("netif=%p pbuf=%p len=%d\n", netif, p, p->len); 
-    return esp_eth_tx(q->payload, pbuf_x_len);
+    return ret;
 #else
     for(q = p; q != NULL; q = q->next) {
         return esp_emac_tx(q->payload, q->len);
@@ -144,6 +185,32 @@ ethernet_low_level_output(struct netif *netif, struct pbuf *p)
 #endif
 }
 
+#if (ESP_L2_TO_L3_COPY == 0)
+static void
+ethernetif_free_rx_pbuf(struct pbuf *p)
+{
+  struct ethernetif_rx_pbuf *rx_pbuf = (struct ethernetif_rx_pbuf *)p;
+
+  esp_eth_free_rx_buf(rx_pbuf->eb);
+  LWIP_MEMPOOL_FREE(ETH_RX_PBUF, rx_pbuf);
+}
+
+/* Wraps a frame lent by the emac in a pbuf which gives it back when freed */
+static struct pbuf *
+ethernetif_alloc_rx_pbuf(void *buffer, u16_t len, void *eb)
+{
+  struct ethernetif_rx_pbuf *rx_pbuf;
+
+  rx_pbuf = (struct ethernetif_rx_pbuf *)LWIP_MEMPOOL_ALLOC(ETH_RX_PBUF);
+  if (rx_pbuf == NULL) {
+    return NULL;
+  }
+  rx_pbuf->p.custom_free_function = ethernetif_free_rx_pbuf;
+  rx_pbuf->eb = eb;
+  return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx_pbuf->p, buffer, len);
+}
+#endif
+
 /**
  * This function should be called when a packet is ready to be read
  * from the interface. It uses the function low_level_input() that
@@ -152,21 +219,37 @@ ethernet_low_level_output(struct netif *netif, struct pbuf *p)
  * the appropriate input function is called.
  *
  * @param netif the lwip network interface structure for this ethernetif
+ * @param buffer the received frame
+ * @param len length of the frame
+ * @param eb set if the emac lends the frame, it is given back with
+ *        esp_eth_free_rx_buf. NULL if the frame must be copied.
  */
 void
-ethernetif_input(struct netif *netif, void *buffer, uint16_t len)
+ethernetif_input(struct netif *netif, void *buffer, u16_t len, void *eb)
 {
-  struct pbuf *p;
+  struct pbuf *p = NULL;
   
   if(buffer== NULL || netif == NULL)
     	goto _exit;
 
-  p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+#if (ESP_L2_TO_L3_COPY == 0)
+  if (eb != NULL) {
+    p = ethernetif_alloc_rx_pbuf(buffer, len, eb);
+    if (p != NULL) {
+      /* given back when p is freed */
+      eb = NULL;
+    }
+  }
+#endif
+
   if (p == NULL) {
-    //g_rx_alloc_pbuf_fail_cnt++;
-    return;
+    p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+    if (p == NULL) {
+      //g_rx_alloc_pbuf_fail_cnt++;
+      goto _exit;
+    }
+    memcpy(p->payload, buffer, len);
   }
-  memcpy(p->payload, buffer, len);
 
   /* full packet send to tcpip_thread to process */
   if (netif->input(p, netif) != ERR_OK) {
@@ -175,7 +258,10 @@ ethernetif_input(struct netif *netif, void *buffer, uint16_t len)
   }
   
 _exit:
-;	  
+  if (eb != NULL) {
+    /* the frame is copied or dropped */
+    esp_eth_free_rx_buf(eb);
+  }
 }
 
 /**
@@ -195,6 +281,15 @@ ethernetif_init(struct netif *netif)
 {
   LWIP_ASSERT("netif != NULL", (netif != NULL));
 
+#if (ESP_L2_TO_L3_COPY == 0)
+  static bool rx_pbuf_pool_init = false;
+
+  if (!rx_pbuf_pool_init) {
+    LWIP_MEMPOOL_INIT(ETH_RX_PBUF);
+    rx_pbuf_pool_init = true;
+  }
+#endif
+
 #if LWIP_NETIF_HOSTNAME
   /* Initialize interface hostname */
 
@@ -0,0 +1,42 @@
+/* POSIX thread based system abstraction for host build of LWIP core */
+#ifndef __SYS_ARCH_H__
+#define __SYS_ARCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_sem* sys_sem_t;
+typedef struct host_mutex* sys_mutex_t;
+typedef struct host_thread* sys_thread_t;
+typedef struct host_mbox* sys_mbox_t;
+
+#define LWIP_COMPAT_MUTEX 0
+
+#define sys_mutex_valid( x ) ( ( *x ) != NULL )
+#define sys_mutex_set_invalid( x ) ( ( *x ) = NULL )
+#define sys_mbox_valid( x ) ( ( *x ) != NULL )
+#define sys_mbox_set_invalid( x ) ( ( *x ) = NULL )
+#define sys_sem_valid( x ) ( ( *x ) != NULL )
+#define sys_sem_set_invalid( x ) ( ( *x ) = NULL )
+
+static inline int sys_arch_cas32(volatile uint32_t *addr, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(addr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void sys_arch_assert(const char *file, int line);
+uint32_t system_get_time(void);
+void sys_delay_ms(uint32_t ms);
+sys_sem_t* sys_thread_sem_init(void);
+void sys_thread_sem_deinit(void);
+sys_sem_t* sys_thread_sem_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYS_ARCH_H__ */
@@ -0,0 +1,7 @@
+/* Host build of LWIP core: WiFi driver functions used by pbuf.c */
+#ifndef __ESP_WIFI_INTERNAL_H__
+#define __ESP_WIFI_INTERNAL_H__
+
+void esp_wifi_internal_free_rx_buffer(void* buffer);
+
+#endif /* __ESP_WIFI_INTERNAL_H__ */
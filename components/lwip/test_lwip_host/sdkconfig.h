@@ -0,0 +1,22 @@
+/* Configuration used for host build of LWIP core */
+#define CONFIG_LWIP_MAX_SOCKETS 16
+#define CONFIG_LWIP_THREAD_LOCAL_STORAGE_INDEX 0
+#define CONFIG_LWIP_DHCP_MAX_NTP_SERVERS 1
+#define CONFIG_LWIP_MEMP_POOLS 1
+#define CONFIG_LWIP_MEMP_NUM_PBUF 16
+#define CONFIG_LWIP_MEMP_NUM_TCP_SEG 16
+#define CONFIG_LWIP_PBUF_POOL_SIZE 0
+#define CONFIG_LWIP_MAX_ACTIVE_TCP 300
+#define CONFIG_LWIP_PCB_HASH 1
+#define CONFIG_LWIP_EPOLL 1
+/* the Makefile also builds the tests without the timer wheel */
+#ifndef CONFIG_LWIP_TCP_TIMER_WHEEL
+#define CONFIG_LWIP_TCP_TIMER_WHEEL 1
+#endif
+/* the Makefile also builds the socket tests without core locking */
+#ifndef CONFIG_LWIP_TCPIP_CORE_LOCKING
+#define CONFIG_LWIP_TCPIP_CORE_LOCKING 1
+#endif
+#define CONFIG_TCPIP_RECVMBOX_SIZE 32
+#define CONFIG_MAIN_TASK_STACK_SIZE 4096
+#define configMAX_PRIORITIES 25
@@ -0,0 +1,396 @@
+/* POSIX thread based implementation of the LWIP system abstraction, for host build of LWIP core */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/err.h"
+
+struct host_mutex {
+    pthread_mutex_t lock;
+};
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+struct host_mbox {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int size;
+    int head;
+    int count;
+    void** msgs;
+};
+
+struct host_thread {
+    pthread_t thread;
+    lwip_thread_fn func;
+    void* arg;
+};
+
+static pthread_mutex_t s_protect_lock;
+static pthread_once_t s_protect_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_thread_sem_key;
+static pthread_once_t s_thread_sem_once = PTHREAD_ONCE_INIT;
+
+static u32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void get_deadline(u32_t timeout_ms, struct timespec* deadline)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/* Wait on cond; timeout 0 waits forever. Returns 0 if the timeout has passed. */
+static int wait_cond(pthread_cond_t* cond, pthread_mutex_t* lock, u32_t timeout, const struct timespec* deadline)
+{
+    if (timeout == 0) {
+        pthread_cond_wait(cond, lock);
+        return 1;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+err_t sys_mutex_new(sys_mutex_t *mutex)
+{
+    *mutex = (sys_mutex_t) malloc(sizeof(**mutex));
+    if (*mutex == NULL) {
+        return ERR_MEM;
+    }
+    /* like on the target, the mutex is not recursive: fail if taken twice */
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+    pthread_mutex_init(&(*mutex)->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return ERR_OK;
+}
+
+void sys_mutex_lock(sys_mutex_t *mutex)
+{
+    if (pthread_mutex_lock(&(*mutex)->lock) != 0) {
+        sys_arch_assert(__FILE__, __LINE__);
+    }
+}
+
+void sys_mutex_unlock(sys_mutex_t *mutex)
+{
+    pthread_mutex_unlock(&(*mutex)->lock);
+}
+
+void sys_mutex_free(sys_mutex_t *mutex)
+{
+    pthread_mutex_destroy(&(*mutex)->lock);
+    free(*mutex);
+}
+
+err_t sys_sem_new(sys_sem_t *sem, u8_t count)
+{
+    *sem = (sys_sem_t) malloc(sizeof(**sem));
+    if (*sem == NULL) {
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&(*sem)->lock, NULL);
+    pthread_cond_init(&(*sem)->cond, NULL);
+    (*sem)->count = count;
+    return ERR_OK;
+}
+
+void sys_sem_signal(sys_sem_t *sem)
+{
+    pthread_mutex_lock(&(*sem)->lock);
+    (*sem)->count = 1;
+    pthread_cond_signal(&(*sem)->cond);
+    pthread_mutex_unlock(&(*sem)->lock);
+}
+
+u32_t sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
+{
+    struct timespec deadline;
+    u32_t start = now_ms();
+    get_deadline(timeout, &deadline);
+    pthread_mutex_lock(&(*sem)->lock);
+    while ((*sem)->count == 0) {
+        if (!wait_cond(&(*sem)->cond, &(*sem)->lock, timeout, &deadline)) {
+            pthread_mutex_unlock(&(*sem)->lock);
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    (*sem)->count = 0;
+    pthread_mutex_unlock(&(*sem)->lock);
+    return now_ms() - start;
+}
+
+void sys_sem_free(sys_sem_t *sem)
+{
+    pthread_mutex_destroy(&(*sem)->lock);
+    pthread_cond_destroy(&(*sem)->cond);
+    free(*sem);
+}
+
+err_t sys_mbox_new(sys_mbox_t *mbox, int size)
+{
+    *mbox = (sys_mbox_t) calloc(1, sizeof(**mbox));
+    if (*mbox == NULL) {
+        return ERR_MEM;
+    }
+    (*mbox)->msgs = (void**) malloc(size * sizeof(void*));
+    if ((*mbox)->msgs == NULL) {
+        free(*mbox);
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&(*mbox)->lock, NULL);
+    pthread_cond_init(&(*mbox)->not_empty, NULL);
+    pthread_cond_init(&(*mbox)->not_full, NULL);
+    (*mbox)->size = size;
+    return ERR_OK;
+}
+
+static void mbox_put(sys_mbox_t mbox, void *msg)
+{
+    mbox->msgs[(mbox->head + mbox->count) % mbox->size] = msg;
+    mbox->count++;
+    pthread_cond_signal(&mbox->not_empty);
+}
+
+void sys_mbox_post(sys_mbox_t *mbox, void *msg)
+{
+    pthread_mutex_lock(&(*mbox)->lock);
+    while ((*mbox)->count == (*mbox)->size) {
+        pthread_cond_wait(&(*mbox)->not_full, &(*mbox)->lock);
+    }
+    mbox_put(*mbox, msg);
+    pthread_mutex_unlock(&(*mbox)->lock);
+}
+
+err_t sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
+{
+    err_t err = ERR_MEM;
+    pthread_mutex_lock(&(*mbox)->lock);
+    if ((*mbox)->count < (*mbox)->size) {
+        mbox_put(*mbox, msg);
+        err = ERR_OK;
+    }
+    pthread_mutex_unlock(&(*mbox)->lock);
+    return err;
+}
+
+static void* mbox_get(sys_mbox_t mbox)
+{
+    void* msg = mbox->msgs[mbox->head];
+    mbox->head = (mbox->head + 1) % mbox->size;
+    mbox->count--;
+    pthread_cond_signal(&mbox->not_full);
+    return msg;
+}
+
+u32_t sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
+{
+    struct timespec deadline;
+    u32_t start = now_ms();
+    void* m;
+    get_deadline(timeout, &deadline);
+    pthread_mutex_lock(&(*mbox)->lock);
+    while ((*mbox)->count == 0) {
+        if (!wait_cond(&(*mbox)->not_empty, &(*mbox)->lock, timeout, &deadline)) {
+            pthread_mutex_unlock(&(*mbox)->lock);
+            if (msg) {
+                *msg = NULL;
+            }
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    m = mbox_get(*mbox);
+    pthread_mutex_unlock(&(*mbox)->lock);
+    if (msg) {
+        *msg = m;
+    }
+    return now_ms() - start;
+}
+
+u32_t sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
+{
+    void* m;
+    pthread_mutex_lock(&(*mbox)->lock);
+    if ((*mbox)->count == 0) {
+        pthread_mutex_unlock(&(*mbox)->lock);
+        return SYS_MBOX_EMPTY;
+    }
+    m = mbox_get(*mbox);
+    pthread_mutex_unlock(&(*mbox)->lock);
+    if (msg) {
+        *msg = m;
+    }
+    return 0;
+}
+
+void sys_mbox_free(sys_mbox_t *mbox)
+{
+    pthread_mutex_destroy(&(*mbox)->lock);
+    pthread_cond_destroy(&(*mbox)->not_empty);
+    pthread_cond_destroy(&(*mbox)->not_full);
+    free((*mbox)->msgs);
+    free(*mbox);
+    *mbox = NULL;
+}
+
+static void* thread_start(void* arg)
+{
+    sys_thread_t thread = (sys_thread_t) arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+sys_thread_t sys_thread_new(const char *name, lwip_thread_fn function, void *arg, int stacksize, int prio)
+{
+    sys_thread_t thread = (sys_thread_t) calloc(1, sizeof(*thread));
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->func = function;
+    thread->arg = arg;
+    if (pthread_create(&thread->thread, NULL, &thread_start, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    pthread_detach(thread->thread);
+    return thread;
+}
+
+void sys_init(void)
+{
+}
+
+/* Tests which need to control time stop the clock sys_now() reads */
+static int s_clock_stopped;
+static u32_t s_clock;
+
+u32_t sys_now(void)
+{
+    return s_clock_stopped ? s_clock : now_ms();
+}
+
+/* Moves the clock sys_now() reads on by msecs. The first call stops it at
+   the current time, from then on it only moves on through this function. */
+void sys_now_advance(u32_t msecs)
+{
+    if (!s_clock_stopped) {
+        s_clock = now_ms();
+        s_clock_stopped = 1;
+    }
+    s_clock += msecs;
+}
+
+uint32_t system_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+void sys_delay_ms(uint32_t ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+static void protect_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_protect_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+sys_prot_t sys_arch_protect(void)
+{
+    pthread_once(&s_protect_once, &protect_init);
+    pthread_mutex_lock(&s_protect_lock);
+    return 1;
+}
+
+void sys_arch_unprotect(sys_prot_t pval)
+{
+    (void) pval;
+    pthread_mutex_unlock(&s_protect_lock);
+}
+
+void sys_arch_assert(const char *file, int line)
+{
+    printf("\nAssertion: %d in %s\n", line, file);
+    abort();
+}
+
+static void thread_sem_free(void* data)
+{
+    sys_sem_t* sem = (sys_sem_t*) data;
+    sys_sem_free(sem);
+    free(sem);
+}
+
+static void thread_sem_key_init(void)
+{
+    pthread_key_create(&s_thread_sem_key, &thread_sem_free);
+}
+
+sys_sem_t* sys_thread_sem_init(void)
+{
+    sys_sem_t* sem = (sys_sem_t*) malloc(sizeof(sys_sem_t));
+    if (sem == NULL) {
+        return NULL;
+    }
+    if (sys_sem_new(sem, 0) != ERR_OK) {
+        free(sem);
+        return NULL;
+    }
+    pthread_once(&s_thread_sem_once, &thread_sem_key_init);
+    pthread_setspecific(s_thread_sem_key, sem);
+    return sem;
+}
+
+void sys_thread_sem_deinit(void)
+{
+    sys_sem_t* sem = (sys_sem_t*) pthread_getspecific(s_thread_sem_key);
+    if (sem != NULL) {
+        thread_sem_free(sem);
+        pthread_setspecific(s_thread_sem_key, NULL);
+    }
+}
+
+sys_sem_t* sys_thread_sem_get(void)
+{
+    sys_sem_t* sem;
+    pthread_once(&s_thread_sem_once, &thread_sem_key_init);
+    sem = (sys_sem_t*) pthread_getspecific(s_thread_sem_key);
+    if (sem == NULL) {
+        sem = sys_thread_sem_init();
+    }
+    return sem;
+}
+
+void esp_wifi_internal_free_rx_buffer(void* buffer)
+{
+    free(buffer);
+}
+
+/* DHCP server is not part of the host build */
+void dhcps_coarse_tmr(void)
+{
+}
@@ -0,0 +1,251 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "test_socket_util.h"
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+static void sendDatagram(int from, u16_t port)
+{
+    struct sockaddr_in addr;
+    localAddr(&addr, port);
+    REQUIRE(lwip_sendto_r(from, "x", 1, 0, (struct sockaddr*) &addr, sizeof(addr)) == 1);
+}
+
+static void receiveDatagram(int s)
+{
+    char buf[4];
+    REQUIRE(lwip_recv_r(s, buf, sizeof(buf), MSG_DONTWAIT) == 1);
+}
+
+static void watch(int ep, int s, u32_t events)
+{
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = s;
+    REQUIRE(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, s, &ev) == 0);
+}
+
+TEST_CASE("level-triggered epoll reports a socket until its data is read", "[epoll]")
+{
+    startTcpip();
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    int sender = udpSocket(5000);
+    int a = udpSocket(5001);
+    int b = udpSocket(5002);
+    watch(ep, a, EPOLLIN);
+    watch(ep, b, EPOLLIN);
+
+    struct epoll_event events[4];
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+    sendDatagram(sender, 5002);
+    REQUIRE(lwip_epoll_wait(ep, events, 4, 1000) == 1);
+    CHECK(events[0].data.fd == b);
+    CHECK(events[0].events == EPOLLIN);
+    /* still there */
+    REQUIRE(lwip_epoll_wait(ep, events, 4, 0) == 1);
+    CHECK(events[0].data.fd == b);
+    receiveDatagram(b);
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+
+    CHECK(lwip_close_r(ep) == 0);
+    lwip_close_r(sender);
+    lwip_close_r(a);
+    lwip_close_r(b);
+}
+
+TEST_CASE("edge-triggered epoll reports each datagram once", "[epoll]")
+{
+    startTcpip();
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    int sender = udpSocket(5000);
+    int a = udpSocket(5001);
+    watch(ep, a, EPOLLIN | EPOLLET);
+
+    struct epoll_event events[4];
+    sendDatagram(sender, 5001);
+    REQUIRE(lwip_epoll_wait(ep, events, 4, 1000) == 1);
+    CHECK(events[0].data.fd == a);
+    /* not read, but no new datagram */
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+    sendDatagram(sender, 5001);
+    CHECK(lwip_epoll_wait(ep, events, 4, 1000) == 1);
+    receiveDatagram(a);
+    receiveDatagram(a);
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+
+    lwip_close_r(ep);
+    lwip_close_r(sender);
+    lwip_close_r(a);
+}
+
+TEST_CASE("EPOLLONESHOT reports a socket once until it is modified", "[epoll]")
+{
+    startTcpip();
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    int a = udpSocket(5001);
+    /* UDP sockets can always send */
+    watch(ep, a, EPOLLOUT | EPOLLONESHOT);
+
+    struct epoll_event events[4];
+    REQUIRE(lwip_epoll_wait(ep, events, 4, 0) == 1);
+    CHECK(events[0].events == EPOLLOUT);
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.u32 = 42;
+    REQUIRE(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, a, &ev) == 0);
+    REQUIRE(lwip_epoll_wait(ep, events, 4, 0) == 1);
+    CHECK(events[0].data.u32 == 42);
+
+    lwip_close_r(ep);
+    lwip_close_r(a);
+}
+
+TEST_CASE("epoll_wait sleeps until a datagram arrives or the timeout", "[epoll]")
+{
+    startTcpip();
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    int sender = udpSocket(5000);
+    int a = udpSocket(5001);
+    watch(ep, a, EPOLLIN);
+
+    struct epoll_event events[4];
+    auto start = std::chrono::steady_clock::now();
+    CHECK(lwip_epoll_wait(ep, events, 4, 50) == 0);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(45));
+
+    std::thread t([sender]() {
+        lwip_socket_thread_init();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        sendDatagram(sender, 5001);
+        lwip_socket_thread_cleanup();
+    });
+    CHECK(lwip_epoll_wait(ep, events, 4, -1) == 1);
+    t.join();
+    receiveDatagram(a);
+
+    lwip_close_r(ep);
+    lwip_close_r(sender);
+    lwip_close_r(a);
+}
+
+TEST_CASE("epoll_ctl checks its arguments, close removes sockets", "[epoll]")
+{
+    startTcpip();
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    int a = udpSocket(5001);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = a;
+
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, a, &ev) == -1);
+    CHECK(errno == ENOENT);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == 0);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == -1);
+    CHECK(errno == EEXIST);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, a, NULL) == 0);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, a, NULL) == -1);
+    CHECK(errno == ENOENT);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, ep, &ev) == -1);
+    CHECK(errno == EBADF);
+
+    /* a closed socket is gone from the epoll instance, even if its number is reused */
+    ev.events = EPOLLOUT;
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == 0);
+    lwip_close_r(a);
+    struct epoll_event events[4];
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+    a = udpSocket(5001);
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == 0);
+    CHECK(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == 0);
+
+    CHECK(lwip_close_r(ep) == 0);
+    CHECK(lwip_epoll_wait(ep, events, 4, 0) == -1);
+    CHECK(errno == EBADF);
+    lwip_close_r(a);
+}
+
+TEST_CASE("select works on top of the socket watchers", "[epoll][select]")
+{
+    startTcpip();
+    int sender = udpSocket(5000);
+    int a = udpSocket(5001);
+    int b = udpSocket(5002);
+    fd_set readset;
+    struct timeval tv = { 0, 50000 };
+
+    FD_ZERO(&readset);
+    FD_SET(a, &readset);
+    FD_SET(b, &readset);
+    CHECK(lwip_select(b + 1, &readset, NULL, NULL, &tv) == 0);
+
+    std::thread t([sender]() {
+        lwip_socket_thread_init();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        sendDatagram(sender, 5002);
+        lwip_socket_thread_cleanup();
+    });
+    FD_ZERO(&readset);
+    FD_SET(a, &readset);
+    FD_SET(b, &readset);
+    CHECK(lwip_select(b + 1, &readset, NULL, NULL, NULL) == 1);
+    CHECK(!FD_ISSET(a, &readset));
+    CHECK(FD_ISSET(b, &readset));
+    t.join();
+    receiveDatagram(b);
+
+    lwip_close_r(sender);
+    lwip_close_r(a);
+    lwip_close_r(b);
+}
+
+TEST_CASE("benchmark select and epoll with one ready socket", "[epoll][bench]")
+{
+    startTcpip();
+    /* as many as the UDP PCB pool allows next to DNS */
+    const int count = 14;
+    int sockets[count];
+    int ep = lwip_epoll_create(1);
+    REQUIRE(ep >= 0);
+    for (int i = 0; i < count; ++i) {
+        sockets[i] = udpSocket(6000 + i);
+        watch(ep, sockets[i], EPOLLIN);
+    }
+    sendDatagram(sockets[0], 6000 + count - 1);
+    struct epoll_event events[count];
+    REQUIRE(lwip_epoll_wait(ep, events, count, 1000) == 1);
+
+    const int rounds = 100000;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        fd_set readset;
+        FD_ZERO(&readset);
+        for (int i = 0; i < count; ++i) {
+            FD_SET(sockets[i], &readset);
+        }
+        struct timeval tv = { 0, 0 };
+        lwip_select(sockets[count - 1] + 1, &readset, NULL, NULL, &tv);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        lwip_epoll_wait(ep, events, count, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("%d sockets, 1 ready: select %6.1f ns, epoll_wait %6.1f ns per call\n", count,
+           std::chrono::duration<double, std::nano>(middle - start).count() / rounds,
+           std::chrono::duration<double, std::nano>(end - middle).count() / rounds);
+
+    lwip_close_r(ep);
+    for (int i = 0; i < count; ++i) {
+        lwip_close_r(sockets[i]);
+    }
+}
@@ -0,0 +1,215 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/priv/tcp_priv.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+static struct stats_memp_pool getPoolStats(memp_t type)
+{
+    struct stats_memp_pool pool;
+    stats_memp_pool_get(type, &pool);
+    return pool;
+}
+
+TEST_CASE("pool elements are allocated before heap memory", "[memp]")
+{
+    memp_init();
+    const int num = memp_pools[MEMP_TCP_SEG]->num;
+    REQUIRE(num == CONFIG_LWIP_MEMP_NUM_TCP_SEG);
+
+    std::vector<void*> segs;
+    for (int i = 0; i < num; ++i) {
+        void* seg = memp_malloc(MEMP_TCP_SEG);
+        REQUIRE(seg != nullptr);
+        CHECK(std::find(segs.begin(), segs.end(), seg) == segs.end());
+        segs.push_back(seg);
+    }
+    auto pool = getPoolStats(MEMP_TCP_SEG);
+    CHECK(pool.max == num);
+    CHECK(pool.fallback == 0);
+
+    void* extra = memp_malloc(MEMP_TCP_SEG);
+    REQUIRE(extra != nullptr);
+    pool = getPoolStats(MEMP_TCP_SEG);
+    CHECK(pool.fallback == 1);
+    memp_free(MEMP_TCP_SEG, extra);
+
+    for (void* seg : segs) {
+        memp_free(MEMP_TCP_SEG, seg);
+    }
+
+    /* freed elements are used again, the high-water mark stays */
+    void* seg = memp_malloc(MEMP_TCP_SEG);
+    CHECK(std::find(segs.begin(), segs.end(), seg) != segs.end());
+    memp_free(MEMP_TCP_SEG, seg);
+    pool = getPoolStats(MEMP_TCP_SEG);
+    CHECK(pool.max == num);
+    CHECK(pool.fallback == 1);
+}
+
+TEST_CASE("high-water mark counts elements in use at the same time", "[memp]")
+{
+    memp_init();
+    for (int i = 0; i < 10; ++i) {
+        void* a = memp_malloc(MEMP_PBUF);
+        void* b = memp_malloc(MEMP_PBUF);
+        memp_free(MEMP_PBUF, a);
+        memp_free(MEMP_PBUF, b);
+    }
+    CHECK(getPoolStats(MEMP_PBUF).max == 2);
+    void* a = memp_malloc(MEMP_PBUF);
+    void* b = memp_malloc(MEMP_PBUF);
+    void* c = memp_malloc(MEMP_PBUF);
+    CHECK(getPoolStats(MEMP_PBUF).max == 3);
+    memp_free(MEMP_PBUF, a);
+    memp_free(MEMP_PBUF, b);
+    memp_free(MEMP_PBUF, c);
+}
+
+TEST_CASE("pools without elements use the heap", "[memp]")
+{
+    memp_init();
+    REQUIRE(memp_pools[MEMP_PBUF_POOL]->num == 0);
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, 100, PBUF_POOL);
+    REQUIRE(p != nullptr);
+    memset(p->payload, 0xab, 100);
+    pbuf_free(p);
+    auto pool = getPoolStats(MEMP_PBUF_POOL);
+    CHECK(pool.max == 0);
+    CHECK(pool.fallback == 1);
+}
+
+TEST_CASE("pbufs and segments allocated by several threads are not shared", "[memp]")
+{
+    memp_init();
+    const int THREADS = 4;
+    const int ITERATIONS = 100000;
+    const memp_t types[] = { MEMP_PBUF, MEMP_TCP_SEG, MEMP_TCP_PCB };
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<std::pair<memp_t, uint32_t*>> held;
+            uint32_t seed = t + 1;
+            for (int i = 0; i < ITERATIONS; ++i) {
+                seed = seed * 1103515245 + 12345;
+                if (held.size() < 8 && (seed >> 16) % 3 != 0) {
+                    memp_t type = types[(seed >> 8) % 3];
+                    uint32_t* mem = static_cast<uint32_t*>(memp_malloc(type));
+                    mem[0] = t;
+                    mem[1] = i;
+                    held.emplace_back(type, mem);
+                } else if (!held.empty()) {
+                    auto item = held.back();
+                    held.pop_back();
+                    if (item.second[0] != (uint32_t) t) {
+                        ++errors;
+                    }
+                    memp_free(item.first, item.second);
+                }
+            }
+            for (auto& item : held) {
+                memp_free(item.first, item.second);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK(errors == 0);
+    /* all pool elements are back in the free lists */
+    for (memp_t type : types) {
+        auto pool = getPoolStats(type);
+        CHECK(pool.max <= pool.num);
+        CHECK(pool.err == 0);
+        std::vector<void*> mem;
+        for (int i = 0; i < pool.num; ++i) {
+            mem.push_back(memp_malloc(type));
+        }
+        CHECK(getPoolStats(type).fallback == pool.fallback);
+        for (void* m : mem) {
+            memp_free(type, m);
+        }
+    }
+}
+
+/* Allocations made for one received and one sent TCP packet: a PBUF_REF
+   header for the driver buffer, a segment and a header pbuf for the data */
+static const memp_t s_packet_allocs[] = { MEMP_PBUF, MEMP_TCP_SEG, MEMP_PBUF };
+static const int PACKET_ALLOCS = sizeof(s_packet_allocs) / sizeof(s_packet_allocs[0]);
+/* Packets which are queued at the same time */
+static const int IN_FLIGHT = 4;
+
+template<typename Alloc, typename Free>
+static double runBenchmark(int threads, Alloc alloc, Free free)
+{
+    const int PACKETS = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            void* mem[IN_FLIGHT][PACKET_ALLOCS] = {};
+            for (int i = 0; i < PACKETS; ++i) {
+                void** packet = mem[i % IN_FLIGHT];
+                if (packet[0] != nullptr) {
+                    for (int j = 0; j < PACKET_ALLOCS; ++j) {
+                        free(s_packet_allocs[j], packet[j]);
+                    }
+                }
+                for (int j = 0; j < PACKET_ALLOCS; ++j) {
+                    packet[j] = alloc(s_packet_allocs[j]);
+                }
+            }
+            for (int i = 0; i < IN_FLIGHT; ++i) {
+                for (int j = 0; j < PACKET_ALLOCS; ++j) {
+                    free(s_packet_allocs[j], mem[i][j]);
+                }
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return threads * PACKETS / elapsed;
+}
+
+TEST_CASE("benchmark allocations per packet", "[memp][bench]")
+{
+    memp_init();
+    auto poolAlloc = [](memp_t type) { return memp_malloc(type); };
+    auto poolFree = [](memp_t type, void* mem) { memp_free(type, mem); };
+    /* what memp_malloc and memp_free do without MEMP_POOLED_MALLOC */
+    auto heapAlloc = [](memp_t type) { return mem_malloc(memp_pools[type]->size); };
+    auto heapFree = [](memp_t type, void* mem) { mem_free(mem); };
+    /* the host heap has per-thread caches; the ESP32 heap has one lock */
+    static std::mutex heapLock;
+    auto lockedHeapAlloc = [](memp_t type) {
+        std::lock_guard<std::mutex> lock(heapLock);
+        return mem_malloc(memp_pools[type]->size);
+    };
+    auto lockedHeapFree = [](memp_t type, void* mem) {
+        std::lock_guard<std::mutex> lock(heapLock);
+        mem_free(mem);
+    };
+
+    printf("%d allocations per packet, %d packets in flight\n", PACKET_ALLOCS, IN_FLIGHT);
+    for (int threads : { 1, 4 }) {
+        printf("%d thread(s), heap: %.0f packets/s\n", threads, runBenchmark(threads, heapAlloc, heapFree));
+        printf("%d thread(s), heap with one lock: %.0f packets/s\n", threads, runBenchmark(threads, lockedHeapAlloc, lockedHeapFree));
+        printf("%d thread(s), pools: %.0f packets/s\n", threads, runBenchmark(threads, poolAlloc, poolFree));
+    }
+    auto pool = getPoolStats(MEMP_PBUF);
+    CHECK(pool.max >= IN_FLIGHT * 2);
+    printf("PBUF pool: %d elements, high-water mark %d, %u taken from the heap\n",
+           pool.num, pool.max, (unsigned) pool.fallback);
+}
@@ -0,0 +1,307 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/ip.h"
+#include "lwip/ip4.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "test_tcp_util.h"
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstring>
+
+#if LWIP_PCB_HASH
+
+/* Every PCB on the list is in the bucket the input path looks it up in */
+static bool hashMatchesList(struct tcp_pcb** pcbs)
+{
+    for (struct tcp_pcb* pcb = *pcbs; pcb != NULL; pcb = pcb->next) {
+        u16_t remote_port = (pcbs == &tcp_listen_pcbs.pcbs) ? 0 : pcb->remote_port;
+        struct tcp_pcb* it = *tcp_pcb_hash_bucket(pcbs, pcb->local_port, &pcb->remote_ip, remote_port);
+        while (it != NULL && it != pcb) {
+            it = it->hash_next;
+        }
+        if (it == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("segments reach the connection they belong to", "[pcb_hash]")
+{
+    setupNetif();
+    /* several remote ports on one host and one remote port on several hosts */
+    std::vector<Connection> conns(64);
+    for (int i = 0; i < 64; ++i) {
+        openConnection(conns[i], i % 8, 40000 + i / 8);
+    }
+    CHECK(hashMatchesList(&tcp_active_pcbs));
+
+    std::mt19937 rng(1);
+    std::vector<int> order;
+    for (int round = 0; round < 4; ++round) {
+        for (int i = 0; i < 64; ++i) {
+            order.push_back(i);
+        }
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+    for (int i : order) {
+        sendData(conns[i], i + 1);
+    }
+    for (int i = 0; i < 64; ++i) {
+        CHECK(conns[i].received == 4 * (i + 1));
+    }
+    /* move-to-front in the buckets leaves the list alone */
+    CHECK(hashMatchesList(&tcp_active_pcbs));
+
+    /* removing connections takes them out of their buckets */
+    for (int i = 0; i < 64; i += 2) {
+        tcp_abort(conns[i].pcb);
+    }
+    CHECK(hashMatchesList(&tcp_active_pcbs));
+    for (int i = 1; i < 64; i += 2) {
+        sendData(conns[i], 1);
+        CHECK(conns[i].received == 4 * (i + 1) + 1);
+        tcp_abort(conns[i].pcb);
+    }
+    CHECK(tcp_active_pcbs == nullptr);
+}
+
+TEST_CASE("closed connections are found in TIME-WAIT", "[pcb_hash]")
+{
+    setupNetif();
+    std::vector<Connection> conns(16);
+    for (int i = 0; i < 16; ++i) {
+        openConnection(conns[i], i, 50000);
+    }
+    Connection& c = conns[5];
+    REQUIRE(tcp_close(c.pcb) == ERR_OK);
+    REQUIRE(c.pcb->state == FIN_WAIT_1);
+    /* the peer acknowledges our FIN and sends its own */
+    Segment fin = { c.host, c.port, 80, c.rcv_seq, c.pcb->snd_nxt, TCP_ACK | TCP_FIN, 0 };
+    ip4_input(makeSegment(fin), &s_netif);
+    REQUIRE(tcp_tw_pcbs == c.pcb);
+    CHECK(c.pcb->state == TIME_WAIT);
+    CHECK(hashMatchesList(&tcp_active_pcbs));
+    CHECK(hashMatchesList(&tcp_tw_pcbs));
+
+    /* a retransmitted FIN is acknowledged from TIME-WAIT */
+    int sent = s_sent;
+    ip4_input(makeSegment(fin), &s_netif);
+    CHECK(s_sent == sent + 1);
+    CHECK(tcp_tw_pcbs == c.pcb);
+
+    tcp_abort(c.pcb);
+    CHECK(tcp_tw_pcbs == nullptr);
+    conns.erase(conns.begin() + 5);
+    closeAll(conns);
+}
+
+TEST_CASE("listeners accept connections on their port", "[pcb_hash]")
+{
+    setupNetif();
+    std::vector<struct tcp_pcb*> listeners;
+    for (u16_t port = 8000; port < 8020; ++port) {
+        struct tcp_pcb* pcb = tcp_new();
+        REQUIRE(pcb != nullptr);
+        REQUIRE(tcp_bind(pcb, IP_ADDR_ANY, port) == ERR_OK);
+        pcb = tcp_listen(pcb);
+        REQUIRE(pcb != nullptr);
+        listeners.push_back(pcb);
+    }
+    CHECK(hashMatchesList(&tcp_listen_pcbs.pcbs));
+
+    /* a SYN to a listening port creates a connection in SYN-RCVD */
+    Segment syn = { 3, 33333, 8013, 7000, 0, TCP_SYN, 0 };
+    ip4_input(makeSegment(syn), &s_netif);
+    REQUIRE(tcp_active_pcbs != nullptr);
+    CHECK(tcp_active_pcbs->state == SYN_RCVD);
+    CHECK(tcp_active_pcbs->local_port == 8013);
+    CHECK(tcp_active_pcbs->remote_port == 33333);
+    CHECK(tcp_active_pcbs->next == nullptr);
+    CHECK(hashMatchesList(&tcp_active_pcbs));
+    tcp_abort(tcp_active_pcbs);
+
+    /* a SYN to any other port is reset */
+    int sent = s_sent;
+    syn.dest = 8020;
+    ip4_input(makeSegment(syn), &s_netif);
+    CHECK(tcp_active_pcbs == nullptr);
+    CHECK(s_sent == sent + 1);
+
+    for (struct tcp_pcb* pcb : listeners) {
+        REQUIRE(tcp_close(pcb) == ERR_OK);
+    }
+    CHECK(tcp_listen_pcbs.pcbs == nullptr);
+}
+
+static int s_udp_received;
+
+static void udpReceived(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    ++s_udp_received;
+    pbuf_free(p);
+}
+
+static void sendDatagram(u16_t dest)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, IP_HLEN + UDP_HLEN + 4, PBUF_RAM);
+    REQUIRE(p != nullptr);
+    memset(p->payload, 0, p->len);
+    struct udp_hdr* udphdr = (struct udp_hdr*) ((u8_t*) p->payload + IP_HLEN);
+    udphdr->src = lwip_htons(1234);
+    udphdr->dest = lwip_htons(dest);
+    udphdr->len = lwip_htons(UDP_HLEN + 4);
+
+    struct ip_hdr* iphdr = (struct ip_hdr*) p->payload;
+    IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+    IPH_LEN_SET(iphdr, lwip_htons(p->tot_len));
+    IPH_TTL_SET(iphdr, 64);
+    IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+    IP4_ADDR(&iphdr->src, 10, 1, 0, 1);
+    ip4_addr_copy(iphdr->dest, *netif_ip4_addr(&s_netif));
+    ip4_input(p, &s_netif);
+}
+
+TEST_CASE("datagrams follow a UDP PCB across rebinding", "[pcb_hash]")
+{
+    setupNetif();
+    std::vector<struct udp_pcb*> others;
+    for (u16_t port = 6000; port < 6040; ++port) {
+        struct udp_pcb* pcb = udp_new();
+        REQUIRE(pcb != nullptr);
+        REQUIRE(udp_bind(pcb, IP_ADDR_ANY, port) == ERR_OK);
+        others.push_back(pcb);
+    }
+    struct udp_pcb* pcb = udp_new();
+    REQUIRE(pcb != nullptr);
+    udp_recv(pcb, udpReceived, NULL);
+    REQUIRE(udp_bind(pcb, IP_ADDR_ANY, 7000) == ERR_OK);
+    /* ports of other PCBs are taken */
+    CHECK(udp_bind(pcb, IP_ADDR_ANY, 6016) == ERR_USE);
+
+    s_udp_received = 0;
+    sendDatagram(7000);
+    CHECK(s_udp_received == 1);
+
+    REQUIRE(udp_bind(pcb, IP_ADDR_ANY, 7001) == ERR_OK);
+    sendDatagram(7000);
+    CHECK(s_udp_received == 1);
+    sendDatagram(7001);
+    CHECK(s_udp_received == 2);
+
+    /* 7000 is free again, a port picked by lwIP is found as well */
+    REQUIRE(udp_bind(others[0], IP_ADDR_ANY, 7000) == ERR_OK);
+    REQUIRE(udp_bind(pcb, IP_ADDR_ANY, 0) == ERR_OK);
+    CHECK(pcb->local_port != 7001);
+    sendDatagram(pcb->local_port);
+    CHECK(s_udp_received == 3);
+
+    udp_remove(pcb);
+    sendDatagram(7001);
+    CHECK(s_udp_received == 3);
+    for (struct udp_pcb* other : others) {
+        udp_remove(other);
+    }
+    CHECK(udp_pcbs == nullptr);
+}
+
+/* The bucket lookup tcp_input does, and the list walk it did before */
+static struct tcp_pcb* findHashed(u16_t local_port, const ip_addr_t* remote_ip, u16_t remote_port)
+{
+    struct tcp_pcb* pcb = *tcp_pcb_hash_bucket(&tcp_active_pcbs, local_port, remote_ip, remote_port);
+    for (; pcb != NULL; pcb = pcb->hash_next) {
+        if (pcb->remote_port == remote_port && pcb->local_port == local_port &&
+                ip_addr_cmp(&pcb->remote_ip, remote_ip)) {
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+static struct tcp_pcb* findLinear(u16_t local_port, const ip_addr_t* remote_ip, u16_t remote_port)
+{
+    for (struct tcp_pcb* pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        if (pcb->remote_port == remote_port && pcb->local_port == local_port &&
+                ip_addr_cmp(&pcb->remote_ip, remote_ip)) {
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+template<typename TFind>
+static double lookupTime(const std::vector<Connection>& conns, const std::vector<int>& stream, TFind find)
+{
+    std::vector<ip_addr_t> addrs(conns.size());
+    for (size_t i = 0; i < conns.size(); ++i) {
+        remoteAddr(&addrs[i], conns[i].host);
+    }
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < 20; ++round) {
+        for (int i : stream) {
+            found += find(80, &addrs[i], conns[i].port) == conns[i].pcb;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    CHECK(found == 20 * stream.size());
+    return std::chrono::duration<double, std::nano>(end - start).count() / (20 * stream.size());
+}
+
+TEST_CASE("benchmark segment demultiplexing", "[pcb_hash][bench]")
+{
+    setupNetif();
+    printf("%d buckets for connections\n", TCP_PCB_HASH_SIZE);
+    for (int count : {16, 64, 256}) {
+        std::vector<Connection> conns(count);
+        for (int i = 0; i < count; ++i) {
+            openConnection(conns[i], i % 32, 30000 + i);
+        }
+        /* a capture-like stream: flows send bursts of one to four segments,
+           some flows are busier than others */
+        std::mt19937 rng(count);
+        std::geometric_distribution<int> flow(4.0 / count);
+        std::uniform_int_distribution<int> burst(1, 4);
+        std::vector<int> stream;
+        while (stream.size() < 20000) {
+            int i = flow(rng) % count;
+            for (int n = burst(rng); n > 0; --n) {
+                stream.push_back(i);
+            }
+        }
+
+        double linear = lookupTime(conns, stream, findLinear);
+        double hashed = lookupTime(conns, stream, findHashed);
+
+        /* nothing is sent back to the peer, the segments can be built in advance */
+        std::vector<struct pbuf*> segs;
+        for (int i : stream) {
+            segs.push_back(nextData(conns[i], 64));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (struct pbuf* p : segs) {
+            ip4_input(p, &s_netif);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double input = std::chrono::duration<double, std::nano>(end - start).count() / stream.size();
+        size_t received = 0;
+        for (auto& c : conns) {
+            received += c.received;
+        }
+        CHECK(received == 64 * stream.size());
+
+        printf("%3d connections: lookup %6.1f ns walking the list, %5.1f ns hashed; ip4_input %6.1f ns per segment\n",
+               count, linear, hashed, input);
+        closeAll(conns);
+    }
+}
+
+#endif // LWIP_PCB_HASH
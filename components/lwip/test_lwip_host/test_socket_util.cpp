@@ -0,0 +1,74 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/ip4.h"
+#include "test_socket_util.h"
+#include <cstring>
+
+struct netif s_loop_netif;
+
+static err_t netif_output_loop(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+    struct pbuf* q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+        return ERR_MEM;
+    }
+    pbuf_copy(q, p);
+    if (netif->input(q, netif) != ERR_OK) {
+        pbuf_free(q);
+    }
+    return ERR_OK;
+}
+
+static err_t netif_init_loop(struct netif *netif)
+{
+    netif->output = netif_output_loop;
+    netif->mtu = 1500;
+    return ERR_OK;
+}
+
+static void tcpipInitDone(void* arg)
+{
+    ip4_addr_t ip, mask, gw;
+    IP4_ADDR(&ip, 10, 0, 0, 1);
+    IP4_ADDR(&mask, 255, 0, 0, 0);
+    IP4_ADDR(&gw, 10, 0, 0, 254);
+    netif_add(&s_loop_netif, &ip, &mask, &gw, NULL, netif_init_loop, tcpip_input);
+    netif_set_default(&s_loop_netif);
+    netif_set_up(&s_loop_netif);
+    netif_set_link_up(&s_loop_netif);
+    sys_sem_signal((sys_sem_t*) arg);
+}
+
+void startTcpip()
+{
+    static bool started = false;
+    if (started) {
+        return;
+    }
+    sys_sem_t done;
+    REQUIRE(sys_sem_new(&done, 0) == ERR_OK);
+    tcpip_init(tcpipInitDone, &done);
+    sys_arch_sem_wait(&done, 0);
+    sys_sem_free(&done);
+    started = true;
+}
+
+void localAddr(struct sockaddr_in* addr, u16_t port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = lwip_htons(port);
+    addr->sin_addr.s_addr = ip4_addr_get_u32(netif_ip4_addr(&s_loop_netif));
+}
+
+int udpSocket(u16_t port)
+{
+    int s = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(s >= 0);
+    struct sockaddr_in addr;
+    localAddr(&addr, port);
+    REQUIRE(lwip_bind_r(s, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    return s;
+}
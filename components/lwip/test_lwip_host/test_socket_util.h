@@ -0,0 +1,16 @@
+#pragma once
+
+#include "lwip/netif.h"
+/* struct iovec is already declared by the host headers */
+#define iovec host_iovec
+#include "lwip/sockets.h"
+#undef iovec
+
+/* Socket tests run lwIP in the tcpip thread. Whatever is sent to the
+   address of this interface comes back in as received. */
+extern struct netif s_loop_netif;
+
+void startTcpip();
+void localAddr(struct sockaddr_in* addr, u16_t port);
+/* A UDP socket bound to the given local port */
+int udpSocket(u16_t port);
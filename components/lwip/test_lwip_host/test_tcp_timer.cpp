@@ -0,0 +1,220 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/ip.h"
+#include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "test_tcp_util.h"
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+extern "C" void sys_now_advance(u32_t msecs);
+
+static int s_timer_calls;
+#if !LWIP_TCP_TIMER_WHEEL
+static u32_t s_next_tmr;
+#endif
+
+static void setupTimers()
+{
+    setupNetif();
+    /* from now on, time only passes in runFor */
+    sys_now_advance(0);
+#if !LWIP_TCP_TIMER_WHEEL
+    if (s_next_tmr == 0) {
+        s_next_tmr = sys_now() + TCP_TMR_INTERVAL;
+    }
+#endif
+}
+
+/* When the TCP timer is called next: when the timer wheel has asked for it,
+   or every TCP_TMR_INTERVAL */
+static bool nextTimerCall(u32_t* at)
+{
+#if LWIP_TCP_TIMER_WHEEL
+    *at = tcp_timer_wake_at;
+    return tcp_timer_wake_pending != 0;
+#else
+    *at = s_next_tmr;
+    return true;
+#endif
+}
+
+/* Lets msecs of time pass, calling tcp_tmr() on the way like the tcpip thread */
+static void runFor(u32_t msecs)
+{
+    u32_t end = sys_now() + msecs;
+    u32_t at;
+    while (nextTimerCall(&at) && (s32_t)(at - end) <= 0) {
+        if ((s32_t)(at - sys_now()) > 0) {
+            sys_now_advance(at - sys_now());
+        }
+        tcp_tmr();
+        ++s_timer_calls;
+#if !LWIP_TCP_TIMER_WHEEL
+        s_next_tmr += TCP_TMR_INTERVAL;
+#endif
+    }
+    sys_now_advance(end - sys_now());
+}
+
+static int s_err_calls;
+static err_t s_err;
+
+static void recordErr(void* arg, err_t err)
+{
+    ++s_err_calls;
+    s_err = err;
+}
+
+TEST_CASE("unacknowledged data is retransmitted after the RTO", "[tcp_timer]")
+{
+    setupTimers();
+    Connection c;
+    openConnection(c, 1, 41000);
+    c.pcb->cwnd = c.pcb->mss;
+    runFor(1000);
+
+    int sent = s_sent;
+    REQUIRE(tcp_write(c.pcb, "hello", 5, TCP_WRITE_FLAG_COPY) == ERR_OK);
+    REQUIRE(tcp_output(c.pcb) == ERR_OK);
+    CHECK(s_sent == sent + 1);
+    /* the initial RTO is 3 s, counted in 500 ms ticks */
+    runFor(2000);
+    CHECK(s_sent == sent + 1);
+    runFor(1500);
+    CHECK(s_sent == sent + 2);
+    CHECK(c.pcb->nrtx == 1);
+
+    /* once the data is acknowledged, nothing is sent any more */
+    Segment ack = { c.host, c.port, 80, c.rcv_seq, c.pcb->snd_nxt, TCP_ACK, 0 };
+    ip4_input(makeSegment(ack), &s_netif);
+    CHECK(c.pcb->unacked == nullptr);
+    sent = s_sent;
+    runFor(60000);
+    CHECK(s_sent == sent);
+    tcp_abort(c.pcb);
+}
+
+TEST_CASE("keepalive probes an idle peer, then gives up", "[tcp_timer]")
+{
+    setupTimers();
+    Connection c;
+    openConnection(c, 2, 41000);
+    tcp_err(c.pcb, recordErr);
+    c.pcb->keep_idle = 10000;
+    c.pcb->keep_intvl = 1000;
+    c.pcb->keep_cnt = 3;
+    ip_set_option(c.pcb, SOF_KEEPALIVE);
+    tcp_keepalive_changed(c.pcb);
+    s_err_calls = 0;
+
+    /* probes after 10 s idle, then every second; ticks start up to 500 ms
+       before the connection was opened */
+    int sent = s_sent;
+    runFor(9500);
+    CHECK(s_sent == sent);
+    runFor(1250);
+    CHECK(s_sent == sent + 1);
+    CHECK(c.pcb->keep_cnt_sent == 1);
+    runFor(2000);
+    CHECK(s_sent == sent + 3);
+    CHECK(s_err_calls == 0);
+    /* no answer to 3 probes: a RST, and the connection is gone */
+    runFor(1250);
+    CHECK(s_sent == sent + 4);
+    CHECK(s_err_calls == 1);
+    CHECK(s_err == ERR_ABRT);
+    CHECK(tcp_active_pcbs == nullptr);
+}
+
+TEST_CASE("delayed ACKs are sent by the fast timer", "[tcp_timer]")
+{
+    setupTimers();
+    Connection c;
+    openConnection(c, 3, 41000);
+    runFor(1000);
+
+    int sent = s_sent;
+    sendData(c, 10);
+    CHECK(c.received == 10);
+    CHECK(s_sent == sent);
+    runFor(TCP_FAST_INTERVAL);
+    CHECK(s_sent == sent + 1);
+    CHECK((c.pcb->flags & TF_ACK_DELAY) == 0);
+    runFor(10000);
+    CHECK(s_sent == sent + 1);
+    tcp_abort(c.pcb);
+}
+
+TEST_CASE("TIME-WAIT connections are freed after 2 MSL", "[tcp_timer]")
+{
+    setupTimers();
+    Connection c;
+    openConnection(c, 4, 41000);
+    REQUIRE(tcp_close(c.pcb) == ERR_OK);
+    REQUIRE(c.pcb->state == FIN_WAIT_1);
+    Segment fin = { c.host, c.port, 80, c.rcv_seq, c.pcb->snd_nxt, TCP_ACK | TCP_FIN, 0 };
+    ip4_input(makeSegment(fin), &s_netif);
+    REQUIRE(tcp_tw_pcbs == c.pcb);
+
+    runFor(2 * TCP_MSL - 1000);
+    CHECK(tcp_tw_pcbs == c.pcb);
+    runFor(2000);
+    CHECK(tcp_tw_pcbs == nullptr);
+}
+
+#if LWIP_TCP_TIMER_WHEEL
+TEST_CASE("idle connections don't wake up the TCP timer", "[tcp_timer]")
+{
+    setupTimers();
+    std::vector<Connection> conns(16);
+    for (int i = 0; i < 16; ++i) {
+        openConnection(conns[i], i, 42000);
+    }
+    runFor(1000);
+    int calls = s_timer_calls;
+    runFor(3600 * 1000);
+    CHECK(s_timer_calls == calls);
+    CHECK(tcp_timer_wake_pending == 0);
+
+    /* keepalive is due 2 hours after the connections were last active */
+    for (auto& c : conns) {
+        ip_set_option(c.pcb, SOF_KEEPALIVE);
+        tcp_keepalive_changed(c.pcb);
+    }
+    CHECK(tcp_timer_wake_pending != 0);
+    CHECK((s32_t)(tcp_timer_wake_at - sys_now()) > 3590 * 1000);
+    runFor(3590 * 1000);
+    CHECK(s_timer_calls == calls);
+    int sent = s_sent;
+    runFor(10000);
+    CHECK(s_sent == sent + 16);
+    closeAll(conns);
+}
+#endif // LWIP_TCP_TIMER_WHEEL
+
+TEST_CASE("benchmark TCP timers with idle connections", "[tcp_timer][bench]")
+{
+    setupTimers();
+    printf("TCP timers %s\n", LWIP_TCP_TIMER_WHEEL ? "in the timer wheel" : "walking the PCB list");
+    const u32_t duration = 600 * 1000;
+    for (int count : {16, 256}) {
+        std::vector<Connection> conns(count);
+        for (int i = 0; i < count; ++i) {
+            openConnection(conns[i], i % 32, 30000 + i);
+            ip_set_option(conns[i].pcb, SOF_KEEPALIVE);
+            tcp_keepalive_changed(conns[i].pcb);
+        }
+        runFor(1000);
+        int calls = s_timer_calls;
+        auto start = std::chrono::steady_clock::now();
+        runFor(duration);
+        auto end = std::chrono::steady_clock::now();
+        double perTick = std::chrono::duration<double, std::nano>(end - start).count() / (duration / TCP_SLOW_INTERVAL);
+        printf("%3d idle keepalive connections: %8.1f ns per %d ms tick, tcp_tmr called %d times in %u s\n",
+               count, perTick, TCP_SLOW_INTERVAL, s_timer_calls - calls, (unsigned) (duration / 1000));
+        closeAll(conns);
+    }
+}
@@ -0,0 +1,137 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/ip4.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/priv/tcp_priv.h"
+#include "test_tcp_util.h"
+#include <cstring>
+
+struct netif s_netif;
+int s_sent;
+
+static err_t netif_output_drop(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+    ++s_sent;
+    return ERR_OK;
+}
+
+static err_t netif_init_drop(struct netif *netif)
+{
+    netif->output = netif_output_drop;
+    netif->mtu = 1500;
+    return ERR_OK;
+}
+
+void setupNetif()
+{
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    lwip_init();
+    ip4_addr_t ip, mask, gw;
+    IP4_ADDR(&ip, 10, 0, 0, 1);
+    IP4_ADDR(&mask, 255, 0, 0, 0);
+    IP4_ADDR(&gw, 10, 0, 0, 254);
+    netif_add(&s_netif, &ip, &mask, &gw, NULL, netif_init_drop, ip4_input);
+    netif_set_default(&s_netif);
+    netif_set_up(&s_netif);
+    netif_set_link_up(&s_netif);
+    initialized = true;
+}
+
+void remoteAddr(ip_addr_t* addr, int host)
+{
+    IP_ADDR4(addr, 10, 1, (host >> 8) & 0xff, host & 0xff);
+}
+
+struct pbuf* makeSegment(const Segment& s)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, IP_HLEN + TCP_HLEN + s.len, PBUF_RAM);
+    REQUIRE(p != nullptr);
+    memset(p->payload, 0, p->len);
+
+    ip_addr_t src, dest;
+    remoteAddr(&src, s.host);
+    ip_addr_copy_from_ip4(dest, *netif_ip4_addr(&s_netif));
+
+    struct tcp_hdr* tcphdr = (struct tcp_hdr*) ((u8_t*) p->payload + IP_HLEN);
+    tcphdr->src = lwip_htons(s.src);
+    tcphdr->dest = lwip_htons(s.dest);
+    tcphdr->seqno = lwip_htonl(s.seqno);
+    tcphdr->ackno = lwip_htonl(s.ackno);
+    TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN / 4, s.flags);
+    tcphdr->wnd = lwip_htons(TCP_WND_DEFAULT);
+    pbuf_header(p, -IP_HLEN);
+    tcphdr->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &src, &dest);
+    pbuf_header(p, IP_HLEN);
+
+    struct ip_hdr* iphdr = (struct ip_hdr*) p->payload;
+    IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+    IPH_LEN_SET(iphdr, lwip_htons(p->tot_len));
+    IPH_TTL_SET(iphdr, 64);
+    IPH_PROTO_SET(iphdr, IP_PROTO_TCP);
+    ip4_addr_copy(iphdr->src, *ip_2_ip4(&src));
+    ip4_addr_copy(iphdr->dest, *ip_2_ip4(&dest));
+    IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+    return p;
+}
+
+static err_t countReceived(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    if (p != NULL) {
+        static_cast<Connection*>(arg)->received += p->tot_len;
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+    }
+    return ERR_OK;
+}
+
+void openConnection(Connection& c, int host, u16_t port)
+{
+    c.pcb = tcp_new();
+    REQUIRE(c.pcb != nullptr);
+    c.host = host;
+    c.port = port;
+    c.rcv_seq = 1000;
+    c.received = 0;
+
+    struct tcp_pcb* pcb = c.pcb;
+    ip_addr_copy_from_ip4(pcb->local_ip, *netif_ip4_addr(&s_netif));
+    remoteAddr(&pcb->remote_ip, host);
+    pcb->local_port = 80;
+    pcb->remote_port = port;
+    pcb->state = ESTABLISHED;
+    pcb->rcv_nxt = c.rcv_seq;
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+    pcb->snd_nxt = pcb->lastack = pcb->snd_lbb = 5000;
+    pcb->snd_wl1 = c.rcv_seq - 1;
+    pcb->snd_wl2 = pcb->snd_nxt;
+    pcb->snd_wnd = TCP_WND_DEFAULT;
+    tcp_arg(pcb, &c);
+    tcp_recv(pcb, countReceived);
+    TCP_REG_ACTIVE(pcb);
+}
+
+struct pbuf* nextData(Connection& c, size_t len)
+{
+    Segment s = { c.host, c.port, 80, c.rcv_seq, c.pcb->snd_nxt, TCP_ACK | TCP_PSH, len };
+    c.rcv_seq += len;
+    return makeSegment(s);
+}
+
+void sendData(Connection& c, size_t len)
+{
+    ip4_input(nextData(c, len), &s_netif);
+}
+
+void closeAll(std::vector<Connection>& conns)
+{
+    for (auto& c : conns) {
+        tcp_abort(c.pcb);
+    }
+    conns.clear();
+    CHECK(tcp_active_pcbs == nullptr);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include <vector>
+
+/* Segments and datagrams are fed to ip4_input of this interface,
+   whatever the stack sends is dropped and counted in s_sent */
+extern struct netif s_netif;
+extern int s_sent;
+
+void setupNetif();
+void remoteAddr(ip_addr_t* addr, int host);
+
+struct Segment {
+    int host;
+    u16_t src;
+    u16_t dest;
+    u32_t seqno;
+    u32_t ackno;
+    u8_t flags;
+    size_t len;
+};
+
+/* An IPv4 packet carrying a TCP segment from 10.1.x.y to 10.0.0.1 */
+struct pbuf* makeSegment(const Segment& s);
+
+struct Connection {
+    struct tcp_pcb* pcb;
+    int host;
+    u16_t port;
+    u32_t rcv_seq;
+    int received;
+};
+
+/* An established connection to local port 80 from the given remote address and port */
+void openConnection(Connection& c, int host, u16_t port);
+struct pbuf* nextData(Connection& c, size_t len);
+void sendData(Connection& c, size_t len);
+void closeAll(std::vector<Connection>& conns);
@@ -0,0 +1,176 @@
+#include "catch.hpp"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "test_socket_util.h"
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char* s_mode = LWIP_TCPIP_CORE_LOCKING ? "with core locking" : "with API messages";
+
+/* A connected pair of TCP sockets over the loop interface */
+static void tcpPair(u16_t port, int* client, int* server)
+{
+    struct sockaddr_in addr;
+    localAddr(&addr, port);
+    int listener = lwip_socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener >= 0);
+    REQUIRE(lwip_bind_r(listener, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    REQUIRE(lwip_listen_r(listener, 1) == 0);
+    *client = lwip_socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(*client >= 0);
+    REQUIRE(lwip_connect_r(*client, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    *server = lwip_accept_r(listener, NULL, NULL);
+    REQUIRE(*server >= 0);
+    lwip_close_r(listener);
+}
+
+/* Sends len bytes of a counting pattern from another thread */
+static std::thread sendPattern(int s, size_t len)
+{
+    return std::thread([s, len]() {
+        lwip_socket_thread_init();
+        char buf[1024];
+        size_t sent = 0;
+        while (sent < len) {
+            size_t n = std::min(sizeof(buf), len - sent);
+            for (size_t i = 0; i < n; ++i) {
+                buf[i] = (char) (sent + i);
+            }
+            int r = lwip_send_r(s, buf, n, 0);
+            if (r <= 0) {
+                break;
+            }
+            sent += r;
+        }
+        lwip_socket_thread_cleanup();
+    });
+}
+
+/* Receives until len bytes have arrived, returns how many matched the pattern */
+static size_t receivePattern(int s, size_t len)
+{
+    char buf[2048];
+    size_t received = 0;
+    size_t matching = 0;
+    while (received < len) {
+        int r = lwip_recv_r(s, buf, sizeof(buf), 0);
+        if (r <= 0) {
+            break;
+        }
+        for (int i = 0; i < r; ++i) {
+            if (buf[i] == (char) (received + i)) {
+                ++matching;
+            }
+        }
+        received += r;
+    }
+    return matching;
+}
+
+TEST_CASE("a TCP stream over the loop interface arrives intact", "[tcpip]")
+{
+    startTcpip();
+    int client, server;
+    tcpPair(7000, &client, &server);
+
+    const size_t len = 256 * 1024;
+    std::thread sender = sendPattern(client, len);
+    CHECK(receivePattern(server, len) == len);
+    sender.join();
+
+    lwip_close_r(client);
+    lwip_close_r(server);
+}
+
+struct CallbackLog {
+    sys_sem_t blocked;
+    sys_sem_t release;
+    std::vector<int> order;
+};
+
+static CallbackLog s_log;
+
+static void blockTcpip(void* ctx)
+{
+    sys_sem_signal(&s_log.blocked);
+    sys_arch_sem_wait(&s_log.release, 0);
+}
+
+static void logCallback(void* ctx)
+{
+    s_log.order.push_back((int) (intptr_t) ctx);
+}
+
+TEST_CASE("messages queued while tcpip_thread is busy are handled in order", "[tcpip]")
+{
+    startTcpip();
+    REQUIRE(sys_sem_new(&s_log.blocked, 0) == ERR_OK);
+    REQUIRE(sys_sem_new(&s_log.release, 0) == ERR_OK);
+    s_log.order.clear();
+
+    REQUIRE(tcpip_callback(blockTcpip, NULL) == ERR_OK);
+    sys_arch_sem_wait(&s_log.blocked, 0);
+    /* more than one batch */
+    const int count = TCPIP_MBOX_SIZE + TCPIP_MBOX_SIZE / 2;
+    std::thread poster([count]() {
+        for (int i = 0; i < count; ++i) {
+            tcpip_callback(logCallback, (void*) (intptr_t) i);
+        }
+    });
+    /* let the mailbox fill up */
+    sys_delay_ms(50);
+    sys_sem_signal(&s_log.release);
+    poster.join();
+
+    /* the callbacks ran before this one */
+    REQUIRE(tcpip_callback(blockTcpip, NULL) == ERR_OK);
+    sys_sem_signal(&s_log.release);
+    sys_arch_sem_wait(&s_log.blocked, 0);
+    REQUIRE(s_log.order.size() == count);
+    for (int i = 0; i < count; ++i) {
+        CHECK(s_log.order[i] == i);
+    }
+    sys_sem_free(&s_log.blocked);
+    sys_sem_free(&s_log.release);
+}
+
+TEST_CASE("benchmark socket calls over the loop interface", "[tcpip][bench]")
+{
+    startTcpip();
+    printf("Socket calls %s, up to %d messages per tcpip_thread wakeup\n", s_mode, TCPIP_MSG_BATCH_MAX);
+
+    /* a datagram sent and received by the same thread: two socket calls and
+       one packet through tcpip_thread per round */
+    int s = udpSocket(7100);
+    struct sockaddr_in addr;
+    localAddr(&addr, 7100);
+    const int rounds = 20000;
+    char buf[64] = { 0 };
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        REQUIRE(lwip_sendto_r(s, buf, sizeof(buf), 0, (struct sockaddr*) &addr, sizeof(addr)) == sizeof(buf));
+        REQUIRE(lwip_recv_r(s, buf, sizeof(buf), 0) == sizeof(buf));
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("UDP send and receive: %8.1f us per datagram\n",
+           std::chrono::duration<double, std::micro>(end - start).count() / rounds);
+    lwip_close_r(s);
+
+    /* bulk TCP transfer from another thread */
+    int client, server;
+    tcpPair(7101, &client, &server);
+    const size_t len = 8 * 1024 * 1024;
+    start = std::chrono::steady_clock::now();
+    std::thread sender = sendPattern(client, len);
+    CHECK(receivePattern(server, len) == len);
+    sender.join();
+    end = std::chrono::steady_clock::now();
+    printf("TCP stream: %8.1f MB/s\n", len / std::chrono::duration<double, std::micro>(end - start).count());
+    lwip_close_r(client);
+    lwip_close_r(server);
+}
@@ -1,13 +1,62 @@
-/* <dirent.h> includes <sys/dirent.h>, which is this file.  On a
-   system which supports <dirent.h>, this file is overridden by
-   dirent.h in the libc/sys/.../sys directory.  On a system which does
-   not support <dirent.h>, we will get this file which uses #error to force
-   an error.  */
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * This header file provides POSIX-compatible definitions of directory
+ * access functions and related data types. Directory operations are
+ * implemented by the VFS component, which forwards them to the filesystem
+ * driver registered for the given path.
+ */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
-#error "<dirent.h> not supported"
+
+/**
+ * @brief Opaque directory structure
+ *
+ * Filesystem drivers return a structure which starts with DIR and may
+ * contain any driver-specific state after it.
+ */
+typedef struct {
+    uint16_t dd_vfs_idx;    /*!< VFS index, not to be used by applications */
+    uint16_t dd_rsv;        /*!< field reserved for future extension */
+    /* remaining fields are defined by VFS implementation */
+} DIR;
+
+/**
+ * @brief Directory entry structure
+ */
+struct dirent {
+    int d_ino;              /*!< file number */
+    uint8_t d_type;         /*!< not defined in POSIX, but present in BSD and Linux */
+#define DT_UNKNOWN  0
+#define DT_REG      1
+#define DT_DIR      2
+    char d_name[256];       /*!< zero-terminated file name */
+};
+
+DIR* opendir(const char* name);
+struct dirent* readdir(DIR* pdir);
+void rewinddir(DIR* pdir);
+int closedir(DIR* pdir);
+
 #ifdef __cplusplus
 }
 #endif
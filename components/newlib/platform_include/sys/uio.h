@@ -0,0 +1,48 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SYS_UIO_H__
+#define __SYS_UIO_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* lwip/sockets.h defines an identical structure unless iovec is defined.
+ * Skip the definition if that header has been included first. */
+#ifndef LWIP_HDR_SOCKETS_H
+struct iovec {
+    void* iov_base;     /*!< start of the buffer */
+    size_t iov_len;     /*!< length of the buffer */
+};
+#endif
+#define iovec iovec
+
+/**
+ * Read into, or write from, a sequence of buffers with a single call.
+ * Implemented by the VFS component, which forwards the call to the
+ * filesystem driver, or falls back to read and write calls for each buffer.
+ * The parentheses keep the lwip_writev macro from sockets.h from applying.
+ */
+ssize_t (readv)(int fd, const struct iovec* iov, int iovcnt);
+ssize_t (writev)(int fd, const struct iovec* iov, int iovcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SYS_UIO_H__
@@ -21,6 +21,17 @@
 #include <stdlib.h>
 #include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
+#include "esp_heap_alloc_caps.h"
+
+/* malloc, calloc and realloc are in ROM and call these functions through
+   _malloc_r, _calloc_r and _realloc_r in ROM, so the code which called malloc
+   is two frames up. Getting it requires spilling register windows, so it is
+   only done when heap tracing is enabled. */
+#if CONFIG_HEAP_TRACING
+#define MALLOC_CALLER() __builtin_return_address(2)
+#else
+#define MALLOC_CALLER() NULL
+#endif
 
 void IRAM_ATTR abort()
 {
@@ -33,7 +44,7 @@ void IRAM_ATTR abort()
 
 void* IRAM_ATTR _malloc_r(struct _reent *r, size_t size)
 {
-    return pvPortMalloc(size);
+    return pvPortMallocCapsFrom(size, MALLOC_CAP_8BIT, MALLOC_CALLER());
 }
 
 void IRAM_ATTR _free_r(struct _reent *r, void* ptr)
@@ -51,7 +62,7 @@ void* IRAM_ATTR _realloc_r(struct _reent *r, void* ptr, size_t size)
         return NULL;
     }
 
-    new_chunk = pvPortMalloc(size);
+    new_chunk = pvPortMallocCapsFrom(size, MALLOC_CAP_8BIT, MALLOC_CALLER());
     if (new_chunk && ptr) {
         memcpy(new_chunk, ptr, size);
         vPortFree(ptr);
@@ -62,7 +73,7 @@ void* IRAM_ATTR _realloc_r(struct _reent *r, void* ptr, size_t size)
 
 void* IRAM_ATTR _calloc_r(struct _reent *r, size_t count, size_t size)
 {
-    void* result = pvPortMalloc(count * size);
+    void* result = pvPortMallocCapsFrom(count * size, MALLOC_CAP_8BIT, MALLOC_CALLER());
     if (result)
     {
         memset(result, 0, count * size);
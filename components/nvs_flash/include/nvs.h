@@ -41,6 +41,10 @@ typedef uint32_t nvs_handle;
 #define ESP_ERR_NVS_PAGE_FULL           (ESP_ERR_NVS_BASE + 0x0a)  /*!< TBA */
 #define ESP_ERR_NVS_INVALID_STATE       (ESP_ERR_NVS_BASE + 0x0b)  /*!< TBA */
 #define ESP_ERR_NVS_INVALID_LENGTH      (ESP_ERR_NVS_BASE + 0x0c)  /*!< TBA */
+#define ESP_ERR_NVS_VALUE_TOO_LONG      (ESP_ERR_NVS_BASE + 0x0d)  /*!< String or blob length is longer than supported */
+
+#define NVS_DEFAULT_PART_NAME           "nvs"   /*!< Name of the partition used by nvs_open and nvs_flash_init */
+#define NVS_PART_NAME_MAX_SIZE          16      /*!< Maximum length of a partition name */
 
 /**
  * @brief Mode of opening the non-volatile storage
@@ -51,6 +55,53 @@ typedef enum {
 	NVS_READWRITE  /*!< Read and write */
 } nvs_open_mode;
 
+/**
+ * @brief Types of values stored in non-volatile storage
+ */
+typedef enum {
+    NVS_TYPE_U8   = 0x01,  /*!< Type uint8_t */
+    NVS_TYPE_I8   = 0x11,  /*!< Type int8_t */
+    NVS_TYPE_U16  = 0x02,  /*!< Type uint16_t */
+    NVS_TYPE_I16  = 0x12,  /*!< Type int16_t */
+    NVS_TYPE_U32  = 0x04,  /*!< Type uint32_t */
+    NVS_TYPE_I32  = 0x14,  /*!< Type int32_t */
+    NVS_TYPE_U64  = 0x08,  /*!< Type uint64_t */
+    NVS_TYPE_I64  = 0x18,  /*!< Type int64_t */
+    NVS_TYPE_STR  = 0x21,  /*!< Type string */
+    NVS_TYPE_BLOB = 0x41,  /*!< Type blob */
+    NVS_TYPE_ANY  = 0xff   /*!< Must be last */
+} nvs_type_t;
+
+/**
+ * @brief Information about a key-value pair, obtained with nvs_entry_info
+ */
+typedef struct {
+    char namespace_name[16];    /*!< Namespace to which the key-value pair belongs */
+    char key[16];               /*!< Key of the key-value pair */
+    nvs_type_t type;            /*!< Type of the value */
+} nvs_entry_info_t;
+
+/**
+ * Opaque pointer type representing iterator over key-value pairs
+ */
+typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
+
+/**
+ * @brief Entry and sector usage of the NVS partition
+ *
+ * Each key-value pair uses at least one 32-byte entry; strings and blobs
+ * use one entry per 32 bytes of data in addition.
+ */
+typedef struct {
+    size_t used_entries;        /*!< Number of entries holding key-value pairs */
+    size_t free_entries;        /*!< Number of entries which were never written since the sector was erased */
+    size_t erased_entries;      /*!< Number of entries holding erased key-value pairs, reclaimed by garbage collection */
+    size_t total_entries;       /*!< Number of entries in the partition */
+    size_t namespace_count;     /*!< Number of namespaces */
+    uint32_t min_erase_count;   /*!< Smallest number of erase cycles of a sector in the partition */
+    uint32_t max_erase_count;   /*!< Largest number of erase cycles of a sector in the partition */
+} nvs_stats_t;
+
 /**
  * @brief      Open non-volatile storage with a given namespace
  *
@@ -77,6 +128,29 @@ typedef enum {
  */
 esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle);
 
+/**
+ * @brief      Open non-volatile storage with a given namespace in a given partition
+ *
+ * Each partition has its own lock, so operations on handles of different
+ * partitions don't wait for each other. Within a partition, reads by several
+ * tasks run concurrently, while operations which write to flash run one at
+ * a time. Partition must be initialized first, with nvs_flash_init_partition.
+ *
+ * @param[in]  part_name   Name (label) of the partition, at most NVS_PART_NAME_MAX_SIZE
+ *                         characters. nvs_open uses NVS_DEFAULT_PART_NAME.
+ * @param[in]  name        Namespace name, as in nvs_open.
+ * @param[in]  open_mode   NVS_READWRITE or NVS_READONLY, as in nvs_open.
+ * @param[out] out_handle  If successful (return code is zero), handle will be
+ *                         returned in this argument.
+ *
+ * @return
+ *             - ESP_OK if storage handle was opened successfully
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the partition is not initialized
+ *             - ESP_ERR_NO_MEM if too many handles are open
+ *             - other error codes, as in nvs_open
+ */
+esp_err_t nvs_open_from_partition(const char* part_name, const char* name, nvs_open_mode open_mode, nvs_handle *out_handle);
+
 /**@{*/
 /**
  * @brief      set value for given key
@@ -127,6 +201,8 @@ esp_err_t nvs_set_str (nvs_handle handle, const char* key, const char* value);
  *                     16 characters. Shouldn't be empty.
  * @param[in]  value   The value to set.
  * @param[in]  length  length of binary value to set, in bytes.
+ *                     Values which don't fit into one flash sector are split
+ *                     into chunks stored on several sectors.
  *
  * @return
  *             - ESP_OK if value was set successfully
@@ -135,6 +211,8 @@ esp_err_t nvs_set_str (nvs_handle handle, const char* key, const char* value);
  *             - ESP_ERR_NVS_INVALID_NAME if key name doesn't satisfy constraints
  *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space in the
  *               underlying storage to save the value
+ *             - ESP_ERR_NVS_VALUE_TOO_LONG if the value is longer than supported,
+ *               or if a value longer than one sector is set within a batch
  *             - ESP_ERR_NVS_REMOVE_FAILED if the value wasn't updated because flash
  *               write operation has failed. The value was written however, and
  *               update will be finished after re-initialization of nvs, provided that
@@ -251,6 +329,28 @@ esp_err_t nvs_get_str (nvs_handle handle, const char* key, char* out_value, size
 esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length);
 /**@}*/
 
+/**
+ * @brief      get part of a binary value for given key
+ *
+ * Reads length bytes of the value starting at offset. Data is read from flash
+ * directly into out_value, so large blobs can be read piece by piece without
+ * allocating a buffer for the whole value. Use nvs_get_blob with out_value
+ * set to NULL to find the total length of the value.
+ *
+ * @param[in]  handle     Handle obtained from nvs_open function.
+ * @param[in]  key        Key name.
+ * @param[in]  offset     Offset within the value, in bytes.
+ * @param[out] out_value  Buffer to receive the data, at least length bytes long.
+ * @param[in]  length     Number of bytes to read.
+ *
+ * @return
+ *             - ESP_OK if the data was retrieved successfully
+ *             - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_LENGTH if offset and length are outside of the value
+ */
+esp_err_t nvs_get_blob_chunked(nvs_handle handle, const char* key, size_t offset, void* out_value, size_t length);
+
 /**
  * @brief      Erase key-value pair with given key name.
  *
@@ -267,6 +367,7 @@ esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size
  *              - ESP_OK if erase operation was successful
  *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
  *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *              - ESP_ERR_NVS_INVALID_STATE if a batch is open for this handle
  *              - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
  *              - other error codes from the underlying storage driver
  */
@@ -284,10 +385,32 @@ esp_err_t nvs_erase_key(nvs_handle handle, const char* key);
  *              - ESP_OK if erase operation was successful
  *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
  *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *              - ESP_ERR_NVS_INVALID_STATE if a batch is open for this handle
  *              - other error codes from the underlying storage driver
  */
 esp_err_t nvs_erase_all(nvs_handle handle);
 
+/**
+ * @brief      Start a batch of writes which are committed together
+ *
+ * After this function is called, values set using this handle are kept in RAM
+ * until nvs_commit is called. nvs_commit writes all of them to storage so that
+ * after a power loss either all of the new values, or none of them are present.
+ * Values set within the batch are returned by nvs_get functions called with
+ * the same handle. Erasing keys is not allowed while the batch is open.
+ * Closing the handle discards the batch.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ *
+ * @return
+ *             - ESP_OK if the batch was started
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *             - ESP_ERR_NVS_INVALID_STATE if a batch is already open for this handle
+ */
+esp_err_t nvs_begin(nvs_handle handle);
+
 /**
  * @brief      Write any pending changes to non-volatile storage
  *
@@ -301,6 +424,8 @@ esp_err_t nvs_erase_all(nvs_handle handle);
  * @return
  *             - ESP_OK if the changes have been written successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space to
+ *               write the batch started with nvs_begin; none of its values are written
  *             - other error codes from the underlying storage driver
  */
 esp_err_t nvs_commit(nvs_handle handle);
@@ -318,6 +443,84 @@ esp_err_t nvs_commit(nvs_handle handle);
  */
 void nvs_close(nvs_handle handle);
 
+/**
+ * @brief      Find the first key-value pair matching namespace and type
+ *
+ * Key-value pairs are returned in the order in which they are stored in
+ * flash. The iterator remembers its position only, so it uses the same
+ * amount of memory regardless of the number of keys. Values set within
+ * a batch which is not committed yet are not returned. If keys are written
+ * or erased while the iterator is in use, some of the key-value pairs may be
+ * skipped or returned twice.
+ *
+ * @param[in]  part_name       Name of the partition, or NULL for NVS_DEFAULT_PART_NAME.
+ *                             The iterator keeps using this partition.
+ * @param[in]  namespace_name  Namespace name, or NULL to iterate over all namespaces.
+ * @param[in]  type            Type of values to return, or NVS_TYPE_ANY.
+ * @param[out] out_iterator    Iterator positioned at the first matching key-value
+ *                             pair. Must be released with nvs_release_iterator,
+ *                             unless iteration has finished. Set to NULL if no
+ *                             matching key-value pair was found.
+ *
+ * @return
+ *             - ESP_OK if a matching key-value pair was found
+ *             - ESP_ERR_NVS_NOT_FOUND if there are no matching key-value pairs,
+ *               or the namespace doesn't exist
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the storage driver is not initialized
+ *             - ESP_ERR_INVALID_ARG if out_iterator is NULL
+ */
+esp_err_t nvs_entry_find(const char* part_name, const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator);
+
+/**
+ * @brief      Advance the iterator to the next matching key-value pair
+ *
+ * @param[inout] iterator  Iterator obtained from nvs_entry_find. When there are no more
+ *                         matching key-value pairs, the iterator is released and set to NULL.
+ *
+ * @return
+ *             - ESP_OK if the next key-value pair was found
+ *             - ESP_ERR_NVS_NOT_FOUND if there are no more matching key-value pairs
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the partition is no longer initialized
+ *             - ESP_ERR_INVALID_ARG if iterator is NULL
+ */
+esp_err_t nvs_entry_next(nvs_iterator_t* iterator);
+
+/**
+ * @brief      Get namespace, key and type of the key-value pair at the iterator position
+ *
+ * @param[in]  iterator  Iterator obtained from nvs_entry_find or nvs_entry_next.
+ * @param[out] out_info  Structure to receive the information.
+ *
+ * @return
+ *             - ESP_OK if the information was retrieved
+ *             - ESP_ERR_INVALID_ARG if iterator or out_info is NULL
+ */
+esp_err_t nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t* out_info);
+
+/**
+ * @brief      Release the iterator
+ *
+ * @param[in]  iterator  Iterator obtained from nvs_entry_find or nvs_entry_next. May be NULL.
+ */
+void nvs_release_iterator(nvs_iterator_t iterator);
+
+/**
+ * @brief      Get entry usage statistics of the NVS partition
+ *
+ * Erase cycles are counted by the driver since the first time the sector was
+ * initialized, so sectors erased by other means (e.g. esptool erase_flash)
+ * start counting from zero again.
+ *
+ * @param[in]  part_name  Name of the partition, or NULL for NVS_DEFAULT_PART_NAME.
+ * @param[out] nvs_stats  Structure to receive the statistics.
+ *
+ * @return
+ *             - ESP_OK if the statistics were retrieved
+ *             - ESP_ERR_NVS_NOT_INITIALIZED if the storage driver is not initialized
+ *             - ESP_ERR_INVALID_ARG if nvs_stats is NULL
+ */
+esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -25,6 +25,20 @@ extern "C" {
  */
 esp_err_t nvs_flash_init(void);
 
+/**
+ * @brief Initialize NVS flash storage in the NVS partition with the given label.
+ *
+ * Handles for this partition are opened with nvs_open_from_partition.
+ *
+ * @param partition_label Label of the partition, at most NVS_PART_NAME_MAX_SIZE characters.
+ *
+ * @return
+ *      - ESP_OK if storage was successfully initialized.
+ *      - ESP_ERR_NOT_FOUND if there is no NVS partition with this label.
+ *      - ESP_ERR_NO_MEM if too many partitions are initialized.
+ */
+esp_err_t nvs_flash_init_partition(const char* partition_label);
+
 
 #ifdef __cplusplus
 }
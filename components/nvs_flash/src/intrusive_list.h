@@ -15,6 +15,7 @@
 #define intrusive_list_h
 
 #include <cassert>
+#include <iterator>
 
 template <typename T>
 class intrusive_list;
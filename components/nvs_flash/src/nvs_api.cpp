@@ -28,154 +28,389 @@ static const char* TAG = "nvs";
 #define ESP_LOGD(...)
 #endif
 
-class HandleEntry : public intrusive_list_node<HandleEntry>
+/* Storage of one NVS partition, and the lock which guards it */
+class PartitionEntry
 {
 public:
-    HandleEntry() {}
+    PartitionEntry(const char* name)
+    {
+        strncpy(mName, name, sizeof(mName) - 1);
+        mName[sizeof(mName) - 1] = 0;
+    }
+
+    char mName[NVS_PART_NAME_MAX_SIZE + 1];
+    nvs::Storage mStorage;
+    nvs::RWLock mLock;
+};
 
-    HandleEntry(nvs_handle handle, bool readOnly, uint8_t nsIndex) :
-        mHandle(handle),
+class HandleEntry
+{
+public:
+    HandleEntry(bool readOnly, uint8_t nsIndex, PartitionEntry* partition) :
         mReadOnly(readOnly),
-        mNsIndex(nsIndex)
+        mNsIndex(nsIndex),
+        mPartition(partition)
     {
     }
 
-    nvs_handle mHandle;
+    nvs_handle mHandle = 0;
     uint8_t mReadOnly;
     uint8_t mNsIndex;
+    PartitionEntry* mPartition;
+    nvs::Batch* mBatch = nullptr;
+};
+
+/**
+ * Open handles. Handle value holds the index of the partition and the index of
+ * the slot in this table, so lookup doesn't depend on the number of open handles.
+ * Upper bits of the handle come from a counter, so a closed handle is not
+ * mistaken for a handle opened later in the same slot.
+ */
+class HandleTable
+{
+public:
+    static const size_t MAX_PARTITIONS = 16;
+
+    ~HandleTable()
+    {
+        for (size_t i = 0; i < mSize; ++i) {
+            if (mSlots[i]) {
+                delete mSlots[i]->mBatch;
+                delete mSlots[i];
+            }
+        }
+        delete[] mSlots;
+    }
+
+    esp_err_t insert(HandleEntry* entry, size_t partitionIndex)
+    {
+        size_t slot = 0;
+        while (slot < mSize && mSlots[slot] != nullptr) {
+            ++slot;
+        }
+        if (slot == mSize) {
+            if (mSize == MAX_SLOTS) {
+                return ESP_ERR_NO_MEM;
+            }
+            size_t newSize = (mSize == 0) ? 8 : mSize * 2;
+            HandleEntry** newSlots = new HandleEntry*[newSize];
+            std::copy(mSlots, mSlots + mSize, newSlots);
+            std::fill(newSlots + mSize, newSlots + newSize, nullptr);
+            delete[] mSlots;
+            mSlots = newSlots;
+            mSize = newSize;
+        }
+        if (++mGeneration == 0) {
+            mGeneration = 1;
+        }
+        entry->mHandle = (static_cast<uint32_t>(mGeneration) << GENERATION_SHIFT) |
+                         (static_cast<uint32_t>(partitionIndex) << PARTITION_SHIFT) |
+                         static_cast<uint32_t>(slot);
+        mSlots[slot] = entry;
+        return ESP_OK;
+    }
+
+    HandleEntry* find(nvs_handle handle) const
+    {
+        size_t slot = handle & (MAX_SLOTS - 1);
+        if (slot >= mSize || mSlots[slot] == nullptr || mSlots[slot]->mHandle != handle) {
+            return nullptr;
+        }
+        return mSlots[slot];
+    }
+
+    void erase(HandleEntry* entry)
+    {
+        mSlots[entry->mHandle & (MAX_SLOTS - 1)] = nullptr;
+    }
+
+    /* Close all handles of the partition */
+    void clear(const PartitionEntry* partition)
+    {
+        for (size_t i = 0; i < mSize; ++i) {
+            if (mSlots[i] && mSlots[i]->mPartition == partition) {
+                delete mSlots[i]->mBatch;
+                delete mSlots[i];
+                mSlots[i] = nullptr;
+            }
+        }
+    }
+
+    static size_t partitionIndexOf(nvs_handle handle)
+    {
+        return (handle >> PARTITION_SHIFT) & (MAX_PARTITIONS - 1);
+    }
+
+protected:
+    static const size_t PARTITION_SHIFT = 12;
+    static const size_t GENERATION_SHIFT = 16;
+    static const size_t MAX_SLOTS = 1 << PARTITION_SHIFT;
+
+    HandleEntry** mSlots = nullptr;
+    size_t mSize = 0;
+    uint16_t mGeneration = 0;
 };
 
 #ifdef ESP_PLATFORM
 SemaphoreHandle_t nvs::Lock::mSemaphore = NULL;
+#else
+std::mutex nvs::Lock::mMutex;
 #endif
 
 using namespace std;
 using namespace nvs;
 
-static intrusive_list<HandleEntry> s_nvs_handles;
-static uint32_t s_nvs_next_handle = 1;
-static nvs::Storage s_nvs_storage;
+// Lock guards the handle table and the list of partitions only. Each partition
+// has its own lock, which is always taken before Lock.
+static HandleTable s_nvs_handles;
+static PartitionEntry* s_nvs_partitions[HandleTable::MAX_PARTITIONS];
 
-extern "C" void nvs_dump()
+static PartitionEntry* nvs_find_partition(const char* name)
 {
     Lock lock;
-    s_nvs_storage.debugDump();
+    for (size_t i = 0; i < HandleTable::MAX_PARTITIONS; ++i) {
+        if (s_nvs_partitions[i] && strncmp(s_nvs_partitions[i]->mName, name, NVS_PART_NAME_MAX_SIZE) == 0) {
+            return s_nvs_partitions[i];
+        }
+    }
+    return nullptr;
+}
+
+static PartitionEntry* nvs_default_partition()
+{
+    return nvs_find_partition(NVS_DEFAULT_PART_NAME);
+}
+
+/* Partition with the given name, or the default one if name is NULL */
+static PartitionEntry* nvs_find_partition_or_default(const char* name)
+{
+    return nvs_find_partition(name ? name : NVS_DEFAULT_PART_NAME);
+}
+
+/**
+ * Takes the lock of the partition a handle belongs to, shared or exclusive,
+ * then looks up the handle. The partition lock is held until this object is
+ * destroyed, so the handle entry can't be closed meanwhile.
+ */
+class HandleLock
+{
+public:
+    HandleLock(nvs_handle handle, bool exclusive) : mExclusive(exclusive)
+    {
+        {
+            Lock lock;
+            mPartition = s_nvs_partitions[HandleTable::partitionIndexOf(handle)];
+        }
+        if (mPartition == nullptr) {
+            return;
+        }
+        if (mExclusive) {
+            mPartition->mLock.lock();
+        } else {
+            mPartition->mLock.lockShared();
+        }
+        Lock lock;
+        mEntry = s_nvs_handles.find(handle);
+    }
+
+    ~HandleLock()
+    {
+        if (mPartition == nullptr) {
+            return;
+        }
+        if (mExclusive) {
+            mPartition->mLock.unlock();
+        } else {
+            mPartition->mLock.unlockShared();
+        }
+    }
+
+    /* Entry of the handle, or nullptr if the handle is not open */
+    HandleEntry* entry()
+    {
+        return mEntry;
+    }
+
+protected:
+    bool mExclusive;
+    PartitionEntry* mPartition = nullptr;
+    HandleEntry* mEntry = nullptr;
+};
+
+extern "C" void nvs_dump()
+{
+    PartitionEntry* partition = nvs_default_partition();
+    if (partition == nullptr) {
+        return;
+    }
+    ReadLock lock(partition->mLock);
+    partition->mStorage.debugDump();
+}
+
+extern "C" esp_err_t nvs_flash_init_partition_custom(const char* partName, uint32_t baseSector, uint32_t sectorCount)
+{
+    ESP_LOGD(TAG, "nvs_flash_init_custom %s start=%d count=%d", partName, baseSector, sectorCount);
+    PartitionEntry* partition = nvs_find_partition(partName);
+    if (partition == nullptr) {
+        Lock lock;
+        auto slot = find(begin(s_nvs_partitions), end(s_nvs_partitions), nullptr);
+        if (slot == end(s_nvs_partitions)) {
+            return ESP_ERR_NO_MEM;
+        }
+        partition = new PartitionEntry(partName);
+        *slot = partition;
+    }
+
+    WriteLock partitionLock(partition->mLock);
+    {
+        Lock lock;
+        s_nvs_handles.clear(partition);
+    }
+    return partition->mStorage.init(baseSector, sectorCount);
 }
 
 extern "C" esp_err_t nvs_flash_init_custom(uint32_t baseSector, uint32_t sectorCount)
 {
-    ESP_LOGD(TAG, "nvs_flash_init_custom start=%d count=%d", baseSector, sectorCount);
-    s_nvs_handles.clear();
-    return s_nvs_storage.init(baseSector, sectorCount);
+    return nvs_flash_init_partition_custom(NVS_DEFAULT_PART_NAME, baseSector, sectorCount);
 }
 
 #ifdef ESP_PLATFORM
-extern "C" esp_err_t nvs_flash_init(void)
+static esp_err_t nvs_flash_init_from_partition_table(const char* partName, const char* label)
 {
     Lock::init();
-    Lock lock;
-    if (s_nvs_storage.isValid()) {
-        return ESP_OK;
+    PartitionEntry* entry = nvs_find_partition(partName);
+    if (entry != nullptr) {
+        ReadLock lock(entry->mLock);
+        if (entry->mStorage.isValid()) {
+            return ESP_OK;
+        }
     }
     const esp_partition_t* partition = esp_partition_find_first(
-            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
+            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, label);
     if (partition == NULL) {
         return ESP_ERR_NOT_FOUND;
     }
 
-    return nvs_flash_init_custom(partition->address / SPI_FLASH_SEC_SIZE,
+    return nvs_flash_init_partition_custom(partName, partition->address / SPI_FLASH_SEC_SIZE,
             partition->size / SPI_FLASH_SEC_SIZE);
 }
+
+extern "C" esp_err_t nvs_flash_init(void)
+{
+    // first NVS partition in the table, whatever its label is
+    return nvs_flash_init_from_partition_table(NVS_DEFAULT_PART_NAME, NULL);
+}
+
+extern "C" esp_err_t nvs_flash_init_partition(const char* partition_label)
+{
+    return nvs_flash_init_from_partition_table(partition_label, partition_label);
+}
 #endif
 
-static esp_err_t nvs_find_ns_handle(nvs_handle handle, HandleEntry& entry)
+static esp_err_t nvs_write(const HandleEntry& entry, nvs::ItemType datatype, const char* key, const void* data, size_t dataSize)
 {
-    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
-        return e.mHandle == handle;
-    });
-    if (it == end(s_nvs_handles)) {
-        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (entry.mBatch) {
+        return entry.mBatch->set(entry.mNsIndex, datatype, key, data, dataSize);
     }
-    entry = *it;
-    return ESP_OK;
+    return entry.mPartition->mStorage.writeItem(entry.mNsIndex, datatype, key, data, dataSize);
 }
 
-extern "C" esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
+extern "C" esp_err_t nvs_open_from_partition(const char* part_name, const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
 {
-    Lock lock;
-    ESP_LOGD(TAG, "%s %s %d", __func__, name, open_mode);
+    ESP_LOGD(TAG, "%s %s %s %d", __func__, part_name, name, open_mode);
+    PartitionEntry* partition = nvs_find_partition(part_name);
+    if (partition == nullptr) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    // creating the namespace may write to flash
+    WriteLock partitionLock(partition->mLock);
     uint8_t nsIndex;
-    esp_err_t err = s_nvs_storage.createOrOpenNamespace(name, open_mode == NVS_READWRITE, nsIndex);
+    esp_err_t err = partition->mStorage.createOrOpenNamespace(name, open_mode == NVS_READWRITE, nsIndex);
     if (err != ESP_OK) {
         return err;
     }
 
-    uint32_t handle = s_nvs_next_handle;
-    ++s_nvs_next_handle;
-    *out_handle = handle;
-
-    s_nvs_handles.push_back(new HandleEntry(handle, open_mode==NVS_READONLY, nsIndex));
+    Lock lock;
+    size_t partitionIndex = find(begin(s_nvs_partitions), end(s_nvs_partitions), partition) - begin(s_nvs_partitions);
+    HandleEntry* entry = new HandleEntry(open_mode == NVS_READONLY, nsIndex, partition);
+    err = s_nvs_handles.insert(entry, partitionIndex);
+    if (err != ESP_OK) {
+        delete entry;
+        return err;
+    }
+    *out_handle = entry->mHandle;
     return ESP_OK;
 }
 
+extern "C" esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, name, open_mode, out_handle);
+}
+
 extern "C" void nvs_close(nvs_handle handle)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %d", __func__, handle);
-    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
-        return e.mHandle == handle;
-    });
-    if (it == end(s_nvs_handles)) {
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
         return;
     }
-    s_nvs_handles.erase(it);
-    delete static_cast<HandleEntry*>(it);
+    {
+        Lock tableLock;
+        s_nvs_handles.erase(entry);
+    }
+    delete entry->mBatch;
+    delete entry;
 }
 
 extern "C" esp_err_t nvs_erase_key(nvs_handle handle, const char* key)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s\r\n", __func__, key);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    if (entry.mReadOnly) {
+    if (entry->mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
-    return s_nvs_storage.eraseItem(entry.mNsIndex, key);
+    if (entry->mBatch) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    return entry->mPartition->mStorage.eraseItem(entry->mNsIndex, key);
 }
 
 extern "C" esp_err_t nvs_erase_all(nvs_handle handle)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s\r\n", __func__);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    if (entry.mReadOnly) {
+    if (entry->mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
-    return s_nvs_storage.eraseNamespace(entry.mNsIndex);
+    if (entry->mBatch) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    return entry->mPartition->mStorage.eraseNamespace(entry->mNsIndex);
 }
 
 template<typename T>
 static esp_err_t nvs_set(nvs_handle handle, const char* key, T value)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s %d %d", __func__, key, sizeof(T), (uint32_t) value);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    if (entry.mReadOnly) {
+    if (entry->mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, key, value);
+    return nvs_write(*entry, itemTypeOf(value), key, &value, sizeof(value));
 }
 
 extern "C" esp_err_t nvs_set_i8  (nvs_handle handle, const char* key, int8_t value)
@@ -218,50 +453,81 @@ extern "C" esp_err_t nvs_set_u64 (nvs_handle handle, const char* key, uint64_t v
     return nvs_set(handle, key, value);
 }
 
+extern "C" esp_err_t nvs_begin(nvs_handle handle)
+{
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (entry->mBatch) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    entry->mBatch = new nvs::Batch;
+    return ESP_OK;
+}
+
 extern "C" esp_err_t nvs_commit(nvs_handle handle)
 {
-    Lock lock;
-    // no-op for now, to be used when intermediate cache is added
-    HandleEntry entry;
-    return nvs_find_ns_handle(handle, entry);
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (entry->mBatch == nullptr) {
+        // values set outside of a batch have already been written
+        return ESP_OK;
+    }
+    auto err = entry->mPartition->mStorage.writeBatch(*entry->mBatch);
+    delete entry->mBatch;
+    entry->mBatch = nullptr;
+    return err;
 }
 
 extern "C" esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s %s", __func__, key, value);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
+    return nvs_write(*entry, nvs::ItemType::SZ, key, value, strlen(value) + 1);
 }
 
 extern "C" esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s %d", __func__, key, length);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, true);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    return s_nvs_storage.writeItem(entry.mNsIndex, nvs::ItemType::BLOB, key, value, length);
+    return nvs_write(*entry, nvs::ItemType::BLOB, key, value, length);
 }
 
 
 template<typename T>
 static esp_err_t nvs_get(nvs_handle handle, const char* key, T* out_value)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s %d", __func__, key, sizeof(T));
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, false);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
-    return s_nvs_storage.readItem(entry.mNsIndex, key, *out_value);
+    if (entry->mBatch) {
+        auto err = entry->mBatch->get(entry->mNsIndex, itemTypeOf(*out_value), key, out_value, sizeof(T));
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return entry->mPartition->mStorage.readItem(entry->mNsIndex, key, *out_value);
 }
 
 extern "C" esp_err_t nvs_get_i8  (nvs_handle handle, const char* key, int8_t* out_value)
@@ -306,18 +572,28 @@ extern "C" esp_err_t nvs_get_u64 (nvs_handle handle, const char* key, uint64_t*
 
 static esp_err_t nvs_get_str_or_blob(nvs_handle handle, nvs::ItemType type, const char* key, void* out_value, size_t* length)
 {
-    Lock lock;
     ESP_LOGD(TAG, "%s %s", __func__, key);
-    HandleEntry entry;
-    auto err = nvs_find_ns_handle(handle, entry);
-    if (err != ESP_OK) {
-        return err;
+    HandleLock lock(handle, false);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
     }
 
+    esp_err_t err;
     size_t dataSize;
-    err = s_nvs_storage.getItemDataSize(entry.mNsIndex, type, key, dataSize);
-    if (err != ESP_OK) {
-        return err;
+    bool inBatch = false;
+    if (entry->mBatch) {
+        err = entry->mBatch->getDataSize(entry->mNsIndex, type, key, dataSize);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+        inBatch = (err == ESP_OK);
+    }
+    if (!inBatch) {
+        err = entry->mPartition->mStorage.getItemDataSize(entry->mNsIndex, type, key, dataSize);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
 
     if (length == nullptr) {
@@ -330,7 +606,10 @@ static esp_err_t nvs_get_str_or_blob(nvs_handle handle, nvs::ItemType type, cons
         return ESP_ERR_NVS_INVALID_LENGTH;
     }
 
-    return s_nvs_storage.readItem(entry.mNsIndex, type, key, out_value, dataSize);
+    if (inBatch) {
+        return entry->mBatch->get(entry->mNsIndex, type, key, out_value, dataSize);
+    }
+    return entry->mPartition->mStorage.readItem(entry->mNsIndex, type, key, out_value, dataSize);
 }
 
 extern "C" esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length)
@@ -343,3 +622,94 @@ extern "C" esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_
     return nvs_get_str_or_blob(handle, nvs::ItemType::BLOB, key, out_value, length);
 }
 
+extern "C" esp_err_t nvs_get_blob_chunked(nvs_handle handle, const char* key, size_t offset, void* out_value, size_t length)
+{
+    ESP_LOGD(TAG, "%s %s %d %d", __func__, key, offset, length);
+    HandleLock lock(handle, false);
+    HandleEntry* entry = lock.entry();
+    if (entry == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (entry->mBatch) {
+        auto err = entry->mBatch->getPart(entry->mNsIndex, nvs::ItemType::BLOB, key, offset, out_value, length);
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return entry->mPartition->mStorage.readItemPart(entry->mNsIndex, nvs::ItemType::BLOB, key, offset, out_value, length);
+}
+
+static_assert(static_cast<int>(NVS_TYPE_STR) == static_cast<int>(nvs::ItemType::SZ) &&
+              static_cast<int>(NVS_TYPE_BLOB) == static_cast<int>(nvs::ItemType::BLOB) &&
+              static_cast<int>(NVS_TYPE_ANY) == static_cast<int>(nvs::ItemType::ANY),
+              "nvs_type_t values should match ItemType");
+
+extern "C" esp_err_t nvs_entry_find(const char* part_name, const char* namespace_name, nvs_type_t type, nvs_iterator_t* out_iterator)
+{
+    ESP_LOGD(TAG, "%s %s %s %d", __func__, part_name ? part_name : "", namespace_name ? namespace_name : "", type);
+    if (out_iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_iterator = nullptr;
+    PartitionEntry* partition = nvs_find_partition_or_default(part_name);
+    if (partition == nullptr) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    ReadLock lock(partition->mLock);
+    nvs_iterator_t it = new nvs_opaque_iterator_t;
+    strcpy(it->mPartName, partition->mName);
+    auto err = partition->mStorage.findEntry(it, namespace_name, static_cast<nvs::ItemType>(type));
+    if (err != ESP_OK) {
+        delete it;
+        return err;
+    }
+    *out_iterator = it;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_entry_next(nvs_iterator_t* iterator)
+{
+    ESP_LOGD(TAG, "%s", __func__);
+    if (iterator == nullptr || *iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    PartitionEntry* partition = nvs_find_partition((*iterator)->mPartName);
+    if (partition == nullptr) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    ReadLock lock(partition->mLock);
+    auto err = partition->mStorage.nextEntry(*iterator);
+    if (err != ESP_OK) {
+        delete *iterator;
+        *iterator = nullptr;
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t* out_info)
+{
+    if (iterator == nullptr || out_info == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_info = iterator->mInfo;
+    return ESP_OK;
+}
+
+extern "C" void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
+
+extern "C" esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats)
+{
+    ESP_LOGD(TAG, "%s %s", __func__, part_name ? part_name : "");
+    if (nvs_stats == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    PartitionEntry* partition = nvs_find_partition_or_default(part_name);
+    if (partition == nullptr) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    ReadLock lock(partition->mLock);
+    return partition->mStorage.fillStats(*nvs_stats);
+}
@@ -0,0 +1,121 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_batch.hpp"
+#include "nvs_page.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace nvs
+{
+
+Batch::BatchItem::BatchItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize) :
+    mNsIndex(nsIndex),
+    mDatatype(datatype),
+    mDataSize(dataSize),
+    mData(new uint8_t[dataSize])
+{
+    strncpy(mKey, key, sizeof(mKey) - 1);
+    mKey[sizeof(mKey) - 1] = 0;
+    memcpy(mData, data, dataSize);
+}
+
+Batch::BatchItem* Batch::find(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    auto it = std::find_if(mItems.begin(), mItems.end(), [=] (const BatchItem& e) -> bool {
+        return e.mNsIndex == nsIndex && e.mDatatype == datatype && strncmp(key, e.mKey, sizeof(e.mKey) - 1) == 0;
+    });
+    if (it == mItems.end()) {
+        return nullptr;
+    }
+    return it;
+}
+
+esp_err_t Batch::set(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    // items of a batch are written as single page items
+    if (isVariableLengthType(datatype) && dataSize > Page::getVarDataMaxSize()) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    BatchItem* old = find(nsIndex, datatype, key);
+    if (old) {
+        mItems.erase(old);
+        delete old;
+    }
+    mItems.push_back(new BatchItem(nsIndex, datatype, key, data, dataSize));
+    return ESP_OK;
+}
+
+esp_err_t Batch::get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+{
+    BatchItem* item = find(nsIndex, datatype, key);
+    if (!item) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (datatype == ItemType::SZ || datatype == ItemType::BLOB) {
+        if (dataSize < item->mDataSize) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+    } else if (dataSize != item->mDataSize) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    memcpy(data, item->mData, item->mDataSize);
+    return ESP_OK;
+}
+
+esp_err_t Batch::getPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize)
+{
+    BatchItem* item = find(nsIndex, datatype, key);
+    if (!item) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (offset > item->mDataSize || dataSize > item->mDataSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(data, item->mData + offset, dataSize);
+    return ESP_OK;
+}
+
+esp_err_t Batch::getDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize)
+{
+    BatchItem* item = find(nsIndex, datatype, key);
+    if (!item) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    dataSize = item->mDataSize;
+    return ESP_OK;
+}
+
+void Batch::relocate(const Page* from, Page* to)
+{
+    for (auto it = mItems.begin(); it != mItems.end(); ++it) {
+        if (it->mOldPage == from) {
+            it->mOldPage = to;
+        }
+    }
+}
+
+void Batch::clear()
+{
+    for (auto it = mItems.begin(); it != mItems.end(); ) {
+        auto tmp = it;
+        ++it;
+        mItems.erase(tmp);
+        delete static_cast<BatchItem*>(tmp);
+    }
+}
+
+} // namespace nvs
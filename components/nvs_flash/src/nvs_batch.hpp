@@ -0,0 +1,99 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_batch_hpp
+#define nvs_batch_hpp
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+#include "intrusive_list.h"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Set of item writes kept in RAM until they are written to flash by Storage::writeBatch.
+ */
+class Batch
+{
+public:
+    class BatchItem : public intrusive_list_node<BatchItem>
+    {
+    public:
+        BatchItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+        ~BatchItem()
+        {
+            delete[] mData;
+        }
+
+        uint8_t mNsIndex;
+        ItemType mDatatype;
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        size_t mDataSize;
+        uint8_t* mData;
+        // page holding the previous value of the key, used while the batch is written
+        Page* mOldPage = nullptr;
+    };
+
+    typedef intrusive_list<BatchItem> TItems;
+
+    Batch() {}
+
+    ~Batch()
+    {
+        clear();
+    }
+
+    esp_err_t set(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    esp_err_t get(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
+
+    esp_err_t getPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize);
+
+    esp_err_t getDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize);
+
+    void relocate(const Page* from, Page* to);
+
+    void clear();
+
+    TItems::iterator begin()
+    {
+        return mItems.begin();
+    }
+
+    TItems::iterator end()
+    {
+        return mItems.end();
+    }
+
+    bool empty() const
+    {
+        return mItems.empty();
+    }
+
+protected:
+    BatchItem* find(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    TItems mItems;
+
+private:
+    Batch(const Batch& other);
+    const Batch& operator= (const Batch& rhs);
+}; // class Batch
+
+} // namespace nvs
+
+#endif /* nvs_batch_hpp */
@@ -0,0 +1,124 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nvs_item_index.hpp"
+
+namespace nvs
+{
+
+ItemIndex::ItemIndex()
+{
+    static_assert(sizeof(IndexBlock) <= IndexBlock::BYTE_SIZE,
+                  "index block size calculation incorrect");
+}
+
+ItemIndex::~ItemIndex()
+{
+    clear();
+}
+
+void ItemIndex::clear()
+{
+    for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+        TBlockList& blocks = mBuckets[b];
+        for (auto it = blocks.begin(); it != blocks.end();) {
+            auto tmp = it;
+            ++it;
+            blocks.erase(tmp);
+            delete static_cast<IndexBlock*>(tmp);
+        }
+    }
+    mCount = 0;
+}
+
+void ItemIndex::insert(const Item& item, Page* page)
+{
+    const uint32_t hash = hashOf(item);
+    TBlockList& blocks = mBuckets[bucketOf(hash)];
+    ++mCount;
+    // add entry to the end of last block if possible
+    if (blocks.size()) {
+        auto& block = blocks.back();
+        if (block.mCount < IndexBlock::ENTRY_COUNT) {
+            block.mNodes[block.mCount++] = IndexNode(hash, page);
+            return;
+        }
+    }
+    IndexBlock* newBlock = new IndexBlock;
+    blocks.push_back(newBlock);
+    newBlock->mNodes[0] = IndexNode(hash, page);
+    newBlock->mCount++;
+}
+
+void ItemIndex::erase(const Item& item, const Page* page)
+{
+    const uint32_t hash = hashOf(item);
+    TBlockList& blocks = mBuckets[bucketOf(hash)];
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        for (size_t i = 0; i < it->mCount; ++i) {
+            IndexNode& node = it->mNodes[i];
+            if (node.mHash != hash || node.mPage != page) {
+                continue;
+            }
+            // keep blocks dense: replace the node with the last one in the bucket
+            IndexBlock& last = blocks.back();
+            node = last.mNodes[--last.mCount];
+            if (last.mCount == 0) {
+                IndexBlock* tmp = &last;
+                blocks.erase(tmp);
+                delete tmp;
+            }
+            --mCount;
+            return;
+        }
+    }
+}
+
+Page* ItemIndex::find(const Item& item, size_t& cookie)
+{
+    const uint32_t hash = hashOf(item);
+    TBlockList& blocks = mBuckets[bucketOf(hash)];
+    size_t pos = 0;
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        if (pos + it->mCount <= cookie) {
+            pos += it->mCount;
+            continue;
+        }
+        for (size_t i = cookie - pos; i < it->mCount; ++i) {
+            const IndexNode& node = it->mNodes[i];
+            if (node.mHash == hash) {
+                cookie = pos + i + 1;
+                return node.mPage;
+            }
+        }
+        pos += it->mCount;
+        cookie = pos;
+    }
+    return nullptr;
+}
+
+void ItemIndex::relocate(const Page* from, Page* to)
+{
+    for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+        for (auto it = mBuckets[b].begin(); it != mBuckets[b].end(); ++it) {
+            for (size_t i = 0; i < it->mCount; ++i) {
+                if (it->mNodes[i].mPage == from) {
+                    it->mNodes[i].mPage = to;
+                }
+            }
+        }
+    }
+}
+
+} // namespace nvs
@@ -0,0 +1,110 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_item_index_h
+#define nvs_item_index_h
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+#include "intrusive_list.h"
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Storage-wide index which maps (namespace, key) hash to the page holding the item.
+ *
+ * Index is a fixed number of buckets, selected by the lower bits of the hash.
+ * Each bucket is a list of small arrays, same as HashList of a page.
+ * Index may return false positives (hash collisions), callers are expected
+ * to verify the item by looking it up in the page.
+ */
+class ItemIndex
+{
+public:
+    ItemIndex();
+    ~ItemIndex();
+
+    void insert(const Item& item, Page* page);
+    void erase(const Item& item, const Page* page);
+
+    /**
+     * Find next page which may contain the item, starting after node
+     * returned by the previous call. Pass 0 as cookie to start the search.
+     * Returns nullptr if no more candidate pages exist.
+     */
+    Page* find(const Item& item, size_t& cookie);
+
+    /* Move all nodes which refer to page 'from' to page 'to' */
+    void relocate(const Page* from, Page* to);
+
+    void clear();
+
+    size_t size() const
+    {
+        return mCount;
+    }
+
+private:
+    ItemIndex(const ItemIndex& other);
+    const ItemIndex& operator= (const ItemIndex& rhs);
+
+protected:
+
+    struct IndexNode {
+        IndexNode() :
+            mHash(0), mPage(nullptr)
+        {
+        }
+
+        IndexNode(uint32_t hash, Page* page) :
+            mHash(hash), mPage(page)
+        {
+        }
+
+        uint32_t mHash;
+        Page* mPage;
+    };
+
+    struct IndexBlock : public intrusive_list_node<ItemIndex::IndexBlock> {
+        static const size_t BYTE_SIZE = 128;
+        static const size_t ENTRY_COUNT = (BYTE_SIZE - sizeof(intrusive_list_node<IndexBlock>) - sizeof(size_t)) / sizeof(IndexNode);
+
+        size_t mCount = 0;
+        IndexNode mNodes[ENTRY_COUNT];
+    };
+
+    static const size_t BUCKET_COUNT = 32;
+
+    static uint32_t hashOf(const Item& item)
+    {
+        return item.calculateCrc32WithoutValue();
+    }
+
+    static size_t bucketOf(uint32_t hash)
+    {
+        return hash % BUCKET_COUNT;
+    }
+
+    typedef intrusive_list<IndexBlock> TBlockList;
+    TBlockList mBuckets[BUCKET_COUNT];
+    size_t mCount = 0;
+}; // class ItemIndex
+
+} // namespace nvs
+
+
+#endif /* nvs_item_index_h */
@@ -35,25 +35,35 @@ esp_err_t Page::load(uint32_t sectorNumber)
     mBaseAddress = sectorNumber * SEC_SIZE;
     mUsedEntryCount = 0;
     mErasedEntryCount = 0;
-
-    Header header;
-    auto rc = spi_flash_read(mBaseAddress, &header, sizeof(header));
+    mEraseCount = 0;
+    mHashList.clear();
+    mHashListLoaded = true;
+    mCorruptEntries.reset();
+
+    // header and entry state table are read in one go
+    struct {
+        Header header;
+        uint32_t entryTable[TEntryTable::byteSize() / sizeof(uint32_t)];
+    } headerAndTable;
+    static_assert(sizeof(headerAndTable) == ENTRY_DATA_OFFSET - HEADER_OFFSET, "header and entry table should be adjacent");
+    auto rc = spi_flash_read(mBaseAddress + HEADER_OFFSET, &headerAndTable, sizeof(headerAndTable));
     if (rc != ESP_OK) {
         mState = PageState::INVALID;
         return rc;
     }
+    Header& header = headerAndTable.header;
     if (header.mState == PageState::UNINITIALIZED) {
         mState = header.mState;
         // check if the whole page is really empty
         // reading the whole page takes ~40 times less than erasing it
-        uint32_t line[8];
-        for (uint32_t i = 0; i < SPI_FLASH_SEC_SIZE; i += sizeof(line)) {
-            rc = spi_flash_read(mBaseAddress + i, line, sizeof(line));
+        uint32_t block[64];
+        for (uint32_t i = 0; i < SPI_FLASH_SEC_SIZE; i += sizeof(block)) {
+            rc = spi_flash_read(mBaseAddress + i, block, sizeof(block));
             if (rc != ESP_OK) {
                 mState = PageState::INVALID;
                 return rc;
             }
-            if (std::any_of(line, line + 4, [](uint32_t val) -> bool { return val != 0xffffffff; })) {
+            if (std::any_of(std::begin(block), std::end(block), [](uint32_t val) -> bool { return val != 0xffffffff; })) {
                 // page isn't as empty after all, mark it as corrupted
                 mState = PageState::CORRUPT;
                 break;
@@ -64,6 +74,7 @@ esp_err_t Page::load(uint32_t sectorNumber)
     } else {
         mState = header.mState;
         mSeqNumber = header.mSeqNumber;
+        mEraseCount = (header.mEraseCount == UINT32_MAX) ? 0 : header.mEraseCount;
     }
 
     switch (mState) {
@@ -73,6 +84,7 @@ esp_err_t Page::load(uint32_t sectorNumber)
     case PageState::FULL:
     case PageState::ACTIVE:
     case PageState::FREEING:
+        std::copy(std::begin(headerAndTable.entryTable), std::end(headerAndTable.entryTable), mEntryTable.data());
         mLoadEntryTable();
         break;
 
@@ -84,7 +96,7 @@ esp_err_t Page::load(uint32_t sectorNumber)
     return ESP_OK;
 }
 
-esp_err_t Page::writeEntry(const Item& item)
+esp_err_t Page::writeEntry(const Item& item, bool stage)
 {
     auto rc = spi_flash_write(getEntryAddress(mNextFreeEntry), &item, sizeof(item));
     if (rc != ESP_OK) {
@@ -92,26 +104,22 @@ esp_err_t Page::writeEntry(const Item& item)
         return rc;
     }
 
-    auto err = alterEntryState(mNextFreeEntry, EntryState::WRITTEN);
-    if (err != ESP_OK) {
-        return err;
-    }
-
-    if (mFirstUsedEntry == INVALID_ENTRY) {
-        mFirstUsedEntry = mNextFreeEntry;
+    if (!stage) {
+        auto err = alterEntryState(mNextFreeEntry, EntryState::WRITTEN);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
 
-    ++mUsedEntryCount;
-    ++mNextFreeEntry;
-
+    advanceNextFreeEntry(1, stage);
     return ESP_OK;
 }
     
-esp_err_t Page::writeEntryData(const uint8_t* data, size_t size)
+esp_err_t Page::writeEntryData(const uint8_t* data, size_t size, bool stage)
 {
     assert(size % ENTRY_SIZE == 0);
     assert(mNextFreeEntry != INVALID_ENTRY);
-    assert(mFirstUsedEntry != INVALID_ENTRY);
+    assert(mFirstUsedEntry != INVALID_ENTRY || mFirstStagedEntry != INVALID_ENTRY);
     const uint16_t count = size / ENTRY_SIZE;
     
     const uint8_t* buf = data;
@@ -142,16 +150,72 @@ esp_err_t Page::writeEntryData(const uint8_t* data, size_t size)
         mState = PageState::INVALID;
         return rc;
     }
-    auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + count, EntryState::WRITTEN);
-    if (err != ESP_OK) {
-        return err;
+    if (!stage) {
+        auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + count, EntryState::WRITTEN);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    advanceNextFreeEntry(count, stage);
+    return ESP_OK;
+}
+
+void Page::advanceNextFreeEntry(size_t count, bool stage)
+{
+    if (stage) {
+        if (mFirstStagedEntry == INVALID_ENTRY) {
+            mFirstStagedEntry = mNextFreeEntry;
+        }
+    } else {
+        if (mFirstUsedEntry == INVALID_ENTRY) {
+            mFirstUsedEntry = mNextFreeEntry;
+        }
+        mUsedEntryCount += count;
     }
-    mUsedEntryCount += count;
     mNextFreeEntry += count;
+}
+
+esp_err_t Page::commitStagedEntries()
+{
+    if (mFirstStagedEntry == INVALID_ENTRY) {
+        return ESP_OK;
+    }
+    const size_t begin = mFirstStagedEntry;
+    const size_t end = mNextFreeEntry;
+    mFirstStagedEntry = INVALID_ENTRY;
+
+    for (size_t i = begin; i < end; ++i) {
+        mEntryTable.set(i, EntryState::WRITTEN);
+    }
+    // update all affected words of entry state table with one write
+    const size_t firstWord = mEntryTable.getWordIndex(begin);
+    const size_t lastWord = mEntryTable.getWordIndex(end - 1);
+    auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(firstWord) * 4,
+            mEntryTable.data() + firstWord, (lastWord - firstWord + 1) * 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = begin;
+    }
+    mUsedEntryCount += end - begin;
     return ESP_OK;
 }
 
-esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId, uint8_t chunkIdx)
+{
+    assert(mFirstStagedEntry == INVALID_ENTRY);
+    return writeItem(nsIndex, datatype, key, data, dataSize, batchId, chunkIdx, false);
+}
+
+esp_err_t Page::stageItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId)
+{
+    return writeItem(nsIndex, datatype, key, data, dataSize, batchId, Item::CHUNK_ANY, true);
+}
+
+esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId, uint8_t chunkIdx, bool stage)
 {
     Item item;
     esp_err_t err;
@@ -178,14 +242,17 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
 
     size_t totalSize = ENTRY_SIZE;
     size_t entriesCount = 1;
-    if (datatype == ItemType::SZ || datatype == ItemType::BLOB) {
+    if (isVariableLengthType(datatype)) {
+        if (dataSize > getVarDataMaxSize()) {
+            return ESP_ERR_NVS_VALUE_TOO_LONG;
+        }
         size_t roundedSize = (dataSize + ENTRY_SIZE - 1) & ~(ENTRY_SIZE - 1);
         totalSize += roundedSize;
         entriesCount += roundedSize / ENTRY_SIZE;
     }
 
     // primitive types should fit into one entry
-    assert(totalSize == ENTRY_SIZE || datatype == ItemType::BLOB || datatype == ItemType::SZ);
+    assert(totalSize == ENTRY_SIZE || isVariableLengthType(datatype));
 
     if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + entriesCount > ENTRY_COUNT) {
         // page will not fit this amount of data
@@ -195,12 +262,13 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     // write first item
     size_t span = (totalSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
     item = Item(nsIndex, datatype, span, key);
+    item.reserved = batchId;
     mHashList.insert(item, mNextFreeEntry);
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    if (!isVariableLengthType(datatype)) {
         memcpy(item.data, data, dataSize);
         item.crc32 = item.calculateCrc32();
-        err = writeEntry(item);
+        err = writeEntry(item, stage);
         if (err != ESP_OK) {
             return err;
         }
@@ -208,16 +276,17 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
         const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
         item.varLength.dataCrc32 = Item::calculateCrc32(src, dataSize);
         item.varLength.dataSize = dataSize;
-        item.varLength.reserved2 = 0xffff;
+        item.varLength.chunkIndex = chunkIdx;
+        item.varLength.reserved2 = 0xff;
         item.crc32 = item.calculateCrc32();
-        err = writeEntry(item);
+        err = writeEntry(item, stage);
         if (err != ESP_OK) {
             return err;
         }
 
         size_t left = dataSize / ENTRY_SIZE * ENTRY_SIZE;
         if (left > 0) {
-            err = writeEntryData(static_cast<const uint8_t*>(data), left);
+            err = writeEntryData(static_cast<const uint8_t*>(data), left, stage);
             if (err != ESP_OK) {
                 return err;
             }
@@ -227,7 +296,7 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
         if (tail > 0) {
             std::fill_n(item.rawData, ENTRY_SIZE / 4, 0xffffffff);
             memcpy(item.rawData, static_cast<const uint8_t*>(data) + left, tail);
-            err = writeEntry(item);
+            err = writeEntry(item, stage);
             if (err != ESP_OK) {
                 return err;
             }
@@ -237,7 +306,7 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
-esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx)
 {
     size_t index = 0;
     Item item;
@@ -246,12 +315,12 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
         return ESP_ERR_NVS_INVALID_STATE;
     }
     
-    esp_err_t rc = findItem(nsIndex, datatype, key, index, item);
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
     if (rc != ESP_OK) {
         return rc;
     }
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    if (!isVariableLengthType(datatype)) {
         if (dataSize != getAlignmentForType(datatype)) {
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
@@ -279,7 +348,7 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
         dst += willCopy;
     }
     if (Item::calculateCrc32(reinterpret_cast<uint8_t*>(data), item.varLength.dataSize) != item.varLength.dataCrc32) {
-        rc = eraseEntryAndSpan(index);
+        rc = eraseCorruptEntry(index);
         if (rc != ESP_OK) {
             return rc;
         }
@@ -288,32 +357,177 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
     return ESP_OK;
 }
 
-esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
+esp_err_t Page::readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, uint8_t chunkIdx)
 {
     size_t index = 0;
     Item item;
-    esp_err_t rc = findItem(nsIndex, datatype, key, index, item);
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (!isVariableLengthType(datatype)) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    const size_t itemSize = item.varLength.dataSize;
+    if (offset > itemSize || dataSize > itemSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    const size_t end = offset + dataSize;
+    uint32_t crc32 = 0xffffffff;
+    size_t pos = 0;
+    size_t i = index + 1;
+    while (pos < itemSize) {
+        // whole entries inside the requested range go straight to the destination
+        uint8_t* runDst = dst + (pos - offset);
+        if (pos >= offset && pos + ENTRY_SIZE <= end && reinterpret_cast<uintptr_t>(runDst) % 4 == 0) {
+            size_t runSize = (end - pos) / ENTRY_SIZE * ENTRY_SIZE;
+            rc = spi_flash_read(getEntryAddress(i), runDst, runSize);
+            if (rc != ESP_OK) {
+                return rc;
+            }
+            crc32 = Item::calculateCrc32(runDst, runSize, crc32);
+            pos += runSize;
+            i += runSize / ENTRY_SIZE;
+            continue;
+        }
+
+        Item ditem;
+        rc = readEntry(i, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t willRead = ENTRY_SIZE;
+        willRead = (itemSize - pos < willRead) ? itemSize - pos : willRead;
+        crc32 = Item::calculateCrc32(ditem.rawData, willRead, crc32);
+        size_t copyBegin = std::max(pos, offset);
+        size_t copyEnd = std::min(pos + willRead, end);
+        if (copyBegin < copyEnd) {
+            memcpy(dst + (copyBegin - offset), ditem.rawData + (copyBegin - pos), copyEnd - copyBegin);
+        }
+        pos += willRead;
+        ++i;
+    }
+    if (crc32 != item.varLength.dataCrc32) {
+        rc = eraseCorruptEntry(index);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx)
+{
+    size_t index = 0;
+    Item item;
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
     if (rc != ESP_OK) {
         return rc;
     }
-    if (CachedFindInfo(nsIndex, datatype, key) == mFindInfo) {
+    if (CachedFindInfo(nsIndex, datatype, key, chunkIdx) == mFindInfo) {
         invalidateCache();
     }
     return eraseEntryAndSpan(index);
 }
 
-esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key)
+esp_err_t Page::stageEraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
 {
     size_t index = 0;
     Item item;
-    return findItem(nsIndex, datatype, key, index, item);
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+    invalidateCache();
+    return eraseEntryAndSpan(index, true);
 }
 
-esp_err_t Page::eraseEntryAndSpan(size_t index)
+esp_err_t Page::commitStagedErases()
+{
+    if (mFirstStagedEraseWord == INVALID_ENTRY) {
+        return ESP_OK;
+    }
+    const size_t firstWord = mFirstStagedEraseWord;
+    const size_t lastWord = mLastStagedEraseWord;
+    mFirstStagedEraseWord = INVALID_ENTRY;
+    mLastStagedEraseWord = 0;
+
+    // update all affected words of entry state table with one write
+    auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(firstWord) * 4,
+            mEntryTable.data() + firstWord, (lastWord - firstWord + 1) * 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseItemAt(size_t itemIndex)
+{
+    if (mFindInfo.itemIndex() == itemIndex) {
+        invalidateCache();
+    }
+    return eraseEntryAndSpan(itemIndex);
+}
+
+esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx)
+{
+    size_t index = 0;
+    Item item;
+    return findItem(nsIndex, datatype, key, index, item, chunkIdx);
+}
+
+esp_err_t Page::eraseCorruptEntry(size_t index)
+{
+    if (mReadMutex == nullptr) {
+        return eraseEntryAndSpan(index);
+    }
+    // lookups may run concurrently, and a reader must not change the entry table
+    // or write to flash, so the entry is erased later by a writer
+    MutexLock lock(mReadMutex);
+    mCorruptEntries.set(index);
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseCorruptEntries()
+{
+    for (size_t i = 0; i < ENTRY_COUNT && mCorruptEntries.any(); ++i) {
+        if (!mCorruptEntries.test(i)) {
+            continue;
+        }
+        mCorruptEntries.reset(i);
+        if (mEntryTable.get(i) != EntryState::WRITTEN) {
+            continue;
+        }
+        if (mFindInfo.itemIndex() == i) {
+            invalidateCache();
+        }
+        auto rc = eraseEntryAndSpan(i);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseEntryAndSpan(size_t index, bool stage)
 {
     auto state = mEntryTable.get(index);
     assert(state == EntryState::WRITTEN || state == EntryState::EMPTY);
-    mHashList.erase(index);
+    assert(!stage || state == EntryState::WRITTEN);
+    if (mHashListLoaded) {
+        mHashList.erase(index);
+    }
 
     size_t span = 1;
     if (state == EntryState::WRITTEN) {
@@ -323,12 +537,8 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
             return rc;
         }
         if (item.calculateCrc32() != item.crc32) {
-            rc = alterEntryState(index, EntryState::ERASED);
             --mUsedEntryCount;
             ++mErasedEntryCount;
-            if (rc != ESP_OK) {
-                return rc;
-            }
         } else {
             span = item.span;
             for (ptrdiff_t i = index + span - 1; i >= static_cast<ptrdiff_t>(index); --i) {
@@ -337,14 +547,24 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
                 }
                 ++mErasedEntryCount;
             }
-            if (span == 1) {
-                rc = alterEntryState(index, EntryState::ERASED);
-            } else {
-                rc = alterEntryRangeState(index, index + span, EntryState::ERASED);
+        }
+        if (stage) {
+            for (size_t i = index; i < index + span; ++i) {
+                mEntryTable.set(i, EntryState::ERASED);
             }
-            if (rc != ESP_OK) {
-                return rc;
+            if (mFirstStagedEraseWord == INVALID_ENTRY || mEntryTable.getWordIndex(index) < mFirstStagedEraseWord) {
+                mFirstStagedEraseWord = mEntryTable.getWordIndex(index);
             }
+            if (mEntryTable.getWordIndex(index + span - 1) > mLastStagedEraseWord) {
+                mLastStagedEraseWord = mEntryTable.getWordIndex(index + span - 1);
+            }
+        } else if (span == 1) {
+            rc = alterEntryState(index, EntryState::ERASED);
+        } else {
+            rc = alterEntryRangeState(index, index + span, EntryState::ERASED);
+        }
+        if (rc != ESP_OK) {
+            return rc;
         }
     } else {
         auto rc = alterEntryState(index, EntryState::ERASED);
@@ -425,18 +645,6 @@ esp_err_t Page::moveItem(Page& other)
 
 esp_err_t Page::mLoadEntryTable()
 {
-    // for states where we actually care about data in the page, read entry state table
-    if (mState == PageState::ACTIVE ||
-            mState == PageState::FULL ||
-            mState == PageState::FREEING) {
-        auto rc = spi_flash_read(mBaseAddress + ENTRY_TABLE_OFFSET, mEntryTable.data(),
-                                 mEntryTable.byteSize());
-        if (rc != ESP_OK) {
-            mState = PageState::INVALID;
-            return rc;
-        }
-    }
-
     mErasedEntryCount = 0;
     mUsedEntryCount = 0;
     for (size_t i = 0; i < ENTRY_COUNT; ++i) {
@@ -474,17 +682,31 @@ esp_err_t Page::mLoadEntryTable()
                 return rc;
             }
             if (header != 0xffffffff) {
-                auto oldState = mEntryTable.get(mNextFreeEntry);
-                auto err = alterEntryState(mNextFreeEntry, EntryState::ERASED);
+                // entries of a staged item are written before their state is updated,
+                // so if this is a valid item header, its data entries have to be skipped too
+                size_t span = 1;
+                Item item;
+                rc = readEntry(mNextFreeEntry, item);
+                if (rc != ESP_OK) {
+                    mState = PageState::INVALID;
+                    return rc;
+                }
+                if (item.crc32 == item.calculateCrc32() && item.span > 1 &&
+                        mNextFreeEntry + item.span <= ENTRY_COUNT) {
+                    span = item.span;
+                }
+                for (size_t i = mNextFreeEntry; i < mNextFreeEntry + span; ++i) {
+                    if (mEntryTable.get(i) == EntryState::WRITTEN) {
+                        --mUsedEntryCount;
+                    }
+                    ++mErasedEntryCount;
+                }
+                auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + span, EntryState::ERASED);
                 if (err != ESP_OK) {
                     mState = PageState::INVALID;
                     return err;
                 }
-                ++mNextFreeEntry;
-                if (oldState == EntryState::WRITTEN) {
-                    --mUsedEntryCount;
-                }
-                ++mErasedEntryCount;
+                mNextFreeEntry += span;
             }
             else {
                 break;
@@ -529,7 +751,7 @@ esp_err_t Page::mLoadEntryTable()
             }
 
             
-            if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+            if (isVariableLengthType(item.datatype)) {
                 span = item.span;
                 bool needErase = false;
                 for (size_t j = i; j < i + span; ++j) {
@@ -545,16 +767,32 @@ esp_err_t Page::mLoadEntryTable()
                 }
             }
             
-            if (duplicateIndex < i) {
-                eraseEntryAndSpan(duplicateIndex);
+            // duplicates created by a batch are resolved by Storage, once it is known
+            // whether the batch was committed
+            if (item.reserved == Item::BATCH_NONE) {
+                // hash only covers namespace and key, which are shared by all chunks of a blob
+                for (; duplicateIndex < i; duplicateIndex = mHashList.find(duplicateIndex + 1, item)) {
+                    Item dupItem;
+                    err = readEntry(duplicateIndex, dupItem);
+                    if (err != ESP_OK) {
+                        mState = PageState::INVALID;
+                        return err;
+                    }
+                    if (dupItem.datatype == item.datatype &&
+                            dupItem.getChunkIndex() == item.getChunkIndex() &&
+                            strncmp(dupItem.key, item.key, Item::MAX_KEY_LENGTH) == 0) {
+                        eraseEntryAndSpan(duplicateIndex);
+                        break;
+                    }
+                }
             }
         }
 
         // check that last item is not duplicate
-        if (lastItemIndex != INVALID_ENTRY) {
+        if (lastItemIndex != INVALID_ENTRY && item.reserved == Item::BATCH_NONE) {
             size_t findItemIndex = 0;
             Item dupItem;
-            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem) == ESP_OK) {
+            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem, item.getChunkIndex()) == ESP_OK) {
                 if (findItemIndex < lastItemIndex) {
                     auto err = eraseEntryAndSpan(findItemIndex);
                     if (err != ESP_OK) {
@@ -565,28 +803,36 @@ esp_err_t Page::mLoadEntryTable()
             }
         }
     } else if (mState == PageState::FULL || mState == PageState::FREEING) {
-        // We have already filled mHashList for page in active state.
-        // Do the same for the case when page is in full or freeing state.
-        Item item;
-        for (size_t i = mFirstUsedEntry; i < ENTRY_COUNT; ++i) {
-            if (mEntryTable.get(i) != EntryState::WRITTEN) {
-                continue;
-            }
+        // Entries of full pages don't need to be checked, so reading them
+        // to fill mHashList is deferred until the page is searched by key.
+        mHashListLoaded = false;
+    }
 
-            auto err = readEntry(i, item);
-            if (err != ESP_OK) {
-                mState = PageState::INVALID;
-                return err;
-            }
+    return ESP_OK;
+}
 
-            mHashList.insert(item, i);
+esp_err_t Page::loadHashList()
+{
+    Item item;
+    for (size_t i = mFirstUsedEntry; i < ENTRY_COUNT; ++i) {
+        if (mEntryTable.get(i) != EntryState::WRITTEN) {
+            continue;
+        }
 
-            size_t span = item.span;
-            i += span - 1;
+        auto err = readEntry(i, item);
+        if (err != ESP_OK) {
+            // called by lookups, which don't change the page state; loading is
+            // tried again by the next lookup
+            mHashList.clear();
+            return err;
         }
 
-    }
+        mHashList.insert(item, i);
 
+        size_t span = item.span;
+        i += span - 1;
+    }
+    mHashListLoaded = true;
     return ESP_OK;
 }
 
@@ -598,6 +844,7 @@ esp_err_t Page::initialize()
     Header header;
     header.mState = mState;
     header.mSeqNumber = mSeqNumber;
+    header.mEraseCount = mEraseCount;
     header.mCrc32 = header.calculateCrc32();
 
     auto rc = spi_flash_write(mBaseAddress, &header, sizeof(header));
@@ -607,6 +854,8 @@ esp_err_t Page::initialize()
     }
 
     mNextFreeEntry = 0;
+    mFirstStagedEntry = INVALID_ENTRY;
+    mFirstStagedEraseWord = INVALID_ENTRY;
     std::fill_n(mEntryTable.data(), mEntryTable.byteSize() / sizeof(uint32_t), 0xffffffff);
     invalidateCache();
     return ESP_OK;
@@ -674,7 +923,7 @@ esp_err_t Page::readEntry(size_t index, Item& dst) const
     return ESP_OK;
 }
 
-esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item)
+esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint8_t chunkIdx)
 {
     if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
         return ESP_ERR_NVS_NOT_FOUND;
@@ -685,9 +934,14 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
         return ESP_ERR_NVS_NOT_FOUND;
     }
 
-    CachedFindInfo findInfo(nsIndex, datatype, key);
-    if (mFindInfo == findInfo) {
-        findBeginIndex = mFindInfo.itemIndex();
+    CachedFindInfo findInfo(nsIndex, datatype, key, chunkIdx);
+    bool haveCorruptEntries;
+    {
+        MutexLock lock(mReadMutex);
+        if (mFindInfo == findInfo) {
+            findBeginIndex = mFindInfo.itemIndex();
+        }
+        haveCorruptEntries = mCorruptEntries.any();
     }
 
     size_t start = mFirstUsedEntry;
@@ -701,6 +955,13 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
     }
 
     if (nsIndex != NS_ANY && datatype != ItemType::ANY && key != NULL) {
+        MutexLock lock(mReadMutex);
+        if (!mHashListLoaded) {
+            auto err = loadHashList();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
         size_t cachedIndex = mHashList.find(start, Item(nsIndex, datatype, 0, key));
         if (cachedIndex < ENTRY_COUNT) {
             start = cachedIndex;
@@ -716,22 +977,29 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
             continue;
         }
 
+        // readers may share the page, so a read failure is only reported
         auto rc = readEntry(i, item);
         if (rc != ESP_OK) {
-            mState = PageState::INVALID;
             return rc;
         }
 
         auto crc32 = item.calculateCrc32();
         if (item.crc32 != crc32) {
-            eraseEntryAndSpan(i);
+            eraseCorruptEntry(i);
             continue;
         }
 
-        if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+        if (isVariableLengthType(item.datatype)) {
             next = i + item.span;
         }
 
+        if (haveCorruptEntries) {
+            MutexLock lock(mReadMutex);
+            if (mCorruptEntries.test(i)) {
+                continue;
+            }
+        }
+
         if (nsIndex != NS_ANY && item.nsIndex != nsIndex) {
             continue;
         }
@@ -741,11 +1009,20 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
         }
 
         if (datatype != ItemType::ANY && item.datatype != datatype) {
+            // single page blob, blob index and blob chunks may share the key
+            if (item.datatype == ItemType::BLOB_DATA || (isBlobType(datatype) && isBlobType(item.datatype))) {
+                continue;
+            }
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
 
+        if (chunkIdx != Item::CHUNK_ANY && item.getChunkIndex() != chunkIdx) {
+            continue;
+        }
+
         itemIndex = i;
         findInfo.setItemIndex(static_cast<uint32_t>(itemIndex));
+        MutexLock lock(mReadMutex);
         mFindInfo = findInfo;
 
         return ESP_OK;
@@ -781,12 +1058,17 @@ esp_err_t Page::erase()
         mState = PageState::INVALID;
         return rc;
     }
+    ++mEraseCount;
     mUsedEntryCount = 0;
     mErasedEntryCount = 0;
     mFirstUsedEntry = INVALID_ENTRY;
     mNextFreeEntry = INVALID_ENTRY;
+    mFirstStagedEntry = INVALID_ENTRY;
+    mFirstStagedEraseWord = INVALID_ENTRY;
     mState = PageState::UNINITIALIZED;
     mHashList.clear();
+    mHashListLoaded = true;
+    mCorruptEntries.reset();
     return ESP_OK;
 }
 
@@ -798,6 +1080,17 @@ esp_err_t Page::markFreeing()
     return alterPageState(PageState::FREEING);
 }
 
+size_t Page::getVarDataTailroom() const
+{
+    if (mState == PageState::UNINITIALIZED) {
+        return getVarDataMaxSize();
+    }
+    if (mState != PageState::ACTIVE || mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + 1 >= ENTRY_COUNT) {
+        return 0;
+    }
+    return (ENTRY_COUNT - mNextFreeEntry - 1) * ENTRY_SIZE;
+}
+
 esp_err_t Page::markFull()
 {
     if (mState != PageState::ACTIVE) {
@@ -20,10 +20,12 @@
 #include <type_traits>
 #include <cstring>
 #include <algorithm>
+#include <bitset>
 #include "esp_spi_flash.h"
 #include "compressed_enum_table.hpp"
 #include "intrusive_list.h"
 #include "nvs_item_hash_list.hpp"
+#include "nvs_platform.hpp"
 
 namespace nvs
 {
@@ -32,16 +34,22 @@ class CachedFindInfo
 {
 public:
     CachedFindInfo() { }
-    CachedFindInfo(uint8_t nsIndex, ItemType type, const char* key) :
-        mKeyPtr(key),
+    CachedFindInfo(uint8_t nsIndex, ItemType type, const char* key, uint8_t chunkIdx = Item::CHUNK_ANY) :
         mNsIndex(nsIndex),
-        mType(type)
+        mType(type),
+        mChunkIdx(chunkIdx)
     {
+        // key is copied: callers may reuse the same buffer for different keys
+        if (key != nullptr) {
+            strncpy(mKey, key, sizeof(mKey) - 1);
+            mHasKey = true;
+        }
     }
 
     bool operator==(const CachedFindInfo& other) const
     {
-        return mKeyPtr != nullptr && mKeyPtr == other.mKeyPtr && mType == other.mType && mNsIndex == other.mNsIndex;
+        return mHasKey && other.mHasKey && mType == other.mType && mNsIndex == other.mNsIndex && mChunkIdx == other.mChunkIdx &&
+               strncmp(mKey, other.mKey, sizeof(mKey)) == 0;
     }
 
     void setItemIndex(uint32_t index)
@@ -55,9 +63,11 @@ public:
 
 protected:
     uint32_t mItemIndex = 0;
-    const char* mKeyPtr = nullptr;
+    char mKey[Item::MAX_KEY_LENGTH + 1] = {0};
+    bool mHasKey = false;
     uint8_t mNsIndex = 0;
     ItemType mType;
+    uint8_t mChunkIdx = Item::CHUNK_ANY;
 
 };
 
@@ -114,15 +124,42 @@ public:
 
     esp_err_t setSeqNumber(uint32_t seqNumber);
 
-    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId = Item::BATCH_NONE, uint8_t chunkIdx = Item::CHUNK_ANY);
+
+    /**
+     * Write item entries into the page without marking them as written in the
+     * entry state table. Staged items are not visible until commitStagedEntries
+     * is called, which updates entry state table for all of them at once.
+     */
+    esp_err_t stageItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId);
+
+    esp_err_t commitStagedEntries();
+
+    /**
+     * Erase an item in the RAM copy of entry state table only. Entry state
+     * table in flash is updated for all staged erases at once by
+     * commitStagedErases.
+     */
+    esp_err_t stageEraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    esp_err_t commitStagedErases();
+
+    esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx = Item::CHUNK_ANY);
 
-    esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
+    /**
+     * Read dataSize bytes of a variable length item, starting at offset.
+     * Data is read from flash directly into the destination buffer where possible.
+     * The rest of the item is read through a small buffer to verify its CRC.
+     */
+    esp_err_t readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, uint8_t chunkIdx = Item::CHUNK_ANY);
 
-    esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
+    esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = Item::CHUNK_ANY);
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key);
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = Item::CHUNK_ANY);
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item);
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint8_t chunkIdx = Item::CHUNK_ANY);
+
+    esp_err_t eraseItemAt(size_t itemIndex);
 
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
@@ -152,6 +189,22 @@ public:
         return mErasedEntryCount;
     }
 
+    /* Number of times the sector was erased, as far as it is known. Count is kept
+     * in the page header, so it is lost if the page is erased and not initialized again. */
+    uint32_t getEraseCount() const
+    {
+        return mEraseCount;
+    }
+
+    /* Number of data bytes of a variable length item which can still be written to this page */
+    size_t getVarDataTailroom() const;
+
+    /* Largest variable length item which fits into an empty page */
+    static constexpr size_t getVarDataMaxSize()
+    {
+        return (ENTRY_COUNT - 1) * ENTRY_SIZE;
+    }
+
 
     esp_err_t markFull();
 
@@ -163,6 +216,23 @@ public:
 
     void invalidateCache();
 
+    /**
+     * Erase the entries in which lookups have found CRC errors. Lookups only
+     * record such entries if the page has a read mutex, because other readers
+     * may be using the page; this must be called with exclusive access.
+     */
+    esp_err_t eraseCorruptEntries();
+
+    /**
+     * Set the mutex which guards the state changed by lookups: find cache, hash list
+     * and the set of entries with CRC errors. Needed if several readers use the page
+     * at the same time; any other change of the page requires exclusive access.
+     */
+    void setReadMutex(Mutex* mutex)
+    {
+        mReadMutex = mutex;
+    }
+
     void debugDump() const;
 
 protected:
@@ -170,14 +240,15 @@ protected:
     class Header
     {
     public:
-        Header()
+        Header() : mEraseCount(UINT32_MAX)
         {
             std::fill_n(mReserved, sizeof(mReserved)/sizeof(mReserved[0]), UINT32_MAX);
         }
 
         PageState mState;       // page state
         uint32_t mSeqNumber;    // sequence number of this page
-        uint32_t mReserved[5];  // unused, must be 0xffffffff
+        uint32_t mEraseCount;   // number of times the sector was erased, 0xffffffff if unknown
+        uint32_t mReserved[4];  // unused, must be 0xffffffff
         uint32_t mCrc32;        // crc of everything except mState
 
         uint32_t calculateCrc32();
@@ -192,6 +263,8 @@ protected:
 
     esp_err_t mLoadEntryTable();
 
+    esp_err_t loadHashList();
+
     esp_err_t initialize();
 
     esp_err_t alterEntryState(size_t index, EntryState state);
@@ -202,11 +275,17 @@ protected:
 
     esp_err_t readEntry(size_t index, Item& dst) const;
 
-    esp_err_t writeEntry(const Item& item);
+    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchId, uint8_t chunkIdx, bool stage);
+
+    esp_err_t writeEntry(const Item& item, bool stage = false);
     
-    esp_err_t writeEntryData(const uint8_t* data, size_t size);
+    esp_err_t writeEntryData(const uint8_t* data, size_t size, bool stage = false);
+
+    void advanceNextFreeEntry(size_t count, bool stage);
+
+    esp_err_t eraseEntryAndSpan(size_t index, bool stage = false);
 
-    esp_err_t eraseEntryAndSpan(size_t index);
+    esp_err_t eraseCorruptEntry(size_t index);
 
     void updateFirstUsedEntry(size_t index, size_t span);
 
@@ -226,15 +305,23 @@ protected:
     uint32_t mBaseAddress = 0;
     PageState mState = PageState::INVALID;
     uint32_t mSeqNumber = UINT32_MAX;
+    uint32_t mEraseCount = 0;
     typedef CompressedEnumTable<EntryState, 2, ENTRY_COUNT> TEntryTable;
     TEntryTable mEntryTable;
     size_t mNextFreeEntry = INVALID_ENTRY;
     size_t mFirstUsedEntry = INVALID_ENTRY;
+    size_t mFirstStagedEntry = INVALID_ENTRY;
+    size_t mFirstStagedEraseWord = INVALID_ENTRY;
+    size_t mLastStagedEraseWord = 0;
     uint16_t mUsedEntryCount = 0;
     uint16_t mErasedEntryCount = 0;
 
     CachedFindInfo mFindInfo;
     HashList mHashList;
+    bool mHashListLoaded = true;
+    Mutex* mReadMutex = nullptr;
+    // entries with CRC errors, left for eraseCorruptEntries
+    std::bitset<ENTRY_COUNT> mCorruptEntries;
 
     static const uint32_t HEADER_OFFSET = 0;
     static const uint32_t ENTRY_TABLE_OFFSET = HEADER_OFFSET + 32;
@@ -12,9 +12,44 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_pagemanager.hpp"
+#include <algorithm>
 
 namespace nvs
 {
+
+static const MostErasedReclaimPolicy s_defaultReclaimPolicy;
+
+Page* OldestPageReclaimPolicy::selectPage(intrusive_list<Page>& pages) const
+{
+    // pages are ordered by sequence number
+    auto it = std::find_if(pages.begin(), pages.end(), [](const Page& page) -> bool {
+        return page.getErasedEntryCount() > 0;
+    });
+    if (it == pages.end()) {
+        return nullptr;
+    }
+    return it;
+}
+
+Page* MostErasedReclaimPolicy::selectPage(intrusive_list<Page>& pages) const
+{
+    Page* best = nullptr;
+    for (auto it = pages.begin(); it != pages.end(); ++it) {
+        if (it->getErasedEntryCount() == 0) {
+            continue;
+        }
+        if (best == nullptr ||
+                it->getErasedEntryCount() > best->getErasedEntryCount() ||
+                (it->getErasedEntryCount() == best->getErasedEntryCount() &&
+                 (it->getUsedEntryCount() < best->getUsedEntryCount() ||
+                  (it->getUsedEntryCount() == best->getUsedEntryCount() &&
+                   it->getEraseCount() < best->getEraseCount())))) {
+            best = it;
+        }
+    }
+    return best;
+}
+
 esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
 {
     mBaseSector = baseSector;
@@ -24,6 +59,7 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     mPages.reset(new Page[sectorCount]);
 
     for (uint32_t i = 0; i < sectorCount; ++i) {
+        mPages[i].setReadMutex(&mReadMutex);
         auto err = mPages[i].load(baseSector + i);
         if (err != ESP_OK) {
             return err;
@@ -53,25 +89,9 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
         mSeqNumber = lastSeqNo + 1;
     }
 
-    // if power went out after a new item for the given key was written,
-    // but before the old one was erased, we end up with a duplicate item
-    Page& lastPage = back();
-    size_t lastItemIndex = SIZE_MAX;
-    Item item;
-    size_t itemIndex = 0;
-    while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
-        itemIndex += item.span;
-        lastItemIndex = itemIndex;
-    }
-
-    if (lastItemIndex != SIZE_MAX) {
-        auto last = PageManager::TPageListIterator(&lastPage);
-        for (auto it = begin(); it != last; ++it) {
-            if (it->eraseItem(item.nsIndex, item.datatype, item.key) == ESP_OK) {
-                break;
-            }
-        }
-    }
+    // duplicate left if power went out after a new item for the given key was
+    // written, but before the old one was erased, is removed by Storage::init,
+    // which can locate the old item without reading every page
 
     // check if power went out while page was being freed
     for (auto it = begin(); it!= end(); ++it) {
@@ -108,7 +128,7 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
-esp_err_t PageManager::requestNewPage()
+esp_err_t PageManager::requestNewPage(Page** freedPage)
 {
     if (mFreePageList.empty()) {
         return ESP_ERR_NVS_INVALID_STATE;
@@ -119,18 +139,9 @@ esp_err_t PageManager::requestNewPage()
         return activatePage();
     }
 
-    // find the page with the higest number of erased items
-    TPageListIterator maxErasedItemsPageIt;
-    size_t maxErasedItems = 0;
-    for (auto it = begin(); it != end(); ++it) {
-        auto erased = it->getErasedEntryCount();
-        if (erased > maxErasedItems) {
-            maxErasedItemsPageIt = it;
-            maxErasedItems = erased;
-        }
-    }
-
-    if (maxErasedItems == 0) {
+    const ReclaimPolicy* policy = mReclaimPolicy ? mReclaimPolicy : &s_defaultReclaimPolicy;
+    Page* erasedPage = policy->selectPage(mPageList);
+    if (erasedPage == nullptr || erasedPage->getErasedEntryCount() == 0) {
         return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
     }
 
@@ -141,7 +152,6 @@ esp_err_t PageManager::requestNewPage()
 
     Page* newPage = &mPageList.back();
 
-    Page* erasedPage = maxErasedItemsPageIt;
 #ifndef NDEBUG
     size_t usedEntries = erasedPage->getUsedEntryCount();
 #endif
@@ -165,12 +175,47 @@ esp_err_t PageManager::requestNewPage()
 
     assert(usedEntries == newPage->getUsedEntryCount());
 
-    mPageList.erase(maxErasedItemsPageIt);
+    mPageList.erase(erasedPage);
     mFreePageList.push_back(erasedPage);
+    if (freedPage) {
+        *freedPage = erasedPage;
+    }
 
     return ESP_OK;
 }
 
+void PageManager::setReclaimPolicy(const ReclaimPolicy* policy)
+{
+    mReclaimPolicy = policy;
+}
+
+void PageManager::fillStats(nvs_stats_t& stats) const
+{
+    stats.used_entries = 0;
+    stats.free_entries = 0;
+    stats.erased_entries = 0;
+    stats.total_entries = 0;
+    stats.min_erase_count = UINT32_MAX;
+    stats.max_erase_count = 0;
+    for (uint32_t i = 0; i < mPageCount; ++i) {
+        const Page& page = mPages[i];
+        auto state = page.state();
+        stats.total_entries += Page::ENTRY_COUNT;
+        if (state == Page::PageState::ACTIVE || state == Page::PageState::FULL || state == Page::PageState::FREEING) {
+            stats.used_entries += page.getUsedEntryCount();
+            stats.erased_entries += page.getErasedEntryCount();
+            stats.free_entries += Page::ENTRY_COUNT - page.getUsedEntryCount() - page.getErasedEntryCount();
+        } else {
+            stats.free_entries += Page::ENTRY_COUNT;
+        }
+        stats.min_erase_count = std::min(stats.min_erase_count, page.getEraseCount());
+        stats.max_erase_count = std::max(stats.max_erase_count, page.getEraseCount());
+    }
+    if (mPageCount == 0) {
+        stats.min_erase_count = 0;
+    }
+}
+
 esp_err_t PageManager::activatePage()
 {
     if (mFreePageList.empty()) {
@@ -23,6 +23,37 @@
 
 namespace nvs
 {
+
+/**
+ * Selects the page which is reclaimed when there are no spare free pages left.
+ * Items of the selected page are moved to a new page, so the page should have
+ * some erased entries, otherwise no space is gained.
+ */
+class ReclaimPolicy
+{
+public:
+    virtual ~ReclaimPolicy() {}
+
+    /* Return the page to be reclaimed, or nullptr if none of the pages has erased entries */
+    virtual Page* selectPage(intrusive_list<Page>& pages) const = 0;
+};
+
+/* Reclaims the oldest page which has erased entries */
+class OldestPageReclaimPolicy : public ReclaimPolicy
+{
+public:
+    Page* selectPage(intrusive_list<Page>& pages) const override;
+};
+
+/* Reclaims the page with most erased entries, so that fewest items have to be moved.
+ * Of the pages with the same number of erased entries, the one with fewer used entries
+ * is chosen, and then the one in the sector which was erased fewer times. */
+class MostErasedReclaimPolicy : public ReclaimPolicy
+{
+public:
+    Page* selectPage(intrusive_list<Page>& pages) const override;
+};
+
 class PageManager
 {
     using TPageList = intrusive_list<Page>;
@@ -48,7 +79,22 @@ public:
         return mPageList.back();
     }
 
-    esp_err_t requestNewPage();
+    /**
+     * Activate a new page, reclaiming one of the used pages if needed.
+     * If a page was reclaimed, its items are moved to the new page, and
+     * freedPage (if not null) is set to the reclaimed page.
+     */
+    esp_err_t requestNewPage(Page** freedPage = nullptr);
+
+    /**
+     * Set the policy used by requestNewPage to select the page to be reclaimed.
+     * Policy object is not copied. Passing nullptr restores the default policy,
+     * MostErasedReclaimPolicy.
+     */
+    void setReclaimPolicy(const ReclaimPolicy* policy);
+
+    /* Fill entry counts and sector erase counts of the stats structure */
+    void fillStats(nvs_stats_t& stats) const;
 
 protected:
     friend class Iterator;
@@ -61,6 +107,9 @@ protected:
     uint32_t mBaseSector;
     uint32_t mPageCount;
     uint32_t mSeqNumber;
+    const ReclaimPolicy* mReclaimPolicy = nullptr;
+    // shared by all pages, see Page::setReadMutex
+    Mutex mReadMutex;
 }; // class PageManager
 
 
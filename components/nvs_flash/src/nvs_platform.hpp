@@ -61,21 +61,237 @@ public:
 
     static SemaphoreHandle_t mSemaphore;
 };
+
+class Mutex
+{
+public:
+    Mutex() : mSemaphore(xSemaphoreCreateMutex())
+    {
+    }
+
+    ~Mutex()
+    {
+        vSemaphoreDelete(mSemaphore);
+    }
+
+    void lock()
+    {
+        xSemaphoreTake(mSemaphore, portMAX_DELAY);
+    }
+
+    void unlock()
+    {
+        xSemaphoreGive(mSemaphore);
+    }
+
+protected:
+    SemaphoreHandle_t mSemaphore;
+
+private:
+    Mutex(const Mutex& other);
+    const Mutex& operator= (const Mutex& rhs);
+};
+
+/**
+ * Readers-writer lock. A writer waiting for the lock stops new readers
+ * from entering, so writers are not starved by a stream of readers.
+ */
+class RWLock
+{
+public:
+    RWLock() :
+        mTurnstile(xSemaphoreCreateMutex()),
+        mReaderMutex(xSemaphoreCreateMutex()),
+        mRoomEmpty(xSemaphoreCreateBinary())
+    {
+        xSemaphoreGive(mRoomEmpty);
+    }
+
+    ~RWLock()
+    {
+        vSemaphoreDelete(mRoomEmpty);
+        vSemaphoreDelete(mReaderMutex);
+        vSemaphoreDelete(mTurnstile);
+    }
+
+    void lockShared()
+    {
+        xSemaphoreTake(mTurnstile, portMAX_DELAY);
+        xSemaphoreGive(mTurnstile);
+        xSemaphoreTake(mReaderMutex, portMAX_DELAY);
+        if (++mReaders == 1) {
+            xSemaphoreTake(mRoomEmpty, portMAX_DELAY);
+        }
+        xSemaphoreGive(mReaderMutex);
+    }
+
+    void unlockShared()
+    {
+        xSemaphoreTake(mReaderMutex, portMAX_DELAY);
+        if (--mReaders == 0) {
+            // binary semaphore, may be given by a task other than the one which took it
+            xSemaphoreGive(mRoomEmpty);
+        }
+        xSemaphoreGive(mReaderMutex);
+    }
+
+    void lock()
+    {
+        xSemaphoreTake(mTurnstile, portMAX_DELAY);
+        xSemaphoreTake(mRoomEmpty, portMAX_DELAY);
+        xSemaphoreGive(mTurnstile);
+    }
+
+    void unlock()
+    {
+        xSemaphoreGive(mRoomEmpty);
+    }
+
+protected:
+    SemaphoreHandle_t mTurnstile;
+    SemaphoreHandle_t mReaderMutex;
+    SemaphoreHandle_t mRoomEmpty;
+    size_t mReaders = 0;
+
+private:
+    RWLock(const RWLock& other);
+    const RWLock& operator= (const RWLock& rhs);
+};
 } // namespace nvs
 
 #else // ESP_PLATFORM
+#include <mutex>
+#include <condition_variable>
+
 namespace nvs
 {
 class Lock
 {
 public:
-    Lock() { }
-    ~Lock() { }
+    Lock()
+    {
+        mMutex.lock();
+    }
+
+    ~Lock()
+    {
+        mMutex.unlock();
+    }
+
     static void init() {}
     static void uninit() {}
+
+    static std::mutex mMutex;
+};
+
+typedef std::mutex Mutex;
+
+class RWLock
+{
+public:
+    void lockShared()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return !mWriter && mWritersWaiting == 0; });
+        ++mReaders;
+    }
+
+    void unlockShared()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mReaders == 0) {
+            mCondition.notify_all();
+        }
+    }
+
+    void lock()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        ++mWritersWaiting;
+        mCondition.wait(lock, [this] { return !mWriter && mReaders == 0; });
+        --mWritersWaiting;
+        mWriter = true;
+    }
+
+    void unlock()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWriter = false;
+        mCondition.notify_all();
+    }
+
+protected:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mReaders = 0;
+    size_t mWritersWaiting = 0;
+    bool mWriter = false;
 };
 } // namespace nvs
 #endif // ESP_PLATFORM
 
+namespace nvs
+{
+
+/* Holds the mutex, if there is one, for the lifetime of the object */
+class MutexLock
+{
+public:
+    MutexLock(Mutex* mutex) : mMutex(mutex)
+    {
+        if (mMutex) {
+            mMutex->lock();
+        }
+    }
+
+    ~MutexLock()
+    {
+        if (mMutex) {
+            mMutex->unlock();
+        }
+    }
+
+protected:
+    Mutex* mMutex;
+};
+
+/* Shares the lock with other readers for the lifetime of the object */
+class ReadLock
+{
+public:
+    ReadLock(RWLock& lock) : mLock(lock)
+    {
+        mLock.lockShared();
+    }
+
+    ~ReadLock()
+    {
+        mLock.unlockShared();
+    }
+
+protected:
+    RWLock& mLock;
+};
+
+/* Holds the lock exclusively for the lifetime of the object */
+class WriteLock
+{
+public:
+    WriteLock(RWLock& lock) : mLock(lock)
+    {
+        mLock.lock();
+    }
+
+    ~WriteLock()
+    {
+        mLock.unlock();
+    }
+
+protected:
+    RWLock& mLock;
+};
+
+} // namespace nvs
+
 
 #endif /* nvs_platform_h */
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_storage.hpp"
+#include <cstdio>
+#include <cstdlib>
 
 #ifndef ESP_PLATFORM
 #include <map>
@@ -44,24 +46,85 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
         return err;
     }
 
-    // load namespaces list
+    // load namespaces list and build the index of all items
     clearNamespaces();
+    mItemIndex.clear();
     std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
+    BatchInfo batchInfo;
+    bool haveDuplicates = false;
+    TBlobChunks blobChunks;
+    Item lastItem;
+    size_t lastItemIndex = Page::INVALID_ENTRY;
     for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
         Page& p = *it;
         size_t itemIndex = 0;
         Item item;
-        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new NamespaceEntry;
-            item.getKey(entry->mName, sizeof(entry->mName) - 1);
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
+        while (p.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            if (&p == &mPageManager.back()) {
+                lastItem = item;
+                lastItemIndex = itemIndex;
+            }
+            Page* copyPage;
+            size_t copyIndex;
+            Item copy;
+            if (findPrecedingCopy(item, &p, itemIndex, copyPage, copyIndex, copy) == ESP_OK) {
+                haveDuplicates = true;
+            }
+            mItemIndex.insert(item, &p);
+            batchInfo.update(item);
+            if (item.datatype == ItemType::BLOB_DATA) {
+                blobChunks.push_back(new BlobChunkEntry(item));
+            }
+            if (item.nsIndex == Page::NS_INDEX && item.datatype == ItemType::U8) {
+                NamespaceEntry* entry = new NamespaceEntry;
+                item.getKey(entry->mName, sizeof(entry->mName) - 1);
+                item.getValue(entry->mIndex);
+                mNamespaces.push_back(entry);
+                mNamespaceUsage.set(entry->mIndex, true);
+            }
             itemIndex += item.span;
         }
     }
     mNamespaceUsage.set(0, true);
     mNamespaceUsage.set(255, true);
+
+    // if power went out after a new item for the given key was written,
+    // but before the old one was erased, we end up with a duplicate item;
+    // duplicates of items written by a batch are handled by resolveBatches
+    if (lastItemIndex != Page::INVALID_ENTRY && lastItem.reserved == Item::BATCH_NONE) {
+        Page* copyPage;
+        size_t copyIndex;
+        Item copy;
+        if (findPrecedingCopy(lastItem, &mPageManager.back(), lastItemIndex, copyPage, copyIndex, copy) == ESP_OK) {
+            err = copyPage->eraseItemAt(copyIndex);
+            if (err == ESP_OK) {
+                mItemIndex.erase(copy, copyPage);
+            }
+        }
+    }
+
+    // if power went out while a batch was written, discard it;
+    // if it went out while old values were erased after a batch, finish that
+    if (err == ESP_OK && (haveDuplicates || batchInfo.haveUncommitted())) {
+        err = resolveBatches(batchInfo);
+    }
+    if (err == ESP_OK) {
+        err = applyBatchInfo(batchInfo);
+    }
+    if (err == ESP_OK) {
+        // chunks which don't belong to a blob index were left by an interrupted write
+        err = eraseOrphanBlobChunks(blobChunks);
+    }
+    while (!blobChunks.empty()) {
+        BlobChunkEntry* entry = &blobChunks.front();
+        blobChunks.erase(entry);
+        delete entry;
+    }
+    if (err != ESP_OK) {
+        mState = StorageState::INVALID;
+        return err;
+    }
+
     mState = StorageState::ACTIVE;
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -69,62 +132,300 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
+Storage::BatchInfo::BatchInfo()
+{
+    std::fill_n(mItems.data(), mItems.byteSize() / 4, 0);
+    std::fill_n(mMarkers.data(), mMarkers.byteSize() / 4, 0);
+}
+
+void Storage::BatchInfo::update(Item& item)
+{
+    uint8_t batchId;
+    if (isBatchMarker(item, batchId)) {
+        uint32_t seq;
+        item.getValue(seq);
+        mMarkers.set(batchId, true);
+        if (mLastBatchId == Item::BATCH_NONE || seq >= mLastSeq) {
+            mLastSeq = seq;
+            mLastBatchId = batchId;
+        }
+    } else if (item.reserved != Item::BATCH_NONE) {
+        mItems.set(item.reserved, true);
+    }
+}
+
+bool Storage::BatchInfo::haveUncommitted() const
+{
+    for (size_t i = 0; i < mItems.byteSize() / 4; ++i) {
+        if (mItems.data()[i] & ~mMarkers.data()[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Storage::isBatchMarker(const Item& item, uint8_t& batchId)
+{
+    if (item.nsIndex != Page::NS_INDEX || item.datatype != ItemType::U32 || item.key[0] != BATCH_MARKER_PREFIX) {
+        return false;
+    }
+    batchId = static_cast<uint8_t>(strtoul(item.key + 1, nullptr, 16));
+    return true;
+}
+
+void Storage::makeBatchMarkerKey(uint8_t batchId, char* key, size_t size)
+{
+    snprintf(key, size, "%c%02x", BATCH_MARKER_PREFIX, batchId);
+}
+
+esp_err_t Storage::resolveBatches(const BatchInfo& batchInfo)
+{
+    // index is built again, this time erasing older copies as they are found
+    mItemIndex.clear();
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        Page& p = *it;
+        size_t itemIndex = 0;
+        Item item;
+        while (p.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            if (item.reserved != Item::BATCH_NONE && !batchInfo.mMarkers.get(item.reserved)) {
+                // batch was not committed
+                auto err = p.eraseItemAt(itemIndex);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                itemIndex += item.span;
+                continue;
+            }
+            Page* copyPage;
+            size_t copyIndex;
+            Item copy;
+            if (findPrecedingCopy(item, &p, itemIndex, copyPage, copyIndex, copy) == ESP_OK) {
+                // the copy precedes this item in the log, so this one is newer,
+                // unless the copy was written by the last committed batch
+                if (copy.reserved == batchInfo.mLastBatchId && item.reserved != batchInfo.mLastBatchId) {
+                    auto err = p.eraseItemAt(itemIndex);
+                    if (err != ESP_OK) {
+                        return err;
+                    }
+                    itemIndex += item.span;
+                    continue;
+                }
+                auto err = copyPage->eraseItemAt(copyIndex);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                mItemIndex.erase(copy, copyPage);
+            }
+            mItemIndex.insert(item, &p);
+            itemIndex += item.span;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::applyBatchInfo(BatchInfo& batchInfo)
+{
+    std::fill_n(mBatchIdUsage.data(), mBatchIdUsage.byteSize() / 4, 0);
+    for (size_t id = 0; id < Item::BATCH_NONE; ++id) {
+        if (batchInfo.mItems.get(id)) {
+            mBatchIdUsage.set(id, true);
+            continue;
+        }
+        if (!batchInfo.mMarkers.get(id)) {
+            continue;
+        }
+        // no items written by this batch are left, marker is not needed any more
+        char key[Item::MAX_KEY_LENGTH + 1];
+        makeBatchMarkerKey(static_cast<uint8_t>(id), key, sizeof(key));
+        Page* page;
+        Item item;
+        auto err = findItem(Page::NS_INDEX, ItemType::U32, key, page, item);
+        if (err == ESP_OK) {
+            err = page->eraseItem(Page::NS_INDEX, ItemType::U32, key);
+            if (err != ESP_OK) {
+                return err;
+            }
+            mItemIndex.erase(item, page);
+        }
+    }
+    mBatchSeq = (batchInfo.mLastBatchId == Item::BATCH_NONE) ? 0 : batchInfo.mLastSeq + 1;
+    return ESP_OK;
+}
+
+esp_err_t Storage::allocateBatchId(uint8_t& batchId)
+{
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        for (size_t id = 0; id < Item::BATCH_NONE; ++id) {
+            if (!mBatchIdUsage.get(id)) {
+                // id stays in use until the next scan, even if the batch fails
+                mBatchIdUsage.set(id, true);
+                batchId = static_cast<uint8_t>(id);
+                return ESP_OK;
+            }
+        }
+        // all ids have been used since the last scan, check which ones are still alive
+        BatchInfo batchInfo;
+        for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+            size_t itemIndex = 0;
+            Item item;
+            while (it->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+                batchInfo.update(item);
+                itemIndex += item.span;
+            }
+        }
+        auto err = applyBatchInfo(batchInfo);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
 bool Storage::isValid() const
 {
     return mState == StorageState::ACTIVE;
 }
 
-esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item)
+esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx)
 {
-    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+    // the index only tells which pages may hold the key, the page itself does the real lookup
+    size_t cookie = 0;
+    Item hashItem(nsIndex, datatype, 0, key);
+    for (Page* candidate = mItemIndex.find(hashItem, cookie); candidate != nullptr;
+            candidate = mItemIndex.find(hashItem, cookie)) {
         size_t itemIndex = 0;
-        auto err = it->findItem(nsIndex, datatype, key, itemIndex, item);
+        auto err = candidate->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx);
         if (err == ESP_OK) {
-            page = it;
+            page = candidate;
             return ESP_OK;
         }
     }
     return ESP_ERR_NVS_NOT_FOUND;
 }
 
+esp_err_t Storage::eraseCorruptEntries()
+{
+    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+        auto err = it->eraseCorruptEntries();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::findPrecedingCopy(const Item& item, const Page* page, size_t itemIndex, Page* &copyPage, size_t& copyIndex, Item& copy)
+{
+    // Only pages which were already visited are in the index. Blob chunks share the
+    // hash with their blob index, so the page of the item itself may be a candidate:
+    // there only entries before the item count. Pages remember the last search by
+    // key pointer, which is not valid when the same buffer is used for different keys.
+    const uint8_t chunkIdx = item.getChunkIndex();
+    size_t cookie = 0;
+    for (Page* candidate = mItemIndex.find(item, cookie); candidate != nullptr;
+            candidate = mItemIndex.find(item, cookie)) {
+        size_t index = 0;
+        candidate->invalidateCache();
+        while (candidate->findItem(item.nsIndex, item.datatype, item.key, index, copy, chunkIdx) == ESP_OK) {
+            candidate->invalidateCache();
+            if (candidate == page && index >= itemIndex) {
+                break;
+            }
+            copyPage = candidate;
+            copyIndex = index;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Storage::requestNewPage(Batch* batch)
+{
+    Page* freedPage = nullptr;
+    auto err = mPageManager.requestNewPage(&freedPage);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (freedPage) {
+        // items of the reclaimed page have been moved to the new one
+        mItemIndex.relocate(freedPage, &getCurrentPage());
+        if (batch) {
+            batch->relocate(freedPage, &getCurrentPage());
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeToCurrentPage(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, Batch* batch, uint8_t batchId)
+{
+    Page* page = &getCurrentPage();
+    esp_err_t err;
+    if (batch && batchId != Item::BATCH_NONE) {
+        err = page->stageItem(nsIndex, datatype, key, data, dataSize, batchId);
+    } else {
+        err = page->writeItem(nsIndex, datatype, key, data, dataSize, batchId);
+    }
+    if (err != ESP_ERR_NVS_PAGE_FULL) {
+        return err;
+    }
+
+    err = page->commitStagedEntries();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (page->state() != Page::PageState::FULL) {
+        err = page->markFull();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    err = requestNewPage(batch);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    page = &getCurrentPage();
+    if (batch && batchId != Item::BATCH_NONE) {
+        err = page->stageItem(nsIndex, datatype, key, data, dataSize, batchId);
+    } else {
+        err = page->writeItem(nsIndex, datatype, key, data, dataSize, batchId);
+    }
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    return err;
+}
+
 esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
 {
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    auto err = eraseCorruptEntries();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (datatype == ItemType::BLOB && dataSize > Page::getVarDataMaxSize()) {
+        return writeMultiPageBlob(nsIndex, key, data, dataSize);
+    }
+
     Page* findPage = nullptr;
     Item item;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
+    err = findItem(nsIndex, datatype, key, findPage, item);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         return err;
     }
 
-    Page& page = getCurrentPage();
-    err = page.writeItem(nsIndex, datatype, key, data, dataSize);
-    if (err == ESP_ERR_NVS_PAGE_FULL) {
-        if (page.state() != Page::PageState::FULL) {
-            err = page.markFull();
-            if (err != ESP_OK) {
-                return err;
-            }
-        }
-        err = mPageManager.requestNewPage();
-        if (err != ESP_OK) {
-            return err;
-        }
-
-        err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize);
-        if (err == ESP_ERR_NVS_PAGE_FULL) {
-            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
-        }
-        if (err != ESP_OK) {
-            return err;
-        }
-    } else if (err != ESP_OK) {
+    err = writeToCurrentPage(nsIndex, datatype, key, data, dataSize);
+    if (err != ESP_OK) {
         return err;
     }
 
+    Item hashItem(nsIndex, datatype, 0, key);
+    mItemIndex.insert(hashItem, &getCurrentPage());
+
     if (findPage) {
         if (findPage->state() == Page::PageState::UNINITIALIZED ||
                 findPage->state() == Page::PageState::INVALID) {
@@ -137,6 +438,108 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
         if (err != ESP_OK) {
             return err;
         }
+        mItemIndex.erase(hashItem, findPage);
+    }
+    if (datatype == ItemType::BLOB) {
+        // the key may have been stored as a multi-page blob before
+        err = eraseMultiPageBlob(nsIndex, key);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize)
+{
+    if (dataSize > Item::CHUNK_MAX_COUNT * Page::getVarDataMaxSize()) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    Page* oldIndexPage;
+    Item oldIndex;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, oldIndexPage, oldIndex);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    const bool haveOld = (err == ESP_OK);
+    // new chunks are numbered differently from the old ones, so both sets can coexist
+    const uint8_t chunkStart = (haveOld && oldIndex.blobIndex.chunkStart == Item::CHUNK_START_0) ?
+                               Item::CHUNK_START_1 : Item::CHUNK_START_0;
+
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    size_t offset = 0;
+    uint8_t chunkCount = 0;
+    err = ESP_OK;
+    while (offset < dataSize) {
+        Page& page = getCurrentPage();
+        size_t tailroom = page.getVarDataTailroom();
+        if (tailroom == 0) {
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+            err = requestNewPage();
+            if (err != ESP_OK) {
+                break;
+            }
+            continue;
+        }
+        size_t chunkSize = std::min(tailroom, dataSize - offset);
+        const uint8_t chunkIdx = chunkStart + chunkCount;
+        err = page.writeItem(nsIndex, ItemType::BLOB_DATA, key, src + offset, chunkSize, Item::BATCH_NONE, chunkIdx);
+        if (err != ESP_OK) {
+            break;
+        }
+        Item hashItem(nsIndex, ItemType::BLOB_DATA, 0, key);
+        mItemIndex.insert(hashItem, &page);
+        offset += chunkSize;
+        ++chunkCount;
+    }
+
+    // until the index is written, new chunks are orphans and are erased at init
+    if (err == ESP_OK) {
+        Item indexItem(nsIndex, ItemType::BLOB_IDX, 1, key);
+        indexItem.blobIndex.dataSize = static_cast<uint32_t>(dataSize);
+        indexItem.blobIndex.chunkCount = chunkCount;
+        indexItem.blobIndex.chunkStart = chunkStart;
+        err = writeToCurrentPage(nsIndex, ItemType::BLOB_IDX, key, indexItem.data, sizeof(indexItem.data));
+        if (err == ESP_OK) {
+            mItemIndex.insert(indexItem, &getCurrentPage());
+        }
+    }
+    if (err != ESP_OK) {
+        eraseBlobChunks(nsIndex, key, chunkStart, chunkCount);
+        return err;
+    }
+
+    if (haveOld) {
+        err = eraseBlobIndex(nsIndex, key, oldIndex.blobIndex.chunkStart);
+        if (err == ESP_OK) {
+            err = eraseBlobChunks(nsIndex, key, oldIndex.blobIndex.chunkStart, oldIndex.blobIndex.chunkCount);
+        }
+    }
+    if (err == ESP_OK) {
+        // the key may have been stored as a single page blob before
+        Page* findPage;
+        Item item;
+        if (findItem(nsIndex, ItemType::BLOB, key, findPage, item) == ESP_OK) {
+            err = findPage->eraseItem(nsIndex, ItemType::BLOB, key);
+            if (err == ESP_OK) {
+                mItemIndex.erase(item, findPage);
+            }
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
     }
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -144,6 +547,140 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
     return ESP_OK;
 }
 
+esp_err_t Storage::readMultiPageBlob(uint8_t nsIndex, const char* key, size_t offset, void* data, size_t dataSize)
+{
+    Page* indexPage;
+    Item indexItem;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, indexPage, indexItem);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const size_t totalSize = indexItem.blobIndex.dataSize;
+    if (offset > totalSize || dataSize > totalSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    const size_t end = offset + dataSize;
+    size_t pos = 0;
+    for (size_t i = 0; i < indexItem.blobIndex.chunkCount && pos < end; ++i) {
+        const uint8_t chunkIdx = static_cast<uint8_t>(indexItem.blobIndex.chunkStart + i);
+        Page* page;
+        Item item;
+        err = findItem(nsIndex, ItemType::BLOB_DATA, key, page, item, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        const size_t chunkSize = item.varLength.dataSize;
+        if (pos + chunkSize > offset) {
+            size_t readBegin = std::max(pos, offset);
+            size_t readEnd = std::min(pos + chunkSize, end);
+            err = page->readItemPart(nsIndex, ItemType::BLOB_DATA, key, readBegin - pos,
+                                     dst + (readBegin - offset), readEnd - readBegin, chunkIdx);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        pos += chunkSize;
+    }
+    if (pos < end) {
+        // some chunks are missing
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key)
+{
+    Page* indexPage;
+    Item indexItem;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, indexPage, indexItem);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // index is erased first: chunks left after power loss are removed at init
+    err = indexPage->eraseItem(nsIndex, ItemType::BLOB_IDX, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mItemIndex.erase(indexItem, indexPage);
+    return eraseBlobChunks(nsIndex, key, indexItem.blobIndex.chunkStart, indexItem.blobIndex.chunkCount);
+}
+
+esp_err_t Storage::eraseBlobChunks(uint8_t nsIndex, const char* key, uint8_t chunkStart, uint8_t chunkCount)
+{
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const uint8_t chunkIdx = static_cast<uint8_t>(chunkStart + i);
+        Page* page;
+        Item item;
+        if (findItem(nsIndex, ItemType::BLOB_DATA, key, page, item, chunkIdx) != ESP_OK) {
+            continue;
+        }
+        auto err = page->eraseItem(nsIndex, ItemType::BLOB_DATA, key, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        mItemIndex.erase(item, page);
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseBlobIndex(uint8_t nsIndex, const char* key, uint8_t chunkStart)
+{
+    // while a blob is being updated two index items exist, they differ in chunk start
+    size_t cookie = 0;
+    Item hashItem(nsIndex, ItemType::BLOB_IDX, 0, key);
+    for (Page* candidate = mItemIndex.find(hashItem, cookie); candidate != nullptr;
+            candidate = mItemIndex.find(hashItem, cookie)) {
+        size_t itemIndex = 0;
+        Item item;
+        candidate->invalidateCache();
+        while (candidate->findItem(nsIndex, ItemType::BLOB_IDX, key, itemIndex, item) == ESP_OK) {
+            candidate->invalidateCache();
+            if (item.blobIndex.chunkStart == chunkStart) {
+                auto err = candidate->eraseItemAt(itemIndex);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                mItemIndex.erase(item, candidate);
+                return ESP_OK;
+            }
+            itemIndex += item.span;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+Storage::BlobChunkEntry::BlobChunkEntry(const Item& item) :
+    mNsIndex(item.nsIndex),
+    mChunkIndex(item.varLength.chunkIndex)
+{
+    strncpy(mKey, item.key, sizeof(mKey) - 1);
+    mKey[sizeof(mKey) - 1] = 0;
+}
+
+esp_err_t Storage::eraseOrphanBlobChunks(TBlobChunks& chunks)
+{
+    for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+        Page* page;
+        Item item;
+        bool orphan = true;
+        if (findItem(it->mNsIndex, ItemType::BLOB_IDX, it->mKey, page, item) == ESP_OK) {
+            orphan = it->mChunkIndex < item.blobIndex.chunkStart ||
+                     it->mChunkIndex >= item.blobIndex.chunkStart + item.blobIndex.chunkCount;
+        }
+        if (!orphan || findItem(it->mNsIndex, ItemType::BLOB_DATA, it->mKey, page, item, it->mChunkIndex) != ESP_OK) {
+            continue;
+        }
+        auto err = page->eraseItem(it->mNsIndex, ItemType::BLOB_DATA, it->mKey, it->mChunkIndex);
+        if (err != ESP_OK) {
+            return err;
+        }
+        mItemIndex.erase(item, page);
+    }
+    return ESP_OK;
+}
+
 esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex)
 {
     if (mState != StorageState::ACTIVE) {
@@ -187,6 +724,129 @@ esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uin
     return ESP_OK;
 }
 
+esp_err_t Storage::writeBatch(Batch& batch)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = eraseCorruptEntries();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (batch.empty()) {
+        return ESP_OK;
+    }
+
+    uint8_t batchId;
+    err = allocateBatchId(batchId);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        Item item;
+        it->mOldPage = nullptr;
+        err = findItem(it->mNsIndex, it->mDatatype, it->mKey, it->mOldPage, item);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+
+    // write all items without marking them in the entry state tables,
+    // so that each page gets one state table update
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        err = writeToCurrentPage(it->mNsIndex, it->mDatatype, it->mKey, it->mData, it->mDataSize, &batch, batchId);
+        if (err != ESP_OK) {
+            break;
+        }
+        Item hashItem(it->mNsIndex, it->mDatatype, 0, it->mKey);
+        mItemIndex.insert(hashItem, &getCurrentPage());
+    }
+    auto commitErr = getCurrentPage().commitStagedEntries();
+    if (err == ESP_OK) {
+        err = commitErr;
+    }
+
+    // until the marker is written, items of the batch are discarded at init
+    if (err == ESP_OK) {
+        char key[Item::MAX_KEY_LENGTH + 1];
+        makeBatchMarkerKey(batchId, key, sizeof(key));
+        err = writeToCurrentPage(Page::NS_INDEX, ItemType::U32, key, &mBatchSeq, sizeof(mBatchSeq));
+        if (err == ESP_OK) {
+            Item hashItem(Page::NS_INDEX, ItemType::U32, 0, key);
+            mItemIndex.insert(hashItem, &getCurrentPage());
+        }
+    }
+    if (err != ESP_OK) {
+        discardBatch(batchId);
+        return err;
+    }
+    ++mBatchSeq;
+
+    // erase old copies in RAM first, then update entry state table of each
+    // page which held them once
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        Page* oldPage = it->mOldPage;
+        if (!oldPage) {
+            continue;
+        }
+        // old copy precedes the new one if both are on the same page
+        err = oldPage->stageEraseItem(it->mNsIndex, it->mDatatype, it->mKey);
+        if (err != ESP_OK) {
+            break;
+        }
+        Item hashItem(it->mNsIndex, it->mDatatype, 0, it->mKey);
+        mItemIndex.erase(hashItem, oldPage);
+    }
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        if (it->mOldPage) {
+            auto commitErr = it->mOldPage->commitStagedErases();
+            if (err == ESP_OK) {
+                err = commitErr;
+            }
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+        if (it->mDatatype != ItemType::BLOB) {
+            continue;
+        }
+        err = eraseMultiPageBlob(it->mNsIndex, it->mKey);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+void Storage::discardBatch(uint8_t batchId)
+{
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        Page& p = *it;
+        size_t itemIndex = 0;
+        Item item;
+        while (p.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            if (item.reserved == batchId && p.eraseItemAt(itemIndex) == ESP_OK) {
+                mItemIndex.erase(item, &p);
+            }
+            itemIndex += item.span;
+        }
+    }
+}
+
 esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
 {
     if (mState != StorageState::ACTIVE) {
@@ -196,6 +856,17 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
     Item item;
     Page* findPage = nullptr;
     auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        size_t blobSize;
+        err = getItemDataSize(nsIndex, datatype, key, blobSize);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (dataSize < blobSize) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        return readMultiPageBlob(nsIndex, key, 0, data, blobSize);
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -203,7 +874,7 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
     return findPage->readItem(nsIndex, datatype, key, data, dataSize);
 }
 
-esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
+esp_err_t Storage::readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize)
 {
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
@@ -212,11 +883,46 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
     Item item;
     Page* findPage = nullptr;
     auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        return readMultiPageBlob(nsIndex, key, offset, data, dataSize);
+    }
     if (err != ESP_OK) {
         return err;
     }
 
-    return findPage->eraseItem(nsIndex, datatype, key);
+    return findPage->readItemPart(nsIndex, datatype, key, offset, data, dataSize);
+}
+
+esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    auto err = eraseCorruptEntries();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        return eraseMultiPageBlob(nsIndex, key);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (item.datatype == ItemType::BLOB_DATA || item.datatype == ItemType::BLOB_IDX) {
+        return eraseMultiPageBlob(nsIndex, key);
+    }
+
+    err = findPage->eraseItem(nsIndex, datatype, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mItemIndex.erase(item, findPage);
+    return ESP_OK;
 }
 
 esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
@@ -225,15 +931,27 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    auto err = eraseCorruptEntries();
+    if (err != ESP_OK) {
+        return err;
+    }
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         while (true) {
-            auto err = it->eraseItem(nsIndex, ItemType::ANY, nullptr);
+            size_t itemIndex = 0;
+            Item item;
+            err = it->findItem(nsIndex, ItemType::ANY, nullptr, itemIndex, item);
             if (err == ESP_ERR_NVS_NOT_FOUND) {
                 break;
             }
             else if (err != ESP_OK) {
                 return err;
             }
+            err = it->eraseItem(item.nsIndex, item.datatype, item.key, item.getChunkIndex());
+            if (err != ESP_OK) {
+                return err;
+            }
+            mItemIndex.erase(item, it);
         }
     }
     return ESP_OK;
@@ -249,6 +967,14 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     Item item;
     Page* findPage = nullptr;
     auto err = findItem(nsIndex, datatype, key, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dataSize = item.blobIndex.dataSize;
+        return ESP_OK;
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -257,6 +983,84 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     return ESP_OK;
 }
 
+esp_err_t Storage::findEntry(nvs_opaque_iterator_t* it, const char* nsName, ItemType datatype)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    it->mNsIndex = Page::NS_ANY;
+    if (nsName != nullptr) {
+        auto err = createOrOpenNamespace(nsName, false, it->mNsIndex);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    it->mType = datatype;
+    it->mPageSeq = 0;
+    it->mEntryIndex = 0;
+    return nextEntry(it);
+}
+
+esp_err_t Storage::nextEntry(nvs_opaque_iterator_t* it)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    // Pages are listed in the order of their sequence numbers. If the page of the
+    // iterator was reclaimed since the last call, iteration goes on at the next one.
+    // Page::findItem skips entries which are not written using the entry state
+    // table, and reads only the first entry of strings and blobs
+    for (auto page = mPageManager.begin(); page != mPageManager.end(); ++page) {
+        uint32_t seqNumber;
+        if (page->getSeqNumber(seqNumber) != ESP_OK || seqNumber < it->mPageSeq) {
+            continue;
+        }
+        if (seqNumber != it->mPageSeq) {
+            it->mPageSeq = seqNumber;
+            it->mEntryIndex = 0;
+        }
+        Item item;
+        while (page->findItem(it->mNsIndex, ItemType::ANY, nullptr, it->mEntryIndex, item) == ESP_OK) {
+            it->mEntryIndex += item.span;
+            // namespace entries, commit markers and chunks of multi-page blobs are not listed
+            if (item.nsIndex == Page::NS_INDEX || item.datatype == ItemType::BLOB_DATA) {
+                continue;
+            }
+            ItemType datatype = (item.datatype == ItemType::BLOB_IDX) ? ItemType::BLOB : item.datatype;
+            if (it->mType != ItemType::ANY && it->mType != datatype) {
+                continue;
+            }
+            auto ns = std::find_if(mNamespaces.begin(), mNamespaces.end(), [=] (const NamespaceEntry& e) -> bool {
+                return e.mIndex == item.nsIndex;
+            });
+            if (ns == mNamespaces.end()) {
+                continue;
+            }
+            strncpy(it->mInfo.namespace_name, ns->mName, sizeof(it->mInfo.namespace_name) - 1);
+            it->mInfo.namespace_name[sizeof(it->mInfo.namespace_name) - 1] = 0;
+            item.getKey(it->mInfo.key, sizeof(it->mInfo.key) - 1);
+            it->mInfo.key[sizeof(it->mInfo.key) - 1] = 0;
+            it->mInfo.type = static_cast<nvs_type_t>(datatype);
+            return ESP_OK;
+        }
+        it->mPageSeq = seqNumber + 1;
+        it->mEntryIndex = 0;
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Storage::fillStats(nvs_stats_t& stats)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    mPageManager.fillStats(stats);
+    stats.namespace_count = mNamespaces.size();
+    return ESP_OK;
+}
+
 void Storage::debugDump()
 {
     for (auto p = mPageManager.begin(); p != mPageManager.end(); ++p) {
@@ -276,6 +1080,9 @@ void Storage::debugCheck()
         while (p->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
             std::stringstream keyrepr;
             keyrepr << static_cast<unsigned>(item.nsIndex) << "_" << static_cast<unsigned>(item.datatype) << "_" << item.key;
+            if (item.datatype == ItemType::BLOB_DATA) {
+                keyrepr << "_" << static_cast<unsigned>(item.varLength.chunkIndex);
+            }
             std::string keystr = keyrepr.str();
             if (keys.find(keystr) != std::end(keys)) {
                 printf("Duplicate key: %s\n", keystr.c_str());
@@ -283,6 +1090,15 @@ void Storage::debugCheck()
                 assert(0);
             }
             keys.insert(std::make_pair(keystr, static_cast<Page*>(p)));
+            size_t cookie = 0;
+            Page* indexed;
+            do {
+                indexed = mItemIndex.find(item, cookie);
+            } while (indexed != nullptr && indexed != static_cast<Page*>(p));
+            if (indexed == nullptr) {
+                printf("Key missing from the index: %s\n", keystr.c_str());
+                assert(0);
+            }
             itemIndex += item.span;
             usedCount += item.span;
         }
@@ -21,6 +21,8 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_item_index.hpp"
+#include "nvs_batch.hpp"
 
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
@@ -42,6 +44,36 @@ class Storage
 
     typedef intrusive_list<NamespaceEntry> TNamespaces;
 
+    /* Batch ids and commit markers found while scanning all items */
+    struct BatchInfo {
+        BatchInfo();
+
+        void update(Item& item);
+
+        bool haveUncommitted() const;
+
+        CompressedEnumTable<bool, 1, 256> mItems;
+        CompressedEnumTable<bool, 1, 256> mMarkers;
+        uint8_t mLastBatchId = Item::BATCH_NONE;
+        uint32_t mLastSeq = 0;
+    };
+
+    /* Chunk of a multi-page blob found at init, checked against blob indices afterwards */
+    struct BlobChunkEntry : public intrusive_list_node<BlobChunkEntry> {
+    public:
+        BlobChunkEntry(const Item& item);
+
+        uint8_t mNsIndex;
+        uint8_t mChunkIndex;
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+    };
+
+    typedef intrusive_list<BlobChunkEntry> TBlobChunks;
+
+    /* Commit marker of a batch is an U32 item in the namespace index,
+     * with key made of this prefix followed by the batch id in hex */
+    static const char BATCH_MARKER_PREFIX = '\x01';
+
 public:
     ~Storage();
 
@@ -55,10 +87,24 @@ public:
 
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
 
+    /**
+     * Read dataSize bytes of a string or blob, starting at offset.
+     * Blobs which are split into chunks on several pages are read chunk by chunk,
+     * without reading the whole blob into memory.
+     */
+    esp_err_t readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize);
+
     esp_err_t getItemDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize);
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key);
 
+    /**
+     * Write all items of the batch so that either all of them or none of them
+     * are present after a power loss. Items are written with the batch id,
+     * and the batch becomes valid once its commit marker is written.
+     */
+    esp_err_t writeBatch(Batch& batch);
+
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
     {
@@ -78,6 +124,22 @@ public:
     
     esp_err_t eraseNamespace(uint8_t nsIndex);
 
+    /**
+     * Position the iterator at the first item in the namespace (or in any namespace,
+     * if nsName is NULL) with the given type (or any type).
+     */
+    esp_err_t findEntry(nvs_opaque_iterator_t* it, const char* nsName, ItemType datatype);
+
+    esp_err_t nextEntry(nvs_opaque_iterator_t* it);
+
+    esp_err_t fillStats(nvs_stats_t& stats);
+
+    /* See PageManager::setReclaimPolicy */
+    void setReclaimPolicy(const ReclaimPolicy* policy)
+    {
+        mPageManager.setReclaimPolicy(policy);
+    }
+
     void debugDump();
     
     void debugCheck();
@@ -92,18 +154,65 @@ protected:
 
     void clearNamespaces();
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item);
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx = Item::CHUNK_ANY);
+
+    /* Erase entries with CRC errors found by readers, see Page::eraseCorruptEntries */
+    esp_err_t eraseCorruptEntries();
+
+    esp_err_t findPrecedingCopy(const Item& item, const Page* page, size_t itemIndex, Page* &copyPage, size_t& copyIndex, Item& copy);
+
+    esp_err_t writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize);
+
+    esp_err_t readMultiPageBlob(uint8_t nsIndex, const char* key, size_t offset, void* data, size_t dataSize);
+
+    esp_err_t eraseMultiPageBlob(uint8_t nsIndex, const char* key);
+
+    esp_err_t eraseBlobChunks(uint8_t nsIndex, const char* key, uint8_t chunkStart, uint8_t chunkCount);
+
+    esp_err_t eraseBlobIndex(uint8_t nsIndex, const char* key, uint8_t chunkStart);
+
+    esp_err_t eraseOrphanBlobChunks(TBlobChunks& chunks);
+
+    esp_err_t requestNewPage(Batch* batch = nullptr);
+
+    esp_err_t writeToCurrentPage(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, Batch* batch = nullptr, uint8_t batchId = Item::BATCH_NONE);
+
+    static bool isBatchMarker(const Item& item, uint8_t& batchId);
+
+    static void makeBatchMarkerKey(uint8_t batchId, char* key, size_t size);
+
+    esp_err_t resolveBatches(const BatchInfo& batchInfo);
+
+    esp_err_t applyBatchInfo(BatchInfo& batchInfo);
+
+    esp_err_t allocateBatchId(uint8_t& batchId);
+
+    void discardBatch(uint8_t batchId);
 
 protected:
     size_t mPageCount;
     PageManager mPageManager;
+    ItemIndex mItemIndex;
     TNamespaces mNamespaces;
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
+    CompressedEnumTable<bool, 1, 256> mBatchIdUsage;
+    uint32_t mBatchSeq = 0;
     StorageState mState = StorageState::INVALID;
 };
 
 } // namespace nvs
 
+/* Position of an iterator over the items of the storage. The page is kept
+ * as its sequence number, because it may be reclaimed between two calls. */
+struct nvs_opaque_iterator_t
+{
+    char mPartName[NVS_PART_NAME_MAX_SIZE + 1];
+    nvs::ItemType mType;
+    uint8_t mNsIndex;
+    size_t mEntryIndex;
+    uint32_t mPageSeq;
+    nvs_entry_info_t mInfo;
+};
 
 
 #endif /* nvs_storage_hpp */
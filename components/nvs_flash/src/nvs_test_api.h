@@ -32,6 +32,18 @@ extern "C" {
  */
 esp_err_t nvs_flash_init_custom(uint32_t baseSector, uint32_t sectorCount);
 
+/**
+ * @brief Initialize a named NVS partition with custom flash sector layout
+ *
+ * @note  This API is intended to be used in unit tests.
+ *
+ * @param partName Partition name, used with nvs_open_from_partition
+ * @param baseSector Flash sector (units of 4096 bytes) offset to start NVS
+ * @param sectorCount Length (in flash sectors) of NVS region.
+ * @return ESP_OK if flash was successfully initialized
+ */
+esp_err_t nvs_flash_init_partition_custom(const char* partName, uint32_t baseSector, uint32_t sectorCount);
+
 
 /**
  * @brief Dump contents of NVS storage to stdout
@@ -37,9 +37,23 @@ enum class ItemType : uint8_t {
     I64  = 0x18,
     SZ   = 0x21,
     BLOB = 0x41,
+    BLOB_DATA = 0x42,
+    BLOB_IDX  = 0x48,
     ANY  = 0xff
 };
 
+/* Types of items which are followed by data entries */
+inline bool isVariableLengthType(ItemType type)
+{
+    return type == ItemType::SZ || type == ItemType::BLOB || type == ItemType::BLOB_DATA;
+}
+
+/* Types used to store a blob; a key may be stored using either of them */
+inline bool isBlobType(ItemType type)
+{
+    return type == ItemType::BLOB || type == ItemType::BLOB_DATA || type == ItemType::BLOB_IDX;
+}
+
 template<typename T, typename std::enable_if<std::is_integral<T>::value, void*>::type = nullptr>
 constexpr ItemType itemTypeOf()
 {
@@ -66,9 +80,16 @@ public:
             union {
                 struct {
                     uint16_t dataSize;
-                    uint16_t reserved2;
+                    uint8_t  chunkIndex;
+                    uint8_t  reserved2;
                     uint32_t dataCrc32;
                 } varLength;
+                struct {
+                    uint32_t dataSize;
+                    uint8_t  chunkCount;
+                    uint8_t  chunkStart;
+                    uint16_t reserved;
+                } blobIndex;
                 uint8_t data[8];
             };
         };
@@ -77,6 +98,17 @@ public:
 
     static const size_t MAX_KEY_LENGTH = sizeof(key) - 1;
 
+    // 'reserved' field holds the id of the batch which has written the item,
+    // or BATCH_NONE for items written one by one
+    static const uint8_t BATCH_NONE = 0xff;
+
+    // chunks of a multi-page blob are numbered starting from either of the two
+    // chunk start values, so that old and new chunks don't collide during update
+    static const uint8_t CHUNK_ANY = 0xff;
+    static const uint8_t CHUNK_START_0 = 0x00;
+    static const uint8_t CHUNK_START_1 = 0x80;
+    static const uint8_t CHUNK_MAX_COUNT = CHUNK_START_1 - 1;
+
     Item(uint8_t nsIndex, ItemType datatype, uint8_t span, const char* key_)
         : nsIndex(nsIndex), datatype(datatype), span(span), reserved(0xff)
     {
@@ -94,9 +126,15 @@ public:
     {
     }
 
+    /* Chunk index for chunks of multi-page blobs, CHUNK_ANY for other items */
+    uint8_t getChunkIndex() const
+    {
+        return (datatype == ItemType::BLOB_DATA) ? varLength.chunkIndex : CHUNK_ANY;
+    }
+
     uint32_t calculateCrc32() const;
     uint32_t calculateCrc32WithoutValue() const;
-    static uint32_t calculateCrc32(const uint8_t* data, size_t size);
+    static uint32_t calculateCrc32(const uint8_t* data, size_t size, uint32_t crc = 0xffffffff);
 
     void getKey(char* dst, size_t dstSize)
     {
@@ -13,9 +13,12 @@
 // limitations under the License.
 #include "esp_spi_flash.h"
 #include "spi_flash_emulation.h"
+#include <mutex>
 
 
 static SpiFlashEmulator* s_emulator = nullptr;
+// flash operations are serialized, as they are by the SPI flash driver
+static std::mutex s_emulator_mutex;
 
 void spi_flash_emulator_set(SpiFlashEmulator* e)
 {
@@ -24,6 +27,7 @@ void spi_flash_emulator_set(SpiFlashEmulator* e)
 
 esp_err_t spi_flash_erase_sector(size_t sec)
 {
+    std::lock_guard<std::mutex> lock(s_emulator_mutex);
     if (!s_emulator) {
         return ESP_ERR_FLASH_OP_TIMEOUT;
     }
@@ -37,6 +41,7 @@ esp_err_t spi_flash_erase_sector(size_t sec)
 
 esp_err_t spi_flash_write(size_t des_addr, const void *src_addr, size_t size)
 {
+    std::lock_guard<std::mutex> lock(s_emulator_mutex);
     if (!s_emulator) {
         return ESP_ERR_FLASH_OP_TIMEOUT;
     }
@@ -50,6 +55,7 @@ esp_err_t spi_flash_write(size_t des_addr, const void *src_addr, size_t size)
 
 esp_err_t spi_flash_read(size_t src_addr, void *des_addr, size_t size)
 {
+    std::lock_guard<std::mutex> lock(s_emulator_mutex);
     if (!s_emulator) {
         return ESP_ERR_FLASH_OP_TIMEOUT;
     }
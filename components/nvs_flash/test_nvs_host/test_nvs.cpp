@@ -17,6 +17,9 @@
 #include "spi_flash_emulation.h"
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
 
 using namespace std;
 using namespace nvs;
@@ -252,6 +255,46 @@ TEST_CASE("can init storage in empty flash", "[nvs]")
     s_perf << "Time to init empty storage (4 sectors): " << emu.getTotalTime() << " us" << std::endl;
 }
 
+TEST_CASE("mount time depends on partition size and number of items", "[nvs]")
+{
+    const size_t sectorCounts[] = {4, 16, 64};
+    for (size_t sectorCount : sectorCounts) {
+        for (size_t fill = 0; fill <= 1; ++fill) {
+            SpiFlashEmulator emu(sectorCount);
+            Storage storage;
+            CHECK(storage.init(0, sectorCount) == ESP_OK);
+            // fill about a half of the partition
+            const size_t itemCount = fill * (sectorCount - 1) * Page::ENTRY_COUNT / 2;
+            char key[16];
+            for (size_t i = 0; i < itemCount; ++i) {
+                snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+                REQUIRE(storage.writeItem(1, key, static_cast<uint32_t>(i)) == ESP_OK);
+            }
+
+            emu.clearStats();
+            Storage mounted;
+            CHECK(mounted.init(0, sectorCount) == ESP_OK);
+            s_perf << "Time to mount " << sectorCount << " sectors with " << itemCount << " items: "
+                   << emu.getTotalTime() << " us (" << emu.getReadOps() << " " << emu.getReadBytes() << ")" << std::endl;
+            // every item is read once by Storage::init and once more by debugCheck on the host,
+            // headers and entry tables are read in one go
+            if (fill) {
+                CHECK(emu.getReadOps() < 2 * itemCount + sectorCount * (SPI_FLASH_SEC_SIZE / 256 + 1) + Page::ENTRY_COUNT * 2);
+            } else {
+                CHECK(emu.getReadOps() == sectorCount * (SPI_FLASH_SEC_SIZE / 256 + 1));
+            }
+
+            // hash lists of full pages are loaded on demand
+            for (size_t i = 0; i < itemCount; i += 97) {
+                snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+                uint32_t val;
+                REQUIRE(mounted.readItem(1, key, val) == ESP_OK);
+                CHECK(val == i);
+            }
+        }
+    }
+}
+
 TEST_CASE("storage doesn't add duplicates within one page", "[nvs]")
 {
     SpiFlashEmulator emu(8);
@@ -347,6 +390,45 @@ TEST_CASE("can write and read variable length data lots of times", "[nvs]")
 }
 
 
+TEST_CASE("storage index finds items without probing every page", "[nvs]")
+{
+    const size_t sectorCount = 64;
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    CHECK(storage.init(0, sectorCount) == ESP_OK);
+    const size_t keyCount = Page::ENTRY_COUNT * 12;
+    char key[16];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, key, static_cast<uint32_t>(i)) == ESP_OK);
+    }
+
+    emu.clearStats();
+    uint32_t val;
+    snprintf(key, sizeof(key), "key_%d", static_cast<int>(keyCount - 1));
+    CHECK(storage.readItem(1, key, val) == ESP_OK);
+    CHECK(val == keyCount - 1);
+    size_t lastKeyReadOps = emu.getReadOps();
+    CHECK(lastKeyReadOps <= 2);
+
+    emu.clearStats();
+    CHECK(storage.readItem(1, "missing", val) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(emu.getReadOps() == 0);
+
+    // index has to follow items which are moved when pages are reclaimed
+    for (size_t i = 0; i < keyCount; i += 7) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        REQUIRE(storage.writeItem(1, key, static_cast<uint32_t>(i + 1)) == ESP_OK);
+    }
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+        CHECK(val == ((i % 7 == 0) ? i + 1 : i));
+    }
+
+    s_perf << "Read ops to find last key (" << sectorCount << " sectors, " << keyCount << " keys): " << lastKeyReadOps << std::endl;
+}
+
 TEST_CASE("can get length of variable length data", "[nvs]")
 {
     SpiFlashEmulator emu(8);
@@ -1075,6 +1157,38 @@ TEST_CASE("crc error in variable length item is handled", "[nvs]")
     }
 }
 
+TEST_CASE("crc error found by a reader is erased by the next writer", "[nvs]")
+{
+    SpiFlashEmulator emu(3);
+    Storage storage;
+    CHECK(storage.init(0, 3) == ESP_OK);
+    const char* str = "foobar";
+    TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "key", str, strlen(str) + 1));
+    // corrupt string data
+    uint32_t w;
+    CHECK(emu.read(&w, 32 * 3, sizeof(w)));
+    w &= 0xf000000f;
+    CHECK(emu.write(32 * 3, &w, sizeof(w)));
+
+    // readers may share the page, so they leave flash alone
+    char buf[16];
+    size_t writeOps = emu.getWriteOps();
+    TEST_ESP_ERR(storage.readItem(1, ItemType::SZ, "key", buf, sizeof(buf)), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(storage.readItem(1, ItemType::SZ, "key", buf, sizeof(buf)), ESP_ERR_NVS_NOT_FOUND);
+    CHECK(emu.getWriteOps() == writeOps);
+    {
+        Page p;
+        p.load(0);
+        CHECK(p.getUsedEntryCount() == 2);
+    }
+
+    TEST_ESP_OK(storage.writeItem<uint32_t>(1, "other", 1));
+    TEST_ESP_ERR(storage.readItem(1, ItemType::SZ, "key", buf, sizeof(buf)), ESP_ERR_NVS_NOT_FOUND);
+    Page p;
+    p.load(0);
+    CHECK(p.getUsedEntryCount() == 1);
+    CHECK(p.getErasedEntryCount() == 2);
+}
 
 TEST_CASE("read/write failure (TW8406)", "[nvs]")
 {
@@ -1109,6 +1223,843 @@ TEST_CASE("read/write failure (TW8406)", "[nvs]")
 }
 
 
+TEST_CASE("batch of writes is visible to the handle and committed together", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(3);
+    TEST_ESP_OK(nvs_flash_init_custom(0, 3));
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("batch", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 1));
+    TEST_ESP_OK(nvs_set_str(handle, "s", "old"));
+
+    TEST_ESP_OK(nvs_begin(handle));
+    TEST_ESP_ERR(nvs_begin(handle), ESP_ERR_NVS_INVALID_STATE);
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 2));
+    TEST_ESP_OK(nvs_set_u32(handle, "b", 3));
+    TEST_ESP_OK(nvs_set_str(handle, "s", "new value"));
+    TEST_ESP_ERR(nvs_erase_key(handle, "a"), ESP_ERR_NVS_INVALID_STATE);
+    TEST_ESP_ERR(nvs_erase_all(handle), ESP_ERR_NVS_INVALID_STATE);
+
+    // values set in the batch are visible through the handle which set them
+    uint32_t val;
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 2);
+    nvs_handle other;
+    TEST_ESP_OK(nvs_open("batch", NVS_READONLY, &other));
+    TEST_ESP_OK(nvs_get_u32(other, "a", &val));
+    CHECK(val == 1);
+    TEST_ESP_ERR(nvs_get_u32(other, "b", &val), ESP_ERR_NVS_NOT_FOUND);
+    size_t len;
+    TEST_ESP_OK(nvs_get_str(handle, "s", nullptr, &len));
+    CHECK(len == strlen("new value") + 1);
+
+    TEST_ESP_OK(nvs_commit(handle));
+    TEST_ESP_OK(nvs_get_u32(other, "a", &val));
+    CHECK(val == 2);
+    TEST_ESP_OK(nvs_get_u32(other, "b", &val));
+    CHECK(val == 3);
+    char buf[16];
+    len = sizeof(buf);
+    TEST_ESP_OK(nvs_get_str(other, "s", buf, &len));
+    CHECK(strcmp(buf, "new value") == 0);
+
+    // closing the handle discards the batch
+    TEST_ESP_OK(nvs_begin(handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 4));
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_get_u32(other, "a", &val));
+    CHECK(val == 2);
+    nvs_close(other);
+
+    // values are still there after reinitialization, and commit markers are not visible
+    TEST_ESP_OK(nvs_flash_init_custom(0, 3));
+    TEST_ESP_OK(nvs_open("batch", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 2);
+    TEST_ESP_OK(nvs_get_u32(handle, "b", &val));
+    CHECK(val == 3);
+    nvs_close(handle);
+}
+
+TEST_CASE("batch needs fewer flash writes than separate writes", "[nvs][batch]")
+{
+    const size_t keyCount = 32;
+    size_t writeOps[2];
+    for (int useBatch = 0; useBatch < 2; ++useBatch) {
+        SpiFlashEmulator emu(4);
+        TEST_ESP_OK(nvs_flash_init_custom(0, 4));
+        nvs_handle handle;
+        TEST_ESP_OK(nvs_open("batch", NVS_READWRITE, &handle));
+        char key[16];
+        for (size_t i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+            TEST_ESP_OK(nvs_set_u32(handle, key, 0));
+        }
+        emu.clearStats();
+        if (useBatch) {
+            TEST_ESP_OK(nvs_begin(handle));
+        }
+        for (size_t i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+            TEST_ESP_OK(nvs_set_u32(handle, key, i));
+        }
+        TEST_ESP_OK(nvs_commit(handle));
+        writeOps[useBatch] = emu.getWriteOps();
+        for (size_t i = 0; i < keyCount; ++i) {
+            uint32_t val;
+            snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+            TEST_ESP_OK(nvs_get_u32(handle, key, &val));
+            CHECK(val == i);
+        }
+        nvs_close(handle);
+    }
+    CHECK(writeOps[1] < writeOps[0]);
+    // one write per item, then one entry state table update per page for
+    // the new items, the commit marker and the old copies
+    CHECK(writeOps[1] <= keyCount + 4);
+    s_perf << "Write ops to update " << keyCount << " keys: " << writeOps[0] << " separately, " << writeOps[1] << " in a batch" << std::endl;
+}
+
+TEST_CASE("batch is written completely or not at all after sudden poweroff", "[nvs][batch]")
+{
+    const size_t sectorCount = 3;
+    const size_t keyCount = 12;
+    uint8_t blob[100];
+    char key[16];
+
+    auto writeBatch = [&](nvs_handle handle, uint8_t value) -> esp_err_t {
+        auto err = nvs_begin(handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+        fill_n(blob, sizeof(blob), value);
+        for (size_t i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "blob_%d", static_cast<int>(i));
+            err = nvs_set_blob(handle, key, blob, sizeof(blob));
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        TEST_ESP_OK(nvs_set_u8(handle, "value", value));
+        return nvs_commit(handle);
+    };
+
+    auto checkValues = [&](nvs_handle handle) -> uint8_t {
+        uint8_t value;
+        TEST_ESP_OK(nvs_get_u8(handle, "value", &value));
+        for (size_t i = 0; i < keyCount; ++i) {
+            uint8_t buf[sizeof(blob)];
+            size_t len = sizeof(buf);
+            snprintf(key, sizeof(key), "blob_%d", static_cast<int>(i));
+            TEST_ESP_OK(nvs_get_blob(handle, key, buf, &len));
+            CHECK(len == sizeof(buf));
+            CHECK(all_of(buf, buf + len, [=](uint8_t b) { return b == value; }));
+        }
+        return value;
+    };
+
+    size_t iterations = 0;
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(sectorCount);
+        nvs_handle handle;
+        TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+        TEST_ESP_OK(nvs_open("batch", NVS_READWRITE, &handle));
+        // second batch reclaims the first page, which holds the first values
+        for (uint8_t value = 1; value <= 3; ++value) {
+            TEST_ESP_OK(writeBatch(handle, value));
+        }
+        nvs_close(handle);
+
+        emu.failAfter(errDelay);
+        bool completed = false;
+        if (nvs_flash_init_custom(0, sectorCount) == ESP_OK &&
+                nvs_open("batch", NVS_READWRITE, &handle) == ESP_OK) {
+            completed = (writeBatch(handle, 4) == ESP_OK);
+            nvs_close(handle);
+        }
+        emu.failAfter(UINT32_MAX);
+
+        TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+        TEST_ESP_OK(nvs_open("batch", NVS_READWRITE, &handle));
+        uint8_t value = checkValues(handle);
+        CHECK((value == 3 || value == 4));
+        if (completed) {
+            CHECK(value == 4);
+        }
+        // storage is usable after recovery
+        TEST_ESP_OK(writeBatch(handle, 5));
+        CHECK(checkValues(handle) == 5);
+        nvs_close(handle);
+        ++iterations;
+        if (completed) {
+            break;
+        }
+    }
+    CHECK(iterations > 1);
+}
+
+TEST_CASE("blobs larger than a page are split into chunks", "[nvs][blob]")
+{
+    const size_t sectorCount = 12;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("blobs", NVS_READWRITE, &handle));
+
+    const size_t blobSize = 16 * 1024;
+    uint8_t* blob = new uint8_t[blobSize];
+    uint8_t* buf = new uint8_t[blobSize + 1];
+    for (size_t i = 0; i < blobSize; ++i) {
+        blob[i] = static_cast<uint8_t>(i * 7 + i / 256);
+    }
+    TEST_ESP_OK(nvs_set_u8(handle, "before", 1));
+    TEST_ESP_OK(nvs_set_blob(handle, "cert", blob, blobSize));
+    TEST_ESP_OK(nvs_set_u8(handle, "after", 2));
+
+    size_t len = 0;
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", nullptr, &len));
+    CHECK(len == blobSize);
+    len = blobSize - 1;
+    TEST_ESP_ERR(nvs_get_blob(handle, "cert", buf, &len), ESP_ERR_NVS_INVALID_LENGTH);
+    len = blobSize;
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", buf, &len));
+    CHECK(memcmp(buf, blob, blobSize) == 0);
+
+    // read in pieces which cross entry and chunk boundaries, to aligned and unaligned buffers
+    const size_t pieces[] = {1, 31, 100, 1000, 3999, 4001};
+    for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p) {
+        for (size_t offset = 0; offset < blobSize; offset += pieces[p]) {
+            size_t count = std::min(pieces[p], blobSize - offset);
+            uint8_t* dst = buf + (offset % 2);
+            TEST_ESP_OK(nvs_get_blob_chunked(handle, "cert", offset, dst, count));
+            REQUIRE(memcmp(dst, blob + offset, count) == 0);
+        }
+    }
+    TEST_ESP_ERR(nvs_get_blob_chunked(handle, "cert", blobSize - 10, buf, 11), ESP_ERR_NVS_INVALID_LENGTH);
+
+    emu.clearStats();
+    TEST_ESP_OK(nvs_get_blob_chunked(handle, "cert", 8000, buf, 64));
+    size_t pieceReadBytes = emu.getReadBytes();
+
+    // update the blob a few times, old chunks have to be reclaimed
+    for (int i = 0; i < 5; ++i) {
+        blob[i] = ~blob[i];
+        TEST_ESP_OK(nvs_set_blob(handle, "cert", blob, blobSize - i * 1000));
+    }
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", nullptr, &len));
+    CHECK(len == blobSize - 4000);
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", buf, &len));
+    CHECK(memcmp(buf, blob, len) == 0);
+    nvs_close(handle);
+
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_OK(nvs_open("blobs", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", nullptr, &len));
+    CHECK(len == blobSize - 4000);
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", buf, &len));
+    CHECK(memcmp(buf, blob, len) == 0);
+    uint8_t val;
+    TEST_ESP_OK(nvs_get_u8(handle, "before", &val));
+    CHECK(val == 1);
+    TEST_ESP_OK(nvs_get_u8(handle, "after", &val));
+    CHECK(val == 2);
+
+    // switching between single page and multi-page representation
+    TEST_ESP_OK(nvs_set_blob(handle, "cert", blob, 100));
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", nullptr, &len));
+    CHECK(len == 100);
+    TEST_ESP_OK(nvs_set_blob(handle, "cert", blob, blobSize));
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", nullptr, &len));
+    CHECK(len == blobSize);
+    TEST_ESP_OK(nvs_get_blob(handle, "cert", buf, &len));
+    CHECK(memcmp(buf, blob, len) == 0);
+
+    TEST_ESP_OK(nvs_erase_key(handle, "cert"));
+    TEST_ESP_ERR(nvs_get_blob(handle, "cert", nullptr, &len), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_blob_chunked(handle, "cert", 0, buf, 1), ESP_ERR_NVS_NOT_FOUND);
+
+    // large blobs can't be part of a batch
+    TEST_ESP_OK(nvs_begin(handle));
+    TEST_ESP_ERR(nvs_set_blob(handle, "cert", blob, blobSize), ESP_ERR_NVS_VALUE_TOO_LONG);
+    TEST_ESP_OK(nvs_commit(handle));
+    nvs_close(handle);
+
+    delete[] blob;
+    delete[] buf;
+    s_perf << "Bytes read to get 64 bytes of a " << blobSize << " byte blob: " << pieceReadBytes << std::endl;
+}
+
+TEST_CASE("multi-page blob survives sudden poweroff during update", "[nvs][blob]")
+{
+    const size_t sectorCount = 6;
+    const size_t blobSize = 8 * 1024;
+    uint8_t blob[blobSize];
+    uint8_t buf[blobSize];
+
+    auto writeBlob = [&](nvs_handle handle, uint8_t value) -> esp_err_t {
+        for (size_t i = 0; i < blobSize; ++i) {
+            blob[i] = static_cast<uint8_t>(value + i);
+        }
+        return nvs_set_blob(handle, "blob", blob, blobSize);
+    };
+
+    auto checkBlob = [&](nvs_handle handle) -> uint8_t {
+        size_t len = 0;
+        TEST_ESP_OK(nvs_get_blob(handle, "blob", nullptr, &len));
+        CHECK(len == blobSize);
+        TEST_ESP_OK(nvs_get_blob(handle, "blob", buf, &len));
+        uint8_t value = buf[0];
+        for (size_t i = 0; i < blobSize; ++i) {
+            if (buf[i] != static_cast<uint8_t>(value + i)) {
+                FAIL("blob contents are inconsistent at " << i);
+            }
+        }
+        return value;
+    };
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(sectorCount);
+        nvs_handle handle;
+        TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+        TEST_ESP_OK(nvs_open("blobs", NVS_READWRITE, &handle));
+        TEST_ESP_OK(writeBlob(handle, 1));
+        TEST_ESP_OK(writeBlob(handle, 2));
+        nvs_close(handle);
+
+        emu.failAfter(errDelay);
+        bool completed = false;
+        if (nvs_flash_init_custom(0, sectorCount) == ESP_OK &&
+                nvs_open("blobs", NVS_READWRITE, &handle) == ESP_OK) {
+            completed = (writeBlob(handle, 3) == ESP_OK);
+            nvs_close(handle);
+        }
+        emu.failAfter(UINT32_MAX);
+
+        TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+        TEST_ESP_OK(nvs_open("blobs", NVS_READWRITE, &handle));
+        uint8_t value = checkBlob(handle);
+        CHECK((value == 2 || value == 3));
+        if (completed) {
+            CHECK(value == 3);
+        }
+        // chunks left by the interrupted write don't take space forever
+        for (uint8_t i = 4; i < 8; ++i) {
+            TEST_ESP_OK(writeBlob(handle, i));
+        }
+        CHECK(checkBlob(handle) == 7);
+        nvs_close(handle);
+        if (completed) {
+            break;
+        }
+    }
+}
+
+static size_t countEntries(const char* namespace_name, nvs_type_t type, std::string* keys = nullptr)
+{
+    nvs_iterator_t it;
+    size_t count = 0;
+    for (esp_err_t err = nvs_entry_find(nullptr, namespace_name, type, &it); err == ESP_OK; err = nvs_entry_next(&it)) {
+        nvs_entry_info_t info;
+        TEST_ESP_OK(nvs_entry_info(it, &info));
+        if (keys) {
+            *keys += std::string(info.namespace_name) + "/" + info.key + ":" + std::to_string(info.type) + " ";
+        }
+        ++count;
+    }
+    CHECK(it == nullptr);
+    return count;
+}
+
+TEST_CASE("iterator returns all keys matching namespace and type", "[nvs][iterator]")
+{
+    const size_t sectorCount = 8;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+
+    nvs_iterator_t it;
+    TEST_ESP_ERR(nvs_entry_find(nullptr, nullptr, NVS_TYPE_ANY, &it), ESP_ERR_NVS_NOT_FOUND);
+    CHECK(it == nullptr);
+    TEST_ESP_ERR(nvs_entry_find(nullptr, nullptr, NVS_TYPE_ANY, nullptr), ESP_ERR_INVALID_ARG);
+    TEST_ESP_ERR(nvs_entry_next(nullptr), ESP_ERR_INVALID_ARG);
+
+    nvs_handle a, b;
+    TEST_ESP_OK(nvs_open("ns_a", NVS_READWRITE, &a));
+    TEST_ESP_OK(nvs_open("ns_b", NVS_READWRITE, &b));
+    TEST_ESP_OK(nvs_set_u8(a, "u8", 1));
+    TEST_ESP_OK(nvs_set_i32(a, "i32", -1));
+    TEST_ESP_OK(nvs_set_str(a, "str", "value"));
+    TEST_ESP_OK(nvs_set_blob(a, "blob", "\x01\x02", 2));
+    TEST_ESP_OK(nvs_set_u8(b, "u8", 2));
+    TEST_ESP_OK(nvs_set_u16(b, "u16", 3));
+    uint8_t bigBlob[6000] = {0};
+    TEST_ESP_OK(nvs_set_blob(b, "big", bigBlob, sizeof(bigBlob)));
+    TEST_ESP_OK(nvs_erase_key(a, "i32"));
+    TEST_ESP_OK(nvs_begin(b));
+    TEST_ESP_OK(nvs_set_u32(b, "batched", 4));
+
+    std::string keys;
+    CHECK(countEntries(nullptr, NVS_TYPE_ANY, &keys) == 6);
+    CHECK(keys == "ns_a/u8:1 ns_a/str:33 ns_a/blob:65 ns_b/u8:1 ns_b/u16:2 ns_b/big:65 ");
+    CHECK(countEntries("ns_a", NVS_TYPE_ANY) == 3);
+    CHECK(countEntries("ns_b", NVS_TYPE_ANY) == 3);
+    CHECK(countEntries(nullptr, NVS_TYPE_U8) == 2);
+    CHECK(countEntries(nullptr, NVS_TYPE_BLOB) == 2);
+    CHECK(countEntries("ns_b", NVS_TYPE_BLOB) == 1);
+    CHECK(countEntries(nullptr, NVS_TYPE_I32) == 0);
+    TEST_ESP_ERR(nvs_entry_find(nullptr, "ns_c", NVS_TYPE_ANY, &it), ESP_ERR_NVS_NOT_FOUND);
+
+    TEST_ESP_OK(nvs_commit(b));
+    CHECK(countEntries(nullptr, NVS_TYPE_ANY) == 7);
+
+    // stop before reaching the end
+    TEST_ESP_OK(nvs_entry_find(nullptr, "ns_b", NVS_TYPE_ANY, &it));
+    nvs_entry_info_t info;
+    TEST_ESP_OK(nvs_entry_info(it, &info));
+    CHECK(std::string(info.namespace_name) == "ns_b");
+    nvs_release_iterator(it);
+
+    nvs_close(a);
+    nvs_close(b);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    CHECK(countEntries(nullptr, NVS_TYPE_ANY) == 7);
+}
+
+TEST_CASE("iterator survives reclaim of its page between calls", "[nvs][iterator]")
+{
+    const size_t sectorCount = 4;
+    const size_t keyCount = 100;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    char key[16];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        TEST_ESP_OK(nvs_set_u32(handle, key, i));
+    }
+
+    nvs_iterator_t it;
+    TEST_ESP_OK(nvs_entry_find(nullptr, "test", NVS_TYPE_ANY, &it));
+    // rewriting one key many times reclaims every page, including the iterator's
+    for (size_t i = 0; i < Page::ENTRY_COUNT * sectorCount; ++i) {
+        TEST_ESP_OK(nvs_set_u32(handle, "key_0", i));
+    }
+    size_t count = 1;
+    esp_err_t err;
+    while ((err = nvs_entry_next(&it)) == ESP_OK) {
+        ++count;
+        CHECK(count <= 2 * keyCount);
+    }
+    TEST_ESP_ERR(err, ESP_ERR_NVS_NOT_FOUND);
+    CHECK(it == nullptr);
+    nvs_close(handle);
+}
+
+TEST_CASE("iterator and stats use the given partition", "[nvs][iterator]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(2 * sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_OK(nvs_flash_init_partition_custom("iter", sectorCount, sectorCount));
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open_from_partition("iter", "ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u8(handle, "a", 1));
+    TEST_ESP_OK(nvs_set_u8(handle, "b", 2));
+
+    nvs_iterator_t it;
+    TEST_ESP_ERR(nvs_entry_find(nullptr, nullptr, NVS_TYPE_ANY, &it), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_entry_find("missing", nullptr, NVS_TYPE_ANY, &it), ESP_ERR_NVS_NOT_INITIALIZED);
+    TEST_ESP_OK(nvs_entry_find("iter", nullptr, NVS_TYPE_ANY, &it));
+    TEST_ESP_OK(nvs_entry_next(&it));
+    TEST_ESP_ERR(nvs_entry_next(&it), ESP_ERR_NVS_NOT_FOUND);
+
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(nullptr, &stats));
+    CHECK(stats.used_entries == 0);
+    TEST_ESP_OK(nvs_get_stats("iter", &stats));
+    CHECK(stats.used_entries == 3);
+    nvs_close(handle);
+}
+
+TEST_CASE("iterator skips erased entries without reading them", "[nvs][iterator]")
+{
+    const size_t sectorCount = 6;
+    const size_t keyCount = 400;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("test", NVS_READWRITE, &handle));
+    char key[16];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        TEST_ESP_OK(nvs_set_u32(handle, key, i));
+    }
+    for (size_t i = 0; i < keyCount; i += 2) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        TEST_ESP_OK(nvs_erase_key(handle, key));
+    }
+    nvs_close(handle);
+
+    emu.clearStats();
+    CHECK(countEntries("test", NVS_TYPE_U32) == keyCount / 2);
+    // one read for each remaining key, and one for the namespace entry
+    CHECK(emu.getReadOps() == keyCount / 2 + 1);
+    s_perf << "Read ops to iterate over " << keyCount / 2 << " keys (" << keyCount / 2 << " erased): " << emu.getReadOps() << std::endl;
+}
+
+static double measureWriteAmplification(const ReclaimPolicy* policy, size_t& eraseOps)
+{
+    const size_t sectorCount = 16;
+    const size_t keyCount = 500;
+    const size_t hotKeyCount = keyCount / 10;
+    const size_t updateCount = 10000;
+    const size_t valueSize = 40;
+    // item header entry plus two data entries
+    const size_t bytesPerUpdate = 3 * sizeof(Item);
+
+    SpiFlashEmulator emu(sectorCount);
+    Storage storage;
+    storage.setReclaimPolicy(policy);
+    REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+
+    std::mt19937 gen(12345);
+    char key[16];
+    uint8_t value[valueSize];
+    for (size_t i = 0; i < keyCount; ++i) {
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(i));
+        std::generate_n(value, valueSize, gen);
+        REQUIRE(storage.writeItem(1, ItemType::BLOB, key, value, valueSize) == ESP_OK);
+    }
+
+    // 80% of updates go to 10% of keys
+    emu.clearStats();
+    std::uniform_int_distribution<size_t> percent(0, 99);
+    std::uniform_int_distribution<size_t> hotKey(0, hotKeyCount - 1);
+    std::uniform_int_distribution<size_t> coldKey(hotKeyCount, keyCount - 1);
+    for (size_t i = 0; i < updateCount; ++i) {
+        size_t k = (percent(gen) < 80) ? hotKey(gen) : coldKey(gen);
+        snprintf(key, sizeof(key), "key_%d", static_cast<int>(k));
+        std::generate_n(value, valueSize, gen);
+        REQUIRE(storage.writeItem(1, ItemType::BLOB, key, value, valueSize) == ESP_OK);
+    }
+    eraseOps = emu.getEraseOps();
+    return static_cast<double>(emu.getWriteBytes()) / (updateCount * bytesPerUpdate);
+}
+
+TEST_CASE("reclaiming page with most erased entries reduces write amplification", "[nvs][gc]")
+{
+    OldestPageReclaimPolicy oldest;
+    MostErasedReclaimPolicy mostErased;
+    size_t oldestErases, mostErasedErases;
+    double oldestWA = measureWriteAmplification(&oldest, oldestErases);
+    double mostErasedWA = measureWriteAmplification(&mostErased, mostErasedErases);
+    s_perf << "Write amplification of skewed random updates: " << oldestWA << " (" << oldestErases
+           << " erases) reclaiming oldest page, " << mostErasedWA << " (" << mostErasedErases
+           << " erases) reclaiming page with most erased entries" << std::endl;
+    CHECK(mostErasedWA <= oldestWA);
+    CHECK(mostErasedErases <= oldestErases);
+}
+
+TEST_CASE("sector erase counts survive reinit", "[nvs][gc]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    nvs_stats_t before;
+    {
+        Storage storage;
+        REQUIRE(storage.init(0, sectorCount) == ESP_OK);
+        for (uint32_t i = 0; i < 1000; ++i) {
+            REQUIRE(storage.writeItem(1, "key", i) == ESP_OK);
+        }
+        REQUIRE(storage.fillStats(before) == ESP_OK);
+    }
+    CHECK(before.max_erase_count > 0);
+    CHECK(before.max_erase_count * sectorCount >= emu.getEraseOps());
+
+    // the count of the spare free page is only kept in RAM, because the page
+    // is initialized when it becomes active
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(nullptr, &stats));
+    CHECK(stats.max_erase_count > 0);
+    CHECK(stats.max_erase_count <= before.max_erase_count);
+    CHECK(stats.min_erase_count <= before.min_erase_count);
+}
+
+TEST_CASE("erased page is left blank for older firmware", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(4);
+    Page page;
+    CHECK(page.load(0) == ESP_OK);
+    CHECK(page.erase() == ESP_OK);
+    CHECK(page.getEraseCount() == 1);
+    // erase count of a free page is only written when the page is initialized,
+    // so the sector reads as uninitialized to any version of the driver
+    uint32_t header[8];
+    CHECK(emu.read(header, 0, sizeof(header)));
+    CHECK(std::all_of(std::begin(header), std::end(header), [](uint32_t val) { return val == 0xffffffff; }));
+    Page reloaded;
+    CHECK(reloaded.load(0) == ESP_OK);
+    CHECK(reloaded.state() == Page::PageState::UNINITIALIZED);
+}
+
+TEST_CASE("nvs_get_stats reports entry usage", "[nvs][gc]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_ERR(nvs_get_stats(nullptr, nullptr), ESP_ERR_INVALID_ARG);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(nullptr, &stats));
+    CHECK(stats.total_entries == sectorCount * Page::ENTRY_COUNT);
+    CHECK(stats.used_entries == 0);
+    CHECK(stats.erased_entries == 0);
+    CHECK(stats.free_entries == stats.total_entries);
+    CHECK(stats.namespace_count == 0);
+
+    nvs_handle a, b;
+    TEST_ESP_OK(nvs_open("ns_a", NVS_READWRITE, &a));
+    TEST_ESP_OK(nvs_open("ns_b", NVS_READWRITE, &b));
+    TEST_ESP_OK(nvs_set_u32(a, "u32", 1));
+    TEST_ESP_OK(nvs_set_str(a, "str", "a string longer than 32 bytes........"));
+    TEST_ESP_OK(nvs_set_u8(b, "u8", 2));
+    TEST_ESP_OK(nvs_set_u8(b, "u8", 3));
+    TEST_ESP_OK(nvs_get_stats(nullptr, &stats));
+    // two namespace entries, u32, str (1 + 2 data entries), u8
+    CHECK(stats.used_entries == 2 + 1 + 3 + 1);
+    CHECK(stats.erased_entries == 1);
+    CHECK(stats.free_entries == stats.total_entries - stats.used_entries - stats.erased_entries);
+    CHECK(stats.namespace_count == 2);
+    nvs_close(a);
+    nvs_close(b);
+}
+
+TEST_CASE("readers share RWLock, writers hold it alone", "[nvs][concurrency]")
+{
+    RWLock rwlock;
+    const size_t threadCount = 4;
+    std::atomic<size_t> readers(0);
+    std::atomic<size_t> writers(0);
+    std::atomic<size_t> maxReaders(0);
+    std::atomic<bool> violation(false);
+
+    auto reader = [&]() {
+        for (int i = 0; i < 200; ++i) {
+            ReadLock lock(rwlock);
+            size_t count = ++readers;
+            size_t prev = maxReaders.load();
+            while (count > prev && !maxReaders.compare_exchange_weak(prev, count)) {
+            }
+            if (writers.load() != 0) {
+                violation = true;
+            }
+            std::this_thread::yield();
+            --readers;
+        }
+    };
+    auto writer = [&]() {
+        for (int i = 0; i < 200; ++i) {
+            WriteLock lock(rwlock);
+            if (++writers != 1 || readers.load() != 0) {
+                violation = true;
+            }
+            std::this_thread::yield();
+            --writers;
+        }
+    };
+
+    // all readers enter before any of them leaves
+    {
+        std::atomic<size_t> entered(0);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&]() {
+                ReadLock lock(rwlock);
+                ++entered;
+                while (entered.load() < threadCount) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        CHECK(entered.load() == threadCount);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(reader);
+    }
+    threads.emplace_back(writer);
+    threads.emplace_back(writer);
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK_FALSE(violation.load());
+    CHECK(maxReaders.load() >= 1);
+}
+
+TEST_CASE("closed handles are rejected after their table slot is reused", "[nvs][concurrency]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+
+    const size_t handleCount = 100;
+    nvs_handle handles[handleCount];
+    for (size_t i = 0; i < handleCount; ++i) {
+        TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handles[i]));
+        CHECK(handles[i] != 0);
+    }
+    TEST_ESP_OK(nvs_set_u32(handles[0], "key", 42));
+    for (size_t i = 0; i < handleCount; i += 2) {
+        nvs_close(handles[i]);
+    }
+    nvs_handle reopened[handleCount / 2];
+    for (size_t i = 0; i < handleCount / 2; ++i) {
+        TEST_ESP_OK(nvs_open("ns", NVS_READONLY, &reopened[i]));
+    }
+    uint32_t value;
+    for (size_t i = 0; i < handleCount; ++i) {
+        if (i % 2 == 0) {
+            TEST_ESP_ERR(nvs_get_u32(handles[i], "key", &value), ESP_ERR_NVS_INVALID_HANDLE);
+            TEST_ESP_ERR(nvs_set_u32(handles[i], "key", 1), ESP_ERR_NVS_INVALID_HANDLE);
+        } else {
+            TEST_ESP_OK(nvs_get_u32(handles[i], "key", &value));
+            CHECK(value == 42);
+        }
+    }
+    for (size_t i = 0; i < handleCount / 2; ++i) {
+        TEST_ESP_ERR(nvs_set_u32(reopened[i], "key", 1), ESP_ERR_NVS_READ_ONLY);
+    }
+    TEST_ESP_ERR(nvs_get_u32(0, "key", &value), ESP_ERR_NVS_INVALID_HANDLE);
+    nvs_close(0);
+}
+
+TEST_CASE("partitions have separate storage and handles", "[nvs][concurrency]")
+{
+    const size_t sectorCount = 4;
+    SpiFlashEmulator emu(2 * sectorCount);
+    nvs_handle handle;
+    TEST_ESP_ERR(nvs_open_from_partition("other", "ns", NVS_READWRITE, &handle), ESP_ERR_NVS_NOT_INITIALIZED);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_OK(nvs_flash_init_partition_custom("other", sectorCount, sectorCount));
+
+    nvs_handle a, b;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &a));
+    TEST_ESP_OK(nvs_open_from_partition("other", "ns", NVS_READWRITE, &b));
+    TEST_ESP_OK(nvs_set_u32(a, "key", 1));
+    TEST_ESP_OK(nvs_set_u32(b, "key", 2));
+    uint32_t value;
+    TEST_ESP_OK(nvs_get_u32(a, "key", &value));
+    CHECK(value == 1);
+    TEST_ESP_OK(nvs_get_u32(b, "key", &value));
+    CHECK(value == 2);
+
+    // reinitializing one partition closes only its own handles
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_ERR(nvs_get_u32(a, "key", &value), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_OK(nvs_get_u32(b, "key", &value));
+    CHECK(value == 2);
+    TEST_ESP_OK(nvs_open("ns", NVS_READONLY, &a));
+    TEST_ESP_OK(nvs_get_u32(a, "key", &value));
+    CHECK(value == 1);
+    nvs_close(a);
+    nvs_close(b);
+}
+
+TEST_CASE("concurrent readers and writers of two partitions see consistent values", "[nvs][concurrency]")
+{
+    const size_t sectorCount = 4;
+    const size_t keyCount = 16;
+    const uint32_t writesPerThread = 300;
+    SpiFlashEmulator emu(2 * sectorCount);
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_OK(nvs_flash_init_partition_custom("other", sectorCount, sectorCount));
+
+    const char* partitions[] = {NVS_DEFAULT_PART_NAME, "other"};
+    nvs_handle handles[2];
+    for (size_t p = 0; p < 2; ++p) {
+        TEST_ESP_OK(nvs_open_from_partition(partitions[p], "stress", NVS_READWRITE, &handles[p]));
+        for (uint32_t k = 0; k < keyCount; ++k) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%u", k);
+            TEST_ESP_OK(nvs_set_u32(handles[p], key, k << 16));
+        }
+    }
+
+    // values hold the key number in the upper half, so a reader can tell
+    // if it got a value of another key or a partially updated one
+    std::atomic<size_t> errors(0);
+    std::atomic<size_t> reads(0);
+    std::atomic<bool> done(false);
+    auto writer = [&](nvs_handle handle, uint32_t seed) {
+        std::mt19937 gen(seed);
+        for (uint32_t i = 0; i < writesPerThread; ++i) {
+            uint32_t k = gen() % keyCount;
+            char key[16];
+            snprintf(key, sizeof(key), "key_%u", k);
+            if (nvs_set_u32(handle, key, (k << 16) | (i & 0xffff)) != ESP_OK) {
+                ++errors;
+            }
+        }
+    };
+    auto reader = [&](uint32_t seed) {
+        std::mt19937 gen(seed);
+        while (!done.load()) {
+            nvs_handle handle = handles[gen() % 2];
+            uint32_t k = gen() % keyCount;
+            char key[16];
+            snprintf(key, sizeof(key), "key_%u", k);
+            uint32_t value;
+            if (nvs_get_u32(handle, key, &value) != ESP_OK || (value >> 16) != k) {
+                ++errors;
+            }
+            ++reads;
+        }
+    };
+
+    std::vector<std::thread> writers;
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < 4; ++i) {
+        readers.emplace_back(reader, i);
+    }
+    for (uint32_t i = 0; i < 4; ++i) {
+        writers.emplace_back(writer, handles[i % 2], 100 + i);
+    }
+    for (auto& t : writers) {
+        t.join();
+    }
+    done = true;
+    for (auto& t : readers) {
+        t.join();
+    }
+    CHECK(errors.load() == 0);
+    CHECK(reads.load() > 0);
+
+    // values are still there after remount
+    for (size_t p = 0; p < 2; ++p) {
+        nvs_close(handles[p]);
+    }
+    TEST_ESP_OK(nvs_flash_init_custom(0, sectorCount));
+    TEST_ESP_OK(nvs_flash_init_partition_custom("other", sectorCount, sectorCount));
+    for (size_t p = 0; p < 2; ++p) {
+        TEST_ESP_OK(nvs_open_from_partition(partitions[p], "stress", NVS_READONLY, &handles[p]));
+        for (uint32_t k = 0; k < keyCount; ++k) {
+            char key[16];
+            snprintf(key, sizeof(key), "key_%u", k);
+            uint32_t value;
+            TEST_ESP_OK(nvs_get_u32(handles[p], key, &value));
+            CHECK((value >> 16) == k);
+        }
+        nvs_close(handles[p]);
+    }
+}
+
 TEST_CASE("dump all performance data", "[nvs]")
 {
     std::cout << "====================" << std::endl << "Dumping benchmarks" << std::endl;
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "catch.hpp"
+#include <functional>
 #include "esp_spi_flash.h"
 #include "spi_flash_emulation.h"
 
@@ -0,0 +1,371 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/param.h>  // For MIN/MAX(a, b)
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+#include "esp_spi_flash.h"
+#include "flash_buffered.h"
+
+#if CONFIG_SPI_FLASH_BUFFERED
+
+/*
+ * Buffered flash access layer.
+ *
+ * Every spi_flash_* call disables caches and stalls the other CPU at least
+ * once, and unaligned writes do so for every 32 bytes. This layer trades
+ * some RAM for fewer of these windows:
+ *
+ * - Writes smaller than a page are collected in a single page-sized buffer.
+ *   NOR flash programming can only clear bits, so the buffer starts as all
+ *   0xff and new data is ANDed into it. This gives the same result as
+ *   programming each write separately, in any order, and bytes which were
+ *   never written are programmed as 0xff, which leaves flash unchanged.
+ *   The buffer is programmed with a single aligned spi_flash_write call
+ *   when a write to a different page arrives or spi_flash_flush is called.
+ *
+ * - Reads smaller than a sector are served from an LRU cache of whole
+ *   sectors. Pending buffered writes are applied to cached sectors as they
+ *   arrive, so cached sectors always show what flash will contain after
+ *   the next flush.
+ *
+ * Direct writes and erases notify this layer once they are done (see
+ * flash_buffered.h). Erases drop the pending page if it was erased, and
+ * both invalidate affected cache lines.
+ */
+
+#define READ_CACHE_SECTORS CONFIG_SPI_FLASH_READ_CACHE_SECTORS
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+#define COUNT_SAVED_WINDOWS(n)  spi_flash_count_saved_windows(n)
+#else
+#define COUNT_SAVED_WINDOWS(n)
+#endif
+
+typedef struct {
+    uint32_t data[SPI_FLASH_SEC_SIZE / 4];
+    size_t sector;
+    uint32_t last_used;
+    bool valid;
+} read_cache_line_t;
+
+static SemaphoreHandle_t s_buf_mutex;
+
+static uint32_t s_page[SPI_FLASH_PAGE_SIZE / 4];
+static size_t s_page_addr;
+static size_t s_page_lo;            // first byte of the page written since last flush
+static size_t s_page_hi;            // one past the last byte written since last flush
+static bool s_page_valid;
+static bool s_own_write;            // set while this layer calls spi_flash_write
+
+#if READ_CACHE_SECTORS > 0
+static read_cache_line_t s_lines[READ_CACHE_SECTORS];
+static uint32_t s_lru_clock;
+#endif
+
+void spi_flash_buffered_init(void)
+{
+    s_buf_mutex = xSemaphoreCreateRecursiveMutex();
+}
+
+static void buf_lock(void)
+{
+    xSemaphoreTakeRecursive(s_buf_mutex, portMAX_DELAY);
+}
+
+static void buf_unlock(void)
+{
+    xSemaphoreGiveRecursive(s_buf_mutex);
+}
+
+static inline bool ranges_overlap(size_t a, size_t a_size, size_t b, size_t b_size)
+{
+    return a < b + b_size && b < a + a_size;
+}
+
+static void and_bytes(uint8_t* dst, const uint8_t* src, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        dst[i] &= src[i];
+    }
+}
+
+/* Apply the part of pending page data which overlaps [addr, addr + size) to buf */
+static void apply_pending(size_t addr, uint8_t* buf, size_t size)
+{
+    if (!s_page_valid || !ranges_overlap(addr, size, s_page_addr, SPI_FLASH_PAGE_SIZE)) {
+        return;
+    }
+    size_t start = MAX(addr, s_page_addr);
+    size_t end = MIN(addr + size, s_page_addr + SPI_FLASH_PAGE_SIZE);
+    and_bytes(buf + (start - addr), ((const uint8_t*) s_page) + (start - s_page_addr), end - start);
+}
+
+#if READ_CACHE_SECTORS > 0
+
+static read_cache_line_t* find_line(size_t sector)
+{
+    for (int i = 0; i < READ_CACHE_SECTORS; ++i) {
+        if (s_lines[i].valid && s_lines[i].sector == sector) {
+            return &s_lines[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t load_line(size_t sector, read_cache_line_t** out_line)
+{
+    read_cache_line_t* victim = &s_lines[0];
+    for (int i = 0; i < READ_CACHE_SECTORS; ++i) {
+        if (!s_lines[i].valid) {
+            victim = &s_lines[i];
+            break;
+        }
+        if (s_lines[i].last_used < victim->last_used) {
+            victim = &s_lines[i];
+        }
+    }
+    victim->valid = false;
+    esp_err_t err = spi_flash_read(sector * SPI_FLASH_SEC_SIZE, victim->data, SPI_FLASH_SEC_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    apply_pending(sector * SPI_FLASH_SEC_SIZE, (uint8_t*) victim->data, SPI_FLASH_SEC_SIZE);
+    victim->sector = sector;
+    victim->valid = true;
+    *out_line = victim;
+    return ESP_OK;
+}
+
+/* Write data into cached sectors, with the same AND semantics as flash programming */
+static void apply_to_lines(size_t addr, const uint8_t* src, size_t size)
+{
+    for (int i = 0; i < READ_CACHE_SECTORS; ++i) {
+        read_cache_line_t* line = &s_lines[i];
+        size_t line_addr = line->sector * SPI_FLASH_SEC_SIZE;
+        if (!line->valid || !ranges_overlap(addr, size, line_addr, SPI_FLASH_SEC_SIZE)) {
+            continue;
+        }
+        size_t start = MAX(addr, line_addr);
+        size_t end = MIN(addr + size, line_addr + SPI_FLASH_SEC_SIZE);
+        and_bytes(((uint8_t*) line->data) + (start - line_addr), src + (start - addr), end - start);
+    }
+}
+
+static void invalidate_lines(size_t addr, size_t size)
+{
+    for (int i = 0; i < READ_CACHE_SECTORS; ++i) {
+        if (s_lines[i].valid &&
+            ranges_overlap(addr, size, s_lines[i].sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE)) {
+            s_lines[i].valid = false;
+        }
+    }
+}
+
+#else //READ_CACHE_SECTORS > 0
+
+static void apply_to_lines(size_t addr, const uint8_t* src, size_t size)
+{
+}
+
+static void invalidate_lines(size_t addr, size_t size)
+{
+}
+
+#endif //READ_CACHE_SECTORS > 0
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+/* Number of cache-disable windows spi_flash_write would use for this write.
+ * This mirrors the way spi_flash_write splits data into SPIWrite calls. */
+static int32_t direct_write_windows(size_t dst, const void* src, size_t size)
+{
+    size_t left_size = MIN(((dst + 3) & ~3U) - dst, size);
+    size_t mid_size = (size - left_size) & ~3U;
+    size_t right_size = size - mid_size - left_size;
+    int32_t windows = (left_size > 0) + (right_size > 0);
+    if (mid_size > 0) {
+        bool in_dram = ((uintptr_t) src >= 0x3FFAE000 &&
+                        (uintptr_t) src < 0x40000000);
+        bool aligned = (((uintptr_t) src) + left_size) % 4 == 0;
+        windows += (in_dram && aligned) ? 1 : (mid_size + 31) / 32;
+    }
+    return windows;
+}
+#endif //CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+static esp_err_t flush_page(void)
+{
+    if (!s_page_valid) {
+        return ESP_OK;
+    }
+    size_t lo = s_page_lo & ~3U;
+    size_t hi = (s_page_hi + 3) & ~3U;
+    s_own_write = true;
+    esp_err_t err = spi_flash_write(s_page_addr + lo, ((const uint8_t*) s_page) + lo, hi - lo);
+    s_own_write = false;
+    if (err != ESP_OK) {
+        // keep the data, so that the caller may retry spi_flash_flush
+        return err;
+    }
+    s_page_valid = false;
+    COUNT_SAVED_WINDOWS(-1);
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_write_buffered(size_t dest, const void *srcv, size_t size)
+{
+    if (dest + size > spi_flash_get_chip_size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (size == 0) {
+        return ESP_OK;
+    }
+    const uint8_t* src = (const uint8_t*) srcv;
+    esp_err_t err = ESP_OK;
+    buf_lock();
+    if (size >= SPI_FLASH_PAGE_SIZE) {
+        // Nothing to combine. Order with respect to the pending page doesn't
+        // matter, because programming only clears bits.
+        s_own_write = true;
+        err = spi_flash_write(dest, src, size);
+        s_own_write = false;
+        if (err == ESP_OK) {
+            apply_to_lines(dest, src, size);
+        } else {
+            invalidate_lines(dest, size);
+        }
+        goto out;
+    }
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    int32_t saved = direct_write_windows(dest, src, size);
+#endif
+    while (size > 0) {
+        size_t page_addr = dest & ~(SPI_FLASH_PAGE_SIZE - 1);
+        if (s_page_valid && s_page_addr != page_addr) {
+            err = flush_page();
+            if (err != ESP_OK) {
+                goto out;
+            }
+        }
+        if (!s_page_valid) {
+            memset(s_page, 0xff, sizeof(s_page));
+            s_page_addr = page_addr;
+            s_page_lo = SPI_FLASH_PAGE_SIZE;
+            s_page_hi = 0;
+            s_page_valid = true;
+        }
+        size_t offset = dest - page_addr;
+        size_t chunk = MIN(size, SPI_FLASH_PAGE_SIZE - offset);
+        and_bytes(((uint8_t*) s_page) + offset, src, chunk);
+        s_page_lo = MIN(s_page_lo, offset);
+        s_page_hi = MAX(s_page_hi, offset + chunk);
+        apply_to_lines(dest, src, chunk);
+        dest += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    COUNT_SAVED_WINDOWS(saved);
+out:
+    buf_unlock();
+    return err;
+}
+
+esp_err_t spi_flash_read_buffered(size_t src, void *dstv, size_t size)
+{
+    if (src + size > spi_flash_get_chip_size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (size == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    buf_lock();
+#if READ_CACHE_SECTORS > 0
+    if (size < SPI_FLASH_SEC_SIZE) {
+        uint8_t* dst = (uint8_t*) dstv;
+        int32_t saved = 1;
+        while (size > 0) {
+            size_t sector = src / SPI_FLASH_SEC_SIZE;
+            read_cache_line_t* line = find_line(sector);
+            if (line == NULL) {
+                err = load_line(sector, &line);
+                if (err != ESP_OK) {
+                    goto out;
+                }
+                --saved;
+            }
+            line->last_used = ++s_lru_clock;
+            size_t offset = src % SPI_FLASH_SEC_SIZE;
+            size_t chunk = MIN(size, SPI_FLASH_SEC_SIZE - offset);
+            memcpy(dst, ((const uint8_t*) line->data) + offset, chunk);
+            src += chunk;
+            dst += chunk;
+            size -= chunk;
+        }
+        COUNT_SAVED_WINDOWS(saved);
+        goto out;
+    }
+#endif //READ_CACHE_SECTORS > 0
+    err = spi_flash_read(src, dstv, size);
+    if (err == ESP_OK) {
+        apply_pending(src, (uint8_t*) dstv, size);
+    }
+out:
+    buf_unlock();
+    return err;
+}
+
+esp_err_t spi_flash_flush(void)
+{
+    buf_lock();
+    esp_err_t err = flush_page();
+    buf_unlock();
+    return err;
+}
+
+void spi_flash_buffered_notify_write(size_t addr, size_t size)
+{
+    if (s_buf_mutex == NULL) {
+        return;
+    }
+    buf_lock();
+    if (!s_own_write) {
+        invalidate_lines(addr, size);
+    }
+    buf_unlock();
+}
+
+void spi_flash_buffered_notify_erase(size_t addr, size_t size)
+{
+    if (s_buf_mutex == NULL) {
+        return;
+    }
+    buf_lock();
+    // Erase ranges are sector aligned, so the pending page is either
+    // erased completely or not at all. Data written before the erase
+    // must not be programmed after it.
+    if (s_page_valid && ranges_overlap(addr, size, s_page_addr, SPI_FLASH_PAGE_SIZE)) {
+        s_page_valid = false;
+    }
+    invalidate_lines(addr, size);
+    buf_unlock();
+}
+
+#endif //CONFIG_SPI_FLASH_BUFFERED
@@ -0,0 +1,42 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ESP_SPI_FLASH_BUFFERED_H
+#define ESP_SPI_FLASH_BUFFERED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * This header file contains declarations of functions used by flash_ops.c
+ * to keep the buffered access layer (flash_buffered.c) coherent with
+ * direct spi_flash_* operations.
+ *
+ * These functions are considered internal and are not designed to be called from applications.
+ */
+
+// Create the mutex protecting write buffer and read cache
+void spi_flash_buffered_init(void);
+
+// Called after data was written to flash bypassing the buffered layer
+void spi_flash_buffered_notify_write(size_t addr, size_t size);
+
+// Called after a range of flash was erased
+void spi_flash_buffered_notify_erase(size_t addr, size_t size);
+
+// Add to the number of cache-disable windows saved by the buffered layer
+// (may be negative if the buffered layer had to do extra work)
+void spi_flash_count_saved_windows(int32_t count);
+
+#endif //ESP_SPI_FLASH_BUFFERED_H
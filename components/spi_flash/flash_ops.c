@@ -31,6 +31,7 @@
 #include "esp_spi_flash.h"
 #include "esp_log.h"
 #include "cache_utils.h"
+#include "flash_buffered.h"
 
 /* bytes erased by SPIEraseBlock() ROM function */
 #define BLOCK_ERASE_SIZE 65536
@@ -58,6 +59,12 @@ static spi_flash_counters_t s_flash_stats;
 
 #endif //CONFIG_SPI_FLASH_ENABLE_COUNTERS
 
+#if CONFIG_SPI_FLASH_BUFFERED
+#define NOTIFY_BUFFERED(op, addr, size) spi_flash_buffered_notify_ ## op(addr, size)
+#else
+#define NOTIFY_BUFFERED(op, addr, size)
+#endif //CONFIG_SPI_FLASH_BUFFERED
+
 static esp_err_t spi_flash_translate_rc(SpiFlashOpResult rc);
 
 void spi_flash_init()
@@ -66,6 +73,9 @@ void spi_flash_init()
 #if CONFIG_SPI_FLASH_ENABLE_COUNTERS
     spi_flash_reset_counters();
 #endif
+#if CONFIG_SPI_FLASH_BUFFERED
+    spi_flash_buffered_init();
+#endif
 }
 
 size_t spi_flash_get_chip_size()
@@ -124,6 +134,7 @@ esp_err_t IRAM_ATTR spi_flash_erase_range(uint32_t start_addr, uint32_t size)
     }
     spi_flash_enable_interrupts_caches_and_other_cpu();
     COUNTER_STOP(erase);
+    NOTIFY_BUFFERED(erase, start_addr, size);
     return spi_flash_translate_rc(rc);
 }
 
@@ -219,6 +230,7 @@ esp_err_t IRAM_ATTR spi_flash_write(size_t dst, const void *srcv, size_t size)
     }
 out:
     COUNTER_STOP(write);
+    NOTIFY_BUFFERED(write, dst, size);
     return spi_flash_translate_rc(rc);
 }
 
@@ -255,6 +267,7 @@ esp_err_t IRAM_ATTR spi_flash_write_encrypted(size_t dest_addr, const void *src,
         bzero(encrypt_buf, sizeof(encrypt_buf));
     }
     COUNTER_ADD_BYTES(write, size);
+    NOTIFY_BUFFERED(write, dest_addr, size);
     return spi_flash_translate_rc(rc);
 }
 
@@ -376,6 +389,11 @@ const spi_flash_counters_t* spi_flash_get_counters()
     return &s_flash_stats;
 }
 
+void spi_flash_count_saved_windows(int32_t count)
+{
+    s_flash_stats.windows_saved += count;
+}
+
 void spi_flash_reset_counters()
 {
     memset(&s_flash_stats, 0, sizeof(s_flash_stats));
@@ -386,6 +404,9 @@ void spi_flash_dump_counters()
     dump_counter(&s_flash_stats.read,  "read ");
     dump_counter(&s_flash_stats.write, "write");
     dump_counter(&s_flash_stats.erase, "erase");
+#if CONFIG_SPI_FLASH_BUFFERED
+    ESP_LOGI(TAG, "buffered APIs saved %d cache-disable windows\n", s_flash_stats.windows_saved);
+#endif
 }
 
 #endif //CONFIG_SPI_FLASH_ENABLE_COUNTERS
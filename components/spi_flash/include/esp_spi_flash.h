@@ -116,6 +116,56 @@ esp_err_t spi_flash_write_encrypted(size_t dest, const void *src, size_t size);
  */
 esp_err_t spi_flash_read(size_t src, void *dest, size_t size);
 
+#if CONFIG_SPI_FLASH_BUFFERED
+
+#define SPI_FLASH_PAGE_SIZE 256     /**< SPI Flash program page size */
+
+/**
+ * @brief  Write data to Flash through the write-combining buffer.
+ *
+ * Small writes are merged in a page-sized RAM buffer and programmed when
+ * a write to a different page arrives, or when spi_flash_flush is called.
+ * Writes of at least SPI_FLASH_PAGE_SIZE bytes go to flash directly.
+ * Unlike spi_flash_write, this function has no alignment requirements.
+ *
+ * @note Data which has not been flushed yet is visible to
+ *       spi_flash_read_buffered, but not to spi_flash_read or to memory
+ *       mapped regions. Call spi_flash_flush before relying on data being
+ *       stored in flash, e.g. before a reset.
+ *
+ * @param  dest  destination address in Flash
+ * @param  src   pointer to the source buffer
+ * @param  size  length of data, in bytes
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_write_buffered(size_t dest, const void *src, size_t size);
+
+/**
+ * @brief  Read data from Flash through the sector read cache.
+ *
+ * Reads smaller than a sector are served from a small LRU cache of
+ * recently used sectors (see CONFIG_SPI_FLASH_READ_CACHE_SECTORS).
+ * The result includes data passed to spi_flash_write_buffered which
+ * has not been flushed yet.
+ *
+ * @param  src   source address of the data in Flash.
+ * @param  dest  pointer to the destination buffer
+ * @param  size  length of data
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_read_buffered(size_t src, void *dest, size_t size);
+
+/**
+ * @brief  Program data held in the write-combining buffer into flash.
+ *
+ * @return esp_err_t
+ */
+esp_err_t spi_flash_flush(void);
+
+#endif //CONFIG_SPI_FLASH_BUFFERED
+
 /**
  * @brief Enumeration which specifies memory space requested in an mmap call
  */
@@ -188,6 +238,7 @@ typedef struct {
     spi_flash_counter_t read;
     spi_flash_counter_t write;
     spi_flash_counter_t erase;
+    uint32_t windows_saved; // number of cache-disable windows avoided by buffered APIs
 } spi_flash_counters_t;
 
 /**
@@ -0,0 +1,98 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Test for spi_flash_{read,write}_buffered and spi_flash_flush.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unity.h>
+#include <esp_spi_flash.h>
+
+#if CONFIG_SPI_FLASH_BUFFERED
+
+/* Base offset in flash for tests. */
+#define FLASH_BASE 0x130000
+
+static uint8_t s_gold[2 * SPI_FLASH_SEC_SIZE];
+
+TEST_CASE("Buffered writes are visible to buffered reads before flush", "[spi_flash_buffered]")
+{
+    ESP_ERROR_CHECK(spi_flash_erase_range(FLASH_BASE, sizeof(s_gold)));
+    memset(s_gold, 0xff, sizeof(s_gold));
+    srand(0);
+    for (int i = 0; i < 500; ++i) {
+        uint8_t data[24];
+        size_t len = rand() % sizeof(data) + 1;
+        size_t off = rand() % (sizeof(s_gold) - len);
+        for (size_t j = 0; j < len; ++j) {
+            data[j] = rand();
+            s_gold[off + j] &= data[j];
+        }
+        ESP_ERROR_CHECK(spi_flash_write_buffered(FLASH_BASE + off, data, len));
+        uint8_t readback[sizeof(data)];
+        ESP_ERROR_CHECK(spi_flash_read_buffered(FLASH_BASE + off, readback, len));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(s_gold + off, readback, len);
+    }
+    ESP_ERROR_CHECK(spi_flash_flush());
+
+    static uint8_t flash_data[sizeof(s_gold)];
+    ESP_ERROR_CHECK(spi_flash_read(FLASH_BASE, flash_data, sizeof(flash_data)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(s_gold, flash_data, sizeof(s_gold));
+}
+
+TEST_CASE("Buffered layer stays coherent with direct writes and erases", "[spi_flash_buffered]")
+{
+    ESP_ERROR_CHECK(spi_flash_erase_sector(FLASH_BASE / SPI_FLASH_SEC_SIZE));
+    uint32_t val;
+    // bring the sector into the read cache
+    ESP_ERROR_CHECK(spi_flash_read_buffered(FLASH_BASE, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL_HEX32(0xffffffff, val);
+
+    const uint32_t direct = 0x12345678;
+    ESP_ERROR_CHECK(spi_flash_write(FLASH_BASE, &direct, sizeof(direct)));
+    ESP_ERROR_CHECK(spi_flash_read_buffered(FLASH_BASE, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL_HEX32(direct, val);
+
+    // pending data written before an erase must not reach flash after it
+    const uint32_t buffered = 0xabcdef01;
+    ESP_ERROR_CHECK(spi_flash_write_buffered(FLASH_BASE + 4, &buffered, sizeof(buffered)));
+    ESP_ERROR_CHECK(spi_flash_erase_sector(FLASH_BASE / SPI_FLASH_SEC_SIZE));
+    ESP_ERROR_CHECK(spi_flash_flush());
+    ESP_ERROR_CHECK(spi_flash_read(FLASH_BASE + 4, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL_HEX32(0xffffffff, val);
+    ESP_ERROR_CHECK(spi_flash_read_buffered(FLASH_BASE, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL_HEX32(0xffffffff, val);
+}
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+TEST_CASE("Buffered writes save cache-disable windows", "[spi_flash_buffered]")
+{
+    ESP_ERROR_CHECK(spi_flash_erase_sector(FLASH_BASE / SPI_FLASH_SEC_SIZE));
+    spi_flash_reset_counters();
+    for (int i = 0; i < 64; ++i) {
+        uint8_t b = i;
+        ESP_ERROR_CHECK(spi_flash_write_buffered(FLASH_BASE + i, &b, 1));
+    }
+    ESP_ERROR_CHECK(spi_flash_flush());
+    const spi_flash_counters_t* counters = spi_flash_get_counters();
+    spi_flash_dump_counters();
+    TEST_ASSERT_EQUAL_UINT32(1, counters->write.count);
+    TEST_ASSERT_EQUAL_UINT32(63, counters->windows_saved);
+}
+#endif //CONFIG_SPI_FLASH_ENABLE_COUNTERS
+
+#endif //CONFIG_SPI_FLASH_BUFFERED
@@ -647,7 +647,7 @@ esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if)
 
 esp_err_t tcpip_adapter_eth_input(void *buffer, uint16_t len, void *eb)
 {
-    ethernetif_input(esp_netif[TCPIP_ADAPTER_IF_ETH], buffer, len);
+    ethernetif_input(esp_netif[TCPIP_ADAPTER_IF_ETH], buffer, len, eb);
     return ESP_OK;
 }
 
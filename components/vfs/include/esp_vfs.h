@@ -21,6 +21,9 @@
 #include <sys/types.h>
 #include <sys/reent.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <dirent.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +43,17 @@ extern "C" {
  */
 #define ESP_VFS_FLAG_CONTEXT_PTR    1
 
+/**
+ * Maximum number of file descriptors open through VFS at the same time.
+ * Equal to FD_SETSIZE so that any of them can be passed to esp_vfs_select.
+ */
+#define ESP_VFS_MAX_FDS             FD_SETSIZE
+
+/**
+ * Handle which FS drivers use to wake up a task blocked in esp_vfs_select
+ */
+typedef void* esp_vfs_select_sem_t;
+
 /**
  * @brief VFS definition structure
  *
@@ -61,6 +75,22 @@ extern "C" {
  *
  * If the FS driver doesn't provide some of the functions, set corresponding
  * members to NULL.
+ *
+ * readv and writev are optional even if read and write are provided;
+ * VFS calls read and write for each buffer if they are NULL.
+ *
+ * Drivers of devices which may not be ready for reading or writing at all
+ * times provide poll_select, which reports the descriptors that are ready.
+ * If the driver can also signal readiness, e.g. from an interrupt, it
+ * provides start_select and end_select: start_select is called before the
+ * task blocks in esp_vfs_select, and the driver should call
+ * esp_vfs_select_triggered (or esp_vfs_select_triggered_isr) with the
+ * given handle whenever one of the descriptors may have become ready, until
+ * end_select is called. start_select may return ESP_ERR_NOT_SUPPORTED if
+ * the driver can't signal readiness of the given descriptors. Drivers with
+ * poll_select and without a working start_select are polled once per tick.
+ * Sets passed to these functions are never NULL. Descriptors of drivers
+ * without poll_select are always ready for reading and writing.
  */
 typedef struct
 {
@@ -106,6 +136,44 @@ typedef struct
         int (*rename_p)(void* ctx, const char *src, const char *dst);
         int (*rename)(const char *src, const char *dst);
     };
+    union {
+        ssize_t (*readv_p)(void* ctx, int fd, const struct iovec* iov, int iovcnt);
+        ssize_t (*readv)(int fd, const struct iovec* iov, int iovcnt);
+    };
+    union {
+        ssize_t (*writev_p)(void* ctx, int fd, const struct iovec* iov, int iovcnt);
+        ssize_t (*writev)(int fd, const struct iovec* iov, int iovcnt);
+    };
+    union {
+        DIR* (*opendir_p)(void* ctx, const char* name);
+        DIR* (*opendir)(const char* name);
+    };
+    union {
+        struct dirent* (*readdir_p)(void* ctx, DIR* pdir);
+        struct dirent* (*readdir)(DIR* pdir);
+    };
+    union {
+        void (*rewinddir_p)(void* ctx, DIR* pdir);
+        void (*rewinddir)(DIR* pdir);
+    };
+    union {
+        int (*closedir_p)(void* ctx, DIR* pdir);
+        int (*closedir)(DIR* pdir);
+    };
+    union {
+        int (*poll_select_p)(void* ctx, int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds);
+        int (*poll_select)(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds);
+    };
+    union {
+        esp_err_t (*start_select_p)(void* ctx, int nfds, const fd_set* readfds, const fd_set* writefds,
+                                    const fd_set* exceptfds, esp_vfs_select_sem_t sem);
+        esp_err_t (*start_select)(int nfds, const fd_set* readfds, const fd_set* writefds,
+                                  const fd_set* exceptfds, esp_vfs_select_sem_t sem);
+    };
+    union {
+        void (*end_select_p)(void* ctx, esp_vfs_select_sem_t sem);
+        void (*end_select)(esp_vfs_select_sem_t sem);
+    };
 } esp_vfs_t;
 
 
@@ -119,6 +187,9 @@ typedef struct
  *                   For example, "/data" or "/dev/spi" are valid.
  *                   These VFSes would then be called to handle file paths such as
  *                   "/data/myfile.txt" or "/dev/spi/0".
+ *                   A prefix may be nested inside another one, e.g. "/data"
+ *                   and "/data/fs2"; paths are handled by the VFS with the
+ *                   longest matching prefix.
  * @param vfs  Pointer to esp_vfs_t, a structure which maps syscalls to
  *             the filesystem driver functions. VFS component doesn't
  *             assume ownership of this pointer.
@@ -126,7 +197,8 @@ typedef struct
  *             which should be passed to VFS functions. Otherwise, NULL.
  *
  * @return  ESP_OK if successful, ESP_ERR_NO_MEM if too many VFSes are
- *          registered.
+ *          registered, ESP_ERR_INVALID_STATE if a VFS is already
+ *          registered for the same prefix.
  */
 esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx);
 
@@ -157,6 +229,42 @@ int esp_vfs_unlink(struct _reent *r, const char *path);
 int esp_vfs_rename(struct _reent *r, const char *src, const char *dst);
 /**@}*/
 
+/**
+ * Synchronous I/O multiplexing over file descriptors of all registered VFSes
+ *
+ * Works like POSIX select: on return, the sets only contain the descriptors
+ * which are ready, and the return value is the total number of bits set.
+ *
+ * @param nfds      highest numbered descriptor in any of the sets, plus 1
+ * @param readfds   descriptors to check for reading, or NULL
+ * @param writefds  descriptors to check for writing, or NULL
+ * @param exceptfds descriptors to check for exceptional conditions, or NULL
+ * @param timeout   maximum time to wait, or NULL to wait indefinitely
+ *
+ * @return  number of ready descriptors, 0 on timeout, or -1 with errno set:
+ *          EBADF if a descriptor is not open, EINVAL if nfds is out of range,
+ *          ENOMEM if the wakeup semaphore can not be created
+ */
+int esp_vfs_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+
+/**
+ * Wake up the task blocked in esp_vfs_select
+ *
+ * Called by FS drivers between their start_select and end_select hooks.
+ *
+ * @param sem  handle passed to start_select
+ */
+void esp_vfs_select_triggered(esp_vfs_select_sem_t sem);
+
+/**
+ * Wake up the task blocked in esp_vfs_select from an interrupt handler
+ *
+ * @param sem  handle passed to start_select
+ * @param[out] woken  set to 1 if a context switch should be requested
+ *                    before the interrupt handler returns
+ */
+void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, int* woken);
+
 
 #ifdef __cplusplus
 } // extern "C"
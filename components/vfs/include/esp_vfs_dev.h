@@ -24,5 +24,25 @@
  */
 void esp_vfs_dev_uart_register();
 
+/**
+ * @brief read and write the UART through the interrupt-driven UART driver
+ *
+ * The driver must be installed with uart_driver_install first. Reads then
+ * come from the RX ring buffer, and esp_vfs_select is woken up by the UART
+ * interrupt handler instead of polling the UART once per tick.
+ *
+ * @param uart_num  UART number
+ */
+void esp_vfs_dev_uart_use_driver(int uart_num);
+
+/**
+ * @brief read and write the UART FIFOs directly (the default)
+ *
+ * Must be called before the UART driver is deleted.
+ *
+ * @param uart_num  UART number
+ */
+void esp_vfs_dev_uart_use_fifo(int uart_num);
+
 
 #endif //__ESP_VFS_DEV_H__
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/uio.h>
+#include "unity.h"
+#include "esp_vfs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Driver which records the calls made to it */
+typedef struct {
+    char last_path[32];
+    int writev_calls;
+    int write_calls;
+    bool readable;
+    esp_vfs_select_sem_t sem;
+    DIR dir;
+    int dir_pos;
+    struct dirent entry;
+} test_vfs_t;
+
+static int test_open(void* ctx, const char* path, int flags, int mode)
+{
+    test_vfs_t* t = (test_vfs_t*) ctx;
+    strlcpy(t->last_path, path, sizeof(t->last_path));
+    return 0;
+}
+
+static int test_close(void* ctx, int fd)
+{
+    return 0;
+}
+
+static size_t test_write(void* ctx, int fd, const void* data, size_t size)
+{
+    ++((test_vfs_t*) ctx)->write_calls;
+    return size;
+}
+
+static ssize_t test_writev(void* ctx, int fd, const struct iovec* iov, int iovcnt)
+{
+    ++((test_vfs_t*) ctx)->writev_calls;
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+static DIR* test_opendir(void* ctx, const char* name)
+{
+    test_vfs_t* t = (test_vfs_t*) ctx;
+    strlcpy(t->last_path, name, sizeof(t->last_path));
+    t->dir_pos = 0;
+    return &t->dir;
+}
+
+static struct dirent* test_readdir(void* ctx, DIR* pdir)
+{
+    test_vfs_t* t = (test_vfs_t*) ctx;
+    if (t->dir_pos == 3) {
+        return NULL;
+    }
+    t->entry.d_ino = t->dir_pos;
+    t->entry.d_type = DT_REG;
+    snprintf(t->entry.d_name, sizeof(t->entry.d_name), "file%d", t->dir_pos++);
+    return &t->entry;
+}
+
+static int test_closedir(void* ctx, DIR* pdir)
+{
+    return 0;
+}
+
+static int test_poll_select(void* ctx, int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds)
+{
+    test_vfs_t* t = (test_vfs_t*) ctx;
+    int ready = 0;
+    if (nfds > 0 && FD_ISSET(0, readfds)) {
+        if (t->readable) {
+            ++ready;
+        } else {
+            FD_CLR(0, readfds);
+        }
+    }
+    FD_ZERO(writefds);
+    FD_ZERO(exceptfds);
+    return ready;
+}
+
+static esp_err_t test_start_select(void* ctx, int nfds, const fd_set* readfds, const fd_set* writefds,
+                                   const fd_set* exceptfds, esp_vfs_select_sem_t sem)
+{
+    ((test_vfs_t*) ctx)->sem = sem;
+    return ESP_OK;
+}
+
+static void test_end_select(void* ctx, esp_vfs_select_sem_t sem)
+{
+    ((test_vfs_t*) ctx)->sem = NULL;
+}
+
+static esp_vfs_t test_vfs_desc()
+{
+    esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_CONTEXT_PTR,
+        .open_p = &test_open,
+        .close_p = &test_close,
+        .write_p = &test_write,
+        .opendir_p = &test_opendir,
+        .readdir_p = &test_readdir,
+        .closedir_p = &test_closedir,
+        .poll_select_p = &test_poll_select,
+        .start_select_p = &test_start_select,
+        .end_select_p = &test_end_select,
+    };
+    return desc;
+}
+
+TEST_CASE("vfs uses the longest matching path prefix", "[vfs]")
+{
+    test_vfs_t outer = { 0 }, inner = { 0 };
+    esp_vfs_t desc = test_vfs_desc();
+    TEST_ESP_OK(esp_vfs_register("/vfs_test", &desc, &outer));
+    TEST_ESP_OK(esp_vfs_register("/vfs_test/in", &desc, &inner));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_vfs_register("/vfs_test", &desc, &outer));
+
+    int fd = open("/vfs_test/in/a.txt", O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0 && fd < ESP_VFS_MAX_FDS);
+    TEST_ASSERT_EQUAL_STRING("/a.txt", inner.last_path);
+    close(fd);
+
+    fd = open("/vfs_test/inner/b.txt", O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_STRING("/inner/b.txt", outer.last_path);
+    close(fd);
+
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test/in"));
+    fd = open("/vfs_test/in/c.txt", O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_STRING("/in/c.txt", outer.last_path);
+    close(fd);
+
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test"));
+    TEST_ASSERT_EQUAL(-1, open("/vfs_test/c.txt", O_RDONLY));
+    TEST_ASSERT_EQUAL(ENOENT, errno);
+}
+
+TEST_CASE("vfs writev is passed through or split into writes", "[vfs]")
+{
+    test_vfs_t t = { 0 };
+    esp_vfs_t desc = test_vfs_desc();
+    TEST_ESP_OK(esp_vfs_register("/vfs_test", &desc, &t));
+    char a[3], b[5];
+    const struct iovec iov[] = { { a, sizeof(a) }, { b, sizeof(b) } };
+
+    int fd = open("/vfs_test/f", O_WRONLY);
+    TEST_ASSERT_EQUAL(8, writev(fd, iov, 2));
+    TEST_ASSERT_EQUAL(0, t.writev_calls);
+    TEST_ASSERT_EQUAL(2, t.write_calls);
+    close(fd);
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test"));
+
+    desc.writev_p = &test_writev;
+    TEST_ESP_OK(esp_vfs_register("/vfs_test", &desc, &t));
+    fd = open("/vfs_test/f", O_WRONLY);
+    TEST_ASSERT_EQUAL(8, writev(fd, iov, 2));
+    TEST_ASSERT_EQUAL(1, t.writev_calls);
+    TEST_ASSERT_EQUAL(2, t.write_calls);
+    close(fd);
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test"));
+}
+
+TEST_CASE("vfs directories can be listed", "[vfs]")
+{
+    test_vfs_t t = { 0 };
+    esp_vfs_t desc = test_vfs_desc();
+    TEST_ESP_OK(esp_vfs_register("/vfs_test", &desc, &t));
+    DIR* dir = opendir("/vfs_test");
+    TEST_ASSERT_NOT_NULL(dir);
+    TEST_ASSERT_EQUAL_STRING("/", t.last_path);
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char expected[8];
+        snprintf(expected, sizeof(expected), "file%d", count++);
+        TEST_ASSERT_EQUAL_STRING(expected, entry->d_name);
+    }
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(0, closedir(dir));
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test"));
+}
+
+static void make_readable_task(void* arg)
+{
+    test_vfs_t* t = (test_vfs_t*) arg;
+    vTaskDelay(50 / portTICK_PERIOD_MS);
+    t->readable = true;
+    esp_vfs_select_triggered(t->sem);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("vfs select waits for the driver to signal readiness", "[vfs]")
+{
+    test_vfs_t t = { 0 };
+    esp_vfs_t desc = test_vfs_desc();
+    TEST_ESP_OK(esp_vfs_register("/vfs_test", &desc, &t));
+    int fd = open("/vfs_test/dev", O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 20000 };
+    TEST_ASSERT_EQUAL(0, esp_vfs_select(fd + 1, &rfds, NULL, NULL, &tv));
+    TEST_ASSERT_FALSE(FD_ISSET(fd, &rfds));
+    TEST_ASSERT_NULL(t.sem);
+
+    xTaskCreate(&make_readable_task, "readable", 2048, &t, 5, NULL);
+    FD_SET(fd, &rfds);
+    tv.tv_sec = 1;
+    TickType_t start = xTaskGetTickCount();
+    TEST_ASSERT_EQUAL(1, esp_vfs_select(fd + 1, &rfds, NULL, NULL, &tv));
+    TEST_ASSERT_TRUE(FD_ISSET(fd, &rfds));
+    TEST_ASSERT_TRUE(xTaskGetTickCount() - start < 500 / portTICK_PERIOD_MS);
+
+    TEST_ASSERT_EQUAL(-1, esp_vfs_select(ESP_VFS_MAX_FDS + 1, &rfds, NULL, NULL, &tv));
+    TEST_ASSERT_EQUAL(EINVAL, errno);
+    close(fd);
+    FD_SET(fd, &rfds);
+    TEST_ASSERT_EQUAL(-1, esp_vfs_select(fd + 1, &rfds, NULL, NULL, &tv));
+    TEST_ASSERT_EQUAL(EBADF, errno);
+    TEST_ESP_OK(esp_vfs_unregister("/vfs_test"));
+}
@@ -13,37 +13,24 @@
 // limitations under the License.
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 #include <sys/errno.h>
+#include <sys/lock.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_vfs.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 
-/*
- * File descriptors visible by the applications are composed of two parts.
- * Lower CONFIG_MAX_FD_BITS bits are used for the actual file descriptor.
- * Next (16 - CONFIG_MAX_FD_BITS - 1) bits are used to identify the VFS this
- * descriptor corresponds to.
- * Highest bit is zero.
- * We can only use 16 bits because newlib stores file descriptor as short int.
- */
-
-#ifndef CONFIG_MAX_FD_BITS
-#define CONFIG_MAX_FD_BITS 12
-#endif
-
-#define MAX_VFS_ID_BITS (16 - CONFIG_MAX_FD_BITS - 1)
-// mask of actual file descriptor (e.g. 0x00000fff)
-#define VFS_FD_MASK     ((1 << CONFIG_MAX_FD_BITS) - 1)
 // max number of VFS entries
-#define VFS_MAX_COUNT   ((1 << MAX_VFS_ID_BITS) - 1)
-// mask of VFS id (e.g. 0x00007000)
-#define VFS_INDEX_MASK  (VFS_MAX_COUNT << CONFIG_MAX_FD_BITS)
-#define VFS_INDEX_S     CONFIG_MAX_FD_BITS
+#define VFS_MAX_COUNT   8
 
 typedef struct vfs_entry_ {
     esp_vfs_t vfs;          // contains pointers to VFS functions
-    char path_prefix[ESP_VFS_PATH_MAX]; // path prefix mapped to this VFS
+    char path_prefix[ESP_VFS_PATH_MAX + 1]; // path prefix mapped to this VFS
     size_t path_prefix_len; // micro-optimization to avoid doing extra strlen
     void* ctx;              // optional pointer which can be passed to VFS
     int offset;             // index of this structure in s_vfs array
@@ -52,13 +39,116 @@ typedef struct vfs_entry_ {
 static vfs_entry_t* s_vfs[VFS_MAX_COUNT] = { 0 };
 static size_t s_vfs_count = 0;
 
+/*
+ * File descriptors visible by the applications are indices into this table,
+ * which holds the VFS and the descriptor returned by its driver. Keeping the
+ * descriptors small and dense allows any of them to be used with
+ * esp_vfs_select, whose fd_set can only hold FD_SETSIZE descriptors.
+ * Entries are allocated and freed under s_fd_table_lock; lookups read an
+ * entry without locking.
+ */
+typedef struct {
+    int16_t vfs_index;      // index in s_vfs, or -1 if the descriptor is free
+    int16_t local_fd;       // descriptor as returned by the FS driver
+} fd_table_t;
+
+#define FD_TABLE_ENTRY_UNUSED   (fd_table_t) { .vfs_index = -1, .local_fd = -1 }
+
+static fd_table_t s_fd_table[ESP_VFS_MAX_FDS] = { [0 ... ESP_VFS_MAX_FDS - 1] = FD_TABLE_ENTRY_UNUSED };
+static _lock_t s_fd_table_lock;
+
+/*
+ * Registered path prefixes are kept in a trie with one node per path
+ * component, so that a path is resolved in a single pass over its
+ * components, and the VFS with the longest matching prefix wins.
+ * For "/data" and "/data/fs2":
+ *
+ *     root -> "data" (VFS 0) -> "fs2" (VFS 1)
+ *
+ * The trie is only modified by esp_vfs_register and esp_vfs_unregister.
+ */
+typedef struct vfs_trie_node_ {
+    struct vfs_trie_node_* child;   // first node one component deeper
+    struct vfs_trie_node_* next;    // next node with the same parent
+    int vfs_index;                  // VFS registered for the path ending here, or -1
+    size_t name_len;
+    char name[ESP_VFS_PATH_MAX];    // path component, not zero-terminated
+} vfs_trie_node_t;
+
+static vfs_trie_node_t s_vfs_trie = { .vfs_index = -1 };
+
+static vfs_trie_node_t* trie_find_child(const vfs_trie_node_t* node, const char* name, size_t len)
+{
+    for (vfs_trie_node_t* child = node->child; child != NULL; child = child->next) {
+        if (child->name_len == len && memcmp(child->name, name, len) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t trie_insert(const char* path, int vfs_index)
+{
+    vfs_trie_node_t* node = &s_vfs_trie;
+    while (*path == '/') {
+        ++path;
+        size_t len = strcspn(path, "/");
+        vfs_trie_node_t* child = trie_find_child(node, path, len);
+        if (child == NULL) {
+            child = (vfs_trie_node_t*) calloc(1, sizeof(vfs_trie_node_t));
+            if (child == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            child->vfs_index = -1;
+            child->name_len = len;
+            memcpy(child->name, path, len);
+            child->next = node->child;
+            node->child = child;
+        }
+        node = child;
+        path += len;
+    }
+    if (node->vfs_index >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    node->vfs_index = vfs_index;
+    return ESP_OK;
+}
+
+/*
+ * Clears the VFS registered for the path below node, and frees the nodes
+ * which are left without a VFS and without children.
+ */
+static void trie_remove(vfs_trie_node_t* node, const char* path)
+{
+    if (*path != '/') {
+        node->vfs_index = -1;
+        return;
+    }
+    ++path;
+    size_t len = strcspn(path, "/");
+    vfs_trie_node_t** link = &node->child;
+    while (*link != NULL && !((*link)->name_len == len && memcmp((*link)->name, path, len) == 0)) {
+        link = &(*link)->next;
+    }
+    vfs_trie_node_t* child = *link;
+    if (child == NULL) {
+        return;
+    }
+    trie_remove(child, path + len);
+    if (child->child == NULL && child->vfs_index < 0) {
+        *link = child->next;
+        free(child);
+    }
+}
+
 esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx)
 {
     size_t len = strlen(base_path);
     if (len < 2 || len > ESP_VFS_PATH_MAX) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (base_path[0] != '/' || base_path[len - 1] == '/') {
+    if (base_path[0] != '/' || base_path[len - 1] == '/' || strstr(base_path, "//") != NULL) {
         return ESP_ERR_INVALID_ARG;
     }
     vfs_entry_t *entry = (vfs_entry_t*) malloc(sizeof(vfs_entry_t));
@@ -71,19 +161,29 @@ esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ct
             break;
         }
     }
-    if (index == s_vfs_count) {
-        if (s_vfs_count >= VFS_MAX_COUNT) {
-            free(entry);
-            return ESP_ERR_NO_MEM;
-        }
-        ++s_vfs_count;
+    if (index == VFS_MAX_COUNT) {
+        free(entry);
+        return ESP_ERR_NO_MEM;
     }
-    s_vfs[index] = entry;
     strcpy(entry->path_prefix, base_path); // we have already verified argument length
     memcpy(&entry->vfs, vfs, sizeof(esp_vfs_t));
     entry->path_prefix_len = len;
     entry->ctx = ctx;
     entry->offset = index;
+    // the entry has to be in place before the trie can lead lookups to it
+    s_vfs[index] = entry;
+    if (index == s_vfs_count) {
+        ++s_vfs_count;
+    }
+    esp_err_t err = trie_insert(base_path, index);
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_NO_MEM) {
+            trie_remove(&s_vfs_trie, base_path);
+        }
+        s_vfs[index] = NULL;
+        free(entry);
+        return err;
+    }
     return ESP_OK;
 }
 
@@ -91,52 +191,89 @@ esp_err_t esp_vfs_unregister(const char* base_path)
 {
     for (size_t i = 0; i < s_vfs_count; ++i) {
         vfs_entry_t* vfs = s_vfs[i];
-        if (memcmp(base_path, vfs->path_prefix, vfs->path_prefix_len) == 0) {
-            free(vfs);
-            s_vfs[i] = NULL;
-            return ESP_OK;
+        if (vfs == NULL || strcmp(base_path, vfs->path_prefix) != 0) {
+            continue;
         }
+        trie_remove(&s_vfs_trie, vfs->path_prefix);
+        _lock_acquire(&s_fd_table_lock);
+        for (int fd = 0; fd < ESP_VFS_MAX_FDS; ++fd) {
+            if (s_fd_table[fd].vfs_index == i) {
+                s_fd_table[fd] = FD_TABLE_ENTRY_UNUSED;
+            }
+        }
+        _lock_release(&s_fd_table_lock);
+        s_vfs[i] = NULL;
+        free(vfs);
+        return ESP_OK;
     }
     return ESP_ERR_INVALID_STATE;
 }
 
-static const vfs_entry_t* get_vfs_for_fd(int fd)
+static const vfs_entry_t* get_vfs_for_index(int index)
 {
-    int index = ((fd & VFS_INDEX_MASK) >> VFS_INDEX_S);
-    if (index >= s_vfs_count) {
+    if (index < 0 || index >= s_vfs_count) {
         return NULL;
     }
     return s_vfs[index];
 }
 
-static int translate_fd(const vfs_entry_t* vfs, int fd)
+static const vfs_entry_t* get_vfs_for_fd(int fd, int* local_fd)
+{
+    if (fd < 0 || fd >= ESP_VFS_MAX_FDS) {
+        return NULL;
+    }
+    const fd_table_t entry = s_fd_table[fd];
+    *local_fd = entry.local_fd;
+    return get_vfs_for_index(entry.vfs_index);
+}
+
+static int alloc_fd(const vfs_entry_t* vfs, int local_fd)
+{
+    int ret = -1;
+    _lock_acquire(&s_fd_table_lock);
+    for (int fd = 0; fd < ESP_VFS_MAX_FDS; ++fd) {
+        if (s_fd_table[fd].vfs_index < 0) {
+            s_fd_table[fd] = (fd_table_t) { .vfs_index = vfs->offset, .local_fd = local_fd };
+            ret = fd;
+            break;
+        }
+    }
+    _lock_release(&s_fd_table_lock);
+    return ret;
+}
+
+static void free_fd(int fd)
 {
-    return (fd & VFS_FD_MASK) + vfs->vfs.fd_offset;
+    _lock_acquire(&s_fd_table_lock);
+    s_fd_table[fd] = FD_TABLE_ENTRY_UNUSED;
+    _lock_release(&s_fd_table_lock);
 }
 
 static const char* translate_path(const vfs_entry_t* vfs, const char* src_path)
 {
     assert(strncmp(src_path, vfs->path_prefix, vfs->path_prefix_len) == 0);
-    return src_path + vfs->path_prefix_len;
+    const char* path_within_vfs = src_path + vfs->path_prefix_len;
+    // the mount point itself, e.g. for opendir("/data"), is the root of the FS
+    return (*path_within_vfs == 0) ? "/" : path_within_vfs;
 }
 
 static const vfs_entry_t* get_vfs_for_path(const char* path)
 {
-    size_t len = strlen(path);
-    for (size_t i = 0; i < s_vfs_count; ++i) {
-        const vfs_entry_t* vfs = s_vfs[i];
-        if (len < vfs->path_prefix_len + 1) {   // +1 is for the trailing slash after base path
-            continue;
-        }
-        if (memcmp(path, vfs->path_prefix, vfs->path_prefix_len) != 0) {  // match prefix
-            continue;
+    const vfs_entry_t* vfs = NULL;
+    const vfs_trie_node_t* node = &s_vfs_trie;
+    while (*path == '/') {
+        ++path;
+        size_t len = strcspn(path, "/");
+        node = trie_find_child(node, path, len);
+        if (node == NULL) {
+            break;
         }
-        if (path[vfs->path_prefix_len] != '/') {   // don't match "/data" prefix for "/data1/foo.txt"
-            continue;
+        if (node->vfs_index >= 0) {
+            vfs = get_vfs_for_index(node->vfs_index);
         }
-        return vfs;
+        path += len;
     }
-    return NULL;
+    return vfs;
 }
 
 /*
@@ -156,12 +293,38 @@ static const vfs_entry_t* get_vfs_for_path(const char* path)
         __errno_r(r) = ENOSYS; \
         return -1; \
     } \
+    CALL(ret, pvfs, func, __VA_ARGS__)
+
+#define CALL(ret, pvfs, func, ...) \
     if (pvfs->vfs.flags & ESP_VFS_FLAG_CONTEXT_PTR) { \
         ret = (*pvfs->vfs.func ## _p)(pvfs->ctx, __VA_ARGS__); \
     } else { \
         ret = (*pvfs->vfs.func)(__VA_ARGS__);\
     }
 
+/* Same as CHECK_AND_CALL, for functions which return a pointer */
+#define CHECK_AND_CALLP(ret, r, pvfs, func, ...) \
+    if (pvfs->vfs.func == NULL) { \
+        __errno_r(r) = ENOSYS; \
+        return NULL; \
+    } \
+    CALL(ret, pvfs, func, __VA_ARGS__)
+
+/* Same as CHECK_AND_CALL, for functions which don't return a value */
+#define CHECK_AND_CALLV(r, pvfs, func, ...) \
+    if (pvfs->vfs.func == NULL) { \
+        __errno_r(r) = ENOSYS; \
+        return; \
+    } \
+    CALLV(pvfs, func, __VA_ARGS__)
+
+#define CALLV(pvfs, func, ...) \
+    if (pvfs->vfs.flags & ESP_VFS_FLAG_CONTEXT_PTR) { \
+        (*pvfs->vfs.func ## _p)(pvfs->ctx, __VA_ARGS__); \
+    } else { \
+        (*pvfs->vfs.func)(__VA_ARGS__);\
+    }
+
 
 int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
 {
@@ -177,17 +340,27 @@ int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
         return ret;
     }
     assert(ret >= vfs->vfs.fd_offset);
-    return ret - vfs->vfs.fd_offset + (vfs->offset << VFS_INDEX_S);
+    int fd = alloc_fd(vfs, ret);
+    if (fd < 0) {
+        if (vfs->vfs.close != NULL) {
+            int close_ret;
+            CALL(close_ret, vfs, close, ret);
+            (void) close_ret;
+        }
+        __errno_r(r) = ENFILE;
+        return -1;
+    }
+    return fd;
 }
 
 ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL) {
         __errno_r(r) = EBADF;
         return -1;
     }
-    int local_fd = translate_fd(vfs, fd);
     int ret;
     CHECK_AND_CALL(ret, r, vfs, write, local_fd, data, size);
     return ret;
@@ -195,12 +368,12 @@ ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 
 off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL) {
         __errno_r(r) = EBADF;
         return -1;
     }
-    int local_fd = translate_fd(vfs, fd);
     int ret;
     CHECK_AND_CALL(ret, r, vfs, lseek, local_fd, size, mode);
     return ret;
@@ -208,12 +381,12 @@ off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 
 ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL) {
         __errno_r(r) = EBADF;
         return -1;
     }
-    int local_fd = translate_fd(vfs, fd);
     int ret;
     CHECK_AND_CALL(ret, r, vfs, read, local_fd, dst, size);
     return ret;
@@ -222,25 +395,33 @@ ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 
 int esp_vfs_close(struct _reent *r, int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL) {
         __errno_r(r) = EBADF;
         return -1;
     }
-    int local_fd = translate_fd(vfs, fd);
+    if (vfs->vfs.close == NULL) {
+        free_fd(fd);
+        __errno_r(r) = ENOSYS;
+        return -1;
+    }
+    // the descriptor is released even if the driver can't close it, but only
+    // after close returns, so that a concurrent open can't get it too early
     int ret;
-    CHECK_AND_CALL(ret, r, vfs, close, local_fd);
+    CALL(ret, vfs, close, local_fd);
+    free_fd(fd);
     return ret;
 }
 
 int esp_vfs_fstat(struct _reent *r, int fd, struct stat * st)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL) {
         __errno_r(r) = EBADF;
         return -1;
     }
-    int local_fd = translate_fd(vfs, fd);
     int ret;
     CHECK_AND_CALL(ret, r, vfs, fstat, local_fd, st);
     return ret;
@@ -309,3 +490,349 @@ int esp_vfs_rename(struct _reent *r, const char *src, const char *dst)
     CHECK_AND_CALL(ret, r, vfs, rename, src_within_vfs, dst_within_vfs);
     return ret;
 }
+
+/*
+ * readv and writev for drivers which don't implement them: one read or write
+ * call per buffer, stopping at the first short transfer.
+ */
+static ssize_t readv_each(struct _reent *r, const vfs_entry_t* vfs, int local_fd, const struct iovec* iov, int iovcnt)
+{
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        ssize_t ret;
+        CHECK_AND_CALL(ret, r, vfs, read, local_fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return (total > 0) ? total : ret;
+        }
+        total += ret;
+        if (ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+static ssize_t writev_each(struct _reent *r, const vfs_entry_t* vfs, int local_fd, const struct iovec* iov, int iovcnt)
+{
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        ssize_t ret;
+        CHECK_AND_CALL(ret, r, vfs, write, local_fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return (total > 0) ? total : ret;
+        }
+        total += ret;
+        if (ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt)
+{
+    struct _reent* r = __getreent();
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (iovcnt < 0) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+    if (vfs->vfs.readv == NULL) {
+        return readv_each(r, vfs, local_fd, iov, iovcnt);
+    }
+    ssize_t ret;
+    CALL(ret, vfs, readv, local_fd, iov, iovcnt);
+    return ret;
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt)
+{
+    struct _reent* r = __getreent();
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (iovcnt < 0) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+    if (vfs->vfs.writev == NULL) {
+        return writev_each(r, vfs, local_fd, iov, iovcnt);
+    }
+    ssize_t ret;
+    CALL(ret, vfs, writev, local_fd, iov, iovcnt);
+    return ret;
+}
+
+DIR* opendir(const char* name)
+{
+    struct _reent* r = __getreent();
+    const vfs_entry_t* vfs = get_vfs_for_path(name);
+    if (vfs == NULL) {
+        __errno_r(r) = ENOENT;
+        return NULL;
+    }
+    const char* path_within_vfs = translate_path(vfs, name);
+    DIR* ret;
+    CHECK_AND_CALLP(ret, r, vfs, opendir, path_within_vfs);
+    if (ret != NULL) {
+        ret->dd_vfs_idx = vfs->offset;
+    }
+    return ret;
+}
+
+struct dirent* readdir(DIR* pdir)
+{
+    struct _reent* r = __getreent();
+    const vfs_entry_t* vfs = get_vfs_for_index(pdir->dd_vfs_idx);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return NULL;
+    }
+    struct dirent* ret;
+    CHECK_AND_CALLP(ret, r, vfs, readdir, pdir);
+    return ret;
+}
+
+void rewinddir(DIR* pdir)
+{
+    struct _reent* r = __getreent();
+    const vfs_entry_t* vfs = get_vfs_for_index(pdir->dd_vfs_idx);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return;
+    }
+    CHECK_AND_CALLV(r, vfs, rewinddir, pdir);
+}
+
+int closedir(DIR* pdir)
+{
+    struct _reent* r = __getreent();
+    const vfs_entry_t* vfs = get_vfs_for_index(pdir->dd_vfs_idx);
+    if (vfs == NULL) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    int ret;
+    CHECK_AND_CALL(ret, r, vfs, closedir, pdir);
+    return ret;
+}
+
+/* Descriptors of one VFS which esp_vfs_select waits for */
+typedef struct {
+    fd_set readfds;
+    fd_set writefds;
+    fd_set exceptfds;
+    int nfds;       // highest local descriptor in the sets plus 1, 0 if none
+    bool started;   // start_select has been called
+} vfs_select_sets_t;
+
+static TickType_t timeval_to_ticks(const struct timeval* tv)
+{
+    uint64_t ms = (uint64_t) tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+    uint64_t ticks = (ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    return (ticks >= portMAX_DELAY) ? portMAX_DELAY - 1 : (TickType_t) ticks;
+}
+
+static int count_fds(int nfds, const fd_set* fds)
+{
+    int count = 0;
+    for (int fd = 0; fd < nfds; ++fd) {
+        count += (FD_ISSET(fd, fds) != 0);
+    }
+    return count;
+}
+
+/*
+ * Checks which descriptors are ready, leaving them in the ready sets.
+ * Returns the number of ready descriptors or -1 if a driver failed.
+ */
+static int poll_all(const vfs_select_sets_t* sets, vfs_select_sets_t* ready)
+{
+    int count = 0;
+    for (size_t i = 0; i < s_vfs_count; ++i) {
+        const vfs_entry_t* vfs = s_vfs[i];
+        if (sets[i].nfds == 0 || vfs == NULL) {
+            continue;
+        }
+        ready[i] = sets[i];
+        if (vfs->vfs.poll_select == NULL) {
+            // plain files are always ready for reading and writing
+            FD_ZERO(&ready[i].exceptfds);
+            count += count_fds(sets[i].nfds, &sets[i].readfds) + count_fds(sets[i].nfds, &sets[i].writefds);
+            continue;
+        }
+        int ret;
+        CALL(ret, vfs, poll_select, sets[i].nfds, &ready[i].readfds, &ready[i].writefds, &ready[i].exceptfds);
+        if (ret < 0) {
+            return -1;
+        }
+        count += ret;
+    }
+    return count;
+}
+
+int esp_vfs_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout)
+{
+    struct _reent* r = __getreent();
+    if (nfds < 0 || nfds > ESP_VFS_MAX_FDS) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+
+    // split the sets by VFS, translating to the descriptors of each driver
+    vfs_select_sets_t sets[VFS_MAX_COUNT];
+    vfs_select_sets_t ready[VFS_MAX_COUNT];
+    int8_t fd_vfs[ESP_VFS_MAX_FDS];
+    uint8_t fd_local[ESP_VFS_MAX_FDS];
+    memset(sets, 0, sizeof(sets));
+    for (int fd = 0; fd < nfds; ++fd) {
+        bool rd = readfds != NULL && FD_ISSET(fd, readfds);
+        bool wr = writefds != NULL && FD_ISSET(fd, writefds);
+        bool ex = exceptfds != NULL && FD_ISSET(fd, exceptfds);
+        fd_vfs[fd] = -1;
+        if (!rd && !wr && !ex) {
+            continue;
+        }
+        int local_fd;
+        const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
+        if (vfs == NULL || local_fd < 0 || local_fd >= FD_SETSIZE) {
+            __errno_r(r) = EBADF;
+            return -1;
+        }
+        vfs_select_sets_t* s = &sets[vfs->offset];
+        if (rd) {
+            FD_SET(local_fd, &s->readfds);
+        }
+        if (wr) {
+            FD_SET(local_fd, &s->writefds);
+        }
+        if (ex) {
+            FD_SET(local_fd, &s->exceptfds);
+        }
+        if (local_fd >= s->nfds) {
+            s->nfds = local_fd + 1;
+        }
+        fd_vfs[fd] = vfs->offset;
+        fd_local[fd] = local_fd;
+    }
+
+    // ask drivers which can signal readiness to do so, and poll the others
+    SemaphoreHandle_t sem = NULL;
+    bool poll_each_tick = false;
+    int ret = 0;
+    for (size_t i = 0; i < s_vfs_count && ret == 0; ++i) {
+        const vfs_entry_t* vfs = s_vfs[i];
+        if (sets[i].nfds == 0 || vfs == NULL) {
+            continue;
+        }
+        if (vfs->vfs.start_select == NULL) {
+            poll_each_tick |= (vfs->vfs.poll_select != NULL);
+            continue;
+        }
+        if (sem == NULL) {
+            sem = xSemaphoreCreateBinary();
+            if (sem == NULL) {
+                __errno_r(r) = ENOMEM;
+                ret = -1;
+                break;
+            }
+        }
+        esp_err_t err;
+        CALL(err, vfs, start_select, sets[i].nfds, &sets[i].readfds,
+                &sets[i].writefds, &sets[i].exceptfds, (esp_vfs_select_sem_t) sem);
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            // the driver can't signal readiness this time, poll it instead
+            poll_each_tick |= (vfs->vfs.poll_select != NULL);
+            continue;
+        }
+        if (err != ESP_OK) {
+            __errno_r(r) = EINVAL;
+            ret = -1;
+            break;
+        }
+        sets[i].started = true;
+    }
+
+    const TickType_t ticks_to_wait = (timeout == NULL) ? portMAX_DELAY : timeval_to_ticks(timeout);
+    const TickType_t start = xTaskGetTickCount();
+    while (ret == 0) {
+        ret = poll_all(sets, ready);
+        if (ret != 0) {
+            break;
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (ticks_to_wait != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks_to_wait) {
+                break;
+            }
+            wait = ticks_to_wait - elapsed;
+        }
+        if (poll_each_tick) {
+            wait = 1;
+        }
+        if (sem != NULL) {
+            xSemaphoreTake(sem, wait);
+        } else {
+            vTaskDelay(wait);
+        }
+    }
+
+    for (size_t i = 0; i < s_vfs_count; ++i) {
+        const vfs_entry_t* vfs = s_vfs[i];
+        if (sets[i].started && vfs != NULL) {
+            CALLV(vfs, end_select, (esp_vfs_select_sem_t) sem);
+        }
+    }
+    if (sem != NULL) {
+        vSemaphoreDelete(sem);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    // translate the ready descriptors back
+    ret = 0;
+    for (int fd = 0; fd < nfds; ++fd) {
+        int i = fd_vfs[fd];
+        if (i < 0) {
+            continue;
+        }
+        const int local_fd = fd_local[fd];
+        if (readfds != NULL && FD_ISSET(fd, readfds) && !FD_ISSET(local_fd, &ready[i].readfds)) {
+            FD_CLR(fd, readfds);
+        }
+        if (writefds != NULL && FD_ISSET(fd, writefds) && !FD_ISSET(local_fd, &ready[i].writefds)) {
+            FD_CLR(fd, writefds);
+        }
+        if (exceptfds != NULL && FD_ISSET(fd, exceptfds) && !FD_ISSET(local_fd, &ready[i].exceptfds)) {
+            FD_CLR(fd, exceptfds);
+        }
+        ret += (readfds != NULL && FD_ISSET(fd, readfds)) +
+               (writefds != NULL && FD_ISSET(fd, writefds)) +
+               (exceptfds != NULL && FD_ISSET(fd, exceptfds));
+    }
+    return ret;
+}
+
+void esp_vfs_select_triggered(esp_vfs_select_sem_t sem)
+{
+    xSemaphoreGive((SemaphoreHandle_t) sem);
+}
+
+void IRAM_ATTR esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, int* woken)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR((SemaphoreHandle_t) sem, &higher_priority_task_woken);
+    if (woken != NULL && higher_priority_task_woken == pdTRUE) {
+        *woken = 1;
+    }
+}
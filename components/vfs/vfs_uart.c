@@ -18,10 +18,21 @@
 #include "sys/errno.h"
 #include "sys/lock.h"
 #include "soc/uart_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
 #include "sdkconfig.h"
 
 static uart_dev_t* s_uarts[3] = {&UART0, &UART1, &UART2};
 static _lock_t s_uart_locks[3]; // per-UART locks, lazily initialized
+static _lock_t s_uart_read_locks[3]; // per-UART locks for reading, lazily initialized
+static bool s_uart_use_driver[3]; // read and write through the UART driver instead of the FIFOs
+
+// Select call which waits for UARTs, only one at a time can be woken up by the driver
+static portMUX_TYPE s_select_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_vfs_select_sem_t s_select_sem;
+static uint8_t s_select_uarts;          // UARTs which have the notification callback set
+static volatile uint8_t s_uart_errors;  // UARTs which reported an RX error during select
 
 static int IRAM_ATTR uart_open(const char * path, int flags, int mode)
 {
@@ -40,13 +51,28 @@ static int IRAM_ATTR uart_open(const char * path, int flags, int mode)
 
 static void IRAM_ATTR uart_tx_char(uart_dev_t* uart, int c)
 {
-    while (uart->status.txfifo_cnt >= 127) {
+    while (uart->status.txfifo_cnt >= UART_FIFO_LEN - 1) {
         ;
     }
     uart->fifo.rw_byte = c;
 }
 
 
+static void uart_write_driver(int fd, const char* data_c, size_t size)
+{
+    size_t start = 0;
+#if CONFIG_NEWLIB_STDOUT_ADDCR
+    for (size_t i = 0; i < size; i++) {
+        if (data_c[i] == '\n') {
+            uart_write_bytes(fd, data_c + start, i - start);
+            uart_write_bytes(fd, "\r", 1);
+            start = i;
+        }
+    }
+#endif
+    uart_write_bytes(fd, data_c + start, size - start);
+}
+
 static size_t IRAM_ATTR uart_write(int fd, const void * data, size_t size)
 {
     assert(fd >=0 && fd < 3);
@@ -58,6 +84,11 @@ static size_t IRAM_ATTR uart_write(int fd, const void * data, size_t size)
      *  same UART.
      */
     _lock_acquire_recursive(&s_uart_locks[fd]);
+    if (s_uart_use_driver[fd]) {
+        uart_write_driver(fd, data_c, size);
+        _lock_release_recursive(&s_uart_locks[fd]);
+        return size;
+    }
     for (size_t i = 0; i < size; i++) {
 #if CONFIG_NEWLIB_STDOUT_ADDCR
         if (data_c[i]=='\n') {
@@ -70,6 +101,173 @@ static size_t IRAM_ATTR uart_write(int fd, const void * data, size_t size)
     return size;
 }
 
+/*
+ * Same as uart_read, taking the data from the RX ring buffer of the driver.
+ */
+static ssize_t uart_read_driver(int fd, char* data_c, size_t size)
+{
+    int received = uart_read_bytes(fd, (uint8_t*) data_c, size, 0);
+    if (received == 0) {
+        received = uart_read_bytes(fd, (uint8_t*) data_c, 1, portMAX_DELAY);
+        if (received == 1 && size > 1) {
+            int more = uart_read_bytes(fd, (uint8_t*) data_c + 1, size - 1, 0);
+            received += (more > 0) ? more : 0;
+        }
+    }
+    if (received < 0) {
+        errno = EIO;
+        return -1;
+    }
+    return received;
+}
+
+/*
+ * Reads whatever the RX FIFO holds, up to size bytes, waiting one tick at a
+ * time until at least one byte is received. Unless esp_vfs_dev_uart_use_driver
+ * was called for the port, data is taken from the FIFO directly, so this
+ * can't be used together with the interrupt-driven UART driver.
+ */
+static ssize_t uart_read(int fd, void* data, size_t size)
+{
+    assert(fd >=0 && fd < 3);
+    char *data_c = (char *) data;
+    uart_dev_t* uart = s_uarts[fd];
+    size_t received = 0;
+    _lock_acquire_recursive(&s_uart_read_locks[fd]);
+    if (s_uart_use_driver[fd]) {
+        ssize_t ret = uart_read_driver(fd, data_c, size);
+        _lock_release_recursive(&s_uart_read_locks[fd]);
+        return ret;
+    }
+    while (received < size) {
+        if (uart->status.rxfifo_cnt == 0) {
+            if (received > 0) {
+                break;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        data_c[received++] = uart->fifo.rw_byte;
+    }
+    _lock_release_recursive(&s_uart_read_locks[fd]);
+    return received;
+}
+
+static bool uart_readable(int fd)
+{
+    if (s_uart_use_driver[fd]) {
+        size_t len = 0;
+        return uart_get_buffered_data_len(fd, &len) == ESP_OK && len > 0;
+    }
+    return s_uarts[fd]->status.rxfifo_cnt > 0;
+}
+
+/*
+ * Reports which UARTs have received data, or have space in the TX FIFO, and
+ * which of the UARTs used through the driver had an RX error during select.
+ */
+static int uart_poll_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds)
+{
+    int ready = 0;
+    for (int fd = 0; fd < nfds && fd < 3; ++fd) {
+        uart_dev_t* uart = s_uarts[fd];
+        if (FD_ISSET(fd, readfds)) {
+            if (uart_readable(fd)) {
+                ++ready;
+            } else {
+                FD_CLR(fd, readfds);
+            }
+        }
+        if (FD_ISSET(fd, writefds)) {
+            if (uart->status.txfifo_cnt < UART_FIFO_LEN - 1) {
+                ++ready;
+            } else {
+                FD_CLR(fd, writefds);
+            }
+        }
+        if (FD_ISSET(fd, exceptfds)) {
+            if (s_uart_errors & BIT(fd)) {
+                portENTER_CRITICAL(&s_select_lock);
+                s_uart_errors &= ~BIT(fd);
+                portEXIT_CRITICAL(&s_select_lock);
+                ++ready;
+            } else {
+                FD_CLR(fd, exceptfds);
+            }
+        }
+    }
+    return ready;
+}
+
+static void IRAM_ATTR select_notif_callback(uart_port_t uart_num, uart_select_notif_t notif, BaseType_t* task_woken)
+{
+    portENTER_CRITICAL_ISR(&s_select_lock);
+    if (notif == UART_SELECT_ERROR_NOTIF) {
+        s_uart_errors |= BIT(uart_num);
+    }
+    if (s_select_sem != NULL) {
+        int woken = 0;
+        esp_vfs_select_triggered_isr(s_select_sem, &woken);
+        if (woken) {
+            *task_woken = pdTRUE;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&s_select_lock);
+}
+
+static void uart_end_select(esp_vfs_select_sem_t sem)
+{
+    for (int fd = 0; fd < 3; ++fd) {
+        if (s_select_uarts & BIT(fd)) {
+            uart_set_select_notif_callback(fd, NULL);
+        }
+    }
+    portENTER_CRITICAL(&s_select_lock);
+    s_select_uarts = 0;
+    s_select_sem = NULL;
+    portEXIT_CRITICAL(&s_select_lock);
+}
+
+/*
+ * Asks the UART driver to wake up the task when data is received, space is
+ * freed for sending, or an RX error occurs. Without the driver, or while
+ * another task waits in select, esp_vfs_select falls back to polling the
+ * UARTs once per tick.
+ */
+static esp_err_t uart_start_select(int nfds, const fd_set* readfds, const fd_set* writefds,
+                                   const fd_set* exceptfds, esp_vfs_select_sem_t sem)
+{
+    uint8_t uarts = 0;
+    for (int fd = 0; fd < nfds && fd < 3; ++fd) {
+        if (!FD_ISSET(fd, readfds) && !FD_ISSET(fd, writefds) && !FD_ISSET(fd, exceptfds)) {
+            continue;
+        }
+        if (!s_uart_use_driver[fd]) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        uarts |= BIT(fd);
+    }
+    portENTER_CRITICAL(&s_select_lock);
+    if (s_select_sem != NULL) {
+        portEXIT_CRITICAL(&s_select_lock);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_select_sem = sem;
+    s_uart_errors = 0;
+    portEXIT_CRITICAL(&s_select_lock);
+    for (int fd = 0; fd < 3; ++fd) {
+        if ((uarts & BIT(fd)) == 0) {
+            continue;
+        }
+        if (uart_set_select_notif_callback(fd, &select_notif_callback) != ESP_OK) {
+            uart_end_select(sem);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        s_select_uarts |= BIT(fd);
+    }
+    return ESP_OK;
+}
+
 static int IRAM_ATTR uart_fstat(int fd, struct stat * st)
 {
     assert(fd >=0 && fd < 3);
@@ -92,12 +290,35 @@ void esp_vfs_dev_uart_register()
         .open = &uart_open,
         .fstat = &uart_fstat,
         .close = &uart_close,
-        .read = NULL, // TODO: implement reading from UART
+        .read = &uart_read,
         .lseek = NULL,
         .stat = NULL,
         .link = NULL,
         .unlink = NULL,
-        .rename = NULL
+        .rename = NULL,
+        .poll_select = &uart_poll_select,
+        .start_select = &uart_start_select,
+        .end_select = &uart_end_select,
     };
     ESP_ERROR_CHECK(esp_vfs_register("/dev/uart", &vfs, NULL));
 }
+
+static void uart_set_use_driver(int uart_num, bool use_driver)
+{
+    assert(uart_num >= 0 && uart_num < 3);
+    _lock_acquire_recursive(&s_uart_read_locks[uart_num]);
+    _lock_acquire_recursive(&s_uart_locks[uart_num]);
+    s_uart_use_driver[uart_num] = use_driver;
+    _lock_release_recursive(&s_uart_locks[uart_num]);
+    _lock_release_recursive(&s_uart_read_locks[uart_num]);
+}
+
+void esp_vfs_dev_uart_use_driver(int uart_num)
+{
+    uart_set_use_driver(uart_num, true);
+}
+
+void esp_vfs_dev_uart_use_fifo(int uart_num)
+{
+    uart_set_use_driver(uart_num, false);
+}